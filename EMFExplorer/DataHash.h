@@ -0,0 +1,218 @@
+#ifndef DATA_HASH_H
+#define DATA_HASH_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace data_access
+{
+
+// 64-bit content hash (XXH64), used to identify payloads such as embedded
+// images or nested metafiles independently of where they are stored.
+// https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+class Hash64
+{
+public:
+	explicit Hash64(uint64_t nSeed = 0)
+	{
+		Reset(nSeed);
+	}
+public:
+	void Reset(uint64_t nSeed = 0)
+	{
+		m_v[0] = nSeed + P1 + P2;
+		m_v[1] = nSeed + P2;
+		m_v[2] = nSeed;
+		m_v[3] = nSeed - P1;
+		m_nSeed = nSeed;
+		m_nTotalSize = 0;
+		m_nBufSize = 0;
+	}
+
+	void Update(const void* pData, size_t nSize)
+	{
+		auto p = (const uint8_t*)pData;
+		auto pEnd = p + nSize;
+		m_nTotalSize += nSize;
+		if (m_nBufSize + nSize < StripeSize)
+		{
+			if (nSize)
+				memcpy(m_buf + m_nBufSize, p, nSize);
+			m_nBufSize += nSize;
+			return;
+		}
+		if (m_nBufSize)
+		{
+			size_t nFill = StripeSize - m_nBufSize;
+			memcpy(m_buf + m_nBufSize, p, nFill);
+			p += nFill;
+			ProcessStripe(m_buf);
+			m_nBufSize = 0;
+		}
+		for (; p + StripeSize <= pEnd; p += StripeSize)
+			ProcessStripe(p);
+		if (p < pEnd)
+		{
+			m_nBufSize = (size_t)(pEnd - p);
+			memcpy(m_buf, p, m_nBufSize);
+		}
+	}
+
+	template <typename ValT>
+	inline void UpdateValue(const ValT& val)
+	{
+		Update(&val, sizeof(val));
+	}
+
+	uint64_t Digest() const
+	{
+		uint64_t h;
+		if (m_nTotalSize >= StripeSize)
+		{
+			h = Rotl(m_v[0], 1) + Rotl(m_v[1], 7) + Rotl(m_v[2], 12) + Rotl(m_v[3], 18);
+			for (auto v : m_v)
+				h = (h ^ Round(0, v)) * P1 + P4;
+		}
+		else
+			h = m_nSeed + P5;
+		h += m_nTotalSize;
+
+		const uint8_t* p = m_buf;
+		const uint8_t* pEnd = m_buf + m_nBufSize;
+		for (; p + 8 <= pEnd; p += 8)
+		{
+			h ^= Round(0, Read64(p));
+			h = Rotl(h, 27) * P1 + P4;
+		}
+		if (p + 4 <= pEnd)
+		{
+			h ^= (uint64_t)Read32(p) * P1;
+			h = Rotl(h, 23) * P2 + P3;
+			p += 4;
+		}
+		for (; p < pEnd; ++p)
+		{
+			h ^= (uint64_t)*p * P5;
+			h = Rotl(h, 11) * P1;
+		}
+
+		h ^= h >> 33;
+		h *= P2;
+		h ^= h >> 29;
+		h *= P3;
+		h ^= h >> 32;
+		return h;
+	}
+private:
+	static constexpr uint64_t P1 = 0x9E3779B185EBCA87ULL;
+	static constexpr uint64_t P2 = 0xC2B2AE3D27D4EB4FULL;
+	static constexpr uint64_t P3 = 0x165667B19E3779F9ULL;
+	static constexpr uint64_t P4 = 0x85EBCA77C2B2AE63ULL;
+	static constexpr uint64_t P5 = 0x27D4EB2F165667C5ULL;
+
+	enum : size_t { StripeSize = 32 };
+
+	static inline uint64_t Rotl(uint64_t x, int r)
+	{
+		return (x << r) | (x >> (64 - r));
+	}
+	static inline uint64_t Read64(const uint8_t* p)
+	{
+		uint64_t val;
+		memcpy(&val, p, sizeof(val));
+		return val;
+	}
+	static inline uint32_t Read32(const uint8_t* p)
+	{
+		uint32_t val;
+		memcpy(&val, p, sizeof(val));
+		return val;
+	}
+	static inline uint64_t Round(uint64_t acc, uint64_t input)
+	{
+		acc += input * P2;
+		acc = Rotl(acc, 31);
+		return acc * P1;
+	}
+	inline void ProcessStripe(const uint8_t* p)
+	{
+		m_v[0] = Round(m_v[0], Read64(p));
+		m_v[1] = Round(m_v[1], Read64(p + 8));
+		m_v[2] = Round(m_v[2], Read64(p + 16));
+		m_v[3] = Round(m_v[3], Read64(p + 24));
+	}
+private:
+	uint64_t	m_v[4];
+	uint64_t	m_nSeed;
+	uint64_t	m_nTotalSize;
+	uint8_t		m_buf[StripeSize];
+	size_t		m_nBufSize;
+};
+
+inline uint64_t GetHash64(const void* pData, size_t nSize, uint64_t nSeed = 0)
+{
+	Hash64 hash(nSeed);
+	hash.Update(pData, nSize);
+	return hash.Digest();
+}
+
+// Polynomial hash of a sequence of 64-bit values (e.g. the hashes of
+// consecutive records), modulo 2^64. A window of fixed length can be slid
+// one value at a time, and with prefix values (the hash of the first i
+// values, for every i) any range is hashed in O(1). A window and the range
+// holding the same values hash the same.
+class RollingHash64
+{
+public:
+	static constexpr uint64_t Base = 0x9E3779B97F4A7C15ULL;	// odd, so invertible
+
+	explicit RollingHash64(size_t nWindow = 1)
+		: m_nOutFactor(Power(nWindow ? nWindow - 1 : 0))
+	{
+	}
+public:
+	inline void Reset() { m_nHash = 0; }
+
+	// Appends a value, while filling the window
+	inline void Push(uint64_t nVal) { m_nHash = m_nHash * Base + nVal; }
+
+	// Slides the full window by one: nOut (the oldest value) leaves, nIn enters
+	inline void Roll(uint64_t nOut, uint64_t nIn) { m_nHash = (m_nHash - nOut * m_nOutFactor) * Base + nIn; }
+
+	inline uint64_t Digest() const { return m_nHash; }
+
+	static uint64_t Power(size_t n)
+	{
+		uint64_t nRet = 1, nBase = Base;
+		for (; n; n >>= 1, nBase *= nBase)
+		{
+			if (n & 1)
+				nRet *= nBase;
+		}
+		return nRet;
+	}
+
+	// pPrefix[i] is the hash of the first i values (pPrefix[0] is 0)
+	static inline uint64_t GetRange(const uint64_t* pPrefix, size_t nFirst, size_t nCount)
+	{
+		return pPrefix[nFirst + nCount] - pPrefix[nFirst] * Power(nCount);
+	}
+private:
+	uint64_t	m_nHash = 0;
+	uint64_t	m_nOutFactor;	// Base^(window - 1)
+};
+
+// 16 lowercase hex digits, suitable for file names
+inline std::wstring Hash64ToString(uint64_t nHash)
+{
+	static const wchar_t aDigits[] = L"0123456789abcdef";
+	std::wstring str(16, L'0');
+	for (int ii = 15; ii >= 0; --ii, nHash >>= 4)
+		str[ii] = aDigits[nHash & 0xF];
+	return str;
+}
+
+}
+
+#endif // DATA_HASH_H
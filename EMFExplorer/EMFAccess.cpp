@@ -1,6 +1,7 @@
 #include "pch.h"
 #include "framework.h"
 #include "EMFAccess.h"
+#include "EMFTrace.h"
 
 #include <atlbase.h>
 #include <Shlwapi.h>
@@ -58,6 +59,7 @@ EMFAccessBase::~EMFAccessBase()
 
 void EMFAccessBase::DrawMetafile(Gdiplus::Graphics& gg, const CRect& rcDraw) const
 {
+	EMF_TRACE_SCOPE("DrawMetafile", "render");
 	ASSERT(m_pMetafile.get());
 	Gdiplus::Rect rcDrawP(rcDraw.left, rcDraw.top, rcDraw.Width(), rcDraw.Height());
 	gg.DrawImage(m_pMetafile.get(), rcDrawP);
@@ -84,6 +86,7 @@ BOOL CALLBACK EnumDrawMetafilePlusProc(Gdiplus::EmfPlusRecordType type, UINT fla
 
 void EMFAccessBase::DrawMetafileUntilRecord(Gdiplus::Graphics& gg, const CRect& rcDraw, size_t nRecord) const
 {
+	EMF_TRACE_SCOPE_INDEX("DrawMetafileUntilRecord", "render", nRecord);
 	ASSERT(m_pMetafile.get());
 	Gdiplus::Rect rcDrawP(rcDraw.left, rcDraw.top, rcDraw.Width(), rcDraw.Height());
 	EnumDrawEmfPlusContext ctxt{ m_pMetafile.get(), &gg, nRecord };
@@ -97,11 +100,42 @@ Gdiplus::Image* EMFAccessBase::CloneMetafile() const
 }
 
 #ifndef SHARED_HANDLERS
+bool ReadFileData(LPCWSTR szPath, emfplus::memory_vector& data)
+{
+	EMF_TRACE_SCOPE("ReadFileData", "load");
+	HANDLE hFile = CreateFileW(szPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER nSize;
+	bool bRet = GetFileSizeEx(hFile, &nSize) && nSize.QuadPart <= MAXDWORD;
+	if (bRet)
+	{
+		data.resize((size_t)nSize.QuadPart);
+		DWORD nRead = 0;
+		bRet = ReadFile(hFile, data.data(), (DWORD)data.size(), &nRead, nullptr) && nRead == data.size();
+	}
+	CloseHandle(hFile);
+	return bRet;
+}
+
 using namespace emfplus;
 
 #include "EMFRecAccessGDI.h"
 #include "EMFRecAccessPlus.h"
 #include "EMFRecAccessWMF.h"
+#include "DataHash.h"
+#include "EMFRecordIndex.h"
+#include "EMFMemoryUsage.h"
+
+EMFAccess::EMFAccess(const void* pData, size_t nSize)
+	: EMFAccessBase(pData, nSize)
+{
+	if (wmf::IsWmfData(pData, nSize))
+	{
+		m_vWmfData.assign((const u8t*)pData, (const u8t*)pData + nSize);
+		m_wmfReader.Open(m_vWmfData.data(), m_vWmfData.size());
+	}
+}
 
 EMFAccess::EMFAccess(const emfplus::memory_vector& data)
 	: EMFAccess(data.data(), data.size())
@@ -110,6 +144,7 @@ EMFAccess::EMFAccess(const emfplus::memory_vector& data)
 
 EMFAccess::~EMFAccess()
 {
+	CancelRecords();
 	FreeRecords();
 }
 
@@ -132,15 +167,221 @@ BOOL CALLBACK EnumMetafilePlusProc(Gdiplus::EmfPlusRecordType type, UINT flags,
 
 bool EMFAccess::GetRecords()
 {
-	if (!m_EMFRecords.empty())
-		return true;
+	if (m_thRecords.joinable())
+		return WaitRecords();
+	if (IsRecordsComplete())
+		return m_bRecordsValid;
+	EMF_TRACE_SCOPE("GetRecords", "load");
+	m_bRecordsValid = ReadRecords(m_pMetafile.get());
+	PublishRecords(true);
+	return m_bRecordsValid;
+}
+
+void EMFAccess::StartGetRecords(RecordsProgress fnProgress)
+{
+	{
+		// Completion is stored before the callbacks are taken, so a late
+		// caller either sees it or is called when done
+		std::lock_guard<std::mutex> lock(m_mtxRecordsProgress);
+		if (m_thRecords.joinable() || IsRecordsComplete())
+		{
+			bool bDone = IsRecordsComplete();
+			if (fnProgress)
+			{
+				fnProgress(GetRecordCount(), bDone);
+				if (!bDone)
+					m_vRecordsProgress.push_back(std::move(fnProgress));
+			}
+			return;
+		}
+		if (fnProgress)
+			m_vRecordsProgress.push_back(std::move(fnProgress));
+	}
+	m_bCancelRecords = false;
+	// GDI+ objects can't be used by two threads at once, the records are
+	// enumerated from a copy while the document is drawn
+	std::shared_ptr<Gdiplus::Metafile> pMetafile;
+	if (!IsWmf())
+		pMetafile.reset((Gdiplus::Metafile*)m_pMetafile->Clone());
+	m_thRecords = std::thread([this, pMetafile]()
+		{
+			EMF_TRACE_SCOPE("GetRecords", "load");
+			m_bRecordsValid = ReadRecords(pMetafile.get());
+			PublishRecords(true);
+		});
+}
+
+bool EMFAccess::WaitRecords()
+{
+	if (m_thRecords.joinable())
+		m_thRecords.join();
+	return m_bRecordsValid;
+}
+
+void EMFAccess::CancelRecords()
+{
+	m_bCancelRecords = true;
+	WaitRecords();
+}
+
+bool EMFAccess::ReadRecords(Gdiplus::Metafile* pMetafile)
+{
+	if (IsWmf())
+	{
+		m_bPublishRecords = true;
+		return GetWmfRecords();
+	}
+	m_checksum.Reset();
+	m_bChecksumKnown = true;
+	if (m_pRecordIndex)
+	{
+		// Nothing is published until the records are all read from the
+		// index, they're freed if it turns out not to have them
+		m_bPublishRecords = false;
+		if (GetIndexedRecords())
+		{
+			CacheRecordHashes();
+			return true;
+		}
+		// Whatever was replayed is enumerated again
+		FreeRecords();
+		m_checksum.Reset();
+		m_bChecksumKnown = true;
+	}
+	m_bPublishRecords = true;
 	CDC dcMem;
 	dcMem.CreateCompatibleDC(nullptr);
 	Gdiplus::Graphics gg(dcMem.GetSafeHdc());
 	Gdiplus::Point pt(0, 0);
-	EnumEmfPlusContext ctxt{ m_pMetafile.get(), &gg, this };
-	auto sts = gg.EnumerateMetafile(m_pMetafile.get(), pt, EnumMetafilePlusProc, (void*)&ctxt);
-	return sts == Gdiplus::Ok;
+	EnumEmfPlusContext ctxt{ pMetafile, &gg, this };
+	auto sts = gg.EnumerateMetafile(pMetafile, pt, EnumMetafilePlusProc, (void*)&ctxt);
+	if (sts != Gdiplus::Ok)
+		return false;
+	if (m_pRecordIndex)
+		AddRecordsToIndex();
+	CacheRecordHashes();
+	return true;
+}
+
+void EMFAccess::PublishRecords(bool bDone)
+{
+	m_EMFRecords.Publish();
+	if (bDone)
+		m_bRecordsComplete.store(true, std::memory_order_release);
+	auto nTick = GetTickCount64();
+	if (!bDone && nTick - m_nRecordsProgressTick < RecordsProgressInterval)
+		return;
+	m_nRecordsProgressTick = nTick;
+	std::vector<RecordsProgress> vProgress;
+	{
+		std::lock_guard<std::mutex> lock(m_mtxRecordsProgress);
+		if (bDone)
+			vProgress.swap(m_vRecordsProgress);
+		else
+			vProgress = m_vRecordsProgress;
+	}
+	for (auto& fnProgress : vProgress)
+		fnProgress(m_EMFRecords.GetWrittenCount(), bDone);
+}
+
+void EMFAccess::SetRecordIndex(std::shared_ptr<EMFRecordIndex> pIndex, size_t nDocOffset, size_t nDocSize)
+{
+	m_pRecordIndex = std::move(pIndex);
+	m_nIndexDocOffset = nDocOffset;
+	m_nIndexDocSize = nDocSize;
+}
+
+bool EMFAccess::GetIndexedRecords()
+{
+	EMF_TRACE_SCOPE("GetIndexedRecords", "load");
+	// The records are handled exactly as enumerated, only the playback
+	// needed to enumerate them is saved
+	return m_pRecordIndex->ReadRecords(m_nIndexDocOffset, m_nIndexDocSize,
+		[this](const emfindex::OIndexRecord& rec, const u8t* pData)
+		{
+			return HandleEMFRecord((OEmfPlusRecordType)rec.Type, rec.Flags, rec.DataSize, pData);
+		});
+}
+
+void EMFAccess::AddRecordsToIndex()
+{
+	std::vector<emfindex::ORecordRef> vRecs;
+	vRecs.reserve(m_EMFRecords.GetWrittenCount());
+	for (size_t ii = 0; ii < m_EMFRecords.GetWrittenCount(); ++ii)
+	{
+		auto pRec = m_EMFRecords[ii];
+		auto& recInfo = pRec->GetRecInfo();
+		vRecs.push_back({ (u32t)pRec->GetRecordType(), recInfo.Flags, recInfo.Data, recInfo.DataSize });
+	}
+	// Not being able to write the index only means the next opening is slow
+	m_pRecordIndex->WriteRecords(m_nIndexDocOffset, m_nIndexDocSize, vRecs);
+}
+
+bool EMFAccess::GetWmfRecords()
+{
+	EMF_TRACE_SCOPE("GetWmfRecords", "load");
+	// Drawing until a record and hit testing take the records GDI+
+	// enumerates to be these ones, the headers aside, in the same order:
+	// EnumHitTestMetafilePlusProc checks it in debug builds
+	m_wmfReader.Rewind();
+	wmf::OWmfRecordRef rec;
+	while (m_wmfReader.Next(rec))
+	{
+		auto type = (OEmfPlusRecordType)(GDIP_WMF_RECORD_BASE | rec.Function);
+		if (!HandleEMFRecord(type, 0, (UINT)rec.nParamSize, rec.pParams))
+			return false;
+		m_EMFRecords[m_EMFRecords.GetWrittenCount() - 1]->m_nFileOffset = rec.nOffset;
+	}
+	if (m_wmfReader.IsTruncated())
+		return false;
+	CacheRecordHashes();
+	return true;
+}
+
+void EMFAccess::CacheRecordHashes()
+{
+	EMF_TRACE_SCOPE("CacheRecordHashes", "decode");
+	data_access::Hash64 hash;
+	data_access::RollingHash64 rolling;
+	m_vRangeHashPrefix.resize(m_EMFRecords.GetWrittenCount() + 1);
+	m_vRangeHashPrefix[0] = 0;
+	for (size_t ii = 0; ii < m_EMFRecords.GetWrittenCount(); ++ii)
+	{
+		auto nHash = m_EMFRecords[ii]->GetContentHash();
+		hash.UpdateValue(nHash);
+		rolling.Push(nHash);
+		m_vRangeHashPrefix[ii + 1] = rolling.Digest();
+	}
+	m_nFingerprint = hash.Digest();
+}
+
+uint64_t EMFAccess::GetRangeHash(size_t nFirst, size_t nCount) const
+{
+	if (nFirst > GetRecordCount() || nCount > GetRecordCount() - nFirst || m_vRangeHashPrefix.empty())
+	{
+		ASSERT(0);
+		return 0;
+	}
+	return data_access::RollingHash64::GetRange(m_vRangeHashPrefix.data(), nFirst, nCount);
+}
+
+void EMFAccess::ReportMemoryUsage(EMFMemoryUsage& usage) const
+{
+	// GDI+ keeps its own copy of the bytes
+	usage.Add(EMFMemoryUsage::CategoryMetafile, sizeof(*this) + m_hdr.Size + m_vWmfData.capacity());
+	usage.Add(EMFMemoryUsage::CategoryRecords, m_EMFRecords.GetMemorySize()
+		+ m_vRangeHashPrefix.capacity() * sizeof(uint64_t)
+		+ m_vGDIObjTable.capacity() * sizeof(EMFGDIObjInfo) + m_vPlusObjTable.capacity() * sizeof(EMFPlusObjInfo)
+		+ m_strNestedPath.capacity() * sizeof(wchar_t));
+	for (size_t ii = 0; ii < GetRecordCount(); ++ii)
+		m_EMFRecords[ii]->ReportMemoryUsage(usage);
+}
+
+void EMFAccess::EnableRecordCache(size_t nBudget)
+{
+	if (!m_pRecordCache)
+		m_pRecordCache = std::make_unique<EMFRecordCache>();
+	m_pRecordCache->SetMemoryBudget(nBudget);
 }
 
 struct EnumHitTestEmfPlusContext
@@ -178,6 +419,10 @@ BOOL CALLBACK EnumHitTestMetafilePlusProc(Gdiplus::EmfPlusRecordType type, UINT
 {
 	auto& ctxt = *(EnumHitTestEmfPlusContext*)pCallbackData;
 	auto pRec = ctxt.pAccess->GetRecord(ctxt.nCurRecIdx);
+	// Records read natively (WMF) must be those GDI+ enumerates
+	ASSERT(pRec && pRec->GetRecordType() == (OEmfPlusRecordType)type);
+	if (!pRec)
+		return FALSE;
 #ifndef DEBUG_HITTEST_BITMAP
 	bool bDrawRec = pRec->IsDrawingRecord();
 	if (bDrawRec)
@@ -205,7 +450,8 @@ BOOL CALLBACK EnumHitTestMetafilePlusProc(Gdiplus::EmfPlusRecordType type, UINT
 
 EMFRecAccess* EMFAccess::HitTest(const POINT& pos, unsigned tolerance) const
 {
-	if (m_EMFRecords.empty() || !m_nDrawRecCount)
+	EMF_TRACE_SCOPE("HitTest", "hittest");
+	if (!IsRecordsComplete() || !m_nDrawRecCount)
 		return nullptr;
 	POINT ptImg = pos;
 	ptImg.x += m_hdr.X;
@@ -297,23 +543,48 @@ EMFRecAccess* EMFAccess::HitTest(const POINT& pos, unsigned tolerance) const
 
 void EMFAccess::FreeRecords()
 {
-	for (auto pRec : m_EMFRecords)
+	if (m_pRecordCache)
+		m_pRecordCache->Clear();
+	for (size_t ii = 0; ii < m_EMFRecords.GetWrittenCount(); ++ii)
 	{
-		delete pRec;
+		delete m_EMFRecords[ii];
 	}
-	m_EMFRecords.clear();
+	m_EMFRecords.Clear();
+	m_bRecordsComplete = false;
+	m_bRecordsValid = false;
+	m_vRangeHashPrefix.clear();
+	m_nFingerprint = 0;
 	m_vPlusObjTable.clear();
+	m_vGDIState.clear();
+	m_vGDIObjTable.clear();
+	m_vPlusState.clear();
+	m_PlusRecObjReader = {};
 	m_nDrawRecCount = 0;
 }
 
 bool EMFAccess::HandleEMFRecord(OEmfPlusRecordType type, UINT flags, UINT dataSize, const BYTE* data)
 {
+	if (m_bCancelRecords.load(std::memory_order_relaxed))
+		return false;
+	auto nIndex = m_EMFRecords.GetWrittenCount();
+	// The records before this one are complete, offset included, once it's
+	// handled; its links to them are added under EMFRecAccess's lock
+	if (m_bPublishRecords && nIndex && !(nIndex % RecordsPublishInterval))
+		PublishRecords(false);
+	EMF_TRACE_SCOPE_INDEX("HandleEMFRecord", "decode", nIndex);
 	OEmfPlusRecInfo rec;
 	rec.Type = (u16t)type;
 	rec.Flags = (u16t)flags;
 	rec.Size = sizeof(OEmfPlusRec) + dataSize;
 	rec.DataSize = dataSize;
 	rec.Data = (u8t*)data;
+	if (type >= EmfRecordTypeMin && type <= EmfRecordTypeMax)
+		m_checksum.AddRecord((u32t)type, data, dataSize);
+	else if (type >= EmfPlusRecordTypeMin && type <= EmfPlusRecordTypeMax)
+	{
+		// The comments carrying the EMF+ records aren't enumerated as such
+		m_bChecksumKnown = false;
+	}
 	EMFRecAccess* pRecAccess = nullptr;
 	switch (type)
 	{
@@ -985,9 +1256,14 @@ bool EMFAccess::HandleEMFRecord(OEmfPlusRecordType type, UINT flags, UINT dataSi
 		return false;
 	}
 	pRecAccess->SetRecInfo(rec);
-	pRecAccess->SetIndex(m_EMFRecords.size());
-	pRecAccess->Preprocess(this);
-	m_EMFRecords.push_back(pRecAccess);
+	pRecAccess->CacheHashes();
+	pRecAccess->SetIndex(nIndex);
+	pRecAccess->m_pOwner = this;
+	{
+		EMF_TRACE_SCOPE_INDEX("Preprocess", "link", nIndex);
+		pRecAccess->Preprocess(this);
+	}
+	m_EMFRecords.Push(pRecAccess);
 
 	switch (type)
 	{
@@ -29,27 +29,109 @@ CRect GetFitRect(const CRect& rcDest, const SIZE& szSrc, bool bCenter = false, f
 #ifndef SHARED_HANDLERS
 #include "DataAccess.h"
 #include "EMFRecAccess.h"
+#include "WmfReader.h"
+#include "EmfEmbedded.h"
+#include "PublishedArray.h"
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <thread>
+
+// Whole file read at once, the metafiles are parsed from memory
+bool ReadFileData(LPCWSTR szPath, emfplus::memory_vector& data);
+
+class EMFRecordIndex;
+class EMFMemoryUsage;
 
 class EMFAccess : public EMFAccessBase
 {
 public:
-	using EMFAccessBase::EMFAccessBase;
-
+	EMFAccess(const void* pData, size_t nSize);
 	EMFAccess(const emfplus::memory_vector& data);
 	~EMFAccess();
 public:
-	inline size_t GetRecordCount() const { return m_EMFRecords.size(); }
+	// While the records are read in the background, the ones read so far:
+	// those can be used from any thread, the count only grows
+	inline size_t GetRecordCount() const { return m_EMFRecords.GetCount(); }
 
 	inline EMFRecAccess* GetRecord(size_t index) const
 	{
-		if (index >= m_EMFRecords.size())
+		if (index >= m_EMFRecords.GetCount())
 			return nullptr;
 		return m_EMFRecords[index];
 	}
 
+	// Reads all the records, or waits for StartGetRecords to be done
 	bool GetRecords();
 
+	// Called from the thread reading the records, with how many can be used
+	// so far, at most every RecordsProgressInterval ms and once when done
+	using RecordsProgress = std::function<void(size_t nCount, bool bDone)>;
+
+	enum : size_t {
+		RecordsPublishInterval = 256,
+		RecordsProgressInterval = 30,
+	};
+
+	// Reads the records on a thread of their own, making them available by
+	// RecordsPublishInterval as they're read. The linked records, checksum
+	// and hashes are only complete once IsRecordsComplete(). Callers while
+	// they're being read get the count so far, then the same progress as
+	// the first one.
+	void StartGetRecords(RecordsProgress fnProgress = nullptr);
+
+	// Whether the reading of the records is over, successful or not
+	inline bool IsRecordsComplete() const { return m_bRecordsComplete.load(std::memory_order_acquire); }
+
+	// Waits for the records being read by StartGetRecords, if any
+	bool WaitRecords();
+
+	// Stops reading the records in the background, those read so far are kept
+	void CancelRecords();
+
+	// The records are read from the index when it has them (the document is
+	// nDocSize bytes at nDocOffset in the indexed file), and added to it
+	// otherwise. Not used for WMF, which is read natively anyway.
+	void SetRecordIndex(std::shared_ptr<EMFRecordIndex> pIndex, size_t nDocOffset, size_t nDocSize);
+
+	// WMF documents keep their bytes, the records are read from them
+	// natively rather than through GDI+
+	inline bool IsWmf() const { return !m_vWmfData.empty(); }
+
+	// Whether all the DWORDs of the EMF add up to 0, i.e. the WMF embedded by
+	// EMR_COMMENT_WINDOWS_METAFILE is still what the EMF shows. It's worked
+	// out while the records are read, and only known for plain EMF.
+	inline bool IsChecksumKnown() const { return IsRecordsComplete() && m_bChecksumKnown; }
+	inline bool IsChecksumValid() const { return IsChecksumKnown() && m_checksum.IsValid(); }
+
+	// Hash of the whole record stream, from the content hashes of the
+	// records. This and GetRangeHash need IsRecordsComplete().
+	inline uint64_t GetFingerprint() const { return m_nFingerprint; }
+
+	// Rolling hash (data_access::RollingHash64) of the content hashes of
+	// nCount records from nFirst, in O(1). Equal ranges hash the same
+	// wherever they are, in this metafile or another.
+	uint64_t GetRangeHash(size_t nFirst, size_t nCount) const;
+
+	// Adds the document and its records to usage. The records must not be
+	// read or freed meanwhile.
+	void ReportMemoryUsage(EMFMemoryUsage& usage) const;
+
+	// Bounds what the records build on demand (property trees, decoded
+	// images) to about nBudget bytes, the least recently used being dropped
+	// first; 0 only tracks them. Without it, they're kept until the records
+	// are freed. The cache is used by the thread the document is shown from,
+	// which may enable it while the records are read in the background: the
+	// records reach it through their document once they're published.
+	void EnableRecordCache(size_t nBudget = EMFRecordCache::DefaultMemoryBudget);
+	inline const EMFRecordCache* GetRecordCache() const { return m_pRecordCache.get(); }
+
+	// Placeable and META_HEADER details, only meaningful if IsWmf()
+	inline const wmf::WmfReader& GetWmfReader() const { return m_wmfReader; }
+
+	// Not while the records are read in the background
 	void FreeRecords();
 
 	bool HandleEMFRecord(emfplus::OEmfPlusRecordType type, UINT flags, UINT dataSize, const BYTE* data);
@@ -85,13 +167,56 @@ public:
 	EMFRecAccess* HitTest(const POINT& pos, unsigned tolerance = 3) const;
 private:
 	bool PopPlusState(uint32_t nStackIndex, bool bContainer);
+
+	bool ReadRecords(Gdiplus::Metafile* pMetafile);
+
+	void PublishRecords(bool bDone);
+
+	bool GetWmfRecords();
+
+	bool GetIndexedRecords();
+
+	void AddRecordsToIndex();
+
+	void CacheRecordHashes();
 protected:
-	using EmfRecArray	= std::vector<EMFRecAccess*>;
+	friend class EMFRecAccess;
+	using EmfRecArray	= PublishedArray<EMFRecAccess*>;
 	
 	EmfRecArray			m_EMFRecords;
+	std::atomic<bool>	m_bRecordsComplete = false;
+	// Reading the records in the background
+	std::thread			m_thRecords;
+	std::atomic<bool>	m_bCancelRecords = false;
+	bool				m_bRecordsValid = false;
+	bool				m_bPublishRecords = false;
+	// Of every caller of StartGetRecords, until the records are read
+	std::mutex					m_mtxRecordsProgress;
+	std::vector<RecordsProgress>	m_vRecordsProgress;
+	ULONGLONG			m_nRecordsProgressTick = 0;
 	size_t				m_nDrawRecCount = 0;
 	std::wstring		m_strNestedPath;
 
+	emfplus::memory_vector	m_vWmfData;
+	wmf::WmfReader			m_wmfReader;
+
+	emfembed::EmfChecksum	m_checksum;
+	bool					m_bChecksumKnown = false;
+
+	uint64_t				m_nFingerprint = 0;
+	// Rolling hash of the first i records, for every i
+	std::vector<uint64_t>	m_vRangeHashPrefix;
+
+	std::shared_ptr<EMFRecordIndex>	m_pRecordIndex;
+	size_t					m_nIndexDocOffset = 0;
+	size_t					m_nIndexDocSize = 0;
+
+	std::unique_ptr<EMFRecordCache>	m_pRecordCache;
+
+	// The records read so far are used while the next ones are, and those
+	// add themselves to the links of the former (EMFRecAccess::AddLinkRecord)
+	mutable std::shared_mutex	m_mtxLinks;
+
 	//////////////////////////////
 	// GDI
 	//////////////////////////////
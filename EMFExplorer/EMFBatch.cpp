@@ -0,0 +1,1187 @@
+#include "pch.h"
+#include "framework.h"
+#include "EMFBatch.h"
+#include "EMFExplorerDoc.h"
+#include "EMFImageExtractor.h"
+#include "EMFRecordDiff.h"
+#include "EMFBenchmark.h"
+#include "EMFMemoryUsage.h"
+#include "EMFNestedCache.h"
+#include "EMFPlaybackProfiler.h"
+#include "EMFPosterExport.h"
+#include "EmfSvg.h"
+#include "EmfPdf.h"
+#include "EMFRecordBisect.h"
+#include "EMFGoldenCompare.h"
+#include "EMFRegression.h"
+#include "EmfCompact.h"
+#include "EMFTrace.h"
+
+#undef min
+#undef max
+
+using BatchCommand = CEMFBatchCommandLineInfo::BatchCommand;
+
+static constexpr UINT _CommandMask(std::initializer_list<BatchCommand> aCommands)
+{
+	UINT nMask = 0;
+	for (auto nCmd : aCommands)
+		nMask |= 1u << (UINT)nCmd;
+	return nMask;
+}
+
+// The commands using each of the options shared by several, which are
+// rejected with any other rather than ignored. The options of /Generate
+// and /Bisect are parsed on their own.
+static const struct
+{
+	LPCTSTR		szName;
+	UINT		nCommands;
+} s_aOptions[] = {
+	{ _T("Out"), _CommandMask({ BatchCommand::ExtractImages, BatchCommand::Bench, BatchCommand::Generate,
+		BatchCommand::Profile, BatchCommand::Poster, BatchCommand::Svg, BatchCommand::Pdf, BatchCommand::Bisect,
+		BatchCommand::Compare, BatchCommand::Regress, BatchCommand::Compact }) },
+	{ _T("Threads"), _CommandMask({ BatchCommand::ExtractImages, BatchCommand::Poster, BatchCommand::Pdf,
+		BatchCommand::Compare, BatchCommand::Regress }) },
+	{ _T("MaxFields"), _CommandMask({ BatchCommand::Diff }) },
+	{ _T("MinTime"), _CommandMask({ BatchCommand::Bench }) },
+	{ _T("Top"), _CommandMask({ BatchCommand::Memory, BatchCommand::Profile }) },
+	{ _T("Properties"), _CommandMask({ BatchCommand::Memory }) },
+	{ _T("Budget"), _CommandMask({ BatchCommand::Memory }) },
+	{ _T("Repeat"), _CommandMask({ BatchCommand::Profile }) },
+	{ _T("Dpi"), _CommandMask({ BatchCommand::Poster }) },
+	{ _T("Band"), _CommandMask({ BatchCommand::Poster }) },
+	{ _T("Alpha"), _CommandMask({ BatchCommand::Poster }) },
+	{ _T("Tolerance"), _CommandMask({ BatchCommand::Bisect, BatchCommand::Compare, BatchCommand::Regress }) },
+	{ _T("Ssim"), _CommandMask({ BatchCommand::Compare, BatchCommand::Regress }) },
+	{ _T("Golden"), _CommandMask({ BatchCommand::Regress }) },
+	{ _T("Widths"), _CommandMask({ BatchCommand::Regress }) },
+	{ _T("Update"), _CommandMask({ BatchCommand::Regress }) },
+	{ _T("Shard"), _CommandMask({ BatchCommand::Regress }) },
+	{ _T("Timings"), _CommandMask({ BatchCommand::Regress }) },
+};
+
+void CEMFBatchCommandLineInfo::ParseParam(const TCHAR* pszParam, BOOL bFlag, BOOL bLast)
+{
+	if (bFlag && _tcsnicmp(pszParam, _T("Trace:"), 6) == 0)
+	{
+		m_strTrace = pszParam + 6;
+	#ifndef ENABLE_EMF_TRACE
+		m_strError = _T("Tracing isn't built in, see ENABLE_EMF_TRACE");
+	#endif // ENABLE_EMF_TRACE
+		if (bLast && !IsBatchCommand())
+			CCommandLineInfo::ParseLast(bLast);
+		return;
+	}
+	if (bFlag && _tcsicmp(pszParam, _T("ExtractImages")) == 0)
+	{
+		m_nBatchCmd = BatchCommand::ExtractImages;
+		return;
+	}
+	if (bFlag && _tcsicmp(pszParam, _T("Diff")) == 0)
+	{
+		m_nBatchCmd = BatchCommand::Diff;
+		return;
+	}
+	if (bFlag && _tcsicmp(pszParam, _T("Bench")) == 0)
+	{
+		m_nBatchCmd = BatchCommand::Bench;
+		return;
+	}
+	if (bFlag && _tcsicmp(pszParam, _T("Generate")) == 0)
+	{
+		m_nBatchCmd = BatchCommand::Generate;
+		return;
+	}
+	if (bFlag && _tcsicmp(pszParam, _T("Memory")) == 0)
+	{
+		m_nBatchCmd = BatchCommand::Memory;
+		return;
+	}
+	if (bFlag && _tcsicmp(pszParam, _T("Profile")) == 0)
+	{
+		m_nBatchCmd = BatchCommand::Profile;
+		return;
+	}
+	if (bFlag && _tcsicmp(pszParam, _T("Poster")) == 0)
+	{
+		m_nBatchCmd = BatchCommand::Poster;
+		return;
+	}
+	if (bFlag && _tcsicmp(pszParam, _T("Svg")) == 0)
+	{
+		m_nBatchCmd = BatchCommand::Svg;
+		return;
+	}
+	if (bFlag && _tcsicmp(pszParam, _T("Pdf")) == 0)
+	{
+		m_nBatchCmd = BatchCommand::Pdf;
+		return;
+	}
+	if (bFlag && _tcsicmp(pszParam, _T("Bisect")) == 0)
+	{
+		m_nBatchCmd = BatchCommand::Bisect;
+		return;
+	}
+	if (bFlag && _tcsicmp(pszParam, _T("Compare")) == 0)
+	{
+		m_nBatchCmd = BatchCommand::Compare;
+		return;
+	}
+	if (bFlag && _tcsicmp(pszParam, _T("Regress")) == 0)
+	{
+		m_nBatchCmd = BatchCommand::Regress;
+		return;
+	}
+	if (bFlag && _tcsicmp(pszParam, _T("Compact")) == 0)
+	{
+		m_nBatchCmd = BatchCommand::Compact;
+		return;
+	}
+	if (!IsBatchCommand())
+	{
+		CCommandLineInfo::ParseParam(pszParam, bFlag, bLast);
+		return;
+	}
+	if (!bFlag)
+	{
+		m_vInputs.push_back(pszParam);
+		return;
+	}
+	// Options are given as /Name:Value
+	CString strParam(pszParam);
+	int nColon = strParam.Find(_T(':'));
+	CString strName = nColon < 0 ? strParam : strParam.Left(nColon);
+	CString strValue = nColon < 0 ? CString() : strParam.Mid(nColon + 1);
+	for (auto& option : s_aOptions)
+	{
+		if (strName.CompareNoCase(option.szName) == 0 && !(option.nCommands & _CommandMask({ m_nBatchCmd })))
+		{
+			m_strError.Format(_T("/%s isn't an option of this command"), (LPCTSTR)strName);
+			return;
+		}
+	}
+	if (strName.CompareNoCase(_T("Out")) == 0)
+		m_strOutput = strValue;
+	else if (strName.CompareNoCase(_T("Threads")) == 0)
+		m_nThreads = (unsigned)_tcstoul(strValue, nullptr, 10);
+	else if (strName.CompareNoCase(_T("MaxFields")) == 0)
+		m_nMaxFields = (size_t)_tcstoul(strValue, nullptr, 10);
+	else if (strName.CompareNoCase(_T("MinTime")) == 0)
+		m_fMinTime = _tcstod(strValue, nullptr);
+	else if (strName.CompareNoCase(_T("Top")) == 0)
+		m_nTop = (size_t)_tcstoul(strValue, nullptr, 10);
+	else if (strName.CompareNoCase(_T("Properties")) == 0)
+		m_bProperties = true;
+	else if (strName.CompareNoCase(_T("Budget")) == 0)
+		m_nCacheBudget = (int)_tcstoul(strValue, nullptr, 10);
+	else if (strName.CompareNoCase(_T("Repeat")) == 0)
+		m_nRepeat = (unsigned)_tcstoul(strValue, nullptr, 10);
+	else if (strName.CompareNoCase(_T("Dpi")) == 0)
+		m_fDpi = _tcstod(strValue, nullptr);
+	else if (strName.CompareNoCase(_T("Band")) == 0)
+		m_nBandRows = (unsigned)_tcstoul(strValue, nullptr, 10);
+	else if (strName.CompareNoCase(_T("Alpha")) == 0)
+		m_bAlpha = true;
+	else if (strName.CompareNoCase(_T("Tolerance")) == 0)
+		m_nTolerance = (UINT)_tcstoul(strValue, nullptr, 10);
+	else if (strName.CompareNoCase(_T("Ssim")) == 0)
+		m_bSsim = true;
+	else if (strName.CompareNoCase(_T("Golden")) == 0)
+		m_strGoldenDir = strValue;
+	else if (strName.CompareNoCase(_T("Widths")) == 0)
+	{
+		m_vWidths.clear();
+		int nPos = 0;
+		for (CString strWidth = strValue.Tokenize(_T(","), nPos); nPos >= 0; strWidth = strValue.Tokenize(_T(","), nPos))
+			m_vWidths.push_back((UINT)_tcstoul(strWidth, nullptr, 10));
+	}
+	else if (strName.CompareNoCase(_T("Update")) == 0)
+		m_bUpdate = true;
+	else if (strName.CompareNoCase(_T("Shard")) == 0)
+	{
+		// <index>/<count>
+		int nSlash = strValue.Find(_T('/'));
+		m_nShard = (UINT)_tcstoul(strValue.Left(nSlash), nullptr, 10);
+		m_nShards = nSlash < 0 ? 0 : (UINT)_tcstoul(strValue.Mid(nSlash + 1), nullptr, 10);
+	}
+	else if (strName.CompareNoCase(_T("Timings")) == 0)
+		m_strTimings = strValue;
+	else if (m_nBatchCmd == BatchCommand::Bisect)
+	{
+		if (!ParseBisectOption(strName, strValue))
+			m_strError.Format(_T("Unknown option /%s"), (LPCTSTR)strParam);
+	}
+	else if (m_nBatchCmd != BatchCommand::Generate || !ParseGenerateOption(strName, strValue))
+		m_strError.Format(_T("Unknown option /%s"), (LPCTSTR)strParam);
+}
+
+bool CEMFBatchCommandLineInfo::ParseGenerateOption(const CString& strName, const CString& strValue)
+{
+	auto& options = m_genOptions;
+	auto nValue = _tcstoui64(strValue, nullptr, 10);
+	if (strName.CompareNoCase(_T("Format")) == 0)
+	{
+		const std::pair<LPCTSTR, emfgen::OFormat> aFormats[] = {
+			{ _T("Emf"), emfgen::OFormat::Emf },
+			{ _T("EmfPlus"), emfgen::OFormat::EmfPlusDual },
+			{ _T("EmfPlusOnly"), emfgen::OFormat::EmfPlusOnly },
+			{ _T("Wmf"), emfgen::OFormat::Wmf },
+		};
+		for (auto& [szName, nFormat] : aFormats)
+		{
+			if (strValue.CompareNoCase(szName) == 0)
+			{
+				options.Format = nFormat;
+				return true;
+			}
+		}
+		return false;
+	}
+	if (strName.CompareNoCase(_T("Mix")) == 0)
+	{
+		// Weights of shapes, lines, paths, state, transforms, objects
+		emfgen::u32t* aWeights[] = { &options.Mix.Shapes, &options.Mix.Lines, &options.Mix.Paths,
+			&options.Mix.State, &options.Mix.Transforms, &options.Mix.Objects };
+		int nPos = 0;
+		for (auto pWeight : aWeights)
+		{
+			CString strWeight = strValue.Tokenize(_T(","), nPos);
+			if (nPos < 0)
+				return false;
+			*pWeight = (emfgen::u32t)_tcstoul(strWeight, nullptr, 10);
+		}
+		return true;
+	}
+	if (strName.CompareNoCase(_T("Size")) == 0)
+	{
+		// <width>x<height>
+		int nX = strValue.FindOneOf(_T("xX"));
+		if (nX < 0)
+			return false;
+		options.Width = _ttoi(strValue.Left(nX));
+		options.Height = _ttoi(strValue.Mid(nX + 1));
+		return true;
+	}
+	if (strName.CompareNoCase(_T("Seed")) == 0)
+		options.Seed = nValue;
+	else if (strName.CompareNoCase(_T("Operations")) == 0)
+		options.Operations = (size_t)nValue;
+	else if (strName.CompareNoCase(_T("Points")) == 0)
+		options.MaxPoints = (emfgen::u32t)nValue;
+	else if (strName.CompareNoCase(_T("Slots")) == 0)
+		options.ObjectSlots = (emfgen::u32t)nValue;
+	else if (strName.CompareNoCase(_T("Depth")) == 0)
+		options.MaxDepth = (emfgen::u32t)nValue;
+	else if (strName.CompareNoCase(_T("ContinuedObjects")) == 0)
+		options.ContinuedObjects = (size_t)nValue;
+	else if (strName.CompareNoCase(_T("ContinuedSize")) == 0)
+		options.ContinuedObjectSize = (emfgen::u32t)nValue;
+	else if (strName.CompareNoCase(_T("Images")) == 0)
+		options.Images = (size_t)nValue;
+	else if (strName.CompareNoCase(_T("ImageSize")) == 0)
+		options.ImageSize = (emfgen::u32t)nValue;
+	else if (strName.CompareNoCase(_T("Metafiles")) == 0)
+		options.Metafiles = (size_t)nValue;
+	else
+		return false;
+	return true;
+}
+
+bool CEMFBatchCommandLineInfo::ParseBisectOption(const CString& strName, const CString& strValue)
+{
+	auto& options = m_bisectOptions;
+	// Comma separated numbers, all of them given
+	auto ParseList = [&strValue](std::initializer_list<UINT*> aValues)
+	{
+		int nPos = 0;
+		for (auto pValue : aValues)
+		{
+			CString strItem = strValue.Tokenize(_T(","), nPos);
+			if (nPos < 0)
+				return false;
+			*pValue = (UINT)_tcstoul(strItem, nullptr, 10);
+		}
+		return true;
+	};
+	if (strName.CompareNoCase(_T("Pixel")) == 0)
+		return options.bPixel = ParseList({ &options.x, &options.y });
+	if (strName.CompareNoCase(_T("Region")) == 0)
+		return options.bRegion = ParseList({ &options.x, &options.y, &options.nWidth, &options.nHeight });
+	if (strName.CompareNoCase(_T("Color")) == 0)
+		options.clrRef = (DWORD)_tcstoul(strValue, nullptr, 16);
+	else if (strName.CompareNoCase(_T("Reference")) == 0)
+		options.strReference = strValue;
+	else if (strName.CompareNoCase(_T("Probes")) == 0)
+		options.nProbes = (size_t)_tcstoul(strValue, nullptr, 10);
+	else if (strName.CompareNoCase(_T("MaxSize")) == 0)
+		options.nMaxSize = (UINT)_tcstoul(strValue, nullptr, 10);
+	else
+		return false;
+	return true;
+}
+
+static void AttachParentConsole()
+{
+	// The application is a GUI one, so there's no console unless it was started from one
+	if (!AttachConsole(ATTACH_PARENT_PROCESS))
+		return;
+	FILE* fp = nullptr;
+	_wfreopen_s(&fp, L"CONOUT$", L"w", stdout);
+	_wfreopen_s(&fp, L"CONOUT$", L"w", stderr);
+}
+
+static void PrintUsage()
+{
+	fwprintf(stderr,
+		L"Usage:\n"
+		L"  EMFExplorer.exe /ExtractImages /Out:<dir> [/Threads:<n>] <file or directory>...\n"
+		L"      Writes every embedded image to <dir>, named by content hash, and\n"
+		L"      <dir>\\manifest.csv linking the records to the images.\n"
+		L"  EMFExplorer.exe /Diff [/MaxFields:<n>] <file A> <file B>\n"
+		L"      Lists the records deleted (-), inserted (+) and modified (~) from A to B,\n"
+		L"      with up to <n> changed properties per modified record (20 by default).\n"
+		L"      Exits with 0 when the records are the same, 3 when they differ.\n"
+		L"  EMFExplorer.exe /Bench [/Out:<json>] [/MinTime:<seconds>] <file>...\n"
+		L"      Times the parsing of the records of the files, each benchmark running\n"
+		L"      for at least <seconds> (0.5 by default). The results are written to\n"
+		L"      <json> (or the console) in the JSON format of Google Benchmark.\n"
+		L"  EMFExplorer.exe /Generate /Out:<file> [/Format:Emf|EmfPlus|EmfPlusOnly|Wmf]\n"
+		L"      [/Seed:<n>] [/Operations:<n>] [/Mix:<shapes>,<lines>,<paths>,<state>,<transforms>,<objects>]\n"
+		L"      [/Points:<n>] [/Slots:<n>] [/Depth:<n>] [/Size:<width>x<height>]\n"
+		L"      [/ContinuedObjects:<n>] [/ContinuedSize:<bytes>] [/Images:<n>] [/ImageSize:<pixels>]\n"
+		L"      [/Metafiles:<n>]\n"
+		L"      Writes a synthetic metafile of <n> operations (EMF+ dual by default),\n"
+		L"      the same one for the same options and seed.\n"
+		L"  EMFExplorer.exe /Memory [/Top:<n>] [/Properties] [/Budget:<MB>] <file>...\n"
+		L"      Reports the memory held by each document by category, and its <n>\n"
+		L"      record types holding the most (20 by default). With /Properties, the\n"
+		L"      properties of every record are cached first, as if all were viewed.\n"
+		L"      With /Budget, the caches of the records are bounded to <MB> as in the\n"
+		L"      application, and their hits, misses and evictions are reported.\n"
+		L"  EMFExplorer.exe /Profile [/Repeat:<n>] [/Top:<n>] [/Out:<folded>] <file>\n"
+		L"      Plays the file <n> times (5 by default) with GDI+, timing every record,\n"
+		L"      and lists the <n> records costing the most (20 by default). With /Out,\n"
+		L"      the mean time of every record is written to <folded> as folded stacks\n"
+		L"      for flame graphs.\n"
+		L"  EMFExplorer.exe /Poster /Out:<png> [/Dpi:<n>] [/Band:<rows>] [/Threads:<n>] [/Alpha] <file>\n"
+		L"      Renders the file at <n> DPI (300 by default) to <png>, <rows> at a time\n"
+		L"      (about 16MB of pixels by default) so that any size fits in memory.\n"
+		L"      With /Alpha, the background is left transparent rather than white.\n"
+		L"  EMFExplorer.exe /Svg /Out:<svg> <file>\n"
+		L"      Converts the EMF (with its EMF+ records) to <svg>, a record at a time\n"
+		L"      as read from the file, without loading it.\n"
+		L"  EMFExplorer.exe /Pdf /Out:<pdf> [/Threads:<n>] <file>\n"
+		L"      Converts the EMF (with its EMF+ records) to a one page <pdf>, a record\n"
+		L"      at a time, the page content compressed on <n> threads (one per core by\n"
+		L"      default).\n"
+		L"  EMFExplorer.exe /Bisect (/Pixel:<x>,<y> [/Color:<aarrggbb> | /Reference:<image>]\n"
+		L"      | /Region:<x>,<y>,<w>,<h>) [/Tolerance:<n>] [/Probes:<n>] [/MaxSize:<n>] [/Out:<png>] <file>\n"
+		L"      Finds the first record after which pixel (x, y) differs from <aarrggbb>\n"
+		L"      (white by default) or from the same pixel of <image>, a rendering of\n"
+		L"      the same size, or after which the region isn't white any more. A pixel\n"
+		L"      differs when a channel is more than <n> away (0 by default). The file\n"
+		L"      is played with GDI+ at most <n> pixels a side (2048 by default), up to\n"
+		L"      <n> records tested per playback (16 by default). With /Out, the\n"
+		L"      rendering up to that record is written to <png>.\n"
+		L"      Exits with 0 when the record is found, 3 when it isn't.\n"
+		L"  EMFExplorer.exe /Compare [/Tolerance:<n>] [/Ssim] [/Out:<dir>] [/Threads:<n>] <rendered> <golden>\n"
+		L"      Compares every .png below the <golden> directory with the image of the\n"
+		L"      same path below <rendered> (or two image files), <n> files at a time\n"
+		L"      (one per core by default), and lists those which differ: how many\n"
+		L"      pixels have a channel more than <n> away (0 by default), the largest\n"
+		L"      difference of each channel and, with /Ssim, the mean SSIM. With /Out,\n"
+		L"      a heatmap of each one which differs is written below <dir>.\n"
+		L"      Exits with 0 when all are within the tolerance, 3 otherwise.\n"
+		L"  EMFExplorer.exe /Regress /Golden:<dir> [/Widths:<w>,...] [/Tolerance:<n>] [/Ssim] [/Out:<dir>]\n"
+		L"      [/Update] [/Shard:<i>/<n>] [/Threads:<n>] [/Timings:<csv>] <manifest>\n"
+		L"      Parses and draws every metafile of <manifest> at each width (256 and\n"
+		L"      1024 by default), and compares the renderings to the goldens\n"
+		L"      <dir>\\<name>.<w>.png as /Compare does. The manifest lists a metafile a\n"
+		L"      line, a path relative to the manifest or \"generate <name> [/<option>...]\"\n"
+		L"      with the options of /Generate, '#' starting comments. With /Out, the\n"
+		L"      renderings which differ and their heatmaps are written below <dir>;\n"
+		L"      with /Update, the goldens which differ or are missing are written.\n"
+		L"      /Shard checks the <i>th of every <n> metafiles (from 0), for runs on\n"
+		L"      several machines. /Timings writes the time taken to parse and to\n"
+		L"      draw each metafile to <csv>.\n"
+		L"      Exits with 0 when all pass, 3 otherwise.\n"
+		L"  EMFExplorer.exe /Compact /Out:<emf> <file>\n"
+		L"      Writes the EMF to <emf> with its 32-bit POLY* records as their 16-bit\n"
+		L"      counterparts and the points of its EMF+ records as 16-bit or relative\n"
+		L"      ones, wherever no coordinate changes. The records written are decoded\n"
+		L"      again and checked against those of the file first.\n"
+		L"      Exits with 0 when it's written, 3 when a record doesn't check.\n");
+}
+
+static int RunExtractImages(const CEMFBatchCommandLineInfo& cmdInfo)
+{
+	if (cmdInfo.m_strOutput.IsEmpty() || cmdInfo.m_vInputs.empty())
+	{
+		PrintUsage();
+		return 1;
+	}
+	EMFImageExtractor extractor(cmdInfo.m_strOutput, cmdInfo.m_nThreads);
+	for (auto& strInput : cmdInfo.m_vInputs)
+	{
+		if (!extractor.AddPath(strInput))
+			fwprintf(stderr, L"Cannot read %s\n", (LPCWSTR)strInput);
+	}
+	extractor.Wait();
+	CString strManifest = cmdInfo.m_strOutput + _T("\\manifest.csv");
+	if (!extractor.WriteManifest(strManifest))
+	{
+		fwprintf(stderr, L"Cannot write %s\n", (LPCWSTR)strManifest);
+		return 2;
+	}
+	auto stats = extractor.GetStats();
+	fwprintf(stdout, L"%zu metafile(s), %zu image reference(s), %zu unique image(s) written, %zu failure(s)\n",
+		stats.nFiles, stats.nReferences, stats.nWritten, stats.nFailed);
+	return stats.nFailed ? 2 : 0;
+}
+
+static std::unique_ptr<EMFAccess> LoadMetafile(LPCWSTR szPath)
+{
+	emfplus::memory_vector data;
+	if (!ReadFileData(szPath, data) || data.empty())
+		return nullptr;
+	auto emf = std::make_unique<EMFAccess>(data);
+	if (!emf->GetRecords())
+		return nullptr;
+	return emf;
+}
+
+static void PrintRecord(wchar_t chEdit, LPCWSTR szSide, const EMFAccess* pEMF, size_t nIndex)
+{
+	auto pRec = pEMF->GetRecord(nIndex);
+	fwprintf(stdout, L"%c %s#%zu %s\n", chEdit, szSide, nIndex + 1, pRec->GetRecordName());
+}
+
+static int RunDiff(const CEMFBatchCommandLineInfo& cmdInfo)
+{
+	if (cmdInfo.m_vInputs.size() != 2)
+	{
+		PrintUsage();
+		return 1;
+	}
+	std::unique_ptr<EMFAccess> emf[2];
+	for (size_t ii = 0; ii < 2; ++ii)
+	{
+		emf[ii] = LoadMetafile(cmdInfo.m_vInputs[ii]);
+		if (!emf[ii])
+		{
+			fwprintf(stderr, L"Cannot read %s\n", (LPCWSTR)cmdInfo.m_vInputs[ii]);
+			return 2;
+		}
+	}
+	EMFRecordDiff diff(emf[0].get(), emf[1].get());
+	diff.Compare();
+	for (auto& run : diff.GetRuns())
+	{
+		for (size_t ii = 0; ii < run.nCount; ++ii)
+		{
+			switch (run.Type)
+			{
+			case emfdiff::OEditType::Delete:
+				PrintRecord(L'-', L"A", emf[0].get(), run.nIndexA + ii);
+				break;
+			case emfdiff::OEditType::Insert:
+				PrintRecord(L'+', L"B", emf[1].get(), run.nIndexB + ii);
+				break;
+			case emfdiff::OEditType::Modify:
+				{
+					size_t nIndexA = run.nIndexA + ii, nIndexB = run.nIndexB + ii;
+					fwprintf(stdout, L"~ A#%zu B#%zu %s\n", nIndexA + 1, nIndexB + 1,
+						emf[0]->GetRecord(nIndexA)->GetRecordName());
+					if (!cmdInfo.m_nMaxFields)
+						break;
+					auto vFields = diff.GetFieldDiffs(nIndexA, nIndexB);
+					size_t nCount = std::min(vFields.size(), cmdInfo.m_nMaxFields);
+					for (size_t jj = 0; jj < nCount; ++jj)
+					{
+						auto& field = vFields[jj];
+						fwprintf(stdout, L"    %s: %s -> %s\n", field.strPath.c_str(),
+							field.strA.empty() ? L"(none)" : field.strA.c_str(),
+							field.strB.empty() ? L"(none)" : field.strB.c_str());
+					}
+					if (vFields.size() > nCount)
+						fwprintf(stdout, L"    ... %zu more\n", vFields.size() - nCount);
+				}
+				break;
+			default:
+				break;
+			}
+		}
+	}
+	auto stats = diff.GetStats();
+	fwprintf(stdout, L"%zu equal, %zu deleted, %zu inserted, %zu modified record(s)\n",
+		stats.nEqual, stats.nDeleted, stats.nInserted, stats.nModified);
+	return stats.nDeleted || stats.nInserted || stats.nModified ? 3 : 0;
+}
+
+static int RunBench(const CEMFBatchCommandLineInfo& cmdInfo)
+{
+	if (cmdInfo.m_vInputs.empty() || cmdInfo.m_fMinTime < 0)
+	{
+		PrintUsage();
+		return 1;
+	}
+	EMFBenchmark bench(cmdInfo.m_fMinTime);
+	bench.AddStructs();
+	for (auto& strInput : cmdInfo.m_vInputs)
+	{
+		if (!bench.AddFile(strInput))
+		{
+			fwprintf(stderr, L"Cannot read %s\n", (LPCWSTR)strInput);
+			return 2;
+		}
+	}
+	LPCWSTR szOut = cmdInfo.m_strOutput.IsEmpty() ? nullptr : (LPCWSTR)cmdInfo.m_strOutput;
+	if (!bench.WriteJson(szOut))
+	{
+		fwprintf(stderr, L"Cannot write %s\n", szOut);
+		return 2;
+	}
+	return 0;
+}
+
+static int RunGenerate(const CEMFBatchCommandLineInfo& cmdInfo)
+{
+	if (cmdInfo.m_strOutput.IsEmpty() || !cmdInfo.m_vInputs.empty())
+	{
+		PrintUsage();
+		return 1;
+	}
+	emfplus::memory_vector data;
+	if (!emfgen::GenerateMetafile(cmdInfo.m_genOptions, data))
+	{
+		fwprintf(stderr, L"Invalid generation options\n");
+		return 1;
+	}
+	FILE* fp = nullptr;
+	if (_wfopen_s(&fp, cmdInfo.m_strOutput, L"wb") != 0 || !fp)
+	{
+		fwprintf(stderr, L"Cannot write %s\n", (LPCWSTR)cmdInfo.m_strOutput);
+		return 2;
+	}
+	bool bRet = fwrite(data.data(), 1, data.size(), fp) == data.size();
+	bRet = fclose(fp) == 0 && bRet;
+	if (!bRet)
+	{
+		fwprintf(stderr, L"Cannot write %s\n", (LPCWSTR)cmdInfo.m_strOutput);
+		return 2;
+	}
+	fwprintf(stdout, L"%zu byte(s) written\n", data.size());
+	return 0;
+}
+
+static int RunMemory(const CEMFBatchCommandLineInfo& cmdInfo)
+{
+	if (cmdInfo.m_vInputs.empty())
+	{
+		PrintUsage();
+		return 1;
+	}
+	EMFMemoryUsage total;
+	for (auto& strInput : cmdInfo.m_vInputs)
+	{
+		auto emf = LoadMetafile(strInput);
+		if (!emf)
+		{
+			fwprintf(stderr, L"Cannot read %s\n", (LPCWSTR)strInput);
+			return 2;
+		}
+		if (cmdInfo.m_nCacheBudget >= 0)
+			emf->EnableRecordCache((size_t)cmdInfo.m_nCacheBudget * 1024 * 1024);
+		if (cmdInfo.m_bProperties)
+		{
+			CachePropertiesContext ctxt{ emf.get() };
+			for (size_t ii = 0; ii < emf->GetRecordCount(); ++ii)
+				emf->GetRecord(ii)->GetProperties(ctxt);
+		}
+		EMFMemoryUsage usage;
+		emf->ReportMemoryUsage(usage);
+		fwprintf(stdout, L"%s\n%s\n", (LPCWSTR)strInput, usage.FormatReport(cmdInfo.m_nTop).c_str());
+		if (auto pCache = emf->GetRecordCache())
+		{
+			for (int nKind = 0; nKind < EMFRecordCache::CacheKindCount; ++nKind)
+			{
+				auto stats = pCache->GetStats((EMFRecordCache::CacheKind)nKind);
+				fwprintf(stdout, L"Record cache, %s: %zu entries, %zu bytes, %zu hit(s), %zu miss(es), %zu eviction(s)\n",
+					EMFRecordCache::GetKindName((EMFRecordCache::CacheKind)nKind), stats.nEntries, stats.nMemory,
+					stats.nHits, stats.nMisses, stats.nEvictions);
+			}
+		}
+		total.Merge(usage);
+	}
+	if (cmdInfo.m_vInputs.size() > 1)
+		fwprintf(stdout, L"All documents\n%s\n", total.FormatReport(cmdInfo.m_nTop).c_str());
+	EMFMemoryUsage nested;
+	EMFNestedCache::Instance().ReportMemoryUsage(nested);
+	fwprintf(stdout, L"Nested metafile cache: %zu bytes\n", nested.GetTotal());
+	return 0;
+}
+
+static int RunProfile(const CEMFBatchCommandLineInfo& cmdInfo)
+{
+	if (cmdInfo.m_vInputs.size() != 1 || !cmdInfo.m_nRepeat)
+	{
+		PrintUsage();
+		return 1;
+	}
+	auto& strInput = cmdInfo.m_vInputs[0];
+	auto emf = LoadMetafile(strInput);
+	if (!emf)
+	{
+		fwprintf(stderr, L"Cannot read %s\n", (LPCWSTR)strInput);
+		return 2;
+	}
+	EMFPlaybackProfiler profiler(EMFPlaybackProfiler::CreateGdiplusBackend());
+	if (!profiler.Profile(*emf, cmdInfo.m_nRepeat))
+	{
+		fwprintf(stderr, L"Cannot play %s\n", (LPCWSTR)strInput);
+		return 2;
+	}
+	fwprintf(stdout, L"%s\n%s", (LPCWSTR)strInput, profiler.FormatTable(*emf, cmdInfo.m_nTop).c_str());
+	if (!cmdInfo.m_strOutput.IsEmpty())
+	{
+		if (!profiler.WriteFoldedStacks(*emf, PathFindFileNameW(strInput), cmdInfo.m_strOutput))
+		{
+			fwprintf(stderr, L"Cannot write %s\n", (LPCWSTR)cmdInfo.m_strOutput);
+			return 2;
+		}
+	}
+	return 0;
+}
+
+static int RunPoster(const CEMFBatchCommandLineInfo& cmdInfo)
+{
+	if (cmdInfo.m_vInputs.size() != 1 || cmdInfo.m_strOutput.IsEmpty() || cmdInfo.m_fDpi <= 0)
+	{
+		PrintUsage();
+		return 1;
+	}
+	auto& strInput = cmdInfo.m_vInputs[0];
+	// Only drawn, the records aren't needed
+	emfplus::memory_vector data;
+	if (!ReadFileData(strInput, data) || data.empty())
+	{
+		fwprintf(stderr, L"Cannot read %s\n", (LPCWSTR)strInput);
+		return 2;
+	}
+	EMFAccessBase emf(data.data(), data.size());
+	EMFPosterExport::Options options;
+	options.fDpi = cmdInfo.m_fDpi;
+	options.nBandRows = cmdInfo.m_nBandRows;
+	options.nThreads = cmdInfo.m_nThreads;
+	options.bAlpha = cmdInfo.m_bAlpha;
+	EMFPosterExport poster(options);
+	if (!poster.Export(emf, cmdInfo.m_strOutput))
+	{
+		fwprintf(stderr, L"Cannot render %s to %s\n", (LPCWSTR)strInput, (LPCWSTR)cmdInfo.m_strOutput);
+		return 2;
+	}
+	auto& stats = poster.GetStats();
+	fwprintf(stdout, L"%u x %u pixels in %zu band(s) of %u rows, %llu bytes written, about %zu MB of bands in memory\n",
+		stats.nWidth, stats.nHeight, stats.nBands, stats.nBandRows, stats.nFileSize, stats.nPeakMemory / (1024 * 1024));
+	return 0;
+}
+
+static int RunSvg(const CEMFBatchCommandLineInfo& cmdInfo)
+{
+	if (cmdInfo.m_vInputs.size() != 1 || cmdInfo.m_strOutput.IsEmpty())
+	{
+		PrintUsage();
+		return 1;
+	}
+	auto& strInput = cmdInfo.m_vInputs[0];
+	FILE* fpIn = nullptr;
+	if (_wfopen_s(&fpIn, strInput, L"rb") || !fpIn)
+	{
+		fwprintf(stderr, L"Cannot read %s\n", (LPCWSTR)strInput);
+		return 2;
+	}
+	FILE* fpOut = nullptr;
+	if (_wfopen_s(&fpOut, cmdInfo.m_strOutput, L"wb") || !fpOut)
+	{
+		fclose(fpIn);
+		fwprintf(stderr, L"Cannot write %s\n", (LPCWSTR)cmdInfo.m_strOutput);
+		return 2;
+	}
+	emfsvg::OSvgWriter writer([fpOut](const void* pData, size_t nSize)
+		{
+			return fwrite(pData, 1, nSize, fpOut) == nSize;
+		});
+	bool bRet = writer.Convert([fpIn](void* pData, size_t nSize)
+		{
+			return fread(pData, 1, nSize, fpIn);
+		});
+	fclose(fpIn);
+	bRet = fclose(fpOut) == 0 && bRet;
+	if (!bRet)
+	{
+		DeleteFileW(cmdInfo.m_strOutput);
+		fwprintf(stderr, L"Cannot convert %s to %s\n", (LPCWSTR)strInput, (LPCWSTR)cmdInfo.m_strOutput);
+		return 2;
+	}
+	auto& stats = writer.GetStats();
+	fwprintf(stdout, L"%zu record(s), %zu element(s), %zu style(s) and def(s) reused %zu time(s), %zu record(s) not converted, %llu bytes written\n",
+		stats.nRecords, stats.nElements, stats.nDefs, stats.nReused, stats.nSkipped, stats.nWritten);
+	return 0;
+}
+
+static int RunCompact(const CEMFBatchCommandLineInfo& cmdInfo)
+{
+	if (cmdInfo.m_vInputs.size() != 1 || cmdInfo.m_strOutput.IsEmpty())
+	{
+		PrintUsage();
+		return 1;
+	}
+	auto& strInput = cmdInfo.m_vInputs[0];
+	emfplus::memory_vector data;
+	if (!ReadFileData(strInput, data) || data.empty())
+	{
+		fwprintf(stderr, L"Cannot read %s\n", (LPCWSTR)strInput);
+		return 2;
+	}
+	emfplus::memory_vector vCompact;
+	emfcompact::CompactStats stats;
+	if (!emfcompact::CompactMetafile(data.data(), data.size(), vCompact, &stats))
+	{
+		fwprintf(stderr, L"Cannot compact %s, it isn't an EMF\n", (LPCWSTR)strInput);
+		return 2;
+	}
+	// Nothing is written unless every record decodes to what it was
+	size_t nRecord = 0;
+	if (!emfcompact::VerifyCompactedMetafile(data.data(), data.size(), vCompact.data(), vCompact.size(), &nRecord))
+	{
+		fwprintf(stderr, L"Record #%zu of %s doesn't decode to the original once compacted\n", nRecord + 1,
+			(LPCWSTR)strInput);
+		return 3;
+	}
+	FILE* fp = nullptr;
+	if (_wfopen_s(&fp, cmdInfo.m_strOutput, L"wb") || !fp)
+	{
+		fwprintf(stderr, L"Cannot write %s\n", (LPCWSTR)cmdInfo.m_strOutput);
+		return 2;
+	}
+	bool bRet = fwrite(vCompact.data(), 1, vCompact.size(), fp) == vCompact.size();
+	bRet = fclose(fp) == 0 && bRet;
+	if (!bRet)
+	{
+		DeleteFileW(cmdInfo.m_strOutput);
+		fwprintf(stderr, L"Cannot write %s\n", (LPCWSTR)cmdInfo.m_strOutput);
+		return 2;
+	}
+	fwprintf(stdout, L"%zu POLY* record(s) and %zu EMF+ record(s) compacted, %zu bytes to %zu\n",
+		stats.nGdiRecords, stats.nPlusRecords, stats.nBytesIn, stats.nBytesOut);
+	return 0;
+}
+
+static int RunPdf(const CEMFBatchCommandLineInfo& cmdInfo)
+{
+	if (cmdInfo.m_vInputs.size() != 1 || cmdInfo.m_strOutput.IsEmpty())
+	{
+		PrintUsage();
+		return 1;
+	}
+	auto& strInput = cmdInfo.m_vInputs[0];
+	FILE* fpIn = nullptr;
+	if (_wfopen_s(&fpIn, strInput, L"rb") || !fpIn)
+	{
+		fwprintf(stderr, L"Cannot read %s\n", (LPCWSTR)strInput);
+		return 2;
+	}
+	FILE* fpOut = nullptr;
+	if (_wfopen_s(&fpOut, cmdInfo.m_strOutput, L"wb") || !fpOut)
+	{
+		fclose(fpIn);
+		fwprintf(stderr, L"Cannot write %s\n", (LPCWSTR)cmdInfo.m_strOutput);
+		return 2;
+	}
+	emfpdf::OPdfWriter writer([fpOut](const void* pData, size_t nSize)
+		{
+			return fwrite(pData, 1, nSize, fpOut) == nSize;
+		}, cmdInfo.m_nThreads);
+	bool bRet = writer.Convert([fpIn](void* pData, size_t nSize)
+		{
+			return fread(pData, 1, nSize, fpIn);
+		});
+	fclose(fpIn);
+	bRet = fclose(fpOut) == 0 && bRet;
+	if (!bRet)
+	{
+		DeleteFileW(cmdInfo.m_strOutput);
+		fwprintf(stderr, L"Cannot convert %s to %s\n", (LPCWSTR)strInput, (LPCWSTR)cmdInfo.m_strOutput);
+		return 2;
+	}
+	auto& stats = writer.GetStats();
+	fwprintf(stdout, L"%zu record(s), %zu element(s), %zu resource(s) reused %zu time(s), %zu record(s) not converted, %llu bytes written\n",
+		stats.nRecords, stats.nElements, stats.nDefs, stats.nReused, stats.nSkipped, stats.nWritten);
+	return 0;
+}
+
+static int RunBisect(const CEMFBatchCommandLineInfo& cmdInfo)
+{
+	auto& options = cmdInfo.m_bisectOptions;
+	if (cmdInfo.m_vInputs.size() != 1 || options.bPixel == options.bRegion || cmdInfo.m_nTolerance > 255
+		|| !options.nMaxSize)
+	{
+		PrintUsage();
+		return 1;
+	}
+	auto& strInput = cmdInfo.m_vInputs[0];
+	auto emf = LoadMetafile(strInput);
+	if (!emf)
+	{
+		fwprintf(stderr, L"Cannot read %s\n", (LPCWSTR)strInput);
+		return 2;
+	}
+	EMFRecordBisect bisect(*emf, options.nMaxSize);
+	auto sz = bisect.GetSize();
+	emfbisect::Predicate pred;
+	if (options.bPixel)
+	{
+		DWORD clrRef = options.clrRef;
+		if (!options.strReference.IsEmpty())
+		{
+			Gdiplus::Bitmap bmpRef(options.strReference);
+			Gdiplus::Color clr;
+			if (bmpRef.GetLastStatus() != Gdiplus::Ok || bmpRef.GetPixel(options.x, options.y, &clr) != Gdiplus::Ok)
+			{
+				fwprintf(stderr, L"Cannot read pixel (%u, %u) of %s\n", options.x, options.y, (LPCWSTR)options.strReference);
+				return 2;
+			}
+			if (bmpRef.GetWidth() != (UINT)sz.cx || bmpRef.GetHeight() != (UINT)sz.cy)
+				fwprintf(stderr, L"%s is %u x %u pixels, the rendering %d x %d\n", (LPCWSTR)options.strReference,
+					bmpRef.GetWidth(), bmpRef.GetHeight(), sz.cx, sz.cy);
+			clrRef = clr.GetValue();
+		}
+		pred = emfbisect::PixelDiffers(options.x, options.y, clrRef, (uint8_t)cmdInfo.m_nTolerance);
+	}
+	else
+		pred = emfbisect::RegionNonEmpty(options.x, options.y, options.nWidth, options.nHeight, 0xFFFFFFFF, (uint8_t)cmdInfo.m_nTolerance);
+	emfbisect::OBisectOptions bisectOptions;
+	bisectOptions.nProbesPerPass = options.nProbes;
+	emfbisect::OBisectResult result;
+	if (!bisect.Bisect(pred, result, bisectOptions))
+	{
+		fwprintf(stderr, L"Cannot play %s\n", (LPCWSTR)strInput);
+		return 2;
+	}
+	fwprintf(stdout, L"%s (%d x %d pixels, %zu records)\n", (LPCWSTR)strInput, sz.cx, sz.cy, emf->GetRecordCount());
+	if (result.bFound)
+	{
+		auto pRec = emf->GetRecord(result.nRecord);
+		fwprintf(stdout, L"#%zu %s\n", result.nRecord + 1, pRec ? pRec->GetRecordName() : L"?");
+	}
+	else
+		fwprintf(stdout, L"Not found, even after the last record\n");
+	fwprintf(stdout, L"%zu playback(s), %zu snapshot(s) tested, %llu record(s) drawn\n",
+		result.nPasses, result.nProbes, (unsigned long long)result.nPlayed);
+	if (result.bFound && !cmdInfo.m_strOutput.IsEmpty())
+	{
+		if (!bisect.WriteSnapshot(result.nRecord, cmdInfo.m_strOutput))
+		{
+			fwprintf(stderr, L"Cannot write %s\n", (LPCWSTR)cmdInfo.m_strOutput);
+			return 2;
+		}
+	}
+	return result.bFound ? 0 : 3;
+}
+
+static int RunCompare(const CEMFBatchCommandLineInfo& cmdInfo)
+{
+	if (cmdInfo.m_vInputs.size() != 2 || cmdInfo.m_nTolerance > 255)
+	{
+		PrintUsage();
+		return 1;
+	}
+	EMFGoldenCompare::Options options;
+	options.compare.nTolerance = (uint8_t)cmdInfo.m_nTolerance;
+	options.compare.bSsim = cmdInfo.m_bSsim;
+	options.strHeatmapDir = cmdInfo.m_strOutput;
+	options.nThreads = cmdInfo.m_nThreads;
+	EMFGoldenCompare compare(options);
+	size_t aCounts[(int)EMFGoldenCompare::Status::Unreadable + 1] = {};
+	size_t nSameFiles = 0;
+	auto fnResult = [&](const EMFGoldenCompare::FileResult& res)
+	{
+		++aCounts[(int)res.nStatus];
+		nSameFiles += res.bSameFile;
+		auto& result = res.result;
+		switch (res.nStatus)
+		{
+		case EMFGoldenCompare::Status::Different:
+			fwprintf(stdout, L"~ %s: %llu pixel(s) differ, up to R %u G %u B %u A %u", res.strName.c_str(),
+				(unsigned long long)result.nMismatched, result.aMaxDelta[2], result.aMaxDelta[1], result.aMaxDelta[0],
+				result.aMaxDelta[3]);
+			if (cmdInfo.m_bSsim)
+				fwprintf(stdout, L", SSIM %.4f", result.fSsim);
+			fwprintf(stdout, L"\n");
+			break;
+		case EMFGoldenCompare::Status::SizeDiffers:
+			fwprintf(stdout, L"! %s: the sizes differ\n", res.strName.c_str());
+			break;
+		case EMFGoldenCompare::Status::Missing:
+			fwprintf(stdout, L"- %s: no rendering\n", res.strName.c_str());
+			break;
+		case EMFGoldenCompare::Status::Unreadable:
+			fwprintf(stdout, L"! %s: cannot decode\n", res.strName.c_str());
+			break;
+		default:
+			break;
+		}
+	};
+	auto& strRendered = cmdInfo.m_vInputs[0];
+	auto& strGolden = cmdInfo.m_vInputs[1];
+	if (PathIsDirectoryW(strGolden))
+	{
+		if (!compare.CompareDirectories(strRendered, strGolden, fnResult))
+		{
+			fwprintf(stderr, L"Cannot read %s\n", (LPCWSTR)strGolden);
+			return 2;
+		}
+	}
+	else
+		fnResult(compare.CompareFiles(strRendered, strGolden, PathFindFileNameW(strGolden)));
+	size_t nTotal = 0;
+	for (auto nCount : aCounts)
+		nTotal += nCount;
+	fwprintf(stdout, L"%zu compared: %zu identical (%zu the same file), %zu within the tolerance, %zu different, "
+		L"%zu of another size, %zu missing, %zu unreadable\n", nTotal,
+		aCounts[(int)EMFGoldenCompare::Status::Identical], nSameFiles, aCounts[(int)EMFGoldenCompare::Status::Within],
+		aCounts[(int)EMFGoldenCompare::Status::Different], aCounts[(int)EMFGoldenCompare::Status::SizeDiffers],
+		aCounts[(int)EMFGoldenCompare::Status::Missing], aCounts[(int)EMFGoldenCompare::Status::Unreadable]);
+	return aCounts[(int)EMFGoldenCompare::Status::Identical] + aCounts[(int)EMFGoldenCompare::Status::Within] == nTotal ? 0 : 3;
+}
+
+// One metafile a line: a path relative to the manifest, or "generate <name>"
+// followed by the options of /Generate
+static bool ReadRegressionManifest(LPCWSTR szPath, UINT nShard, UINT nShards,
+	std::vector<EMFRegression::Entry>& vEntries, CString& strError)
+{
+	emfplus::memory_vector data;
+	if (!ReadFileData(szPath, data))
+	{
+		strError.Format(_T("Cannot read %s"), szPath);
+		return false;
+	}
+	CString strText(CA2W(CStringA((const char*)data.data(), (int)data.size()), CP_UTF8));
+	CString strDir(szPath);
+	PathRemoveFileSpec(strDir.GetBuffer());
+	strDir.ReleaseBuffer();
+	int nPos = 0;
+	size_t nIndex = 0;
+	for (int nLine = 1; nPos >= 0; ++nLine)
+	{
+		// Tokenize would skip the empty lines, and their numbers
+		int nEnd = strText.Find(_T('\n'), nPos);
+		CString strLine = nEnd < 0 ? strText.Mid(nPos) : strText.Mid(nPos, nEnd - nPos);
+		nPos = nEnd < 0 ? -1 : nEnd + 1;
+		int nComment = strLine.Find(_T('#'));
+		if (nComment >= 0)
+			strLine.Truncate(nComment);
+		strLine.Trim();
+		if (strLine.IsEmpty())
+			continue;
+		if (nShards && nIndex++ % nShards != nShard)
+			continue;
+		int nArgs = 0;
+		LPWSTR* pArgs = CommandLineToArgvW(strLine, &nArgs);
+		if (!pArgs)
+			continue;
+		EMFRegression::Entry entry;
+		if (_wcsicmp(pArgs[0], L"generate") != 0)
+		{
+			// Goldens are named after the path from the manifest, or the file name
+			entry.strPath = pArgs[0];
+			std::replace(entry.strPath.begin(), entry.strPath.end(), L'/', L'\\');
+			if (PathIsRelativeW(pArgs[0]))
+			{
+				entry.strName = entry.strPath;
+				entry.strPath = (LPCWSTR)(strDir + _T("\\") + entry.strName.c_str());
+			}
+			else
+				entry.strName = PathFindFileNameW(entry.strPath.c_str());
+			if (nArgs > 1)
+				strError.Format(_T("%s(%d): one path a line"), szPath, nLine);
+		}
+		else if (nArgs < 2)
+			strError.Format(_T("%s(%d): generate <name> [/<option>...]"), szPath, nLine);
+		else
+		{
+			entry.strName = pArgs[1];
+			// The options, as given to /Generate
+			CEMFBatchCommandLineInfo genInfo;
+			genInfo.ParseParam(_T("Generate"), TRUE, FALSE);
+			for (int ii = 2; ii < nArgs && genInfo.m_strError.IsEmpty(); ++ii)
+			{
+				if (pArgs[ii][0] == L'/')
+					genInfo.ParseParam(pArgs[ii] + 1, TRUE, ii + 1 == nArgs);
+				else
+					genInfo.m_strError.Format(_T("Unexpected %s"), pArgs[ii]);
+			}
+			if (genInfo.m_strError.IsEmpty() && !genInfo.m_strOutput.IsEmpty())
+				genInfo.m_strError = _T("/Out isn't an option of generated metafiles");
+			if (!genInfo.m_strError.IsEmpty())
+				strError.Format(_T("%s(%d): %s"), szPath, nLine, (LPCTSTR)genInfo.m_strError);
+			entry.genOptions = genInfo.m_genOptions;
+		}
+		LocalFree(pArgs);
+		if (!strError.IsEmpty())
+			return false;
+		vEntries.push_back(std::move(entry));
+	}
+	return true;
+}
+
+static int RunRegress(const CEMFBatchCommandLineInfo& cmdInfo)
+{
+	if (cmdInfo.m_vInputs.size() != 1 || cmdInfo.m_strGoldenDir.IsEmpty() || cmdInfo.m_vWidths.empty()
+		|| std::count(cmdInfo.m_vWidths.begin(), cmdInfo.m_vWidths.end(), 0u) || cmdInfo.m_nTolerance > 255
+		|| !cmdInfo.m_nShards || cmdInfo.m_nShard >= cmdInfo.m_nShards)
+	{
+		PrintUsage();
+		return 1;
+	}
+	std::vector<EMFRegression::Entry> vEntries;
+	CString strError;
+	if (!ReadRegressionManifest(cmdInfo.m_vInputs[0], cmdInfo.m_nShard, cmdInfo.m_nShards, vEntries, strError))
+	{
+		fwprintf(stderr, L"%s\n", (LPCWSTR)strError);
+		return 2;
+	}
+	EMFRegression::Options options;
+	options.vWidths = cmdInfo.m_vWidths;
+	options.compare.nTolerance = (uint8_t)cmdInfo.m_nTolerance;
+	options.compare.bSsim = cmdInfo.m_bSsim;
+	options.strGoldenDir = cmdInfo.m_strGoldenDir;
+	options.strOutDir = cmdInfo.m_strOutput;
+	options.bUpdate = cmdInfo.m_bUpdate;
+	options.nThreads = cmdInfo.m_nThreads;
+	EMFRegression regression(options);
+	size_t aCounts[(int)EMFRegression::Status::Failed + 1] = {};
+	size_t nFailedFiles = 0;
+	regression.Run(vEntries, [&](const EMFRegression::FileResult& res)
+		{
+			auto szName = res.pEntry->strName.c_str();
+			if (!res.bParsed)
+			{
+				fwprintf(stdout, L"! %s: cannot read the metafile\n", szName);
+				++nFailedFiles;
+				return;
+			}
+			nFailedFiles += !EMFRegression::IsPassed(res);
+			for (auto& render : res.vRenders)
+			{
+				++aCounts[(int)render.nStatus];
+				auto& result = render.result;
+				switch (render.nStatus)
+				{
+				case EMFRegression::Status::Different:
+					fwprintf(stdout, L"~ %s @%u: %llu pixel(s) differ, up to R %u G %u B %u A %u", szName, render.nWidth,
+						(unsigned long long)result.nMismatched, result.aMaxDelta[2], result.aMaxDelta[1],
+						result.aMaxDelta[0], result.aMaxDelta[3]);
+					if (cmdInfo.m_bSsim)
+						fwprintf(stdout, L", SSIM %.4f", result.fSsim);
+					fwprintf(stdout, L"\n");
+					break;
+				case EMFRegression::Status::SizeDiffers:
+					fwprintf(stdout, L"! %s @%u: the golden isn't %u x %u\n", szName, render.nWidth, render.nWidth,
+						render.nHeight);
+					break;
+				case EMFRegression::Status::NoGolden:
+					fwprintf(stdout, L"- %s @%u: no golden\n", szName, render.nWidth);
+					break;
+				case EMFRegression::Status::Written:
+					fwprintf(stdout, L"+ %s @%u: golden written\n", szName, render.nWidth);
+					break;
+				case EMFRegression::Status::Failed:
+					fwprintf(stdout, L"! %s @%u: cannot draw, or read the golden\n", szName, render.nWidth);
+					break;
+				default:
+					break;
+				}
+			}
+		});
+	double fParseTime = 0, fRenderTime = 0;
+	for (auto& res : regression.GetResults())
+	{
+		fParseTime += res.fParseTime;
+		for (auto& render : res.vRenders)
+			fRenderTime += render.fRenderTime;
+	}
+	fwprintf(stdout, L"%zu metafile(s), %zu failed; renderings: %zu identical, %zu within the tolerance, %zu different, "
+		L"%zu of another size, %zu without golden, %zu written, %zu failed; %.3f s parsing, %.3f s drawing\n",
+		vEntries.size(), nFailedFiles, aCounts[(int)EMFRegression::Status::Identical],
+		aCounts[(int)EMFRegression::Status::Within], aCounts[(int)EMFRegression::Status::Different],
+		aCounts[(int)EMFRegression::Status::SizeDiffers], aCounts[(int)EMFRegression::Status::NoGolden],
+		aCounts[(int)EMFRegression::Status::Written], aCounts[(int)EMFRegression::Status::Failed], fParseTime,
+		fRenderTime);
+	if (!cmdInfo.m_strTimings.IsEmpty() && !regression.WriteTimings(cmdInfo.m_strTimings))
+	{
+		fwprintf(stderr, L"Cannot write %s\n", (LPCWSTR)cmdInfo.m_strTimings);
+		return 2;
+	}
+	return nFailedFiles ? 3 : 0;
+}
+
+int RunBatchCommand(const CEMFBatchCommandLineInfo& cmdInfo)
+{
+	AttachParentConsole();
+	if (!cmdInfo.m_strError.IsEmpty())
+	{
+		fwprintf(stderr, L"%s\n", (LPCWSTR)cmdInfo.m_strError);
+		PrintUsage();
+		return 1;
+	}
+	int nRet = 1;
+	GdiplusBegin();
+	switch (cmdInfo.m_nBatchCmd)
+	{
+	case CEMFBatchCommandLineInfo::BatchCommand::ExtractImages:
+		nRet = RunExtractImages(cmdInfo);
+		break;
+	case CEMFBatchCommandLineInfo::BatchCommand::Diff:
+		nRet = RunDiff(cmdInfo);
+		break;
+	case CEMFBatchCommandLineInfo::BatchCommand::Bench:
+		nRet = RunBench(cmdInfo);
+		break;
+	case CEMFBatchCommandLineInfo::BatchCommand::Generate:
+		nRet = RunGenerate(cmdInfo);
+		break;
+	case CEMFBatchCommandLineInfo::BatchCommand::Memory:
+		nRet = RunMemory(cmdInfo);
+		break;
+	case CEMFBatchCommandLineInfo::BatchCommand::Profile:
+		nRet = RunProfile(cmdInfo);
+		break;
+	case CEMFBatchCommandLineInfo::BatchCommand::Poster:
+		nRet = RunPoster(cmdInfo);
+		break;
+	case CEMFBatchCommandLineInfo::BatchCommand::Svg:
+		nRet = RunSvg(cmdInfo);
+		break;
+	case CEMFBatchCommandLineInfo::BatchCommand::Pdf:
+		nRet = RunPdf(cmdInfo);
+		break;
+	case CEMFBatchCommandLineInfo::BatchCommand::Bisect:
+		nRet = RunBisect(cmdInfo);
+		break;
+	case CEMFBatchCommandLineInfo::BatchCommand::Compare:
+		nRet = RunCompare(cmdInfo);
+		break;
+	case CEMFBatchCommandLineInfo::BatchCommand::Regress:
+		nRet = RunRegress(cmdInfo);
+		break;
+	case CEMFBatchCommandLineInfo::BatchCommand::Compact:
+		nRet = RunCompact(cmdInfo);
+		break;
+	}
+	GdiplusEnd();
+	fflush(stdout);
+	fflush(stderr);
+	return nRet;
+}
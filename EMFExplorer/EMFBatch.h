@@ -0,0 +1,98 @@
+#ifndef EMF_BATCH_H
+#define EMF_BATCH_H
+
+#include <vector>
+#include "EmfGenerator.h"
+
+// Command line of the headless batch commands:
+//   EMFExplorer.exe /ExtractImages /Out:<dir> [/Threads:<n>] <file or directory>...
+//   EMFExplorer.exe /Diff [/MaxFields:<n>] <file A> <file B>
+//   EMFExplorer.exe /Bench [/Out:<json>] [/MinTime:<seconds>] <file>...
+//   EMFExplorer.exe /Generate /Out:<file> [/Format:<format>] [/Seed:<n>] [/Operations:<n>] ...
+//   EMFExplorer.exe /Memory [/Top:<n>] [/Properties] [/Budget:<MB>] <file>...
+//   EMFExplorer.exe /Profile [/Repeat:<n>] [/Top:<n>] [/Out:<folded>] <file>
+//   EMFExplorer.exe /Poster /Out:<png> [/Dpi:<n>] [/Band:<rows>] [/Threads:<n>] [/Alpha] <file>
+//   EMFExplorer.exe /Svg /Out:<svg> <file>
+//   EMFExplorer.exe /Pdf /Out:<pdf> [/Threads:<n>] <file>
+//   EMFExplorer.exe /Bisect (/Pixel:<x>,<y> [/Color:<argb> | /Reference:<image>] | /Region:<x>,<y>,<w>,<h>) ...
+//   EMFExplorer.exe /Compare [/Tolerance:<n>] [/Ssim] [/Out:<dir>] [/Threads:<n>] <rendered> <golden>
+//   EMFExplorer.exe /Regress /Golden:<dir> [/Widths:<w>,...] [/Tolerance:<n>] [/Out:<dir>] ... <manifest>
+//   EMFExplorer.exe /Compact /Out:<emf> <file>
+// The command must come first; anything else is left to the standard
+// shell commands. An option the command doesn't use is an error. /Trace:<json> goes with any command line, the batch ones
+// and the standard ones, in builds with ENABLE_EMF_TRACE (see EMFTrace.h).
+class CEMFBatchCommandLineInfo : public CCommandLineInfo
+{
+public:
+	enum class BatchCommand
+	{
+		None,
+		ExtractImages,
+		Diff,
+		Bench,
+		Generate,
+		Memory,
+		Profile,
+		Poster,
+		Svg,
+		Pdf,
+		Bisect,
+		Compare,
+		Regress,
+		Compact,
+	};
+
+	// What /Bisect looks for in the rendering
+	struct BisectOptions
+	{
+		bool		bPixel = false;		// pixel (x, y) differs from clrRef
+		bool		bRegion = false;	// a pixel of the rectangle differs from white
+		UINT		x = 0;
+		UINT		y = 0;
+		UINT		nWidth = 0;
+		UINT		nHeight = 0;
+		DWORD		clrRef = 0xFFFFFFFF;	// 0xAARRGGBB
+		CString		strReference;		// image clrRef is read from
+		size_t		nProbes = 16;
+		UINT		nMaxSize = 2048;
+	};
+
+	void ParseParam(const TCHAR* pszParam, BOOL bFlag, BOOL bLast) override;
+
+	inline bool IsBatchCommand() const { return m_nBatchCmd != BatchCommand::None; }
+public:
+	BatchCommand			m_nBatchCmd = BatchCommand::None;
+	CString					m_strOutput;
+	unsigned				m_nThreads = 0;
+	size_t					m_nMaxFields = 20;
+	double					m_fMinTime = 0.5;
+	emfgen::OGenOptions		m_genOptions;
+	BisectOptions			m_bisectOptions;
+	size_t					m_nTop = 20;
+	bool					m_bProperties = false;
+	int						m_nCacheBudget = -1;	// MB, not bounded if negative
+	unsigned				m_nRepeat = 5;
+	double					m_fDpi = 300;
+	unsigned				m_nBandRows = 0;	// sized by EMFPosterExport if 0
+	bool					m_bAlpha = false;
+	UINT					m_nTolerance = 0;
+	bool					m_bSsim = false;
+	CString					m_strGoldenDir;
+	std::vector<UINT>		m_vWidths = { 256, 1024 };
+	bool					m_bUpdate = false;
+	UINT					m_nShard = 0;
+	UINT					m_nShards = 1;
+	CString					m_strTimings;
+	CString					m_strTrace;
+	std::vector<CString>	m_vInputs;
+	CString					m_strError;
+private:
+	bool ParseGenerateOption(const CString& strName, const CString& strValue);
+	bool ParseBisectOption(const CString& strName, const CString& strValue);
+};
+
+// Runs the batch command with the output sent to the parent console,
+// returns the process exit code.
+int RunBatchCommand(const CEMFBatchCommandLineInfo& cmdInfo);
+
+#endif // EMF_BATCH_H
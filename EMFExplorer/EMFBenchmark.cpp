@@ -0,0 +1,333 @@
+#include "pch.h"
+#include "framework.h"
+#include "EMFBenchmark.h"
+#include "EMFAccess.h"
+#include "EMFStruct2Props.h"
+#include "EMFRecordDisplay.h"
+
+#include <map>
+#include <Shlwapi.h>
+
+#undef min
+#undef max
+
+using namespace data_access;
+
+// Results the compiler must not drop
+static volatile uint64_t s_nSink;
+
+static int64_t GetRealTimeNs()
+{
+	static LARGE_INTEGER s_nFreq = [] { LARGE_INTEGER freq; QueryPerformanceFrequency(&freq); return freq; }();
+	LARGE_INTEGER nCount;
+	QueryPerformanceCounter(&nCount);
+	return (int64_t)((double)nCount.QuadPart * 1e9 / s_nFreq.QuadPart);
+}
+
+static int64_t GetCpuTimeNs()
+{
+	FILETIME ftCreation, ftExit, ftKernel, ftUser;
+	if (!GetThreadTimes(GetCurrentThread(), &ftCreation, &ftExit, &ftKernel, &ftUser))
+		return 0;
+	auto nKernel = ((int64_t)ftKernel.dwHighDateTime << 32) | ftKernel.dwLowDateTime;
+	auto nUser = ((int64_t)ftUser.dwHighDateTime << 32) | ftUser.dwLowDateTime;
+	return (nKernel + nUser) * 100;
+}
+
+void EMFBenchmark::State::PauseTiming()
+{
+	if (!m_nRealStart)
+		return;
+	m_nReal += GetRealTimeNs() - m_nRealStart;
+	m_nCpu += GetCpuTimeNs() - m_nCpuStart;
+	m_nRealStart = 0;
+}
+
+void EMFBenchmark::State::ResumeTiming()
+{
+	if (m_nRealStart)
+		return;
+	m_nCpuStart = GetCpuTimeNs();
+	m_nRealStart = GetRealTimeNs();
+}
+
+EMFBenchmark::EMFBenchmark(double fMinTime)
+	: m_fMinTime(fMinTime)
+{
+}
+
+void EMFBenchmark::Run(const std::wstring& strName, uint64_t nBytes, uint64_t nItems, const BenchFunc& fn)
+{
+	// Iterations are added until the run is long enough, as Google Benchmark does
+	uint64_t nIterations = 1;
+	State state;
+	for (;;)
+	{
+		state = State();
+		for (uint64_t ii = 0; ii < nIterations; ++ii)
+		{
+			state.ResumeTiming();
+			fn(state);
+			state.PauseTiming();
+		}
+		double fSeconds = state.m_nReal / 1e9;
+		if (fSeconds >= m_fMinTime || nIterations >= 1000000000)
+			break;
+		double fScale = fSeconds > 0 ? m_fMinTime * 1.4 / fSeconds : 10.;
+		nIterations = std::max(nIterations + 1, (uint64_t)(nIterations * std::min(fScale, 10.)));
+	}
+	Result result;
+	result.strName = strName;
+	result.nIterations = nIterations;
+	result.fRealTime = (double)state.m_nReal / nIterations;
+	result.fCpuTime = (double)state.m_nCpu / nIterations;
+	double fSeconds = std::max(state.m_nReal, (int64_t)1) / 1e9;
+	result.fBytesPerSecond = nBytes * nIterations / fSeconds;
+	result.fItemsPerSecond = nItems * nIterations / fSeconds;
+	m_vResults.push_back(result);
+}
+
+static LPCWSTR GetObjectTypeName(OObjType type)
+{
+	static const LPCWSTR aText[] = {
+		L"Invalid", L"Brush", L"Pen", L"Path", L"Region", L"Image",
+		L"Font", L"StringFormat", L"ImageAttributes", L"CustomLineCap"
+	};
+	return (size_t)type < _countof(aText) ? aText[(size_t)type] : aText[0];
+}
+
+bool EMFBenchmark::AddFile(LPCWSTR szPath)
+{
+	memory_vector data;
+	if (!ReadFileData(szPath, data) || data.empty())
+		return false;
+	EMFAccess emf(data);
+	if (!emf.GetRecords())
+		return false;
+	std::wstring strFile = L"/";
+	strFile += PathFindFileNameW(szPath);
+
+	//////////////////////////////
+	// DataReader
+	//////////////////////////////
+	Run(L"DataReader/ReadBytes" + strFile, data.size(), data.size() / sizeof(u32t), [&](State&)
+		{
+			DataReader reader(data.data(), data.size());
+			u32t nSum = 0;
+			for (size_t ii = data.size() / sizeof(u32t); ii; --ii)
+			{
+				u32t nVal;
+				reader.ReadBytes(&nVal, sizeof(nVal));
+				nSum += nVal;
+			}
+			s_nSink = nSum;
+		});
+	constexpr size_t ArrayCount = 1024;
+	size_t nArrays = data.size() / (ArrayCount * sizeof(u32t));
+	if (nArrays)
+	{
+		Run(L"DataReader/ReadArray" + strFile, nArrays * ArrayCount * sizeof(u32t), nArrays, [&](State&)
+			{
+				DataReader reader(data.data(), data.size());
+				std::vector<u32t> arr;
+				for (size_t ii = 0; ii < nArrays; ++ii)
+					reader.ReadArray(arr, ArrayCount);
+				s_nSink = arr.back();
+			});
+	}
+
+	//////////////////////////////
+	// Records
+	//////////////////////////////
+	struct RecordData
+	{
+		OEmfPlusRecordType		nType;
+		const OEmfPlusRecInfo*	pInfo;
+	};
+	std::vector<RecordData> vRecs(emf.GetRecordCount());
+	uint64_t nRecBytes = 0;
+	for (size_t ii = 0; ii < vRecs.size(); ++ii)
+	{
+		auto pRec = emf.GetRecord(ii);
+		vRecs[ii] = { pRec->GetRecordType(), &pRec->GetRecInfo() };
+		nRecBytes += pRec->GetRecInfo().DataSize;
+	}
+	Run(L"HandleEMFRecord" + strFile, nRecBytes, vRecs.size(), [&](State& state)
+		{
+			state.PauseTiming();
+			auto emfRun = std::make_unique<EMFAccess>(data);
+			state.ResumeTiming();
+			for (auto& rec : vRecs)
+				emfRun->HandleEMFRecord(rec.nType, rec.pInfo->Flags, rec.pInfo->DataSize, rec.pInfo->Data);
+			state.PauseTiming();
+		});
+	Run(L"GetProperties" + strFile, nRecBytes, vRecs.size(), [&](State& state)
+		{
+			state.PauseTiming();
+			auto emfRun = std::make_unique<EMFAccess>(data);
+			emfRun->GetRecords();
+			state.ResumeTiming();
+			CachePropertiesContext ctxt{ emfRun.get() };
+			for (size_t ii = 0; ii < emfRun->GetRecordCount(); ++ii)
+				emfRun->GetRecord(ii)->GetProperties(ctxt);
+			state.PauseTiming();
+		});
+	// How long the record list waits for its first rows
+	Run(L"StartGetRecords/FirstRows" + strFile, 0, 1, [&](State& state)
+		{
+			state.PauseTiming();
+			auto emfRun = std::make_unique<EMFAccess>(data);
+			state.ResumeTiming();
+			emfRun->StartGetRecords();
+			while (!emfRun->GetRecordCount() && !emfRun->IsRecordsComplete())
+				std::this_thread::yield();
+			state.PauseTiming();
+			emfRun->CancelRecords();
+		});
+
+	//////////////////////////////
+	// Record list
+	//////////////////////////////
+	emfdisplay::ODisplayModel model;
+	Run(L"DisplayModel/Build" + strFile, 0, vRecs.size(), [&](State&)
+		{
+			model = emfdisplay::ODisplayModel();
+			AddRecordDisplayRows(model, emf, vRecs.size());
+		});
+	// What painting every row reads
+	Run(L"DisplayModel/Lookup" + strFile, 0, model.GetRowCount(), [&](State&)
+		{
+			size_t nSum = 0;
+			for (size_t ii = 0; ii < model.GetRowCount(); ++ii)
+			{
+				nSum += model.GetLabelLength(ii) + model.GetRecordType(ii) + model.GetFlags(ii);
+				if (auto szColor = model.GetColorText(ii))
+					nSum += szColor[0];
+			}
+			s_nSink = nSum;
+		});
+
+	//////////////////////////////
+	// EMF+ objects
+	//////////////////////////////
+	std::vector<const OEmfPlusRecInfo*> vObjRecs;
+	std::map<OObjType, std::vector<const OEmfPlusRecInfo*>> mapObjRecs;
+	uint64_t nObjBytes = 0, nObjects = 0;
+	for (auto& rec : vRecs)
+	{
+		if (rec.nType != EmfPlusRecordTypeObject)
+			continue;
+		vObjRecs.push_back(rec.pInfo);
+		nObjBytes += rec.pInfo->DataSize;
+		if (rec.pInfo->Flags & OEmfPlusRecObjectReader::FlagContinueObj)
+			continue;
+		// The last part of a continued object isn't flagged
+		++nObjects;
+		mapObjRecs[OEmfPlusRecObjectReader::GetObjectType(*rec.pInfo)].push_back(rec.pInfo);
+	}
+	for (auto& [nObjType, vTypeRecs] : mapObjRecs)
+	{
+		if (!std::unique_ptr<OEmfPlusGraphObject>(OEmfPlusRecObjectReader::CreateObjectByType(nObjType)))
+			continue;
+		uint64_t nBytes = 0;
+		for (auto pInfo : vTypeRecs)
+			nBytes += pInfo->DataSize;
+		Run(std::wstring(L"PlusObjectRead/") + GetObjectTypeName(nObjType) + strFile, nBytes, vTypeRecs.size(), [&](State&)
+			{
+				for (auto pInfo : vTypeRecs)
+				{
+					std::unique_ptr<OEmfPlusGraphObject> pObj(OEmfPlusRecObjectReader::CreateObjectByType(nObjType));
+					DataReader reader(pInfo->Data, pInfo->DataSize);
+					s_nSink = pObj->Read(reader, pInfo->DataSize);
+				}
+			});
+	}
+	if (!vObjRecs.empty())
+	{
+		// With the continued objects put back together
+		Run(L"PlusObjectReader" + strFile, nObjBytes, nObjects, [&](State&)
+			{
+				OEmfPlusRecObjectReader reader;
+				for (auto pInfo : vObjRecs)
+				{
+					if (reader.Read(*pInfo) == OEmfPlusRecObjectReader::StatusComplete)
+						delete reader.CreateObject();
+				}
+			});
+	}
+	return true;
+}
+
+template <typename ValT>
+static void RunStructBuild(EMFBenchmark& bench, LPCWSTR szName, const ValT& obj)
+{
+	bench.Run(std::wstring(L"EmfStruct2Properties::Build/") + szName, sizeof(ValT), 1, [&](EMFBenchmark::State&)
+		{
+			PropertyNode node;
+			EmfStruct2Properties::Build(obj, &node);
+			s_nSink = node.sub.size();
+		});
+}
+
+void EMFBenchmark::AddStructs()
+{
+	XFORM xform = { 1.f, 0.f, 0.f, 1.f, 0.f, 0.f };
+	RunStructBuild(*this, L"XFORM", xform);
+	EXTLOGFONTW font = {};
+	wcscpy_s(font.elfLogFont.lfFaceName, L"Segoe UI");
+	RunStructBuild(*this, L"EXTLOGFONTW", font);
+	PIXELFORMATDESCRIPTOR pfd = { sizeof(PIXELFORMATDESCRIPTOR), 1 };
+	RunStructBuild(*this, L"PIXELFORMATDESCRIPTOR", pfd);
+}
+
+static CStringA ToJsonString(const std::wstring& str)
+{
+	CStringA strRet = CW2A(str.c_str(), CP_UTF8);
+	strRet.Replace("\\", "\\\\");
+	strRet.Replace("\"", "\\\"");
+	return "\"" + strRet + "\"";
+}
+
+bool EMFBenchmark::WriteJson(LPCWSTR szPath) const
+{
+	FILE* fp = stdout;
+	if (szPath && _wfopen_s(&fp, szPath, L"wb") != 0)
+		return false;
+	SYSTEMTIME st;
+	GetLocalTime(&st);
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	WCHAR szExe[MAX_PATH] = {};
+	GetModuleFileNameW(nullptr, szExe, MAX_PATH);
+	fprintf(fp, "{\n  \"context\": {\n");
+	fprintf(fp, "    \"date\": \"%04u-%02u-%02uT%02u:%02u:%02u\",\n", st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
+	fprintf(fp, "    \"executable\": %s,\n", (LPCSTR)ToJsonString(szExe));
+	fprintf(fp, "    \"num_cpus\": %u,\n", si.dwNumberOfProcessors);
+#ifdef _DEBUG
+	fprintf(fp, "    \"library_build_type\": \"debug\"\n");
+#else
+	fprintf(fp, "    \"library_build_type\": \"release\"\n");
+#endif // _DEBUG
+	fprintf(fp, "  },\n  \"benchmarks\": [");
+	for (size_t ii = 0; ii < m_vResults.size(); ++ii)
+	{
+		auto& result = m_vResults[ii];
+		auto strName = ToJsonString(result.strName);
+		fprintf(fp, "%s\n    {\n", ii ? "," : "");
+		fprintf(fp, "      \"name\": %s,\n", (LPCSTR)strName);
+		fprintf(fp, "      \"run_name\": %s,\n", (LPCSTR)strName);
+		fprintf(fp, "      \"run_type\": \"iteration\",\n");
+		fprintf(fp, "      \"iterations\": %llu,\n", result.nIterations);
+		fprintf(fp, "      \"real_time\": %.6e,\n", result.fRealTime);
+		fprintf(fp, "      \"cpu_time\": %.6e,\n", result.fCpuTime);
+		fprintf(fp, "      \"time_unit\": \"ns\",\n");
+		fprintf(fp, "      \"bytes_per_second\": %.6e,\n", result.fBytesPerSecond);
+		fprintf(fp, "      \"items_per_second\": %.6e\n", result.fItemsPerSecond);
+		fprintf(fp, "    }");
+	}
+	fprintf(fp, "\n  ]\n}\n");
+	bool bRet = !ferror(fp);
+	if (fp != stdout)
+		bRet = fclose(fp) == 0 && bRet;
+	return bRet;
+}
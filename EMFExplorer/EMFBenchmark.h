@@ -0,0 +1,63 @@
+#ifndef EMF_BENCHMARK_H
+#define EMF_BENCHMARK_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Timings of the parsing core (DataReader, the EMF+ object readers, record
+// dispatch, the property trees and the record list display model) on the
+// records of metafiles.
+// The results are written in the JSON layout of Google Benchmark, so that
+// runs can be compared and tracked with its tools (e.g. compare.py).
+class EMFBenchmark
+{
+public:
+	// Every benchmark runs for at least fMinTime seconds
+	EMFBenchmark(double fMinTime = 0.5);
+public:
+	struct Result
+	{
+		std::wstring	strName;
+		uint64_t		nIterations;
+		double			fRealTime;		// ns per iteration
+		double			fCpuTime;		// ns per iteration
+		double			fBytesPerSecond;
+		double			fItemsPerSecond;
+	};
+
+	// Runs the benchmarks of the records of the metafile, named
+	// "<benchmark>/<file name>"
+	bool AddFile(LPCWSTR szPath);
+
+	// Runs the benchmarks that don't depend on a metafile
+	void AddStructs();
+
+	inline const std::vector<Result>& GetResults() const { return m_vResults; }
+
+	// To stdout if szPath is nullptr
+	bool WriteJson(LPCWSTR szPath) const;
+
+	// Measures given time, pausing it around what isn't benchmarked
+	class State
+	{
+	public:
+		void PauseTiming();
+		void ResumeTiming();
+	private:
+		friend class EMFBenchmark;
+		int64_t		m_nRealStart = 0;
+		int64_t		m_nCpuStart = 0;
+		int64_t		m_nReal = 0;
+		int64_t		m_nCpu = 0;
+	};
+	using BenchFunc = std::function<void(State& state)>;
+
+	// fn runs one iteration, processing nBytes and nItems
+	void Run(const std::wstring& strName, uint64_t nBytes, uint64_t nItems, const BenchFunc& fn);
+private:
+	double				m_fMinTime;
+	std::vector<Result>	m_vResults;
+};
+
+#endif // EMF_BENCHMARK_H
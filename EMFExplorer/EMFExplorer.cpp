@@ -12,6 +12,8 @@
 #include "EMFExplorerDoc.h"
 #include "EMFExplorerView.h"
 #include "SubEMFFrame.h"
+#include "EMFBatch.h"
+#include "EMFTrace.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -137,6 +139,24 @@ BOOL CEMFExplorerApp::InitInstance()
 
 	CWinAppEx::InitInstance();
 
+	// Parse command line for standard shell commands, DDE, file open and batch commands
+	CEMFBatchCommandLineInfo cmdInfo;
+	ParseCommandLine(cmdInfo);
+
+#ifdef ENABLE_EMF_TRACE
+	// Written when the application exits
+	if (!cmdInfo.m_strTrace.IsEmpty())
+		EMFTrace::Instance().Start(cmdInfo.m_strTrace);
+#endif // ENABLE_EMF_TRACE
+
+	// Batch commands run headless, without touching the settings
+	if (cmdInfo.IsBatchCommand())
+	{
+		m_bBatchMode = TRUE;
+		m_nBatchExitCode = RunBatchCommand(cmdInfo);
+		return FALSE;
+	}
+
 
 	EnableTaskbarInteraction(FALSE);
 
@@ -179,10 +199,6 @@ BOOL CEMFExplorerApp::InitInstance()
 	AddDocTemplate(pDocTemplate);
 
 
-	// Parse command line for standard shell commands, DDE, file open
-	CCommandLineInfo cmdInfo;
-	ParseCommandLine(cmdInfo);
-
 	// Enable DDE Execute open
 	EnableShellOpen();
 	RegisterShellFileTypes(TRUE);
@@ -207,6 +223,14 @@ BOOL CEMFExplorerApp::InitInstance()
 
 int CEMFExplorerApp::ExitInstance()
 {
+#ifdef ENABLE_EMF_TRACE
+	EMFTrace::Instance().Stop();
+#endif // ENABLE_EMF_TRACE
+	if (m_bBatchMode)
+	{
+		CWinAppEx::ExitInstance();
+		return m_nBatchExitCode;
+	}
 	SaveCustomSettings();
 	return CWinAppEx::ExitInstance();
 }
@@ -341,6 +365,8 @@ const TCHAR cszThemeStyle[] = _T("ThemeStyle");
 const TCHAR cszImgBackgroundType[] = _T("BackgroundType");
 const TCHAR cszViewCenter[] = _T("ViewCenter");
 const TCHAR cszUpdatePropOnHover[] = _T("UpdatePropOnHover");
+const TCHAR cszUseRecordIndex[] = _T("UseRecordIndex");
+const TCHAR cszRecordCacheBudget[] = _T("RecordCacheBudget");
 
 void CEMFExplorerApp::LoadCustomSettings()
 {
@@ -348,6 +374,8 @@ void CEMFExplorerApp::LoadCustomSettings()
 	m_nImgBackgroundType = GetInt(cszImgBackgroundType, CEMFExplorerView::ImgBackgroundTypeTransparentGrid);
 	m_bViewCenter = GetInt(cszViewCenter, TRUE);
 	m_bUpdatePropOnHover = GetInt(cszUpdatePropOnHover, FALSE);
+	m_bUseRecordIndex = GetInt(cszUseRecordIndex, FALSE);
+	m_nRecordCacheBudget = GetInt(cszRecordCacheBudget, m_nRecordCacheBudget);
 }
 
 void CEMFExplorerApp::SaveCustomSettings()
@@ -356,6 +384,8 @@ void CEMFExplorerApp::SaveCustomSettings()
 	WriteInt(cszImgBackgroundType, m_nImgBackgroundType);
 	WriteInt(cszViewCenter, m_bViewCenter);
 	WriteInt(cszUpdatePropOnHover, m_bUpdatePropOnHover);
+	WriteInt(cszUseRecordIndex, m_bUseRecordIndex);
+	WriteInt(cszRecordCacheBudget, m_nRecordCacheBudget);
 }
 
 CDocument* CEMFExplorerApp::OpenDocumentFile(LPCTSTR lpszFileName)
@@ -368,7 +398,7 @@ CDocument* CEMFExplorerApp::OpenDocumentFile(LPCTSTR lpszFileName)
 
 // CEMFExplorerApp message handlers
 
-bool CEMFExplorerApp::CreateNewFrameForSubEMF(std::shared_ptr<EMFAccess> emf)
+bool CEMFExplorerApp::CreateNewFrameForSubEMF(std::shared_ptr<EMFAccess> emf, LPCWSTR szNestedPath)
 {
 	if (!m_pSubDocTemplate)
 	{
@@ -405,7 +435,8 @@ bool CEMFExplorerApp::CreateNewFrameForSubEMF(std::shared_ptr<EMFAccess> emf)
 			else
 			{
 				pFrame->ModifyStyle(0, FWS_ADDTOTITLE);
-				pDoc->SetTitle(emf->GetNestedPath().c_str());
+				pDoc->SetTitle(szNestedPath);
+				pDoc->SetNestedPath(szNestedPath);
 				
 				pFrame->LoadEMFDataEvent(true);
 
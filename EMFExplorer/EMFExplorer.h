@@ -8,6 +8,7 @@
 #endif
 
 #include "resource.h"       // main symbols
+#include "EMFRecordCache.h"
 #include <memory>
 
 class CEMFExplorerDoc;
@@ -27,7 +28,7 @@ public:
 protected:
 	CSubEMFDocTemplate* m_pSubDocTemplate = nullptr;
 public:
-	bool CreateNewFrameForSubEMF(std::shared_ptr<EMFAccess> emf);
+	bool CreateNewFrameForSubEMF(std::shared_ptr<EMFAccess> emf, LPCWSTR szNestedPath);
 // Overrides
 public:
 	virtual BOOL InitInstance();
@@ -45,6 +46,11 @@ public:
 	int m_nDrawToType = 0;
 	BOOL m_bUpdatePropOnHover = TRUE;
 	BOOL m_bViewCenter = TRUE;
+	BOOL m_bUseRecordIndex = FALSE;
+	// Memory budget of the caches of the records of each document, in MB
+	UINT m_nRecordCacheBudget = EMFRecordCache::DefaultMemoryBudget / (1024 * 1024);
+	BOOL m_bBatchMode = FALSE;
+	int m_nBatchExitCode = 0;
 
 	const COLORREF m_crfDarkThemeBkColor = RGB(0x53, 0x53, 0x53);
 	const COLORREF m_crfDarkThemeTxtColor = RGB(0xf1,0xf1,0xf1);
@@ -8,6 +8,8 @@
 // and search filter handlers and allows sharing of document code with that project.
 #ifndef SHARED_HANDLERS
 #include "EMFExplorer.h"
+#include "EMFSpoolAccess.h"
+#include "EMFRecordIndex.h"
 #endif
 
 #include "EMFExplorerDoc.h"
@@ -85,6 +87,9 @@ void CEMFExplorerDoc::UpdateEMFData(const std::vector<BYTE>& data, EMFType type)
 {
 	m_emf = std::make_shared<EMFAccessT>(data);
 	m_type = type;
+#ifndef SHARED_HANDLERS
+	m_emf->EnableRecordCache((size_t)theApp.m_nRecordCacheBudget * 1024 * 1024);
+#endif // SHARED_HANDLERS
 }
 
 #ifndef SHARED_HANDLERS
@@ -92,12 +97,15 @@ void CEMFExplorerDoc::SetEMFAccess(std::shared_ptr<EMFAccessT> emf, EMFType type
 {
 	m_emf = emf;
 	m_type = type;
+	if (m_emf)
+		m_emf->EnableRecordCache((size_t)theApp.m_nRecordCacheBudget * 1024 * 1024);
 }
 
 BOOL CEMFExplorerDoc::DoFileSave()
 {
 	DWORD dwAttrib = GetFileAttributes(m_strPathName);
-	BOOL bUsePathName = m_type == EMFType::FromFile && !(dwAttrib & FILE_ATTRIBUTE_READONLY);
+	// A spool file is never overwritten by the page being shown
+	BOOL bUsePathName = m_type == EMFType::FromFile && !m_spool && !(dwAttrib & FILE_ATTRIBUTE_READONLY);
 	LPCTSTR pszFilePath = bUsePathName ? m_strPathName : nullptr;
 	if (!DoSave(pszFilePath, FALSE))
 	{
@@ -131,13 +139,39 @@ void CEMFExplorerDoc::Serialize(CArchive& ar)
 		auto nSize = (UINT)pFile->GetLength();
 		std::vector<BYTE> vBuffer(nSize);
 		pFile->Read(vBuffer.data(), nSize);
+#ifndef SHARED_HANDLERS
+		if (emfspool::IsSpoolFile(vBuffer.data(), vBuffer.size()))
+		{
+			// Further pages are opened on demand through the spool
+			auto spool = std::make_shared<EMFSpoolAccess>(std::move(vBuffer), pFile->GetFileName());
+			if (!spool->GetPageCount())
+				AfxThrowArchiveException(CArchiveException::badIndex, pFile->GetFilePath());
+			if (theApp.m_bUseRecordIndex)
+				spool->SetRecordIndex(pFile->GetFilePath());
+			m_spool = spool;
+			SetEMFAccess(spool->GetPage(0), EMFType::FromFile);
+			return;
+		}
+#endif // SHARED_HANDLERS
 		UpdateEMFData(vBuffer, EMFType::FromFile);
+#ifndef SHARED_HANDLERS
+		if (theApp.m_bUseRecordIndex && !m_emf->IsWmf())
+		{
+			// The index refers to the file data, kept as long as the index
+			auto pData = std::make_shared<const emfplus::memory_vector>(std::move(vBuffer));
+			m_emf->SetRecordIndex(std::make_shared<EMFRecordIndex>(pFile->GetFilePath(), pData), 0, pData->size());
+		}
+#endif // SHARED_HANDLERS
 	}
 }
 
 void CEMFExplorerDoc::DeleteContents()
 {
 	m_emf.reset();
+#ifndef SHARED_HANDLERS
+	m_spool.reset();
+	m_strNestedPath.clear();
+#endif // SHARED_HANDLERS
 	m_type = EMFType::Invalid;
 }
 
@@ -11,8 +11,14 @@
 using EMFAccessT = EMFAccessBase;
 #else
 using EMFAccessT = EMFAccess;
+
+class EMFSpoolAccess;
 #endif // SHARED_HANDLERS
 
+// Reference counted GdiplusStartup/GdiplusShutdown
+int GdiplusBegin();
+int GdiplusEnd();
+
 class CEMFExplorerDoc : public CDocument
 {
 protected: // create from serialization only
@@ -36,6 +42,15 @@ public:
 
 #ifndef SHARED_HANDLERS
 	void SetEMFAccess(std::shared_ptr<EMFAccessT> emf, EMFType type);
+
+	// Where the document was opened from, the file and the records the nested
+	// metafiles were reached through ("file/12/3"). The nested documents are
+	// shared by the identical payloads, so it's kept here and not with them.
+	inline const std::wstring& GetNestedPath() const { return m_strNestedPath; }
+	inline void SetNestedPath(LPCWSTR szPath) { m_strNestedPath = szPath; }
+
+	// Print spool file the document shows the first page of, if any
+	std::shared_ptr<EMFSpoolAccess> GetSpoolAccess() const { return m_spool; }
 #endif // SHARED_HANDLERS
 
 // Operations
@@ -72,6 +87,10 @@ public:
 
 protected:
 	std::shared_ptr<EMFAccessT>	m_emf;
+#ifndef SHARED_HANDLERS
+	std::shared_ptr<EMFSpoolAccess>	m_spool;
+	std::wstring					m_strNestedPath;
+#endif // SHARED_HANDLERS
 
 	EMFType			m_type = EMFType::Invalid;
 
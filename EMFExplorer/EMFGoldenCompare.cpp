@@ -0,0 +1,163 @@
+#include "pch.h"
+#include "framework.h"
+#include "EMFGoldenCompare.h"
+#include "EMFAccess.h"
+#include "ThreadPool.h"
+#include <filesystem>
+#include <mutex>
+
+#undef min
+#undef max
+
+bool EMFGoldenCompare::DecodeImage(const void* pData, size_t nSize, UINT& nWidth, UINT& nHeight,
+	std::vector<uint8_t>& vPixels)
+{
+	ATL::CComPtr<IStream> stream;
+	stream.Attach(SHCreateMemStream((const BYTE*)pData, (UINT)nSize));
+	if (!stream)
+		return false;
+	Gdiplus::Bitmap bmp(stream);
+	if (bmp.GetLastStatus() != Gdiplus::Ok)
+		return false;
+	nWidth = bmp.GetWidth();
+	nHeight = bmp.GetHeight();
+	if (!nWidth || !nHeight || nWidth > INT_MAX / 4)
+		return false;
+	vPixels.resize((size_t)nWidth * 4 * nHeight);
+	// Converted straight to our buffer
+	Gdiplus::BitmapData data;
+	data.Width = nWidth;
+	data.Height = nHeight;
+	data.Stride = (INT)nWidth * 4;
+	data.PixelFormat = PixelFormat32bppARGB;
+	data.Scan0 = vPixels.data();
+	data.Reserved = 0;
+	Gdiplus::Rect rcLock(0, 0, (INT)nWidth, (INT)nHeight);
+	if (bmp.LockBits(&rcLock, Gdiplus::ImageLockModeRead | Gdiplus::ImageLockModeUserInputBuf,
+		PixelFormat32bppARGB, &data) != Gdiplus::Ok)
+		return false;
+	bmp.UnlockBits(&data);
+	return true;
+}
+
+static FILE* OpenOutput(LPCWSTR szPath)
+{
+	std::error_code ec;
+	std::filesystem::create_directories(std::filesystem::path(szPath).parent_path(), ec);
+	FILE* fp = nullptr;
+	if (_wfopen_s(&fp, szPath, L"wb") || !fp)
+		return nullptr;
+	return fp;
+}
+
+bool EMFGoldenCompare::WritePng(LPCWSTR szPath, const emfcompare::OImageView& img)
+{
+	FILE* fp = OpenOutput(szPath);
+	if (!fp)
+		return false;
+	emfpng::OImageFormat fmt{ img.nWidth, img.nHeight, false };
+	emfpng::OEncodedBand band;
+	emfpng::EncodeBand(fmt, img.pPixels, img.nStride, img.nHeight, true, band);
+	emfpng::OPngWriter writer([fp](const void* pData, size_t nSize)
+		{
+			return fwrite(pData, 1, nSize, fp) == nSize;
+		});
+	bool bRet = writer.Begin(fmt, 0) && writer.AddBand(band) && writer.End();
+	bRet = fclose(fp) == 0 && bRet;
+	if (!bRet)
+		DeleteFileW(szPath);
+	return bRet;
+}
+
+bool EMFGoldenCompare::WriteHeatmap(LPCWSTR szPath, const emfcompare::OImageView& imgA,
+	const emfcompare::OImageView& imgB, uint8_t nTolerance)
+{
+	FILE* fp = OpenOutput(szPath);
+	if (!fp)
+		return false;
+	bool bRet = emfcompare::WriteHeatmap(imgA, imgB, nTolerance, [fp](const void* pData, size_t nSize)
+		{
+			return fwrite(pData, 1, nSize, fp) == nSize;
+		});
+	bRet = fclose(fp) == 0 && bRet;
+	if (!bRet)
+		DeleteFileW(szPath);
+	return bRet;
+}
+
+EMFGoldenCompare::FileResult EMFGoldenCompare::CompareFiles(LPCWSTR szRendered, LPCWSTR szGolden,
+	const std::wstring& strName)
+{
+	FileResult res;
+	res.strName = strName;
+	emfplus::memory_vector vRendered, vGolden;
+	if (!ReadFileData(szGolden, vGolden))
+		return res;
+	if (!ReadFileData(szRendered, vRendered))
+	{
+		res.nStatus = Status::Missing;
+		return res;
+	}
+	if (vRendered == vGolden)
+	{
+		res.nStatus = Status::Identical;
+		res.bSameFile = true;
+		return res;
+	}
+	UINT nWidthA = 0, nHeightA = 0, nWidthB = 0, nHeightB = 0;
+	std::vector<uint8_t> vPixelsA, vPixelsB;
+	if (!DecodeImage(vRendered.data(), vRendered.size(), nWidthA, nHeightA, vPixelsA)
+		|| !DecodeImage(vGolden.data(), vGolden.size(), nWidthB, nHeightB, vPixelsB))
+		return res;
+	if (nWidthA != nWidthB || nHeightA != nHeightB)
+	{
+		res.nStatus = Status::SizeDiffers;
+		return res;
+	}
+	emfcompare::OImageView imgA{ nWidthA, nHeightA, (ptrdiff_t)nWidthA * 4, vPixelsA.data() };
+	emfcompare::OImageView imgB{ nWidthB, nHeightB, (ptrdiff_t)nWidthB * 4, vPixelsB.data() };
+	emfcompare::Compare(imgA, imgB, m_options.compare, res.result);
+	if (res.result.bIdentical)
+		res.nStatus = Status::Identical;
+	else if (!res.result.nMismatched)
+		res.nStatus = Status::Within;
+	else
+		res.nStatus = Status::Different;
+	if (res.nStatus == Status::Different && !m_options.strHeatmapDir.IsEmpty())
+	{
+		// <dir>\<name>.diff.png, in the folders of the name
+		std::filesystem::path path = std::filesystem::path((LPCWSTR)m_options.strHeatmapDir) / strName;
+		path.replace_extension(L".diff.png");
+		WriteHeatmap(path.c_str(), imgA, imgB, m_options.compare.nTolerance);
+	}
+	return res;
+}
+
+bool EMFGoldenCompare::CompareDirectories(LPCWSTR szRenderedDir, LPCWSTR szGoldenDir,
+	const std::function<void(const FileResult&)>& fnResult)
+{
+	std::error_code ec;
+	std::filesystem::path pathRendered(szRenderedDir);
+	std::filesystem::path pathGolden(szGoldenDir);
+	if (!std::filesystem::is_directory(pathGolden, ec))
+		return false;
+	std::mutex mtxResult;
+	ThreadPool pool(m_options.nThreads);
+	for (auto it = std::filesystem::recursive_directory_iterator(pathGolden, ec);
+		!ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+	{
+		if (!it->is_regular_file(ec) || _wcsicmp(it->path().extension().c_str(), L".png") != 0)
+			continue;
+		std::wstring strName = it->path().lexically_relative(pathGolden).wstring();
+		std::wstring strGolden = it->path().wstring();
+		std::wstring strRendered = (pathRendered / strName).wstring();
+		pool.Submit([&, strName, strGolden, strRendered]
+			{
+				auto res = CompareFiles(strRendered.c_str(), strGolden.c_str(), strName);
+				std::lock_guard<std::mutex> lock(mtxResult);
+				fnResult(res);
+			});
+	}
+	pool.Wait();
+	return !ec;
+}
@@ -0,0 +1,68 @@
+#ifndef EMF_GOLDEN_COMPARE_H
+#define EMF_GOLDEN_COMPARE_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "EmfImageCompare.h"
+
+// Comparison of the renderings of a corpus with their goldens, the images
+// of the same relative path in two directories, decoded by GDI+ and
+// compared by emfcompare. Files with the same bytes aren't decoded, most
+// renderings are the same as their golden from one change to the next.
+// Files are compared on a thread pool, the tiles of each image on the
+// thread of its file.
+class EMFGoldenCompare
+{
+public:
+	struct Options
+	{
+		emfcompare::OCompareOptions	compare;
+		CString						strHeatmapDir;	// none written if empty
+		unsigned					nThreads = 0;	// one per core
+	};
+
+	enum class Status
+	{
+		Identical,
+		Within,			// no pixel differs by more than the tolerance
+		Different,
+		SizeDiffers,
+		Missing,		// no rendering for the golden
+		Unreadable,
+	};
+
+	struct FileResult
+	{
+		std::wstring				strName;	// relative to the directories
+		Status						nStatus = Status::Unreadable;
+		bool						bSameFile = false;
+		emfcompare::OCompareResult	result;
+	};
+
+	explicit EMFGoldenCompare(const Options& options) : m_options(options) {}
+public:
+	static inline bool IsPassed(Status nStatus) { return nStatus == Status::Identical || nStatus == Status::Within; }
+
+	// Every .png below szGoldenDir against the file of the same relative
+	// path below szRenderedDir. fnResult gets the files one at a time, in
+	// no particular order.
+	bool CompareDirectories(LPCWSTR szRenderedDir, LPCWSTR szGoldenDir,
+		const std::function<void(const FileResult&)>& fnResult);
+
+	// The heatmap, if any, is named after strName
+	FileResult CompareFiles(LPCWSTR szRendered, LPCWSTR szGolden, const std::wstring& strName);
+
+	// 32-bit BGRA pixels (PixelFormat32bppARGB) of an image file GDI+ decodes
+	static bool DecodeImage(const void* pData, size_t nSize, UINT& nWidth, UINT& nHeight,
+		std::vector<uint8_t>& vPixels);
+
+	// As PNG files, their folders created if need be
+	static bool WritePng(LPCWSTR szPath, const emfcompare::OImageView& img);
+	static bool WriteHeatmap(LPCWSTR szPath, const emfcompare::OImageView& imgA, const emfcompare::OImageView& imgB,
+		uint8_t nTolerance);
+private:
+	Options		m_options;
+};
+
+#endif // EMF_GOLDEN_COMPARE_H
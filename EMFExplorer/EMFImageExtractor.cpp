@@ -0,0 +1,763 @@
+#include "pch.h"
+#include "framework.h"
+#include "EMFImageExtractor.h"
+#include "EMFRecAccessGDI.h"
+#include "EMFRecAccessPlus.h"
+#include "DataHash.h"
+#include "WmfStruct.h"
+#include "EmfDIBDecode.h"
+#include "EMFSpoolAccess.h"
+
+#include <algorithm>
+#include <filesystem>
+
+#undef min
+#undef max
+
+using namespace emfplus;
+using namespace data_access;
+
+struct EMFImageExtractor::ImageRef
+{
+	enum class Kind
+	{
+		Native,		// data is written as is
+		DIB,		// data is a BITMAPINFO followed by the pixel bits
+		PlusPixel,	// data is the pixel data of an EMF+ bitmap
+	};
+	Kind			nKind = Kind::Native;
+
+	std::wstring	strSource;
+	std::wstring	strNestedPath;
+	size_t			nRecIndex = 0;
+	std::wstring	strRecName;
+	std::wstring	strOrigin;
+
+	memory_vector	data;
+
+	// Native
+	LPCWSTR			szExt = L"bin";
+	// DIB
+	size_t			nBitsOffset = 0;
+	bool			bAlpha = false;		// 32bpp BI_RGB bits carry premultiplied alpha
+	// PlusPixel
+	INT				nWidth = 0;
+	INT				nHeight = 0;
+	INT				nStride = 0;
+	Gdiplus::PixelFormat	nFormat = 0;
+	UINT					nPaletteFlags = 0;
+	std::vector<Gdiplus::ARGB>	vPalette;
+};
+
+static bool WriteFileData(LPCWSTR szPath, const void* pData, size_t nSize)
+{
+	HANDLE hFile = CreateFileW(szPath, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+	DWORD nWritten = 0;
+	bool bRet = WriteFile(hFile, pData, (DWORD)nSize, &nWritten, nullptr) && nWritten == nSize;
+	CloseHandle(hFile);
+	if (!bRet)
+		DeleteFileW(szPath);
+	return bRet;
+}
+
+static const CLSID* GetPngEncoderClsid()
+{
+	static const auto encoder = []() -> std::pair<bool, CLSID>
+	{
+		UINT nNum = 0, nSize = 0;
+		if (Gdiplus::GetImageEncodersSize(&nNum, &nSize) != Gdiplus::Ok || !nSize)
+			return { false, CLSID() };
+		std::vector<BYTE> vBuffer(nSize);
+		auto pCodecs = (Gdiplus::ImageCodecInfo*)vBuffer.data();
+		if (Gdiplus::GetImageEncoders(nNum, nSize, pCodecs) != Gdiplus::Ok)
+			return { false, CLSID() };
+		for (UINT ii = 0; ii < nNum; ++ii)
+		{
+			if (wcscmp(pCodecs[ii].MimeType, L"image/png") == 0)
+				return { true, pCodecs[ii].Clsid };
+		}
+		return { false, CLSID() };
+	}();
+	return encoder.first ? &encoder.second : nullptr;
+}
+
+// Extension for the image formats allowed in an EmfPlusCompressedImage
+static LPCWSTR GetCompressedImageExt(const memory_vector& data)
+{
+	auto StartsWith = [&data](const char* szMagic, size_t nLen)
+	{
+		return data.size() >= nLen && memcmp(data.data(), szMagic, nLen) == 0;
+	};
+	if (StartsWith("\x89PNG", 4))
+		return L"png";
+	if (StartsWith("\xFF\xD8\xFF", 3))
+		return L"jpg";
+	if (StartsWith("GIF8", 4))
+		return L"gif";
+	if (StartsWith("BM", 2))
+		return L"bmp";
+	if (StartsWith("II*\0", 4) || StartsWith("MM\0*", 4))
+		return L"tif";
+	if (StartsWith("\0\0\1\0", 4))
+		return L"ico";
+	return L"bin";
+}
+
+// Size of the BITMAPINFO (header, bit fields and color table) at the start
+// of a packed DIB, or 0 if it's not valid.
+static size_t GetDIBHeaderSize(const BYTE* pDIB, size_t nSize)
+{
+	DWORD biSize = 0;
+	if (nSize < sizeof(BITMAPCOREHEADER))
+		return 0;
+	memcpy(&biSize, pDIB, sizeof(biSize));
+	size_t nHdrSize = 0;
+	if (biSize == sizeof(BITMAPCOREHEADER))
+	{
+		BITMAPCOREHEADER bch;
+		memcpy(&bch, pDIB, sizeof(bch));
+		size_t nColors = bch.bcBitCount <= 8 ? (size_t)1 << bch.bcBitCount : 0;
+		nHdrSize = biSize + nColors * sizeof(RGBTRIPLE);
+	}
+	else
+	{
+		if (biSize < sizeof(BITMAPINFOHEADER) || biSize > nSize)
+			return 0;
+		BITMAPINFOHEADER bih;
+		memcpy(&bih, pDIB, sizeof(bih));
+		size_t nColors = bih.biClrUsed;
+		if (!nColors && bih.biBitCount <= 8)
+			nColors = (size_t)1 << bih.biBitCount;
+		nHdrSize = biSize + nColors * sizeof(RGBQUAD);
+		if (biSize == sizeof(BITMAPINFOHEADER))
+		{
+			if (bih.biCompression == BI_BITFIELDS)
+				nHdrSize += 3 * sizeof(DWORD);
+			else if (bih.biCompression == 6)	// BI_ALPHABITFIELDS
+				nHdrSize += 4 * sizeof(DWORD);
+		}
+	}
+	return nHdrSize <= nSize ? nHdrSize : 0;
+}
+
+template <typename EMRT>
+static const EMRT* GetGDIRecordAs(const OEmfPlusRecInfo& rec)
+{
+	if (!rec.Data || rec.DataSize + sizeof(EMR) < sizeof(EMRT))
+		return nullptr;
+	return (const EMRT*)EMFRecAccessGDIRec::GetGDIRecord(rec);
+}
+
+EMFImageExtractor::EMFImageExtractor(LPCWSTR szOutDir, unsigned nThreads)
+	: m_strOutDir(szOutDir)
+	, m_pool(nThreads)
+{
+	std::error_code ec;
+	std::filesystem::create_directories(m_strOutDir, ec);
+}
+
+EMFImageExtractor::~EMFImageExtractor()
+{
+	m_pool.Wait();
+}
+
+bool EMFImageExtractor::AddPath(LPCWSTR szPath)
+{
+	std::error_code ec;
+	std::filesystem::path path(szPath);
+	if (!std::filesystem::is_directory(path, ec))
+	{
+		if (!std::filesystem::is_regular_file(path, ec))
+			return false;
+		std::wstring strPath = path.wstring();
+		m_pool.Submit([this, strPath] { ExtractFile(strPath); });
+		return true;
+	}
+	for (auto it = std::filesystem::recursive_directory_iterator(path, ec);
+		!ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+	{
+		if (!it->is_regular_file(ec))
+			continue;
+		auto strExt = it->path().extension().wstring();
+		if (_wcsicmp(strExt.c_str(), L".emf") != 0 && _wcsicmp(strExt.c_str(), L".wmf") != 0
+			&& _wcsicmp(strExt.c_str(), L".spl") != 0)
+			continue;
+		std::wstring strPath = it->path().wstring();
+		m_pool.Submit([this, strPath] { ExtractFile(strPath); });
+	}
+	return !ec;
+}
+
+void EMFImageExtractor::AddEMF(std::shared_ptr<EMFAccess> emf, LPCWSTR szSource)
+{
+	std::wstring strSource(szSource ? szSource : L"");
+	m_pool.Submit([this, emf, strSource]
+		{
+			if (emf->GetRecords())
+				CollectImages(emf.get(), strSource);
+		});
+}
+
+void EMFImageExtractor::Wait()
+{
+	m_pool.Wait();
+}
+
+EMFImageExtractor::Stats EMFImageExtractor::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	return m_stats;
+}
+
+void EMFImageExtractor::ExtractFile(const std::wstring& strPath)
+{
+	memory_vector data;
+	if (!ReadFileData(strPath.c_str(), data) || data.empty())
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		++m_stats.nFailed;
+		return;
+	}
+	if (emfspool::IsSpoolFile(data.data(), data.size()))
+	{
+		// Every page is queued on its own, the spool stays alive until the last one is done
+		auto spool = std::make_shared<EMFSpoolAccess>(std::move(data));
+		for (size_t ii = 0; ii < spool->GetPageCount(); ++ii)
+		{
+			m_pool.Submit([this, spool, ii, strPath]
+				{
+					auto emf = spool->GetPage(ii);
+					if (emf && emf->GetRecords())
+						CollectImages(emf.get(), strPath);
+					else
+					{
+						std::lock_guard<std::mutex> lock(m_mtx);
+						++m_stats.nFailed;
+					}
+				});
+		}
+		return;
+	}
+	EMFAccess emf(data);
+	if (!emf.GetRecords())
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		++m_stats.nFailed;
+		return;
+	}
+	CollectImages(&emf, strPath);
+}
+
+void EMFImageExtractor::CollectImages(EMFAccess* pEMF, const std::wstring& strSource)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		++m_stats.nFiles;
+	}
+	for (size_t ii = 0; ii < pEMF->GetRecordCount(); ++ii)
+	{
+		auto pRec = pEMF->GetRecord(ii);
+		auto& rec = pRec->GetRecInfo();
+		switch (pRec->GetRecordType())
+		{
+		case EmfPlusRecordTypeObject:
+			{
+				auto nObjType = OEmfPlusRecObjectReader::GetObjectType(rec);
+				if (nObjType != OObjType::Image && nObjType != OObjType::Brush && nObjType != OObjType::Pen)
+					break;
+				auto pObjWrapper = ((EMFRecAccessGDIPlusRecObject*)pRec)->GetObjectWrapper();
+				if (!pObjWrapper || !pObjWrapper->GetObject())
+					break;
+				const OEmfPlusBrush* pBrush = nullptr;
+				switch (nObjType)
+				{
+				case OObjType::Image:
+					CollectPlusImage(pEMF, strSource, pRec, *(OEmfPlusImage*)pObjWrapper->GetObject(), L"Image");
+					break;
+				case OObjType::Brush:
+					pBrush = (OEmfPlusBrush*)pObjWrapper->GetObject();
+					break;
+				case OObjType::Pen:
+					pBrush = &((OEmfPlusPen*)pObjWrapper->GetObject())->BrushObject;
+					break;
+				}
+				if (pBrush && pBrush->Type == OBrushType::TextureFill && pBrush->BrushDataTexture.is_enabled()
+					&& pBrush->BrushDataTexture->OptionalData.ImageObject.is_enabled())
+				{
+					CollectPlusImage(pEMF, strSource, pRec, *pBrush->BrushDataTexture->OptionalData.ImageObject,
+						nObjType == OObjType::Brush ? L"TextureBrush" : L"PenTextureBrush");
+				}
+			}
+			break;
+		case EmfRecordTypeGdiComment:
+			CollectEmbeddedMetafiles(pEMF, strSource, (const EMFRecAccessGDIRecGdiComment*)pRec);
+			break;
+		case EmfRecordTypeBitBlt:
+			if (auto pEMR = GetGDIRecordAs<EMRBITBLT>(rec))
+			{
+				CollectDIB(pEMF, strSource, pRec, EMFRecAccessGDIRec::GetGDIRecordBlock(rec, pEMR->offBmiSrc, pEMR->cbBmiSrc), pEMR->cbBmiSrc,
+					EMFRecAccessGDIRec::GetGDIRecordBlock(rec, pEMR->offBitsSrc, pEMR->cbBitsSrc), pEMR->cbBitsSrc, L"Source");
+			}
+			break;
+		case EmfRecordTypeStretchBlt:
+			if (auto pEMR = GetGDIRecordAs<EMRSTRETCHBLT>(rec))
+			{
+				CollectDIB(pEMF, strSource, pRec, EMFRecAccessGDIRec::GetGDIRecordBlock(rec, pEMR->offBmiSrc, pEMR->cbBmiSrc), pEMR->cbBmiSrc,
+					EMFRecAccessGDIRec::GetGDIRecordBlock(rec, pEMR->offBitsSrc, pEMR->cbBitsSrc), pEMR->cbBitsSrc, L"Source");
+			}
+			break;
+		case EmfRecordTypeMaskBlt:
+			if (auto pEMR = GetGDIRecordAs<EMRMASKBLT>(rec))
+			{
+				CollectDIB(pEMF, strSource, pRec, EMFRecAccessGDIRec::GetGDIRecordBlock(rec, pEMR->offBmiSrc, pEMR->cbBmiSrc), pEMR->cbBmiSrc,
+					EMFRecAccessGDIRec::GetGDIRecordBlock(rec, pEMR->offBitsSrc, pEMR->cbBitsSrc), pEMR->cbBitsSrc, L"Source");
+				CollectDIB(pEMF, strSource, pRec, EMFRecAccessGDIRec::GetGDIRecordBlock(rec, pEMR->offBmiMask, pEMR->cbBmiMask), pEMR->cbBmiMask,
+					EMFRecAccessGDIRec::GetGDIRecordBlock(rec, pEMR->offBitsMask, pEMR->cbBitsMask), pEMR->cbBitsMask, L"Mask");
+			}
+			break;
+		case EmfRecordTypePlgBlt:
+			if (auto pEMR = GetGDIRecordAs<EMRPLGBLT>(rec))
+			{
+				CollectDIB(pEMF, strSource, pRec, EMFRecAccessGDIRec::GetGDIRecordBlock(rec, pEMR->offBmiSrc, pEMR->cbBmiSrc), pEMR->cbBmiSrc,
+					EMFRecAccessGDIRec::GetGDIRecordBlock(rec, pEMR->offBitsSrc, pEMR->cbBitsSrc), pEMR->cbBitsSrc, L"Source");
+				CollectDIB(pEMF, strSource, pRec, EMFRecAccessGDIRec::GetGDIRecordBlock(rec, pEMR->offBmiMask, pEMR->cbBmiMask), pEMR->cbBmiMask,
+					EMFRecAccessGDIRec::GetGDIRecordBlock(rec, pEMR->offBitsMask, pEMR->cbBitsMask), pEMR->cbBitsMask, L"Mask");
+			}
+			break;
+		case EmfRecordTypeSetDIBitsToDevice:
+			if (auto pEMR = GetGDIRecordAs<EMRSETDIBITSTODEVICE>(rec))
+			{
+				CollectDIB(pEMF, strSource, pRec, EMFRecAccessGDIRec::GetGDIRecordBlock(rec, pEMR->offBmiSrc, pEMR->cbBmiSrc), pEMR->cbBmiSrc,
+					EMFRecAccessGDIRec::GetGDIRecordBlock(rec, pEMR->offBitsSrc, pEMR->cbBitsSrc), pEMR->cbBitsSrc, L"Source");
+			}
+			break;
+		case EmfRecordTypeStretchDIBits:
+			if (auto pEMR = GetGDIRecordAs<EMRSTRETCHDIBITS>(rec))
+			{
+				CollectDIB(pEMF, strSource, pRec, EMFRecAccessGDIRec::GetGDIRecordBlock(rec, pEMR->offBmiSrc, pEMR->cbBmiSrc), pEMR->cbBmiSrc,
+					EMFRecAccessGDIRec::GetGDIRecordBlock(rec, pEMR->offBitsSrc, pEMR->cbBitsSrc), pEMR->cbBitsSrc, L"Source");
+			}
+			break;
+		case EmfRecordTypeAlphaBlend:
+			if (auto pEMR = GetGDIRecordAs<EMRALPHABLEND>(rec))
+			{
+				// dwRop holds the BLENDFUNCTION, AlphaFormat is the high byte
+				bool bSrcAlpha = ((pEMR->dwRop >> 24) & AC_SRC_ALPHA) != 0;
+				CollectDIB(pEMF, strSource, pRec, EMFRecAccessGDIRec::GetGDIRecordBlock(rec, pEMR->offBmiSrc, pEMR->cbBmiSrc), pEMR->cbBmiSrc,
+					EMFRecAccessGDIRec::GetGDIRecordBlock(rec, pEMR->offBitsSrc, pEMR->cbBitsSrc), pEMR->cbBitsSrc, L"Source", bSrcAlpha);
+			}
+			break;
+		case EmfRecordTypeTransparentBlt:
+			if (auto pEMR = GetGDIRecordAs<EMRTRANSPARENTBLT>(rec))
+			{
+				CollectDIB(pEMF, strSource, pRec, EMFRecAccessGDIRec::GetGDIRecordBlock(rec, pEMR->offBmiSrc, pEMR->cbBmiSrc), pEMR->cbBmiSrc,
+					EMFRecAccessGDIRec::GetGDIRecordBlock(rec, pEMR->offBitsSrc, pEMR->cbBitsSrc), pEMR->cbBitsSrc, L"Source");
+			}
+			break;
+		case EmfRecordTypeCreateMonoBrush:
+			if (auto pEMR = GetGDIRecordAs<EMRCREATEMONOBRUSH>(rec))
+			{
+				CollectDIB(pEMF, strSource, pRec, EMFRecAccessGDIRec::GetGDIRecordBlock(rec, pEMR->offBmi, pEMR->cbBmi), pEMR->cbBmi,
+					EMFRecAccessGDIRec::GetGDIRecordBlock(rec, pEMR->offBits, pEMR->cbBits), pEMR->cbBits, L"Pattern");
+			}
+			break;
+		case EmfRecordTypeCreateDIBPatternBrushPt:
+			if (auto pEMR = GetGDIRecordAs<EMRCREATEDIBPATTERNBRUSHPT>(rec))
+			{
+				CollectDIB(pEMF, strSource, pRec, EMFRecAccessGDIRec::GetGDIRecordBlock(rec, pEMR->offBmi, pEMR->cbBmi), pEMR->cbBmi,
+					EMFRecAccessGDIRec::GetGDIRecordBlock(rec, pEMR->offBits, pEMR->cbBits), pEMR->cbBits, L"Pattern");
+			}
+			break;
+		case EmfRecordTypeExtCreatePen:
+			if (auto pEMR = GetGDIRecordAs<EMREXTCREATEPEN>(rec))
+			{
+				CollectDIB(pEMF, strSource, pRec, EMFRecAccessGDIRec::GetGDIRecordBlock(rec, pEMR->offBmi, pEMR->cbBmi), pEMR->cbBmi,
+					EMFRecAccessGDIRec::GetGDIRecordBlock(rec, pEMR->offBits, pEMR->cbBits), pEMR->cbBits, L"Pattern");
+			}
+			break;
+		case WmfRecordTypeDIBBitBlt:
+		case WmfRecordTypeDIBStretchBlt:
+		case WmfRecordTypeStretchDIB:
+		case WmfRecordTypeSetDIBToDev:
+		case WmfRecordTypeDIBCreatePatternBrush:
+			{
+				// Offset of the packed DIB in the record parameters ([MS-WMF] 2.3.1 and 2.3.4.8).
+				// DIBBitBlt and DIBStretchBlt only carry the Reserved field when there's no bitmap.
+				size_t nOffset = 0;
+				switch (pRec->GetRecordType())
+				{
+				case WmfRecordTypeDIBBitBlt:			nOffset = sizeof(wmf::OWmfDIBBitBlt) - sizeof(int16_t); break;
+				case WmfRecordTypeDIBStretchBlt:		nOffset = sizeof(wmf::OWmfDIBStretchBlt) - sizeof(int16_t); break;
+				case WmfRecordTypeStretchDIB:			nOffset = sizeof(wmf::OWmfStretchDIB); break;
+				case WmfRecordTypeSetDIBToDev:			nOffset = sizeof(wmf::OWmfSetDIBToDev); break;
+				case WmfRecordTypeDIBCreatePatternBrush:
+					{
+						// Style, ColorUsage; BS_PATTERN carries a device dependent Bitmap16 instead
+						u16t nStyle = 0;
+						if (rec.DataSize >= sizeof(u16t))
+							memcpy(&nStyle, rec.Data, sizeof(u16t));
+						if (nStyle == BS_PATTERN)
+							break;
+						nOffset = 2 * sizeof(u16t);
+					}
+					break;
+				}
+				if (!nOffset || !rec.Data || rec.DataSize <= nOffset)
+					break;
+				auto pDIB = rec.Data + nOffset;
+				size_t nDIBSize = rec.DataSize - nOffset;
+				size_t nHdrSize = GetDIBHeaderSize(pDIB, nDIBSize);
+				if (!nHdrSize)
+					break;
+				CollectDIB(pEMF, strSource, pRec, pDIB, nHdrSize, pDIB + nHdrSize, nDIBSize - nHdrSize,
+					pRec->GetRecordType() == WmfRecordTypeDIBCreatePatternBrush ? L"Pattern" : L"Source");
+			}
+			break;
+		}
+	}
+}
+
+void EMFImageExtractor::CollectPlusImage(EMFAccess* pEMF, const std::wstring& strSource, const EMFRecAccess* pRec,
+	const OEmfPlusImage& img, LPCWSTR szOrigin)
+{
+	auto ref = std::make_shared<ImageRef>();
+	ref->strSource = strSource;
+	ref->strNestedPath = pEMF->GetNestedPath();
+	ref->nRecIndex = pRec->GetIndex();
+	ref->strRecName = pRec->GetRecordName();
+	ref->strOrigin = szOrigin;
+	switch (img.Type)
+	{
+	case OImageDataType::Bitmap:
+		{
+			if (!img.ImageDataBmp.is_enabled())
+				return;
+			auto& bmp = *img.ImageDataBmp;
+			switch (bmp.Type)
+			{
+			case OBitmapDataType::Compressed:
+				if (!bmp.BitmapDataCompressed.is_enabled())
+					return;
+				ref->nKind = ImageRef::Kind::Native;
+				ref->data = bmp.BitmapDataCompressed->CompressedImageData;
+				ref->szExt = GetCompressedImageExt(ref->data);
+				break;
+			case OBitmapDataType::Pixel:
+				if (!bmp.BitmapData.is_enabled())
+					return;
+				ref->nKind = ImageRef::Kind::PlusPixel;
+				ref->nWidth = bmp.Width;
+				ref->nHeight = bmp.Height;
+				ref->nStride = bmp.Stride;
+				ref->nFormat = (Gdiplus::PixelFormat)bmp.PixelFormat;
+				ref->data = bmp.BitmapData->PixelData;
+				if (bmp.BitmapData->Colors.is_enabled())
+				{
+					auto& palette = *bmp.BitmapData->Colors;
+					ref->nPaletteFlags = palette.PaletteStyleFlags;
+					for (auto& argb : palette.PaletteEntries)
+						ref->vPalette.push_back(argb.argb);
+				}
+				break;
+			default:
+				return;
+			}
+		}
+		break;
+	case OImageDataType::Metafile:
+		{
+			if (!img.ImageDataMetafile.is_enabled())
+				return;
+			auto& mf = *img.ImageDataMetafile;
+			ref->nKind = ImageRef::Kind::Native;
+			ref->data = mf.MetafileData;
+			ref->szExt = (mf.Type == OMetafileDataType::Wmf || mf.Type == OMetafileDataType::WmfPlaceable) ? L"wmf" : L"emf";
+
+			// Images embedded in the nested metafile
+			EMFAccess emfNested(mf.MetafileData);
+			emfNested.AddNestedPath(pEMF->GetNestedPath().c_str());
+			emfNested.AddNestedPath(std::to_wstring(pRec->GetIndex() + 1).c_str());
+			if (emfNested.GetRecords())
+				CollectImages(&emfNested, strSource);
+		}
+		break;
+	default:
+		return;
+	}
+	if (ref->data.empty())
+		return;
+	SubmitImage(ref);
+}
+
+void EMFImageExtractor::CollectEmbeddedMetafiles(EMFAccess* pEMF, const std::wstring& strSource,
+	const EMFRecAccessGDIRecGdiComment* pRec)
+{
+	auto& vPayloads = pRec->GetEmbeddedPayloads();
+	for (size_t ii = 0; ii < vPayloads.size(); ++ii)
+	{
+		auto& payload = vPayloads[ii];
+		auto ref = std::make_shared<ImageRef>();
+		ref->nKind = ImageRef::Kind::Native;
+		ref->strSource = strSource;
+		ref->strNestedPath = pEMF->GetNestedPath();
+		ref->nRecIndex = pRec->GetIndex();
+		ref->strRecName = pRec->GetRecordName();
+		ref->data.assign(payload.pData, payload.pData + payload.nSize);
+		switch (payload.Type)
+		{
+		case emfembed::OEmbeddedType::Wmf:
+			ref->strOrigin = L"WindowsMetafile";
+			ref->szExt = L"wmf";
+			break;
+		case emfembed::OEmbeddedType::Emf:
+			ref->strOrigin = L"MultiFormats";
+			ref->szExt = L"emf";
+			break;
+		case emfembed::OEmbeddedType::Eps:
+			ref->strOrigin = L"MultiFormats";
+			ref->szExt = L"eps";
+			break;
+		}
+		SubmitImage(ref);
+		if (payload.Type == emfembed::OEmbeddedType::Eps)
+			continue;
+
+		// Images embedded in the nested metafile, named as in the UI
+		EMFAccess emfNested(payload.pData, payload.nSize);
+		emfNested.AddNestedPath(pEMF->GetNestedPath().c_str());
+		std::wstring strName = std::to_wstring(pRec->GetIndex() + 1);
+		if (ii)
+			strName += L"." + std::to_wstring(ii + 1);
+		emfNested.AddNestedPath(strName.c_str());
+		if (emfNested.GetRecords())
+			CollectImages(&emfNested, strSource);
+	}
+}
+
+void EMFImageExtractor::CollectDIB(EMFAccess* pEMF, const std::wstring& strSource, const EMFRecAccess* pRec,
+	const BYTE* pBmi, size_t cbBmi, const BYTE* pBits, size_t cbBits, LPCWSTR szOrigin, bool bAlpha)
+{
+	if (!pBmi || !pBits || cbBmi < sizeof(BITMAPCOREHEADER))
+		return;
+	auto ref = std::make_shared<ImageRef>();
+	ref->nKind = ImageRef::Kind::DIB;
+	ref->strSource = strSource;
+	ref->strNestedPath = pEMF->GetNestedPath();
+	ref->nRecIndex = pRec->GetIndex();
+	ref->strRecName = pRec->GetRecordName();
+	ref->strOrigin = szOrigin;
+	ref->data.reserve(cbBmi + cbBits);
+	ref->data.assign(pBmi, pBmi + cbBmi);
+	ref->data.insert(ref->data.end(), pBits, pBits + cbBits);
+	ref->nBitsOffset = cbBmi;
+	ref->bAlpha = bAlpha;
+	SubmitImage(ref);
+}
+
+void EMFImageExtractor::SubmitImage(std::shared_ptr<ImageRef> ref)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		++m_stats.nReferences;
+	}
+	m_pool.Submit([this, ref] { WriteImage(*ref); });
+}
+
+static bool SaveAsPng(Gdiplus::Bitmap& bmp, const std::wstring& strPath)
+{
+	auto pClsid = GetPngEncoderClsid();
+	if (!pClsid || bmp.GetLastStatus() != Gdiplus::Ok)
+		return false;
+	return bmp.Save(strPath.c_str(), pClsid) == Gdiplus::Ok;
+}
+
+void EMFImageExtractor::WriteImage(ImageRef& ref)
+{
+	// The hash covers everything that determines the decoded image
+	Hash64 hash;
+	hash.UpdateValue(ref.nKind);
+	switch (ref.nKind)
+	{
+	case ImageRef::Kind::DIB:
+		hash.UpdateValue(ref.nBitsOffset);
+		hash.UpdateValue(ref.bAlpha);
+		break;
+	case ImageRef::Kind::PlusPixel:
+		hash.UpdateValue(ref.nWidth);
+		hash.UpdateValue(ref.nHeight);
+		hash.UpdateValue(ref.nStride);
+		hash.UpdateValue(ref.nFormat);
+		hash.UpdateValue(ref.nPaletteFlags);
+		hash.Update(ref.vPalette.data(), ref.vPalette.size() * sizeof(Gdiplus::ARGB));
+		break;
+	}
+	hash.Update(ref.data.data(), ref.data.size());
+	auto nHash = hash.Digest();
+
+	bool bWrite = false;
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		m_vManifest.push_back({ nHash, ref.strSource, ref.strNestedPath, ref.nRecIndex, ref.strRecName, ref.strOrigin });
+		auto [it, bNew] = m_mapImages.try_emplace(nHash);
+		bWrite = bNew;
+		// Every reference to an image which failed is a failure
+		++it->second.nReferences;
+		if (it->second.bFailed)
+			++m_stats.nFailed;
+	}
+	if (!bWrite)
+		return;
+
+	auto strBase = m_strOutDir + L"\\" + Hash64ToString(nHash);
+	std::wstring strFile;
+	switch (ref.nKind)
+	{
+	case ImageRef::Kind::Native:
+		strFile = strBase + L"." + ref.szExt;
+		if (!WriteFileData(strFile.c_str(), ref.data.data(), ref.data.size()))
+			strFile.clear();
+		break;
+	case ImageRef::Kind::DIB:
+		{
+			BITMAPINFOHEADER bih = { 0 };
+			memcpy(&bih, ref.data.data(), std::min(ref.nBitsOffset, sizeof(bih)));
+			auto pBits = ref.data.data() + ref.nBitsOffset;
+			size_t cbBits = ref.data.size() - ref.nBitsOffset;
+			if (bih.biSize >= sizeof(BITMAPINFOHEADER) && (bih.biCompression == BI_JPEG || bih.biCompression == BI_PNG))
+			{
+				// The bits are a complete JPEG/PNG file
+				strFile = strBase + (bih.biCompression == BI_JPEG ? L".jpg" : L".png");
+				if (!WriteFileData(strFile.c_str(), pBits, cbBits))
+					strFile.clear();
+				break;
+			}
+			strFile = strBase + L".png";
+			bool bSaved = false;
+			emfdib::DIBDecoder decoder;
+			if (decoder.Init(ref.data.data(), ref.nBitsOffset, pBits, cbBits))
+			{
+				// AlphaBlend sources keep their premultiplied alpha, other DIBs are opaque
+				decoder.SetAlphaMode(ref.bAlpha ? emfdib::AlphaMode::Premultiplied : emfdib::AlphaMode::Ignore);
+				decoder.SetPixelOrder(emfdib::PixelOrder::BGRA);
+				auto& bmi = decoder.GetInfo();
+				Gdiplus::Bitmap bmp(bmi.Width, bmi.Height, PixelFormat32bppPARGB);
+				Gdiplus::BitmapData locked;
+				Gdiplus::Rect rcLock(0, 0, bmi.Width, bmi.Height);
+				if (bmp.LockBits(&rcLock, Gdiplus::ImageLockModeWrite, PixelFormat32bppPARGB, &locked) == Gdiplus::Ok)
+				{
+					bool bDecoded = decoder.DecodeRows(0, bmi.Height, (u8t*)locked.Scan0, locked.Stride);
+					bmp.UnlockBits(&locked);
+					bSaved = bDecoded && SaveAsPng(bmp, strFile);
+				}
+			}
+			if (!bSaved)
+			{
+				// Keep the DIB as a .bmp file if it can't be decoded
+				BITMAPFILEHEADER bfh = { 0 };
+				bfh.bfType = 0x4D42;	// "BM"
+				bfh.bfSize = (DWORD)(sizeof(bfh) + ref.data.size());
+				bfh.bfOffBits = (DWORD)(sizeof(bfh) + ref.nBitsOffset);
+				memory_vector vFile((const u8t*)&bfh, (const u8t*)&bfh + sizeof(bfh));
+				vFile.insert(vFile.end(), ref.data.begin(), ref.data.end());
+				strFile = strBase + L".bmp";
+				if (!WriteFileData(strFile.c_str(), vFile.data(), vFile.size()))
+					strFile.clear();
+			}
+		}
+		break;
+	case ImageRef::Kind::PlusPixel:
+		{
+			strFile = strBase + L".png";
+			INT nAbsStride = ref.nStride < 0 ? -ref.nStride : ref.nStride;
+			if (ref.nWidth <= 0 || ref.nHeight <= 0 || (size_t)nAbsStride * ref.nHeight > ref.data.size())
+			{
+				strFile.clear();
+				break;
+			}
+			Gdiplus::Bitmap bmp(ref.nWidth, ref.nHeight, ref.nStride, ref.nFormat, ref.data.data());
+			if (!ref.vPalette.empty() && Gdiplus::IsIndexedPixelFormat(ref.nFormat))
+			{
+				std::vector<BYTE> vPalette(sizeof(Gdiplus::ColorPalette) + ref.vPalette.size() * sizeof(Gdiplus::ARGB));
+				auto pPalette = (Gdiplus::ColorPalette*)vPalette.data();
+				pPalette->Flags = ref.nPaletteFlags;
+				pPalette->Count = (UINT)ref.vPalette.size();
+				memcpy(pPalette->Entries, ref.vPalette.data(), ref.vPalette.size() * sizeof(Gdiplus::ARGB));
+				bmp.SetPalette(pPalette);
+			}
+			if (!SaveAsPng(bmp, strFile))
+				strFile.clear();
+		}
+		break;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mtx);
+	auto& file = m_mapImages[nHash];
+	if (strFile.empty())
+	{
+		// With the references found while it was written
+		file.bFailed = true;
+		m_stats.nFailed += file.nReferences;
+		return;
+	}
+	++m_stats.nWritten;
+	file.strName = std::filesystem::path(strFile).filename().wstring();
+}
+
+static std::wstring CsvField(const std::wstring& str)
+{
+	if (str.find_first_of(L",\"\r\n") == std::wstring::npos)
+		return str;
+	std::wstring strQuoted = L"\"";
+	for (auto ch : str)
+	{
+		if (ch == L'"')
+			strQuoted += L'"';
+		strQuoted += ch;
+	}
+	strQuoted += L'"';
+	return strQuoted;
+}
+
+bool EMFImageExtractor::WriteManifest(LPCWSTR szPath) const
+{
+	std::vector<ManifestEntry> vEntries;
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		vEntries = m_vManifest;
+	}
+	// Workers finish in any order, sort for a stable manifest
+	std::sort(vEntries.begin(), vEntries.end(), [](const ManifestEntry& a, const ManifestEntry& b)
+		{
+			if (a.strSource != b.strSource)
+				return a.strSource < b.strSource;
+			if (a.strNestedPath != b.strNestedPath)
+				return a.strNestedPath < b.strNestedPath;
+			if (a.nRecIndex != b.nRecIndex)
+				return a.nRecIndex < b.nRecIndex;
+			return a.strOrigin < b.strOrigin;
+		});
+	std::wstring strCSV = L"image,source,nested_path,record_index,record_type,origin\r\n";
+	for (auto& entry : vEntries)
+	{
+		std::wstring strImage;
+		{
+			std::lock_guard<std::mutex> lock(m_mtx);
+			auto it = m_mapImages.find(entry.nHash);
+			if (it != m_mapImages.end())
+				strImage = it->second.strName;
+		}
+		if (strImage.empty())
+			continue;
+		strCSV += CsvField(strImage) + L",";
+		strCSV += CsvField(entry.strSource) + L",";
+		strCSV += CsvField(entry.strNestedPath) + L",";
+		// Record indices are 1-based, as in the record list and nested paths
+		strCSV += std::to_wstring(entry.nRecIndex + 1) + L",";
+		strCSV += CsvField(entry.strRecName) + L",";
+		strCSV += CsvField(entry.strOrigin) + L"\r\n";
+	}
+	CW2A strUTF8(strCSV.c_str(), CP_UTF8);
+	return WriteFileData(szPath, (LPCSTR)strUTF8, strlen(strUTF8));
+}
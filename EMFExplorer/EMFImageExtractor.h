@@ -0,0 +1,99 @@
+#ifndef EMF_IMAGE_EXTRACTOR_H
+#define EMF_IMAGE_EXTRACTOR_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "EMFAccess.h"
+#include "ThreadPool.h"
+
+// Pulls every embedded image out of one metafile or a whole corpus:
+// EMF+ image objects (and texture brushes), DIBs carried by the GDI/WMF
+// blit and pattern brush records, and nested metafiles (recursively),
+// EMR_COMMENT_WINDOWS_METAFILE/EMR_COMMENT_MULTIFORMATS payloads included.
+// Compressed images and metafiles are written in their native encoding,
+// raw DIBs and EMF+ pixel bitmaps are encoded as PNG. Files are named by
+// the content hash of the embedded payload so that duplicates are only
+// written once, and a manifest links every referencing record to its file.
+// Parsing, decoding and writing run on a thread pool.
+class EMFRecAccessGDIRecGdiComment;
+
+class EMFImageExtractor
+{
+public:
+	EMFImageExtractor(LPCWSTR szOutDir, unsigned nThreads = 0);
+	~EMFImageExtractor();
+public:
+	// Queues a metafile or a print spool file (each page on its own), or
+	// every .emf/.wmf/.spl file below a directory
+	bool AddPath(LPCWSTR szPath);
+
+	// Queues the images of an already loaded metafile, which must not be
+	// accessed elsewhere until Wait() returns
+	void AddEMF(std::shared_ptr<EMFAccess> emf, LPCWSTR szSource);
+
+	// Blocks until everything queued so far has been written
+	void Wait();
+
+	// CSV: image,source,nested_path,record_index,record_type,origin. The
+	// references to an image which couldn't be written are left out.
+	bool WriteManifest(LPCWSTR szPath) const;
+
+	struct Stats
+	{
+		size_t	nFiles			= 0;	// metafiles parsed (nested ones included)
+		size_t	nReferences		= 0;	// image references found
+		size_t	nWritten		= 0;	// unique images written
+		size_t	nFailed			= 0;	// references that could not be decoded or written
+	};
+	Stats GetStats() const;
+public:
+	struct ImageRef;
+private:
+	void ExtractFile(const std::wstring& strPath);
+
+	void CollectImages(EMFAccess* pEMF, const std::wstring& strSource);
+
+	void CollectPlusImage(EMFAccess* pEMF, const std::wstring& strSource, const EMFRecAccess* pRec,
+		const emfplus::OEmfPlusImage& img, LPCWSTR szOrigin);
+
+	void CollectEmbeddedMetafiles(EMFAccess* pEMF, const std::wstring& strSource,
+		const EMFRecAccessGDIRecGdiComment* pRec);
+
+	void CollectDIB(EMFAccess* pEMF, const std::wstring& strSource, const EMFRecAccess* pRec,
+		const BYTE* pBmi, size_t cbBmi, const BYTE* pBits, size_t cbBits, LPCWSTR szOrigin, bool bAlpha = false);
+
+	void SubmitImage(std::shared_ptr<ImageRef> ref);
+
+	void WriteImage(ImageRef& ref);
+private:
+	std::wstring			m_strOutDir;
+
+	struct ManifestEntry
+	{
+		uint64_t		nHash;
+		std::wstring	strSource;
+		std::wstring	strNestedPath;
+		size_t			nRecIndex;
+		std::wstring	strRecName;
+		std::wstring	strOrigin;
+	};
+	struct ImageFile
+	{
+		std::wstring	strName;		// empty while being written or if it failed
+		size_t			nReferences = 0;
+		bool			bFailed = false;
+	};
+	mutable std::mutex					m_mtx;
+	// Content hash -> file
+	std::unordered_map<uint64_t, ImageFile>	m_mapImages;
+	std::vector<ManifestEntry>			m_vManifest;
+	Stats								m_stats;
+
+	// Declared last so that the workers are joined before anything they use goes away
+	ThreadPool							m_pool;
+};
+
+#endif // EMF_IMAGE_EXTRACTOR_H
@@ -0,0 +1,99 @@
+#include "pch.h"
+#include "framework.h"
+#include "EMFMemoryUsage.h"
+#include "PropertyTree.h"
+
+#undef min
+#undef max
+
+void EMFMemoryUsage::Add(Category nCategory, size_t nBytes, emfplus::OEmfPlusRecordType nType)
+{
+	m_aCategories[nCategory] += nBytes;
+	m_nTotal += nBytes;
+	if (nType)
+		m_mapTypes[nType].nBytes += nBytes;
+}
+
+void EMFMemoryUsage::AddRecord(emfplus::OEmfPlusRecordType nType, LPCWSTR szName)
+{
+	auto& usage = m_mapTypes[nType];
+	usage.nType = nType;
+	usage.szName = szName;
+	++usage.nRecords;
+}
+
+void EMFMemoryUsage::Merge(const EMFMemoryUsage& usage)
+{
+	for (int ii = 0; ii < CategoryCount; ++ii)
+		m_aCategories[ii] += usage.m_aCategories[ii];
+	m_nTotal += usage.m_nTotal;
+	for (auto& [nType, typeUsage] : usage.m_mapTypes)
+	{
+		auto& merged = m_mapTypes[nType];
+		merged.nType = typeUsage.nType;
+		merged.szName = typeUsage.szName;
+		merged.nRecords += typeUsage.nRecords;
+		merged.nBytes += typeUsage.nBytes;
+	}
+}
+
+std::vector<EMFMemoryUsage::RecordTypeUsage> EMFMemoryUsage::GetTopRecordTypes(size_t nMax) const
+{
+	std::vector<RecordTypeUsage> vTypes;
+	vTypes.reserve(m_mapTypes.size());
+	for (auto& it : m_mapTypes)
+		vTypes.push_back(it.second);
+	std::sort(vTypes.begin(), vTypes.end(), [](const RecordTypeUsage& a, const RecordTypeUsage& b)
+		{
+			return a.nBytes != b.nBytes ? a.nBytes > b.nBytes : a.nType < b.nType;
+		});
+	if (vTypes.size() > nMax)
+		vTypes.resize(nMax);
+	return vTypes;
+}
+
+LPCWSTR EMFMemoryUsage::GetCategoryName(Category nCategory)
+{
+	static const LPCWSTR aNames[] = {
+		L"Records", L"Record data", L"Decoded objects", L"Property trees",
+		L"Images", L"Metafile", L"Nested metafiles",
+	};
+	static_assert(_countof(aNames) == CategoryCount);
+	return aNames[nCategory];
+}
+
+std::wstring EMFMemoryUsage::FormatReport(size_t nTop) const
+{
+	std::wstring str;
+	wchar_t szLine[256];
+	swprintf_s(szLine, L"Total: %zu bytes\n", m_nTotal);
+	str += szLine;
+	for (int ii = 0; ii < CategoryCount; ++ii)
+	{
+		swprintf_s(szLine, L"  %-18s %12zu\n", GetCategoryName((Category)ii), m_aCategories[ii]);
+		str += szLine;
+	}
+	auto vTypes = GetTopRecordTypes(nTop);
+	if (!vTypes.empty())
+		str += L"Top record types:\n";
+	for (auto& usage : vTypes)
+	{
+		swprintf_s(szLine, L"  %-32s %8zu record(s) %12zu\n", usage.szName ? usage.szName : L"?",
+			usage.nRecords, usage.nBytes);
+		str += szLine;
+	}
+	return str;
+}
+
+size_t EMFMemoryUsage::GetPropertyTreeSize(const PropertyNode* pNode)
+{
+	if (!pNode)
+		return 0;
+	// The node, with the control block of its shared_ptr
+	size_t nSize = sizeof(PropertyNode) + 2 * sizeof(void*);
+	nSize += (pNode->name.GetAllocLength() + pNode->text.GetAllocLength()) * sizeof(wchar_t);
+	nSize += pNode->sub.capacity() * sizeof(std::shared_ptr<PropertyNode>);
+	for (auto& pSub : pNode->sub)
+		nSize += GetPropertyTreeSize(pSub.get());
+	return nSize;
+}
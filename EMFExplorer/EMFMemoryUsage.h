@@ -0,0 +1,67 @@
+#ifndef EMF_MEMORY_USAGE_H
+#define EMF_MEMORY_USAGE_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "GdiplusEnums.h"
+
+struct PropertyNode;
+
+// Bytes held by documents, by category and by record type.
+// Nothing is tracked while the documents are in use: the objects report
+// their sizes when asked to (EMFAccess::ReportMemoryUsage), so a report
+// costs a walk of the records and nothing otherwise. The sizes are those
+// of the buffers and of the fixed parts of the objects, heap overhead is
+// left out.
+class EMFMemoryUsage
+{
+public:
+	enum Category
+	{
+		CategoryRecords,		// record objects, the tables of the document
+		CategoryRecordData,		// copies of the record data
+		CategoryDecoded,		// structs decoded from the data (EMF+ objects)
+		CategoryProperties,		// cached property trees
+		CategoryImages,			// GDI+ images
+		CategoryMetafile,		// bytes of the document, the GDI+ metafile
+		CategoryNested,			// payloads and documents of the nested metafile cache
+		CategoryCount,
+	};
+
+	struct RecordTypeUsage
+	{
+		emfplus::OEmfPlusRecordType	nType;
+		LPCWSTR						szName;
+		size_t						nRecords;
+		size_t						nBytes;
+	};
+public:
+	// nBytes of the category, held by a record of type nType unless it's 0
+	void Add(Category nCategory, size_t nBytes, emfplus::OEmfPlusRecordType nType = (emfplus::OEmfPlusRecordType)0);
+
+	void AddRecord(emfplus::OEmfPlusRecordType nType, LPCWSTR szName);
+
+	void Merge(const EMFMemoryUsage& usage);
+
+	inline size_t GetTotal() const { return m_nTotal; }
+
+	inline size_t GetCategory(Category nCategory) const { return m_aCategories[nCategory]; }
+
+	// Most memory first
+	std::vector<RecordTypeUsage> GetTopRecordTypes(size_t nMax) const;
+
+	static LPCWSTR GetCategoryName(Category nCategory);
+
+	// Totals, categories and the nTop record types, one per line
+	std::wstring FormatReport(size_t nTop) const;
+
+	// Nodes of the tree, their names and texts
+	static size_t GetPropertyTreeSize(const PropertyNode* pNode);
+private:
+	size_t	m_aCategories[CategoryCount] = {};
+	size_t	m_nTotal = 0;
+	std::unordered_map<emfplus::u32t, RecordTypeUsage>	m_mapTypes;
+};
+
+#endif // EMF_MEMORY_USAGE_H
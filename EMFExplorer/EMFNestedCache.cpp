@@ -0,0 +1,197 @@
+#include "pch.h"
+#include "framework.h"
+#include "EMFNestedCache.h"
+#include "EMFAccess.h"
+#include "DataHash.h"
+#include "EMFMemoryUsage.h"
+
+#undef min
+#undef max
+
+// Rough size of a parsed record besides its data (record object, cached
+// properties), used to estimate what a document holds.
+constexpr size_t RecordCostEstimate = 256;
+
+static size_t EstimateCost(const EMFNestedCache::Entry& entry, const EMFAccess& emf)
+{
+	// The metafile object keeps its own copy of the bytes, the records another one
+	auto nSize = entry.GetData().size();
+	return nSize + (emf.GetRecordCount() ? nSize + emf.GetRecordCount() * RecordCostEstimate : 0);
+}
+
+EMFNestedCache& EMFNestedCache::Instance()
+{
+	static EMFNestedCache cache;
+	return cache;
+}
+
+EMFNestedCache::EntryPtr EMFNestedCache::AddPayload(const void* pData, size_t nSize)
+{
+	if (!pData || !nSize)
+		return nullptr;
+	auto nHash = data_access::GetHash64(pData, nSize);
+	std::lock_guard<std::mutex> lock(m_mtx);
+	auto range = m_mapEntries.equal_range(nHash);
+	for (auto it = range.first; it != range.second; )
+	{
+		auto entry = it->second.lock();
+		if (!entry)
+		{
+			it = m_mapEntries.erase(it);
+			continue;
+		}
+		// A hash collision must not alias two documents
+		if (entry->m_data.size() == nSize && memcmp(entry->m_data.data(), pData, nSize) == 0)
+			return entry;
+		++it;
+	}
+	auto entry = std::make_shared<Entry>();
+	entry->m_nHash = nHash;
+	entry->m_data.assign((const emfplus::u8t*)pData, (const emfplus::u8t*)pData + nSize);
+	m_mapEntries.emplace(nHash, entry);
+	if (m_mapEntries.size() >= m_nPurgeThreshold)
+		PurgeExpired();
+	return entry;
+}
+
+std::shared_ptr<EMFAccess> EMFNestedCache::GetEMFAccess(const EntryPtr& entry)
+{
+	if (!entry)
+		return nullptr;
+	std::shared_ptr<EMFAccess> emf;
+	bool bHit = true;
+	{
+		std::lock_guard<std::mutex> lock(entry->m_mtxParse);
+		emf = entry->m_wpEMF.lock();
+		if (!emf)
+		{
+			emf = std::make_shared<EMFAccess>(entry->m_data);
+			entry->m_wpEMF = emf;
+			bHit = false;
+		}
+	}
+	Touch(entry, emf, bHit);
+	return emf;
+}
+
+void EMFNestedCache::Touch(const EntryPtr& entry, const std::shared_ptr<EMFAccess>& emf, bool bHit)
+{
+	// Documents are destroyed outside of the lock
+	std::vector<std::shared_ptr<EMFAccess>> vEvicted;
+	std::lock_guard<std::mutex> lock(m_mtx);
+	if (bHit)
+		++m_nHits;
+	else
+		++m_nMisses;
+	if (entry->m_bInLRU)
+	{
+		m_lru.splice(m_lru.begin(), m_lru, entry->m_itLRU);
+		m_nMemory -= entry->m_nCost;
+	}
+	else
+	{
+		m_lru.push_front(entry);
+		entry->m_itLRU = m_lru.begin();
+		entry->m_bInLRU = true;
+	}
+	entry->m_emf = emf;
+	// The records may have been read since the last time
+	entry->m_nCost = EstimateCost(*entry, *emf);
+	m_nMemory += entry->m_nCost;
+	Trim(vEvicted);
+}
+
+void EMFNestedCache::Trim(std::vector<std::shared_ptr<EMFAccess>>& vEvicted)
+{
+	// The most recent document is kept even if it's over the budget alone
+	while (m_nMemory > m_nBudget && m_lru.size() > 1)
+	{
+		auto entry = m_lru.back();
+		m_lru.pop_back();
+		entry->m_bInLRU = false;
+		m_nMemory -= entry->m_nCost;
+		entry->m_nCost = 0;
+		vEvicted.push_back(std::move(entry->m_emf));
+		++m_nEvictions;
+	}
+}
+
+void EMFNestedCache::PurgeExpired()
+{
+	for (auto it = m_mapEntries.begin(); it != m_mapEntries.end(); )
+	{
+		if (it->second.expired())
+			it = m_mapEntries.erase(it);
+		else
+			++it;
+	}
+	m_nPurgeThreshold = std::max<size_t>(64, m_mapEntries.size() * 2);
+}
+
+void EMFNestedCache::SetMemoryBudget(size_t nBytes)
+{
+	std::vector<std::shared_ptr<EMFAccess>> vEvicted;
+	std::lock_guard<std::mutex> lock(m_mtx);
+	m_nBudget = nBytes;
+	Trim(vEvicted);
+}
+
+size_t EMFNestedCache::GetMemoryBudget() const
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	return m_nBudget;
+}
+
+EMFNestedCache::Stats EMFNestedCache::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	size_t nEntries = 0;
+	for (auto& it : m_mapEntries)
+	{
+		if (!it.second.expired())
+			++nEntries;
+	}
+	return Stats{ nEntries, m_lru.size(), m_nMemory, m_nHits, m_nMisses, m_nEvictions };
+}
+
+void EMFNestedCache::ReportMemoryUsage(EMFMemoryUsage& usage) const
+{
+	size_t nPayloads = 0;
+	std::vector<std::shared_ptr<EMFAccess>> vDocs;
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		for (auto& it : m_mapEntries)
+		{
+			auto entry = it.second.lock();
+			if (!entry)
+				continue;
+			nPayloads += sizeof(Entry) + entry->m_data.capacity();
+			std::lock_guard<std::mutex> lockParse(entry->m_mtxParse);
+			if (auto emf = entry->m_wpEMF.lock())
+				vDocs.push_back(std::move(emf));
+		}
+	}
+	usage.Add(EMFMemoryUsage::CategoryNested, nPayloads);
+	// The documents are walked outside of the lock
+	for (auto& emf : vDocs)
+	{
+		EMFMemoryUsage docUsage;
+		emf->ReportMemoryUsage(docUsage);
+		usage.Add(EMFMemoryUsage::CategoryNested, docUsage.GetTotal());
+	}
+}
+
+void EMFNestedCache::Clear()
+{
+	std::vector<std::shared_ptr<EMFAccess>> vEvicted;
+	std::lock_guard<std::mutex> lock(m_mtx);
+	for (auto& entry : m_lru)
+	{
+		entry->m_bInLRU = false;
+		entry->m_nCost = 0;
+		vEvicted.push_back(std::move(entry->m_emf));
+	}
+	m_nEvictions += m_lru.size();
+	m_lru.clear();
+	m_nMemory = 0;
+}
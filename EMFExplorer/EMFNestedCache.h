@@ -0,0 +1,104 @@
+#ifndef EMF_NESTED_CACHE_H
+#define EMF_NESTED_CACHE_H
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "EmfPlusStruct.h"
+
+class EMFAccess;
+class EMFMemoryUsage;
+
+// Per-process cache of the metafiles embedded in other metafiles (EMF+
+// metafile images), keyed by the content hash of their payload.
+//
+// Identical payloads share one entry holding a single copy of the bytes,
+// and one EMFAccess which is only created when it's asked for (the nested
+// metafile is rendered or expanded). The shared EMFAccess has no nested
+// path, the same payload may be reached from many places: each reference
+// names it where it's opened (CEMFExplorerDoc::GetNestedPath).
+// Parsed documents are dropped least recently used first once they take
+// more than the memory budget; a document still in use elsewhere stays
+// alive and is handed out again instead of being parsed a second time.
+// No UI is involved, so it can be used by the batch commands too.
+class EMFNestedCache
+{
+public:
+	class Entry
+	{
+	public:
+		inline uint64_t GetHash() const { return m_nHash; }
+		inline const emfplus::memory_vector& GetData() const { return m_data; }
+	private:
+		friend class EMFNestedCache;
+		uint64_t					m_nHash = 0;
+		emfplus::memory_vector		m_data;
+		// Serializes the parsing of this entry only
+		std::mutex					m_mtxParse;
+		std::weak_ptr<EMFAccess>	m_wpEMF;
+		// The following are guarded by the cache
+		std::shared_ptr<EMFAccess>	m_emf;		// held while in the LRU list
+		size_t						m_nCost = 0;
+		bool						m_bInLRU = false;
+		std::list<std::shared_ptr<Entry>>::iterator	m_itLRU;
+	};
+	using EntryPtr = std::shared_ptr<Entry>;
+
+	struct Stats
+	{
+		size_t	nEntries;		// distinct payloads alive
+		size_t	nParsed;		// documents held by the cache
+		size_t	nMemory;		// estimated size of those documents
+		size_t	nHits;
+		size_t	nMisses;		// documents parsed
+		size_t	nEvictions;
+	};
+
+	enum : size_t {
+		DefaultMemoryBudget = 256 * 1024 * 1024,
+	};
+
+	static EMFNestedCache& Instance();
+public:
+	// Entry of the payload, identical payloads get the same entry. The bytes
+	// are copied the first time only, nothing is parsed.
+	EntryPtr AddPayload(const void* pData, size_t nSize);
+	EntryPtr AddPayload(const emfplus::memory_vector& data)
+	{
+		return AddPayload(data.data(), data.size());
+	}
+
+	// Document of the entry, parsed on first use
+	std::shared_ptr<EMFAccess> GetEMFAccess(const EntryPtr& entry);
+
+	void SetMemoryBudget(size_t nBytes);
+	size_t GetMemoryBudget() const;
+
+	Stats GetStats() const;
+
+	// Adds the payloads and the parsed documents alive, in use or not, to
+	// EMFMemoryUsage::CategoryNested of usage
+	void ReportMemoryUsage(EMFMemoryUsage& usage) const;
+
+	// Drops every parsed document held by the cache
+	void Clear();
+private:
+	void Touch(const EntryPtr& entry, const std::shared_ptr<EMFAccess>& emf, bool bHit);
+	void Trim(std::vector<std::shared_ptr<EMFAccess>>& vEvicted);
+	void PurgeExpired();
+private:
+	mutable std::mutex	m_mtx;
+	std::unordered_multimap<uint64_t, std::weak_ptr<Entry>>	m_mapEntries;
+	size_t				m_nPurgeThreshold = 64;
+	// Most recently used first
+	std::list<EntryPtr>	m_lru;
+	size_t				m_nMemory = 0;
+	size_t				m_nBudget = DefaultMemoryBudget;
+	size_t				m_nHits = 0;
+	size_t				m_nMisses = 0;
+	size_t				m_nEvictions = 0;
+};
+
+#endif // EMF_NESTED_CACHE_H
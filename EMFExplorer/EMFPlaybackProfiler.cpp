@@ -0,0 +1,200 @@
+#include "pch.h"
+#include "framework.h"
+#include "EMFPlaybackProfiler.h"
+#include "EMFAccess.h"
+
+#undef min
+#undef max
+
+using namespace emfplus;
+
+class EMFGdiplusPlaybackBackend : public EMFPlaybackProfiler::Backend
+{
+public:
+	explicit EMFGdiplusPlaybackBackend(UINT nMaxSize) : m_nMaxSize(nMaxSize) {}
+public:
+	LPCWSTR GetName() const override { return L"GDI+"; }
+
+	bool Play(const EMFAccess& emf, const std::function<void(size_t nRecord, double fTime)>& fnTime) override;
+private:
+	UINT	m_nMaxSize;
+};
+
+struct EnumProfileEmfPlusContext
+{
+	Gdiplus::Metafile*	pMetafile;
+	const std::function<void(size_t nRecord, double fTime)>*	pfnTime;
+	double				fFreq;
+	size_t				nCurRecIdx;
+};
+
+extern "C"
+BOOL CALLBACK EnumProfileMetafilePlusProc(Gdiplus::EmfPlusRecordType type, UINT flags, UINT dataSize, const BYTE* data, VOID* pCallbackData)
+{
+	auto& ctxt = *(EnumProfileEmfPlusContext*)pCallbackData;
+	LARGE_INTEGER nStart, nEnd;
+	QueryPerformanceCounter(&nStart);
+	ctxt.pMetafile->PlayRecord(type, flags, dataSize, data);
+	QueryPerformanceCounter(&nEnd);
+	(*ctxt.pfnTime)(ctxt.nCurRecIdx++, (double)(nEnd.QuadPart - nStart.QuadPart) / ctxt.fFreq);
+	return TRUE;
+}
+
+bool EMFGdiplusPlaybackBackend::Play(const EMFAccess& emf, const std::function<void(size_t nRecord, double fTime)>& fnTime)
+{
+	// Records are played on a metafile of their own, as they're enumerated
+	std::unique_ptr<Gdiplus::Image> pMetafile(emf.CloneMetafile());
+	if (!pMetafile)
+		return false;
+	auto& hdr = emf.GetMetafileHeader();
+	CSize szEMF(std::max(hdr.Width, 1), std::max(hdr.Height, 1));
+	CRect rcDraw = GetFitRect(CRect(0, 0, m_nMaxSize, m_nMaxSize), szEMF);
+	if (szEMF.cx <= (LONG)m_nMaxSize && szEMF.cy <= (LONG)m_nMaxSize)
+		rcDraw.SetRect(0, 0, szEMF.cx, szEMF.cy);
+	Gdiplus::Bitmap bmp(std::max(rcDraw.Width(), 1), std::max(rcDraw.Height(), 1), PixelFormat32bppPARGB);
+	Gdiplus::Graphics gg(&bmp);
+	gg.Clear(Gdiplus::Color::White);
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	EnumProfileEmfPlusContext ctxt{ (Gdiplus::Metafile*)pMetafile.get(), &fnTime, (double)freq.QuadPart, 0 };
+	Gdiplus::Rect rcDrawP(rcDraw.left, rcDraw.top, rcDraw.Width(), rcDraw.Height());
+	return gg.EnumerateMetafile(ctxt.pMetafile, rcDrawP, EnumProfileMetafilePlusProc, (void*)&ctxt) == Gdiplus::Ok;
+}
+
+std::unique_ptr<EMFPlaybackProfiler::Backend> EMFPlaybackProfiler::CreateGdiplusBackend(UINT nMaxSize)
+{
+	return std::make_unique<EMFGdiplusPlaybackBackend>(nMaxSize);
+}
+
+EMFPlaybackProfiler::EMFPlaybackProfiler(std::unique_ptr<Backend> pBackend)
+	: m_pBackend(std::move(pBackend))
+{
+}
+
+bool EMFPlaybackProfiler::Profile(const EMFAccess& emf, unsigned nRepeat)
+{
+	m_vCosts.clear();
+	m_vCosts.reserve(emf.GetRecordCount());
+	for (size_t ii = 0; ii < emf.GetRecordCount(); ++ii)
+		m_vCosts.push_back(RecordCost{ ii, 0, DBL_MAX, 0 });
+	m_nPlays = 0;
+	m_fPlayTotal = 0;
+	if (!m_pBackend || !nRepeat)
+		return false;
+	for (unsigned nPlay = 0; nPlay < nRepeat; ++nPlay)
+	{
+		bool bPlayed = m_pBackend->Play(emf, [this](size_t nRecord, double fTime)
+			{
+				m_fPlayTotal += fTime;
+				// The indices match those of EMFAccess, as for DrawMetafileUntilRecord
+				if (nRecord >= m_vCosts.size())
+					return;
+				auto& cost = m_vCosts[nRecord];
+				cost.fTotal += fTime;
+				cost.fMin = std::min(cost.fMin, fTime);
+				++cost.nPlays;
+			});
+		if (!bPlayed)
+			return false;
+		++m_nPlays;
+	}
+	return true;
+}
+
+double EMFPlaybackProfiler::GetPlayTime() const
+{
+	return m_nPlays ? m_fPlayTotal / m_nPlays : 0;
+}
+
+std::vector<EMFPlaybackProfiler::RecordCost> EMFPlaybackProfiler::GetRanked(size_t nMax) const
+{
+	std::vector<RecordCost> vRanked;
+	for (auto& cost : m_vCosts)
+	{
+		if (cost.nPlays)
+			vRanked.push_back(cost);
+	}
+	std::sort(vRanked.begin(), vRanked.end(), [](const RecordCost& a, const RecordCost& b)
+		{
+			return a.GetMean() != b.GetMean() ? a.GetMean() > b.GetMean() : a.nIndex < b.nIndex;
+		});
+	if (vRanked.size() > nMax)
+		vRanked.resize(nMax);
+	return vRanked;
+}
+
+std::wstring EMFPlaybackProfiler::FormatTable(const EMFAccess& emf, size_t nTop) const
+{
+	std::wstring str;
+	wchar_t szLine[256];
+	swprintf_s(szLine, L"%s playback: %.3f ms, %u play(s)\n", m_pBackend ? m_pBackend->GetName() : L"",
+		GetPlayTime() * 1e3, m_nPlays);
+	str += szLine;
+	swprintf_s(szLine, L"%8s  %-32s %12s %12s %7s\n", L"Record", L"Type", L"Mean (us)", L"Min (us)", L"Share");
+	str += szLine;
+	double fPlayTime = GetPlayTime();
+	for (auto& cost : GetRanked(nTop))
+	{
+		auto pRec = emf.GetRecord(cost.nIndex);
+		swprintf_s(szLine, L"%8zu  %-32s %12.1f %12.1f %6.1f%%\n", cost.nIndex + 1, pRec ? pRec->GetRecordName() : L"?",
+			cost.GetMean() * 1e6, cost.fMin * 1e6, fPlayTime > 0 ? cost.GetMean() * 100 / fPlayTime : 0.);
+		str += szLine;
+	}
+	return str;
+}
+
+// Kind of the EMF+ image object created by pRec, nullptr if it isn't one
+static LPCWSTR GetImageObjectKind(const EMFRecAccess* pRec)
+{
+	if (!pRec || pRec->GetRecordType() != EmfPlusRecordTypeObject)
+		return nullptr;
+	auto& rec = pRec->GetRecInfo();
+	if (OEmfPlusRecObjectReader::GetObjectType(rec) != OObjType::Image)
+		return nullptr;
+	// Version and Type, after TotalObjectSize when continued
+	size_t nOffset = (rec.Flags & OEmfPlusRecObjectReader::FlagContinueObj) ? 8 : 4;
+	if (rec.DataSize < nOffset + sizeof(u32t))
+		return nullptr;
+	switch ((OImageDataType)*(const u32t*)(rec.Data + nOffset))
+	{
+	case OImageDataType::Bitmap:
+		return L"Bitmap";
+	case OImageDataType::Metafile:
+		return L"Metafile";
+	default:
+		return nullptr;
+	}
+}
+
+bool EMFPlaybackProfiler::WriteFoldedStacks(const EMFAccess& emf, LPCWSTR szRoot, LPCWSTR szPath) const
+{
+	FILE* fp = nullptr;
+	if (_wfopen_s(&fp, szPath, L"wb") != 0 || !fp)
+		return false;
+	// Frames are separated by ';', the count by the last space
+	auto GetFrame = [](LPCWSTR szFrame)
+	{
+		CStringW str(szFrame);
+		str.Replace(L';', L'_');
+		str.Replace(L' ', L'_');
+		return CStringA(CW2A(str, CP_UTF8));
+	};
+	CStringA strRoot = GetFrame(szRoot && *szRoot ? szRoot : L"metafile");
+	for (auto& cost : m_vCosts)
+	{
+		auto nNanoSeconds = (unsigned long long)(cost.GetMean() * 1e9 + 0.5);
+		auto pRec = emf.GetRecord(cost.nIndex);
+		if (!nNanoSeconds || !pRec)
+			continue;
+		CStringA strStack;
+		strStack.Format("%s;#%zu:%s", (LPCSTR)strRoot, cost.nIndex + 1, (LPCSTR)GetFrame(pRec->GetRecordName()));
+		// What the record decodes or draws is under it
+		auto szKind = GetImageObjectKind(pRec);
+		if (!szKind)
+			szKind = GetImageObjectKind(pRec->GetLinkedRecord(EMFRecAccess::LinkedObjTypeImage));
+		if (szKind)
+			strStack += ";" + GetFrame(szKind);
+		fprintf(fp, "%s %llu\n", (LPCSTR)strStack, nNanoSeconds);
+	}
+	return fclose(fp) == 0;
+}
@@ -0,0 +1,68 @@
+#ifndef EMF_PLAYBACK_PROFILER_H
+#define EMF_PLAYBACK_PROFILER_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class EMFAccess;
+
+// Cost of playing each record of a metafile, to find the few that make it
+// slow to preview or print. The metafile is played nRepeat times by a
+// backend timing every record. Whatever a record triggers (decoding its
+// image, playing a nested metafile) is part of its time.
+class EMFPlaybackProfiler
+{
+public:
+	// Plays the records, one at a time
+	class Backend
+	{
+	public:
+		virtual ~Backend() = default;
+
+		virtual LPCWSTR GetName() const = 0;
+
+		// Plays all the records of emf once, calling fnTime with the index
+		// and the time, in seconds, of each record played
+		virtual bool Play(const EMFAccess& emf, const std::function<void(size_t nRecord, double fTime)>& fnTime) = 0;
+	};
+
+	// GDI+ drawing to a bitmap of at most nMaxSize pixels a side
+	static std::unique_ptr<Backend> CreateGdiplusBackend(UINT nMaxSize = 2048);
+
+	explicit EMFPlaybackProfiler(std::unique_ptr<Backend> pBackend);
+public:
+	struct RecordCost
+	{
+		size_t	nIndex;
+		double	fTotal;		// seconds, all the plays together
+		double	fMin;		// seconds, the fastest play
+		size_t	nPlays;
+
+		inline double GetMean() const { return nPlays ? fTotal / nPlays : 0; }
+	};
+
+	// The records of emf must be read
+	bool Profile(const EMFAccess& emf, unsigned nRepeat);
+
+	// Mean time of a whole play, in seconds
+	double GetPlayTime() const;
+
+	// Highest mean first
+	std::vector<RecordCost> GetRanked(size_t nMax) const;
+
+	// The nTop records costing the most, with their share of the play
+	std::wstring FormatTable(const EMFAccess& emf, size_t nTop) const;
+
+	// Folded stacks (flamegraph.pl, speedscope) of the mean nanoseconds of
+	// each record: "<root>;#<index>:<record>[;<what it plays>] <ns>"
+	bool WriteFoldedStacks(const EMFAccess& emf, LPCWSTR szRoot, LPCWSTR szPath) const;
+private:
+	std::unique_ptr<Backend>	m_pBackend;
+	std::vector<RecordCost>		m_vCosts;
+	unsigned					m_nPlays = 0;
+	double						m_fPlayTotal = 0;
+};
+
+#endif // EMF_PLAYBACK_PROFILER_H
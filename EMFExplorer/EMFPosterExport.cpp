@@ -0,0 +1,136 @@
+#include "pch.h"
+#include "framework.h"
+#include "EMFPosterExport.h"
+#include "EMFAccess.h"
+#include "EMFTrace.h"
+#include "ThreadPool.h"
+#include <condition_variable>
+
+#undef min
+#undef max
+
+CSize EMFPosterExport::GetPixelSize(const EMFAccessBase& emf, double fDpi)
+{
+	auto& hdr = emf.GetMetafileHeader();
+	if (hdr.DpiX <= 0 || hdr.DpiY <= 0)
+		return CSize(0, 0);
+	return CSize((int)ceil(hdr.Width * fDpi / hdr.DpiX), (int)ceil(hdr.Height * fDpi / hdr.DpiY));
+}
+
+bool EMFPosterExport::RenderBand(const EMFAccessBase& emf, const emfpng::OImageFormat& fmt, UINT nTop, UINT nRows,
+	bool bLast, emfpng::OEncodedBand& band)
+{
+	EMF_TRACE_SCOPE_INDEX("RenderBand", "render", nTop);
+	std::unique_ptr<Gdiplus::Image> pMetafile;
+	{
+		std::lock_guard<std::mutex> lock(m_mtxClone);
+		pMetafile.reset(emf.CloneMetafile());
+	}
+	if (!pMetafile)
+		return false;
+	Gdiplus::Bitmap bmp(fmt.nWidth, nRows, PixelFormat32bppARGB);
+	if (bmp.GetLastStatus() != Gdiplus::Ok)
+		return false;
+	{
+		Gdiplus::Graphics gg(&bmp);
+		gg.SetCompositingQuality(Gdiplus::CompositingQualityHighQuality);
+		gg.SetInterpolationMode(Gdiplus::InterpolationModeHighQualityBicubic);
+		gg.SetSmoothingMode(Gdiplus::SmoothingModeAntiAlias8x8);
+		gg.SetTextRenderingHint(Gdiplus::TextRenderingHintAntiAliasGridFit);
+		gg.Clear(fmt.bAlpha ? Gdiplus::Color(0, 0, 0, 0) : Gdiplus::Color(Gdiplus::Color::White));
+		// The whole image is drawn shifted up, GDI+ clips it to the band
+		Gdiplus::RectF rcDraw(0, -(Gdiplus::REAL)nTop, (Gdiplus::REAL)fmt.nWidth, (Gdiplus::REAL)fmt.nHeight);
+		if (gg.DrawImage(pMetafile.get(), rcDraw) != Gdiplus::Ok)
+			return false;
+	}
+	Gdiplus::BitmapData data;
+	Gdiplus::Rect rcLock(0, 0, (INT)fmt.nWidth, (INT)nRows);
+	if (bmp.LockBits(&rcLock, Gdiplus::ImageLockModeRead, PixelFormat32bppARGB, &data) != Gdiplus::Ok)
+		return false;
+	{
+		EMF_TRACE_SCOPE_INDEX("EncodeBand", "render", nTop);
+		emfpng::EncodeBand(fmt, (const uint8_t*)data.Scan0, data.Stride, nRows, bLast, band);
+	}
+	bmp.UnlockBits(&data);
+	return true;
+}
+
+bool EMFPosterExport::Export(const EMFAccessBase& emf, LPCWSTR szPath)
+{
+	EMF_TRACE_SCOPE("PosterExport", "render");
+	m_stats = {};
+	m_bCancel = false;
+	auto sz = GetPixelSize(emf, m_options.fDpi);
+	// GDI+ strides are INTs
+	if (sz.cx <= 0 || sz.cy <= 0 || sz.cx > INT_MAX / 4)
+		return false;
+	emfpng::OImageFormat fmt{ (uint32_t)sz.cx, (uint32_t)sz.cy, m_options.bAlpha };
+	UINT nBandRows = m_options.nBandRows;
+	if (!nBandRows)
+		nBandRows = (UINT)std::max<size_t>(16, BandMemory / ((size_t)fmt.nWidth * 4));
+	nBandRows = std::min(nBandRows, fmt.nHeight);
+	size_t nBands = (fmt.nHeight + nBandRows - 1) / nBandRows;
+
+	FILE* fp = nullptr;
+	if (_wfopen_s(&fp, szPath, L"wb") || !fp)
+		return false;
+	emfpng::OPngWriter writer([fp](const void* pData, size_t nSize)
+		{
+			return fwrite(pData, 1, nSize, fp) == nSize;
+		});
+	bool bRet = writer.Begin(fmt, m_options.fDpi);
+
+	enum BandState : char { BandPending, BandDone, BandFailed };
+	std::vector<std::unique_ptr<emfpng::OEncodedBand>> vBands(nBands);
+	std::vector<BandState> vStates(nBands, BandPending);
+	std::mutex mtxBands;
+	std::condition_variable cvBand;
+	{
+		ThreadPool pool(m_options.nThreads);
+		size_t nWindow = pool.GetThreadCount() * BandsPerThread;
+		size_t nSubmitted = 0;
+		for (size_t nBand = 0; nBand < nBands && bRet; ++nBand)
+		{
+			// Bands are drawn ahead of the one written, up to the window
+			for (; nSubmitted < nBands && nSubmitted < nBand + nWindow; ++nSubmitted)
+			{
+				pool.Submit([&, nSubmitted]()
+					{
+						auto pBand = std::make_unique<emfpng::OEncodedBand>();
+						UINT nTop = (UINT)nSubmitted * nBandRows;
+						UINT nRows = std::min(nBandRows, fmt.nHeight - nTop);
+						bool bOK = !m_bCancel && RenderBand(emf, fmt, nTop, nRows, nSubmitted + 1 == nBands, *pBand);
+						std::lock_guard<std::mutex> lock(mtxBands);
+						vBands[nSubmitted] = std::move(pBand);
+						vStates[nSubmitted] = bOK ? BandDone : BandFailed;
+						cvBand.notify_all();
+					});
+			}
+			std::unique_ptr<emfpng::OEncodedBand> pBand;
+			{
+				std::unique_lock<std::mutex> lock(mtxBands);
+				cvBand.wait(lock, [&] { return vStates[nBand] != BandPending; });
+				bRet = vStates[nBand] == BandDone;
+				pBand = std::move(vBands[nBand]);
+			}
+			bRet = bRet && writer.AddBand(*pBand);
+		}
+		if (!bRet)
+			m_bCancel = true;
+		pool.Wait();
+		m_stats.nPeakMemory = std::min(nWindow, nBands) * (size_t)fmt.nWidth * nBandRows * (4 + (fmt.bAlpha ? 4 : 3));
+	}
+	bRet = bRet && writer.End();
+	bRet = fclose(fp) == 0 && bRet;
+	if (!bRet)
+	{
+		DeleteFileW(szPath);
+		return false;
+	}
+	m_stats.nWidth = fmt.nWidth;
+	m_stats.nHeight = fmt.nHeight;
+	m_stats.nBandRows = nBandRows;
+	m_stats.nBands = nBands;
+	m_stats.nFileSize = writer.GetWrittenSize();
+	return true;
+}
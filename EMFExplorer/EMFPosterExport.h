@@ -0,0 +1,62 @@
+#ifndef EMF_POSTER_EXPORT_H
+#define EMF_POSTER_EXPORT_H
+
+#include <atomic>
+#include <mutex>
+#include "EmfPng.h"
+
+class EMFAccessBase;
+
+// Renders a metafile to a PNG at any DPI, a band of rows at a time, for
+// sizes a single bitmap can't hold (an A0 plot at 600 DPI is 20000 x 28000
+// pixels). The bands are drawn with GDI+ and encoded (emfpng::EncodeBand)
+// on a thread pool, each from its own copy of the metafile, and written in
+// order; only a couple of bands per thread are in memory at once.
+class EMFPosterExport
+{
+public:
+	struct Options
+	{
+		double		fDpi		= 300;
+		UINT		nBandRows	= 0;		// as many as make BandMemory
+		unsigned	nThreads	= 0;		// one per core
+		bool		bAlpha		= false;	// transparent background, on white otherwise
+	};
+
+	struct Stats
+	{
+		UINT		nWidth;
+		UINT		nHeight;
+		UINT		nBandRows;
+		size_t		nBands;
+		uint64_t	nFileSize;
+		size_t		nPeakMemory;	// estimated, the bands in memory at once
+	};
+
+	enum : size_t {
+		// Size of the bitmap of a band when the rows aren't given
+		BandMemory = 16 * 1024 * 1024,
+		// Bands queued or encoded, and not written yet, per thread
+		BandsPerThread = 2,
+	};
+
+	explicit EMFPosterExport(const Options& options) : m_options(options) {}
+public:
+	// Size in pixels of the metafile at fDpi, from its size and resolution
+	static CSize GetPixelSize(const EMFAccessBase& emf, double fDpi);
+
+	bool Export(const EMFAccessBase& emf, LPCWSTR szPath);
+
+	inline const Stats& GetStats() const { return m_stats; }
+private:
+	bool RenderBand(const EMFAccessBase& emf, const emfpng::OImageFormat& fmt, UINT nTop, UINT nRows,
+		bool bLast, emfpng::OEncodedBand& band);
+private:
+	Options				m_options;
+	Stats				m_stats{};
+	// CloneMetafile uses the one GDI+ object of the document
+	std::mutex			m_mtxClone;
+	std::atomic<bool>	m_bCancel = false;
+};
+
+#endif // EMF_POSTER_EXPORT_H
@@ -3,9 +3,51 @@
 #include "EMFRecAccess.h"
 #include "EMFAccess.h"
 #include "EMFStruct2Props.h"
+#include "DataHash.h"
+#include "EMFMemoryUsage.h"
+#include "EMFTrace.h"
+
+#undef min
+#undef max
 
 using namespace emfplus;
 
+void EMFRecordTextSink::Append(LPCWSTR pszText, size_t nLength)
+{
+	if (nLength)
+		memcpy(AppendBuffer(nLength), pszText, nLength * sizeof(wchar_t));
+}
+
+void EMFRecordTextSink::AppendA(LPCSTR pszText, size_t nLength)
+{
+	if (!nLength || nLength > INT_MAX)
+		return;
+	UINT nCodePage = ATL::_AtlGetConversionACP();
+	int nWide = MultiByteToWideChar(nCodePage, 0, pszText, (int)nLength, nullptr, 0);
+	if (nWide > 0)
+		MultiByteToWideChar(nCodePage, 0, pszText, (int)nLength, AppendBuffer(nWide), nWide);
+}
+
+class EMFRecordStringSink : public EMFRecordTextSink
+{
+public:
+	LPWSTR AppendBuffer(size_t nLength) override
+	{
+		size_t nPos = m_strText.size();
+		m_strText.resize(nPos + nLength);
+		return m_strText.data() + nPos;
+	}
+public:
+	std::wstring	m_strText;
+};
+
+CStringW EMFRecAccess::GetRecordText() const
+{
+	EMFRecordStringSink sink;
+	AppendRecordText(sink);
+	return CStringW(sink.m_strText.c_str(), (int)sink.m_strText.size());
+}
+
 bool EMFRecAccess::IsDrawingRecord() const
 {
 	auto cate = GetRecordCategory();
@@ -14,10 +56,24 @@ bool EMFRecAccess::IsDrawingRecord() const
 
 std::shared_ptr<PropertyNode> EMFRecAccess::GetProperties(const CachePropertiesContext& ctxt)
 {
-	if (!m_propsCached)
+	// What's only known once the records are all read (checksum, hashes)
+	// is shown by the properties built after
+	bool bRecordsComplete = !m_pOwner || m_pOwner->IsRecordsComplete();
+	bool bHit = m_propsCached != nullptr && m_bPropsRecordsComplete == bRecordsComplete;
+	if (bHit)
 	{
+		// Built while the records were read, later ones may have linked to this
+		auto lock = LockLinksShared();
+		bHit = m_linkRecs.size() == m_nPropsLinks;
+	}
+	if (!bHit)
+	{
+		EMF_TRACE_SCOPE_INDEX("GetProperties", "properties", m_nIndex);
 		m_propsCached = std::make_shared<PropertyNode>();
+		m_bPropsRecordsComplete = bRecordsComplete;
 		CacheProperties(ctxt);
+		auto lock = LockLinksShared();
+		m_nPropsLinks = m_linkRecs.size();
 		if (!m_linkRecs.empty())
 		{
 			auto pLinkBranch = m_propsCached->AddBranch(L"LinkedRecords");
@@ -31,11 +87,26 @@ std::shared_ptr<PropertyNode> EMFRecAccess::GetProperties(const CachePropertiesC
 			}
 		}
 	}
+	if (auto pCache = GetRecordCache())
+		pCache->Touch(this, EMFRecordCache::CacheKindProperties, bHit);
 	return m_propsCached;
 }
 
+EMFRecordCache* EMFRecAccess::GetRecordCache() const
+{
+	return m_pOwner ? m_pOwner->m_pRecordCache.get() : nullptr;
+}
+
+std::shared_lock<std::shared_mutex> EMFRecAccess::LockLinksShared() const
+{
+	if (!m_pOwner)
+		return {};
+	return std::shared_lock(m_pOwner->m_mtxLinks);
+}
+
 auto EMFRecAccess::IsLinked(const EMFRecAccess* pRec) const -> LinkedObjType
 {
+	auto lock = LockLinksShared();
 	for (auto& link : m_linkRecs)
 	{
 		if (link.pRec == pRec)
@@ -44,6 +115,23 @@ auto EMFRecAccess::IsLinked(const EMFRecAccess* pRec) const -> LinkedObjType
 	return LinkedObjTypeInvalid;
 }
 
+size_t EMFRecAccess::GetLinkedRecordCount() const
+{
+	auto lock = LockLinksShared();
+	return m_linkRecs.size();
+}
+
+EMFRecAccess* EMFRecAccess::GetLinkedRecord(LinkedObjType nType) const
+{
+	auto lock = LockLinksShared();
+	for (auto& link : m_linkRecs)
+	{
+		if (link.nType == nType)
+			return link.pRec;
+	}
+	return nullptr;
+}
+
 void EMFRecAccess::SetRecInfo(const emfplus::OEmfPlusRecInfo& info)
 {
 	m_recInfo = info;
@@ -54,19 +142,115 @@ void EMFRecAccess::SetRecInfo(const emfplus::OEmfPlusRecInfo& info)
 	}
 }
 
+// Where the object table slot is in the data of an object creation record
+static bool GetObjectSlot(OEmfPlusRecordType nType, u16t& nFlagsMask, size_t& nDataOffset, size_t& nDataSize)
+{
+	nFlagsMask = 0xFFFF;
+	nDataOffset = nDataSize = 0;
+	switch (nType)
+	{
+	case EmfRecordTypeCreatePen:
+	case EmfRecordTypeCreateBrushIndirect:
+	case EmfRecordTypeCreatePalette:
+	case EmfRecordTypeExtCreateFontIndirect:
+	case EmfRecordTypeCreateMonoBrush:
+	case EmfRecordTypeCreateDIBPatternBrushPt:
+	case EmfRecordTypeExtCreatePen:
+	case EmfRecordTypeCreateColorSpace:
+	case EmfRecordTypeCreateColorSpaceW:
+		// ihObject/ihPen/ihBrush/ihPal/ihFont/ihCS comes first
+		nDataSize = sizeof(DWORD);
+		return true;
+	case EmfPlusRecordTypeObject:
+		// ObjectID in the low byte of the flags
+		nFlagsMask = 0xFF00;
+		return true;
+	default:
+		// WMF objects take their slot implicitly
+		return false;
+	}
+}
+
+static uint64_t GetRecordHash(OEmfPlusRecordType nType, u16t nFlags, const u8t* pData, size_t nDataSize,
+	size_t nSkipOffset = 0, size_t nSkipSize = 0)
+{
+	data_access::Hash64 hash;
+	hash.UpdateValue((u32t)nType);
+	hash.UpdateValue(nFlags);
+	if (pData)
+	{
+		nSkipOffset = std::min(nSkipOffset, nDataSize);
+		nSkipSize = std::min(nSkipSize, nDataSize - nSkipOffset);
+		hash.Update(pData, nSkipOffset);
+		hash.Update(pData + nSkipOffset + nSkipSize, nDataSize - nSkipOffset - nSkipSize);
+	}
+	return hash.Digest();
+}
+
+void EMFRecAccess::ReportMemoryUsage(EMFMemoryUsage& usage) const
+{
+	auto nType = GetRecordType();
+	usage.AddRecord(nType, GetRecordName());
+	size_t nLinks;
+	{
+		auto lock = LockLinksShared();
+		nLinks = m_linkRecs.capacity();
+	}
+	usage.Add(EMFMemoryUsage::CategoryRecords, sizeof(*this) + nLinks * sizeof(LinkedObjInfo), nType);
+	usage.Add(EMFMemoryUsage::CategoryRecordData, m_recData.capacity(), nType);
+	usage.Add(EMFMemoryUsage::CategoryProperties, EMFMemoryUsage::GetPropertyTreeSize(m_propsCached.get()), nType);
+}
+
+size_t EMFRecAccess::GetCacheCost(EMFRecordCache::CacheKind nKind) const
+{
+	if (nKind == EMFRecordCache::CacheKindProperties)
+		return EMFMemoryUsage::GetPropertyTreeSize(m_propsCached.get());
+	return 0;
+}
+
+void EMFRecAccess::ReleaseCache(EMFRecordCache::CacheKind nKind)
+{
+	// The tree may still be shown, it's then freed with the last reference
+	if (nKind == EMFRecordCache::CacheKindProperties)
+		m_propsCached.reset();
+}
+
+void EMFRecAccess::CacheHashes()
+{
+	auto nType = GetRecordType();
+	m_nContentHash = GetRecordHash(nType, m_recInfo.Flags, m_recInfo.Data, m_recInfo.DataSize);
+	m_nSemanticHash = m_nContentHash;
+	u16t nFlagsMask;
+	size_t nSlotOffset, nSlotSize;
+	if (GetObjectSlot(nType, nFlagsMask, nSlotOffset, nSlotSize))
+	{
+		m_nSemanticHash = GetRecordHash(nType, m_recInfo.Flags & nFlagsMask, m_recInfo.Data, m_recInfo.DataSize,
+			nSlotOffset, nSlotSize);
+	}
+}
+
 void EMFRecAccess::CacheProperties(const CachePropertiesContext& ctxt)
 {
 	m_propsCached->AddText(L"RecordName", GetRecordName());
 	m_propsCached->AddValue(L"RecordType", m_recInfo.Type);
 	m_propsCached->AddValue(L"RecordDataSize", m_recInfo.DataSize);
+	if (m_nFileOffset != InvalidOffset)
+		m_propsCached->AddValue(L"RecordOffset", (emfplus::u32t)m_nFileOffset, true);
+	m_propsCached->AddText(L"ContentHash", data_access::Hash64ToString(m_nContentHash).c_str());
+	if (m_nSemanticHash != m_nContentHash)
+		m_propsCached->AddText(L"SemanticHash", data_access::Hash64ToString(m_nSemanticHash).c_str());
 }
 
 void EMFRecAccess::AddLinkRecord(EMFRecAccess* pRec, LinkedObjType nType, LinkedObjType nTypeThis)
 {
+	ASSERT(pRec->m_pOwner == m_pOwner);
 	LinkedObjInfo link{pRec, nType};
+	std::unique_lock<std::shared_mutex> lock;
+	if (m_pOwner)
+		lock = std::unique_lock(m_pOwner->m_mtxLinks);
 	m_linkRecs.emplace_back(link);
 	if (nTypeThis != LinkedObjTypeInvalid)
-		pRec->AddLinkRecord(this, nTypeThis, LinkedObjTypeInvalid);
+		pRec->m_linkRecs.push_back({ this, nTypeThis });
 }
 
 void GetPropertiesFromGDIPlusHeader(PropertyNode* pNode, const Gdiplus::MetafileHeader& hdr)
@@ -7,18 +7,36 @@
 
 
 #include <memory>
+#include <shared_mutex>
 #include <vector>
 #include "GdiplusEnums.h"
 #include "EmfPlusStruct.h"
 #include "PropertyTree.h"
+#include "EMFRecordCache.h"
 
 class EMFAccess;
+class EMFMemoryUsage;
 
 struct CachePropertiesContext
 {
 	EMFAccess* pEMF;
 };
 
+// Where a record writes its text (EMFRecAccess::AppendRecordText), so that
+// it goes straight to where it's shown
+class EMFRecordTextSink
+{
+public:
+	virtual ~EMFRecordTextSink() = default;
+
+	// Room for nLength more characters, to be filled before the next call
+	virtual LPWSTR AppendBuffer(size_t nLength) = 0;
+
+	void Append(LPCWSTR pszText, size_t nLength);
+	// Converted from the ANSI code page, as CStringW does
+	void AppendA(LPCSTR pszText, size_t nLength);
+};
+
 class EMFRecAccess
 {
 public:
@@ -27,8 +45,12 @@ public:
 public:
 	virtual LPCWSTR GetRecordName() const = 0;
 
-	// Additional text associated with the record (e.g. the actual string for text output records)
-	virtual LPCWSTR GetRecordText() const { return nullptr; }
+	// Additional text associated with the record (e.g. the actual string for
+	// text output records), appended to sink. The record doesn't keep it.
+	virtual void AppendRecordText(EMFRecordTextSink& sink) const {}
+
+	// The same as a string, empty if the record has none
+	CStringW GetRecordText() const;
 
 	// Color associated with the record (e.g. for EMR_SETTEXTCOLOR)
 	virtual bool GetRecordColor(COLORREF& cr) const { return false; }
@@ -69,6 +91,20 @@ public:
 
 	inline size_t GetIndex() const { return m_nIndex; }
 
+	// Hash of the type, flags and data of the record, worked out when the
+	// record is read
+	inline uint64_t GetContentHash() const { return m_nContentHash; }
+
+	// Same as the content hash, except that for the records creating an
+	// object the object table slot is left out: the same object created in
+	// another slot hashes the same.
+	inline uint64_t GetSemanticHash() const { return m_nSemanticHash; }
+
+	// Offset of the record in the metafile, InvalidOffset if the records
+	// weren't read from the bytes (GDI+ enumeration)
+	enum : size_t { InvalidOffset = (size_t)-1 };
+	inline size_t GetFileOffset() const { return m_nFileOffset; }
+
 	enum LinkedObjType
 	{
 		LinkedObjTypeInvalid,
@@ -93,18 +129,10 @@ public:
 
 	LinkedObjType IsLinked(const EMFRecAccess* pRec) const;
 
-	inline size_t GetLinkedRecordCount() const { return m_linkRecs.size(); }
+	size_t GetLinkedRecordCount() const;
 
 	// There could be multiple LinkedObjTypeDrawingRecord type but for now we don't care
-	inline EMFRecAccess* GetLinkedRecord(LinkedObjType nType) const
-	{
-		for (auto& link : m_linkRecs)
-		{
-			if (link.nType == nType)
-				return link.pRec;
-		}
-		return nullptr;
-	}
+	EMFRecAccess* GetLinkedRecord(LinkedObjType nType) const;
 
 	struct PreviewContext
 	{
@@ -130,11 +158,28 @@ public:
 	};
 
 	virtual bool DrawPreview(PreviewContext* info = nullptr) { return false; }
+
+	// Adds what the record holds to usage
+	virtual void ReportMemoryUsage(EMFMemoryUsage& usage) const;
+
+	// Bound of the caches of the record, nullptr if they're kept until it's
+	// freed. Only from the thread the document is shown from.
+	EMFRecordCache* GetRecordCache() const;
 protected:
+	friend class EMFRecordCache;
+
+	// Size of the cache of that kind, if the record has one
+	virtual size_t GetCacheCost(EMFRecordCache::CacheKind nKind) const;
+
+	// Drops the cache of that kind, it's built again when needed
+	virtual void ReleaseCache(EMFRecordCache::CacheKind nKind);
+
 	void SetRecInfo(const emfplus::OEmfPlusRecInfo& info);
 
 	void SetIndex(size_t nIndex) { m_nIndex = nIndex; }
 
+	void CacheHashes();
+
 	virtual void CacheProperties(const CachePropertiesContext& ctxt);
 
 	virtual void Preprocess(EMFAccess* pEMF) {}
@@ -145,6 +190,9 @@ protected:
 		LinkedObjType nType;
 	};
 	void AddLinkRecord(EMFRecAccess* pRec, LinkedObjType nType, LinkedObjType nTypeThis = LinkedObjTypeDrawingRecord);
+
+	// Of the links, held by the document (EMFAccess::StartGetRecords)
+	std::shared_lock<std::shared_mutex> LockLinksShared() const;
 protected:
 	friend class EMFAccess;
 	emfplus::OEmfPlusRecInfo		m_recInfo;
@@ -152,8 +200,16 @@ protected:
 	// and it's not safe to directly use them, so here use a copy instead
 	emfplus::memory_vector			m_recData;
 	size_t							m_nIndex = 0;
+	size_t							m_nFileOffset = InvalidOffset;
+	uint64_t						m_nContentHash = 0;
+	uint64_t						m_nSemanticHash = 0;
 	std::shared_ptr<PropertyNode>	m_propsCached;
 	std::vector<LinkedObjInfo>		m_linkRecs;
+	// Links shown by m_propsCached, and whether the records were all read
+	size_t							m_nPropsLinks = 0;
+	bool							m_bPropsRecordsComplete = false;
+	// The document the record was read by, it holds what its records share
+	EMFAccess*						m_pOwner = nullptr;
 };
 
 void GetPropertiesFromGDIPlusHeader(PropertyNode* pNode, const Gdiplus::MetafileHeader& hdr);
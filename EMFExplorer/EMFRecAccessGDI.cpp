@@ -5,6 +5,7 @@
 #include "EMFStruct2Props.h"
 #include "EmfStruct.h"
 #include "EMFRecAccessGDITextHelpers.h"
+#include "EmfDIBDecode.h"
 
 #undef min
 #undef max
@@ -20,6 +21,76 @@ const ENHMETARECORD* EMFRecAccessGDIRec::GetGDIRecord(const emfplus::OEmfPlusRec
 	return nullptr;
 }
 
+const BYTE* EMFRecAccessGDIRec::GetGDIRecordBlock(const emfplus::OEmfPlusRecInfo& rec, DWORD nOffset, DWORD nSize)
+{
+	// Offsets count from the start of the record, while the data starts after the EMR header
+	if (!rec.Data || nOffset < sizeof(EMR) || !nSize)
+		return nullptr;
+	size_t nDataOffset = nOffset - sizeof(EMR);
+	if (nDataOffset > rec.DataSize || nSize > rec.DataSize - nDataOffset)
+		return nullptr;
+	return rec.Data + nDataOffset;
+}
+
+bool EMFRecAccessGDIRec::DrawDIBPreview(const emfplus::OEmfPlusRecInfo& rec, DWORD offBmi, DWORD cbBmi,
+	DWORD offBits, DWORD cbBits, DWORD iUsage, PreviewContext* info)
+{
+	auto pBmi = GetGDIRecordBlock(rec, offBmi, cbBmi);
+	auto pBits = GetGDIRecordBlock(rec, offBits, cbBits);
+	emfdib::DIBDecoder decoder;
+	if (!pBmi || !decoder.Init(pBmi, cbBmi, pBits, pBits ? cbBits : 0, (emfdib::DIBColors)iUsage))
+		return false;
+	auto& bmi = decoder.GetInfo();
+	if (bmi.IsImageFile())
+		return false;
+	if (info)
+	{
+		CSize szImg(bmi.Width, bmi.Height);
+		CRect rect = info->rect;
+		if (info->bCalcOnly)
+		{
+			CSize sz = info->GetDefaultImgPreviewSize();
+			rect.right = rect.left + sz.cx;
+			rect.bottom = rect.top + sz.cy;
+		}
+		CRect rcFit = GetFitRect(rect, szImg, true);
+		info->szPreferedSize = rcFit.Size();
+		if (!info->bCalcOnly)
+		{
+			// Nearest scanlines and pixels of the bitmap, at most at its own size
+			INT cx = std::max(1, std::min(rcFit.Width(), (int)bmi.Width));
+			INT cy = std::max(1, std::min(rcFit.Height(), (int)bmi.Height));
+			Gdiplus::Bitmap bmp(cx, cy, PixelFormat32bppPARGB);
+			Gdiplus::BitmapData locked;
+			Gdiplus::Rect rcLock(0, 0, cx, cy);
+			if (bmp.LockBits(&rcLock, Gdiplus::ImageLockModeWrite, PixelFormat32bppPARGB, &locked) != Gdiplus::Ok)
+				return false;
+			decoder.SetPixelOrder(emfdib::PixelOrder::BGRA);
+			std::vector<DWORD> vRow(bmi.Width);
+			bool bDecoded = true;
+			for (INT y = 0; y < cy && bDecoded; ++y)
+			{
+				auto pDst = (DWORD*)((BYTE*)locked.Scan0 + (ptrdiff_t)y * locked.Stride);
+				if (cx == bmi.Width && cy == bmi.Height)
+				{
+					bDecoded = decoder.DecodeRows(y, 1, (BYTE*)pDst, locked.Stride);
+					continue;
+				}
+				bDecoded = decoder.DecodeRows((INT)((INT64)y * bmi.Height / cy), 1, (BYTE*)vRow.data(), bmi.Width * 4);
+				for (INT x = 0; x < cx; ++x)
+					pDst[x] = vRow[(size_t)((INT64)x * bmi.Width / cx)];
+			}
+			bmp.UnlockBits(&locked);
+			if (!bDecoded)
+				return false;
+			Gdiplus::Graphics gg(info->pDC->GetSafeHdc());
+			Gdiplus::Rect rcDraw(rcFit.left, rcFit.top, rcFit.Width(), rcFit.Height());
+			gg.DrawImage(&bmp, rcDraw);
+		}
+	}
+	return true;
+}
+
 void EMFRecAccessGDIRecHeader::CacheProperties(const CachePropertiesContext& ctxt)
 {
 	EMFRecAccessGDIControlCat::CacheProperties(ctxt);
@@ -329,7 +400,7 @@ void EMFRecAccessGDIRecGdiComment::CacheProperties(const CachePropertiesContext&
 				str = L"Public: End group";
 				break;
 			case EMR_COMMENT_WINDOWS_METAFILE:
-				str = L"Public: End Windows Metafile";
+				str = L"Public: Windows Metafile";
 				break;
 			case EMR_COMMENT_MULTIFORMATS:
 				str = L"Public: Multiformats";
@@ -355,6 +426,92 @@ void EMFRecAccessGDIRecGdiComment::CacheProperties(const CachePropertiesContext&
 	m_propsCached->AddText(L"CommentType", str);
 	if (!strText.IsEmpty())
 		m_propsCached->AddText(L"Text", strText);
+	emfplus::u32t nChecksum = 0;
+	if (emfembed::GetWindowsMetafileChecksum(m_recInfo.Data, m_recInfo.DataSize, nChecksum))
+	{
+		m_propsCached->AddValue(L"Checksum", nChecksum, true);
+		if (ctxt.pEMF->IsChecksumKnown())
+			m_propsCached->AddText(L"ChecksumValid", ctxt.pEMF->IsChecksumValid() ? L"Yes" : L"No (modified since the conversion)");
+	}
+	for (size_t ii = 0; ii < m_vEmbedded.size(); ++ii)
+	{
+		auto& payload = m_vEmbedded[ii];
+		LPCWSTR szType = L"EPS";
+		switch (payload.Type)
+		{
+		case emfembed::OEmbeddedType::Wmf:
+			szType = L"WMF";
+			break;
+		case emfembed::OEmbeddedType::Emf:
+			szType = L"EMF";
+			break;
+		}
+		auto pBranch = m_propsCached->AddBranch((L"Embedded" + std::to_wstring(ii)).c_str(), szType);
+		pBranch->AddValue(L"Version", payload.Version, true);
+		pBranch->AddValue(L"Size", payload.nSize);
+	}
+}
+
+void EMFRecAccessGDIRecGdiComment::Preprocess(EMFAccess* pEMF)
+{
+	emfembed::GetEmbeddedPayloads(m_recInfo.Data, m_recInfo.DataSize, m_vEmbedded);
+	m_vNested.resize(m_vEmbedded.size());
+}
+
+int EMFRecAccessGDIRecGdiComment::GetEmbeddedMetafileIndex() const
+{
+	for (size_t ii = 0; ii < m_vEmbedded.size(); ++ii)
+	{
+		if (m_vEmbedded[ii].Type != emfembed::OEmbeddedType::Eps)
+			return (int)ii;
+	}
+	return -1;
+}
+
+std::shared_ptr<EMFAccess> EMFRecAccessGDIRecGdiComment::GetEmbeddedEMFAccess(size_t nIndex)
+{
+	if (nIndex >= m_vEmbedded.size() || m_vEmbedded[nIndex].Type == emfembed::OEmbeddedType::Eps)
+		return nullptr;
+	auto& payload = m_vEmbedded[nIndex];
+	if (!m_vNested[nIndex])
+		m_vNested[nIndex] = EMFNestedCache::Instance().AddPayload(payload.pData, payload.nSize);
+	return EMFNestedCache::Instance().GetEMFAccess(m_vNested[nIndex]);
+}
+
+bool EMFRecAccessGDIRecGdiComment::DrawPreview(PreviewContext* info)
+{
+	int nIndex = GetEmbeddedMetafileIndex();
+	if (nIndex < 0)
+		return false;
+	if (!info)
+		return true;
+	auto emf = GetEmbeddedEMFAccess(nIndex);
+	if (!emf)
+		return false;
+	auto& hdr = emf->GetMetafileHeader();
+	CSize szEMF(hdr.Width, hdr.Height);
+	CRect rect = info->rect;
+	if (info->bCalcOnly)
+	{
+		CSize sz = info->GetDefaultImgPreviewSize();
+		rect.right = rect.left + sz.cx;
+		rect.bottom = rect.top + sz.cy;
+	}
+	CRect rcFit = GetFitRect(rect, szEMF, true);
+	info->szPreferedSize = rcFit.Size();
+	if (!info->bCalcOnly)
+	{
+		Gdiplus::Graphics gg(info->pDC->GetSafeHdc());
+		emf->DrawMetafile(gg, rcFit);
+	}
+	return true;
+}
+
+bool EMFRecAccessGDIRecBitBlt::DrawPreview(PreviewContext* info)
+{
+	auto pRec = (const EMRBITBLT*)EMFRecAccessGDIRec::GetGDIRecord(m_recInfo);
+	return pRec && DrawDIBPreview(m_recInfo, pRec->offBmiSrc, pRec->cbBmiSrc,
+		pRec->offBitsSrc, pRec->cbBitsSrc, pRec->iUsageSrc, info);
 }
 
 void EMFRecAccessGDIRecBitBlt::CacheProperties(const CachePropertiesContext& ctxt)
@@ -385,6 +542,13 @@ void EMFRecAccessGDIRecBitBlt::CacheProperties(const CachePropertiesContext& ctx
 	}
 }
 
+bool EMFRecAccessGDIRecStretchBlt::DrawPreview(PreviewContext* info)
+{
+	auto pRec = (const EMRSTRETCHBLT*)EMFRecAccessGDIRec::GetGDIRecord(m_recInfo);
+	return pRec && DrawDIBPreview(m_recInfo, pRec->offBmiSrc, pRec->cbBmiSrc,
+		pRec->offBitsSrc, pRec->cbBitsSrc, pRec->iUsageSrc, info);
+}
+
 void EMFRecAccessGDIRecStretchBlt::CacheProperties(const CachePropertiesContext& ctxt)
 {
 	EMFRecAccessGDIBitmapCat::CacheProperties(ctxt);
@@ -447,6 +611,13 @@ void EMFRecAccessGDIRecPlgBlt::CacheProperties(const CachePropertiesContext& ctx
 	}
 }
 
+bool EMFRecAccessGDIRecSetDIBitsToDevice::DrawPreview(PreviewContext* info)
+{
+	auto pRec = (const EMRSETDIBITSTODEVICE*)EMFRecAccessGDIRec::GetGDIRecord(m_recInfo);
+	return pRec && DrawDIBPreview(m_recInfo, pRec->offBmiSrc, pRec->cbBmiSrc,
+		pRec->offBitsSrc, pRec->cbBitsSrc, pRec->iUsageSrc, info);
+}
+
 void EMFRecAccessGDIRecSetDIBitsToDevice::CacheProperties(const CachePropertiesContext& ctxt)
 {
 	EMFRecAccessGDIBitmapCat::CacheProperties(ctxt);
@@ -475,31 +646,9 @@ void EMFRecAccessGDIRecSetDIBitsToDevice::CacheProperties(const CachePropertiesC
 
 bool EMFRecAccessGDIRecStretchDIBits::DrawPreview(PreviewContext* info)
 {
-	auto pRec = (EMRSTRETCHDIBITS*)EMFRecAccessGDIRec::GetGDIRecord(m_recInfo);
-	if (!pRec->offBmiSrc)
-		return false;
-	if (info)
-	{
-		auto pSrcBmpHeader = (const BITMAPINFOHEADER*)((char*)pRec + pRec->offBmiSrc);
-		CSize szImg(pSrcBmpHeader->biWidth, pSrcBmpHeader->biHeight);
-		CRect rect = info->rect;
-		if (info->bCalcOnly)
-		{
-			CSize sz = info->GetDefaultImgPreviewSize();
-			rect.right = rect.left + sz.cx;
-			rect.bottom = rect.top + sz.cy;
-		}
-		float scale = 1.0f;
-		CRect rcFit = GetFitRect(rect, szImg, true, &scale);
-		info->szPreferedSize = rcFit.Size();
-		if (!info->bCalcOnly)
-		{
-			const char* pSrcBits = (const char*)((char*)pRec + pRec->offBitsSrc);
-			StretchDIBits(info->pDC->GetSafeHdc(), rcFit.left, rcFit.top, rcFit.Width(), rcFit.Height(),
-				0, 0, szImg.cx, szImg.cy, pSrcBits, (BITMAPINFO*)pSrcBmpHeader, pRec->iUsageSrc, SRCCOPY);
-		}
-	}
-	return true;
+	auto pRec = (const EMRSTRETCHDIBITS*)EMFRecAccessGDIRec::GetGDIRecord(m_recInfo);
+	return pRec && DrawDIBPreview(m_recInfo, pRec->offBmiSrc, pRec->cbBmiSrc,
+		pRec->offBitsSrc, pRec->cbBitsSrc, pRec->iUsageSrc, info);
 }
 
 void EMFRecAccessGDIRecStretchDIBits::CacheProperties(const CachePropertiesContext& ctxt)
@@ -578,18 +727,14 @@ void EMFRecAccessGDIRecExtCreateFontIndirect::CacheProperties(const CachePropert
 	}
 }
 
-LPCWSTR EMFRecAccessGDIRecExtTextOutA::GetRecordText() const
+void EMFRecAccessGDIRecExtTextOutA::AppendRecordText(EMFRecordTextSink& sink) const
 {
-	if (m_strText.IsEmpty())
+	auto pRec = (const EMREXTTEXTOUTA*)EMFRecAccessGDIRec::GetGDIRecord(m_recInfo);
+	if (pRec && !(pRec->emrtext.fOptions & ETO_GLYPH_INDEX) && pRec->emrtext.nChars > 0 && pRec->emrtext.offString)
 	{
-		auto pRec = (const EMREXTTEXTOUTA*)EMFRecAccessGDIRec::GetGDIRecord(m_recInfo);
-		if (pRec && !(pRec->emrtext.fOptions & ETO_GLYPH_INDEX) && pRec->emrtext.nChars > 0 && pRec->emrtext.offString)
-		{
-			LPCSTR pszText = (LPCSTR)((const BYTE*)pRec + pRec->emrtext.offString);
-			m_strText = CStringW(pszText, pRec->emrtext.nChars);
-		}
+		LPCSTR pszText = (LPCSTR)((const BYTE*)pRec + pRec->emrtext.offString);
+		sink.AppendA(pszText, pRec->emrtext.nChars);
 	}
-	return m_strText.IsEmpty() ? nullptr : (LPCWSTR)m_strText;
 }
 
 void EMFRecAccessGDIRecExtTextOutA::CacheProperties(const CachePropertiesContext& ctxt)
@@ -622,25 +767,21 @@ void EMFRecAccessGDIRecExtTextOutA::CacheProperties(const CachePropertiesContext
 		}
 		else
 		{
-			auto pszText = GetRecordText();
-			if (pszText)
-				m_propsCached->AddText(L"Text", pszText);
+			auto strText = GetRecordText();
+			if (!strText.IsEmpty())
+				m_propsCached->AddText(L"Text", strText);
 		}
 	}
 }
 
-LPCWSTR EMFRecAccessGDIRecExtTextOutW::GetRecordText() const
+void EMFRecAccessGDIRecExtTextOutW::AppendRecordText(EMFRecordTextSink& sink) const
 {
-	if (m_strText.IsEmpty())
+	auto pRec = (const EMREXTTEXTOUTW*)EMFRecAccessGDIRec::GetGDIRecord(m_recInfo);
+	if (pRec && !(pRec->emrtext.fOptions & ETO_GLYPH_INDEX) && pRec->emrtext.nChars > 0 && pRec->emrtext.offString)
 	{
-		auto pRec = (const EMREXTTEXTOUTW*)EMFRecAccessGDIRec::GetGDIRecord(m_recInfo);
-		if (pRec && !(pRec->emrtext.fOptions & ETO_GLYPH_INDEX) && pRec->emrtext.nChars > 0 && pRec->emrtext.offString)
-		{
-			LPCWSTR pszText = (LPCWSTR)((const BYTE*)pRec + pRec->emrtext.offString);
-			m_strText.SetString(pszText, pRec->emrtext.nChars);
-		}
+		LPCWSTR pszText = (LPCWSTR)((const BYTE*)pRec + pRec->emrtext.offString);
+		sink.Append(pszText, pRec->emrtext.nChars);
 	}
-	return m_strText.IsEmpty() ? nullptr : (LPCWSTR)m_strText;
 }
 
 void EMFRecAccessGDIRecExtTextOutW::CacheProperties(const CachePropertiesContext& ctxt)
@@ -673,9 +814,9 @@ void EMFRecAccessGDIRecExtTextOutW::CacheProperties(const CachePropertiesContext
 		}
 		else
 		{
-			auto pszText = GetRecordText();
-			if (pszText)
-				m_propsCached->AddText(L"Text", pszText);
+			auto strText = GetRecordText();
+			if (!strText.IsEmpty())
+				m_propsCached->AddText(L"Text", strText);
 		}
 	}
 }
@@ -707,6 +848,13 @@ void EMFRecAccessGDIRecCreateDIBPatternBrushPt::Preprocess(EMFAccess* pEMF)
 	pEMF->SetObjectToTable(pRec->ihBrush, this, false);
 }
 
+bool EMFRecAccessGDIRecCreateDIBPatternBrushPt::DrawPreview(PreviewContext* info)
+{
+	auto pRec = (const EMRCREATEDIBPATTERNBRUSHPT*)EMFRecAccessGDIRec::GetGDIRecord(m_recInfo);
+	return pRec && DrawDIBPreview(m_recInfo, pRec->offBmi, pRec->cbBmi,
+		pRec->offBits, pRec->cbBits, pRec->iUsage, info);
+}
+
 void EMFRecAccessGDIRecCreateDIBPatternBrushPt::CacheProperties(const CachePropertiesContext& ctxt)
 {
 	EMFRecAccessGDIObjectCat::CacheProperties(ctxt);
@@ -1627,27 +1775,24 @@ void EMFRecAccessGDIRecPolyDraw16::CacheProperties(const CachePropertiesContext&
 	}
 }
 
-LPCWSTR EMFRecAccessGDIRecPolyTextOutA::GetRecordText() const
+void EMFRecAccessGDIRecPolyTextOutA::AppendRecordText(EMFRecordTextSink& sink) const
 {
-	if (m_strText.IsEmpty())
+	auto pRec = (const EMRPOLYTEXTOUTA*)EMFRecAccessGDIRec::GetGDIRecord(m_recInfo);
+	if (!pRec)
+		return;
+	bool bFirst = true;
+	for (LONG ii = 0; ii < pRec->cStrings; ++ii)
 	{
-		auto pRec = (const EMRPOLYTEXTOUTA*)EMFRecAccessGDIRec::GetGDIRecord(m_recInfo);
-		if (pRec)
+		auto& emt = pRec->aemrtext[ii];
+		if (!(emt.fOptions & ETO_GLYPH_INDEX) && emt.nChars > 0 && emt.offString)
 		{
-			for (LONG ii = 0; ii < pRec->cStrings; ++ii)
-			{
-				auto& emt = pRec->aemrtext[ii];
-				if (!(emt.fOptions & ETO_GLYPH_INDEX) && emt.nChars > 0 && emt.offString)
-				{
-					if (!m_strText.IsEmpty())
-						m_strText += L' ';
-					LPCSTR pszText = (LPCSTR)((const BYTE*)pRec + emt.offString);
-					m_strText += CStringW(pszText, emt.nChars);
-				}
-			}
+			if (!bFirst)
+				sink.Append(L" ", 1);
+			bFirst = false;
+			LPCSTR pszText = (LPCSTR)((const BYTE*)pRec + emt.offString);
+			sink.AppendA(pszText, emt.nChars);
 		}
 	}
-	return m_strText.IsEmpty() ? nullptr : (LPCWSTR)m_strText;
 }
 
 void EMFRecAccessGDIRecPolyTextOutA::CacheProperties(const CachePropertiesContext& ctxt)
@@ -1677,33 +1822,30 @@ void EMFRecAccessGDIRecPolyTextOutA::CacheProperties(const CachePropertiesContex
 				}
 			}
 		}
-		auto pszText = GetRecordText();
-		if (pszText)
-			m_propsCached->AddText(L"Text", pszText);
+		auto strText = GetRecordText();
+		if (!strText.IsEmpty())
+			m_propsCached->AddText(L"Text", strText);
 	}
 }
 
-LPCWSTR EMFRecAccessGDIRecPolyTextOutW::GetRecordText() const
+void EMFRecAccessGDIRecPolyTextOutW::AppendRecordText(EMFRecordTextSink& sink) const
 {
-	if (m_strText.IsEmpty())
+	auto pRec = (const EMRPOLYTEXTOUTW*)EMFRecAccessGDIRec::GetGDIRecord(m_recInfo);
+	if (!pRec)
+		return;
+	bool bFirst = true;
+	for (LONG ii = 0; ii < pRec->cStrings; ++ii)
 	{
-		auto pRec = (const EMRPOLYTEXTOUTW*)EMFRecAccessGDIRec::GetGDIRecord(m_recInfo);
-		if (pRec)
+		auto& emt = pRec->aemrtext[ii];
+		if (!(emt.fOptions & ETO_GLYPH_INDEX) && emt.nChars > 0 && emt.offString)
 		{
-			for (LONG ii = 0; ii < pRec->cStrings; ++ii)
-			{
-				auto& emt = pRec->aemrtext[ii];
-				if (!(emt.fOptions & ETO_GLYPH_INDEX) && emt.nChars > 0 && emt.offString)
-				{
-					if (!m_strText.IsEmpty())
-						m_strText += L' ';
-					LPCWSTR pszText = (LPCWSTR)((const BYTE*)pRec + emt.offString);
-					m_strText += CStringW(pszText, emt.nChars);
-				}
-			}
+			if (!bFirst)
+				sink.Append(L" ", 1);
+			bFirst = false;
+			LPCWSTR pszText = (LPCWSTR)((const BYTE*)pRec + emt.offString);
+			sink.Append(pszText, emt.nChars);
 		}
 	}
-	return m_strText.IsEmpty() ? nullptr : (LPCWSTR)m_strText;
 }
 
 void EMFRecAccessGDIRecPolyTextOutW::CacheProperties(const CachePropertiesContext& ctxt)
@@ -1733,9 +1875,9 @@ void EMFRecAccessGDIRecPolyTextOutW::CacheProperties(const CachePropertiesContex
 				}
 			}
 		}
-		auto pszText = GetRecordText();
-		if (pszText)
-			m_propsCached->AddText(L"Text", pszText);
+		auto strText = GetRecordText();
+		if (!strText.IsEmpty())
+			m_propsCached->AddText(L"Text", strText);
 	}
 }
 
@@ -2249,30 +2391,28 @@ CStringW BiCompressionText(DWORD biCompression)
 	return str;
 }
 
-LPCWSTR EMFRecAccessGDIRecSmallTextOut::GetRecordText() const
+void EMFRecAccessGDIRecSmallTextOut::AppendRecordText(EMFRecordTextSink& sink) const
 {
-	if (m_strText.IsEmpty() && m_recInfo.Data && m_recInfo.DataSize >= sizeof(EMRSMALLTEXTOUT_DATA))
+	if (!m_recInfo.Data || m_recInfo.DataSize < sizeof(EMRSMALLTEXTOUT_DATA))
+		return;
+	auto pRec = (const EMRSMALLTEXTOUT_DATA*)m_recInfo.Data;
+	if (pRec->cChars > 0 && !(pRec->fuOptions & ETO_GLYPH_INDEX))
 	{
-		auto pRec = (const EMRSMALLTEXTOUT_DATA*)m_recInfo.Data;
-		if (pRec->cChars > 0 && !(pRec->fuOptions & ETO_GLYPH_INDEX))
+		size_t textOffset = sizeof(EMRSMALLTEXTOUT_DATA);
+		if (!(pRec->fuOptions & ETO_NO_RECT))
+			textOffset += sizeof(RECTL);
+		auto pText = m_recInfo.Data + textOffset;
+		if (pRec->fuOptions & ETO_SMALL_CHARS)
 		{
-			size_t textOffset = sizeof(EMRSMALLTEXTOUT_DATA);
-			if (!(pRec->fuOptions & ETO_NO_RECT))
-				textOffset += sizeof(RECTL);
-			auto pText = m_recInfo.Data + textOffset;
-			if (pRec->fuOptions & ETO_SMALL_CHARS)
-			{
-				if (textOffset + pRec->cChars <= m_recInfo.DataSize)
-					m_strText = CStringW((LPCSTR)pText, pRec->cChars);
-			}
-			else
-			{
-				if (textOffset + pRec->cChars * sizeof(WCHAR) <= m_recInfo.DataSize)
-					m_strText.SetString((LPCWSTR)pText, pRec->cChars);
-			}
+			if (textOffset + pRec->cChars <= m_recInfo.DataSize)
+				sink.AppendA((LPCSTR)pText, pRec->cChars);
+		}
+		else
+		{
+			if (textOffset + pRec->cChars * sizeof(WCHAR) <= m_recInfo.DataSize)
+				sink.Append((LPCWSTR)pText, pRec->cChars);
 		}
 	}
-	return m_strText.IsEmpty() ? nullptr : (LPCWSTR)m_strText;
 }
 
 void EMFRecAccessGDIRecSmallTextOut::CacheProperties(const CachePropertiesContext& ctxt)
@@ -2307,9 +2447,9 @@ void EMFRecAccessGDIRecSmallTextOut::CacheProperties(const CachePropertiesContex
 		}
 		else
 		{
-			auto pszText = GetRecordText();
-			if (pszText)
-				m_propsCached->AddText(L"Text", pszText);
+			auto strText = GetRecordText();
+			if (!strText.IsEmpty())
+				m_propsCached->AddText(L"Text", strText);
 		}
 	}
 }
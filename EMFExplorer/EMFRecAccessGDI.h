@@ -2,6 +2,8 @@
 #define EMF_REC_ACCESS_GDI_H
 
 #include "EMFRecAccess.h"
+#include "EMFNestedCache.h"
+#include "EmfEmbedded.h"
 
 class EMFRecAccessGDIRec : public EMFRecAccess
 {
@@ -9,6 +11,15 @@ public:
 	bool IsGDIRecord() const override { return true; }
 
 	static const ENHMETARECORD* GetGDIRecord(const emfplus::OEmfPlusRecInfo& rec);
+
+	// Block at a record relative offset (as stored in the records), or
+	// nullptr if it's not within the record.
+	static const BYTE* GetGDIRecordBlock(const emfplus::OEmfPlusRecInfo& rec, DWORD nOffset, DWORD nSize);
+protected:
+	// Draws the DIB of a bitmap record, decoded by emfdib. Large bitmaps are
+	// sampled one scanline at a time down to the preview size.
+	static bool DrawDIBPreview(const emfplus::OEmfPlusRecInfo& rec, DWORD offBmi, DWORD cbBmi,
+		DWORD offBits, DWORD cbBits, DWORD iUsage, PreviewContext* info);
 };
 
 class EMFRecAccessGDIBitmapCat : public EMFRecAccessGDIRec
@@ -809,8 +820,25 @@ public:
 	emfplus::OEmfPlusRecordType GetRecordType() const override { return emfplus::EmfRecordTypeGdiComment; }
 
 	RecCategory GetRecordCategory() const override { return RecCategoryComment; }
+
+	// Payloads of EMR_COMMENT_WINDOWS_METAFILE/EMR_COMMENT_MULTIFORMATS
+	inline const std::vector<emfembed::OEmbeddedPayload>& GetEmbeddedPayloads() const { return m_vEmbedded; }
+
+	// Index of the first WMF/EMF payload, -1 if there's none
+	int GetEmbeddedMetafileIndex() const;
+
+	// Nested document of a WMF/EMF payload, only parsed when asked for
+	std::shared_ptr<EMFAccess> GetEmbeddedEMFAccess(size_t nIndex);
+
+	bool DrawPreview(PreviewContext* info = nullptr) override;
 protected:
 	void CacheProperties(const CachePropertiesContext& ctxt) override;
+
+	void Preprocess(EMFAccess* pEMF) override;
+private:
+	// Point into the record data
+	std::vector<emfembed::OEmbeddedPayload>	m_vEmbedded;
+	std::vector<EMFNestedCache::EntryPtr>	m_vNested;
 };
 
 class EMFRecAccessGDIRecFillRgn : public EMFRecAccessGDIDrawingCat
@@ -869,6 +897,8 @@ public:
 	LPCWSTR GetRecordName() const override { return L"EMR_BITBLT"; }
 
 	emfplus::OEmfPlusRecordType GetRecordType() const override { return emfplus::EmfRecordTypeBitBlt; }
+
+	bool DrawPreview(PreviewContext* info = nullptr) override;
 private:
 	void CacheProperties(const CachePropertiesContext& ctxt) override;
 };
@@ -879,6 +909,8 @@ public:
 	LPCWSTR GetRecordName() const override { return L"EMR_STRETCHBLT"; }
 
 	emfplus::OEmfPlusRecordType GetRecordType() const override { return emfplus::EmfRecordTypeStretchBlt; }
+
+	bool DrawPreview(PreviewContext* info = nullptr) override;
 private:
 	void CacheProperties(const CachePropertiesContext& ctxt) override;
 };
@@ -909,6 +941,8 @@ public:
 	LPCWSTR GetRecordName() const override { return L"EMR_SETDIBITSTODEVICE"; }
 
 	emfplus::OEmfPlusRecordType GetRecordType() const override { return emfplus::EmfRecordTypeSetDIBitsToDevice; }
+
+	bool DrawPreview(PreviewContext* info = nullptr) override;
 private:
 	void CacheProperties(const CachePropertiesContext& ctxt) override;
 };
@@ -944,10 +978,9 @@ public:
 
 	emfplus::OEmfPlusRecordType GetRecordType() const override { return emfplus::EmfRecordTypeExtTextOutA; }
 
-	LPCWSTR GetRecordText() const override;
+	void AppendRecordText(EMFRecordTextSink& sink) const override;
 private:
 	void CacheProperties(const CachePropertiesContext& ctxt) override;
-	mutable CStringW m_strText;
 };
 
 class EMFRecAccessGDIRecExtTextOutW : public EMFRecAccessGDIDrawingCat
@@ -957,10 +990,9 @@ public:
 
 	emfplus::OEmfPlusRecordType GetRecordType() const override { return emfplus::EmfRecordTypeExtTextOutW; }
 
-	LPCWSTR GetRecordText() const override;
+	void AppendRecordText(EMFRecordTextSink& sink) const override;
 private:
 	void CacheProperties(const CachePropertiesContext& ctxt) override;
-	mutable CStringW m_strText;
 };
 
 class EMFRecAccessGDIRecPolyBezier16 : public EMFRecAccessGDIDrawingCat
@@ -1061,6 +1093,8 @@ public:
 	LPCWSTR GetRecordName() const override { return L"EMR_CREATEDIBPATTERNBRUSHPT"; }
 
 	emfplus::OEmfPlusRecordType GetRecordType() const override { return emfplus::EmfRecordTypeCreateDIBPatternBrushPt; }
+
+	bool DrawPreview(PreviewContext* info = nullptr) override;
 private:
 	void Preprocess(EMFAccess* pEMF) override;
 
@@ -1088,10 +1122,9 @@ public:
 
 	emfplus::OEmfPlusRecordType GetRecordType() const override { return emfplus::EmfRecordTypePolyTextOutA; }
 
-	LPCWSTR GetRecordText() const override;
+	void AppendRecordText(EMFRecordTextSink& sink) const override;
 private:
 	void CacheProperties(const CachePropertiesContext& ctxt) override;
-	mutable CStringW m_strText;
 };
 
 class EMFRecAccessGDIRecPolyTextOutW : public EMFRecAccessGDIDrawingCat
@@ -1101,10 +1134,9 @@ public:
 
 	emfplus::OEmfPlusRecordType GetRecordType() const override { return emfplus::EmfRecordTypePolyTextOutW; }
 
-	LPCWSTR GetRecordText() const override;
+	void AppendRecordText(EMFRecordTextSink& sink) const override;
 private:
 	void CacheProperties(const CachePropertiesContext& ctxt) override;
-	mutable CStringW m_strText;
 };
 
 class EMFRecAccessGDIRecSetICMMode : public EMFRecAccessGDIStateCat
@@ -1212,10 +1244,9 @@ public:
 
 	emfplus::OEmfPlusRecordType GetRecordType() const override { return emfplus::EmfRecordTypeSmallTextOut; }
 
-	LPCWSTR GetRecordText() const override;
+	void AppendRecordText(EMFRecordTextSink& sink) const override;
 private:
 	void CacheProperties(const CachePropertiesContext& ctxt) override;
-	mutable CStringW m_strText;
 };
 
 class EMFRecAccessGDIRecForceUFIMapping : public EMFRecAccessGDIStateCat
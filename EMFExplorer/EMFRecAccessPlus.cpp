@@ -3,6 +3,10 @@
 #include "EMFRecAccessPlus.h"
 #include "EMFAccess.h"
 #include "EMFStruct2Props.h"
+#include "EmfPixelConvert.h"
+#include "EMFNestedCache.h"
+#include "EMFMemoryUsage.h"
+#include "EMFTrace.h"
 
 void EMFRecAccessGDIPlusRec::CacheProperties(const CachePropertiesContext& ctxt)
 {
@@ -34,6 +38,15 @@ void EMFRecAccessGDIPlusObjWrapper::CacheProperties(const CachePropertiesContext
 	pNode->AddValue(L"Version", m_obj->Version, true);
 }
 
+void EMFRecAccessGDIPlusObjWrapper::ReportMemoryUsage(EMFMemoryUsage& usage) const
+{
+	// The decoded structs are about the size of the data they're read from
+	size_t nSize = sizeof(*this);
+	if (m_obj)
+		nSize += m_pObjRec->GetRecInfo().DataSize;
+	usage.Add(EMFMemoryUsage::CategoryDecoded, nSize, EmfPlusRecordTypeObject);
+}
+
 static CStringW PenDataFlagsText(u32t flags)
 {
 	CStringW str;
@@ -213,8 +226,11 @@ protected:
 		switch (pImg->Type)
 		{
 		case OImageDataType::Bitmap:
-			if (!m_bmp)
+			if (m_bmp)
+				TouchCache(true);
+			else
 			{
+				EMF_TRACE_SCOPE_INDEX("DecodeImage", "image", m_pObjRec->GetIndex());
 				switch (pImg->ImageDataBmp->Type)
 				{
 				case OBitmapDataType::Compressed:
@@ -226,19 +242,33 @@ protected:
 					}
 					break;
 				case OBitmapDataType::Pixel:
-					// TODO
+					{
+						auto& bmpData = *pImg->ImageDataBmp;
+						if (!emfpixel::IsSupportedFormat(bmpData.PixelFormat) || bmpData.Width <= 0 || bmpData.Height <= 0)
+							break;
+						auto pBmp = std::make_unique<Gdiplus::Bitmap>(bmpData.Width, bmpData.Height, PixelFormat32bppPARGB);
+						Gdiplus::BitmapData locked;
+						Gdiplus::Rect rcLock(0, 0, bmpData.Width, bmpData.Height);
+						if (pBmp->LockBits(&rcLock, Gdiplus::ImageLockModeWrite, PixelFormat32bppPARGB, &locked) != Gdiplus::Ok)
+							break;
+						bool bConverted = emfpixel::ConvertToPremultiplied(bmpData, (u8t*)locked.Scan0, locked.Stride,
+							emfpixel::PixelOrder::BGRA);
+						pBmp->UnlockBits(&locked);
+						if (bConverted)
+							m_bmp.reset(pBmp.release());
+					}
 					break;
 				}
+				if (m_bmp)
+					TouchCache(false);
 			}
 			break;
 		case OImageDataType::Metafile:
-			if (!m_emf)
-				m_emf = std::make_shared<EMFAccess>(pImg->ImageDataMetafile->MetafileData);
-			if (pEMF && m_emf->GetNestedPath().empty())
-			{
-				m_emf->AddNestedPath(pEMF->GetNestedPath().c_str());
-				m_emf->AddNestedPath(std::to_wstring(m_pObjRec->GetIndex() + 1).c_str());
-			}
+			// Identical nested metafiles share one document, parsed when it's first needed
+			if (!m_nested)
+				m_nested = EMFNestedCache::Instance().AddPayload(pImg->ImageDataMetafile->MetafileData);
+			if (!m_nested)
+				return false;
 			break;
 		}
 		return true;
@@ -280,11 +310,12 @@ protected:
 			}
 			return true;
 		case OImageDataType::Metafile:
-			if (!m_emf)
-				return false;
 			if (info)
 			{
-				auto& hdr = m_emf->GetMetafileHeader();
+				auto emf = GetEMFAccess();
+				if (!emf)
+					return false;
+				auto& hdr = emf->GetMetafileHeader();
 				CSize szEMF(hdr.Width, hdr.Height);
 				CRect rect = info->rect;
 				if (info->bCalcOnly)
@@ -298,7 +329,7 @@ protected:
 				if (!info->bCalcOnly)
 				{
 					Gdiplus::Graphics gg(info->pDC->GetSafeHdc());
-					m_emf->DrawMetafile(gg, rcFit);
+					emf->DrawMetafile(gg, rcFit);
 				}
 			}
 			return true;
@@ -306,12 +337,39 @@ protected:
 		return false;
 	}
 
+	void ReportMemoryUsage(EMFMemoryUsage& usage) const override
+	{
+		EMFRecAccessGDIPlusObjWrapper::ReportMemoryUsage(usage);
+		// The nested metafiles are held by EMFNestedCache, reported on their own
+		if (m_bmp)
+			usage.Add(EMFMemoryUsage::CategoryImages, GetCachedObjectSize(), EmfPlusRecordTypeObject);
+	}
+
+	size_t GetCachedObjectSize() const override
+	{
+		if (!m_bmp)
+			return 0;
+		size_t nPixelSize = (Gdiplus::GetPixelFormatSize(m_bmp->GetPixelFormat()) + 7) / 8;
+		return (size_t)m_bmp->GetWidth() * m_bmp->GetHeight() * nPixelSize;
+	}
+
+	void ReleaseCachedObject() override
+	{
+		m_bmp.reset();
+	}
+
+	void TouchCache(bool bHit)
+	{
+		if (auto pCache = m_pObjRec->GetRecordCache())
+			pCache->Touch(m_pObjRec, EMFRecordCache::CacheKindImage, bHit);
+	}
+
 	std::shared_ptr<EMFAccess> GetEMFAccess() const override
 	{
-		return m_emf;
+		return EMFNestedCache::Instance().GetEMFAccess(m_nested);
 	}
 private:
-	std::shared_ptr<EMFAccess>			m_emf;
+	EMFNestedCache::EntryPtr			m_nested;
 	std::unique_ptr<Gdiplus::Image>		m_bmp;
 };
 
@@ -494,6 +552,31 @@ void EMFRecAccessGDIPlusRecObject::CacheProperties(const CachePropertiesContext&
 	}
 }
 
+void EMFRecAccessGDIPlusRecObject::ReportMemoryUsage(EMFMemoryUsage& usage) const
+{
+	EMFRecAccessGDIPlusObjectCat::ReportMemoryUsage(usage);
+	if (m_recDataCached)
+		m_recDataCached->ReportMemoryUsage(usage);
+}
+
+size_t EMFRecAccessGDIPlusRecObject::GetCacheCost(EMFRecordCache::CacheKind nKind) const
+{
+	if (nKind == EMFRecordCache::CacheKindImage)
+		return m_recDataCached ? m_recDataCached->GetCachedObjectSize() : 0;
+	return EMFRecAccessGDIPlusObjectCat::GetCacheCost(nKind);
+}
+
+void EMFRecAccessGDIPlusRecObject::ReleaseCache(EMFRecordCache::CacheKind nKind)
+{
+	if (nKind == EMFRecordCache::CacheKindImage)
+	{
+		if (m_recDataCached)
+			m_recDataCached->ReleaseCachedObject();
+		return;
+	}
+	EMFRecAccessGDIPlusObjectCat::ReleaseCache(nKind);
+}
+
 bool EMFRecAccessGDIPlusRecObject::DrawPreview(PreviewContext* info)
 {
 	auto pObjWrapper = GetObjectWrapper();
@@ -1315,19 +1398,14 @@ bool EMFRecAccessGDIPlusRecDrawString::GetRecordColor(COLORREF& cr) const
 	return GetPlusFillColor(m_recInfo, cr);
 }
 
-LPCWSTR EMFRecAccessGDIPlusRecDrawString::GetRecordText() const
+void EMFRecAccessGDIPlusRecDrawString::AppendRecordText(EMFRecordTextSink& sink) const
 {
-	if (m_strText.IsEmpty() && m_recInfo.Data && m_recInfo.DataSize > 0)
-	{
-		DataReader reader(m_recInfo.Data, m_recInfo.DataSize);
-		emfplus::OEmfPlusRecDrawString recData;
-		if (recData.Read(reader, m_recInfo.Flags, m_recInfo.DataSize))
-		{
-			if (!recData.StringData.empty())
-				m_strText.SetString(recData.StringData.data(), (int)recData.StringData.size());
-		}
-	}
-	return m_strText.IsEmpty() ? nullptr : (LPCWSTR)m_strText;
+	if (!m_recInfo.Data || !m_recInfo.DataSize)
+		return;
+	DataReader reader(m_recInfo.Data, m_recInfo.DataSize);
+	emfplus::OEmfPlusRecDrawString recData;
+	if (recData.Read(reader, m_recInfo.Flags, m_recInfo.DataSize))
+		sink.Append((LPCWSTR)recData.StringData.data(), recData.StringData.size());
 }
 
 void EMFRecAccessGDIPlusRecDrawString::CacheProperties(const CachePropertiesContext& ctxt)
@@ -1397,23 +1475,20 @@ bool EMFRecAccessGDIPlusRecDrawDriverString::GetRecordColor(COLORREF& cr) const
 	return GetPlusFillColor(m_recInfo, cr);
 }
 
-LPCWSTR EMFRecAccessGDIPlusRecDrawDriverString::GetRecordText() const
+void EMFRecAccessGDIPlusRecDrawDriverString::AppendRecordText(EMFRecordTextSink& sink) const
 {
-	if (m_strText.IsEmpty() && m_recInfo.Data && m_recInfo.DataSize > 0)
+	if (!m_recInfo.Data || !m_recInfo.DataSize)
+		return;
+	DataReader reader(m_recInfo.Data, m_recInfo.DataSize);
+	emfplus::OEmfPlusRecDrawDriverString recData;
+	if (recData.Read(reader, m_recInfo.Flags, m_recInfo.DataSize) && !recData.Glyphs.empty()
+		&& ((u32t)ODriverStringOptions::CmapLookup & recData.DriverStringOptionsFlags))
 	{
-		DataReader reader(m_recInfo.Data, m_recInfo.DataSize);
-		emfplus::OEmfPlusRecDrawDriverString recData;
-		if (recData.Read(reader, m_recInfo.Flags, m_recInfo.DataSize))
-		{
-			if (!recData.Glyphs.empty() &&
-				((u32t)ODriverStringOptions::CmapLookup & recData.DriverStringOptionsFlags))
-			{
-				for (auto glyph : recData.Glyphs)
-					m_strText += (wchar_t)glyph;
-			}
-		}
+		// The glyphs are characters with CmapLookup
+		auto pszText = sink.AppendBuffer(recData.Glyphs.size());
+		for (size_t ii = 0; ii < recData.Glyphs.size(); ++ii)
+			pszText[ii] = (wchar_t)recData.Glyphs[ii];
 	}
-	return m_strText.IsEmpty() ? nullptr : (LPCWSTR)m_strText;
 }
 
 static CStringW DriverStringOptionsText(u32t flags)
@@ -1466,9 +1541,9 @@ void EMFRecAccessGDIPlusRecDrawDriverString::CacheProperties(const CacheProperti
 		if ((u32t)ODriverStringOptions::CmapLookup & m_recDataCached.DriverStringOptionsFlags)
 		{
 			m_propsCached->sub.emplace_back(std::make_shared<PropertyNodeArray>(L"Glyphs", m_recDataCached.Glyphs));
-			auto pszText = GetRecordText();
-			if (pszText)
-				m_propsCached->AddText(L"Text", pszText);
+			auto strText = GetRecordText();
+			if (!strText.IsEmpty())
+				m_propsCached->AddText(L"Text", strText);
 		}
 	}
 	if (!m_recDataCached.GlyphPos.empty())
@@ -144,9 +144,17 @@ public:
 	virtual std::shared_ptr<EMFAccess> GetEMFAccess() const { return nullptr; }
 
 	virtual bool DrawPreview(EMFRecAccess::PreviewContext* info = nullptr) { return false; }
+
+	// The decoded object, the resources cached from it
+	virtual void ReportMemoryUsage(EMFMemoryUsage& usage) const;
 protected:
 	friend class EMFRecAccessGDIPlusRecObject;
 
+	// GDI+ resource cached by CacheGDIPlusObject, released to bound the
+	// memory of the document (EMFRecordCache::CacheKindImage)
+	virtual size_t GetCachedObjectSize() const { return 0; }
+	virtual void ReleaseCachedObject() {}
+
 	virtual void CacheProperties(const CachePropertiesContext& ctxt, PropertyNode* pNode) const;
 protected:
 	EMFRecAccessGDIPlusRecObject* m_pObjRec = nullptr;
@@ -167,6 +175,12 @@ private:
 	void CacheProperties(const CachePropertiesContext& ctxt) override;
 
 	bool DrawPreview(PreviewContext* info = nullptr) override;
+
+	void ReportMemoryUsage(EMFMemoryUsage& usage) const override;
+
+	size_t GetCacheCost(EMFRecordCache::CacheKind nKind) const override;
+
+	void ReleaseCache(EMFRecordCache::CacheKind nKind) override;
 private:
 	std::unique_ptr<EMFRecAccessGDIPlusObjWrapper>	m_recDataCached;
 };
@@ -458,7 +472,7 @@ public:
 
 	emfplus::OEmfPlusRecordType GetRecordType() const override { return emfplus::EmfPlusRecordTypeDrawString; }
 
-	LPCWSTR GetRecordText() const override;
+	void AppendRecordText(EMFRecordTextSink& sink) const override;
 
 	bool GetRecordColor(COLORREF& cr) const override;
 private:
@@ -467,7 +481,6 @@ private:
 	void CacheProperties(const CachePropertiesContext& ctxt) override;
 private:
 	emfplus::OEmfPlusRecDrawString	m_recDataCached;
-	mutable CStringW m_strText;
 };
 
 class EMFRecAccessGDIPlusRecSetRenderingOrigin : public EMFRecAccessGDIPlusPropertyCat
@@ -757,7 +770,7 @@ public:
 
 	emfplus::OEmfPlusRecordType GetRecordType() const override { return emfplus::EmfPlusRecordTypeDrawDriverString; }
 
-	LPCWSTR GetRecordText() const override;
+	void AppendRecordText(EMFRecordTextSink& sink) const override;
 
 	bool GetRecordColor(COLORREF& cr) const override;
 private:
@@ -766,7 +779,6 @@ private:
 	void CacheProperties(const CachePropertiesContext& ctxt) override;
 private:
 	emfplus::OEmfPlusRecDrawDriverString	m_recDataCached;
-	mutable CStringW m_strText;
 };
 
 class EMFRecAccessGDIPlusRecStrokeFillPath : public EMFRecAccessGDIPlusDrawingCat
@@ -495,20 +495,16 @@ void EMFRecAccessWMFRecPolyPolygon::CacheProperties(const CachePropertiesContext
 // Text records
 // -----------------------------------------------------------------------
 
-LPCWSTR EMFRecAccessWMFRecTextOut::GetRecordText() const
+void EMFRecAccessWMFRecTextOut::AppendRecordText(EMFRecordTextSink& sink) const
 {
-	if (m_strText.IsEmpty())
-	{
-		auto v = View(m_recInfo);
-		auto pHdr = v.As<OWmfTextOutHeader>();
-		if (!pHdr) return nullptr;
-		auto n = pHdr->StringLength;
-		if (n <= 0) return nullptr;
-		auto pStr = v.As<char>(sizeof(*pHdr), (size_t)n);
-		if (pStr)
-			m_strText = CStringW(pStr, (int)n);
-	}
-	return m_strText.IsEmpty() ? nullptr : (LPCWSTR)m_strText;
+	auto v = View(m_recInfo);
+	auto pHdr = v.As<OWmfTextOutHeader>();
+	if (!pHdr) return;
+	auto n = pHdr->StringLength;
+	if (n <= 0) return;
+	auto pStr = v.As<char>(sizeof(*pHdr), (size_t)n);
+	if (pStr)
+		sink.AppendA(pStr, (size_t)n);
 }
 
 void EMFRecAccessWMFRecTextOut::CacheProperties(const CachePropertiesContext& ctxt)
@@ -519,8 +515,8 @@ void EMFRecAccessWMFRecTextOut::CacheProperties(const CachePropertiesContext& ct
 	if (!pHdr) return;
 	const auto strLen = pHdr->StringLength;
 	m_propsCached->AddValue(L"StringLength", (int)strLen);
-	auto pszText = GetRecordText();
-	if (pszText) m_propsCached->AddText(L"String", pszText);
+	auto strText = GetRecordText();
+	if (!strText.IsEmpty()) m_propsCached->AddText(L"String", strText);
 	// After string (padded to even length), YStart and XStart follow.
 	const size_t padded = (strLen <= 0) ? 0 : ((strLen + 1) & ~1);
 	const size_t off = sizeof(*pHdr) + padded;
@@ -529,22 +525,18 @@ void EMFRecAccessWMFRecTextOut::CacheProperties(const CachePropertiesContext& ct
 		AddPoint(m_propsCached.get(), L"Origin", XStart, YStart);
 }
 
-LPCWSTR EMFRecAccessWMFRecExtTextOut::GetRecordText() const
+void EMFRecAccessWMFRecExtTextOut::AppendRecordText(EMFRecordTextSink& sink) const
 {
-	if (m_strText.IsEmpty())
-	{
-		auto v = View(m_recInfo);
-		auto pHdr = v.As<OWmfExtTextOutHeader>();
-		if (!pHdr) return nullptr;
-		auto n = pHdr->StringLength;
-		if (n <= 0 || (pHdr->fwOpts & ETO_GLYPH_INDEX)) return nullptr;
-		size_t off = sizeof(*pHdr);
-		if (pHdr->fwOpts & (ETO_OPAQUE | ETO_CLIPPED)) off += 4 * sizeof(int16_t);
-		auto pStr = v.As<char>(off, (size_t)n);
-		if (pStr)
-			m_strText = CStringW(pStr, (int)n);
-	}
-	return m_strText.IsEmpty() ? nullptr : (LPCWSTR)m_strText;
+	auto v = View(m_recInfo);
+	auto pHdr = v.As<OWmfExtTextOutHeader>();
+	if (!pHdr) return;
+	auto n = pHdr->StringLength;
+	if (n <= 0 || (pHdr->fwOpts & ETO_GLYPH_INDEX)) return;
+	size_t off = sizeof(*pHdr);
+	if (pHdr->fwOpts & (ETO_OPAQUE | ETO_CLIPPED)) off += 4 * sizeof(int16_t);
+	auto pStr = v.As<char>(off, (size_t)n);
+	if (pStr)
+		sink.AppendA(pStr, (size_t)n);
 }
 
 void EMFRecAccessWMFRecExtTextOut::CacheProperties(const CachePropertiesContext& ctxt)
@@ -582,8 +574,8 @@ void EMFRecAccessWMFRecExtTextOut::CacheProperties(const CachePropertiesContext&
 		}
 		else
 		{
-			auto pszText = GetRecordText();
-			if (pszText) m_propsCached->AddText(L"String", pszText);
+			auto strText = GetRecordText();
+			if (!strText.IsEmpty()) m_propsCached->AddText(L"String", strText);
 		}
 	}
 }
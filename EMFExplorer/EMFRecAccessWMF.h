@@ -4,9 +4,9 @@
 #include "EMFRecAccess.h"
 
 // Base class for all WMF records.
-// Like EMF, GDI+ strips the record header before invoking the EnumerateMetafile
-// callback, so m_recInfo.Data points at the parameters and m_recInfo.DataSize is
-// the parameter byte count.
+// The records are read natively by wmf::WmfReader, which like the GDI+
+// EnumerateMetafile callback strips the record header, so m_recInfo.Data points
+// at the parameters and m_recInfo.DataSize is the parameter byte count.
 class EMFRecAccessWMFRec : public EMFRecAccess
 {
 public:
@@ -146,10 +146,9 @@ class EMFRecAccessWMFRecTextOut : public EMFRecAccessWMFDrawingCat
 public:
 	LPCWSTR GetRecordName() const override { return L"META_TEXTOUT"; }
 	emfplus::OEmfPlusRecordType GetRecordType() const override { return emfplus::WmfRecordTypeTextOut; }
-	LPCWSTR GetRecordText() const override;
+	void AppendRecordText(EMFRecordTextSink& sink) const override;
 private:
 	void CacheProperties(const CachePropertiesContext& ctxt) override;
-	mutable CStringW m_strText;
 };
 
 class EMFRecAccessWMFRecExtTextOut : public EMFRecAccessWMFDrawingCat
@@ -157,10 +156,9 @@ class EMFRecAccessWMFRecExtTextOut : public EMFRecAccessWMFDrawingCat
 public:
 	LPCWSTR GetRecordName() const override { return L"META_EXTTEXTOUT"; }
 	emfplus::OEmfPlusRecordType GetRecordType() const override { return emfplus::WmfRecordTypeExtTextOut; }
-	LPCWSTR GetRecordText() const override;
+	void AppendRecordText(EMFRecordTextSink& sink) const override;
 private:
 	void CacheProperties(const CachePropertiesContext& ctxt) override;
-	mutable CStringW m_strText;
 };
 WMF_DECLARE_RECORD_BASE(EMFRecAccessWMFRecPatBlt,                L"META_PATBLT",                WmfRecordTypePatBlt,                EMFRecAccessWMFBitmapCat);
 
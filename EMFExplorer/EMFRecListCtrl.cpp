@@ -4,6 +4,7 @@
 #include "EMFRecListCtrl.h"
 #include "EMFExplorer.h"
 #include "EMFAccess.h"
+#include "EMFRecordDisplay.h"
 
 #undef min
 #undef max
@@ -58,6 +59,8 @@ CEMFRecListCtrl::~CEMFRecListCtrl()
 
 #define TIMER_ID_ADJUST_COLUMN_WIDTH_EVENT	0x00010000
 #define TIMER_ADJUST_COLUMN_WIDTH_DELAY		400
+#define TIMER_ID_BUILD_DISPLAY_MODEL_EVENT	0x00010001
+#define DISPLAY_MODEL_ROWS_PER_SLICE		20000
 
 BEGIN_MESSAGE_MAP(CEMFRecListCtrl, CEMFRecListCtrlBase)
 	ON_WM_CREATE()
@@ -309,6 +312,11 @@ void CEMFRecListCtrl::OnCustomDraw(NMHDR* pNMHDR, LRESULT* pResult)
 	switch (lplvcd->nmcd.dwDrawStage)
 	{
 	case CDDS_PREPAINT:
+		{
+			// The focused row is compared with the visible ones
+			int nLast = std::max(GetTopIndex() + GetCountPerPage(), GetNextItem(-1, LVNI_FOCUSED));
+			BuildDisplayRows((size_t)nLast + 1);
+		}
 		*pResult = CDRF_NOTIFYITEMDRAW;
 		break;
 
@@ -322,6 +330,11 @@ void CEMFRecListCtrl::OnCustomDraw(NMHDR* pNMHDR, LRESULT* pResult)
 void CEMFRecListCtrl::OnDrawItem(LPNMLVCUSTOMDRAW lplvcd) const
 {
 	int nRow = (int)lplvcd->nmcd.dwItemSpec;
+	if ((size_t)nRow >= m_model.GetRowCount())
+	{
+		ASSERT(0);
+		return;
+	}
 	CDC* pDC = CDC::FromHandle(lplvcd->nmcd.hdc);
 	
 	auto state = GetItemState(nRow, LVIS_SELECTED | LVIS_FOCUSED);
@@ -331,11 +344,14 @@ void CEMFRecListCtrl::OnDrawItem(LPNMLVCUSTOMDRAW lplvcd) const
 
 	int nSel = GetNextItem(-1, LVNI_FOCUSED);
 	EMFRecAccess* pRecSel = nullptr;
+	int nSelRecType = -1;
 	if (nSel >= 0)
 	{
 		pRecSel = GetEMFRecord(nSel);
+		if ((size_t)nSel < m_model.GetRowCount())
+			nSelRecType = (int)m_model.GetRecordType(nSel);
 	}
-	int nSelRecType = pRecSel ? (int)pRecSel->GetRecordType() : -1;
+	auto nRowFlags = m_model.GetFlags(nRow);
 
 	lplvcd->clrText = theApp.m_crfDarkThemeTxtColor;
 	bool bHotItem = m_nHotItem == nRow;
@@ -351,9 +367,9 @@ void CEMFRecListCtrl::OnDrawItem(LPNMLVCUSTOMDRAW lplvcd) const
 	{
 		if (!bHotItem)
 		{
-			if (nSelRecType >= (int)emfplus::EmfRecordTypeMin && (int)pRec->GetRecordType() == nSelRecType)
+			if (nSelRecType >= (int)emfplus::EmfRecordTypeMin && (int)m_model.GetRecordType(nRow) == nSelRecType)
 				lplvcd->clrTextBk = RGB(83, 144, 217);
-			else if (pRec->IsDrawingRecord())
+			else if (nRowFlags & emfdisplay::RowFlagDrawing)
 				lplvcd->clrTextBk = theApp.IsDarkTheme() ? RGB(3, 136, 87) : RGB(4, 170, 109);
 			else
 				lplvcd->clrTextBk = GetBkColor();
@@ -434,17 +450,11 @@ void CEMFRecListCtrl::OnDrawItem(LPNMLVCUSTOMDRAW lplvcd) const
 
 		if (nCol == ColumnTypeName)
 		{
-			COLORREF crRec;
-			if (pRec->GetRecordColor(crRec))
+			if (nRowFlags & emfdisplay::RowFlagColor)
 			{
-				// Append hex RGB text (show full COLORREF if high byte is non-zero)
-				CStringW strColor;
-				if (crRec & 0xFF000000)
-					strColor.Format(L" #%02X%02X%02X [%08X]",
-						GetRValue(crRec), GetGValue(crRec), GetBValue(crRec), crRec);
-				else
-					strColor.Format(L" #%02X%02X%02X",
-						GetRValue(crRec), GetGValue(crRec), GetBValue(crRec));
+				// Hex RGB text, the full COLORREF too if the high byte is non-zero
+				COLORREF crRec = m_model.GetColor(nRow);
+				CStringW strColor((LPCWSTR)m_model.GetColorText(nRow));
 				CSize szText = pDC->GetTextExtent(str);
 				CRect rcColor = rcText;
 				rcColor.left += szText.cx;
@@ -484,7 +494,12 @@ void CEMFRecListCtrl::OnDrawItem(LPNMLVCUSTOMDRAW lplvcd) const
 
 void CEMFRecListCtrl::GetDispItemText(LVITEM& item) const
 {
-	auto pRec = GetEMFRecord(item.iItem);
+	if ((size_t)item.iItem >= m_model.GetRowCount())
+	{
+		ASSERT(0);
+		item.pszText[0] = _T('\0');
+		return;
+	}
 	// See document for LVITEM:
 	// the list-view control allows any length string to be stored as item text, only the first 260 TCHARs are displayed.
 	// so better truncate the text here instead of leaving junk/gibberish string
@@ -494,14 +509,7 @@ void CEMFRecListCtrl::GetDispItemText(LVITEM& item) const
 		_sntprintf_s(item.pszText, item.cchTextMax, item.cchTextMax, _T("%ld"), item.iItem + 1);
 		break;
 	case ColumnTypeName:
-		{
-			auto szName = pRec->GetRecordName();
-			auto szRecText = pRec->GetRecordText();
-			if (szRecText)
-				_sntprintf_s(item.pszText, item.cchTextMax, item.cchTextMax, _T("%s: %s"), szName, szRecText);
-			else
-				_tcsncpy_s(item.pszText, item.cchTextMax, szName, item.cchTextMax);
-		}
+		_tcsncpy_s(item.pszText, item.cchTextMax, (LPCWSTR)m_model.GetLabel(item.iItem), _TRUNCATE);
 		break;
 	}
 }
@@ -516,6 +524,7 @@ void CEMFRecListCtrl::OnGetDispInfo(NMHDR* pNMHDR, LRESULT* pResult)
 
 	if (item.mask & LVIF_TEXT)
 	{
+		BuildDisplayRows((size_t)item.iItem + 1);
 		GetDispItemText(item);
 	}
 
@@ -571,6 +580,12 @@ void CEMFRecListCtrl::LoadEMFDataEvent(bool bBefore)
 		}
 		SetCustomHotItem(-1);
 		m_emf = nullptr;
+		m_model = emfdisplay::ODisplayModel();
+		if (m_nBuildModelTimerID)
+		{
+			KillTimer(m_nBuildModelTimerID);
+			m_nBuildModelTimerID = 0;
+		}
 		// There could be repaint issue when the list control was previously scrolled
 		// Steps to reproduce:
 		// 1) Load EMF 1
@@ -589,11 +604,33 @@ void CEMFRecListCtrl::LoadEMFDataEvent(bool bBefore)
 	{
 		int nCount = m_emf ? (int)m_emf->GetRecordCount() : 0;
 		SetItemCount(nCount);
+		// Timer messages only come once the queue is empty
+		if (nCount)
+			m_nBuildModelTimerID = SetTimer(TIMER_ID_BUILD_DISPLAY_MODEL_EVENT, 0, NULL);
 		Invalidate();
 		SetRedraw(TRUE);
 	}
 }
 
+int CEMFRecListCtrl::UpdateRecordCount()
+{
+	int nOldCount = GetItemCount();
+	int nCount = m_emf ? (int)m_emf->GetRecordCount() : 0;
+	if (nCount <= nOldCount)
+		return nOldCount;
+	SetItemCountEx(nCount, LVSICF_NOINVALIDATEALL | LVSICF_NOSCROLL);
+	if (!m_nBuildModelTimerID)
+		m_nBuildModelTimerID = SetTimer(TIMER_ID_BUILD_DISPLAY_MODEL_EVENT, 0, NULL);
+	return nOldCount;
+}
+
+void CEMFRecListCtrl::BuildDisplayRows(size_t nRows)
+{
+	if (!m_emf || nRows <= m_model.GetRowCount())
+		return;
+	AddRecordDisplayRows(m_model, *m_emf, nRows - m_model.GetRowCount());
+}
+
 EMFRecAccess* CEMFRecListCtrl::GetEMFRecord(int nRow) const
 {
 	auto pRec = m_emf->GetRecord(nRow);
@@ -673,13 +710,14 @@ int CEMFRecListCtrl::FindRecord(LPCWSTR str, int nStart)
 	auto count = m_emf->GetRecordCount();
 	if (nStart >= (int)count)
 		nStart = 0;
+	BuildDisplayRows(count);
 	for (int ii = nStart; ii < count; ++ii)
 	{
 		auto pRec = m_emf->GetRecord((size_t)ii);
 		auto szName = pRec->GetRecordName();
 		if (StrStrIW(szName, str))
 			return ii;
-		auto szText = pRec->GetRecordText();
+		auto szText = (LPCWSTR)m_model.GetText(ii);
 		if (szText && StrStrIW(szText, str))
 			return ii;
 	}
@@ -723,6 +761,14 @@ void CEMFRecListCtrl::OnTimer(UINT_PTR nIDEvent)
 		KillTimer(m_nAdjustColumnWidthTimerID);
 		m_nAdjustColumnWidthTimerID = 0;
 	}
+	else if (nIDEvent == TIMER_ID_BUILD_DISPLAY_MODEL_EVENT)
+	{
+		if (!m_emf || !AddRecordDisplayRows(m_model, *m_emf, DISPLAY_MODEL_ROWS_PER_SLICE))
+		{
+			KillTimer(m_nBuildModelTimerID);
+			m_nBuildModelTimerID = 0;
+		}
+	}
 
 	CEMFRecListCtrlBase::OnTimer(nIDEvent);
 }
@@ -2,6 +2,7 @@
 #pragma once
 #include <memory>
 #include "EMFRecAccess.h"
+#include "EmfDisplayModel.h"
 
 /////////////////////////////////////////////////////////////////////////////
 // CEMFRecListCtrl window
@@ -38,6 +39,10 @@ public:
 
 	void LoadEMFDataEvent(bool bBefore);
 
+	// Adds the rows of the records read since, returns the previous number
+	// of rows
+	int UpdateRecordCount();
+
 	inline EMFRecAccess* GetEMFRecord(int nRow) const;
 
 	int GetCurSelRecIndex(BOOL bHottrack = FALSE) const;
@@ -75,6 +80,9 @@ protected:
 
 	void GetDispItemText(LVITEM& item) const;
 
+	// Makes sure the display model has the first nRows rows
+	void BuildDisplayRows(size_t nRows);
+
 	// We don't want sort
 	void Sort(int iColumn, BOOL bAscending = TRUE, BOOL bAdd = FALSE) override {};
 
@@ -111,6 +119,12 @@ protected:
 	CStringW					m_strSearch;
 
 	UINT_PTR					m_nAdjustColumnWidthTimerID = 0;
+
+	// Built on the UI thread, a slice per message of a zero-delay timer (they
+	// only come once the message queue is empty), and up to the rows painted
+	// when those are reached first
+	emfdisplay::ODisplayModel	m_model;
+	UINT_PTR					m_nBuildModelTimerID = 0;
 protected:
 	DECLARE_MESSAGE_MAP()
 };
@@ -0,0 +1,200 @@
+#include "pch.h"
+#include "framework.h"
+#include "EMFRecordBisect.h"
+#include "EMFAccess.h"
+#include "EMFRecAccess.h"
+#include "EmfPng.h"
+
+#undef min
+#undef max
+
+using namespace emfbisect;
+
+struct EnumBisectEmfPlusContext
+{
+	Gdiplus::Metafile*			pMetafile;
+	Gdiplus::Graphics*			pGraphics;
+	const std::vector<size_t>*	pvRecords;
+	const SnapshotCallback*		pfnSnapshot;
+	const OSnapshot*			pSnapshot;
+	const std::vector<bool>*	pvDrawOnly;
+	// The records before are in the pixels already
+	size_t						nResume;
+	std::vector<uint8_t>*		pvKept;
+	size_t*						pnKept;
+	size_t						nNext;
+	size_t						nCurRecIdx;
+	size_t						nDrawn;
+	bool						bStopped;
+};
+
+extern "C"
+BOOL CALLBACK EnumBisectMetafilePlusProc(Gdiplus::EmfPlusRecordType type, UINT flags, UINT dataSize, const BYTE* data, VOID* pCallbackData)
+{
+	auto& ctxt = *(EnumBisectEmfPlusContext*)pCallbackData;
+	// The indices match those of EMFAccess, as for DrawMetafileUntilRecord
+	auto& vDrawOnly = *ctxt.pvDrawOnly;
+	if (ctxt.nCurRecIdx >= ctxt.nResume)
+	{
+		ctxt.pMetafile->PlayRecord(type, flags, dataSize, data);
+		++ctxt.nDrawn;
+	}
+	else if (ctxt.nCurRecIdx >= vDrawOnly.size() || !vDrawOnly[ctxt.nCurRecIdx])
+		ctxt.pMetafile->PlayRecord(type, flags, dataSize, data);
+	auto& vRecords = *ctxt.pvRecords;
+	if (ctxt.nNext < vRecords.size() && vRecords[ctxt.nNext] == ctxt.nCurRecIdx)
+	{
+		ctxt.pGraphics->Flush(Gdiplus::FlushIntentionSync);
+		if (!(*ctxt.pfnSnapshot)(ctxt.nCurRecIdx, *ctxt.pSnapshot))
+		{
+			ctxt.bStopped = true;
+			return FALSE;
+		}
+		// Not met yet, the next playback can start from here
+		auto& snap = *ctxt.pSnapshot;
+		ctxt.pvKept->assign(snap.pPixels, snap.pPixels + (size_t)snap.nStride * snap.nHeight);
+		*ctxt.pnKept = ctxt.nCurRecIdx;
+		// Nothing after the last record probed is needed
+		if (++ctxt.nNext == vRecords.size())
+		{
+			ctxt.bStopped = true;
+			return FALSE;
+		}
+	}
+	++ctxt.nCurRecIdx;
+	return TRUE;
+}
+
+EMFRecordBisect::EMFRecordBisect(const EMFAccess& emf, UINT nMaxSize)
+	: m_emf(emf)
+{
+	auto& hdr = emf.GetMetafileHeader();
+	CSize szEMF(std::max(hdr.Width, 1), std::max(hdr.Height, 1));
+	m_rcDraw = GetFitRect(CRect(0, 0, nMaxSize, nMaxSize), szEMF);
+	if (szEMF.cx <= (LONG)nMaxSize && szEMF.cy <= (LONG)nMaxSize)
+		m_rcDraw.SetRect(0, 0, szEMF.cx, szEMF.cy);
+	m_szBitmap.SetSize(std::max(m_rcDraw.Width(), 1), std::max(m_rcDraw.Height(), 1));
+
+	// Drawing records, but for those moving the current position (text
+	// may, with TA_UPDATECP), those making up a path and those consuming
+	// it: a later SelectClipPath would clip by the path left otherwise
+	m_vDrawOnly.assign(emf.GetRecordCount(), false);
+	bool bPath = false;
+	for (size_t ii = 0; ii < emf.GetRecordCount(); ++ii)
+	{
+		auto pRec = emf.GetRecord(ii);
+		switch (pRec->GetRecordType())
+		{
+		case EmfRecordTypeBeginPath:
+			bPath = true;
+			break;
+		case EmfRecordTypeEndPath:
+		case EmfRecordTypeAbortPath:
+			bPath = false;
+			break;
+		case EmfRecordTypeLineTo:
+		case EmfRecordTypeArcTo:
+		case EmfRecordTypeAngleArc:
+		case EmfRecordTypePolyBezierTo:
+		case EmfRecordTypePolylineTo:
+		case EmfRecordTypePolyBezierTo16:
+		case EmfRecordTypePolylineTo16:
+		case EmfRecordTypePolyDraw:
+		case EmfRecordTypePolyDraw16:
+		case EmfRecordTypeExtTextOutA:
+		case EmfRecordTypeExtTextOutW:
+		case EmfRecordTypePolyTextOutA:
+		case EmfRecordTypePolyTextOutW:
+		case EmfRecordTypeSmallTextOut:
+		case WmfRecordTypeLineTo:
+		case WmfRecordTypeTextOut:
+		case WmfRecordTypeExtTextOut:
+		case EmfRecordTypeFillPath:
+		case EmfRecordTypeStrokePath:
+		case EmfRecordTypeStrokeAndFillPath:
+			break;
+		default:
+			m_vDrawOnly[ii] = !bPath && pRec->IsDrawingRecord();
+			break;
+		}
+	}
+}
+
+bool EMFRecordBisect::Play(const std::vector<size_t>& vRecords, const SnapshotCallback& fnSnapshot, size_t& nDrawn)
+{
+	nDrawn = 0;
+	// Records are played on a metafile of their own, as they're enumerated
+	std::unique_ptr<Gdiplus::Image> pMetafile(m_emf.CloneMetafile());
+	if (!pMetafile)
+		return false;
+	// The bitmap draws to pixels of ours, tested as they are. It starts from
+	// those kept when all the records probed come after them.
+	INT nStride = m_szBitmap.cx * 4;
+	size_t nResume = 0;
+	if (m_nKept != SIZE_MAX && !vRecords.empty() && m_nKept < vRecords.front())
+	{
+		m_vPixels = m_vKept;
+		nResume = m_nKept + 1;
+	}
+	else
+		m_vPixels.assign((size_t)nStride * m_szBitmap.cy, 0);
+	Gdiplus::Bitmap bmp(m_szBitmap.cx, m_szBitmap.cy, nStride, PixelFormat32bppARGB, m_vPixels.data());
+	if (bmp.GetLastStatus() != Gdiplus::Ok)
+		return false;
+	Gdiplus::Graphics gg(&bmp);
+	if (!nResume)
+		gg.Clear(Gdiplus::Color::White);
+	OSnapshot snap{ (uint32_t)m_szBitmap.cx, (uint32_t)m_szBitmap.cy, nStride, m_vPixels.data() };
+	EnumBisectEmfPlusContext ctxt{ (Gdiplus::Metafile*)pMetafile.get(), &gg, &vRecords, &fnSnapshot, &snap,
+		&m_vDrawOnly, nResume, &m_vKept, &m_nKept, 0, 0, 0, false };
+	Gdiplus::Rect rcDrawP(m_rcDraw.left, m_rcDraw.top, m_rcDraw.Width(), m_rcDraw.Height());
+	auto sts = gg.EnumerateMetafile(ctxt.pMetafile, rcDrawP, EnumBisectMetafilePlusProc, (void*)&ctxt);
+	nDrawn = ctxt.nDrawn;
+	if (ctxt.bStopped)
+		return true;
+	if (sts != Gdiplus::Ok)
+		return false;
+	// Those past the end get the whole drawing
+	gg.Flush(Gdiplus::FlushIntentionSync);
+	for (size_t ii = ctxt.nNext; ii < vRecords.size(); ++ii)
+	{
+		if (!fnSnapshot(vRecords[ii], snap))
+			break;
+	}
+	return true;
+}
+
+bool EMFRecordBisect::Bisect(const Predicate& pred, OBisectResult& result, const OBisectOptions& options)
+{
+	return emfbisect::Bisect(m_emf.GetRecordCount(), [this](const std::vector<size_t>& vRecords,
+		const SnapshotCallback& fnSnapshot, size_t& nDrawn)
+		{
+			return Play(vRecords, fnSnapshot, nDrawn);
+		}, pred, result, options);
+}
+
+bool EMFRecordBisect::WriteSnapshot(size_t nRecord, LPCWSTR szPath)
+{
+	emfpng::OImageFormat fmt{ (uint32_t)m_szBitmap.cx, (uint32_t)m_szBitmap.cy, false };
+	emfpng::OEncodedBand band;
+	size_t nDrawn = 0;
+	bool bPlayed = Play({ nRecord }, [&](size_t, const OSnapshot& snap)
+		{
+			emfpng::EncodeBand(fmt, snap.pPixels, snap.nStride, snap.nHeight, true, band);
+			return true;
+		}, nDrawn);
+	if (!bPlayed)
+		return false;
+	FILE* fp = nullptr;
+	if (_wfopen_s(&fp, szPath, L"wb") || !fp)
+		return false;
+	emfpng::OPngWriter writer([fp](const void* pData, size_t nSize)
+		{
+			return fwrite(pData, 1, nSize, fp) == nSize;
+		});
+	bool bRet = writer.Begin(fmt, 0) && writer.AddBand(band) && writer.End();
+	bRet = fclose(fp) == 0 && bRet;
+	if (!bRet)
+		DeleteFileW(szPath);
+	return bRet;
+}
@@ -0,0 +1,46 @@
+#ifndef EMF_RECORD_BISECT_H
+#define EMF_RECORD_BISECT_H
+
+#include <vector>
+#include "EmfBisect.h"
+
+class EMFAccess;
+
+// Search of the first record of a metafile after which its rendering meets
+// a predicate (emfbisect), replacing the stepping through the records with
+// "draw to selection". The records are played with GDI+ as by
+// DrawMetafileUntilRecord, on a white bitmap of at most nMaxSize pixels a
+// side, the pixels tested after the records probed of a playback as it goes.
+// The pixels after the last record probed which didn't meet the predicate
+// are kept, and the next playback starts from them: the records before are
+// played again for the state they set (objects, transforms, clipping...),
+// but those which only draw are skipped.
+class EMFRecordBisect
+{
+public:
+	// The records of emf must be read
+	explicit EMFRecordBisect(const EMFAccess& emf, UINT nMaxSize = 2048);
+public:
+	// Size of the bitmap the records are played on
+	inline CSize GetSize() const { return m_szBitmap; }
+
+	bool Bisect(const emfbisect::Predicate& pred, emfbisect::OBisectResult& result,
+		const emfbisect::OBisectOptions& options = emfbisect::OBisectOptions());
+
+	// Pixels after the records up to nRecord included, as a PNG
+	bool WriteSnapshot(size_t nRecord, LPCWSTR szPath);
+private:
+	bool Play(const std::vector<size_t>& vRecords, const emfbisect::SnapshotCallback& fnSnapshot, size_t& nDrawn);
+private:
+	const EMFAccess&		m_emf;
+	CRect					m_rcDraw;
+	CSize					m_szBitmap;
+	std::vector<uint8_t>	m_vPixels;
+	// Records nothing after depends on but the pixels they draw
+	std::vector<bool>		m_vDrawOnly;
+	// Pixels after the records up to m_nKept included, none if SIZE_MAX
+	std::vector<uint8_t>	m_vKept;
+	size_t					m_nKept = SIZE_MAX;
+};
+
+#endif // EMF_RECORD_BISECT_H
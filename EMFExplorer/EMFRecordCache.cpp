@@ -0,0 +1,102 @@
+#include "pch.h"
+#include "framework.h"
+#include "EMFRecordCache.h"
+#include "EMFRecAccess.h"
+
+#undef min
+#undef max
+
+void EMFRecordCache::Touch(EMFRecAccess* pRec, CacheKind nKind, bool bHit)
+{
+	if (bHit)
+		++m_nHits[nKind];
+	else
+		++m_nMisses[nKind];
+	auto& mapEntries = m_mapEntries[nKind];
+	auto itEntry = mapEntries.find(pRec);
+	if (itEntry != mapEntries.end())
+	{
+		auto it = itEntry->second;
+		m_lru.splice(m_lru.begin(), m_lru, it);
+		if (bHit)
+			return;
+		m_nMemory[nKind] -= it->nCost;
+		it->nCost = pRec->GetCacheCost(nKind);
+		m_nMemory[nKind] += it->nCost;
+	}
+	else
+	{
+		// Also for a hit, the cache may have been built before the record was
+		// given this one
+		m_lru.push_front(Entry{ pRec, nKind, pRec->GetCacheCost(nKind) });
+		mapEntries.emplace(pRec, m_lru.begin());
+		m_nMemory[nKind] += m_lru.front().nCost;
+	}
+	Trim();
+}
+
+void EMFRecordCache::Evict(EntryList::iterator it)
+{
+	auto entry = *it;
+	m_nMemory[entry.nKind] -= entry.nCost;
+	m_mapEntries[entry.nKind].erase(entry.pRec);
+	m_lru.erase(it);
+	++m_nEvictions[entry.nKind];
+	entry.pRec->ReleaseCache(entry.nKind);
+}
+
+void EMFRecordCache::Trim()
+{
+	if (!m_nBudget)
+		return;
+	size_t nMemory = 0;
+	for (auto nBytes : m_nMemory)
+		nMemory += nBytes;
+	// The most recent cache is kept even if it's over the budget alone, it's
+	// the one being used
+	while (nMemory > m_nBudget && m_lru.size() > 1)
+	{
+		auto it = std::prev(m_lru.end());
+		nMemory -= it->nCost;
+		Evict(it);
+	}
+}
+
+void EMFRecordCache::SetMemoryBudget(size_t nBytes)
+{
+	m_nBudget = nBytes;
+	Trim();
+}
+
+EMFRecordCache::Stats EMFRecordCache::GetStats(CacheKind nKind) const
+{
+	return Stats{ m_mapEntries[nKind].size(), m_nMemory[nKind], m_nHits[nKind], m_nMisses[nKind], m_nEvictions[nKind] };
+}
+
+EMFRecordCache::Stats EMFRecordCache::GetTotalStats() const
+{
+	Stats total{};
+	for (int nKind = 0; nKind < CacheKindCount; ++nKind)
+	{
+		auto stats = GetStats((CacheKind)nKind);
+		total.nEntries += stats.nEntries;
+		total.nMemory += stats.nMemory;
+		total.nHits += stats.nHits;
+		total.nMisses += stats.nMisses;
+		total.nEvictions += stats.nEvictions;
+	}
+	return total;
+}
+
+LPCWSTR EMFRecordCache::GetKindName(CacheKind nKind)
+{
+	static const LPCWSTR aText[] = { L"Properties", L"Images" };
+	static_assert(_countof(aText) == CacheKindCount);
+	return nKind < CacheKindCount ? aText[nKind] : L"";
+}
+
+void EMFRecordCache::Clear()
+{
+	while (!m_lru.empty())
+		Evict(m_lru.begin());
+}
@@ -0,0 +1,75 @@
+#ifndef EMF_RECORD_CACHE_H
+#define EMF_RECORD_CACHE_H
+
+#include <list>
+#include <unordered_map>
+
+class EMFRecAccess;
+
+// Per-document bound on what the records build on demand: their property
+// trees and their decoded GDI+ images. The records tell the cache when
+// they use one (Touch); once they take more than the memory budget, the
+// least recently used are released by the records holding them, and built
+// again the next time they're asked for (GetProperties, DrawPreview).
+// The metafiles nested in the records are bounded by EMFNestedCache.
+// Not thread-safe, as the records of a document aren't.
+class EMFRecordCache
+{
+public:
+	enum CacheKind
+	{
+		CacheKindProperties,
+		CacheKindImage,
+		CacheKindCount,
+	};
+
+	struct Stats
+	{
+		size_t	nEntries;		// caches held by the records
+		size_t	nMemory;		// estimated size of those
+		size_t	nHits;
+		size_t	nMisses;		// caches built
+		size_t	nEvictions;
+	};
+
+	enum : size_t {
+		DefaultMemoryBudget = 64 * 1024 * 1024,
+	};
+public:
+	// The cache of pRec was used, bHit unless it was just built. Its size is
+	// asked to the record (EMFRecAccess::GetCacheCost) when it's built.
+	void Touch(EMFRecAccess* pRec, CacheKind nKind, bool bHit);
+
+	void SetMemoryBudget(size_t nBytes);
+	inline size_t GetMemoryBudget() const { return m_nBudget; }
+
+	Stats GetStats(CacheKind nKind) const;
+	Stats GetTotalStats() const;
+
+	static LPCWSTR GetKindName(CacheKind nKind);
+
+	// Releases the caches of every record
+	void Clear();
+private:
+	struct Entry
+	{
+		EMFRecAccess*	pRec;
+		CacheKind		nKind;
+		size_t			nCost;
+	};
+	using EntryList = std::list<Entry>;
+
+	void Evict(EntryList::iterator it);
+	void Trim();
+private:
+	// Most recently used first
+	EntryList			m_lru;
+	std::unordered_map<const EMFRecAccess*, EntryList::iterator>	m_mapEntries[CacheKindCount];
+	size_t				m_nBudget = DefaultMemoryBudget;
+	size_t				m_nMemory[CacheKindCount] = {};
+	size_t				m_nHits[CacheKindCount] = {};
+	size_t				m_nMisses[CacheKindCount] = {};
+	size_t				m_nEvictions[CacheKindCount] = {};
+};
+
+#endif // EMF_RECORD_CACHE_H
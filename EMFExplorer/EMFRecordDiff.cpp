@@ -0,0 +1,254 @@
+#include "pch.h"
+#include "framework.h"
+#include "EMFRecordDiff.h"
+#include "EMFAccess.h"
+
+#include <unordered_map>
+
+#undef min
+#undef max
+
+using namespace emfdiff;
+
+EMFRecordDiff::EMFRecordDiff(EMFAccess* pEMFA, EMFAccess* pEMFB)
+	: m_pEMFA(pEMFA)
+	, m_pEMFB(pEMFB)
+{
+}
+
+static void GetRecordKeys(const EMFAccess* pEMF, std::vector<ORecordKey>& vKeys)
+{
+	vKeys.resize(pEMF->GetRecordCount());
+	for (size_t ii = 0; ii < vKeys.size(); ++ii)
+	{
+		auto pRec = pEMF->GetRecord(ii);
+		vKeys[ii] = { pRec->GetContentHash(), (uint32_t)pRec->GetRecordType() };
+	}
+}
+
+void EMFRecordDiff::Compare(const ODiffOptions& options)
+{
+	std::vector<ORecordKey> vKeysA, vKeysB;
+	GetRecordKeys(m_pEMFA, vKeysA);
+	GetRecordKeys(m_pEMFB, vKeysB);
+	DiffRecords(vKeysA, vKeysB, m_vRuns, options);
+}
+
+EMFRecordDiff::DiffStats EMFRecordDiff::GetStats() const
+{
+	DiffStats stats;
+	for (auto& run : m_vRuns)
+	{
+		switch (run.Type)
+		{
+		case OEditType::Equal:
+			stats.nEqual += run.nCount;
+			break;
+		case OEditType::Delete:
+			stats.nDeleted += run.nCount;
+			break;
+		case OEditType::Insert:
+			stats.nInserted += run.nCount;
+			break;
+		case OEditType::Modify:
+			stats.nModified += run.nCount;
+			break;
+		}
+	}
+	return stats;
+}
+
+static CStringW GetArrayElemText(const PropertyNodeArray& node, size_t index)
+{
+	CStringW strVal;
+	switch (node.elem_type)
+	{
+	case PropertyNodeArray::ElemTypeu8t:
+		strVal.Format(L"0x%02X", ((emfplus::u8t*)node.data)[index]);
+		break;
+	case PropertyNodeArray::ElemTypeu16t:
+		strVal.Format(L"0x%04X", ((emfplus::u16t*)node.data)[index]);
+		break;
+	case PropertyNodeArray::ElemTypeu32t:
+		strVal.Format(L"0x%08X", ((emfplus::u32t*)node.data)[index]);
+		break;
+	case PropertyNodeArray::ElemTypeuFloat:
+		strVal.Format(L"%g", ((emfplus::Float*)node.data)[index]);
+		break;
+	case PropertyNodeArray::ElemTypePlusPoint:
+		{
+			auto& val = ((emfplus::OEmfPlusPoint*)node.data)[index];
+			strVal.Format(L"%d, %d", val.x, val.y);
+		}
+		break;
+	case PropertyNodeArray::ElemTypePlusPointF:
+		{
+			auto& val = ((emfplus::OEmfPlusPointF*)node.data)[index];
+			strVal.Format(L"%g, %g", val.x, val.y);
+		}
+		break;
+	case PropertyNodeArray::ElemTypeGDIPOINTL:
+		{
+			auto& val = ((POINTL*)node.data)[index];
+			strVal.Format(L"%d, %d", val.x, val.y);
+		}
+		break;
+	case PropertyNodeArray::ElemTypePlusRect:
+		{
+			auto& val = ((emfplus::OEmfPlusRect*)node.data)[index];
+			strVal.Format(L"%d, %d, %d, %d", val.X, val.Y, val.Width, val.Height);
+		}
+		break;
+	case PropertyNodeArray::ElemTypePlusRectF:
+		{
+			auto& val = ((emfplus::OEmfPlusRectF*)node.data)[index];
+			strVal.Format(L"%g, %g, %g, %g", val.X, val.Y, val.Width, val.Height);
+		}
+		break;
+	case PropertyNodeArray::ElemTypePlusCharacterRange:
+		{
+			auto& val = ((emfplus::OEmfPlusCharacterRange*)node.data)[index];
+			strVal.Format(L"%d, %d", val.First, val.Length);
+		}
+		break;
+	case PropertyNodeArray::ElemTypePlusARGB:
+		strVal.Format(L"#%08X", ((emfplus::OEmfPlusARGB*)node.data)[index].argb);
+		break;
+	case PropertyNodeArray::ElemTypeGDIPALETTEENTRY:
+		{
+			auto& val = ((PALETTEENTRY*)node.data)[index];
+			strVal.Format(L"%u, %u, %u, 0x%02X", val.peRed, val.peGreen, val.peBlue, val.peFlags);
+		}
+		break;
+	default:
+		ASSERT(0);
+		break;
+	}
+	return strVal;
+}
+
+using PropertyField = std::pair<std::wstring, std::wstring>;
+
+// The property tree as (path, value) pairs, in order
+static void FlattenProperties(const PropertyNode& node, const std::wstring& strPath, std::vector<PropertyField>& vFields)
+{
+	CStringW strVal;
+	switch (node.GetNodeType())
+	{
+	case PropertyNode::NodeTypeBranch:
+		if (!node.text.IsEmpty())
+			vFields.emplace_back(strPath, (LPCWSTR)node.text);
+		for (auto& sub : node.sub)
+			FlattenProperties(*sub, strPath + L"/" + (LPCWSTR)sub->name, vFields);
+		return;
+	case PropertyNode::NodeTypeRectInt:
+		{
+			auto& rc = ((const PropertyNodeRectInt&)node).rect;
+			strVal.Format(L"%d, %d, %d, %d", rc.left, rc.top, rc.right, rc.bottom);
+		}
+		break;
+	case PropertyNode::NodeTypeRectFloat:
+		{
+			auto& rc = ((const PropertyNodePlusRectF&)node).data;
+			strVal.Format(L"%g, %g, %g, %g", rc.X, rc.Y, rc.Width, rc.Height);
+		}
+		break;
+	case PropertyNode::NodeTypeRectData:
+		{
+			auto& rc = ((const PropertyNodePlusRectData&)node).data;
+			if (rc.AsInt)
+				strVal.Format(L"%d, %d, %d, %d", rc.ival->X, rc.ival->Y, rc.ival->Width, rc.ival->Height);
+			else
+				strVal.Format(L"%g, %g, %g, %g", rc.fval->X, rc.fval->Y, rc.fval->Width, rc.fval->Height);
+		}
+		break;
+	case PropertyNode::NodeTypeSizeInt:
+		{
+			auto& sz = ((const PropertyNodeSizeInt&)node).size;
+			strVal.Format(L"%d x %d", sz.cx, sz.cy);
+		}
+		break;
+	case PropertyNode::NodeTypeMatrix:
+		{
+			auto& mat = ((const PropertyNodePlusTransform&)node).data;
+			strVal.Format(L"%g, %g, %g, %g, %g, %g", mat[0], mat[1], mat[2], mat[3], mat[4], mat[5]);
+		}
+		break;
+	case PropertyNode::NodeTypeColor:
+		strVal.Format(L"#%08X", ((const PropertyNodeColor&)node).data.argb);
+		break;
+	case PropertyNode::NodeTypeFont:
+		return;
+	case PropertyNode::NodeTypePointDataArray:
+	case PropertyNode::NodeTypeArray:
+		{
+			auto& arr = (const PropertyNodeArray&)node;
+			vFields.emplace_back(strPath + L"/Size", std::to_wstring(arr.size));
+			for (size_t ii = 0; ii < arr.size; ++ii)
+				vFields.emplace_back(strPath + L"[" + std::to_wstring(ii) + L"]", (LPCWSTR)GetArrayElemText(arr, ii));
+		}
+		return;
+	default:
+		strVal = node.text;
+		break;
+	}
+	vFields.emplace_back(strPath, (LPCWSTR)strVal);
+}
+
+static void GetPropertyFields(EMFAccess* pEMF, size_t nIndex, std::vector<PropertyField>& vFields)
+{
+	auto pRec = pEMF->GetRecord(nIndex);
+	if (!pRec)
+		return;
+	CachePropertiesContext ctxt{ pEMF };
+	auto props = pRec->GetProperties(ctxt);
+	for (auto& sub : props->sub)
+	{
+		// Where the record is, and the hashes the records were matched on
+		if (sub->name == L"RecordOffset" || sub->name == L"LinkedRecords"
+			|| sub->name == L"ContentHash" || sub->name == L"SemanticHash")
+			continue;
+		FlattenProperties(*sub, (LPCWSTR)sub->name, vFields);
+	}
+	// Repeated names are told apart by their occurrence
+	std::unordered_map<std::wstring, size_t> mapCount;
+	for (auto& field : vFields)
+	{
+		auto nCount = mapCount[field.first]++;
+		if (nCount)
+			field.first += L"#" + std::to_wstring(nCount + 1);
+	}
+}
+
+std::vector<EMFRecordDiff::FieldDiff> EMFRecordDiff::GetFieldDiffs(size_t nIndexA, size_t nIndexB) const
+{
+	std::vector<PropertyField> vFieldsA, vFieldsB;
+	GetPropertyFields(m_pEMFA, nIndexA, vFieldsA);
+	GetPropertyFields(m_pEMFB, nIndexB, vFieldsB);
+
+	std::unordered_map<std::wstring, size_t> mapB;
+	for (size_t ii = 0; ii < vFieldsB.size(); ++ii)
+		mapB.emplace(vFieldsB[ii].first, ii);
+	std::vector<bool> vMatchedB(vFieldsB.size());
+
+	std::vector<FieldDiff> vDiffs;
+	for (auto& field : vFieldsA)
+	{
+		auto it = mapB.find(field.first);
+		if (it == mapB.end())
+		{
+			vDiffs.push_back({ field.first, field.second, std::wstring() });
+			continue;
+		}
+		vMatchedB[it->second] = true;
+		auto& strB = vFieldsB[it->second].second;
+		if (field.second != strB)
+			vDiffs.push_back({ field.first, field.second, strB });
+	}
+	for (size_t ii = 0; ii < vFieldsB.size(); ++ii)
+	{
+		if (!vMatchedB[ii])
+			vDiffs.push_back({ vFieldsB[ii].first, std::wstring(), vFieldsB[ii].second });
+	}
+	return vDiffs;
+}
@@ -0,0 +1,48 @@
+#ifndef EMF_RECORD_DIFF_H
+#define EMF_RECORD_DIFF_H
+
+#include <string>
+#include <vector>
+#include "EmfDiff.h"
+
+class EMFAccess;
+
+// Record-level comparison of two metafiles: which records were deleted,
+// inserted or modified, and for a modified record which of its properties
+// changed. Both metafiles must have their records read.
+class EMFRecordDiff
+{
+public:
+	EMFRecordDiff(EMFAccess* pEMFA, EMFAccess* pEMFB);
+public:
+	void Compare(const emfdiff::ODiffOptions& options = emfdiff::ODiffOptions());
+
+	inline const std::vector<emfdiff::OEditRun>& GetRuns() const { return m_vRuns; }
+
+	struct DiffStats
+	{
+		size_t	nEqual		= 0;
+		size_t	nDeleted	= 0;
+		size_t	nInserted	= 0;
+		size_t	nModified	= 0;
+	};
+	DiffStats GetStats() const;
+
+	struct FieldDiff
+	{
+		std::wstring	strPath;	// property names joined with '/'
+		// Empty when the property only exists on the other side
+		std::wstring	strA;
+		std::wstring	strB;
+	};
+	// Properties differing between record nIndexA of A and nIndexB of B.
+	// The properties get cached by the records, so this is meant for the
+	// modified records only.
+	std::vector<FieldDiff> GetFieldDiffs(size_t nIndexA, size_t nIndexB) const;
+private:
+	EMFAccess*						m_pEMFA;
+	EMFAccess*						m_pEMFB;
+	std::vector<emfdiff::OEditRun>	m_vRuns;
+};
+
+#endif // EMF_RECORD_DIFF_H
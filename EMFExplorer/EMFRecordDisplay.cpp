@@ -0,0 +1,53 @@
+#include "pch.h"
+#include "framework.h"
+#include "EMFRecordDisplay.h"
+#include "EMFAccess.h"
+
+#undef min
+#undef max
+
+static_assert(sizeof(wchar_t) == sizeof(char16_t), "The display model is UTF-16");
+
+// The text of a record written straight into its row
+class DisplayRowTextSink : public EMFRecordTextSink
+{
+public:
+	explicit DisplayRowTextSink(emfdisplay::ODisplayModel& model) : m_model(model) {}
+
+	LPWSTR AppendBuffer(size_t nLength) override { return (LPWSTR)m_model.AppendText(nLength); }
+private:
+	emfdisplay::ODisplayModel&	m_model;
+};
+
+size_t AddRecordDisplayRows(emfdisplay::ODisplayModel& model, const EMFAccess& emf, size_t nMaxRows)
+{
+	size_t nFirst = model.GetRowCount();
+	size_t nCount = emf.GetRecordCount();
+	if (nFirst >= nCount)
+		return 0;
+	// Most names are short, the text records are few
+	if (!nFirst)
+		model.Reserve(nCount, nCount * 24);
+	size_t nEnd = nFirst + std::min(nMaxRows, nCount - nFirst);
+	DisplayRowTextSink sink(model);
+	for (size_t ii = nFirst; ii < nEnd; ++ii)
+	{
+		auto pRec = emf.GetRecord(ii);
+		emfdisplay::ORowInput row{};
+		row.szName = (const char16_t*)pRec->GetRecordName();
+		row.nType = (uint32_t)pRec->GetRecordType();
+		row.nCategory = (uint8_t)pRec->GetRecordCategory();
+		if (pRec->IsDrawingRecord())
+			row.nFlags |= emfdisplay::RowFlagDrawing;
+		COLORREF cr;
+		if (pRec->GetRecordColor(cr))
+		{
+			row.nColor = cr;
+			row.nFlags |= emfdisplay::RowFlagColor;
+		}
+		model.BeginRow(row);
+		pRec->AppendRecordText(sink);
+		model.EndRow();
+	}
+	return nEnd - nFirst;
+}
@@ -0,0 +1,13 @@
+#ifndef EMF_RECORD_DISPLAY_H
+#define EMF_RECORD_DISPLAY_H
+
+#include "EmfDisplayModel.h"
+
+class EMFAccess;
+
+// Appends the rows of the records of emf that model doesn't have yet, at
+// most nMaxRows of them, and returns how many were added. A model can so be
+// built a slice at a time, on the thread using the records.
+size_t AddRecordDisplayRows(emfdisplay::ODisplayModel& model, const EMFAccess& emf, size_t nMaxRows);
+
+#endif // EMF_RECORD_DISPLAY_H
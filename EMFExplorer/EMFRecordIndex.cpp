@@ -0,0 +1,153 @@
+#include "pch.h"
+#include "framework.h"
+#include "EMFRecordIndex.h"
+#include "DataHash.h"
+
+#undef min
+#undef max
+
+using namespace emfindex;
+
+EMFRecordIndex::EMFRecordIndex(LPCWSTR szFile, std::shared_ptr<const emfplus::memory_vector> pFileData)
+	: m_strIndexPath(GetIndexPath(szFile))
+	, m_pFileData(std::move(pFileData))
+{
+	WIN32_FILE_ATTRIBUTE_DATA attr;
+	if (!GetFileAttributesExW(szFile, GetFileExInfoStandard, &attr))
+		return;
+	m_key.FileSize = ((uint64_t)attr.nFileSizeHigh << 32) | attr.nFileSizeLow;
+	m_key.FileTime = ((uint64_t)attr.ftLastWriteTime.dwHighDateTime << 32) | attr.ftLastWriteTime.dwLowDateTime;
+	// Changed since it was read, nothing can be trusted
+	if (m_key.FileSize != m_pFileData->size())
+		return;
+	m_key.FileHash = data_access::GetHash64(m_pFileData->data(), m_pFileData->size());
+	m_bKeyValid = true;
+}
+
+EMFRecordIndex::~EMFRecordIndex()
+{
+	UnmapIndex();
+}
+
+std::wstring EMFRecordIndex::GetIndexPath(LPCWSTR szFile)
+{
+	return std::wstring(szFile) + L".emxidx";
+}
+
+bool EMFRecordIndex::MapIndex()
+{
+	if (m_bMapTried)
+		return m_pIndex != nullptr;
+	m_bMapTried = true;
+	m_hIndexFile = CreateFileW(m_strIndexPath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_hIndexFile == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER nSize;
+	if (!GetFileSizeEx(m_hIndexFile, &nSize) || nSize.QuadPart < (LONGLONG)sizeof(OIndexHeader)
+		|| (ULONGLONG)nSize.QuadPart > SIZE_MAX)
+	{
+		UnmapIndex();
+		return false;
+	}
+	m_hMapping = CreateFileMappingW(m_hIndexFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_hMapping)
+		m_pIndex = (const emfplus::u8t*)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+	if (!m_pIndex)
+	{
+		UnmapIndex();
+		return false;
+	}
+	m_nIndexSize = (size_t)nSize.QuadPart;
+	if (!IsIndexValid(m_pIndex, m_nIndexSize, m_key))
+	{
+		UnmapIndex();
+		return false;
+	}
+	return true;
+}
+
+void EMFRecordIndex::UnmapIndex()
+{
+	if (m_pIndex)
+		UnmapViewOfFile(m_pIndex);
+	if (m_hMapping)
+		CloseHandle(m_hMapping);
+	if (m_hIndexFile != INVALID_HANDLE_VALUE)
+		CloseHandle(m_hIndexFile);
+	m_pIndex = nullptr;
+	m_nIndexSize = 0;
+	m_hMapping = nullptr;
+	m_hIndexFile = INVALID_HANDLE_VALUE;
+}
+
+bool EMFRecordIndex::ReadRecords(size_t nDocOffset, size_t nDocSize, const RecordCallback& fn)
+{
+	// Copied out so that the pages of a spool file can be replayed at once,
+	// and written meanwhile
+	std::vector<OIndexRecord> vRecords;
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		if (!m_bKeyValid || !MapIndex())
+			return false;
+		size_t nCount = 0;
+		auto pRecords = FindStream(m_pIndex, nDocOffset, nDocSize, nCount);
+		if (!pRecords || !nCount)
+			return false;
+		vRecords.assign(pRecords, pRecords + nCount);
+	}
+	auto pDoc = m_pFileData->data() + nDocOffset;
+	for (auto& rec : vRecords)
+	{
+		if (!fn(rec, pDoc + rec.DataOffset))
+			return false;
+	}
+	return true;
+}
+
+bool EMFRecordIndex::WriteRecords(size_t nDocOffset, size_t nDocSize, const std::vector<ORecordRef>& vRecs)
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	if (!m_bKeyValid || nDocOffset > m_pFileData->size() || nDocSize > m_pFileData->size() - nDocOffset)
+		return false;
+	OStreamData streamNew{ nDocOffset, nDocSize };
+	if (!LocateRecords(m_pFileData->data() + nDocOffset, nDocSize, vRecs, streamNew.vRecords))
+		return false;
+
+	// The documents already indexed are kept
+	std::vector<OStreamData> vStreams;
+	if (MapIndex())
+	{
+		auto& hdr = *(const OIndexHeader*)m_pIndex;
+		auto pStreams = (const OIndexStream*)(m_pIndex + sizeof(OIndexHeader));
+		for (emfplus::u32t ii = 0; ii < hdr.StreamCount; ++ii)
+		{
+			auto& stream = pStreams[ii];
+			if (stream.DocOffset == nDocOffset && stream.DocSize == nDocSize)
+				continue;
+			auto pRecords = (const OIndexRecord*)(m_pIndex + stream.RecordOffset);
+			vStreams.push_back({ stream.DocOffset, stream.DocSize,
+				std::vector<OIndexRecord>(pRecords, pRecords + stream.RecordCount) });
+		}
+	}
+	vStreams.push_back(std::move(streamNew));
+	emfplus::memory_vector vIndex;
+	BuildIndex(m_key, vStreams, vIndex);
+
+	// Written aside then swapped in, a reader never sees half an index
+	UnmapIndex();
+	m_bMapTried = false;
+	std::wstring strTemp = m_strIndexPath + L".tmp";
+	HANDLE hFile = CreateFileW(strTemp.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+	DWORD nWritten = 0;
+	bool bRet = vIndex.size() <= MAXDWORD
+		&& WriteFile(hFile, vIndex.data(), (DWORD)vIndex.size(), &nWritten, nullptr) && nWritten == vIndex.size();
+	CloseHandle(hFile);
+	if (bRet)
+		bRet = MoveFileExW(strTemp.c_str(), m_strIndexPath.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+	if (!bRet)
+		DeleteFileW(strTemp.c_str());
+	return bRet;
+}
@@ -0,0 +1,54 @@
+#ifndef EMF_RECORD_INDEX_H
+#define EMF_RECORD_INDEX_H
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "EmfIndex.h"
+
+// Sidecar record index of a metafile file (<file>.emxidx, see EmfIndex.h
+// for the format). It's mapped when first read; the documents it doesn't
+// cover (yet) are added once their records have been enumerated, and the
+// index file is rewritten.
+class EMFRecordIndex
+{
+public:
+	// pFileData is the content of szFile, as read
+	EMFRecordIndex(LPCWSTR szFile, std::shared_ptr<const emfplus::memory_vector> pFileData);
+	~EMFRecordIndex();
+public:
+	static std::wstring GetIndexPath(LPCWSTR szFile);
+
+	inline const emfplus::memory_vector& GetFileData() const { return *m_pFileData; }
+
+	using RecordCallback = std::function<bool(const emfindex::OIndexRecord& rec, const emfplus::u8t* pData)>;
+
+	// Calls fn on the indexed records of the document found at nDocOffset in
+	// the file, in order. Returns false when the index doesn't hold that
+	// document (or doesn't match the file anymore), or fn returns false.
+	bool ReadRecords(size_t nDocOffset, size_t nDocSize, const RecordCallback& fn);
+
+	// Stores the records of the document, in enumeration order, and writes
+	// the index file
+	bool WriteRecords(size_t nDocOffset, size_t nDocSize, const std::vector<emfindex::ORecordRef>& vRecs);
+private:
+	bool MapIndex();
+
+	void UnmapIndex();
+private:
+	std::wstring			m_strIndexPath;
+	std::shared_ptr<const emfplus::memory_vector>	m_pFileData;
+	emfindex::OIndexKey		m_key = {};
+	// The file on disk is the one that was read
+	bool					m_bKeyValid = false;
+
+	std::mutex				m_mtx;
+	bool					m_bMapTried = false;
+	HANDLE					m_hIndexFile = INVALID_HANDLE_VALUE;
+	HANDLE					m_hMapping = nullptr;
+	const emfplus::u8t*		m_pIndex = nullptr;
+	size_t					m_nIndexSize = 0;
+};
+
+#endif // EMF_RECORD_INDEX_H
@@ -0,0 +1,170 @@
+#include "pch.h"
+#include "framework.h"
+#include "EMFRegression.h"
+#include "EMFAccess.h"
+#include "EMFGoldenCompare.h"
+#include "ThreadPool.h"
+#include <filesystem>
+#include <mutex>
+
+#undef min
+#undef max
+
+static double GetSeconds()
+{
+	static LARGE_INTEGER s_nFreq = [] { LARGE_INTEGER freq; QueryPerformanceFrequency(&freq); return freq; }();
+	LARGE_INTEGER nCount;
+	QueryPerformanceCounter(&nCount);
+	return (double)nCount.QuadPart / s_nFreq.QuadPart;
+}
+
+bool EMFRegression::IsPassed(const FileResult& res)
+{
+	if (!res.bParsed)
+		return false;
+	for (auto& render : res.vRenders)
+	{
+		if (!IsPassed(render.nStatus))
+			return false;
+	}
+	return true;
+}
+
+void EMFRegression::CheckRendering(const Entry& entry, const EMFAccess& emf, RenderResult& render)
+{
+	auto& hdr = emf.GetMetafileHeader();
+	if (hdr.Width <= 0 || hdr.Height <= 0)
+		return;
+	render.nHeight = std::max(1u, (UINT)((double)render.nWidth * hdr.Height / hdr.Width + 0.5));
+	if (render.nWidth > INT_MAX / 4 || render.nHeight > INT_MAX)
+		return;
+	std::vector<uint8_t> vPixels((size_t)render.nWidth * 4 * render.nHeight);
+	double fStart = GetSeconds();
+	{
+		Gdiplus::Bitmap bmp((INT)render.nWidth, (INT)render.nHeight, (INT)render.nWidth * 4, PixelFormat32bppARGB,
+			vPixels.data());
+		if (bmp.GetLastStatus() != Gdiplus::Ok)
+			return;
+		Gdiplus::Graphics gg(&bmp);
+		gg.SetCompositingQuality(Gdiplus::CompositingQualityHighQuality);
+		gg.SetInterpolationMode(Gdiplus::InterpolationModeHighQualityBicubic);
+		gg.SetSmoothingMode(Gdiplus::SmoothingModeAntiAlias8x8);
+		gg.SetTextRenderingHint(Gdiplus::TextRenderingHintAntiAliasGridFit);
+		gg.Clear(Gdiplus::Color::White);
+		emf.DrawMetafile(gg, CRect(0, 0, (int)render.nWidth, (int)render.nHeight));
+		gg.Flush(Gdiplus::FlushIntentionSync);
+	}
+	render.fRenderTime = GetSeconds() - fStart;
+	emfcompare::OImageView img{ render.nWidth, render.nHeight, (ptrdiff_t)render.nWidth * 4, vPixels.data() };
+
+	wchar_t szSuffix[32];
+	swprintf_s(szSuffix, L".%u.png", render.nWidth);
+	std::wstring strFile = entry.strName + szSuffix;
+	std::filesystem::path pathGolden = std::filesystem::path((LPCWSTR)m_options.strGoldenDir) / strFile;
+	emfplus::memory_vector vGolden;
+	UINT nWidth = 0, nHeight = 0;
+	std::vector<uint8_t> vGoldenPixels;
+	if (!ReadFileData(pathGolden.c_str(), vGolden))
+		render.nStatus = Status::NoGolden;
+	else if (!EMFGoldenCompare::DecodeImage(vGolden.data(), vGolden.size(), nWidth, nHeight, vGoldenPixels))
+		return;
+	else if (nWidth != render.nWidth || nHeight != render.nHeight)
+		render.nStatus = Status::SizeDiffers;
+	else
+	{
+		emfcompare::OImageView imgGolden{ nWidth, nHeight, (ptrdiff_t)nWidth * 4, vGoldenPixels.data() };
+		emfcompare::Compare(img, imgGolden, m_options.compare, render.result);
+		if (render.result.bIdentical)
+			render.nStatus = Status::Identical;
+		else if (!render.result.nMismatched)
+			render.nStatus = Status::Within;
+		else
+		{
+			render.nStatus = Status::Different;
+			if (!m_options.bUpdate && !m_options.strOutDir.IsEmpty())
+			{
+				auto pathHeatmap = std::filesystem::path((LPCWSTR)m_options.strOutDir) / strFile;
+				pathHeatmap.replace_extension(L".diff.png");
+				EMFGoldenCompare::WriteHeatmap(pathHeatmap.c_str(), img, imgGolden, m_options.compare.nTolerance);
+			}
+		}
+	}
+	if (IsPassed(render.nStatus))
+		return;
+	if (m_options.bUpdate)
+		render.nStatus = EMFGoldenCompare::WritePng(pathGolden.c_str(), img) ? Status::Written : Status::Failed;
+	else if (!m_options.strOutDir.IsEmpty())
+		EMFGoldenCompare::WritePng((std::filesystem::path((LPCWSTR)m_options.strOutDir) / strFile).c_str(), img);
+}
+
+void EMFRegression::CheckEntry(const Entry& entry, FileResult& res)
+{
+	res.pEntry = &entry;
+	for (auto nWidth : m_options.vWidths)
+	{
+		res.vRenders.emplace_back();
+		res.vRenders.back().nWidth = nWidth;
+	}
+	emfplus::memory_vector data;
+	if (entry.strPath.empty())
+	{
+		if (!emfgen::GenerateMetafile(entry.genOptions, data))
+			return;
+	}
+	else if (!ReadFileData(entry.strPath.c_str(), data))
+		return;
+	if (data.empty())
+		return;
+	res.nSize = data.size();
+	double fStart = GetSeconds();
+	EMFAccess emf(data);
+	res.bParsed = emf.GetRecords();
+	res.fParseTime = GetSeconds() - fStart;
+	res.nRecords = emf.GetRecordCount();
+	if (!res.bParsed)
+		return;
+	for (auto& render : res.vRenders)
+		CheckRendering(entry, emf, render);
+}
+
+void EMFRegression::Run(const std::vector<Entry>& vEntries, const std::function<void(const FileResult&)>& fnResult)
+{
+	m_vResults.assign(vEntries.size(), FileResult());
+	std::mutex mtxResult;
+	ThreadPool pool(m_options.nThreads);
+	for (size_t ii = 0; ii < vEntries.size(); ++ii)
+	{
+		pool.Submit([&, ii]
+			{
+				// Each its own result, only the callback is shared
+				CheckEntry(vEntries[ii], m_vResults[ii]);
+				std::lock_guard<std::mutex> lock(mtxResult);
+				fnResult(m_vResults[ii]);
+			});
+	}
+	pool.Wait();
+}
+
+bool EMFRegression::WriteTimings(LPCWSTR szPath) const
+{
+	FILE* fp = nullptr;
+	if (_wfopen_s(&fp, szPath, L"wb") != 0 || !fp)
+		return false;
+	fprintf(fp, "name,bytes,records,parse_ms");
+	for (auto nWidth : m_options.vWidths)
+		fprintf(fp, ",render_ms@%u", nWidth);
+	fprintf(fp, "\n");
+	for (auto& res : m_vResults)
+	{
+		if (!res.pEntry)
+			continue;
+		// Names are paths, quoted as any of them may hold a comma
+		CStringA strName(CW2A(res.pEntry->strName.c_str(), CP_UTF8));
+		strName.Replace("\"", "\"\"");
+		fprintf(fp, "\"%s\",%zu,%zu,%.3f", (LPCSTR)strName, res.nSize, res.nRecords, res.fParseTime * 1e3);
+		for (auto& render : res.vRenders)
+			fprintf(fp, ",%.3f", render.fRenderTime * 1e3);
+		fprintf(fp, "\n");
+	}
+	return fclose(fp) == 0;
+}
@@ -0,0 +1,96 @@
+#ifndef EMF_REGRESSION_H
+#define EMF_REGRESSION_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "EmfGenerator.h"
+#include "EmfImageCompare.h"
+
+class EMFAccess;
+
+// Regression check of the rendering of a corpus of metafiles, files or
+// generated ones (emfgen), against goldens. Each metafile is parsed (its
+// records read, as when it's opened) and drawn at each of the widths with
+// GDI+ on white, and the rendering compared (emfcompare) to the golden
+// <golden dir>\<name>.<width>.png. The metafiles are checked on a thread
+// pool, and the time taken to parse and render each is kept, to compare
+// from one run to the next.
+class EMFRegression
+{
+public:
+	struct Options
+	{
+		std::vector<UINT>			vWidths = { 256, 1024 };
+		emfcompare::OCompareOptions	compare;
+		CString						strGoldenDir;
+		// The renderings which differ and their heatmaps, none if empty
+		CString						strOutDir;
+		// Writes the goldens which are missing or differ rather than failing
+		bool						bUpdate = false;
+		unsigned					nThreads = 0;	// one per core
+	};
+
+	struct Entry
+	{
+		std::wstring			strName;	// of the goldens, '\' separated
+		std::wstring			strPath;	// of the file, empty when generated
+		emfgen::OGenOptions		genOptions;
+	};
+
+	enum class Status
+	{
+		Identical,
+		Within,			// no pixel differs by more than the tolerance
+		Different,
+		SizeDiffers,
+		NoGolden,
+		Written,		// the golden, with bUpdate
+		Failed,			// the metafile couldn't be read or drawn, the golden decoded or written
+	};
+
+	struct RenderResult
+	{
+		UINT						nWidth = 0;
+		UINT						nHeight = 0;
+		Status						nStatus = Status::Failed;
+		emfcompare::OCompareResult	result;
+		double						fRenderTime = 0;	// seconds
+	};
+
+	struct FileResult
+	{
+		const Entry*				pEntry = nullptr;
+		bool						bParsed = false;
+		size_t						nSize = 0;			// bytes of the metafile
+		size_t						nRecords = 0;
+		double						fParseTime = 0;		// seconds
+		std::vector<RenderResult>	vRenders;
+	};
+
+	explicit EMFRegression(const Options& options) : m_options(options) {}
+public:
+	static inline bool IsPassed(Status nStatus)
+	{
+		return nStatus == Status::Identical || nStatus == Status::Within || nStatus == Status::Written;
+	}
+
+	static bool IsPassed(const FileResult& res);
+
+	// fnResult gets the metafiles one at a time, as they're done
+	void Run(const std::vector<Entry>& vEntries, const std::function<void(const FileResult&)>& fnResult);
+
+	// In the order of the entries
+	inline const std::vector<FileResult>& GetResults() const { return m_vResults; }
+
+	// CSV: name,bytes,records,parse_ms,render_ms@<width>...
+	bool WriteTimings(LPCWSTR szPath) const;
+private:
+	void CheckEntry(const Entry& entry, FileResult& res);
+	void CheckRendering(const Entry& entry, const EMFAccess& emf, RenderResult& render);
+private:
+	Options						m_options;
+	std::vector<FileResult>		m_vResults;
+};
+
+#endif // EMF_REGRESSION_H
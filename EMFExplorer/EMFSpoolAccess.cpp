@@ -0,0 +1,77 @@
+#include "pch.h"
+#include "framework.h"
+#include "EMFSpoolAccess.h"
+#include "EMFAccess.h"
+#include "EMFRecordIndex.h"
+#include "ThreadPool.h"
+#include "EMFTrace.h"
+
+#undef min
+#undef max
+
+EMFSpoolAccess::EMFSpoolAccess(emfplus::memory_vector&& data, LPCWSTR szName)
+	: m_pData(std::make_shared<const emfplus::memory_vector>(std::move(data)))
+	, m_strName(szName ? szName : L"")
+{
+	EMF_TRACE_SCOPE("BuildSpoolIndex", "load");
+	m_bValid = emfspool::BuildSpoolIndex(m_pData->data(), m_pData->size(), m_index);
+	m_pSlots.reset(new PageSlot[m_index.vPages.size()]);
+}
+
+EMFSpoolAccess::~EMFSpoolAccess()
+{
+}
+
+const emfplus::u8t* EMFSpoolAccess::GetPageData(size_t nPage, size_t& nSize) const
+{
+	if (nPage >= m_index.vPages.size())
+	{
+		nSize = 0;
+		return nullptr;
+	}
+	auto& page = m_index.vPages[nPage];
+	nSize = page.nSize;
+	return m_pData->data() + page.nOffset;
+}
+
+std::shared_ptr<EMFAccess> EMFSpoolAccess::GetPage(size_t nPage)
+{
+	size_t nSize = 0;
+	auto pData = GetPageData(nPage, nSize);
+	if (!pData)
+		return nullptr;
+	auto& slot = m_pSlots[nPage];
+	std::lock_guard<std::mutex> lock(slot.mtx);
+	auto emf = slot.wpEMF.lock();
+	if (!emf)
+	{
+		emf = std::make_shared<EMFAccess>(pData, nSize);
+		if (!m_strName.empty())
+			emf->AddNestedPath(m_strName.c_str());
+		emf->AddNestedPath((L"Page " + std::to_wstring(nPage + 1)).c_str());
+		if (m_pRecordIndex)
+			emf->SetRecordIndex(m_pRecordIndex, m_index.vPages[nPage].nOffset, nSize);
+		slot.wpEMF = emf;
+	}
+	return emf;
+}
+
+void EMFSpoolAccess::SetRecordIndex(LPCWSTR szFile)
+{
+	m_pRecordIndex = std::make_shared<EMFRecordIndex>(szFile, m_pData);
+}
+
+void EMFSpoolAccess::ForEachPage(const std::function<void(size_t nPage, EMFAccess& emf)>& fn, unsigned nThreads)
+{
+	ThreadPool pool(nThreads);
+	for (size_t ii = 0; ii < GetPageCount(); ++ii)
+	{
+		pool.Submit([this, ii, &fn]
+			{
+				auto emf = GetPage(ii);
+				if (emf && emf->GetRecords())
+					fn(ii, *emf);
+			});
+	}
+	pool.Wait();
+}
@@ -0,0 +1,60 @@
+#ifndef EMF_SPOOL_ACCESS_H
+#define EMF_SPOOL_ACCESS_H
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "EmfSpool.h"
+
+class EMFAccess;
+class EMFRecordIndex;
+
+// Print spool file (.SPL) opened as a set of pages. The file is indexed
+// once, then every page is an independent EMFAccess created when it's
+// first asked for, so any page of a long job can be reached directly and
+// pages can be parsed or rendered on several threads at once.
+class EMFSpoolAccess
+{
+public:
+	// szName is the nested path root of the pages (e.g. the file name)
+	EMFSpoolAccess(emfplus::memory_vector&& data, LPCWSTR szName = nullptr);
+	~EMFSpoolAccess();
+public:
+	inline bool IsValid() const { return m_bValid; }
+
+	inline const emfspool::OSpoolIndex& GetIndex() const { return m_index; }
+
+	inline size_t GetPageCount() const { return m_index.vPages.size(); }
+
+	// Bytes of the page's EMF document, valid as long as this object
+	const emfplus::u8t* GetPageData(size_t nPage, size_t& nSize) const;
+
+	// Page document, shared while anybody holds it. Safe to call from
+	// several threads; the records aren't read.
+	std::shared_ptr<EMFAccess> GetPage(size_t nPage);
+
+	// Runs fn on the records of every page, nThreads pages at a time
+	// (0: one per core). A page is released once fn returns for it.
+	void ForEachPage(const std::function<void(size_t nPage, EMFAccess& emf)>& fn, unsigned nThreads = 0);
+
+	// The pages created from now on use the record index of szFile, the
+	// file the data was read from
+	void SetRecordIndex(LPCWSTR szFile);
+private:
+	// Shared with the record index
+	std::shared_ptr<const emfplus::memory_vector>	m_pData;
+	std::shared_ptr<EMFRecordIndex>	m_pRecordIndex;
+	emfspool::OSpoolIndex		m_index;
+	std::wstring				m_strName;
+	bool						m_bValid = false;
+
+	struct PageSlot
+	{
+		std::mutex					mtx;
+		std::weak_ptr<EMFAccess>	wpEMF;
+	};
+	std::unique_ptr<PageSlot[]>	m_pSlots;
+};
+
+#endif // EMF_SPOOL_ACCESS_H
@@ -0,0 +1,94 @@
+#include "pch.h"
+#include "framework.h"
+#include "EMFTrace.h"
+
+#if defined(ENABLE_EMF_TRACE) && !defined(SHARED_HANDLERS)
+
+#undef min
+#undef max
+
+EMFTrace& EMFTrace::Instance()
+{
+	static EMFTrace trace;
+	return trace;
+}
+
+void EMFTrace::Start(LPCWSTR szPath)
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	m_strPath = szPath ? szPath : L"";
+	for (auto& pBuffer : m_vBuffers)
+	{
+		std::lock_guard<std::mutex> lockBuffer(pBuffer->mtx);
+		pBuffer->vEvents.clear();
+	}
+	m_bEnabled = !m_strPath.empty();
+}
+
+double EMFTrace::Now()
+{
+	static const double fFreq = []()
+	{
+		LARGE_INTEGER freq;
+		QueryPerformanceFrequency(&freq);
+		return (double)freq.QuadPart;
+	}();
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return (double)now.QuadPart * 1e6 / fFreq;
+}
+
+EMFTrace::ThreadBuffer& EMFTrace::GetThreadBuffer()
+{
+	// Kept by the trace once registered, the events outlive the thread
+	thread_local std::shared_ptr<ThreadBuffer> t_pBuffer;
+	if (!t_pBuffer)
+	{
+		t_pBuffer = std::make_shared<ThreadBuffer>();
+		std::lock_guard<std::mutex> lock(m_mtx);
+		m_vBuffers.push_back(t_pBuffer);
+	}
+	return *t_pBuffer;
+}
+
+void EMFTrace::AddEvent(const char* szName, const char* szCategory, double fStart, double fEnd, int64_t nArg)
+{
+	if (!IsEnabled())
+		return;
+	auto& buffer = GetThreadBuffer();
+	std::lock_guard<std::mutex> lock(buffer.mtx);
+	buffer.vEvents.push_back(Event{ szName, szCategory, fStart, fEnd - fStart, GetCurrentThreadId(), nArg });
+}
+
+bool EMFTrace::Stop()
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	if (!m_bEnabled)
+		return false;
+	m_bEnabled = false;
+	FILE* fp = nullptr;
+	if (_wfopen_s(&fp, m_strPath.c_str(), L"wb") != 0 || !fp)
+		return false;
+	auto nProcess = GetCurrentProcessId();
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", fp);
+	bool bFirst = true;
+	for (auto& pBuffer : m_vBuffers)
+	{
+		std::lock_guard<std::mutex> lockBuffer(pBuffer->mtx);
+		for (auto& ev : pBuffer->vEvents)
+		{
+			// Complete events, the names are literals without anything to escape
+			fprintf(fp, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%lu,\"tid\":%lu",
+				bFirst ? "" : ",", ev.szName, ev.szCategory, ev.fStart, ev.fDuration, nProcess, ev.nThread);
+			if (ev.nArg >= 0)
+				fprintf(fp, ",\"args\":{\"index\":%lld}", (long long)ev.nArg);
+			fputc('}', fp);
+			bFirst = false;
+		}
+		pBuffer->vEvents.clear();
+	}
+	fputs("\n]}\n", fp);
+	return fclose(fp) == 0;
+}
+
+#endif // ENABLE_EMF_TRACE
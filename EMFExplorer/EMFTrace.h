@@ -0,0 +1,97 @@
+#ifndef EMF_TRACE_H
+#define EMF_TRACE_H
+
+// Uncomment (or define in the project) to build the phase tracing in.
+// Without it, EMF_TRACE_SCOPE compiles to nothing.
+//#define ENABLE_EMF_TRACE
+
+// The shell handlers never trace
+#if defined(ENABLE_EMF_TRACE) && !defined(SHARED_HANDLERS)
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Scoped timings of the phases (loading, decoding, linking, properties,
+// rendering, hit testing, image decoding), written as Chrome trace events
+// (chrome://tracing, ui.perfetto.dev). Each event has the id of its thread,
+// so the work of the thread pools shows up side by side.
+class EMFTrace
+{
+public:
+	static EMFTrace& Instance();
+public:
+	// Starts collecting events, Stop() writes them to szPath
+	void Start(LPCWSTR szPath);
+	bool Stop();
+
+	inline bool IsEnabled() const { return m_bEnabled.load(std::memory_order_relaxed); }
+
+	// In microseconds
+	static double Now();
+
+	// szName and szCategory must be literals, they're kept as is
+	void AddEvent(const char* szName, const char* szCategory, double fStart, double fEnd, int64_t nArg);
+
+	class Scope
+	{
+	public:
+		Scope(const char* szName, const char* szCategory, int64_t nArg = -1)
+		{
+			if (!Instance().IsEnabled())
+				return;
+			m_szName = szName;
+			m_szCategory = szCategory;
+			m_nArg = nArg;
+			m_fStart = Now();
+		}
+		~Scope()
+		{
+			if (m_szName)
+				Instance().AddEvent(m_szName, m_szCategory, m_fStart, Now(), m_nArg);
+		}
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+	private:
+		const char*	m_szName = nullptr;
+		const char*	m_szCategory = nullptr;
+		int64_t		m_nArg = -1;
+		double		m_fStart = 0;
+	};
+private:
+	struct Event
+	{
+		const char*	szName;
+		const char*	szCategory;
+		double		fStart;
+		double		fDuration;
+		DWORD		nThread;
+		int64_t		nArg;		// shown as "index" unless negative
+	};
+	// Each thread adds to its own buffer, only Stop() contends with it
+	struct ThreadBuffer
+	{
+		std::mutex			mtx;
+		std::vector<Event>	vEvents;
+	};
+	ThreadBuffer& GetThreadBuffer();
+private:
+	std::atomic<bool>	m_bEnabled = false;
+	std::mutex			m_mtx;
+	std::wstring		m_strPath;
+	std::vector<std::shared_ptr<ThreadBuffer>>	m_vBuffers;
+};
+
+#define EMF_TRACE_SCOPE(name, category)				EMFTrace::Scope emfTraceScope(name, category)
+#define EMF_TRACE_SCOPE_INDEX(name, category, index)	EMFTrace::Scope emfTraceScope(name, category, (int64_t)(index))
+
+#else
+
+#define EMF_TRACE_SCOPE(name, category)				((void)0)
+#define EMF_TRACE_SCOPE_INDEX(name, category, index)	((void)0)
+
+#endif // ENABLE_EMF_TRACE
+
+#endif // EMF_TRACE_H
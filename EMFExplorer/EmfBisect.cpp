@@ -0,0 +1,113 @@
+#include PCH_FNAME
+
+#include "EmfBisect.h"
+#include <algorithm>
+
+namespace emfbisect
+{
+
+static bool _Differs(const uint8_t* pPixel, uint32_t clrRef, uint8_t nTolerance)
+{
+	// BGRA in memory, 0xAARRGGBB in the color
+	for (int ii = 0; ii < 4; ++ii)
+	{
+		int nRef = (clrRef >> (ii * 8)) & 0xFF;
+		if (std::abs(pPixel[ii] - nRef) > nTolerance)
+			return true;
+	}
+	return false;
+}
+
+bool Bisect(size_t nRecords, const Playback& playback, const Predicate& pred, OBisectResult& result,
+	const OBisectOptions& options)
+{
+	result = OBisectResult();
+	if (!nRecords)
+		return true;
+	size_t nMaxProbes = std::max<size_t>(options.nProbesPerPass, 1);
+	// The predicate is false before nLow; it holds after nHigh once bHigh
+	size_t nLow = 0;
+	size_t nHigh = nRecords - 1;
+	bool bHigh = false;
+	std::vector<size_t> vProbes;
+	std::vector<char> vHolds;
+	while (!bHigh || nLow < nHigh)
+	{
+		// Spread over what's left, the last one at its end: nHigh itself
+		// until the predicate is known to hold there
+		size_t nLast = bHigh ? nHigh - 1 : nHigh;
+		size_t nRange = nLast - nLow + 1;
+		size_t nProbes = std::min(nMaxProbes, nRange);
+		vProbes.clear();
+		for (size_t ii = 1; ii <= nProbes; ++ii)
+			vProbes.push_back(nLow + (size_t)((uint64_t)nRange * ii / nProbes) - 1);
+		vHolds.assign(nProbes, 0);
+		size_t nNext = 0;
+		size_t nDrawn = 0;
+		// Every probe is past those the predicate was false after, the
+		// pixels the playback resumes from
+		bool bPlayed = playback(vProbes, [&](size_t nRecord, const OSnapshot& snap)
+			{
+				while (nNext < vProbes.size() && vProbes[nNext] < nRecord)
+					++nNext;
+				if (nNext >= vProbes.size() || vProbes[nNext] != nRecord)
+					return true;
+				++result.nProbes;
+				vHolds[nNext] = pred(snap) ? 1 : 0;
+				// The records after the first it holds for aren't needed
+				return !vHolds[nNext++];
+			}, nDrawn);
+		if (!bPlayed)
+			return false;
+		++result.nPasses;
+		result.nPlayed += nDrawn;
+		auto it = std::find(vHolds.begin(), vHolds.end(), 1);
+		if (it == vHolds.end())
+		{
+			if (!bHigh)
+				return true;
+			nLow = nLast + 1;
+			continue;
+		}
+		size_t nFirst = it - vHolds.begin();
+		nHigh = vProbes[nFirst];
+		bHigh = true;
+		if (nFirst)
+			nLow = vProbes[nFirst - 1] + 1;
+	}
+	result.bFound = true;
+	result.nRecord = nHigh;
+	return true;
+}
+
+Predicate PixelDiffers(uint32_t x, uint32_t y, uint32_t clrRef, uint8_t nTolerance)
+{
+	return [=](const OSnapshot& snap)
+		{
+			if (x >= snap.nWidth || y >= snap.nHeight)
+				return false;
+			return _Differs(snap.pPixels + y * snap.nStride + x * 4, clrRef, nTolerance);
+		};
+}
+
+Predicate RegionNonEmpty(uint32_t x, uint32_t y, uint32_t nWidth, uint32_t nHeight, uint32_t clrBackground,
+	uint8_t nTolerance)
+{
+	return [=](const OSnapshot& snap)
+		{
+			uint32_t nRight = (uint32_t)std::min<uint64_t>((uint64_t)x + nWidth, snap.nWidth);
+			uint32_t nBottom = (uint32_t)std::min<uint64_t>((uint64_t)y + nHeight, snap.nHeight);
+			for (uint32_t yy = y; yy < nBottom; ++yy)
+			{
+				auto pRow = snap.pPixels + yy * snap.nStride;
+				for (uint32_t xx = x; xx < nRight; ++xx)
+				{
+					if (_Differs(pRow + xx * 4, clrBackground, nTolerance))
+						return true;
+				}
+			}
+			return false;
+		};
+}
+
+}
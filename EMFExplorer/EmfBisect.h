@@ -0,0 +1,78 @@
+#ifndef EMF_BISECT_H
+#define EMF_BISECT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Search of the first record after which the rendering of a metafile
+// satisfies a predicate (a pixel turns some color, a region gets drawn on),
+// from renderings of its first records.
+//
+// The predicate is taken to be false up to that record and true from it on.
+// Rather than one playback per record tried, each playback renders the
+// records up to the last of up to nProbesPerPass records spread over the
+// range left, testing the predicate on the pixels after each of them as it
+// goes, and stopping at the first it holds after: the range shrinks by that
+// factor a playback, and the search takes about log(N) / log(nProbesPerPass)
+// playbacks. A playback resumes from the pixels of the last record probed
+// the predicate was false after, which come before the range left, so that
+// it draws only the records of that range: about N records all together,
+// rather than up to N a playback.
+namespace emfbisect
+{
+	// Pixels drawn by the records so far, 32-bit BGRA rows nStride bytes apart
+	struct OSnapshot
+	{
+		uint32_t		nWidth;
+		uint32_t		nHeight;
+		ptrdiff_t		nStride;
+		const uint8_t*	pPixels;
+	};
+
+	using Predicate = std::function<bool(const OSnapshot& snap)>;
+
+	// Returns false to stop the playback
+	using SnapshotCallback = std::function<bool(size_t nRecord, const OSnapshot& snap)>;
+
+	// Plays the records, calling fnSnapshot after each of vRecords (in
+	// increasing order), and stops after the last of them. Those past the end
+	// of the metafile get the pixels at the end. The playback keeps the pixels
+	// after the last record fnSnapshot returned true for, and starts the next
+	// one from them rather than from the first record when the records of the
+	// next are all after it; nDrawn is set to the records it drew.
+	using Playback = std::function<bool(const std::vector<size_t>& vRecords, const SnapshotCallback& fnSnapshot,
+		size_t& nDrawn)>;
+
+	struct OBisectOptions
+	{
+		size_t		nProbesPerPass = 16;
+	};
+
+	struct OBisectResult
+	{
+		bool		bFound = false;
+		size_t		nRecord = 0;	// the first record the predicate holds after
+		size_t		nPasses = 0;	// playbacks
+		size_t		nProbes = 0;	// snapshots tested
+		uint64_t	nPlayed = 0;	// records drawn, all playbacks together
+	};
+
+	// Searches nRecords records. Fails only when a playback does, not
+	// finding the record (the predicate is false at the end) isn't a failure.
+	bool Bisect(size_t nRecords, const Playback& playback, const Predicate& pred, OBisectResult& result,
+		const OBisectOptions& options = OBisectOptions());
+
+	// Colors are 0xAARRGGBB, as Gdiplus::ARGB. A pixel differs from a color
+	// when one of its channels is more than nTolerance away.
+
+	// Pixel (x, y) differs from clrRef. Pixels outside the snapshot don't.
+	Predicate PixelDiffers(uint32_t x, uint32_t y, uint32_t clrRef, uint8_t nTolerance = 0);
+
+	// Some pixel of the rectangle differs from clrBackground
+	Predicate RegionNonEmpty(uint32_t x, uint32_t y, uint32_t nWidth, uint32_t nHeight, uint32_t clrBackground,
+		uint8_t nTolerance = 0);
+}
+
+#endif // EMF_BISECT_H
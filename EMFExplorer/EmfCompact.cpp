@@ -0,0 +1,695 @@
+#include PCH_FNAME
+#ifdef _ENABLE_GDIPLUS_STRUCT
+
+#include "EmfCompact.h"
+#include "EmfStruct.h"
+#include <limits>
+
+#pragma push_macro("min")
+#pragma push_macro("max")
+#undef max
+#undef min
+
+namespace emfcompact
+{
+
+template <typename _Ty>
+static inline void _AppendBytes(memory_vector& vOut, const _Ty* pData, size_t nCount)
+{
+	auto p = (const u8t*)pData;
+	vOut.insert(vOut.end(), p, p + nCount * sizeof(_Ty));
+}
+
+static inline void _AlignTo4(memory_vector& vOut)
+{
+	vOut.resize((vOut.size() + 3) & ~(size_t)3, 0);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// EMF
+
+static inline bool _FitsInt16(i32t val)
+{
+	return val >= std::numeric_limits<i16t>::min() && val <= std::numeric_limits<i16t>::max();
+}
+
+static bool _PointsFitInt16(const GdiArrayWrapper(POINTL)& aptl)
+{
+	for (size_t ii = 0; ii < aptl.size; ++ii)
+	{
+		if (!_FitsInt16(aptl.data[ii].x) || !_FitsInt16(aptl.data[ii].y))
+			return false;
+	}
+	return true;
+}
+
+static void _AppendPoints16(memory_vector& vOut, const GdiArrayWrapper(POINTL)& aptl)
+{
+	auto nPos = vOut.size();
+	vOut.resize(nPos + aptl.size * sizeof(POINTS));
+	auto apts = (POINTS*)(vOut.data() + nPos);
+	for (size_t ii = 0; ii < aptl.size; ++ii)
+	{
+		apts[ii].x = (SHORT)aptl.data[ii].x;
+		apts[ii].y = (SHORT)aptl.data[ii].y;
+	}
+}
+
+static DWORD _GetPoly16Type(DWORD iType)
+{
+	switch (iType)
+	{
+	case EMR_POLYBEZIER:	return EMR_POLYBEZIER16;
+	case EMR_POLYGON:		return EMR_POLYGON16;
+	case EMR_POLYLINE:		return EMR_POLYLINE16;
+	case EMR_POLYBEZIERTO:	return EMR_POLYBEZIERTO16;
+	case EMR_POLYLINETO:	return EMR_POLYLINETO16;
+	case EMR_POLYPOLYLINE:	return EMR_POLYPOLYLINE16;
+	case EMR_POLYPOLYGON:	return EMR_POLYPOLYGON16;
+	case EMR_POLYDRAW:		return EMR_POLYDRAW16;
+	}
+	return 0;
+}
+
+bool CompactGdiPolyRecord(const ENHMETARECORD* pRec, memory_vector& vOut)
+{
+	auto iType16 = _GetPoly16Type(pRec->iType);
+	if (!iType16)
+		return false;
+	// Every check is done before anything is appended to vOut
+	const u64t nRecSize = pRec->nSize;
+	const size_t nStart = vOut.size();
+	switch (pRec->iType)
+	{
+	case EMR_POLYPOLYLINE:
+	case EMR_POLYPOLYGON:
+		{
+			auto& rec = *(const EMRPOLYPOLYLINE*)pRec;
+			if (nRecSize < offsetof(EMRPOLYPOLYLINE, aPolyCounts)
+				|| offsetof(EMRPOLYPOLYLINE, aPolyCounts) + (u64t)rec.nPolys * sizeof(DWORD) + (u64t)rec.cptl * sizeof(POINTL) > nRecSize)
+				return false;
+			emfgdi::OEmfPolyPolyline view(rec);
+			if (!_PointsFitInt16(view.aptl))
+				return false;
+			EMRPOLYPOLYLINE16 hdr{};
+			hdr.emr.iType = iType16;
+			hdr.rclBounds = view.rclBounds;
+			hdr.nPolys = rec.nPolys;
+			hdr.cpts = rec.cptl;
+			vOut.reserve(nStart + offsetof(EMRPOLYPOLYLINE16, aPolyCounts)
+				+ view.aPolyCounts.size * sizeof(DWORD) + view.aptl.size * sizeof(POINTS));
+			_AppendBytes(vOut, (const u8t*)&hdr, offsetof(EMRPOLYPOLYLINE16, aPolyCounts));
+			_AppendBytes(vOut, view.aPolyCounts.data, view.aPolyCounts.size);
+			_AppendPoints16(vOut, view.aptl);
+		}
+		break;
+	case EMR_POLYDRAW:
+		{
+			auto& rec = *(const EMRPOLYDRAW*)pRec;
+			if (nRecSize < offsetof(EMRPOLYDRAW, aptl)
+				|| offsetof(EMRPOLYDRAW, aptl) + (u64t)rec.cptl * (sizeof(POINTL) + sizeof(BYTE)) > nRecSize)
+				return false;
+			emfgdi::OEmfPolyDraw view(rec);
+			if (!_PointsFitInt16(view.aptl))
+				return false;
+			EMRPOLYDRAW16 hdr{};
+			hdr.emr.iType = iType16;
+			hdr.rclBounds = view.rclBounds;
+			hdr.cpts = rec.cptl;
+			_AppendBytes(vOut, (const u8t*)&hdr, offsetof(EMRPOLYDRAW16, apts));
+			_AppendPoints16(vOut, view.aptl);
+			_AppendBytes(vOut, view.abTypes.data, view.abTypes.size);
+			_AlignTo4(vOut);
+		}
+		break;
+	default:
+		{
+			// EMRPOLYBEZIER, EMRPOLYGON, EMRPOLYBEZIERTO and EMRPOLYLINETO share the EMRPOLYLINE layout
+			auto& rec = *(const EMRPOLYLINE*)pRec;
+			if (nRecSize < offsetof(EMRPOLYLINE, aptl)
+				|| offsetof(EMRPOLYLINE, aptl) + (u64t)rec.cptl * sizeof(POINTL) > nRecSize)
+				return false;
+			emfgdi::OEmfPolyline view(rec);
+			if (!_PointsFitInt16(view.aptl))
+				return false;
+			EMRPOLYLINE16 hdr{};
+			hdr.emr.iType = iType16;
+			hdr.rclBounds = view.rclBounds;
+			hdr.cpts = rec.cptl;
+			_AppendBytes(vOut, (const u8t*)&hdr, offsetof(EMRPOLYLINE16, apts));
+			_AppendPoints16(vOut, view.aptl);
+		}
+		break;
+	}
+	((EMR*)(vOut.data() + nStart))->nSize = (DWORD)(vOut.size() - nStart);
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// EMF+
+
+enum : u16t
+{
+	PlusFlagC = OEmfPlusRecDrawLines::FlagC,
+	PlusFlagP = OEmfPlusRecDrawLines::FlagP,
+};
+
+// Size of the fields that precede Count in the records carrying a point array
+static bool _GetPlusPointLayout(u16t nType, size_t& nPrefixSize, bool& bAllowRelative)
+{
+	bAllowRelative = true;
+	switch (nType)
+	{
+	case EmfPlusRecordTypeDrawLines:
+	case EmfPlusRecordTypeDrawBeziers:
+		nPrefixSize = 0;
+		return true;
+	case EmfPlusRecordTypeFillPolygon:		// BrushId
+	case EmfPlusRecordTypeDrawClosedCurve:	// Tension
+		nPrefixSize = sizeof(u32t);
+		return true;
+	case EmfPlusRecordTypeFillClosedCurve:	// BrushId, Tension
+		nPrefixSize = sizeof(u32t) + sizeof(Float);
+		return true;
+	case EmfPlusRecordTypeDrawCurve:		// Tension, Offset, NumSegments
+		nPrefixSize = sizeof(Float) + sizeof(u32t) * 2;
+		bAllowRelative = false;
+		return true;
+	case EmfPlusRecordTypeDrawImagePoints:	// ImageAttributesID, SrcUnit, SrcRect
+		nPrefixSize = sizeof(u32t) * 2 + sizeof(OEmfPlusRectF);
+		return true;
+	}
+	return false;
+}
+
+// https://docs.microsoft.com/en-us/openspecs/windows_protocols/ms-emfplus/c861a0d4-39f0-4f6c-bad9-e3f7bf63205e
+// EmfPlusInteger7 holds [-64, 63], EmfPlusInteger15 holds [-16384, 16383]
+static inline size_t _GetPointRIntegerSize(i32t val)
+{
+	if (val >= -64 && val <= 63)
+		return 1;
+	if (val >= -16384 && val <= 16383)
+		return 2;
+	return 0;
+}
+
+static inline void _AppendPointRInteger(memory_vector& vOut, i32t val)
+{
+	if (_GetPointRIntegerSize(val) == 1)
+		vOut.push_back((u8t)(val & 0x7F));
+	else
+	{
+		vOut.push_back((u8t)(0x80 | ((val >> 8) & 0x7F)));
+		vOut.push_back((u8t)(val & 0xFF));
+	}
+}
+
+// Size of Count EmfPlusPointR objects at pData, or 0 if they run past nAvailSize
+static size_t _GetPointRDataSize(const u8t* pData, size_t nAvailSize, u32t Count)
+{
+	size_t nPos = 0;
+	for (u64t ii = 0; ii < (u64t)Count * 2; ++ii)
+	{
+		if (nPos >= nAvailSize)
+			return 0;
+		nPos += (pData[nPos] & 0x80) ? 2 : 1;
+	}
+	return nPos <= nAvailSize ? nPos : 0;
+}
+
+// Only exact integers are accepted, so the float->int16 conversion round-trips.
+// -0.0 is accepted as 0, which does not change any rendered coordinate.
+static inline bool _FloatIsInt16(Float val)
+{
+	return val >= (Float)std::numeric_limits<i16t>::min()
+		&& val <= (Float)std::numeric_limits<i16t>::max()
+		&& (Float)(i16t)val == val;
+}
+
+bool CompactPlusPointRecord(const OEmfPlusRec* pRec, memory_vector& vOut)
+{
+	size_t nPrefixSize = 0;
+	bool bAllowRelative = false;
+	if (!_GetPlusPointLayout(pRec->Type, nPrefixSize, bAllowRelative))
+		return false;
+	if (pRec->Size < sizeof(OEmfPlusRec) || pRec->DataSize > pRec->Size - sizeof(OEmfPlusRec)
+		|| pRec->DataSize < nPrefixSize + sizeof(u32t))
+		return false;
+	auto pData = (u8t*)(pRec + 1);
+	u32t Count = 0;
+	memcpy(&Count, pData + nPrefixSize, sizeof(Count));
+	if (!Count)
+		return false;
+
+	const bool bRelative = bAllowRelative && (pRec->Flags & PlusFlagP);
+	const bool bInt = !bRelative && (pRec->Flags & PlusFlagC);
+	auto pPointData = pData + nPrefixSize + sizeof(Count);
+	const size_t nSizeIn = pRec->DataSize - nPrefixSize - sizeof(Count);
+	if (bRelative)
+	{
+		if (!_GetPointRDataSize(pPointData, nSizeIn, Count))
+			return false;
+	}
+	else if ((u64t)Count * (bInt ? sizeof(OEmfPlusPoint) : sizeof(OEmfPlusPointF)) > nSizeIn)
+		return false;
+
+	OEmfPlusPointDataArray PointData;
+	DataReader reader(pPointData, nSizeIn);
+	PointData.Read(reader, Count, bRelative, bInt);
+
+	// Absolute 16-bit points, available only if the conversion is lossless
+	std::vector<OEmfPlusPoint> vPoints((size_t)Count);
+	if (bRelative)
+	{
+		i32t x = 0, y = 0;
+		for (size_t ii = 0; ii < vPoints.size(); ++ii)
+		{
+			x += PointData.ivals[ii].x;
+			y += PointData.ivals[ii].y;
+			if (!_FitsInt16(x) || !_FitsInt16(y))
+				return false;
+			vPoints[ii] = { (i16t)x, (i16t)y };
+		}
+	}
+	else if (bInt)
+		std::copy(PointData.ivals.begin(), PointData.ivals.end(), vPoints.begin());
+	else
+	{
+		for (size_t ii = 0; ii < vPoints.size(); ++ii)
+		{
+			auto& pt = PointData.fvals[ii];
+			if (!_FloatIsInt16(pt.x) || !_FloatIsInt16(pt.y))
+				return false;
+			vPoints[ii] = { (i16t)pt.x, (i16t)pt.y };
+		}
+	}
+
+	const size_t nSizeInt = vPoints.size() * sizeof(OEmfPlusPoint);
+	size_t nSizeRel = SIZE_MAX;
+	if (bAllowRelative)
+	{
+		// Each point is relative to the previous one, the first one to (0,0)
+		size_t nSize = 0;
+		OEmfPlusPoint ptPrev{ 0, 0 };
+		for (auto& pt : vPoints)
+		{
+			auto nSizeX = _GetPointRIntegerSize((i32t)pt.x - ptPrev.x);
+			auto nSizeY = _GetPointRIntegerSize((i32t)pt.y - ptPrev.y);
+			if (!nSizeX || !nSizeY)
+			{
+				nSize = SIZE_MAX;
+				break;
+			}
+			nSize += nSizeX + nSizeY;
+			ptPrev = pt;
+		}
+		if (nSize != SIZE_MAX)
+			nSizeRel = (nSize + 3) & ~(size_t)3;
+	}
+	const bool bUseRelative = nSizeRel < nSizeInt;
+	if ((bUseRelative ? nSizeRel : nSizeInt) >= nSizeIn)
+		return false;
+
+	const size_t nStart = vOut.size();
+	vOut.resize(nStart + sizeof(OEmfPlusRec));
+	_AppendBytes(vOut, pData, nPrefixSize);
+	_AppendBytes(vOut, &Count, 1);
+	if (bUseRelative)
+	{
+		OEmfPlusPoint ptPrev{ 0, 0 };
+		for (auto& pt : vPoints)
+		{
+			_AppendPointRInteger(vOut, (i32t)pt.x - ptPrev.x);
+			_AppendPointRInteger(vOut, (i32t)pt.y - ptPrev.y);
+			ptPrev = pt;
+		}
+		_AlignTo4(vOut);
+	}
+	else
+		_AppendBytes(vOut, vPoints.data(), vPoints.size());
+
+	OEmfPlusRec hdr;
+	hdr.Type = pRec->Type;
+	hdr.Flags = (pRec->Flags & ~(PlusFlagC | PlusFlagP)) | (bUseRelative ? PlusFlagP : PlusFlagC);
+	hdr.Size = (u32t)(vOut.size() - nStart);
+	hdr.DataSize = hdr.Size - sizeof(OEmfPlusRec);
+	memcpy(vOut.data() + nStart, &hdr, sizeof(hdr));
+	return true;
+}
+
+// Rewrites an EMR_COMMENT_EMFPLUS comment, or returns false (vOut untouched)
+// if it does not contain any record that can be compacted
+static bool _CompactPlusComment(const ENHMETARECORD* pRec, memory_vector& vOut, CompactStats& stats)
+{
+	if (pRec->nSize < sizeof(EMRCOMMENT_BASE))
+		return false;
+	auto& cmt = *(const EMRCOMMENT_BASE*)pRec;
+	if (cmt.CommentIdentifier != EMR_COMMENT_EMFPLUS || cmt.DataSize < sizeof(u32t)
+		|| offsetof(EMRGDICOMMENT, Data) + (u64t)cmt.DataSize > pRec->nSize)
+		return false;
+	const size_t nStart = vOut.size();
+	_AppendBytes(vOut, (const u8t*)pRec, sizeof(EMRCOMMENT_BASE));
+	auto p = (const u8t*)pRec + sizeof(EMRCOMMENT_BASE);
+	auto pEnd = (const u8t*)pRec + offsetof(EMRGDICOMMENT, Data) + cmt.DataSize;
+	size_t nCompacted = 0;
+	while (p + sizeof(OEmfPlusRec) <= pEnd)
+	{
+		auto pPlusRec = (const OEmfPlusRec*)p;
+		if (pPlusRec->Size < sizeof(OEmfPlusRec) || pPlusRec->Size > (size_t)(pEnd - p))
+			break;
+		if (CompactPlusPointRecord(pPlusRec, vOut))
+			++nCompacted;
+		else
+			_AppendBytes(vOut, p, pPlusRec->Size);
+		p += pPlusRec->Size;
+	}
+	if (!nCompacted)
+	{
+		vOut.resize(nStart);
+		return false;
+	}
+	// Anything we could not walk is kept as is
+	_AppendBytes(vOut, p, (size_t)(pEnd - p));
+	auto nDataSize = (u32t)(vOut.size() - nStart - offsetof(EMRGDICOMMENT, Data));
+	_AlignTo4(vOut);
+	auto& cmtOut = *(EMRCOMMENT_BASE*)(vOut.data() + nStart);
+	cmtOut.Size = (u32t)(vOut.size() - nStart);
+	cmtOut.DataSize = nDataSize;
+	stats.nPlusRecords += nCompacted;
+	return true;
+}
+
+bool CompactMetafile(const u8t* pData, size_t nSize, memory_vector& vOut, CompactStats* pStats)
+{
+	vOut.clear();
+	if (!pData || nSize < offsetof(ENHMETAHEADER, cbPixelFormat))
+		return false;
+	auto pHdr = (const ENHMETAHEADER*)pData;
+	if (pHdr->iType != EMR_HEADER || pHdr->dSignature != ENHMETA_SIGNATURE)
+		return false;
+	CompactStats stats;
+	vOut.reserve(nSize);
+	size_t nPos = 0;
+	while (nPos + sizeof(EMR) <= nSize)
+	{
+		auto pRec = (const ENHMETARECORD*)(pData + nPos);
+		if (pRec->nSize < sizeof(EMR) || (pRec->nSize % 4) || pRec->nSize > nSize - nPos)
+		{
+			vOut.clear();
+			return false;
+		}
+		if (CompactGdiPolyRecord(pRec, vOut))
+			++stats.nGdiRecords;
+		else if (pRec->iType != EMR_GDICOMMENT || !_CompactPlusComment(pRec, vOut, stats))
+			_AppendBytes(vOut, (const u8t*)pRec, pRec->nSize);
+		nPos += pRec->nSize;
+		if (pRec->iType == EMR_EOF)
+			break;
+	}
+	((ENHMETAHEADER*)vOut.data())->nBytes = (DWORD)vOut.size();
+	stats.nBytesIn = nPos;
+	stats.nBytesOut = vOut.size();
+	if (pStats)
+		*pStats = stats;
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Verification, decoding both sides independently of the conversions
+
+// What a EMR_POLY* record or its *16 counterpart draws
+struct _PolyRecord
+{
+	DWORD				iType = 0;	// of the 32-bit record
+	RECTL				rclBounds{};
+	std::vector<POINTL>	vPoints;
+	std::vector<DWORD>	vCounts;
+	std::vector<BYTE>	vTypes;
+};
+
+template <typename _Pt>
+static void _ReadPolyPoints(const GdiArrayWrapper(_Pt)& apt, std::vector<POINTL>& vPoints)
+{
+	vPoints.resize(apt.size);
+	for (size_t ii = 0; ii < apt.size; ++ii)
+		vPoints[ii] = { apt.data[ii].x, apt.data[ii].y };
+}
+
+static bool _ReadPolyRecord(const ENHMETARECORD* pRec, _PolyRecord& poly)
+{
+	const u64t nRecSize = pRec->nSize;
+	switch (pRec->iType)
+	{
+	case EMR_POLYBEZIER:
+	case EMR_POLYGON:
+	case EMR_POLYLINE:
+	case EMR_POLYBEZIERTO:
+	case EMR_POLYLINETO:
+		{
+			auto& rec = *(const EMRPOLYLINE*)pRec;
+			if (nRecSize < offsetof(EMRPOLYLINE, aptl) || offsetof(EMRPOLYLINE, aptl) + (u64t)rec.cptl * sizeof(POINTL) > nRecSize)
+				return false;
+			emfgdi::OEmfPolyline view(rec);
+			poly.rclBounds = view.rclBounds;
+			_ReadPolyPoints(view.aptl, poly.vPoints);
+		}
+		break;
+	case EMR_POLYBEZIER16:
+	case EMR_POLYGON16:
+	case EMR_POLYLINE16:
+	case EMR_POLYBEZIERTO16:
+	case EMR_POLYLINETO16:
+		{
+			auto& rec = *(const EMRPOLYLINE16*)pRec;
+			if (nRecSize < offsetof(EMRPOLYLINE16, apts) || offsetof(EMRPOLYLINE16, apts) + (u64t)rec.cpts * sizeof(POINTS) > nRecSize)
+				return false;
+			emfgdi::OEmfPolyline16 view(rec);
+			poly.rclBounds = view.rclBounds;
+			_ReadPolyPoints(view.apts, poly.vPoints);
+		}
+		break;
+	case EMR_POLYPOLYLINE:
+	case EMR_POLYPOLYGON:
+		{
+			auto& rec = *(const EMRPOLYPOLYLINE*)pRec;
+			if (nRecSize < offsetof(EMRPOLYPOLYLINE, aPolyCounts)
+				|| offsetof(EMRPOLYPOLYLINE, aPolyCounts) + (u64t)rec.nPolys * sizeof(DWORD) + (u64t)rec.cptl * sizeof(POINTL) > nRecSize)
+				return false;
+			emfgdi::OEmfPolyPolyline view(rec);
+			poly.rclBounds = view.rclBounds;
+			poly.vCounts.assign(view.aPolyCounts.data, view.aPolyCounts.data + view.aPolyCounts.size);
+			_ReadPolyPoints(view.aptl, poly.vPoints);
+		}
+		break;
+	case EMR_POLYPOLYLINE16:
+	case EMR_POLYPOLYGON16:
+		{
+			auto& rec = *(const EMRPOLYPOLYLINE16*)pRec;
+			if (nRecSize < offsetof(EMRPOLYPOLYLINE16, aPolyCounts)
+				|| offsetof(EMRPOLYPOLYLINE16, aPolyCounts) + (u64t)rec.nPolys * sizeof(DWORD) + (u64t)rec.cpts * sizeof(POINTS) > nRecSize)
+				return false;
+			emfgdi::OEmfPolyPolyline16 view(rec);
+			poly.rclBounds = view.rclBounds;
+			poly.vCounts.assign(view.aPolyCounts.data, view.aPolyCounts.data + view.aPolyCounts.size);
+			_ReadPolyPoints(view.apts, poly.vPoints);
+		}
+		break;
+	case EMR_POLYDRAW:
+		{
+			auto& rec = *(const EMRPOLYDRAW*)pRec;
+			if (nRecSize < offsetof(EMRPOLYDRAW, aptl)
+				|| offsetof(EMRPOLYDRAW, aptl) + (u64t)rec.cptl * (sizeof(POINTL) + sizeof(BYTE)) > nRecSize)
+				return false;
+			emfgdi::OEmfPolyDraw view(rec);
+			poly.rclBounds = view.rclBounds;
+			poly.vTypes.assign(view.abTypes.data, view.abTypes.data + view.abTypes.size);
+			_ReadPolyPoints(view.aptl, poly.vPoints);
+		}
+		break;
+	case EMR_POLYDRAW16:
+		{
+			auto& rec = *(const EMRPOLYDRAW16*)pRec;
+			if (nRecSize < offsetof(EMRPOLYDRAW16, apts)
+				|| offsetof(EMRPOLYDRAW16, apts) + (u64t)rec.cpts * (sizeof(POINTS) + sizeof(BYTE)) > nRecSize)
+				return false;
+			emfgdi::OEmfPolyDraw16 view(rec);
+			poly.rclBounds = view.rclBounds;
+			poly.vTypes.assign(view.abTypes.data, view.abTypes.data + view.abTypes.size);
+			_ReadPolyPoints(view.apts, poly.vPoints);
+		}
+		break;
+	default:
+		return false;
+	}
+	poly.iType = pRec->iType;
+	for (DWORD iType : { EMR_POLYBEZIER, EMR_POLYGON, EMR_POLYLINE, EMR_POLYBEZIERTO, EMR_POLYLINETO,
+		EMR_POLYPOLYLINE, EMR_POLYPOLYGON, EMR_POLYDRAW })
+	{
+		if (_GetPoly16Type(iType) == pRec->iType)
+			poly.iType = iType;
+	}
+	return true;
+}
+
+static bool _IsSamePoly(const _PolyRecord& a, const _PolyRecord& b)
+{
+	auto IsSamePoint = [](const POINTL& ptA, const POINTL& ptB) { return ptA.x == ptB.x && ptA.y == ptB.y; };
+	return a.iType == b.iType
+		&& a.rclBounds.left == b.rclBounds.left && a.rclBounds.top == b.rclBounds.top
+		&& a.rclBounds.right == b.rclBounds.right && a.rclBounds.bottom == b.rclBounds.bottom
+		&& a.vCounts == b.vCounts && a.vTypes == b.vTypes
+		&& std::equal(a.vPoints.begin(), a.vPoints.end(), b.vPoints.begin(), b.vPoints.end(), IsSamePoint);
+}
+
+// The absolute points of an EMF+ record CompactPlusPointRecord may convert,
+// whichever way they're encoded
+static bool _ReadPlusPoints(const OEmfPlusRec* pRec, size_t nAvailSize, std::vector<OEmfPlusPointF>& vPoints)
+{
+	size_t nPrefixSize = 0;
+	bool bAllowRelative = false;
+	if (!_GetPlusPointLayout(pRec->Type, nPrefixSize, bAllowRelative))
+		return false;
+	if (pRec->Size < sizeof(OEmfPlusRec) || pRec->Size > nAvailSize || pRec->DataSize > pRec->Size - sizeof(OEmfPlusRec)
+		|| pRec->DataSize < nPrefixSize + sizeof(u32t))
+		return false;
+	auto pData = (const u8t*)(pRec + 1);
+	u32t Count = 0;
+	memcpy(&Count, pData + nPrefixSize, sizeof(Count));
+	const bool bRelative = bAllowRelative && (pRec->Flags & PlusFlagP);
+	const bool bInt = !bRelative && (pRec->Flags & PlusFlagC);
+	auto pPointData = pData + nPrefixSize + sizeof(Count);
+	const size_t nSizeIn = pRec->DataSize - nPrefixSize - sizeof(Count);
+	if (bRelative)
+	{
+		if (Count && !_GetPointRDataSize(pPointData, nSizeIn, Count))
+			return false;
+	}
+	else if ((u64t)Count * (bInt ? sizeof(OEmfPlusPoint) : sizeof(OEmfPlusPointF)) > nSizeIn)
+		return false;
+	OEmfPlusPointDataArray PointData;
+	DataReader reader((u8t*)pPointData, nSizeIn);
+	PointData.Read(reader, Count, bRelative, bInt);
+	vPoints.resize((size_t)Count);
+	i32t x = 0, y = 0;
+	for (size_t ii = 0; ii < vPoints.size(); ++ii)
+	{
+		if (bRelative)
+		{
+			x += PointData.ivals[ii].x;
+			y += PointData.ivals[ii].y;
+			vPoints[ii] = { (Float)x, (Float)y };
+		}
+		else if (bInt)
+			vPoints[ii] = { (Float)PointData.ivals[ii].x, (Float)PointData.ivals[ii].y };
+		else
+			vPoints[ii] = PointData.fvals[ii];
+	}
+	return true;
+}
+
+static bool _IsSamePlusRecord(const OEmfPlusRec* pRec, size_t nAvailSize, const OEmfPlusRec* pCompact, size_t nCompactAvailSize)
+{
+	if (pRec->Size <= nAvailSize && pCompact->Size <= nCompactAvailSize
+		&& pRec->Size == pCompact->Size && memcmp(pRec, pCompact, pRec->Size) == 0)
+		return true;
+	size_t nPrefixSize = 0;
+	bool bAllowRelative = false;
+	if (pRec->Type != pCompact->Type || (pRec->Flags & ~(PlusFlagC | PlusFlagP)) != (pCompact->Flags & ~(PlusFlagC | PlusFlagP))
+		|| !_GetPlusPointLayout(pRec->Type, nPrefixSize, bAllowRelative))
+		return false;
+	std::vector<OEmfPlusPointF> vPoints, vCompactPoints;
+	if (!_ReadPlusPoints(pRec, nAvailSize, vPoints) || !_ReadPlusPoints(pCompact, nCompactAvailSize, vCompactPoints))
+		return false;
+	// -0.0 equals 0, as the conversion allows
+	return memcmp(pRec + 1, pCompact + 1, nPrefixSize) == 0
+		&& std::equal(vPoints.begin(), vPoints.end(), vCompactPoints.begin(), vCompactPoints.end(),
+			[](const OEmfPlusPointF& a, const OEmfPlusPointF& b) { return a.x == b.x && a.y == b.y; });
+}
+
+static bool _IsSamePlusComment(const ENHMETARECORD* pRec, const ENHMETARECORD* pCompact)
+{
+	if (pRec->nSize < sizeof(EMRCOMMENT_BASE) || pCompact->nSize < sizeof(EMRCOMMENT_BASE))
+		return false;
+	auto& cmt = *(const EMRCOMMENT_BASE*)pRec;
+	auto& cmtCompact = *(const EMRCOMMENT_BASE*)pCompact;
+	if (cmt.CommentIdentifier != EMR_COMMENT_EMFPLUS || cmtCompact.CommentIdentifier != EMR_COMMENT_EMFPLUS
+		|| offsetof(EMRGDICOMMENT, Data) + (u64t)cmt.DataSize > pRec->nSize
+		|| offsetof(EMRGDICOMMENT, Data) + (u64t)cmtCompact.DataSize > pCompact->nSize)
+		return false;
+	auto p = (const u8t*)pRec + sizeof(EMRCOMMENT_BASE);
+	auto pEnd = (const u8t*)pRec + offsetof(EMRGDICOMMENT, Data) + cmt.DataSize;
+	auto q = (const u8t*)pCompact + sizeof(EMRCOMMENT_BASE);
+	auto qEnd = (const u8t*)pCompact + offsetof(EMRGDICOMMENT, Data) + cmtCompact.DataSize;
+	// The same walk as _CompactPlusComment, what it stops at is kept as is
+	while (p + sizeof(OEmfPlusRec) <= pEnd)
+	{
+		auto pPlusRec = (const OEmfPlusRec*)p;
+		if (pPlusRec->Size < sizeof(OEmfPlusRec) || pPlusRec->Size > (size_t)(pEnd - p))
+			break;
+		auto pCompactRec = (const OEmfPlusRec*)q;
+		if (q + sizeof(OEmfPlusRec) > qEnd || pCompactRec->Size < sizeof(OEmfPlusRec) || pCompactRec->Size > (size_t)(qEnd - q)
+			|| !_IsSamePlusRecord(pPlusRec, (size_t)(pEnd - p), pCompactRec, (size_t)(qEnd - q)))
+			return false;
+		p += pPlusRec->Size;
+		q += pCompactRec->Size;
+	}
+	return pEnd - p == qEnd - q && memcmp(p, q, (size_t)(pEnd - p)) == 0;
+}
+
+bool VerifyCompactedMetafile(const u8t* pData, size_t nSize, const u8t* pCompact, size_t nCompactSize, size_t* pnRecord)
+{
+	size_t nRecord = 0;
+	if (pnRecord)
+		*pnRecord = nRecord;
+	if (!pData || !pCompact || nSize < sizeof(EMR) || nCompactSize < sizeof(EMR))
+		return false;
+	size_t nPos = 0, nCompactPos = 0;
+	while (nPos + sizeof(EMR) <= nSize)
+	{
+		if (pnRecord)
+			*pnRecord = nRecord;
+		auto pRec = (const ENHMETARECORD*)(pData + nPos);
+		auto pCompactRec = (const ENHMETARECORD*)(pCompact + nCompactPos);
+		if (nCompactPos + sizeof(EMR) > nCompactSize
+			|| pRec->nSize < sizeof(EMR) || pRec->nSize > nSize - nPos
+			|| pCompactRec->nSize < sizeof(EMR) || pCompactRec->nSize > nCompactSize - nCompactPos)
+			return false;
+		if (nRecord == 0)
+		{
+			// Only nBytes of the header differs
+			auto& hdr = *(const ENHMETAHEADER*)pRec;
+			auto& hdrCompact = *(const ENHMETAHEADER*)pCompactRec;
+			if (pRec->nSize != pCompactRec->nSize || pRec->nSize < offsetof(ENHMETAHEADER, nRecords)
+				|| hdrCompact.nBytes != nCompactSize
+				|| memcmp(pRec, pCompactRec, offsetof(ENHMETAHEADER, nBytes)) != 0
+				|| memcmp(&hdr.nRecords, &hdrCompact.nRecords, pRec->nSize - offsetof(ENHMETAHEADER, nRecords)) != 0)
+				return false;
+		}
+		else if (pRec->nSize != pCompactRec->nSize || memcmp(pRec, pCompactRec, pRec->nSize) != 0)
+		{
+			_PolyRecord poly, polyCompact;
+			if (_ReadPolyRecord(pRec, poly))
+			{
+				if (pRec->iType == pCompactRec->iType || !_ReadPolyRecord(pCompactRec, polyCompact)
+					|| !_IsSamePoly(poly, polyCompact))
+					return false;
+			}
+			else if (pRec->iType != EMR_GDICOMMENT || pCompactRec->iType != EMR_GDICOMMENT
+				|| !_IsSamePlusComment(pRec, pCompactRec))
+				return false;
+		}
+		nPos += pRec->nSize;
+		nCompactPos += pCompactRec->nSize;
+		++nRecord;
+		if (pRec->iType == EMR_EOF)
+			break;
+	}
+	return nCompactPos == nCompactSize;
+}
+
+}
+
+#pragma pop_macro("min")
+#pragma pop_macro("max")
+
+#endif // _ENABLE_GDIPLUS_STRUCT
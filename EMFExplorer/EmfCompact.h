@@ -0,0 +1,55 @@
+#ifndef EMF_COMPACT_H
+#define EMF_COMPACT_H
+
+#ifdef _ENABLE_GDIPLUS_STRUCT
+
+#include "EmfPlusStruct.h"
+
+// Lossless coordinate-width compaction.
+//
+// 32-bit EMR_POLY* records are rewritten as their *16 counterparts, and the
+// point arrays of EMF+ drawing records are re-encoded as 16-bit integers
+// (C flag) or EmfPlusPointR relative points (P flag), whichever is smaller.
+// A record is only rewritten when every coordinate survives the conversion
+// unchanged, so playback of the compacted metafile is identical.
+namespace emfcompact
+{
+	using namespace emfplus;
+
+	struct CompactStats
+	{
+		size_t	nGdiRecords		= 0;	// EMR_POLY* records rewritten as *16
+		size_t	nPlusRecords	= 0;	// EMF+ records with re-encoded point data
+		size_t	nBytesIn		= 0;
+		size_t	nBytesOut		= 0;
+	};
+
+	// Appends an EMR_POLYBEZIER/POLYGON/POLYLINE/POLYBEZIERTO/POLYLINETO/
+	// POLYPOLYLINE/POLYPOLYGON/POLYDRAW record to vOut as its *16 counterpart.
+	// Returns false (vOut is left untouched) when the record is of another type
+	// or any of its points does not fit in 16 bits.
+	bool CompactGdiPolyRecord(const ENHMETARECORD* pRec, memory_vector& vOut);
+
+	// Appends an EMF+ FillPolygon/DrawLines/DrawBeziers/DrawClosedCurve/
+	// FillClosedCurve/DrawCurve/DrawImagePoints record to vOut with its point
+	// array re-encoded.
+	// Returns false (vOut is left untouched) when the record is of another type
+	// or no smaller lossless encoding exists.
+	bool CompactPlusPointRecord(const OEmfPlusRec* pRec, memory_vector& vOut);
+
+	// Runs both passes over a whole EMF (including the EMF+ records embedded in
+	// EMR_COMMENT records) and fixes up the header size.
+	bool CompactMetafile(const u8t* pData, size_t nSize, memory_vector& vOut, CompactStats* pStats = nullptr);
+
+	// Walks a metafile and its CompactMetafile output side by side. Every
+	// record must be the same but for the conversions above, and the points
+	// of the converted ones must decode to the original coordinates.
+	// Returns false at the first record that doesn't, *pnRecord being its
+	// index (of the EMF records, the header is 0).
+	bool VerifyCompactedMetafile(const u8t* pData, size_t nSize, const u8t* pCompact, size_t nCompactSize,
+		size_t* pnRecord = nullptr);
+}
+
+#endif // _ENABLE_GDIPLUS_STRUCT
+
+#endif // EMF_COMPACT_H
@@ -0,0 +1,644 @@
+#include PCH_FNAME
+#ifdef _ENABLE_GDIPLUS_STRUCT
+
+#include "EmfDIBDecode.h"
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	#define EMFDIB_X86
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#define EMFDIB_AVX2
+	#else
+		#define EMFDIB_AVX2	__attribute__((target("avx2")))
+	#endif
+#endif
+
+#pragma push_macro("min")
+#pragma push_macro("max")
+#undef max
+#undef min
+
+namespace emfdib
+{
+
+using BitField = DIBDecoder::BitField;
+using BitFieldLayout = DIBDecoder::BitFieldLayout;
+
+enum
+{
+	CoreHeaderSize	= 12,	// BITMAPCOREHEADER
+	InfoHeaderSize	= 40,	// BITMAPINFOHEADER
+};
+
+template <typename T>
+static inline T _Read(const u8t* p)
+{
+	T val;
+	memcpy(&val, p, sizeof(val));
+	return val;
+}
+
+static inline void _Store(u8t* pDst, u32t nPixel)
+{
+	memcpy(pDst, &nPixel, sizeof(nPixel));
+}
+
+static inline u32t _ToOrder(u32t argb, PixelOrder nOrder)
+{
+	if (nOrder == PixelOrder::BGRA)
+		return argb;
+	return (argb & 0xFF00FF00) | ((argb >> 16) & 0xFF) | ((argb & 0xFF) << 16);
+}
+
+bool ParseDIBInfo(const u8t* pBmi, size_t cbBmi, ODIBInfo& info, DIBColors nUsage,
+	const u32t* pLogPalette, size_t nLogPaletteCount)
+{
+	info = ODIBInfo();
+	if (!pBmi || cbBmi < CoreHeaderSize)
+		return false;
+	u32t biSize = _Read<u32t>(pBmi);
+	size_t nColors = 0;
+	size_t nEntrySize = nUsage == DIBColors::Pal ? sizeof(u16t) : 4;
+	if (biSize == CoreHeaderSize)
+	{
+		info.Width = _Read<u16t>(pBmi + 4);
+		info.Height = _Read<u16t>(pBmi + 6);
+		info.BitCount = _Read<u16t>(pBmi + 10);
+		if (info.BitCount <= 8)
+			nColors = (size_t)1 << info.BitCount;
+		if (nUsage == DIBColors::RGB)
+			nEntrySize = 3;	// RGBTRIPLE
+		info.nHeaderSize = biSize;
+	}
+	else
+	{
+		if (biSize < InfoHeaderSize || biSize > cbBmi)
+			return false;
+		info.Width = _Read<i32t>(pBmi + 4);
+		i32t biHeight = _Read<i32t>(pBmi + 8);
+		if (biHeight == INT32_MIN)
+			return false;
+		info.bTopDown = biHeight < 0;
+		info.Height = info.bTopDown ? -biHeight : biHeight;
+		info.BitCount = _Read<u16t>(pBmi + 14);
+		info.Compression = (DIBCompression)_Read<u32t>(pBmi + 16);
+		nColors = _Read<u32t>(pBmi + 32);
+		if (!nColors && info.BitCount && info.BitCount <= 8)
+			nColors = (size_t)1 << info.BitCount;
+		info.nHeaderSize = biSize;
+		if (info.Compression == DIBCompression::BitFields || info.Compression == DIBCompression::AlphaBitFields)
+		{
+			// The masks are part of the V4/V5 headers, or follow a BITMAPINFOHEADER
+			size_t nMasks = info.Compression == DIBCompression::AlphaBitFields ? 4 : 3;
+			const u8t* pMasks = pBmi + InfoHeaderSize;
+			if (biSize == InfoHeaderSize)
+			{
+				if (cbBmi < InfoHeaderSize + nMasks * 4)
+					return false;
+				info.nHeaderSize += nMasks * 4;
+			}
+			else if (biSize >= InfoHeaderSize + 16)
+				nMasks = 4;
+			else
+				nMasks = std::min<size_t>((biSize - InfoHeaderSize) / 4, nMasks);
+			for (size_t ii = 0; ii < nMasks; ++ii)
+				info.Masks[ii] = _Read<u32t>(pMasks + ii * 4);
+		}
+	}
+	if (nColors > (cbBmi - info.nHeaderSize) / nEntrySize)
+		return false;
+	// Negative widths/heights, and widths too large for the scanline size
+	if (info.Width <= 0 || info.Height <= 0 || (u64t)info.Width * 32 > (u64t)SIZE_MAX - 31)
+		return false;
+
+	switch (info.Compression)
+	{
+	case DIBCompression::RGB:
+		switch (info.BitCount)
+		{
+		case 1: case 4: case 8: case 24:
+			break;
+		case 16:
+			info.Masks[0] = 0x7C00;
+			info.Masks[1] = 0x03E0;
+			info.Masks[2] = 0x001F;
+			break;
+		case 32:
+			info.Masks[0] = 0x00FF0000;
+			info.Masks[1] = 0x0000FF00;
+			info.Masks[2] = 0x000000FF;
+			break;
+		default:
+			return false;
+		}
+		break;
+	case DIBCompression::RLE8:
+		if (info.BitCount != 8)
+			return false;
+		break;
+	case DIBCompression::RLE4:
+		if (info.BitCount != 4)
+			return false;
+		break;
+	case DIBCompression::BitFields:
+	case DIBCompression::AlphaBitFields:
+		if (info.BitCount != 16 && info.BitCount != 32)
+			return false;
+		break;
+	case DIBCompression::JPEG:
+	case DIBCompression::PNG:
+		break;
+	default:
+		return false;
+	}
+
+	// Only the entries an index can reach make the palette, the rest of the
+	// color table (e.g. for 24bpp bitmaps) is an optimization hint
+	const u8t* pColors = pBmi + info.nHeaderSize;
+	size_t nPalette = info.BitCount <= 8 ? std::min(nColors, (size_t)1 << info.BitCount) : 0;
+	info.Palette.resize(nPalette);
+	for (size_t ii = 0; ii < nPalette; ++ii)
+	{
+		u32t argb = 0;
+		if (nUsage == DIBColors::Pal)
+		{
+			u16t nIndex = _Read<u16t>(pColors + ii * nEntrySize);
+			if (pLogPalette && nIndex < nLogPaletteCount)
+				argb = pLogPalette[nIndex];
+		}
+		else
+			argb = pColors[ii * nEntrySize] | (pColors[ii * nEntrySize + 1] << 8) | (pColors[ii * nEntrySize + 2] << 16);
+		// The reserved byte of RGBQUAD isn't an alpha
+		info.Palette[ii] = argb | 0xFF000000;
+	}
+	info.nHeaderSize += nColors * nEntrySize;
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Bit fields
+
+static BitField _MakeBitField(u32t nMask)
+{
+	BitField field = { 0, 0, 0, 0 };
+	if (!nMask)
+		return field;
+	u32t nShift = 0;
+	while (!((nMask >> nShift) & 1))
+		++nShift;
+	u32t nBits = 0;
+	while (nShift + nBits < 32 && ((nMask >> (nShift + nBits)) & 1))
+		++nBits;
+	// Wider fields keep their top 8 bits
+	if (nBits > 8)
+	{
+		nShift += nBits - 8;
+		nBits = 8;
+	}
+	// Narrower ones are scaled by repeating their bits, e.g. 5 bits: (v * 33) >> 2
+	u32t nCopies = (8 + nBits - 1) / nBits;
+	field.nMask = ((1u << nBits) - 1) << nShift;
+	field.nShift = nShift;
+	for (u32t ii = 0; ii < nCopies; ++ii)
+		field.nMul |= 1u << (ii * nBits);
+	field.nPostShift = nCopies * nBits - 8;
+	return field;
+}
+
+// Kernels write BGRA with straight alpha, the SIMD ones return the number
+// of pixels done.
+template <int Bpp>
+static void _RowBitFields(const u8t* pSrc, u8t* pDst, i32t nWidth, const BitFieldLayout& layout)
+{
+	for (i32t x = 0; x < nWidth; ++x, pSrc += Bpp / 8, pDst += 4)
+	{
+		u32t v = Bpp == 16 ? _Read<u16t>(pSrc) : _Read<u32t>(pSrc);
+		u32t nPixel = layout.nOpaque;
+		for (int ii = 0; ii < 4; ++ii)
+		{
+			auto& field = layout.Fields[ii];
+			nPixel |= ((((v & field.nMask) >> field.nShift) * field.nMul) >> field.nPostShift) << (ii * 8);
+		}
+		_Store(pDst, nPixel);
+	}
+}
+
+#ifdef EMFDIB_X86
+
+template <int Bpp>
+static i32t _RowBitFields_SSE2(const u8t* pSrc, u8t* pDst, i32t nWidth, const BitFieldLayout& layout)
+{
+	__m128i aMask[4], aMul[4], aShift[4], aPostShift[4], aChannel[4];
+	for (int ii = 0; ii < 4; ++ii)
+	{
+		auto& field = layout.Fields[ii];
+		aMask[ii] = _mm_set1_epi32((int)field.nMask);
+		// The scaled value stays below 2^16, so a 16-bit multiply is enough
+		aMul[ii] = _mm_set1_epi32((int)field.nMul);
+		aShift[ii] = _mm_cvtsi32_si128((int)field.nShift);
+		aPostShift[ii] = _mm_cvtsi32_si128((int)field.nPostShift);
+		aChannel[ii] = _mm_cvtsi32_si128(ii * 8);
+	}
+	const __m128i opaque = _mm_set1_epi32((int)layout.nOpaque);
+	auto Unpack = [&](__m128i v)
+	{
+		__m128i res = opaque;
+		for (int ii = 0; ii < 4; ++ii)
+		{
+			__m128i t = _mm_srl_epi32(_mm_and_si128(v, aMask[ii]), aShift[ii]);
+			t = _mm_srl_epi32(_mm_mullo_epi16(t, aMul[ii]), aPostShift[ii]);
+			res = _mm_or_si128(res, _mm_sll_epi32(t, aChannel[ii]));
+		}
+		return res;
+	};
+	i32t x = 0;
+	if (Bpp == 16)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		for (; x + 8 <= nWidth; x += 8)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(pSrc + x * 2));
+			_mm_storeu_si128((__m128i*)(pDst + x * 4), Unpack(_mm_unpacklo_epi16(v, zero)));
+			_mm_storeu_si128((__m128i*)(pDst + x * 4 + 16), Unpack(_mm_unpackhi_epi16(v, zero)));
+		}
+	}
+	else
+	{
+		for (; x + 4 <= nWidth; x += 4)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(pSrc + x * 4));
+			_mm_storeu_si128((__m128i*)(pDst + x * 4), Unpack(v));
+		}
+	}
+	return x;
+}
+
+template <int Bpp>
+static EMFDIB_AVX2 i32t _RowBitFields_AVX2(const u8t* pSrc, u8t* pDst, i32t nWidth, const BitFieldLayout& layout)
+{
+	__m256i aMask[4], aMul[4];
+	__m128i aShift[4], aPostShift[4], aChannel[4];
+	for (int ii = 0; ii < 4; ++ii)
+	{
+		auto& field = layout.Fields[ii];
+		aMask[ii] = _mm256_set1_epi32((int)field.nMask);
+		aMul[ii] = _mm256_set1_epi32((int)field.nMul);
+		aShift[ii] = _mm_cvtsi32_si128((int)field.nShift);
+		aPostShift[ii] = _mm_cvtsi32_si128((int)field.nPostShift);
+		aChannel[ii] = _mm_cvtsi32_si128(ii * 8);
+	}
+	const __m256i opaque = _mm256_set1_epi32((int)layout.nOpaque);
+	i32t x = 0;
+	for (; x + 8 <= nWidth; x += 8)
+	{
+		__m256i v = Bpp == 16
+			? _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(pSrc + x * 2)))
+			: _mm256_loadu_si256((const __m256i*)(pSrc + x * 4));
+		__m256i res = opaque;
+		for (int ii = 0; ii < 4; ++ii)
+		{
+			__m256i t = _mm256_srl_epi32(_mm256_and_si256(v, aMask[ii]), aShift[ii]);
+			t = _mm256_srl_epi32(_mm256_mullo_epi16(t, aMul[ii]), aPostShift[ii]);
+			res = _mm256_or_si256(res, _mm256_sll_epi32(t, aChannel[ii]));
+		}
+		_mm256_storeu_si256((__m256i*)(pDst + x * 4), res);
+	}
+	return x;
+}
+
+#endif // EMFDIB_X86
+
+//////////////////////////////////////////////////////////////////////////
+// DIBDecoder
+
+bool DIBDecoder::Init(const u8t* pBmi, size_t cbBmi, const u8t* pBits, size_t cbBits,
+	DIBColors nUsage, const u32t* pLogPalette, size_t nLogPaletteCount)
+{
+	m_pBits = nullptr;
+	m_cbBits = 0;
+	m_vRLERows.clear();
+	if (!ParseDIBInfo(pBmi, cbBmi, m_info, nUsage, pLogPalette, nLogPaletteCount))
+		return false;
+	if (!pBits && cbBits)
+		return false;
+	m_pBits = pBits;
+	m_cbBits = cbBits;
+	if (m_info.IsRLE())
+		m_vRLERows.push_back({ 0, 0, 0 });
+	return true;
+}
+
+bool DIBDecoder::Init(const u8t* pDIB, size_t cbDIB, DIBColors nUsage)
+{
+	ODIBInfo info;
+	if (!ParseDIBInfo(pDIB, cbDIB, info, nUsage))
+		return false;
+	return Init(pDIB, info.nHeaderSize, pDIB + info.nHeaderSize, cbDIB - info.nHeaderSize, nUsage);
+}
+
+bool DIBDecoder::InitFormat()
+{
+	m_nFormat = OPixelFormat::FormatUndefined;
+	auto& masks = m_info.Masks;
+	bool bAlpha = m_nAlpha != AlphaMode::Ignore;
+	switch (m_info.BitCount)
+	{
+	case 1:
+		m_nFormat = OPixelFormat::Format1bppIndexed;
+		return true;
+	case 4:
+		m_nFormat = OPixelFormat::Format4bppIndexed;
+		return true;
+	case 8:
+		m_nFormat = OPixelFormat::Format8bppIndexed;
+		return true;
+	case 24:
+		m_nFormat = OPixelFormat::Format24bppRGB;
+		return true;
+	case 16:
+		if (masks[0] == 0x7C00 && masks[1] == 0x03E0 && masks[2] == 0x001F)
+		{
+			if (!masks[3] || !bAlpha)
+				m_nFormat = OPixelFormat::Format16bppRGB555;
+			else if (masks[3] == 0x8000)
+				m_nFormat = OPixelFormat::Format16bppARGB1555;
+		}
+		else if (masks[0] == 0xF800 && masks[1] == 0x07E0 && masks[2] == 0x001F && (!masks[3] || !bAlpha))
+			m_nFormat = OPixelFormat::Format16bppRGB565;
+		break;
+	case 32:
+		if (masks[0] == 0x00FF0000 && masks[1] == 0x0000FF00 && masks[2] == 0x000000FF)
+		{
+			// The 4th byte of BI_RGB pixels is the alpha when it's asked for
+			if (m_info.Compression == DIBCompression::RGB ? bAlpha : bAlpha && masks[3] == 0xFF000000)
+				m_nFormat = m_nAlpha == AlphaMode::Straight ? OPixelFormat::Format32bppARGB : OPixelFormat::Format32bppPARGB;
+			else if (!bAlpha || !masks[3])
+				m_nFormat = OPixelFormat::Format32bppRGB;
+		}
+		break;
+	default:
+		return false;
+	}
+	if (m_nFormat != OPixelFormat::FormatUndefined)
+		return true;
+	static const int aFieldOrder[] = { 2, 1, 0, 3 };	// masks are red, green, blue, alpha
+	for (int ii = 0; ii < 4; ++ii)
+		m_layout.Fields[ii] = _MakeBitField(masks[aFieldOrder[ii]]);
+	if (!bAlpha)
+		m_layout.Fields[3] = _MakeBitField(0);
+	m_layout.nOpaque = m_layout.Fields[3].nMask ? 0 : 0xFF000000;
+	return true;
+}
+
+void DIBDecoder::DecodeBitFieldRow(const u8t* pSrc, u8t* pDst)
+{
+	using SimdFunc = i32t (*)(const u8t*, u8t*, i32t, const BitFieldLayout&);
+	bool b16 = m_info.BitCount == 16;
+	SimdFunc pSimd = nullptr;
+	switch (GetSimdLevel())
+	{
+#ifdef EMFDIB_X86
+	case SimdLevel::AVX2:
+		pSimd = b16 ? _RowBitFields_AVX2<16> : _RowBitFields_AVX2<32>;
+		break;
+	case SimdLevel::SSE2:
+		pSimd = b16 ? _RowBitFields_SSE2<16> : _RowBitFields_SSE2<32>;
+		break;
+#endif // EMFDIB_X86
+	default:
+		break;
+	}
+	i32t nWidth = m_info.Width;
+	i32t nDone = pSimd ? pSimd(pSrc, pDst, nWidth, m_layout) : 0;
+	if (nDone < nWidth)
+	{
+		size_t nSrcOffset = (size_t)nDone * (b16 ? 2 : 4);
+		if (b16)
+			_RowBitFields<16>(pSrc + nSrcOffset, pDst + nDone * 4, nWidth - nDone, m_layout);
+		else
+			_RowBitFields<32>(pSrc + nSrcOffset, pDst + nDone * 4, nWidth - nDone, m_layout);
+	}
+
+	// Premultiply and reorder in place
+	size_t nRowSize = (size_t)nWidth * 4;
+	if (m_layout.Fields[3].nMask && m_nAlpha == AlphaMode::Straight)
+	{
+		ConvertToPremultiplied(OPixelFormat::Format32bppARGB, nWidth, 1, (i32t)nRowSize,
+			pDst, nRowSize, nullptr, 0, pDst, nRowSize, m_nOrder);
+	}
+	else if (m_nOrder != PixelOrder::BGRA)
+	{
+		ConvertToPremultiplied(OPixelFormat::Format32bppPARGB, nWidth, 1, (i32t)nRowSize,
+			pDst, nRowSize, nullptr, 0, pDst, nRowSize, m_nOrder);
+	}
+}
+
+bool DIBDecoder::DecodeUncompressed(i32t nTop, i32t nRows, u8t* pDst, ptrdiff_t nDstStride)
+{
+	i32t nWidth = m_info.Width, nHeight = m_info.Height;
+	size_t nStride = m_info.GetStride();
+	if (nStride > (size_t)INT32_MAX)
+		return false;
+	// Scanlines the bits cover, in file order
+	i32t nAvail = (i32t)std::min<size_t>(m_cbBits / nStride, (size_t)nHeight);
+	i32t nFirst = nTop, nLast = nTop + nRows;
+	if (m_info.bTopDown)
+		nLast = std::min(nLast, nAvail);
+	else
+		nFirst = std::max(nFirst, nHeight - nAvail);
+	for (i32t y = nTop; y < nTop + nRows; ++y)
+	{
+		if (y < nFirst || y >= nLast)
+			memset(pDst + (y - nTop) * nDstStride, 0, (size_t)nWidth * 4);
+	}
+	if (nFirst >= nLast)
+		return true;
+
+	u8t* pDstFirst = pDst + (nFirst - nTop) * nDstStride;
+	i32t nCount = nLast - nFirst;
+	if (m_nFormat == OPixelFormat::FormatUndefined)
+	{
+		for (i32t y = nFirst; y < nLast; ++y, pDstFirst += nDstStride)
+		{
+			i32t nFileRow = m_info.bTopDown ? y : nHeight - 1 - y;
+			DecodeBitFieldRow(m_pBits + nStride * nFileRow, pDstFirst);
+		}
+		return true;
+	}
+	// One call for the band, bottom-up bits have a negative stride
+	const u8t* pSrc = m_pBits + nStride * (m_info.bTopDown ? nFirst : nHeight - nLast);
+	i32t nSrcStride = m_info.bTopDown ? (i32t)nStride : -(i32t)nStride;
+	return ConvertToPremultiplied(m_nFormat, nWidth, nCount, nSrcStride, pSrc, nStride * nCount,
+		m_info.Palette.data(), m_info.Palette.size(), pDstFirst, nDstStride, m_nOrder);
+}
+
+void DIBDecoder::DecodeRLE(i32t nTop, i32t nRows, u8t* pDst, ptrdiff_t nDstStride)
+{
+	i32t nWidth = m_info.Width, nHeight = m_info.Height;
+	for (i32t y = 0; y < nRows; ++y)
+		memset(pDst + y * nDstStride, 0, (size_t)nWidth * 4);
+
+	u32t aLUT[256] = { 0 };
+	for (size_t ii = 0; ii < m_info.Palette.size(); ++ii)
+		aLUT[ii] = _ToOrder(m_info.Palette[ii], m_nOrder);
+
+	// The band in file order
+	i32t nBegin = m_info.bTopDown ? nTop : nHeight - nTop - nRows;
+	i32t nEnd = nBegin + nRows;
+	auto GetRow = [&](i32t y)
+	{
+		i32t nRow = m_info.bTopDown ? y : nHeight - 1 - y;
+		return pDst + (nRow - nTop) * nDstStride;
+	};
+
+	ASSERT(!m_vRLERows.empty());
+	auto state = m_vRLERows[std::min((size_t)nBegin, m_vRLERows.size() - 1)];
+	size_t nOffset = state.nOffset;
+	i32t x = state.x, y = state.y;
+	auto Record = [&]()
+	{
+		for (i32t nRow = (i32t)m_vRLERows.size(); nRow <= std::min(y, nHeight - 1); ++nRow)
+			m_vRLERows.push_back({ nOffset, x, y });
+	};
+
+	bool bRLE8 = m_info.Compression == DIBCompression::RLE8;
+	const u8t* pBits = m_pBits;
+	while (y < nEnd && nOffset + 2 <= m_cbBits)
+	{
+		u8t nCount = pBits[nOffset], nCode = pBits[nOffset + 1];
+		nOffset += 2;
+		if (nCount)
+		{
+			// Encoded run, RLE4 alternates the two nibbles
+			if (y >= nBegin && x < nWidth)
+			{
+				u8t* pRow = GetRow(y);
+				i32t nPixels = std::min((i32t)nCount, nWidth - x);
+				if (bRLE8)
+				{
+					for (i32t ii = 0; ii < nPixels; ++ii)
+						_Store(pRow + (x + ii) * 4, aLUT[nCode]);
+				}
+				else
+				{
+					u32t aColors[2] = { aLUT[nCode >> 4], aLUT[nCode & 0x0F] };
+					for (i32t ii = 0; ii < nPixels; ++ii)
+						_Store(pRow + (x + ii) * 4, aColors[ii & 1]);
+				}
+			}
+			x = std::min(x + nCount, nWidth);
+			continue;
+		}
+		switch (nCode)
+		{
+		case 0:		// end of line
+			x = 0;
+			++y;
+			Record();
+			break;
+		case 1:		// end of bitmap
+			nOffset = m_cbBits;
+			break;
+		case 2:		// delta
+			if (nOffset + 2 > m_cbBits)
+			{
+				nOffset = m_cbBits;
+				break;
+			}
+			x = std::min(x + pBits[nOffset], nWidth);
+			y = std::min(y + pBits[nOffset + 1], nHeight);
+			nOffset += 2;
+			Record();
+			break;
+		default:	// absolute run of nCode pixels, padded to a WORD
+			{
+				size_t nBytes = bRLE8 ? nCode : ((size_t)nCode + 1) / 2;
+				if (nOffset + nBytes > m_cbBits)
+				{
+					nOffset = m_cbBits;
+					break;
+				}
+				if (y >= nBegin && x < nWidth)
+				{
+					u8t* pRow = GetRow(y);
+					const u8t* pIndices = pBits + nOffset;
+					i32t nPixels = std::min((i32t)nCode, nWidth - x);
+					for (i32t ii = 0; ii < nPixels; ++ii)
+					{
+						u8t nIndex = bRLE8 ? pIndices[ii] : ((ii & 1) ? (pIndices[ii >> 1] & 0x0F) : (pIndices[ii >> 1] >> 4));
+						_Store(pRow + (x + ii) * 4, aLUT[nIndex]);
+					}
+				}
+				nOffset += (nBytes + 1) & ~(size_t)1;
+				x = std::min(x + nCode, nWidth);
+			}
+			break;
+		}
+	}
+	if (nOffset + 2 > m_cbBits)
+	{
+		// The stream is done, the remaining scanlines are empty
+		x = 0;
+		y = nHeight;
+		nOffset = m_cbBits;
+		while ((i32t)m_vRLERows.size() < nHeight)
+			m_vRLERows.push_back({ nOffset, x, y });
+	}
+}
+
+bool DIBDecoder::DecodeRows(i32t nTop, i32t nRows, u8t* pDst, ptrdiff_t nDstStride)
+{
+	if (!m_pBits || m_info.IsImageFile() || !pDst)
+		return false;
+	if (nTop < 0 || nRows <= 0 || nRows > m_info.Height - nTop)
+		return false;
+	if ((size_t)(nDstStride < 0 ? -nDstStride : nDstStride) < (size_t)m_info.Width * 4)
+		return false;
+	if (m_info.IsRLE())
+	{
+#ifdef _DEBUG
+		i32t nBegin = m_info.bTopDown ? nTop : m_info.Height - nTop - nRows;
+		bool bResumed = nBegin > 0 && (size_t)nBegin < m_vRLERows.size();
+#endif // _DEBUG
+		DecodeRLE(nTop, nRows, pDst, nDstStride);
+#ifdef _DEBUG
+		if (bResumed)
+		{
+			// The band resumed from a kept position is the same as walked from the start
+			DIBDecoder check(*this);
+			check.m_vRLERows.assign(1, { 0, 0, 0 });
+			size_t nRowSize = (size_t)m_info.Width * 4;
+			std::vector<u8t> vCheck(nRowSize * nRows);
+			check.DecodeRLE(nTop, nRows, vCheck.data(), (ptrdiff_t)nRowSize);
+			for (i32t y = 0; y < nRows; ++y)
+				ASSERT(!memcmp(pDst + y * nDstStride, vCheck.data() + y * nRowSize, nRowSize));
+		}
+#endif // _DEBUG
+		return true;
+	}
+	if (!InitFormat())
+		return false;
+	return DecodeUncompressed(nTop, nRows, pDst, nDstStride);
+}
+
+bool DIBDecoder::Decode(memory_vector& vOut)
+{
+	size_t nRowSize = (size_t)m_info.Width * 4;
+	if (!m_info.Height || nRowSize > PTRDIFF_MAX || (size_t)m_info.Height > SIZE_MAX / nRowSize)
+		return false;
+	vOut.resize(nRowSize * m_info.Height);
+	if (!DecodeRows(0, m_info.Height, vOut.data(), (ptrdiff_t)nRowSize))
+	{
+		vOut.clear();
+		return false;
+	}
+	return true;
+}
+
+}
+
+#pragma pop_macro("min")
+#pragma pop_macro("max")
+
+#endif // _ENABLE_GDIPLUS_STRUCT
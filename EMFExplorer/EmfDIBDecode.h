@@ -0,0 +1,135 @@
+#ifndef EMF_DIB_DECODE_H
+#define EMF_DIB_DECODE_H
+
+#ifdef _ENABLE_GDIPLUS_STRUCT
+
+#include "EmfPixelConvert.h"
+
+// Decoder of the device-independent bitmaps carried by the GDI
+// bitmap records (EMR_BITBLT, EMR_STRETCHDIBITS, EMR_CREATEDIBPATTERNBRUSHPT,
+// META_DIBSTRETCHBLT, ...), to the same premultiplied 8-bit output as emfpixel.
+//
+// BI_RGB, BI_BITFIELDS/BI_ALPHABITFIELDS, BI_RLE8 and BI_RLE4 are decoded;
+// BI_JPEG/BI_PNG bits are complete image files left to an image codec.
+// Any band of scanlines can be decoded on its own. RLE bits are walked as
+// a stream and the stream position of every scanline reached is kept, so
+// the next band resumes from there; debug builds check each resumed band
+// against a walk from the start of the stream.
+namespace emfdib
+{
+	using namespace emfpixel;
+
+	enum class DIBCompression : u32t
+	{
+		RGB				= 0,
+		RLE8			= 1,
+		RLE4			= 2,
+		BitFields		= 3,
+		JPEG			= 4,
+		PNG				= 5,
+		AlphaBitFields	= 6,
+	};
+
+	// iUsage of the records
+	enum class DIBColors : u32t
+	{
+		RGB		= 0,	// DIB_RGB_COLORS
+		Pal		= 1,	// DIB_PAL_COLORS, 16-bit indices into the logical palette
+	};
+
+	// How the 4th byte of 32bpp BI_RGB pixels and the alpha bit field are taken
+	enum class AlphaMode
+	{
+		Ignore,			// opaque, as StretchDIBits draws them
+		Straight,
+		Premultiplied,	// AlphaBlend with AC_SRC_ALPHA
+	};
+
+	struct ODIBInfo
+	{
+		i32t				Width = 0;
+		i32t				Height = 0;			// always positive
+		bool				bTopDown = false;
+		u16t				BitCount = 0;
+		DIBCompression		Compression = DIBCompression::RGB;
+		u32t				Masks[4] = {};		// red, green, blue, alpha
+		std::vector<u32t>	Palette;			// 0xAARRGGBB, always opaque
+		size_t				nHeaderSize = 0;	// header, bit fields and color table
+
+		inline bool IsRLE() const { return Compression == DIBCompression::RLE8 || Compression == DIBCompression::RLE4; }
+		inline bool IsImageFile() const { return Compression == DIBCompression::JPEG || Compression == DIBCompression::PNG; }
+
+		// DWORD aligned scanline size of uncompressed bits
+		inline size_t GetStride() const { return (((size_t)Width * BitCount + 31) / 32) * 4; }
+	};
+
+	// Parses the BITMAPINFO (or BITMAPCOREINFO) at pBmi. With DIBColors::Pal
+	// the color table is resolved through pLogPalette (0xAARRGGBB entries).
+	bool ParseDIBInfo(const u8t* pBmi, size_t cbBmi, ODIBInfo& info, DIBColors nUsage = DIBColors::RGB,
+		const u32t* pLogPalette = nullptr, size_t nLogPaletteCount = 0);
+
+	class DIBDecoder
+	{
+	public:
+		// The header and the bits must stay valid while the decoder is in use
+		bool Init(const u8t* pBmi, size_t cbBmi, const u8t* pBits, size_t cbBits,
+			DIBColors nUsage = DIBColors::RGB, const u32t* pLogPalette = nullptr, size_t nLogPaletteCount = 0);
+
+		// Packed DIB, the bits follow the color table
+		bool Init(const u8t* pDIB, size_t cbDIB, DIBColors nUsage = DIBColors::RGB);
+
+		inline const ODIBInfo& GetInfo() const { return m_info; }
+
+		inline void SetAlphaMode(AlphaMode nMode) { m_nAlpha = nMode; }
+		inline void SetPixelOrder(PixelOrder nOrder) { m_nOrder = nOrder; }
+
+		// Decodes the scanlines [nTop, nTop + nRows), counted from the top of
+		// the image. Pixels the bits don't cover (RLE deltas, truncated data)
+		// are transparent black.
+		bool DecodeRows(i32t nTop, i32t nRows, u8t* pDst, ptrdiff_t nDstStride);
+
+		// Whole image, tightly packed and top-down
+		bool Decode(memory_vector& vOut);
+	public:
+		// Bit field scaled to 8 bits: ((((v & nMask) >> nShift) * nMul) >> nPostShift)
+		struct BitField
+		{
+			u32t	nMask;
+			u32t	nShift;
+			u32t	nMul;
+			u32t	nPostShift;
+		};
+		struct BitFieldLayout
+		{
+			BitField	Fields[4];	// blue, green, red, alpha (BGRA output order)
+			u32t		nOpaque;	// 0xFF000000 when there's no alpha field
+		};
+	private:
+		bool InitFormat();
+		bool DecodeUncompressed(i32t nTop, i32t nRows, u8t* pDst, ptrdiff_t nDstStride);
+		void DecodeBitFieldRow(const u8t* pSrc, u8t* pDst);
+		void DecodeRLE(i32t nTop, i32t nRows, u8t* pDst, ptrdiff_t nDstStride);
+	private:
+		// Position in the RLE stream, y counts scanlines in file order
+		struct RLEState
+		{
+			size_t	nOffset;
+			i32t	x;
+			i32t	y;
+		};
+		ODIBInfo			m_info;
+		const u8t*			m_pBits = nullptr;
+		size_t				m_cbBits = 0;
+		AlphaMode			m_nAlpha = AlphaMode::Ignore;
+		PixelOrder			m_nOrder = PixelOrder::RGBA;
+		// emfpixel format of uncompressed bits, FormatUndefined for the other bit fields
+		OPixelFormat		m_nFormat = OPixelFormat::FormatUndefined;
+		BitFieldLayout		m_layout = {};
+		// State of the stream when it first reached each scanline
+		std::vector<RLEState>	m_vRLERows;
+	};
+}
+
+#endif // _ENABLE_GDIPLUS_STRUCT
+
+#endif // EMF_DIB_DECODE_H
@@ -0,0 +1,300 @@
+#include PCH_FNAME
+
+#include "EmfDiff.h"
+#include <algorithm>
+
+namespace emfdiff
+{
+
+// Below that, anchors are no longer looked for in the stretches between anchors
+constexpr int MaxAnchorDepth = 32;
+
+static void AppendRun(std::vector<OEditRun>& vRuns, const OEditRun& run)
+{
+	if (!run.nCount)
+		return;
+	if (!vRuns.empty())
+	{
+		auto& last = vRuns.back();
+		size_t nNextA = last.nIndexA + (last.Type != OEditType::Insert ? last.nCount : 0);
+		size_t nNextB = last.nIndexB + (last.Type != OEditType::Delete ? last.nCount : 0);
+		if (last.Type == run.Type && nNextA == run.nIndexA && nNextB == run.nIndexB)
+		{
+			last.nCount += run.nCount;
+			return;
+		}
+	}
+	vRuns.push_back(run);
+}
+
+// Aligns ranges of A and B, the edits are appended in order. Records match
+// on their hash, or on their type alone when pairing up deleted and inserted
+// records (the matches are then reported as modified).
+class RecordAligner
+{
+public:
+	RecordAligner(const ORecordKey* pA, const ORecordKey* pB, bool bByType,
+		const ODiffOptions& options, std::vector<OEditRun>& vRuns)
+		: m_pA(pA)
+		, m_pB(pB)
+		, m_bByType(bByType)
+		, m_options(options)
+		, m_vRuns(vRuns)
+	{
+	}
+public:
+	void Align(size_t a0, size_t a1, size_t b0, size_t b1, int nDepth);
+private:
+	inline bool IsSame(size_t a, size_t b) const
+	{
+		return m_bByType ? m_pA[a].nType == m_pB[b].nType : m_pA[a].nHash == m_pB[b].nHash;
+	}
+
+	inline void Emit(OEditType type, size_t a, size_t b, size_t n)
+	{
+		if (type != OEditType::Equal || !m_bByType)
+		{
+			AppendRun(m_vRuns, { type, a, b, n });
+			return;
+		}
+		// Same type, the content may still match when the alignment wasn't minimal
+		for (size_t ii = 0; ii < n; ++ii)
+		{
+			type = m_pA[a + ii].nHash == m_pB[b + ii].nHash ? OEditType::Equal : OEditType::Modify;
+			AppendRun(m_vRuns, { type, a + ii, b + ii, 1 });
+		}
+	}
+
+	bool AlignAnchors(size_t a0, size_t a1, size_t b0, size_t b1, int nDepth);
+
+	void AlignMyers(size_t a0, size_t a1, size_t b0, size_t b1);
+
+	bool FindSplit(size_t a0, size_t a1, size_t b0, size_t b1, size_t& x, size_t& y) const;
+private:
+	const ORecordKey*		m_pA;
+	const ORecordKey*		m_pB;
+	bool					m_bByType;
+	const ODiffOptions&		m_options;
+	std::vector<OEditRun>&	m_vRuns;
+};
+
+void RecordAligner::Align(size_t a0, size_t a1, size_t b0, size_t b1, int nDepth)
+{
+	size_t nPrefix = 0;
+	while (a0 + nPrefix < a1 && b0 + nPrefix < b1 && IsSame(a0 + nPrefix, b0 + nPrefix))
+		++nPrefix;
+	Emit(OEditType::Equal, a0, b0, nPrefix);
+	a0 += nPrefix;
+	b0 += nPrefix;
+
+	size_t nSuffix = 0;
+	while (a1 - nSuffix > a0 && b1 - nSuffix > b0 && IsSame(a1 - nSuffix - 1, b1 - nSuffix - 1))
+		++nSuffix;
+	a1 -= nSuffix;
+	b1 -= nSuffix;
+
+	if (a0 == a1)
+		Emit(OEditType::Insert, a0, b0, b1 - b0);
+	else if (b0 == b1)
+		Emit(OEditType::Delete, a0, b0, a1 - a0);
+	else if (nDepth >= MaxAnchorDepth || a1 - a0 + b1 - b0 < m_options.nMinAnchorRange
+		|| !AlignAnchors(a0, a1, b0, b1, nDepth))
+		AlignMyers(a0, a1, b0, b1);
+
+	Emit(OEditType::Equal, a1, b1, nSuffix);
+}
+
+bool RecordAligner::AlignAnchors(size_t a0, size_t a1, size_t b0, size_t b1, int nDepth)
+{
+	using HashPos = std::pair<uint64_t, size_t>;
+	std::vector<HashPos> vHashA, vHashB;
+	vHashA.reserve(a1 - a0);
+	vHashB.reserve(b1 - b0);
+	for (size_t ii = a0; ii < a1; ++ii)
+		vHashA.emplace_back(m_pA[ii].nHash, ii);
+	for (size_t ii = b0; ii < b1; ++ii)
+		vHashB.emplace_back(m_pB[ii].nHash, ii);
+	std::sort(vHashA.begin(), vHashA.end());
+	std::sort(vHashB.begin(), vHashB.end());
+
+	// Hashes occurring once on each side, as (position in A, position in B)
+	std::vector<std::pair<size_t, size_t>> vUnique;
+	size_t ia = 0, ib = 0;
+	while (ia < vHashA.size() && ib < vHashB.size())
+	{
+		uint64_t nHash = std::min(vHashA[ia].first, vHashB[ib].first);
+		size_t na = 0, nb = 0;
+		for (; ia + na < vHashA.size() && vHashA[ia + na].first == nHash; ++na);
+		for (; ib + nb < vHashB.size() && vHashB[ib + nb].first == nHash; ++nb);
+		if (na == 1 && nb == 1)
+			vUnique.emplace_back(vHashA[ia].second, vHashB[ib].second);
+		ia += na;
+		ib += nb;
+	}
+	if (vUnique.empty())
+		return false;
+	std::sort(vUnique.begin(), vUnique.end());
+
+	// Longest run of them increasing on both sides
+	std::vector<size_t> vTails;
+	std::vector<size_t> vPrev(vUnique.size(), (size_t)-1);
+	for (size_t ii = 0; ii < vUnique.size(); ++ii)
+	{
+		auto it = std::lower_bound(vTails.begin(), vTails.end(), vUnique[ii].second,
+			[&vUnique](size_t nTail, size_t nPosB) { return vUnique[nTail].second < nPosB; });
+		if (it != vTails.begin())
+			vPrev[ii] = *(it - 1);
+		if (it == vTails.end())
+			vTails.push_back(ii);
+		else
+			*it = ii;
+	}
+	std::vector<size_t> vAnchors(vTails.size());
+	for (size_t ii = vTails.back(), jj = vTails.size(); jj > 0; ii = vPrev[ii])
+		vAnchors[--jj] = ii;
+
+	for (auto nAnchor : vAnchors)
+	{
+		auto& anchor = vUnique[nAnchor];
+		Align(a0, anchor.first, b0, anchor.second, nDepth + 1);
+		Emit(OEditType::Equal, anchor.first, anchor.second, 1);
+		a0 = anchor.first + 1;
+		b0 = anchor.second + 1;
+	}
+	Align(a0, a1, b0, b1, nDepth + 1);
+	return true;
+}
+
+void RecordAligner::AlignMyers(size_t a0, size_t a1, size_t b0, size_t b1)
+{
+	size_t x, y;
+	if (!FindSplit(a0, a1, b0, b1, x, y))
+	{
+		Emit(OEditType::Delete, a0, b0, a1 - a0);
+		Emit(OEditType::Insert, a1, b0, b1 - b0);
+		return;
+	}
+	Align(a0, x, b0, y, MaxAnchorDepth);
+	Align(x, a1, y, b1, MaxAnchorDepth);
+}
+
+// Middle of the shortest edit script, searched for from both ends at once.
+// The ranges have no common prefix or suffix. Returns false when the edit
+// distance is over nMaxCost.
+bool RecordAligner::FindSplit(size_t a0, size_t a1, size_t b0, size_t b1, size_t& x, size_t& y) const
+{
+	const ptrdiff_t N = (ptrdiff_t)(a1 - a0);
+	const ptrdiff_t M = (ptrdiff_t)(b1 - b0);
+	const ptrdiff_t nMaxD = std::min((N + M + 1) / 2, (ptrdiff_t)std::max<size_t>(m_options.nMaxCost / 2, 1));
+	const ptrdiff_t nOffset = nMaxD + 1;
+	const ptrdiff_t nLength = 2 * nMaxD + 2;
+	std::vector<ptrdiff_t> v1(nLength, -1), v2(nLength, -1);
+	v1[nOffset + 1] = 0;
+	v2[nOffset + 1] = 0;
+	const ptrdiff_t delta = N - M;
+	// With an odd delta the paths collide on a forward step
+	const bool bFront = (delta & 1) != 0;
+	ptrdiff_t k1start = 0, k1end = 0, k2start = 0, k2end = 0;
+	for (ptrdiff_t d = 0; d < nMaxD; ++d)
+	{
+		for (ptrdiff_t k1 = -d + k1start; k1 <= d - k1end; k1 += 2)
+		{
+			ptrdiff_t k1off = nOffset + k1;
+			ptrdiff_t x1;
+			if (k1 == -d || (k1 != d && v1[k1off - 1] < v1[k1off + 1]))
+				x1 = v1[k1off + 1];
+			else
+				x1 = v1[k1off - 1] + 1;
+			ptrdiff_t y1 = x1 - k1;
+			while (x1 < N && y1 < M && IsSame(a0 + x1, b0 + y1))
+			{
+				++x1;
+				++y1;
+			}
+			v1[k1off] = x1;
+			if (x1 > N)
+				k1end += 2;
+			else if (y1 > M)
+				k1start += 2;
+			else if (bFront)
+			{
+				ptrdiff_t k2off = nOffset + delta - k1;
+				if (k2off >= 0 && k2off < nLength && v2[k2off] != -1 && x1 >= N - v2[k2off])
+				{
+					x = a0 + x1;
+					y = b0 + y1;
+					return true;
+				}
+			}
+		}
+		for (ptrdiff_t k2 = -d + k2start; k2 <= d - k2end; k2 += 2)
+		{
+			ptrdiff_t k2off = nOffset + k2;
+			ptrdiff_t x2;
+			if (k2 == -d || (k2 != d && v2[k2off - 1] < v2[k2off + 1]))
+				x2 = v2[k2off + 1];
+			else
+				x2 = v2[k2off - 1] + 1;
+			ptrdiff_t y2 = x2 - k2;
+			while (x2 < N && y2 < M && IsSame(a1 - x2 - 1, b1 - y2 - 1))
+			{
+				++x2;
+				++y2;
+			}
+			v2[k2off] = x2;
+			if (x2 > N)
+				k2end += 2;
+			else if (y2 > M)
+				k2start += 2;
+			else if (!bFront)
+			{
+				ptrdiff_t k1off = nOffset + delta - k2;
+				if (k1off >= 0 && k1off < nLength && v1[k1off] != -1)
+				{
+					ptrdiff_t x1 = v1[k1off];
+					ptrdiff_t y1 = nOffset + x1 - k1off;
+					if (x1 >= N - x2)
+					{
+						x = a0 + x1;
+						y = b0 + y1;
+						return true;
+					}
+				}
+			}
+		}
+	}
+	return false;
+}
+
+void DiffRecords(const std::vector<ORecordKey>& vA, const std::vector<ORecordKey>& vB,
+	std::vector<OEditRun>& vRuns, const ODiffOptions& options)
+{
+	vRuns.clear();
+	std::vector<OEditRun> vMatched;
+	RecordAligner(vA.data(), vB.data(), false, options, vMatched).Align(0, vA.size(), 0, vB.size(), 0);
+
+	// Pair up by type what was deleted and inserted between two matches
+	RecordAligner typeAligner(vA.data(), vB.data(), true, options, vRuns);
+	for (size_t ii = 0; ii < vMatched.size();)
+	{
+		auto& run = vMatched[ii];
+		if (run.Type == OEditType::Equal)
+		{
+			AppendRun(vRuns, run);
+			++ii;
+			continue;
+		}
+		size_t a0 = run.nIndexA, a1 = a0;
+		size_t b0 = run.nIndexB, b1 = b0;
+		for (; ii < vMatched.size() && vMatched[ii].Type != OEditType::Equal; ++ii)
+		{
+			if (vMatched[ii].Type == OEditType::Delete)
+				a1 = vMatched[ii].nIndexA + vMatched[ii].nCount;
+			else
+				b1 = vMatched[ii].nIndexB + vMatched[ii].nCount;
+		}
+		typeAligner.Align(a0, a1, b0, b1, MaxAnchorDepth);
+	}
+}
+
+}
@@ -0,0 +1,57 @@
+#ifndef EMF_DIFF_H
+#define EMF_DIFF_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Alignment of two record streams, each record reduced to a content hash
+// and its type.
+//
+// Records whose hash occurs exactly once on each side are taken as anchors
+// (the longest increasing run of them, as in patience diff), the stretches
+// between anchors are aligned with Myers' linear space O(ND) algorithm.
+// Deleted and inserted records left between two matches are then paired by
+// type, a pair being a modified record.
+namespace emfdiff
+{
+	struct ORecordKey
+	{
+		uint64_t	nHash;
+		uint32_t	nType;
+	};
+
+	enum class OEditType
+	{
+		Equal,
+		Delete,		// records of A only
+		Insert,		// records of B only
+		Modify,		// records of the same type whose content differs
+	};
+
+	// nCount consecutive records from nIndexA in A and nIndexB in B. For
+	// Delete nIndexB is where the records would be in B, and the other way
+	// around for Insert.
+	struct OEditRun
+	{
+		OEditType	Type;
+		size_t		nIndexA;
+		size_t		nIndexB;
+		size_t		nCount;
+	};
+
+	struct ODiffOptions
+	{
+		// Edit distance above which Myers gives up on a stretch without
+		// anchors, the stretch is then reported as deleted and inserted
+		// (and paired by type).
+		size_t		nMaxCost = 4096;
+		// Stretches shorter than this are aligned with Myers directly
+		size_t		nMinAnchorRange = 64;
+	};
+
+	void DiffRecords(const std::vector<ORecordKey>& vA, const std::vector<ORecordKey>& vB,
+		std::vector<OEditRun>& vRuns, const ODiffOptions& options = ODiffOptions());
+}
+
+#endif // EMF_DIFF_H
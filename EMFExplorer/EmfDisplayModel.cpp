@@ -0,0 +1,115 @@
+#include PCH_FNAME
+
+#include "EmfDisplayModel.h"
+#include <algorithm>
+
+namespace emfdisplay
+{
+
+static size_t GetLength(const char16_t* sz)
+{
+	size_t nLen = 0;
+	while (sz[nLen])
+		++nLen;
+	return nLen;
+}
+
+static void AppendHex(std::vector<char16_t>& vChars, uint32_t nValue, int nDigits)
+{
+	static const char16_t aHex[] = u"0123456789ABCDEF";
+	for (int ii = nDigits - 1; ii >= 0; --ii)
+		vChars.push_back(aHex[(nValue >> (ii * 4)) & 0xF]);
+}
+
+void ODisplayModel::Reserve(size_t nRows, size_t nChars)
+{
+	m_vRows.reserve(nRows);
+	m_vChars.reserve(nChars);
+}
+
+void ODisplayModel::AddRow(const ORowInput& row)
+{
+	BeginRow(row);
+	if (row.szText)
+	{
+		size_t nText = GetLength(row.szText);
+		std::copy(row.szText, row.szText + nText, AppendText(nText));
+	}
+	EndRow();
+}
+
+void ODisplayModel::BeginRow(const ORowInput& row)
+{
+	ORow& info = m_rowPending;
+	info = ORow{};
+	info.nOffset = (uint32_t)m_vChars.size();
+	info.nType = row.nType;
+	info.nColor = row.nColor;
+	info.nCategory = row.nCategory;
+	info.nFlags = row.nFlags & (RowFlagDrawing | RowFlagColor);
+	size_t nName = GetLength(row.szName);
+	info.nNameLength = (uint16_t)nName;
+	m_vChars.insert(m_vChars.end(), row.szName, row.szName + info.nNameLength);
+}
+
+char16_t* ODisplayModel::AppendText(size_t nLength)
+{
+	// The separator only comes with some text
+	if (nLength && !(m_rowPending.nFlags & RowFlagText))
+	{
+		m_rowPending.nFlags |= RowFlagText;
+		m_vChars.push_back(u':');
+		m_vChars.push_back(u' ');
+	}
+	size_t nPos = m_vChars.size();
+	m_vChars.resize(nPos + nLength);
+	return m_vChars.data() + nPos;
+}
+
+void ODisplayModel::EndRow()
+{
+	ORow& info = m_rowPending;
+	info.nLabelLength = (uint32_t)(m_vChars.size() - info.nOffset);
+	m_vChars.push_back(0);
+	if (info.nFlags & RowFlagColor)
+	{
+		// COLORREF is 0x00BBGGRR
+		m_vChars.push_back(u' ');
+		m_vChars.push_back(u'#');
+		AppendHex(m_vChars, info.nColor & 0xFF, 2);
+		AppendHex(m_vChars, (info.nColor >> 8) & 0xFF, 2);
+		AppendHex(m_vChars, (info.nColor >> 16) & 0xFF, 2);
+		if (info.nColor & 0xFF000000)
+		{
+			m_vChars.push_back(u' ');
+			m_vChars.push_back(u'[');
+			AppendHex(m_vChars, info.nColor, 8);
+			m_vChars.push_back(u']');
+		}
+		m_vChars.push_back(0);
+	}
+	m_vRows.push_back(info);
+}
+
+const char16_t* ODisplayModel::GetText(size_t nRow) const
+{
+	auto& row = m_vRows[nRow];
+	if (!(row.nFlags & RowFlagText))
+		return nullptr;
+	return m_vChars.data() + row.nOffset + row.nNameLength + 2;
+}
+
+const char16_t* ODisplayModel::GetColorText(size_t nRow) const
+{
+	auto& row = m_vRows[nRow];
+	if (!(row.nFlags & RowFlagColor))
+		return nullptr;
+	return m_vChars.data() + row.nOffset + row.nLabelLength + 1;
+}
+
+size_t ODisplayModel::GetMemorySize() const
+{
+	return sizeof(*this) + m_vRows.capacity() * sizeof(ORow) + m_vChars.capacity() * sizeof(char16_t);
+}
+
+}
@@ -0,0 +1,88 @@
+#ifndef EMF_DISPLAY_MODEL_H
+#define EMF_DISPLAY_MODEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// What the record list shows of each record, worked out once per document:
+// the label (the record name, then ": " and the text of the record if it
+// has one), the hex text of its color, its type, category and flags.
+//
+// The strings are UTF-16, packed null-terminated in a single buffer and
+// referred to by offset, so painting a row is a few lookups and a document
+// of a million records costs a couple of allocations.
+// Rows are only appended; once complete, the model is read-only.
+namespace emfdisplay
+{
+	enum ORowFlags : uint8_t
+	{
+		RowFlagDrawing	= 0x01,		// the record draws (EMFRecAccess::IsDrawingRecord)
+		RowFlagText		= 0x02,		// the label has the text of the record
+		RowFlagColor	= 0x04,		// the record has a color
+	};
+
+	struct ORowInput
+	{
+		const char16_t*	szName;
+		const char16_t*	szText;			// nullptr if there's none
+		uint32_t		nType;
+		uint32_t		nColor;			// COLORREF, with RowFlagColor
+		uint8_t			nCategory;
+		uint8_t			nFlags;
+	};
+
+	class ODisplayModel
+	{
+	public:
+		void Reserve(size_t nRows, size_t nChars);
+
+		void AddRow(const ORowInput& row);
+
+		// The same a piece at a time, the text being written in place:
+		// BeginRow (szText is ignored), AppendText for each piece of the
+		// text, then EndRow
+		void BeginRow(const ORowInput& row);
+		// Room for nLength more characters of the text, to be filled before
+		// the next call
+		char16_t* AppendText(size_t nLength);
+		void EndRow();
+
+		inline size_t GetRowCount() const { return m_vRows.size(); }
+
+		// Null-terminated, the name then ": " and the text with RowFlagText
+		inline const char16_t* GetLabel(size_t nRow) const { return m_vChars.data() + m_vRows[nRow].nOffset; }
+		inline size_t GetLabelLength(size_t nRow) const { return m_vRows[nRow].nLabelLength; }
+		inline size_t GetNameLength(size_t nRow) const { return m_vRows[nRow].nNameLength; }
+
+		// Null-terminated, nullptr without RowFlagText
+		const char16_t* GetText(size_t nRow) const;
+
+		// " #RRGGBB", followed by " [AARRGGBB]" when the high byte is set.
+		// Null-terminated, nullptr without RowFlagColor.
+		const char16_t* GetColorText(size_t nRow) const;
+
+		inline uint32_t GetRecordType(size_t nRow) const { return m_vRows[nRow].nType; }
+		inline uint32_t GetColor(size_t nRow) const { return m_vRows[nRow].nColor; }
+		inline uint8_t GetCategory(size_t nRow) const { return m_vRows[nRow].nCategory; }
+		inline uint8_t GetFlags(size_t nRow) const { return m_vRows[nRow].nFlags; }
+
+		size_t GetMemorySize() const;
+	private:
+		struct ORow
+		{
+			uint32_t	nOffset;
+			uint32_t	nLabelLength;
+			uint32_t	nType;
+			uint32_t	nColor;
+			uint16_t	nNameLength;
+			uint8_t		nCategory;
+			uint8_t		nFlags;
+		};
+		std::vector<ORow>		m_vRows;
+		std::vector<char16_t>	m_vChars;
+		ORow					m_rowPending{};	// between BeginRow and EndRow
+	};
+}
+
+#endif // EMF_DISPLAY_MODEL_H
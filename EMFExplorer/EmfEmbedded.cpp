@@ -0,0 +1,109 @@
+#include PCH_FNAME
+#ifdef _ENABLE_GDIPLUS_STRUCT
+
+#include "EmfEmbedded.h"
+
+#pragma push_macro("min")
+#pragma push_macro("max")
+#undef max
+#undef min
+
+namespace emfembed
+{
+
+// Offsets in the record data (past the EMR header)
+constexpr size_t CommentIdentifierOff			= 4;
+constexpr size_t PublicIdentifierOff			= 8;
+// EMR_COMMENT_WINDOWS_METAFILE
+constexpr size_t WinMetafileVersionOff			= 12;
+constexpr size_t WinMetafileChecksumOff			= 16;
+constexpr size_t WinMetafileSizeOff				= 24;
+constexpr size_t WinMetafileDataOff				= 28;
+// EMR_COMMENT_MULTIFORMATS, offData counts from the comment identifier
+constexpr size_t MultiFormatsCountOff			= 28;
+constexpr size_t MultiFormatsFormatsOff			= 32;
+constexpr size_t MultiFormatsFormatSize			= 16;
+
+static inline u32t _ReadU32(const u8t* p)
+{
+	u32t val;
+	memcpy(&val, p, sizeof(val));
+	return val;
+}
+
+static bool _IsPublicComment(const u8t* pData, size_t nDataSize, u32t nPublicId)
+{
+	return pData && nDataSize >= PublicIdentifierOff + sizeof(u32t)
+		&& _ReadU32(pData + CommentIdentifierOff) == EMR_COMMENT_PUBLIC
+		&& _ReadU32(pData + PublicIdentifierOff) == nPublicId;
+}
+
+bool GetEmbeddedPayloads(const u8t* pData, size_t nDataSize, std::vector<OEmbeddedPayload>& vPayloads)
+{
+	vPayloads.clear();
+	if (_IsPublicComment(pData, nDataSize, EMR_COMMENT_WINDOWS_METAFILE))
+	{
+		if (nDataSize < WinMetafileDataOff)
+			return false;
+		size_t nSize = _ReadU32(pData + WinMetafileSizeOff);
+		if (!nSize || nSize > nDataSize - WinMetafileDataOff)
+			return false;
+		u16t nVersion;
+		memcpy(&nVersion, pData + WinMetafileVersionOff, sizeof(nVersion));
+		vPayloads.push_back({ OEmbeddedType::Wmf, nVersion, pData + WinMetafileDataOff, nSize });
+		return true;
+	}
+	if (_IsPublicComment(pData, nDataSize, EMR_COMMENT_MULTIFORMATS))
+	{
+		if (nDataSize < MultiFormatsFormatsOff)
+			return false;
+		size_t nCount = _ReadU32(pData + MultiFormatsCountOff);
+		nCount = std::min(nCount, (nDataSize - MultiFormatsFormatsOff) / MultiFormatsFormatSize);
+		for (size_t ii = 0; ii < nCount; ++ii)
+		{
+			auto pFormat = pData + MultiFormatsFormatsOff + ii * MultiFormatsFormatSize;
+			u32t nSignature = _ReadU32(pFormat);
+			u32t nVersion = _ReadU32(pFormat + 4);
+			size_t nSize = _ReadU32(pFormat + 8);
+			size_t nOffset = CommentIdentifierOff + (size_t)_ReadU32(pFormat + 12);
+			if (!nSize || nOffset > nDataSize || nSize > nDataSize - nOffset)
+				continue;
+			OEmbeddedType nType;
+			if (nSignature == EmbeddedSignatureEmf)
+				nType = OEmbeddedType::Emf;
+			else if (nSignature == EmbeddedSignatureEps)
+				nType = OEmbeddedType::Eps;
+			else
+				continue;
+			vPayloads.push_back({ nType, nVersion, pData + nOffset, nSize });
+		}
+		return !vPayloads.empty();
+	}
+	return false;
+}
+
+bool GetWindowsMetafileChecksum(const u8t* pData, size_t nDataSize, u32t& nChecksum)
+{
+	if (!_IsPublicComment(pData, nDataSize, EMR_COMMENT_WINDOWS_METAFILE) || nDataSize < WinMetafileDataOff)
+		return false;
+	nChecksum = _ReadU32(pData + WinMetafileChecksumOff);
+	return true;
+}
+
+void EmfChecksum::AddRecord(u32t nType, const u8t* pData, size_t nDataSize)
+{
+	m_nSum += nType;
+	m_nSum += (u32t)(nDataSize + 2 * sizeof(u32t));
+	if (!pData)
+		return;
+	size_t nWords = nDataSize / sizeof(u32t);
+	for (size_t ii = 0; ii < nWords; ++ii)
+		m_nSum += _ReadU32(pData + ii * sizeof(u32t));
+}
+
+}
+
+#pragma pop_macro("min")
+#pragma pop_macro("max")
+
+#endif // _ENABLE_GDIPLUS_STRUCT
@@ -0,0 +1,67 @@
+#ifndef EMF_EMBEDDED_H
+#define EMF_EMBEDDED_H
+
+#ifdef _ENABLE_GDIPLUS_STRUCT
+
+#include "EmfPlusStruct.h"
+
+// Metafiles carried by public EMR_GDICOMMENT records:
+// - EMR_COMMENT_WINDOWS_METAFILE holds the WMF an EMF was converted from
+//   (SetWinMetaFileBits), with a checksum telling whether the EMF was
+//   modified since.
+// - EMR_COMMENT_MULTIFORMATS holds the same picture in several formats
+//   (EMF, encapsulated PostScript).
+// The payloads are only located, they point into the record data.
+namespace emfembed
+{
+	using namespace emfplus;
+
+	enum class OEmbeddedType
+	{
+		Wmf,
+		Emf,
+		Eps,
+	};
+
+	enum : u32t {
+		EmbeddedSignatureEmf	= 0x464D4520,	// " EMF"
+		EmbeddedSignatureEps	= 0x46535045,	// "EPSF"
+	};
+
+	struct OEmbeddedPayload
+	{
+		OEmbeddedType	Type;
+		u32t			Version;
+		const u8t*		pData;
+		size_t			nSize;
+	};
+
+	// pData/nDataSize are the record data past the EMR header (as handed
+	// out by the enumeration). Payloads running past the record are
+	// left out.
+	bool GetEmbeddedPayloads(const u8t* pData, size_t nDataSize, std::vector<OEmbeddedPayload>& vPayloads);
+
+	// Checksum field of EMR_COMMENT_WINDOWS_METAFILE
+	bool GetWindowsMetafileChecksum(const u8t* pData, size_t nDataSize, u32t& nChecksum);
+
+	// The checksum of EMR_COMMENT_WINDOWS_METAFILE is chosen so that all the
+	// DWORDs of the EMF (the checksum included) add up to 0. The records are
+	// added as they are read, nothing is kept.
+	class EmfChecksum
+	{
+	public:
+		// nType/nDataSize are the EMR header, pData the rest of the record
+		void AddRecord(u32t nType, const u8t* pData, size_t nDataSize);
+
+		inline u32t GetSum() const { return m_nSum; }
+		inline bool IsValid() const { return m_nSum == 0; }
+
+		inline void Reset() { m_nSum = 0; }
+	private:
+		u32t	m_nSum = 0;
+	};
+}
+
+#endif // _ENABLE_GDIPLUS_STRUCT
+
+#endif // EMF_EMBEDDED_H
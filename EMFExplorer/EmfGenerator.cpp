@@ -0,0 +1,1257 @@
+#include PCH_FNAME
+#ifdef _ENABLE_GDIPLUS_STRUCT
+
+#include "EmfGenerator.h"
+#include "WmfStruct.h"
+
+#pragma push_macro("min")
+#pragma push_macro("max")
+#undef max
+#undef min
+
+namespace emfgen
+{
+
+constexpr u32t PlusHeaderVersion		= 0xDBC01002;
+constexpr u32t PlusCommentFlushSize		= 0x10000;
+// Objects above 64 KB are written in parts, as GDI+ does: every part is
+// flagged as continued (the spec says the last one isn't) and starts with
+// the whole size of the object.
+constexpr size_t MaxObjectSize			= 0x10000 - 16;
+constexpr size_t ObjectPartSize			= 0x8000;
+constexpr u16t PlusFlagContinueObj		= 0x8000;
+constexpr u16t PlusFlagS				= 0x8000;
+constexpr u16t PlusFlagC				= 0x4000;
+constexpr u32t PlusUnitPixel			= 2;
+constexpr u32t GdiStockBlackPen			= 0x80000007;
+constexpr u32t GdiStockWhiteBrush		= 0x80000000;
+constexpr u32t GdiLeftMultiply			= 2;	// MWT_LEFTMULTIPLY
+constexpr u32t GdiSrcCopy				= 0x00CC0020;
+constexpr u32t EnhMetaSignature			= 0x464D4520;	// " EMF"
+
+// splitmix64, the same sequence everywhere (unlike the std distributions)
+class Random
+{
+public:
+	explicit Random(u64t nSeed) : m_nState(nSeed) {}
+public:
+	u64t Next()
+	{
+		u64t z = (m_nState += 0x9E3779B97F4A7C15ull);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+	// In [0, n)
+	inline u32t Below(u32t n) { return n ? (u32t)(Next() % n) : 0; }
+	// In [nLow, nHigh]
+	inline i32t Range(i32t nLow, i32t nHigh) { return nLow + (i32t)Below((u32t)(nHigh - nLow) + 1); }
+	inline bool Chance(u32t nPercent) { return Below(100) < nPercent; }
+	// In [0, 1)
+	inline Float Unit() { return (Float)(Next() >> 40) / (Float)(1 << 24); }
+private:
+	u64t	m_nState;
+};
+
+class Writer
+{
+public:
+	explicit Writer(memory_vector& data) : m_data(data) {}
+public:
+	inline size_t Size() const { return m_data.size(); }
+
+	template <typename ValT>
+	inline void Put(const ValT& val) { PutBytes(&val, sizeof(val)); }
+
+	void PutBytes(const void* pData, size_t nSize)
+	{
+		size_t nPos = m_data.size();
+		m_data.resize(nPos + nSize);
+		if (nSize)
+			memcpy(m_data.data() + nPos, pData, nSize);
+	}
+
+	inline void Pad(size_t nAlign) { m_data.resize((m_data.size() + nAlign - 1) / nAlign * nAlign); }
+
+	template <typename ValT>
+	inline void Set(size_t nOffset, const ValT& val) { memcpy(m_data.data() + nOffset, &val, sizeof(val)); }
+private:
+	memory_vector&	m_data;
+};
+
+struct OPoint
+{
+	i16t	x;
+	i16t	y;
+};
+
+struct ORect
+{
+	i32t	left;
+	i32t	top;
+	i32t	right;
+	i32t	bottom;
+};
+
+enum class OOperation
+{
+	Shapes,
+	Lines,
+	Paths,
+	State,
+	Transforms,
+	Objects,
+};
+
+// Events spread evenly over the operations
+struct OEventSpread
+{
+	size_t	nCount;
+	size_t	nDone = 0;
+
+	// Whether the next event is due before operation nOp of nOps (any
+	// that are left are due at nOp == nOps)
+	inline bool Due(size_t nOp, size_t nOps) const
+	{
+		return nDone < nCount && nDone * nOps / nCount <= nOp;
+	}
+};
+
+static bool _IsValidOptions(const OGenOptions& options)
+{
+	auto& mix = options.Mix;
+	if (!mix.Shapes && !mix.Lines && !mix.Paths && !mix.State && !mix.Transforms && !mix.Objects && options.Operations)
+		return false;
+	// The coordinates are 16-bit in the records used (POLYLINE16, WMF)
+	if (options.Width < 16 || options.Height < 16 || options.Width > INT16_MAX || options.Height > INT16_MAX)
+		return false;
+	return options.ObjectSlots >= 2 && options.ObjectSlots <= 64 && options.MaxPoints >= 2
+		&& options.ImageSize >= 1 && options.ImageSize <= 4096;
+}
+
+class BaseGenerator
+{
+public:
+	BaseGenerator(const OGenOptions& options, memory_vector& data)
+		: m_options(options), m_rnd(options.Seed), m_out(data)
+	{
+	}
+protected:
+	OOperation PickOperation()
+	{
+		auto& mix = m_options.Mix;
+		// Nothing to nest without depth
+		u32t nState = m_options.MaxDepth ? mix.State : 0;
+		const u32t aWeights[] = { mix.Shapes, mix.Lines, mix.Paths, nState, mix.Transforms, mix.Objects };
+		u32t nTotal = 0;
+		for (auto nWeight : aWeights)
+			nTotal += nWeight;
+		if (!nTotal)
+			return OOperation::Objects;
+		u32t nPick = m_rnd.Below(nTotal);
+		for (size_t ii = 0; ii < _countof(aWeights); ++ii)
+		{
+			if (nPick < aWeights[ii])
+				return (OOperation)ii;
+			nPick -= aWeights[ii];
+		}
+		return OOperation::Objects;
+	}
+
+	ORect RandomRect()
+	{
+		i32t cx = m_options.Width, cy = m_options.Height;
+		ORect rc;
+		rc.left = m_rnd.Range(0, cx - 2);
+		rc.top = m_rnd.Range(0, cy - 2);
+		rc.right = m_rnd.Range(rc.left + 1, std::min(cx - 1, rc.left + cx / 4));
+		rc.bottom = m_rnd.Range(rc.top + 1, std::min(cy - 1, rc.top + cy / 4));
+		return rc;
+	}
+
+	void RandomPoints(std::vector<OPoint>& vPoints, size_t nCount)
+	{
+		vPoints.resize(nCount);
+		// Around a center, so that the figures look like figures
+		i32t cx = m_options.Width, cy = m_options.Height;
+		i32t x0 = m_rnd.Range(0, cx - 1), y0 = m_rnd.Range(0, cy - 1);
+		i32t nRadius = std::max(4, std::min(cx, cy) / 8);
+		for (auto& pt : vPoints)
+		{
+			pt.x = (i16t)std::clamp(x0 + m_rnd.Range(-nRadius, nRadius), 0, cx - 1);
+			pt.y = (i16t)std::clamp(y0 + m_rnd.Range(-nRadius, nRadius), 0, cy - 1);
+		}
+	}
+
+	static ORect GetBounds(const std::vector<OPoint>& vPoints)
+	{
+		ORect rc = { INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN };
+		for (auto& pt : vPoints)
+		{
+			rc.left = std::min(rc.left, (i32t)pt.x);
+			rc.top = std::min(rc.top, (i32t)pt.y);
+			rc.right = std::max(rc.right, (i32t)pt.x);
+			rc.bottom = std::max(rc.bottom, (i32t)pt.y);
+		}
+		return rc;
+	}
+
+	inline u32t RandomColor() { return (u32t)m_rnd.Next() & 0x00FFFFFF; }
+
+	// 32bpp, top-down rows
+	void RandomPixels(memory_vector& vPixels, u32t nSize)
+	{
+		vPixels.resize((size_t)nSize * nSize * 4);
+		u32t cr = RandomColor();
+		u8t r = (u8t)cr, g = (u8t)(cr >> 8), b = (u8t)(cr >> 16);
+		auto p = vPixels.data();
+		for (u32t y = 0; y < nSize; ++y)
+		{
+			for (u32t x = 0; x < nSize; ++x)
+			{
+				*p++ = (u8t)(b + x * 255 / nSize);
+				*p++ = (u8t)(g + y * 255 / nSize);
+				*p++ = r;
+				*p++ = 0xFF;
+			}
+		}
+	}
+protected:
+	const OGenOptions&	m_options;
+	Random				m_rnd;
+	Writer				m_out;
+};
+
+//////////////////////////////
+// EMF, EMF+
+//////////////////////////////
+
+class EmfGenerator : public BaseGenerator
+{
+public:
+	EmfGenerator(const OGenOptions& options, memory_vector& data)
+		: BaseGenerator(options, data), m_plus(m_vPlus)
+	{
+		m_bGdi = options.Format != OFormat::EmfPlusOnly;
+		m_bPlus = options.Format != OFormat::Emf;
+	}
+public:
+	void Generate();
+private:
+	enum class OSlot : u8t
+	{
+		Free,
+		Pen,
+		Brush,
+		Path,
+		Image,
+	};
+
+	// GDI records
+	size_t BeginRecord(u32t nType);
+	void EndRecord(size_t nStart);
+	void WriteRecordU32(u32t nType, u32t nVal);
+	void WriteRecordRect(u32t nType, const ORect& rc);
+	void WriteRecordPoints16(u32t nType, const std::vector<OPoint>& vPoints, size_t nFirst = 0);
+
+	// EMF+ records, gathered in EMR_COMMENT_EMFPLUS comments
+	size_t BeginPlusRecord(u16t nType, u16t nFlags);
+	void EndPlusRecord(size_t nStart);
+	void FlushPlusRecords();
+	void WritePlusObject(OObjType nType, u8t nID, const memory_vector& vObj);
+
+	void WriteHeader();
+	void WriteEOF();
+
+	void CreateGdiObject(u32t nSlot, OSlot nKind);
+	void CreatePlusObject(u8t nID, OSlot nKind);
+	u8t GetPlusSlot(OSlot nKind);
+	u8t GetPlusSlotToReplace();
+
+	void PutPlusFill(u16t& nFlags);
+	void PutPlusRect(const ORect& rc, bool bCompressed);
+	void PutPlusPoints(const std::vector<OPoint>& vPoints, bool bCompressed);
+
+	void WriteShape();
+	void WriteLines();
+	void WritePath();
+	void WriteState();
+	void PopState();
+	void WriteTransform();
+	void WriteObject();
+	void WriteContinuedObject();
+	void WriteImage();
+	void WriteMetafile();
+	void WritePlusDrawImage(u8t nID, const ORect& rcDest, Float cxSrc, Float cySrc);
+private:
+	bool					m_bGdi;
+	bool					m_bPlus;
+	u32t					m_nRecords = 0;
+
+	memory_vector			m_vPlus;
+	Writer					m_plus;
+
+	// GDI slots from 1, the current pen and brush
+	std::vector<OSlot>		m_vGdiSlots;
+	u32t					m_nGdiPen = 0;
+	u32t					m_nGdiBrush = 0;
+
+	std::vector<OSlot>		m_vPlusSlots;
+
+	struct PlusState
+	{
+		bool	bContainer;
+		u32t	nStackIndex;
+	};
+	std::vector<PlusState>	m_vPlusStates;
+	u32t					m_nNextStackIndex = 0;
+	u32t					m_nDepth = 0;
+};
+
+size_t EmfGenerator::BeginRecord(u32t nType)
+{
+	FlushPlusRecords();
+	size_t nStart = m_out.Size();
+	m_out.Put(nType);
+	m_out.Put((u32t)0);
+	return nStart;
+}
+
+void EmfGenerator::EndRecord(size_t nStart)
+{
+	m_out.Pad(4);
+	m_out.Set(nStart + 4, (u32t)(m_out.Size() - nStart));
+	++m_nRecords;
+}
+
+void EmfGenerator::WriteRecordU32(u32t nType, u32t nVal)
+{
+	auto nStart = BeginRecord(nType);
+	m_out.Put(nVal);
+	EndRecord(nStart);
+}
+
+void EmfGenerator::WriteRecordRect(u32t nType, const ORect& rc)
+{
+	auto nStart = BeginRecord(nType);
+	m_out.Put(rc);
+	EndRecord(nStart);
+}
+
+void EmfGenerator::WriteRecordPoints16(u32t nType, const std::vector<OPoint>& vPoints, size_t nFirst)
+{
+	auto nStart = BeginRecord(nType);
+	m_out.Put(GetBounds(vPoints));
+	m_out.Put((u32t)(vPoints.size() - nFirst));
+	m_out.PutBytes(vPoints.data() + nFirst, (vPoints.size() - nFirst) * sizeof(OPoint));
+	EndRecord(nStart);
+}
+
+size_t EmfGenerator::BeginPlusRecord(u16t nType, u16t nFlags)
+{
+	size_t nStart = m_plus.Size();
+	m_plus.Put(nType);
+	m_plus.Put(nFlags);
+	m_plus.Put((u32t)0);	// Size
+	m_plus.Put((u32t)0);	// DataSize
+	return nStart;
+}
+
+void EmfGenerator::EndPlusRecord(size_t nStart)
+{
+	m_plus.Pad(4);
+	auto nSize = (u32t)(m_plus.Size() - nStart);
+	m_plus.Set(nStart + 4, nSize);
+	m_plus.Set(nStart + 8, nSize - (u32t)sizeof(OEmfPlusRec));
+	if (m_plus.Size() >= PlusCommentFlushSize)
+		FlushPlusRecords();
+}
+
+void EmfGenerator::FlushPlusRecords()
+{
+	if (m_vPlus.empty())
+		return;
+	size_t nStart = m_out.Size();
+	m_out.Put((u32t)EmfRecordTypeGdiComment);
+	m_out.Put((u32t)0);
+	m_out.Put((u32t)(sizeof(u32t) + m_vPlus.size()));
+	m_out.Put((u32t)EMR_COMMENT_EMFPLUS);
+	m_out.PutBytes(m_vPlus.data(), m_vPlus.size());
+	m_vPlus.clear();
+	EndRecord(nStart);
+}
+
+void EmfGenerator::WritePlusObject(OObjType nType, u8t nID, const memory_vector& vObj)
+{
+	u16t nFlags = (u16t)(((u16t)nType << 8) | nID);
+	if (vObj.size() <= MaxObjectSize)
+	{
+		auto nStart = BeginPlusRecord(EmfPlusRecordTypeObject, nFlags);
+		m_plus.PutBytes(vObj.data(), vObj.size());
+		EndPlusRecord(nStart);
+		return;
+	}
+	for (size_t nOff = 0; nOff < vObj.size(); nOff += ObjectPartSize)
+	{
+		auto nStart = BeginPlusRecord(EmfPlusRecordTypeObject, nFlags | PlusFlagContinueObj);
+		m_plus.Put((u32t)vObj.size());
+		m_plus.PutBytes(vObj.data() + nOff, std::min(ObjectPartSize, vObj.size() - nOff));
+		EndPlusRecord(nStart);
+	}
+}
+
+void EmfGenerator::WriteHeader()
+{
+	i32t cx = m_options.Width, cy = m_options.Height;
+	// A 96 DPI 1920x1080 reference device
+	const SIZEL szDevice = { 1920, 1080 }, szMillimeters = { 508, 286 };
+	ORect rcBounds = { 0, 0, cx - 1, cy - 1 };
+	ORect rcFrame = { 0, 0, cx * 2540 / 96, cy * 2540 / 96 };
+	auto nStart = BeginRecord(EmfRecordTypeHeader);
+	m_out.Put(rcBounds);
+	m_out.Put(rcFrame);
+	m_out.Put(EnhMetaSignature);
+	m_out.Put((u32t)0x10000);	// nVersion
+	m_out.Put((u32t)0);			// nBytes, set at the end
+	m_out.Put((u32t)0);			// nRecords, same
+	m_out.Put((u16t)0);			// nHandles, same
+	m_out.Put((u16t)0);
+	m_out.Put((u32t)0);			// nDescription
+	m_out.Put((u32t)0);			// offDescription
+	m_out.Put((u32t)0);			// nPalEntries
+	m_out.Put(szDevice);
+	m_out.Put(szMillimeters);
+	m_out.Put((u32t)0);			// cbPixelFormat
+	m_out.Put((u32t)0);			// offPixelFormat
+	m_out.Put((u32t)0);			// bOpenGL
+	m_out.Put(SIZEL{ szMillimeters.cx * 1000, szMillimeters.cy * 1000 });
+	EndRecord(nStart);
+
+	if (!m_bPlus)
+		return;
+	nStart = BeginPlusRecord(EmfPlusRecordTypeHeader, m_bGdi ? OEmfPlusHeader::FlagD : 0);
+	m_plus.Put(OEmfPlusHeader{ PlusHeaderVersion, OEmfPlusHeader::EmfPlusFlagV, 96, 96 });
+	EndPlusRecord(nStart);
+	// Alone in its comment, as GDI+ writes it
+	FlushPlusRecords();
+}
+
+void EmfGenerator::WriteEOF()
+{
+	if (m_bPlus)
+	{
+		auto nStart = BeginPlusRecord(EmfPlusRecordTypeEndOfFile, 0);
+		EndPlusRecord(nStart);
+	}
+	auto nStart = BeginRecord(EmfRecordTypeEOF);
+	m_out.Put((u32t)0);		// nPalEntries
+	m_out.Put((u32t)16);	// offPalEntries
+	m_out.Put((u32t)20);	// nSizeLast
+	EndRecord(nStart);
+
+	// ENHMETAHEADER nBytes, nRecords, nHandles
+	m_out.Set(48, (u32t)m_out.Size());
+	m_out.Set(52, m_nRecords);
+	m_out.Set(56, (u16t)(m_bGdi ? m_vGdiSlots.size() : 1));
+}
+
+void EmfGenerator::CreateGdiObject(u32t nSlot, OSlot nKind)
+{
+	u32t& nSelected = nKind == OSlot::Pen ? m_nGdiPen : m_nGdiBrush;
+	if (m_vGdiSlots[nSlot] != OSlot::Free)
+	{
+		// Never delete what's selected
+		if (nSlot == m_nGdiPen)
+		{
+			WriteRecordU32(EmfRecordTypeSelectObject, GdiStockBlackPen);
+			m_nGdiPen = 0;
+		}
+		else if (nSlot == m_nGdiBrush)
+		{
+			WriteRecordU32(EmfRecordTypeSelectObject, GdiStockWhiteBrush);
+			m_nGdiBrush = 0;
+		}
+		WriteRecordU32(EmfRecordTypeDeleteObject, nSlot);
+	}
+	if (nKind == OSlot::Pen)
+	{
+		auto nStart = BeginRecord(EmfRecordTypeCreatePen);
+		m_out.Put(nSlot);
+		m_out.Put((u32t)PS_SOLID);
+		m_out.Put(POINTL{ m_rnd.Range(0, 4), 0 });
+		m_out.Put(RandomColor());
+		EndRecord(nStart);
+	}
+	else
+	{
+		auto nStart = BeginRecord(EmfRecordTypeCreateBrushIndirect);
+		m_out.Put(nSlot);
+		m_out.Put((u32t)BS_SOLID);
+		m_out.Put(RandomColor());
+		m_out.Put((u32t)0);		// lbHatch
+		EndRecord(nStart);
+	}
+	m_vGdiSlots[nSlot] = nKind;
+	WriteRecordU32(EmfRecordTypeSelectObject, nSlot);
+	nSelected = nSlot;
+}
+
+void EmfGenerator::CreatePlusObject(u8t nID, OSlot nKind)
+{
+	memory_vector vObj;
+	Writer obj(vObj);
+	obj.Put((u32t)PlusHeaderVersion);
+	if (nKind == OSlot::Pen)
+	{
+		obj.Put((u32t)0);		// Type
+		obj.Put((u32t)0);		// PenDataFlags
+		obj.Put(PlusUnitPixel);
+		obj.Put((Float)m_rnd.Range(1, 4));
+		// BrushObject
+		obj.Put((u32t)PlusHeaderVersion);
+	}
+	obj.Put((u32t)OBrushType::SolidColor);
+	obj.Put(0xFF000000 | RandomColor());
+	m_vPlusSlots[nID] = nKind;
+	WritePlusObject(nKind == OSlot::Pen ? OObjType::Pen : OObjType::Brush, nID, vObj);
+}
+
+u8t EmfGenerator::GetPlusSlot(OSlot nKind)
+{
+	// From a random place, there's always one pen and one brush
+	u32t nStart = m_rnd.Below((u32t)m_vPlusSlots.size());
+	for (u32t ii = 0; ii < m_vPlusSlots.size(); ++ii)
+	{
+		u32t nSlot = (nStart + ii) % m_vPlusSlots.size();
+		if (m_vPlusSlots[nSlot] == nKind)
+			return (u8t)nSlot;
+	}
+	ASSERT(0);
+	return 0;
+}
+
+u8t EmfGenerator::GetPlusSlotToReplace()
+{
+	for (;;)
+	{
+		auto nSlot = (u8t)m_rnd.Below((u32t)m_vPlusSlots.size());
+		auto nKind = m_vPlusSlots[nSlot];
+		if (nKind != OSlot::Pen && nKind != OSlot::Brush)
+			return nSlot;
+		// Keeping the last of its kind
+		if (std::count(m_vPlusSlots.begin(), m_vPlusSlots.end(), nKind) > 1)
+			return nSlot;
+	}
+}
+
+void EmfGenerator::PutPlusFill(u16t& nFlags)
+{
+	if (m_rnd.Chance(50))
+	{
+		nFlags |= PlusFlagS;
+		m_plus.Put(0xFF000000 | RandomColor());
+	}
+	else
+		m_plus.Put((u32t)GetPlusSlot(OSlot::Brush));
+}
+
+void EmfGenerator::PutPlusRect(const ORect& rc, bool bCompressed)
+{
+	if (bCompressed)
+	{
+		m_plus.Put(OEmfPlusRect{ (i16t)rc.left, (i16t)rc.top, (i16t)(rc.right - rc.left), (i16t)(rc.bottom - rc.top) });
+		return;
+	}
+	m_plus.Put(OEmfPlusRectF{ (Float)rc.left, (Float)rc.top, (Float)(rc.right - rc.left), (Float)(rc.bottom - rc.top) });
+}
+
+void EmfGenerator::PutPlusPoints(const std::vector<OPoint>& vPoints, bool bCompressed)
+{
+	m_plus.Put((u32t)vPoints.size());
+	for (auto& pt : vPoints)
+	{
+		if (bCompressed)
+			m_plus.Put(OEmfPlusPoint{ pt.x, pt.y });
+		else
+			m_plus.Put(OEmfPlusPointF{ (Float)pt.x, (Float)pt.y });
+	}
+}
+
+void EmfGenerator::WriteShape()
+{
+	auto rc = RandomRect();
+	bool bEllipse = m_rnd.Chance(50);
+	if (m_bPlus)
+	{
+		bool bCompressed = m_rnd.Chance(50);
+		u16t nFlags = bCompressed ? PlusFlagC : 0;
+		if (m_rnd.Chance(50))
+		{
+			auto nStart = BeginPlusRecord(bEllipse ? EmfPlusRecordTypeFillEllipse : EmfPlusRecordTypeFillRects, 0);
+			PutPlusFill(nFlags);
+			if (!bEllipse)
+				m_plus.Put((u32t)1);
+			PutPlusRect(rc, bCompressed);
+			m_plus.Set(nStart + 2, nFlags);
+			EndPlusRecord(nStart);
+		}
+		else
+		{
+			nFlags |= GetPlusSlot(OSlot::Pen);
+			auto nStart = BeginPlusRecord(bEllipse ? EmfPlusRecordTypeDrawEllipse : EmfPlusRecordTypeDrawRects, nFlags);
+			if (!bEllipse)
+				m_plus.Put((u32t)1);
+			PutPlusRect(rc, bCompressed);
+			EndPlusRecord(nStart);
+		}
+	}
+	if (m_bGdi)
+	{
+		// RECTANGLE and ELLIPSE exclude the bottom right
+		WriteRecordRect(bEllipse ? EmfRecordTypeEllipse : EmfRecordTypeRectangle,
+			ORect{ rc.left, rc.top, rc.right + 1, rc.bottom + 1 });
+	}
+}
+
+void EmfGenerator::WriteLines()
+{
+	std::vector<OPoint> vPoints;
+	RandomPoints(vPoints, m_rnd.Range(2, m_options.MaxPoints));
+	bool bPolygon = vPoints.size() >= 3 && m_rnd.Chance(50);
+	if (m_bPlus)
+	{
+		bool bCompressed = m_rnd.Chance(50);
+		u16t nFlags = bCompressed ? PlusFlagC : 0;
+		if (bPolygon)
+		{
+			auto nStart = BeginPlusRecord(EmfPlusRecordTypeFillPolygon, 0);
+			PutPlusFill(nFlags);
+			PutPlusPoints(vPoints, bCompressed);
+			m_plus.Set(nStart + 2, nFlags);
+			EndPlusRecord(nStart);
+		}
+		else
+		{
+			nFlags |= GetPlusSlot(OSlot::Pen);
+			auto nStart = BeginPlusRecord(EmfPlusRecordTypeDrawLines, nFlags);
+			PutPlusPoints(vPoints, bCompressed);
+			EndPlusRecord(nStart);
+		}
+	}
+	if (m_bGdi)
+		WriteRecordPoints16(bPolygon ? EmfRecordTypePolygon16 : EmfRecordTypePolyline16, vPoints);
+}
+
+void EmfGenerator::WritePath()
+{
+	// One closed figure, of lines or beziers
+	bool bBezier = m_options.MaxPoints >= 4 && m_rnd.Chance(50);
+	size_t nCount = bBezier ? 1 + 3 * (size_t)m_rnd.Range(1, (m_options.MaxPoints - 1) / 3)
+		: (size_t)m_rnd.Range(2, m_options.MaxPoints);
+	std::vector<OPoint> vPoints;
+	RandomPoints(vPoints, nCount);
+	int nPaint = m_rnd.Range(0, 2);		// fill, stroke, both
+	if (m_bPlus)
+	{
+		auto nID = GetPlusSlotToReplace();
+		memory_vector vObj;
+		Writer obj(vObj);
+		obj.Put((u32t)PlusHeaderVersion);
+		obj.Put((u32t)nCount);
+		obj.Put((u32t)0);		// PathPointFlags: float points
+		for (auto& pt : vPoints)
+			obj.Put(OEmfPlusPointF{ (Float)pt.x, (Float)pt.y });
+		auto nType = bBezier ? OEmfPlusPath::OPathPointType::Bezier : OEmfPlusPath::OPathPointType::Line;
+		obj.Put((u8t)OEmfPlusPath::OPathPointType::Start);
+		for (size_t ii = 1; ii < nCount; ++ii)
+		{
+			u8t nPointType = (u8t)nType;
+			if (ii + 1 == nCount)
+				nPointType |= (u8t)OEmfPlusPath::OPathPointType::CloseSubpath;
+			obj.Put(nPointType);
+		}
+		obj.Pad(4);
+		m_vPlusSlots[nID] = OSlot::Path;
+		WritePlusObject(OObjType::Path, nID, vObj);
+		if (nPaint != 1)
+		{
+			u16t nFlags = nID;
+			auto nStart = BeginPlusRecord(EmfPlusRecordTypeFillPath, 0);
+			PutPlusFill(nFlags);
+			m_plus.Set(nStart + 2, nFlags);
+			EndPlusRecord(nStart);
+		}
+		if (nPaint != 0)
+		{
+			auto nStart = BeginPlusRecord(EmfPlusRecordTypeDrawPath, nID);
+			m_plus.Put((u32t)GetPlusSlot(OSlot::Pen));
+			EndPlusRecord(nStart);
+		}
+	}
+	if (m_bGdi)
+	{
+		auto nStart = BeginRecord(EmfRecordTypeBeginPath);
+		EndRecord(nStart);
+		nStart = BeginRecord(EmfRecordTypeMoveToEx);
+		m_out.Put(POINTL{ vPoints[0].x, vPoints[0].y });
+		EndRecord(nStart);
+		WriteRecordPoints16(bBezier ? EmfRecordTypePolyBezierTo16 : EmfRecordTypePolylineTo16, vPoints, 1);
+		nStart = BeginRecord(EmfRecordTypeCloseFigure);
+		EndRecord(nStart);
+		nStart = BeginRecord(EmfRecordTypeEndPath);
+		EndRecord(nStart);
+		const u32t aPaint[] = { EmfRecordTypeFillPath, EmfRecordTypeStrokePath, EmfRecordTypeStrokeAndFillPath };
+		WriteRecordRect(aPaint[nPaint], GetBounds(vPoints));
+	}
+}
+
+void EmfGenerator::WriteState()
+{
+	if (m_nDepth && (m_nDepth >= m_options.MaxDepth || m_rnd.Chance(50)))
+	{
+		PopState();
+		return;
+	}
+	++m_nDepth;
+	if (m_bPlus)
+	{
+		PlusState state{ m_rnd.Chance(50), m_nNextStackIndex++ };
+		auto nStart = BeginPlusRecord(state.bContainer ? EmfPlusRecordTypeBeginContainerNoParams : EmfPlusRecordTypeSave, 0);
+		m_plus.Put(state.nStackIndex);
+		EndPlusRecord(nStart);
+		m_vPlusStates.push_back(state);
+	}
+	if (m_bGdi)
+	{
+		auto nStart = BeginRecord(EmfRecordTypeSaveDC);
+		EndRecord(nStart);
+	}
+}
+
+void EmfGenerator::PopState()
+{
+	ASSERT(m_nDepth);
+	--m_nDepth;
+	if (m_bPlus)
+	{
+		auto state = m_vPlusStates.back();
+		m_vPlusStates.pop_back();
+		auto nStart = BeginPlusRecord(state.bContainer ? EmfPlusRecordTypeEndContainer : EmfPlusRecordTypeRestore, 0);
+		m_plus.Put(state.nStackIndex);
+		EndPlusRecord(nStart);
+	}
+	if (m_bGdi)
+		WriteRecordU32(EmfRecordTypeRestoreDC, (u32t)-1);
+}
+
+void EmfGenerator::WriteTransform()
+{
+	// Small steps, the saves and the resets keep the picture in place
+	Float dx = (Float)m_rnd.Range(-4, 4), dy = (Float)m_rnd.Range(-4, 4);
+	bool bReset = m_rnd.Chance(25);
+	if (m_bPlus)
+	{
+		if (bReset)
+		{
+			auto nStart = BeginPlusRecord(EmfPlusRecordTypeSetWorldTransform, 0);
+			const Float aMatrix[] = { 1.f, 0.f, 0.f, 1.f, dx, dy };
+			m_plus.Put(aMatrix);
+			EndPlusRecord(nStart);
+		}
+		else
+		{
+			switch (m_rnd.Below(3))
+			{
+			case 0:
+				{
+					auto nStart = BeginPlusRecord(EmfPlusRecordTypeTranslateWorldTransform, 0);
+					m_plus.Put(dx);
+					m_plus.Put(dy);
+					EndPlusRecord(nStart);
+				}
+				break;
+			case 1:
+				{
+					auto nStart = BeginPlusRecord(EmfPlusRecordTypeScaleWorldTransform, 0);
+					m_plus.Put(0.95f + m_rnd.Unit() * 0.1f);
+					m_plus.Put(0.95f + m_rnd.Unit() * 0.1f);
+					EndPlusRecord(nStart);
+				}
+				break;
+			default:
+				{
+					auto nStart = BeginPlusRecord(EmfPlusRecordTypeRotateWorldTransform, 0);
+					m_plus.Put(m_rnd.Unit() * 10.f - 5.f);
+					EndPlusRecord(nStart);
+				}
+				break;
+			}
+		}
+	}
+	if (m_bGdi)
+	{
+		auto nStart = BeginRecord(bReset ? EmfRecordTypeSetWorldTransform : EmfRecordTypeModifyWorldTransform);
+		m_out.Put(XFORM{ 1.f, 0.f, 0.f, 1.f, dx, dy });
+		if (!bReset)
+			m_out.Put(GdiLeftMultiply);
+		EndRecord(nStart);
+	}
+}
+
+void EmfGenerator::WriteObject()
+{
+	auto nKind = m_rnd.Chance(50) ? OSlot::Pen : OSlot::Brush;
+	if (m_bPlus)
+		CreatePlusObject(GetPlusSlotToReplace(), nKind);
+	if (m_bGdi)
+		CreateGdiObject((u32t)m_rnd.Range(1, (i32t)m_vGdiSlots.size() - 1), nKind);
+}
+
+void EmfGenerator::WriteContinuedObject()
+{
+	// EMF+ only, there's no such thing in GDI
+	if (!m_bPlus)
+		return;
+	// Float points and their types
+	size_t nCount = std::max((size_t)2, (m_options.ContinuedObjectSize - 12) / (sizeof(OEmfPlusPointF) + 1));
+	auto nID = GetPlusSlotToReplace();
+	memory_vector vObj;
+	Writer obj(vObj);
+	obj.Put((u32t)PlusHeaderVersion);
+	obj.Put((u32t)nCount);
+	obj.Put((u32t)0);
+	i32t cx = m_options.Width, cy = m_options.Height;
+	for (size_t ii = 0; ii < nCount; ++ii)
+		obj.Put(OEmfPlusPointF{ m_rnd.Unit() * cx, m_rnd.Unit() * cy });
+	obj.Put((u8t)OEmfPlusPath::OPathPointType::Start);
+	for (size_t ii = 1; ii < nCount; ++ii)
+		obj.Put((u8t)OEmfPlusPath::OPathPointType::Line);
+	obj.Pad(4);
+	m_vPlusSlots[nID] = OSlot::Path;
+	WritePlusObject(OObjType::Path, nID, vObj);
+	auto nStart = BeginPlusRecord(EmfPlusRecordTypeDrawPath, nID);
+	m_plus.Put((u32t)GetPlusSlot(OSlot::Pen));
+	EndPlusRecord(nStart);
+}
+
+void EmfGenerator::WritePlusDrawImage(u8t nID, const ORect& rcDest, Float cxSrc, Float cySrc)
+{
+	auto nStart = BeginPlusRecord(EmfPlusRecordTypeDrawImage, nID);
+	m_plus.Put((u32t)InvalidObjectID);	// ImageAttributesID
+	m_plus.Put(PlusUnitPixel);
+	m_plus.Put(OEmfPlusRectF{ 0.f, 0.f, cxSrc, cySrc });
+	PutPlusRect(rcDest, false);
+	EndPlusRecord(nStart);
+}
+
+void EmfGenerator::WriteImage()
+{
+	u32t nSize = m_options.ImageSize;
+	memory_vector vPixels;
+	RandomPixels(vPixels, nSize);
+	auto rc = RandomRect();
+	if (m_bPlus)
+	{
+		auto nID = GetPlusSlotToReplace();
+		memory_vector vObj;
+		Writer obj(vObj);
+		obj.Put((u32t)PlusHeaderVersion);
+		obj.Put((u32t)OImageDataType::Bitmap);
+		obj.Put((i32t)nSize);
+		obj.Put((i32t)nSize);
+		obj.Put((i32t)nSize * 4);	// Stride
+		obj.Put((u32t)OPixelFormat::Format32bppARGB);
+		obj.Put((u32t)OBitmapDataType::Pixel);
+		obj.PutBytes(vPixels.data(), vPixels.size());
+		m_vPlusSlots[nID] = OSlot::Image;
+		WritePlusObject(OObjType::Image, nID, vObj);
+		WritePlusDrawImage(nID, rc, (Float)nSize, (Float)nSize);
+	}
+	if (m_bGdi)
+	{
+		auto nStart = BeginRecord(EmfRecordTypeStretchDIBits);
+		m_out.Put(rc);
+		m_out.Put(rc.left);			// xDest
+		m_out.Put(rc.top);			// yDest
+		m_out.Put((i32t)0);			// xSrc
+		m_out.Put((i32t)0);			// ySrc
+		m_out.Put((i32t)nSize);		// cxSrc
+		m_out.Put((i32t)nSize);		// cySrc
+		m_out.Put((u32t)80);		// offBmiSrc
+		m_out.Put((u32t)40);		// cbBmiSrc
+		m_out.Put((u32t)120);		// offBitsSrc
+		m_out.Put((u32t)vPixels.size());
+		m_out.Put((u32t)DIB_RGB_COLORS);
+		m_out.Put(GdiSrcCopy);
+		m_out.Put(rc.right - rc.left + 1);	// cxDest
+		m_out.Put(rc.bottom - rc.top + 1);	// cyDest
+		// BITMAPINFOHEADER, a negative height for top-down rows
+		m_out.Put((u32t)40);
+		m_out.Put((i32t)nSize);
+		m_out.Put(-(i32t)nSize);
+		m_out.Put((u16t)1);			// biPlanes
+		m_out.Put((u16t)32);		// biBitCount
+		m_out.Put((u32t)BI_RGB);
+		m_out.Put((u32t)vPixels.size());
+		m_out.Put((i32t)3780);		// 96 DPI
+		m_out.Put((i32t)3780);
+		m_out.Put((u32t)0);			// biClrUsed
+		m_out.Put((u32t)0);			// biClrImportant
+		m_out.PutBytes(vPixels.data(), vPixels.size());
+		EndRecord(nStart);
+	}
+}
+
+void EmfGenerator::WriteMetafile()
+{
+	OGenOptions nested;
+	nested.Format = OFormat::Emf;
+	nested.Seed = m_rnd.Next();
+	nested.Operations = 32;
+	nested.Width = 256;
+	nested.Height = 256;
+	memory_vector vEmf;
+	VERIFY(GenerateMetafile(nested, vEmf));
+	auto rc = RandomRect();
+	if (m_bPlus)
+	{
+		auto nID = GetPlusSlotToReplace();
+		memory_vector vObj;
+		Writer obj(vObj);
+		obj.Put((u32t)PlusHeaderVersion);
+		obj.Put((u32t)OImageDataType::Metafile);
+		obj.Put((u32t)OMetafileDataType::Emf);
+		obj.Put((u32t)vEmf.size());
+		obj.PutBytes(vEmf.data(), vEmf.size());
+		m_vPlusSlots[nID] = OSlot::Image;
+		WritePlusObject(OObjType::Image, nID, vObj);
+		WritePlusDrawImage(nID, rc, (Float)nested.Width, (Float)nested.Height);
+	}
+	if (m_bGdi)
+	{
+		// EMR_COMMENT_MULTIFORMATS with the EMF as its only format
+		constexpr u32t nDataOffset = 44;	// from the comment identifier
+		auto nStart = BeginRecord(EmfRecordTypeGdiComment);
+		m_out.Put((u32t)(nDataOffset + vEmf.size()));
+		m_out.Put((u32t)EMR_COMMENT_PUBLIC);
+		m_out.Put((u32t)EMR_COMMENT_MULTIFORMATS);
+		m_out.Put(rc);
+		m_out.Put((u32t)1);			// CountFormats
+		m_out.Put(EnhMetaSignature);
+		m_out.Put((u32t)0x10000);	// nVersion
+		m_out.Put((u32t)vEmf.size());
+		m_out.Put(nDataOffset);
+		m_out.PutBytes(vEmf.data(), vEmf.size());
+		EndRecord(nStart);
+	}
+}
+
+void EmfGenerator::Generate()
+{
+	WriteHeader();
+	if (m_bGdi)
+	{
+		m_vGdiSlots.assign(m_options.ObjectSlots + 1, OSlot::Free);
+		CreateGdiObject(1, OSlot::Pen);
+		CreateGdiObject(2, OSlot::Brush);
+	}
+	if (m_bPlus)
+	{
+		m_vPlusSlots.assign(m_options.ObjectSlots, OSlot::Free);
+		CreatePlusObject(0, OSlot::Pen);
+		CreatePlusObject(1, OSlot::Brush);
+	}
+	size_t nOps = m_options.Operations;
+	OEventSpread continued{ m_options.ContinuedObjects }, images{ m_options.Images }, metafiles{ m_options.Metafiles };
+	for (size_t nOp = 0; nOp <= nOps; ++nOp)
+	{
+		for (; continued.Due(nOp, nOps); ++continued.nDone)
+			WriteContinuedObject();
+		for (; images.Due(nOp, nOps); ++images.nDone)
+			WriteImage();
+		for (; metafiles.Due(nOp, nOps); ++metafiles.nDone)
+			WriteMetafile();
+		if (nOp == nOps)
+			break;
+		switch (PickOperation())
+		{
+		case OOperation::Shapes:
+			WriteShape();
+			break;
+		case OOperation::Lines:
+			WriteLines();
+			break;
+		case OOperation::Paths:
+			WritePath();
+			break;
+		case OOperation::State:
+			WriteState();
+			break;
+		case OOperation::Transforms:
+			WriteTransform();
+			break;
+		case OOperation::Objects:
+			WriteObject();
+			break;
+		}
+	}
+	while (m_nDepth)
+		PopState();
+	WriteEOF();
+}
+
+//////////////////////////////
+// WMF
+//////////////////////////////
+
+class WmfGenerator : public BaseGenerator
+{
+public:
+	using BaseGenerator::BaseGenerator;
+public:
+	void Generate();
+private:
+	size_t BeginRecord(u32t nType);
+	void EndRecord(size_t nStart);
+	void WriteRecordU16(u32t nType, u16t nVal);
+	void WriteRecordRect(u32t nType, const ORect& rc);
+
+	void CreateObject(bool bPen);
+	void WriteShape();
+	void WriteLines();
+	void WritePolyPolygon();
+	void WriteState();
+	void WriteTransform();
+	void WriteImage();
+private:
+	size_t				m_nHeaderOffset = 0;
+	u32t				m_nMaxRecord = 0;
+	// The lowest free slot is taken by a new object
+	std::vector<bool>	m_vSlots;
+	int					m_nPen = -1;
+	int					m_nBrush = -1;
+	u32t				m_nDepth = 0;
+};
+
+size_t WmfGenerator::BeginRecord(u32t nType)
+{
+	size_t nStart = m_out.Size();
+	m_out.Put((u32t)0);
+	m_out.Put((u16t)nType);
+	return nStart;
+}
+
+void WmfGenerator::EndRecord(size_t nStart)
+{
+	m_out.Pad(2);
+	auto nWords = (u32t)((m_out.Size() - nStart) / 2);
+	m_out.Set(nStart, nWords);
+	m_nMaxRecord = std::max(m_nMaxRecord, nWords);
+}
+
+void WmfGenerator::WriteRecordU16(u32t nType, u16t nVal)
+{
+	auto nStart = BeginRecord(nType);
+	m_out.Put(nVal);
+	EndRecord(nStart);
+}
+
+void WmfGenerator::WriteRecordRect(u32t nType, const ORect& rc)
+{
+	auto nStart = BeginRecord(nType);
+	m_out.Put(wmf::OWmfRectangle{ (i16t)rc.bottom, (i16t)rc.right, (i16t)rc.top, (i16t)rc.left });
+	EndRecord(nStart);
+}
+
+void WmfGenerator::CreateObject(bool bPen)
+{
+	int& nSelected = bPen ? m_nPen : m_nBrush;
+	// A slot other than the ones selected is freed, when all are used
+	auto it = std::find(m_vSlots.begin(), m_vSlots.end(), false);
+	if (it == m_vSlots.end())
+	{
+		int nSlot;
+		do
+			nSlot = (int)m_rnd.Below((u32t)m_vSlots.size());
+		while (nSlot == m_nPen || nSlot == m_nBrush);
+		WriteRecordU16(WmfRecordTypeDeleteObject, (u16t)nSlot);
+		m_vSlots[nSlot] = false;
+		it = m_vSlots.begin() + nSlot;
+	}
+	int nSlot = (int)(it - m_vSlots.begin());
+	auto nStart = BeginRecord(bPen ? WmfRecordTypeCreatePenIndirect : WmfRecordTypeCreateBrushIndirect);
+	if (bPen)
+		m_out.Put(wmf::OWmfLogPen{ PS_SOLID, (i16t)m_rnd.Range(0, 4), 0, RandomColor() });
+	else
+		m_out.Put(wmf::OWmfLogBrush{ BS_SOLID, RandomColor(), 0 });
+	EndRecord(nStart);
+	m_vSlots[nSlot] = true;
+	WriteRecordU16(WmfRecordTypeSelectObject, (u16t)nSlot);
+	// The one replaced stays until its slot is needed
+	nSelected = nSlot;
+}
+
+void WmfGenerator::WriteShape()
+{
+	auto rc = RandomRect();
+	WriteRecordRect(m_rnd.Chance(50) ? WmfRecordTypeEllipse : WmfRecordTypeRectangle,
+		ORect{ rc.left, rc.top, rc.right + 1, rc.bottom + 1 });
+}
+
+void WmfGenerator::WriteLines()
+{
+	std::vector<OPoint> vPoints;
+	RandomPoints(vPoints, m_rnd.Range(2, m_options.MaxPoints));
+	bool bPolygon = vPoints.size() >= 3 && m_rnd.Chance(50);
+	auto nStart = BeginRecord(bPolygon ? WmfRecordTypePolygon : WmfRecordTypePolyline);
+	m_out.Put((i16t)vPoints.size());
+	m_out.PutBytes(vPoints.data(), vPoints.size() * sizeof(OPoint));
+	EndRecord(nStart);
+}
+
+void WmfGenerator::WritePolyPolygon()
+{
+	// No paths in WMF, the closest is a polypolygon
+	u16t nPolygons = (u16t)m_rnd.Range(1, 3);
+	std::vector<std::vector<OPoint>> vPolygons(nPolygons);
+	for (auto& vPoints : vPolygons)
+		RandomPoints(vPoints, std::max(3, m_rnd.Range(3, m_options.MaxPoints)));
+	auto nStart = BeginRecord(WmfRecordTypePolyPolygon);
+	m_out.Put(nPolygons);
+	for (auto& vPoints : vPolygons)
+		m_out.Put((u16t)vPoints.size());
+	for (auto& vPoints : vPolygons)
+		m_out.PutBytes(vPoints.data(), vPoints.size() * sizeof(OPoint));
+	EndRecord(nStart);
+}
+
+void WmfGenerator::WriteState()
+{
+	if (m_nDepth && (m_nDepth >= m_options.MaxDepth || m_rnd.Chance(50)))
+	{
+		--m_nDepth;
+		WriteRecordU16(WmfRecordTypeRestoreDC, (u16t)-1);
+		return;
+	}
+	++m_nDepth;
+	auto nStart = BeginRecord(WmfRecordTypeSaveDC);
+	EndRecord(nStart);
+}
+
+void WmfGenerator::WriteTransform()
+{
+	auto nStart = BeginRecord(WmfRecordTypeSetWindowOrg);
+	m_out.Put(wmf::OWmfSetWindowOrg{ (i16t)m_rnd.Range(-4, 4), (i16t)m_rnd.Range(-4, 4) });
+	EndRecord(nStart);
+}
+
+void WmfGenerator::WriteImage()
+{
+	u32t nSize = m_options.ImageSize;
+	memory_vector vPixels;
+	RandomPixels(vPixels, nSize);
+	auto rc = RandomRect();
+	auto nStart = BeginRecord(WmfRecordTypeStretchDIB);
+	m_out.Put(wmf::OWmfStretchDIB{ GdiSrcCopy, DIB_RGB_COLORS, (i16t)nSize, (i16t)nSize, 0, 0,
+		(i16t)(rc.bottom - rc.top + 1), (i16t)(rc.right - rc.left + 1), (i16t)rc.top, (i16t)rc.left });
+	m_out.Put((u32t)40);
+	m_out.Put((i32t)nSize);
+	m_out.Put(-(i32t)nSize);
+	m_out.Put((u16t)1);
+	m_out.Put((u16t)32);
+	m_out.Put((u32t)BI_RGB);
+	m_out.Put((u32t)vPixels.size());
+	m_out.Put((i32t)3780);
+	m_out.Put((i32t)3780);
+	m_out.Put((u32t)0);
+	m_out.Put((u32t)0);
+	m_out.PutBytes(vPixels.data(), vPixels.size());
+	EndRecord(nStart);
+}
+
+void WmfGenerator::Generate()
+{
+	// 96 units per inch
+	wmf::OWmfPlaceableHeader placeable = { wmf::WmfPlaceableKey, 0,
+		{ 0, 0, (i16t)m_options.Width, (i16t)m_options.Height }, 96, 0, 0 };
+	auto pWords = (const u16t*)&placeable;
+	for (size_t ii = 0; ii < 10; ++ii)
+		placeable.Checksum ^= pWords[ii];
+	m_out.Put(placeable);
+	m_nHeaderOffset = m_out.Size();
+	m_out.Put(wmf::OWmfHeader{ 1, 9, 0x0300, 0, 0, (u16t)m_options.ObjectSlots, 0, 0 });
+
+	auto nStart = BeginRecord(WmfRecordTypeSetWindowOrg);
+	m_out.Put(wmf::OWmfSetWindowOrg{ 0, 0 });
+	EndRecord(nStart);
+	nStart = BeginRecord(WmfRecordTypeSetWindowExt);
+	m_out.Put(wmf::OWmfSetWindowExt{ (i16t)m_options.Height, (i16t)m_options.Width });
+	EndRecord(nStart);
+	m_vSlots.assign(m_options.ObjectSlots, false);
+	CreateObject(true);
+	CreateObject(false);
+
+	size_t nOps = m_options.Operations;
+	OEventSpread images{ m_options.Images };
+	for (size_t nOp = 0; nOp <= nOps; ++nOp)
+	{
+		for (; images.Due(nOp, nOps); ++images.nDone)
+			WriteImage();
+		if (nOp == nOps)
+			break;
+		switch (PickOperation())
+		{
+		case OOperation::Shapes:
+			WriteShape();
+			break;
+		case OOperation::Lines:
+			WriteLines();
+			break;
+		case OOperation::Paths:
+			WritePolyPolygon();
+			break;
+		case OOperation::State:
+			WriteState();
+			break;
+		case OOperation::Transforms:
+			WriteTransform();
+			break;
+		case OOperation::Objects:
+			CreateObject(m_rnd.Chance(50));
+			break;
+		}
+	}
+	for (; m_nDepth; --m_nDepth)
+		WriteRecordU16(WmfRecordTypeRestoreDC, (u16t)-1);
+	nStart = BeginRecord(WmfRecordTypeEOF);
+	EndRecord(nStart);
+
+	// META_HEADER Size and MaxRecord
+	auto nWords = (u32t)((m_out.Size() - m_nHeaderOffset) / 2);
+	m_out.Set(m_nHeaderOffset + offsetof(wmf::OWmfHeader, SizeLow), (u16t)nWords);
+	m_out.Set(m_nHeaderOffset + offsetof(wmf::OWmfHeader, SizeHigh), (u16t)(nWords >> 16));
+	m_out.Set(m_nHeaderOffset + offsetof(wmf::OWmfHeader, MaxRecord), m_nMaxRecord);
+}
+
+bool GenerateMetafile(const OGenOptions& options, memory_vector& data)
+{
+	data.clear();
+	if (!_IsValidOptions(options))
+		return false;
+	if (options.Format == OFormat::Wmf)
+	{
+		WmfGenerator gen(options, data);
+		gen.Generate();
+		return true;
+	}
+	EmfGenerator gen(options, data);
+	gen.Generate();
+	return true;
+}
+
+}
+
+#pragma pop_macro("min")
+#pragma pop_macro("max")
+
+#endif // _ENABLE_GDIPLUS_STRUCT
@@ -0,0 +1,65 @@
+#ifndef EMF_GENERATOR_H
+#define EMF_GENERATOR_H
+
+#ifdef _ENABLE_GDIPLUS_STRUCT
+
+#include "EmfPlusStruct.h"
+
+// Synthetic metafiles for stress and scaling tests: valid EMF, EMF+ (dual
+// or EMF+ only) and WMF documents with a chosen mix of records. The output
+// only depends on the options, the seed included, so that the same inputs
+// can be generated again anywhere.
+namespace emfgen
+{
+	using namespace emfplus;
+
+	enum class OFormat
+	{
+		Emf,
+		EmfPlusDual,
+		EmfPlusOnly,
+		Wmf,
+	};
+
+	// Relative weights of the kinds of operations, 0 to leave one out
+	struct ORecordMix
+	{
+		u32t	Shapes		= 4;	// rectangles and ellipses
+		u32t	Lines		= 3;	// polylines and polygons
+		u32t	Paths		= 2;	// paths (polypolygons in WMF)
+		u32t	State		= 1;	// save/restore, containers
+		u32t	Transforms	= 1;
+		u32t	Objects		= 1;	// pen and brush replacements
+	};
+
+	struct OGenOptions
+	{
+		OFormat		Format			= OFormat::EmfPlusDual;
+		u64t		Seed			= 1;
+		// Each writes one record, or a few (per side in dual EMF+)
+		size_t		Operations		= 10000;
+		ORecordMix	Mix;
+		u32t		MaxPoints		= 16;	// of a polyline, polygon or path figure
+		u32t		ObjectSlots		= 16;	// object table slots in use, 2 to 64
+		u32t		MaxDepth		= 4;	// of nested saves/containers
+		// EMF+ path objects of ContinuedObjectSize bytes, written as
+		// continued object records
+		size_t		ContinuedObjects	= 0;
+		u32t		ContinuedObjectSize	= 96 * 1024;
+		size_t		Images			= 0;
+		u32t		ImageSize		= 64;	// width and height, in pixels
+		// Small EMFs embedded as EMF+ metafile images, and by
+		// EMR_COMMENT_MULTIFORMATS in the GDI records. Not in WMF.
+		size_t		Metafiles		= 0;
+		i32t		Width			= 1024;	// of the picture, in pixels
+		i32t		Height			= 768;
+	};
+
+	// Returns false when the options can't be honored (e.g. no kind of
+	// operation, or a picture over the 16-bit coordinates)
+	bool GenerateMetafile(const OGenOptions& options, memory_vector& data);
+}
+
+#endif // _ENABLE_GDIPLUS_STRUCT
+
+#endif // EMF_GENERATOR_H
@@ -0,0 +1,369 @@
+#include PCH_FNAME
+#ifdef _ENABLE_GDIPLUS_STRUCT
+
+#include "EmfImageCompare.h"
+#include "EmfPixelConvert.h"
+#include "ThreadPool.h"
+#include <bit>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	#define EMFCOMPARE_X86
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#define EMFCOMPARE_AVX2
+	#else
+		#define EMFCOMPARE_AVX2	__attribute__((target("avx2")))
+	#endif
+#endif
+
+#pragma push_macro("min")
+#pragma push_macro("max")
+#undef max
+#undef min
+
+namespace emfcompare
+{
+
+// Row kernels take the differences of nWidth pixels, raising aMax (B, G, R,
+// A) and counting the pixels with a difference above nTolerance. The SIMD
+// ones return how many pixels they did, the rest is left to the scalar one.
+using DeltaFunc = uint32_t (*)(const uint8_t* pA, const uint8_t* pB, uint32_t nWidth, uint8_t nTolerance,
+	uint8_t* aMax, uint64_t& nMismatched);
+
+static uint32_t _DeltaRow(const uint8_t* pA, const uint8_t* pB, uint32_t nWidth, uint8_t nTolerance,
+	uint8_t* aMax, uint64_t& nMismatched)
+{
+	for (uint32_t x = 0; x < nWidth; ++x, pA += 4, pB += 4)
+	{
+		bool bMismatch = false;
+		for (int ii = 0; ii < 4; ++ii)
+		{
+			auto nDelta = (uint8_t)std::abs(pA[ii] - pB[ii]);
+			aMax[ii] = std::max(aMax[ii], nDelta);
+			bMismatch |= nDelta > nTolerance;
+		}
+		nMismatched += bMismatch;
+	}
+	return nWidth;
+}
+
+static inline void _FoldMax(const uint8_t* pLanes, size_t nLanes, uint8_t* aMax)
+{
+	for (size_t ii = 0; ii < nLanes; ++ii)
+		aMax[ii % 4] = std::max(aMax[ii % 4], pLanes[ii]);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// SSE2/AVX2
+
+#ifdef EMFCOMPARE_X86
+
+static uint32_t _DeltaRow_SSE2(const uint8_t* pA, const uint8_t* pB, uint32_t nWidth, uint8_t nTolerance,
+	uint8_t* aMax, uint64_t& nMismatched)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i vTol = _mm_set1_epi8((char)nTolerance);
+	__m128i vMax = zero;
+	uint64_t nCount = 0;
+	uint32_t x = 0;
+	for (; x + 4 <= nWidth; x += 4)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(pA + x * 4));
+		__m128i b = _mm_loadu_si128((const __m128i*)(pB + x * 4));
+		__m128i d = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+		vMax = _mm_max_epu8(vMax, d);
+		// Pixels within the tolerance are left all zero
+		__m128i vWithin = _mm_cmpeq_epi32(_mm_subs_epu8(d, vTol), zero);
+		nCount += 4 - std::popcount((unsigned)_mm_movemask_ps(_mm_castsi128_ps(vWithin)));
+	}
+	alignas(16) uint8_t aLanes[16];
+	_mm_store_si128((__m128i*)aLanes, vMax);
+	_FoldMax(aLanes, 16, aMax);
+	nMismatched += nCount;
+	return x;
+}
+
+EMFCOMPARE_AVX2
+static uint32_t _DeltaRow_AVX2(const uint8_t* pA, const uint8_t* pB, uint32_t nWidth, uint8_t nTolerance,
+	uint8_t* aMax, uint64_t& nMismatched)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i vTol = _mm256_set1_epi8((char)nTolerance);
+	__m256i vMax = zero;
+	uint64_t nCount = 0;
+	uint32_t x = 0;
+	for (; x + 8 <= nWidth; x += 8)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i*)(pA + x * 4));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(pB + x * 4));
+		__m256i d = _mm256_or_si256(_mm256_subs_epu8(a, b), _mm256_subs_epu8(b, a));
+		vMax = _mm256_max_epu8(vMax, d);
+		__m256i vWithin = _mm256_cmpeq_epi32(_mm256_subs_epu8(d, vTol), zero);
+		nCount += 8 - std::popcount((unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(vWithin)));
+	}
+	alignas(32) uint8_t aLanes[32];
+	_mm256_store_si256((__m256i*)aLanes, vMax);
+	_FoldMax(aLanes, 32, aMax);
+	nMismatched += nCount;
+	return x;
+}
+
+#endif // EMFCOMPARE_X86
+
+//////////////////////////////////////////////////////////////////////////
+// Dispatch
+
+static DeltaFunc _GetDeltaKernel()
+{
+	switch (emfpixel::GetSimdLevel())
+	{
+#ifdef EMFCOMPARE_X86
+	case emfpixel::SimdLevel::AVX2:
+		return _DeltaRow_AVX2;
+	case emfpixel::SimdLevel::SSE2:
+		return _DeltaRow_SSE2;
+#endif
+	default:
+		return nullptr;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// SSIM
+
+// Luma of the pixel drawn on white, BT.601 weights
+static inline uint8_t _Luma(const uint8_t* pPixel)
+{
+	uint32_t a = pPixel[3];
+	uint32_t aRGB[3];
+	for (int ii = 0; ii < 3; ++ii)
+		aRGB[ii] = (pPixel[ii] * a + 255 * (255 - a) + 127) / 255;
+	return (uint8_t)((29 * aRGB[0] + 150 * aRGB[1] + 77 * aRGB[2] + 128) >> 8);
+}
+
+// Sum of the SSIM of the blocks of rows [nTop, nTop + nRows), at most
+// SsimBlock rows
+static double _SsimBlockRow(const OImageView& imgA, const OImageView& imgB, uint32_t nTop, uint32_t nRows,
+	std::vector<uint8_t>& vLumaA, std::vector<uint8_t>& vLumaB)
+{
+	uint32_t nWidth = imgA.nWidth;
+	vLumaA.resize((size_t)nWidth * nRows);
+	vLumaB.resize((size_t)nWidth * nRows);
+	for (uint32_t y = 0; y < nRows; ++y)
+	{
+		auto pRowA = imgA.pPixels + (nTop + y) * imgA.nStride;
+		auto pRowB = imgB.pPixels + (nTop + y) * imgB.nStride;
+		for (uint32_t x = 0; x < nWidth; ++x)
+		{
+			vLumaA[(size_t)y * nWidth + x] = _Luma(pRowA + x * 4);
+			vLumaB[(size_t)y * nWidth + x] = _Luma(pRowB + x * 4);
+		}
+	}
+	// (K1 L)^2, (K2 L)^2 with K1 = 0.01, K2 = 0.03 and L = 255
+	const double c1 = 6.5025, c2 = 58.5225;
+	double fSum = 0;
+	for (uint32_t nLeft = 0; nLeft < nWidth; nLeft += SsimBlock)
+	{
+		uint32_t nCols = std::min<uint32_t>(SsimBlock, nWidth - nLeft);
+		uint64_t nSumA = 0, nSumB = 0, nSumAA = 0, nSumBB = 0, nSumAB = 0;
+		for (uint32_t y = 0; y < nRows; ++y)
+		{
+			auto pA = vLumaA.data() + (size_t)y * nWidth + nLeft;
+			auto pB = vLumaB.data() + (size_t)y * nWidth + nLeft;
+			for (uint32_t x = 0; x < nCols; ++x)
+			{
+				uint32_t a = pA[x], b = pB[x];
+				nSumA += a;
+				nSumB += b;
+				nSumAA += a * a;
+				nSumBB += b * b;
+				nSumAB += a * b;
+			}
+		}
+		double n = (double)nCols * nRows;
+		double fMeanA = nSumA / n, fMeanB = nSumB / n;
+		double fVarA = nSumAA / n - fMeanA * fMeanA;
+		double fVarB = nSumBB / n - fMeanB * fMeanB;
+		double fCov = nSumAB / n - fMeanA * fMeanB;
+		fSum += (2 * fMeanA * fMeanB + c1) * (2 * fCov + c2)
+			/ ((fMeanA * fMeanA + fMeanB * fMeanB + c1) * (fVarA + fVarB + c2));
+	}
+	return fSum;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Comparison
+
+namespace
+{
+	struct OTileResult
+	{
+		uint8_t		aMaxDelta[4] = {};
+		uint64_t	nMismatched = 0;
+		double		fSsimSum = 0;
+		uint64_t	nBlocks = 0;
+	};
+}
+
+static void _CompareTile(const OImageView& imgA, const OImageView& imgB, const OCompareOptions& options,
+	DeltaFunc pSimd, uint32_t nTop, uint32_t nRows, OTileResult& tile)
+{
+	std::vector<uint8_t> vLumaA, vLumaB;
+	uint64_t nBlocksPerRow = (imgA.nWidth + SsimBlock - 1) / SsimBlock;
+	for (uint32_t nBlockTop = nTop; nBlockTop < nTop + nRows; nBlockTop += SsimBlock)
+	{
+		uint32_t nBlockRows = std::min<uint32_t>(SsimBlock, nTop + nRows - nBlockTop);
+		uint8_t aMax[4] = {};
+		for (uint32_t y = nBlockTop; y < nBlockTop + nBlockRows; ++y)
+		{
+			auto pRowA = imgA.pPixels + y * imgA.nStride;
+			auto pRowB = imgB.pPixels + y * imgB.nStride;
+			uint32_t nDone = pSimd ? pSimd(pRowA, pRowB, imgA.nWidth, options.nTolerance, aMax, tile.nMismatched) : 0;
+			if (nDone < imgA.nWidth)
+			{
+				_DeltaRow(pRowA + nDone * 4, pRowB + nDone * 4, imgA.nWidth - nDone, options.nTolerance, aMax,
+					tile.nMismatched);
+			}
+		}
+		bool bSame = true;
+		for (int ii = 0; ii < 4; ++ii)
+		{
+			tile.aMaxDelta[ii] = std::max(tile.aMaxDelta[ii], aMax[ii]);
+			bSame = bSame && !aMax[ii];
+		}
+		if (!options.bSsim)
+			continue;
+		// The same pixels make blocks of SSIM 1
+		tile.fSsimSum += bSame ? (double)nBlocksPerRow : _SsimBlockRow(imgA, imgB, nBlockTop, nBlockRows, vLumaA, vLumaB);
+		tile.nBlocks += nBlocksPerRow;
+	}
+}
+
+bool Compare(const OImageView& imgA, const OImageView& imgB, const OCompareOptions& options,
+	OCompareResult& result, ThreadPool* pPool)
+{
+	result = OCompareResult();
+	if (imgA.nWidth != imgB.nWidth || imgA.nHeight != imgB.nHeight)
+		return false;
+	if (!imgA.nWidth || !imgA.nHeight)
+		return true;
+	if (!imgA.pPixels || !imgB.pPixels)
+		return false;
+	uint32_t nTileRows = std::max<uint32_t>(options.nTileRows, 1);
+	nTileRows = (nTileRows + SsimBlock - 1) / SsimBlock * SsimBlock;
+	size_t nTiles = (imgA.nHeight + (size_t)nTileRows - 1) / nTileRows;
+	auto pSimd = _GetDeltaKernel();
+	std::vector<OTileResult> vTiles(nTiles);
+	auto CompareTile = [&](size_t nTile)
+	{
+		uint32_t nTop = (uint32_t)nTile * nTileRows;
+		_CompareTile(imgA, imgB, options, pSimd, nTop, std::min(nTileRows, imgA.nHeight - nTop), vTiles[nTile]);
+	};
+	if (pPool && nTiles > 1)
+	{
+		// The pool may be busy with other work, only the tiles are waited for
+		std::mutex mtx;
+		std::condition_variable cvDone;
+		size_t nLeft = nTiles;
+		for (size_t nTile = 0; nTile < nTiles; ++nTile)
+		{
+			pPool->Submit([&, nTile]()
+				{
+					CompareTile(nTile);
+					std::lock_guard<std::mutex> lock(mtx);
+					if (!--nLeft)
+						cvDone.notify_all();
+				});
+		}
+		std::unique_lock<std::mutex> lock(mtx);
+		cvDone.wait(lock, [&] { return !nLeft; });
+	}
+	else
+	{
+		for (size_t nTile = 0; nTile < nTiles; ++nTile)
+			CompareTile(nTile);
+	}
+	// Summed in order, the same whatever the tiles ran on
+	double fSsimSum = 0;
+	uint64_t nBlocks = 0;
+	for (auto& tile : vTiles)
+	{
+		for (int ii = 0; ii < 4; ++ii)
+			result.aMaxDelta[ii] = std::max(result.aMaxDelta[ii], tile.aMaxDelta[ii]);
+		result.nMismatched += tile.nMismatched;
+		fSsimSum += tile.fSsimSum;
+		nBlocks += tile.nBlocks;
+	}
+	result.bIdentical = !(result.aMaxDelta[0] | result.aMaxDelta[1] | result.aMaxDelta[2] | result.aMaxDelta[3]);
+	if (nBlocks)
+		result.fSsim = fSsimSum / nBlocks;
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Heatmap
+
+void RenderHeatmap(const OImageView& imgA, const OImageView& imgB, uint8_t nTolerance,
+	uint32_t nTop, uint32_t nRows, uint8_t* pDst, ptrdiff_t nDstStride)
+{
+	for (uint32_t y = nTop; y < nTop + nRows; ++y, pDst += nDstStride)
+	{
+		auto pA = imgA.pPixels + y * imgA.nStride;
+		auto pB = imgB.pPixels + y * imgB.nStride;
+		auto pOut = pDst;
+		for (uint32_t x = 0; x < imgA.nWidth; ++x, pA += 4, pB += 4, pOut += 4)
+		{
+			int nDelta = 0;
+			for (int ii = 0; ii < 4; ++ii)
+				nDelta = std::max(nDelta, std::abs(pA[ii] - pB[ii]));
+			if (nDelta > nTolerance)
+			{
+				pOut[0] = 0;
+				pOut[1] = (uint8_t)nDelta;
+				pOut[2] = 255;
+			}
+			else
+			{
+				// A quarter of the contrast of the golden
+				auto nGray = (uint8_t)(255 - ((255 - _Luma(pB)) >> 2));
+				pOut[0] = pOut[1] = pOut[2] = nGray;
+			}
+			pOut[3] = 255;
+		}
+	}
+}
+
+bool WriteHeatmap(const OImageView& imgA, const OImageView& imgB, uint8_t nTolerance,
+	const emfpng::OPngWriter::Sink& sink)
+{
+	if (imgA.nWidth != imgB.nWidth || imgA.nHeight != imgB.nHeight || !imgA.nWidth || !imgA.nHeight)
+		return false;
+	emfpng::OImageFormat fmt{ imgA.nWidth, imgA.nHeight, false };
+	// About a megabyte of rows at a time
+	uint32_t nBandRows = (uint32_t)std::max<size_t>(16, (1024 * 1024) / ((size_t)fmt.nWidth * 4));
+	nBandRows = std::min(nBandRows, fmt.nHeight);
+	std::vector<uint8_t> vRows((size_t)fmt.nWidth * 4 * nBandRows);
+	emfpng::OPngWriter writer(sink);
+	if (!writer.Begin(fmt, 0))
+		return false;
+	emfpng::OEncodedBand band;
+	for (uint32_t nTop = 0; nTop < fmt.nHeight; nTop += nBandRows)
+	{
+		uint32_t nRows = std::min(nBandRows, fmt.nHeight - nTop);
+		RenderHeatmap(imgA, imgB, nTolerance, nTop, nRows, vRows.data(), (ptrdiff_t)fmt.nWidth * 4);
+		emfpng::EncodeBand(fmt, vRows.data(), (ptrdiff_t)fmt.nWidth * 4, nRows, nTop + nRows == fmt.nHeight, band);
+		if (!writer.AddBand(band))
+			return false;
+	}
+	return writer.End();
+}
+
+}
+
+#pragma pop_macro("min")
+#pragma pop_macro("max")
+
+#endif // _ENABLE_GDIPLUS_STRUCT
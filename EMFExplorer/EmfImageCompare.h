@@ -0,0 +1,67 @@
+#ifndef EMF_IMAGE_COMPARE_H
+#define EMF_IMAGE_COMPARE_H
+
+#ifdef _ENABLE_GDIPLUS_STRUCT
+
+#include "EmfPng.h"
+
+class ThreadPool;
+
+// Comparison of a rendering against its golden: whether they are the same,
+// the largest difference of each channel, how many pixels differ by more
+// than a tolerance and, as a perceptual measure, the mean SSIM of their
+// luma.
+//
+// The differences are taken by SSE2/AVX2 kernels, picked as the
+// conversions of emfpixel are (capped by emfpixel::SetMaxSimdLevel), over
+// tiles of rows which may run on a thread pool. The SSIM is only computed
+// when asked for and the images differ, it takes the most time.
+namespace emfcompare
+{
+	// 32-bit BGRA pixels (GDI+ PixelFormat32bppARGB), rows nStride bytes apart
+	struct OImageView
+	{
+		uint32_t		nWidth;
+		uint32_t		nHeight;
+		ptrdiff_t		nStride;
+		const uint8_t*	pPixels;
+	};
+
+	struct OCompareOptions
+	{
+		uint8_t		nTolerance = 0;		// of each channel, for the mismatched pixels
+		bool		bSsim = false;
+		uint32_t	nTileRows = 64;		// rounded up to the SSIM blocks
+	};
+
+	struct OCompareResult
+	{
+		bool		bIdentical = true;
+		uint8_t		aMaxDelta[4] = {};	// B, G, R, A
+		uint64_t	nMismatched = 0;	// pixels with a channel more than nTolerance away
+		// Over SsimBlock x SsimBlock blocks of the luma of the pixels on
+		// white, 1 when identical. Only computed with bSsim.
+		double		fSsim = 1;
+	};
+
+	enum : uint32_t { SsimBlock = 8 };
+
+	// Fails when the sizes differ. The tiles run on pPool when given, which
+	// mustn't be one the caller runs on.
+	bool Compare(const OImageView& imgA, const OImageView& imgB, const OCompareOptions& options,
+		OCompareResult& result, ThreadPool* pPool = nullptr);
+
+	// Heatmap of the differences, nRows rows from nTop: the pixels within
+	// the tolerance are shown as a faded gray of imgB, the others from red,
+	// for the smallest difference, to yellow for the largest.
+	void RenderHeatmap(const OImageView& imgA, const OImageView& imgB, uint8_t nTolerance,
+		uint32_t nTop, uint32_t nRows, uint8_t* pDst, ptrdiff_t nDstStride);
+
+	// The heatmap as a PNG, encoded a band at a time
+	bool WriteHeatmap(const OImageView& imgA, const OImageView& imgB, uint8_t nTolerance,
+		const emfpng::OPngWriter::Sink& sink);
+}
+
+#endif // _ENABLE_GDIPLUS_STRUCT
+
+#endif // EMF_IMAGE_COMPARE_H
@@ -0,0 +1,187 @@
+#include PCH_FNAME
+#ifdef _ENABLE_GDIPLUS_STRUCT
+
+#include "EmfIndex.h"
+#include "DataHash.h"
+
+#pragma push_macro("min")
+#pragma push_macro("max")
+#undef max
+#undef min
+
+namespace emfindex
+{
+
+constexpr u32t EmrGdiComment			= 70;	// EMR_GDICOMMENT
+constexpr size_t EmrHeaderSize			= 8;
+// EMR_COMMENT_EMFPLUS: DataSize, CommentIdentifier, then the EMF+ records
+constexpr size_t PlusCommentRecordsOff	= 16;
+constexpr size_t PlusRecordHeaderSize	= 12;
+
+static inline u32t _ReadU32(const u8t* p)
+{
+	u32t val;
+	memcpy(&val, p, sizeof(val));
+	return val;
+}
+
+static inline u16t _ReadU16(const u8t* p)
+{
+	u16t val;
+	memcpy(&val, p, sizeof(val));
+	return val;
+}
+
+static inline bool _IsPlusRecord(u32t nType)
+{
+	return nType >= EmfPlusRecordTypeMin && nType <= EmfPlusRecordTypeMax;
+}
+
+// Every record of the document that the enumeration may hand out, in order
+static void _GetDocumentRecords(const u8t* pDoc, size_t nDocSize, std::vector<OIndexRecord>& vRecs)
+{
+	for (size_t nOff = 0; nOff + EmrHeaderSize <= nDocSize;)
+	{
+		u32t nType = _ReadU32(pDoc + nOff);
+		u32t nSize = _ReadU32(pDoc + nOff + 4);
+		if (nSize < EmrHeaderSize || nSize > nDocSize - nOff)
+			break;
+		vRecs.push_back({ nType, 0, 0, (u32t)(nOff + EmrHeaderSize), nSize - (u32t)EmrHeaderSize });
+		if (nType == EmrGdiComment && nSize >= PlusCommentRecordsOff
+			&& _ReadU32(pDoc + nOff + 12) == EMR_COMMENT_EMFPLUS)
+		{
+			size_t nEnd = nOff + std::min((size_t)nSize, 12 + (size_t)_ReadU32(pDoc + nOff + 8));
+			for (size_t nPlus = nOff + PlusCommentRecordsOff; nPlus + PlusRecordHeaderSize <= nEnd;)
+			{
+				u32t nPlusSize = _ReadU32(pDoc + nPlus + 4);
+				u32t nPlusDataSize = _ReadU32(pDoc + nPlus + 8);
+				if (nPlusSize < PlusRecordHeaderSize || nPlusSize > nEnd - nPlus
+					|| nPlusDataSize > nPlusSize - PlusRecordHeaderSize)
+					break;
+				vRecs.push_back({ _ReadU16(pDoc + nPlus), _ReadU16(pDoc + nPlus + 2), 0,
+					(u32t)(nPlus + PlusRecordHeaderSize), nPlusDataSize });
+				nPlus += nPlusSize;
+			}
+		}
+		nOff += nSize;
+	}
+}
+
+bool LocateRecords(const u8t* pDoc, size_t nDocSize, const std::vector<ORecordRef>& vRecs,
+	std::vector<OIndexRecord>& vIndexRecs)
+{
+	vIndexRecs.clear();
+	if (!pDoc || nDocSize > UINT32_MAX)
+		return false;
+	std::vector<OIndexRecord> vDocRecs;
+	_GetDocumentRecords(pDoc, nDocSize, vDocRecs);
+	vIndexRecs.reserve(vRecs.size());
+	size_t nNext = 0;
+	for (auto& rec : vRecs)
+	{
+		bool bPlus = _IsPlusRecord(rec.Type);
+		for (; nNext < vDocRecs.size(); ++nNext)
+		{
+			auto& docRec = vDocRecs[nNext];
+			if (docRec.Type != rec.Type || docRec.DataSize != rec.nDataSize
+				|| (bPlus && docRec.Flags != rec.Flags))
+				continue;
+			if (rec.nDataSize && (!rec.pData || memcmp(pDoc + docRec.DataOffset, rec.pData, rec.nDataSize) != 0))
+				continue;
+			vIndexRecs.push_back({ rec.Type, rec.Flags, 0, docRec.DataOffset, docRec.DataSize });
+			break;
+		}
+		if (nNext++ >= vDocRecs.size())
+		{
+			vIndexRecs.clear();
+			return false;
+		}
+	}
+	return true;
+}
+
+bool IsIndexValid(const u8t* pIndex, size_t nIndexSize, const OIndexKey& key)
+{
+	if (!pIndex || nIndexSize < sizeof(OIndexHeader))
+		return false;
+	OIndexHeader hdr;
+	memcpy(&hdr, pIndex, sizeof(hdr));
+	if (hdr.Magic != IndexMagic || hdr.Version != IndexVersion || hdr.HeaderSize != sizeof(OIndexHeader))
+		return false;
+	if (hdr.Key.FileSize != key.FileSize || hdr.Key.FileTime != key.FileTime || hdr.Key.FileHash != key.FileHash)
+		return false;
+	if (hdr.StreamCount > (nIndexSize - sizeof(OIndexHeader)) / sizeof(OIndexStream))
+		return false;
+	if (data_access::GetHash64(pIndex + sizeof(OIndexHeader), nIndexSize - sizeof(OIndexHeader)) != hdr.BodyHash)
+		return false;
+	auto pStreams = (const OIndexStream*)(pIndex + sizeof(OIndexHeader));
+	for (u32t ii = 0; ii < hdr.StreamCount; ++ii)
+	{
+		auto& stream = pStreams[ii];
+		if (stream.DocOffset > key.FileSize || stream.DocSize > key.FileSize - stream.DocOffset)
+			return false;
+		if (stream.RecordOffset % alignof(OIndexRecord) || stream.RecordOffset > nIndexSize
+			|| stream.RecordCount > (nIndexSize - stream.RecordOffset) / sizeof(OIndexRecord))
+			return false;
+	}
+	return true;
+}
+
+const OIndexRecord* FindStream(const u8t* pIndex, uint64_t nDocOffset, uint64_t nDocSize, size_t& nCount)
+{
+	nCount = 0;
+	auto pHeader = (const OIndexHeader*)pIndex;
+	auto pStreams = (const OIndexStream*)(pIndex + sizeof(OIndexHeader));
+	for (u32t ii = 0; ii < pHeader->StreamCount; ++ii)
+	{
+		auto& stream = pStreams[ii];
+		if (stream.DocOffset != nDocOffset || stream.DocSize != nDocSize)
+			continue;
+		auto pRecords = (const OIndexRecord*)(pIndex + stream.RecordOffset);
+		for (uint64_t jj = 0; jj < stream.RecordCount; ++jj)
+		{
+			auto& rec = pRecords[jj];
+			if (rec.DataOffset > nDocSize || rec.DataSize > nDocSize - rec.DataOffset)
+				return nullptr;
+		}
+		nCount = (size_t)stream.RecordCount;
+		return pRecords;
+	}
+	return nullptr;
+}
+
+void BuildIndex(const OIndexKey& key, const std::vector<OStreamData>& vStreams, memory_vector& vIndex)
+{
+	size_t nRecordOffset = sizeof(OIndexHeader) + vStreams.size() * sizeof(OIndexStream);
+	size_t nSize = nRecordOffset;
+	for (auto& stream : vStreams)
+		nSize += stream.vRecords.size() * sizeof(OIndexRecord);
+	vIndex.assign(nSize, 0);
+
+	auto pStream = (OIndexStream*)(vIndex.data() + sizeof(OIndexHeader));
+	for (auto& stream : vStreams)
+	{
+		*pStream++ = { stream.nDocOffset, stream.nDocSize, nRecordOffset, stream.vRecords.size() };
+		if (!stream.vRecords.empty())
+		{
+			memcpy(vIndex.data() + nRecordOffset, stream.vRecords.data(), stream.vRecords.size() * sizeof(OIndexRecord));
+			nRecordOffset += stream.vRecords.size() * sizeof(OIndexRecord);
+		}
+	}
+
+	OIndexHeader hdr = {};
+	hdr.Magic = IndexMagic;
+	hdr.Version = IndexVersion;
+	hdr.HeaderSize = sizeof(OIndexHeader);
+	hdr.StreamCount = (u32t)vStreams.size();
+	hdr.Key = key;
+	hdr.BodyHash = data_access::GetHash64(vIndex.data() + sizeof(OIndexHeader), nSize - sizeof(OIndexHeader));
+	memcpy(vIndex.data(), &hdr, sizeof(hdr));
+}
+
+}
+
+#pragma pop_macro("min")
+#pragma pop_macro("max")
+
+#endif // _ENABLE_GDIPLUS_STRUCT
@@ -0,0 +1,106 @@
+#ifndef EMF_INDEX_H
+#define EMF_INDEX_H
+
+#ifdef _ENABLE_GDIPLUS_STRUCT
+
+#include "EmfPlusStruct.h"
+
+// Record index of a metafile file, stored next to it so that reopening
+// doesn't have to go through the GDI+ enumeration again.
+//
+// Layout (little endian, every part 8-byte aligned so that the file can be
+// used mapped as is):
+//   OIndexHeader
+//   OIndexStream[StreamCount]
+//   OIndexRecord[] of every stream
+// A stream is one EMF document of the file: the whole file, or a page of
+// a spool file. Its records are the ones handed out by the enumeration, in
+// order, located by their data in the document.
+//
+// The index is only used when it matches the file (size, last write time
+// and content hash) and is whole (hash of everything after the header).
+// Anything else, another version included, is ignored and rewritten.
+namespace emfindex
+{
+	using namespace emfplus;
+
+	enum : u32t {
+		IndexMagic		= 0x49584D45,	// "EMXI"
+		IndexVersion	= 1,
+	};
+
+	struct OIndexKey
+	{
+		uint64_t	FileSize;
+		uint64_t	FileTime;		// last write time, as a FILETIME
+		uint64_t	FileHash;		// XXH64 of the file
+	};
+
+	struct OIndexHeader
+	{
+		u32t		Magic;
+		u32t		Version;
+		u32t		HeaderSize;		// sizeof(OIndexHeader)
+		u32t		StreamCount;
+		OIndexKey	Key;
+		uint64_t	BodyHash;		// XXH64 of what follows the header
+		uint64_t	Reserved;
+	};
+
+	struct OIndexStream
+	{
+		uint64_t	DocOffset;		// of the document in the file
+		uint64_t	DocSize;
+		uint64_t	RecordOffset;	// of the first OIndexRecord in the index
+		uint64_t	RecordCount;
+	};
+
+	struct OIndexRecord
+	{
+		u32t		Type;			// as enumerated (OEmfPlusRecordType)
+		u16t		Flags;
+		u16t		Reserved;
+		u32t		DataOffset;		// from the start of the document
+		u32t		DataSize;
+	};
+
+	static_assert(sizeof(OIndexHeader) == 56);
+	static_assert(sizeof(OIndexStream) == 32);
+	static_assert(sizeof(OIndexRecord) == 16);
+
+	// An enumerated record, as given to LocateRecords
+	struct ORecordRef
+	{
+		u32t		Type;
+		u16t		Flags;
+		const u8t*	pData;
+		size_t		nDataSize;
+	};
+
+	// Finds where the data of every record is in the document: the GDI
+	// records, and the EMF+ records of the EMR_COMMENT_EMFPLUS comments.
+	// The records must be in document order, records the enumeration left
+	// out are skipped. Returns false when a record can't be found.
+	bool LocateRecords(const u8t* pDoc, size_t nDocSize, const std::vector<ORecordRef>& vRecs,
+		std::vector<OIndexRecord>& vIndexRecs);
+
+	// Validates the whole index against the key of the file
+	bool IsIndexValid(const u8t* pIndex, size_t nIndexSize, const OIndexKey& key);
+
+	// Records of the stream of the given document, nullptr if the index (which
+	// must be valid) has none. The records are checked to be in the document.
+	const OIndexRecord* FindStream(const u8t* pIndex, uint64_t nDocOffset, uint64_t nDocSize, size_t& nCount);
+
+	struct OStreamData
+	{
+		uint64_t					nDocOffset;
+		uint64_t					nDocSize;
+		std::vector<OIndexRecord>	vRecords;
+	};
+
+	void BuildIndex(const OIndexKey& key, const std::vector<OStreamData>& vStreams, memory_vector& vIndex);
+}
+
+#endif // _ENABLE_GDIPLUS_STRUCT
+
+#endif // EMF_INDEX_H
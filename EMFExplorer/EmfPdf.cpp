@@ -0,0 +1,1066 @@
+#include PCH_FNAME
+#ifdef _ENABLE_GDIPLUS_STRUCT
+
+#include "EmfPdf.h"
+#include "EmfPng.h"
+#include "DataHash.h"
+#include "ThreadPool.h"
+#include <charconv>
+
+#pragma push_macro("min")
+#pragma push_macro("max")
+#undef max
+#undef min
+
+namespace emfpdf
+{
+
+namespace
+{
+	// Written last, as they list what the content uses
+	enum : u32t {
+		CatalogObj = 1,
+		PagesObj,
+		PageObj,
+		ResourcesObj,
+		FirstFreeObj,
+	};
+
+	constexpr double PointsPerMm = 72 / 25.4;
+
+	enum class OFontFamily
+	{
+		Helvetica,
+		Times,
+		Courier,
+		Symbol,
+	};
+
+	// By family, then bold and italic
+	const char* const aFontNames[] = {
+		"Helvetica", "Helvetica-Bold", "Helvetica-Oblique", "Helvetica-BoldOblique",
+		"Times-Roman", "Times-Bold", "Times-Italic", "Times-BoldItalic",
+		"Courier", "Courier-Bold", "Courier-Oblique", "Courier-BoldOblique",
+		"Symbol", "Symbol", "Symbol", "Symbol",
+	};
+
+	// Mean advance of the families, in ems
+	const double aFontAdvances[] = { 0.55, 0.5, 0.6, 0.6 };
+
+	// WinAnsiEncoding of 0x80 to 0x9F
+	const u16t aWinAnsiHigh[] = {
+		0x20AC, 0, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021, 0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0, 0x017D, 0,
+		0, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014, 0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0, 0x017E, 0x0178,
+	};
+
+	// Lines of the hatch styles in their cell, as the SVG writer draws them
+	const char* const aHatchLines[] = {
+		"0 3.5 m 8 3.5 l",																// HorizontalLines
+		"3.5 0 m 3.5 8 l",																// VerticalLines
+		"0 0 m 8 8 l -1 7 m 1 9 l 7 -1 m 9 1 l",										// ForwardDiagonal
+		"8 0 m 0 8 l -1 1 m 1 -1 l 7 9 m 9 7 l",										// BackwardDiagonal
+		"0 3.5 m 8 3.5 l 3.5 0 m 3.5 8 l",												// LargeGrid
+		"0 0 m 8 8 l -1 7 m 1 9 l 7 -1 m 9 1 l 8 0 m 0 8 l -1 1 m 1 -1 l 7 9 m 9 7 l",	// DiagonalCross
+	};
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Formatting
+
+// Up to nDecimals, without trailing zeros, and a space
+static void _AppendNumber(std::string& str, double fVal, int nDecimals = 3)
+{
+	if (!std::isfinite(fVal))
+		fVal = 0;
+	double fScale = std::pow(10.0, nDecimals);
+	fVal = std::round(std::clamp(fVal, -1e9, 1e9) * fScale) / fScale;
+	if (fVal == 0)
+	{
+		str += "0 ";
+		return;
+	}
+	char sz[48];
+	auto res = std::to_chars(sz, sz + sizeof(sz), fVal, std::chars_format::fixed, nDecimals);
+	char* pEnd = res.ptr;
+	while (pEnd[-1] == '0')
+		--pEnd;
+	if (pEnd[-1] == '.')
+		--pEnd;
+	str.append(sz, pEnd);
+	str += ' ';
+}
+
+static void _AppendPoint(std::string& str, const OPoint& pt)
+{
+	_AppendNumber(str, pt.x);
+	_AppendNumber(str, pt.y);
+}
+
+static void _AppendMatrix(std::string& str, const OMatrix& mtx)
+{
+	for (double fVal : { mtx.m11, mtx.m12, mtx.m21, mtx.m22 })
+		_AppendNumber(str, fVal, 6);
+	_AppendNumber(str, mtx.dx);
+	_AppendNumber(str, mtx.dy);
+}
+
+static void _AppendColor(std::string& str, const OEmfPlusARGB& clr)
+{
+	for (u8t val : { clr.Red, clr.Green, clr.Blue })
+		_AppendNumber(str, val / 255.0);
+}
+
+static void _AppendRect(std::string& str, const ORect& rc)
+{
+	str += '[';
+	for (double fVal : { rc.x, rc.y, rc.x + rc.w, rc.y + rc.h })
+		_AppendNumber(str, fVal);
+	str += ']';
+}
+
+static void _AppendPath(std::string& str, const OPath& path)
+{
+	auto& vPoints = path.GetPoints();
+	size_t nPoint = 0;
+	bool bOpen = false;
+	for (auto nOp : path.GetOps())
+	{
+		switch (nOp)
+		{
+		case OPath::Op::Move:
+			_AppendPoint(str, vPoints[nPoint++]);
+			str += "m\n";
+			bOpen = true;
+			break;
+		case OPath::Op::Line:
+			_AppendPoint(str, vPoints[nPoint++]);
+			str += bOpen ? "l\n" : "m\n";
+			bOpen = true;
+			break;
+		case OPath::Op::Bezier:
+			// A figure needs a current point first
+			if (!bOpen)
+			{
+				_AppendPoint(str, vPoints[nPoint]);
+				str += "m\n";
+				bOpen = true;
+			}
+			for (int ii = 0; ii < 3; ++ii)
+				_AppendPoint(str, vPoints[nPoint++]);
+			str += "c\n";
+			break;
+		case OPath::Op::Close:
+			if (bOpen)
+				str += "h\n";
+			break;
+		}
+	}
+}
+
+// Literal string of the text in WinAnsiEncoding
+static void _AppendString(std::string& str, const u8t* pText, size_t nLength)
+{
+	str += '(';
+	for (size_t ii = 0; ii < nLength; ++ii)
+	{
+		u8t ch = pText[ii];
+		if (ch == '(' || ch == ')' || ch == '\\')
+		{
+			str += '\\';
+			str += (char)ch;
+		}
+		else if (ch < 0x20 || ch >= 0x7F)
+		{
+			char sz[8];
+			snprintf(sz, sizeof(sz), "\\%03o", ch);
+			str += sz;
+		}
+		else
+			str += (char)ch;
+	}
+	str += ')';
+}
+
+static u8t _ToWinAnsi(u16t ch)
+{
+	if (ch < 0x20)
+		return ' ';
+	if (ch < 0x7F || (ch >= 0xA0 && ch <= 0xFF))
+		return (u8t)ch;
+	for (size_t ii = 0; ii < _countof(aWinAnsiHigh); ++ii)
+	{
+		if (aWinAnsiHigh[ii] == ch)
+			return (u8t)(0x80 + ii);
+	}
+	return '?';
+}
+
+static double _GetPaintAlpha(const OPaint& paint)
+{
+	switch (paint.nType)
+	{
+	case OPaintType::Color:
+		return paint.clr.Alpha / 255.0;
+	case OPaintType::LinearGradient:
+	case OPaintType::RadialGradient:
+		if (!paint.vStops.empty())
+		{
+			double fSum = 0;
+			for (auto& stop : paint.vStops)
+				fSum += stop.clr.Alpha;
+			return fSum / (paint.vStops.size() * 255.0);
+		}
+		break;
+	default:
+		break;
+	}
+	return 1;
+}
+
+// Function of the gradient over [0 1]: the colors interpolated between the
+// stops, and those of the end stops past them
+static void _AppendFunction(std::string& str, const std::vector<OGradientStop>& vStops)
+{
+	struct OPiece
+	{
+		OEmfPlusARGB	clr0;
+		OEmfPlusARGB	clr1;
+		double			fEnd;
+	};
+	std::vector<OGradientStop> vPoints;
+	OEmfPlusARGB clrFirst = vStops.empty() ? OEmfPlusARGB{} : vStops.front().clr;
+	OEmfPlusARGB clrLast = vStops.empty() ? OEmfPlusARGB{} : vStops.back().clr;
+	vPoints.push_back({ 0, clrFirst });
+	vPoints.insert(vPoints.end(), vStops.begin(), vStops.end());
+	vPoints.push_back({ 1, clrLast });
+	std::vector<OPiece> vPieces;
+	for (size_t ii = 0; ii + 1 < vPoints.size(); ++ii)
+	{
+		// Stops at the same offset change the color at once
+		if (vPoints[ii + 1].fOffset > vPoints[ii].fOffset)
+			vPieces.push_back({ vPoints[ii].clr, vPoints[ii + 1].clr, vPoints[ii + 1].fOffset });
+	}
+	if (vPieces.empty())
+		vPieces.push_back({ clrLast, clrLast, 1 });
+	auto appendPiece = [&str](const OPiece& piece)
+	{
+		str += "<</FunctionType 2/Domain[0 1]/C0[";
+		_AppendColor(str, piece.clr0);
+		str += "]/C1[";
+		_AppendColor(str, piece.clr1);
+		str += "]/N 1>>";
+	};
+	if (vPieces.size() == 1)
+	{
+		appendPiece(vPieces[0]);
+		return;
+	}
+	str += "<</FunctionType 3/Domain[0 1]/Functions[";
+	for (auto& piece : vPieces)
+		appendPiece(piece);
+	str += "]/Bounds[";
+	for (size_t ii = 0; ii + 1 < vPieces.size(); ++ii)
+		_AppendNumber(str, vPieces[ii].fEnd, 6);
+	str += "]/Encode[";
+	for (size_t ii = 0; ii < vPieces.size(); ++ii)
+		str += "0 1 ";
+	str += "]>>";
+}
+
+static void _Compress(const std::string& strData, std::vector<u8t>& vOut)
+{
+	vOut = { 0x78, 0x01 };
+	emfpng::Deflate((const u8t*)strData.data(), strData.size(), true, vOut);
+	u32t nAdler = emfpng::Adler32(1, strData.data(), strData.size());
+	for (int nShift = 24; nShift >= 0; nShift -= 8)
+		vOut.push_back((u8t)(nAdler >> nShift));
+}
+
+static u32t _GetBigEndian32(const u8t* p)
+{
+	return ((u32t)p[0] << 24) | ((u32t)p[1] << 16) | ((u32t)p[2] << 8) | p[3];
+}
+
+// Color components of a JPEG, from its frame header, 0 if not found
+static int _GetJpegComponents(const u8t* pData, size_t nSize)
+{
+	size_t nPos = 2;
+	while (nPos + 4 <= nSize)
+	{
+		if (pData[nPos] != 0xFF)
+			return 0;
+		u8t nMarker = pData[nPos + 1];
+		// Fill bytes, and markers without a segment
+		if (nMarker == 0xFF)
+		{
+			++nPos;
+			continue;
+		}
+		if (nMarker == 0x01 || (nMarker >= 0xD0 && nMarker <= 0xD8))
+		{
+			nPos += 2;
+			continue;
+		}
+		if (nMarker >= 0xC0 && nMarker <= 0xCF && nMarker != 0xC4 && nMarker != 0xC8 && nMarker != 0xCC)
+			return nPos + 9 < nSize ? pData[nPos + 9] : 0;
+		if (nMarker == 0xDA || nMarker == 0xD9)
+			return 0;
+		nPos += 2 + (((size_t)pData[nPos + 2] << 8) | pData[nPos + 3]);
+	}
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// OPdfWriter
+
+OPdfWriter::OPdfWriter(Sink sink, unsigned nThreads)
+	: m_sink(std::move(sink))
+	, m_nThreads(nThreads)
+{
+}
+
+OPdfWriter::~OPdfWriter()
+{
+	// Jobs still compressing refer to the queue
+	if (m_pPool)
+		m_pPool->Wait();
+}
+
+bool OPdfWriter::Flush()
+{
+	if (m_bFailed)
+		return false;
+	if (!m_out.empty())
+	{
+		if (!m_sink(m_out.data(), m_out.size()))
+			m_bFailed = true;
+		m_nOffset += m_out.size();
+		m_out.clear();
+	}
+	m_stats.nWritten = m_nOffset;
+	return !m_bFailed;
+}
+
+void OPdfWriter::Write(const void* pData, size_t nSize)
+{
+	if (nSize < FlushSize)
+	{
+		m_out.append((const char*)pData, nSize);
+		Written();
+		return;
+	}
+	// Large data goes to the sink as it is
+	Flush();
+	if (!m_bFailed && !m_sink(pData, nSize))
+		m_bFailed = true;
+	m_nOffset += nSize;
+	m_stats.nWritten = m_nOffset;
+}
+
+u32t OPdfWriter::NewObject()
+{
+	m_vOffsets.push_back(0);
+	return (u32t)m_vOffsets.size() - 1;
+}
+
+void OPdfWriter::BeginObject(u32t nObj)
+{
+	m_vOffsets[nObj] = GetOffset();
+	m_out += std::to_string(nObj);
+	m_out += " 0 obj\n";
+}
+
+void OPdfWriter::WriteObject(u32t nObj, const std::string& strBody)
+{
+	BeginObject(nObj);
+	m_out += strBody;
+	m_out += "\nendobj\n";
+	Written();
+}
+
+void OPdfWriter::BeginStream(u32t nObj, const std::string& strDict, const std::string& strLength)
+{
+	BeginObject(nObj);
+	m_out += "<<";
+	m_out += strDict;
+	m_out += "/Length ";
+	m_out += strLength;
+	m_out += ">>\nstream\n";
+}
+
+void OPdfWriter::EndStream()
+{
+	m_out += "\nendstream\nendobj\n";
+	Written();
+}
+
+void OPdfWriter::WriteStream(u32t nObj, const std::string& strDict, const void* pData, size_t nSize)
+{
+	BeginStream(nObj, strDict, std::to_string(nSize));
+	Write(pData, nSize);
+	EndStream();
+}
+
+void OPdfWriter::WriteImagePixels(u32t nObj, const std::string& strDict, u32t nWidth, u32t nHeight,
+	const RowSource& fnRows, bool bMask)
+{
+	// The length is known once the bands are written
+	u32t nLengthObj = NewObject();
+	BeginStream(nObj, strDict + "/Filter/FlateDecode", std::to_string(nLengthObj) + " 0 R");
+	u64t nStart = GetOffset();
+	size_t nStride = (size_t)nWidth * 4;
+	size_t nOutStride = (size_t)nWidth * (bMask ? 1 : 3);
+	u32t nBandRows = (u32t)std::clamp<size_t>(ImageBandMemory / nStride, 1, nHeight);
+	memory_vector vRows(nStride * nBandRows);
+	std::vector<u8t> vBand(nOutStride * nBandRows);
+	std::vector<u8t> vOut{ 0x78, 0x01 };
+	u32t nAdler = 1;
+	for (u32t nTop = 0; nTop < nHeight; nTop += nBandRows)
+	{
+		u32t nRows = std::min(nBandRows, nHeight - nTop);
+		size_t nPixels = (size_t)nWidth * nRows;
+		if (!fnRows(nTop, nRows, vRows.data()))
+			memset(vRows.data(), 0, nStride * nRows);
+		auto pSrc = vRows.data();
+		auto pDst = vBand.data();
+		for (size_t ii = 0; ii < nPixels; ++ii, pSrc += 4)
+		{
+			u32t nAlpha = pSrc[3];
+			if (bMask)
+			{
+				*pDst++ = (u8t)nAlpha;
+				continue;
+			}
+			// Premultiplied BGRA to RGB
+			for (int jj = 2; jj >= 0; --jj)
+			{
+				u32t nVal = pSrc[jj];
+				if (nAlpha && nAlpha != 255)
+					nVal = std::min<u32t>(255, (nVal * 255 + nAlpha / 2) / nAlpha);
+				*pDst++ = (u8t)nVal;
+			}
+		}
+		size_t nSize = nOutStride * nRows;
+		nAdler = emfpng::Adler32(nAdler, vBand.data(), nSize);
+		emfpng::Deflate(vBand.data(), nSize, nTop + nRows == nHeight, vOut);
+		Write(vOut.data(), vOut.size());
+		vOut.clear();
+	}
+	for (int nShift = 24; nShift >= 0; nShift -= 8)
+		vOut.push_back((u8t)(nAdler >> nShift));
+	Write(vOut.data(), vOut.size());
+	u64t nLength = GetOffset() - nStart;
+	EndStream();
+	WriteObject(nLengthObj, std::to_string(nLength));
+}
+
+void OPdfWriter::QueueStream(u32t nObj, std::string strDict, std::string strData)
+{
+	auto pJob = std::make_unique<OStreamJob>();
+	pJob->nObj = nObj;
+	pJob->strDict = std::move(strDict);
+	pJob->strData = std::move(strData);
+	auto pQueued = pJob.get();
+	m_qJobs.push_back(std::move(pJob));
+	m_pPool->Submit([this, pQueued]()
+		{
+			std::vector<u8t> vData;
+			_Compress(pQueued->strData, vData);
+			std::lock_guard<std::mutex> lock(m_mtxJobs);
+			pQueued->vData = std::move(vData);
+			pQueued->bDone = true;
+			m_cvJob.notify_all();
+		});
+	WriteStreams(m_pPool->GetThreadCount() * StreamsPerThread);
+}
+
+void OPdfWriter::WriteStreams(size_t nKeep)
+{
+	while (m_qJobs.size() > nKeep)
+	{
+		auto& job = *m_qJobs.front();
+		{
+			std::unique_lock<std::mutex> lock(m_mtxJobs);
+			m_cvJob.wait(lock, [&] { return job.bDone; });
+		}
+		WriteStream(job.nObj, job.strDict + "/Filter/FlateDecode", job.vData.data(), job.vData.size());
+		m_qJobs.pop_front();
+	}
+}
+
+void OPdfWriter::Drawn()
+{
+	++m_stats.nElements;
+	// Forms are written whole, at EndSymbol
+	if (m_vContents.size() != 1 || Content().size() < ContentChunkSize)
+		return;
+	u32t nObj = NewObject();
+	m_vPageStreams.push_back(nObj);
+	QueueStream(nObj, std::string(), std::move(Content()));
+	Content().clear();
+}
+
+std::string OPdfWriter::GetResource(std::string& strEntries, char chPrefix, const std::string& strBody)
+{
+	Hash64 hash((u64t)chPrefix);
+	hash.Update(strBody.data(), strBody.size());
+	u64t nKey = hash.Digest();
+	auto it = m_mapResources.find(nKey);
+	u32t nId = 0;
+	if (it != m_mapResources.end())
+	{
+		++m_stats.nReused;
+		nId = it->second;
+	}
+	else
+	{
+		u32t nObj = NewObject();
+		WriteObject(nObj, strBody);
+		nId = AddResource(strEntries, chPrefix, nKey, nObj);
+	}
+	return '/' + (chPrefix + std::to_string(nId));
+}
+
+u32t OPdfWriter::AddResource(std::string& strEntries, char chPrefix, u64t nKey, u32t nObj)
+{
+	u32t nId = m_nNextId++;
+	if (m_mapResources.size() < MaxResources)
+		m_mapResources.emplace(nKey, nId);
+	strEntries += '/';
+	strEntries += chPrefix;
+	strEntries += std::to_string(nId);
+	strEntries += ' ';
+	strEntries += std::to_string(nObj);
+	strEntries += " 0 R";
+	++m_stats.nDefs;
+	return nId;
+}
+
+std::string OPdfWriter::GetAlphaState(double fFill, double fStroke)
+{
+	std::string strBody = "<</Type/ExtGState/ca ";
+	_AppendNumber(strBody, std::clamp(fFill, 0.0, 1.0));
+	strBody += "/CA ";
+	_AppendNumber(strBody, std::clamp(fStroke, 0.0, 1.0));
+	strBody += ">>";
+	return GetResource(m_strStates, 'G', strBody);
+}
+
+std::string OPdfWriter::GetPatternName(const OPaint& paint, const OMatrix& mtx)
+{
+	// Patterns are in the default space of the page or form, not the current one
+	OMatrix mtxPattern = OMatrix::Multiply(OMatrix::Multiply(paint.mtx, mtx), m_vContents.back().mtxBase);
+	std::string strBody;
+	switch (paint.nType)
+	{
+	case OPaintType::LinearGradient:
+	case OPaintType::RadialGradient:
+		{
+			bool bLinear = paint.nType == OPaintType::LinearGradient;
+			strBody = bLinear ? "<</PatternType 2/Shading<</ShadingType 2/ColorSpace/DeviceRGB/Coords["
+				: "<</PatternType 2/Shading<</ShadingType 3/ColorSpace/DeviceRGB/Coords[0 0 0 0 0 1";
+			if (bLinear)
+			{
+				_AppendPoint(strBody, paint.ptStart);
+				_AppendPoint(strBody, paint.ptEnd);
+			}
+			strBody += "]/Function";
+			_AppendFunction(strBody, paint.vStops);
+			strBody += "/Extend[true true]>>/Matrix[";
+			_AppendMatrix(strBody, mtxPattern);
+			strBody += "]>>";
+		}
+		break;
+	case OPaintType::Hatch:
+		{
+			std::string strTile;
+			double fAlpha = paint.clr.Alpha / 255.0;
+			if (paint.clrBack.Alpha)
+			{
+				if (paint.clrBack.Alpha != 255)
+					strTile += GetAlphaState(paint.clrBack.Alpha / 255.0, 1) + " gs\n";
+				_AppendColor(strTile, paint.clrBack);
+				strTile += "rg\n0 0 8 8 re f\n";
+			}
+			size_t nIndex = paint.nHatchStyle;
+			if (nIndex < _countof(aHatchLines))
+			{
+				if (fAlpha < 1)
+					strTile += GetAlphaState(1, fAlpha) + " gs\n";
+				_AppendColor(strTile, paint.clr);
+				strTile += "RG\n1 w\n";
+				strTile += aHatchLines[nIndex];
+				strTile += "\nS";
+			}
+			else
+			{
+				// The other styles are dot and texture patterns, drawn as the
+				// share of the foreground color they cover
+				static const double aCoverage[] = { 0.05, 0.1, 0.2, 0.25, 0.3, 0.4, 0.5, 0.6, 0.7, 0.75, 0.8, 0.9 };
+				nIndex = paint.nHatchStyle - (u32t)OHatchStyle::Style05Percent;
+				fAlpha *= nIndex < _countof(aCoverage) ? aCoverage[nIndex] : 0.5;
+				strTile += GetAlphaState(fAlpha, 1) + " gs\n";
+				_AppendColor(strTile, paint.clr);
+				strTile += "rg\n0 0 8 8 re f";
+			}
+			strBody = "<</PatternType 1/PaintType 1/TilingType 1/BBox[0 0 8 8]/XStep 8/YStep 8/Resources 4 0 R/Matrix[";
+			_AppendMatrix(strBody, mtxPattern);
+			strBody += "]/Length " + std::to_string(strTile.size()) + ">>\nstream\n" + strTile + "\nendstream";
+		}
+		break;
+	case OPaintType::Pattern:
+		{
+			auto& rc = paint.rcImage;
+			if (!paint.nImageId || !(rc.w > 0) || !(rc.h > 0))
+				return std::string();
+			std::string strTile = "q\n";
+			// Images are drawn over the unit square, their first row at the top
+			if (!paint.bSymbol)
+				_AppendMatrix(strTile, { rc.w, 0, 0, -rc.h, rc.x, rc.y + rc.h });
+			strTile += paint.bSymbol ? "/X" : "cm\n/X";
+			strTile += std::to_string(paint.nImageId) + " Do\nQ";
+			strBody = "<</PatternType 1/PaintType 1/TilingType 1/BBox";
+			_AppendRect(strBody, rc);
+			strBody += "/XStep ";
+			_AppendNumber(strBody, rc.w);
+			strBody += "/YStep ";
+			_AppendNumber(strBody, rc.h);
+			strBody += "/Resources 4 0 R/Matrix[";
+			_AppendMatrix(strBody, mtxPattern);
+			strBody += "]/Length " + std::to_string(strTile.size()) + ">>\nstream\n" + strTile + "\nendstream";
+		}
+		break;
+	default:
+		return std::string();
+	}
+	return GetResource(m_strPatterns, 'P', strBody);
+}
+
+void OPdfWriter::AppendPaint(std::string& strOps, const OPaint& paint, bool bStroke, const OMatrix& mtx)
+{
+	std::string strName;
+	if (paint.nType != OPaintType::Color)
+		strName = GetPatternName(paint, mtx);
+	if (strName.empty())
+	{
+		_AppendColor(strOps, paint.clr);
+		strOps += bStroke ? "RG\n" : "rg\n";
+		return;
+	}
+	strOps += bStroke ? "/Pattern CS " : "/Pattern cs ";
+	strOps += strName;
+	strOps += bStroke ? " SCN\n" : " scn\n";
+}
+
+std::string OPdfWriter::GetFontName(const OTextRun& run, double& fAdvance)
+{
+	std::string strFamily;
+	for (u16t ch : run.vFamily)
+	{
+		if (ch < 0x80)
+			strFamily += (char)tolower(ch);
+	}
+	auto has = [&strFamily](const char* sz) { return strFamily.find(sz) != std::string::npos; };
+	OFontFamily nFamily = OFontFamily::Helvetica;
+	if (has("courier") || has("mono") || has("consol") || has("console") || has("fixed"))
+		nFamily = OFontFamily::Courier;
+	else if (has("symbol") || has("wingding") || has("webding"))
+		nFamily = OFontFamily::Symbol;
+	else if (has("times") || has("roman") || has("georgia") || has("garamond") || has("cambria") || has("book")
+		|| (has("serif") && !has("sans")))
+		nFamily = OFontFamily::Times;
+	fAdvance = aFontAdvances[(int)nFamily];
+	size_t nIndex = (size_t)nFamily * 4 + (run.nWeight >= 600 ? 1 : 0) + (run.bItalic ? 2 : 0);
+	std::string strBody = "<</Type/Font/Subtype/Type1/BaseFont/";
+	strBody += aFontNames[nIndex];
+	if (nFamily != OFontFamily::Symbol)
+		strBody += "/Encoding/WinAnsiEncoding";
+	strBody += ">>";
+	return GetResource(m_strFonts, 'F', strBody);
+}
+
+void OPdfWriter::BeginDocument(const ORect& rcBounds, const OPoint& ptPixelsPerMm)
+{
+	double fScaleX = ptPixelsPerMm.x > 0 ? PointsPerMm / ptPixelsPerMm.x : 0.75;
+	double fScaleY = ptPixelsPerMm.y > 0 ? PointsPerMm / ptPixelsPerMm.y : 0.75;
+	m_rcPage = { 0, 0, rcBounds.w * fScaleX, rcBounds.h * fScaleY };
+	m_out += "%PDF-1.4\n%\xE2\xE3\xCF\xD3\n";
+	// Device pixels, y going down, to points
+	OMatrix mtxBase{ fScaleX, 0, 0, -fScaleY, -rcBounds.x * fScaleX, m_rcPage.h + rcBounds.y * fScaleY };
+	m_vContents.push_back({ std::string(), PageObj, m_rcPage, mtxBase });
+	_AppendMatrix(Content(), mtxBase);
+	Content() += "cm\n";
+}
+
+void OPdfWriter::EndDocument()
+{
+	if (m_vContents.size() != 1)
+		return;
+	u32t nObj = NewObject();
+	m_vPageStreams.push_back(nObj);
+	QueueStream(nObj, std::string(), std::move(Content()));
+	m_vContents.clear();
+	WriteStreams(0);
+
+	std::string strBody = "<</ProcSet[/PDF/Text/ImageB/ImageC/ImageI]";
+	const std::pair<const char*, const std::string*> aDicts[] = {
+		{ "/XObject", &m_strXObjects }, { "/Pattern", &m_strPatterns },
+		{ "/ExtGState", &m_strStates }, { "/Font", &m_strFonts },
+	};
+	for (auto& dict : aDicts)
+	{
+		if (dict.second->empty())
+			continue;
+		strBody += dict.first;
+		strBody += "<<";
+		strBody += *dict.second;
+		strBody += ">>";
+	}
+	strBody += ">>";
+	WriteObject(ResourcesObj, strBody);
+	strBody = "<</Type/Page/Parent 2 0 R/MediaBox";
+	_AppendRect(strBody, m_rcPage);
+	strBody += "/Resources 4 0 R/Contents[";
+	for (auto nStream : m_vPageStreams)
+		strBody += std::to_string(nStream) + " 0 R ";
+	strBody += "]>>";
+	WriteObject(PageObj, strBody);
+	WriteObject(PagesObj, "<</Type/Pages/Kids[3 0 R]/Count 1>>");
+	WriteObject(CatalogObj, "<</Type/Catalog/Pages 2 0 R>>");
+
+	u64t nXref = GetOffset();
+	m_out += "xref\n0 " + std::to_string(m_vOffsets.size()) + "\n0000000000 65535 f \n";
+	for (size_t ii = 1; ii < m_vOffsets.size(); ++ii)
+	{
+		char sz[32];
+		snprintf(sz, sizeof(sz), "%010llu 00000 n \n", (unsigned long long)m_vOffsets[ii]);
+		m_out += sz;
+		Written();
+	}
+	m_out += "trailer\n<</Size " + std::to_string(m_vOffsets.size()) + "/Root 1 0 R>>\nstartxref\n"
+		+ std::to_string(nXref) + "\n%%EOF\n";
+	Flush();
+}
+
+void OPdfWriter::DrawPath(const OPath& path, const OPaint* pFill, bool bEvenOdd, const OStroke* pStroke,
+	const OMatrix& mtx)
+{
+	if (path.IsEmpty() || (!pFill && !pStroke))
+		return;
+	auto& str = Content();
+	str += "q\n";
+	double fFill = pFill ? _GetPaintAlpha(*pFill) : 1;
+	double fStroke = pStroke ? _GetPaintAlpha(pStroke->paint) : 1;
+	if (fFill < 1 || fStroke < 1)
+		str += GetAlphaState(fFill, fStroke) + " gs\n";
+	if (pFill)
+		AppendPaint(str, *pFill, false, mtx);
+	if (pStroke)
+	{
+		AppendPaint(str, pStroke->paint, true, mtx);
+		_AppendNumber(str, pStroke->fWidth);
+		str += "w\n";
+		if (pStroke->nCap != OLineCap::Flat)
+			str += pStroke->nCap == OLineCap::Round ? "1 J\n" : "2 J\n";
+		if (pStroke->nJoin != OLineJoin::Miter)
+			str += pStroke->nJoin == OLineJoin::Round ? "1 j\n" : "2 j\n";
+		else if (pStroke->fMiterLimit != 10)
+		{
+			_AppendNumber(str, std::max(pStroke->fMiterLimit, 1.0));
+			str += "M\n";
+		}
+		double fDashes = 0;
+		for (double fDash : pStroke->vDashes)
+			fDashes += std::max(fDash, 0.0);
+		if (fDashes > 0)
+		{
+			str += '[';
+			for (double fDash : pStroke->vDashes)
+				_AppendNumber(str, std::max(fDash, 0.0));
+			str += "] ";
+			_AppendNumber(str, pStroke->fDashOffset);
+			str += "d\n";
+		}
+	}
+	if (!mtx.IsIdentity())
+	{
+		_AppendMatrix(str, mtx);
+		str += "cm\n";
+	}
+	_AppendPath(str, path);
+	if (pFill && pStroke)
+		str += bEvenOdd ? "B*\n" : "B\n";
+	else if (pFill)
+		str += bEvenOdd ? "f*\n" : "f\n";
+	else
+		str += "S\n";
+	str += "Q\n";
+	Drawn();
+}
+
+void OPdfWriter::DrawText(const OTextRun& run, const OMatrix& mtx)
+{
+	// One byte per character, as the positions are given
+	std::vector<u8t> vText;
+	for (size_t ii = 0; ii < run.vText.size(); ++ii)
+	{
+		u16t ch = run.vText[ii];
+		if (ch >= 0xDC00 && ch <= 0xDFFF)
+			continue;
+		vText.push_back(_ToWinAnsi(ch));
+	}
+	if (vText.empty())
+		return;
+	double fAdvance = 0;
+	std::string strFont = GetFontName(run, fAdvance);
+	auto& str = Content();
+	str += "q\n";
+	double fAlpha = _GetPaintAlpha(run.paint);
+	if (fAlpha < 1)
+		str += GetAlphaState(fAlpha, 1) + " gs\n";
+	AppendPaint(str, run.paint, false, mtx);
+	if (!mtx.IsIdentity())
+	{
+		_AppendMatrix(str, mtx);
+		str += "cm\n";
+	}
+	str += "BT\n" + strFont + ' ';
+	_AppendNumber(str, run.fEmSize);
+	str += "Tf\n";
+	// Without positions but the first, the text is anchored from its estimated width
+	double fShift = 0;
+	if (run.vPos.size() <= 1 && run.nAnchor != OTextAnchor::Start)
+	{
+		fShift = -(double)vText.size() * fAdvance * run.fEmSize;
+		if (run.nAnchor == OTextAnchor::Middle)
+			fShift /= 2;
+	}
+	size_t nPositioned = std::clamp<size_t>(run.vPos.size(), 1, vText.size());
+	for (size_t ii = 0; ii < nPositioned; ++ii)
+	{
+		OPoint pt = run.vPos.empty() ? OPoint{ 0, 0 } : run.vPos[ii];
+		// Text space y goes up
+		str += "1 0 0 -1 ";
+		_AppendNumber(str, pt.x + fShift);
+		_AppendNumber(str, pt.y);
+		str += "Tm ";
+		// The characters past the positions follow the last one
+		size_t nLength = ii + 1 < nPositioned ? 1 : vText.size() - ii;
+		_AppendString(str, vText.data() + ii, nLength);
+		str += "Tj\n";
+	}
+	str += "ET\nQ\n";
+	Drawn();
+}
+
+void OPdfWriter::DrawImage(const OImageRef& ref, const ORect& rcSrc, const OMatrix& mtxDst, double fOpacity)
+{
+	if (!ref.nId || rcSrc.w == 0 || rcSrc.h == 0 || !std::isfinite(rcSrc.w) || !std::isfinite(rcSrc.h))
+		return;
+	auto& str = Content();
+	str += "q\n";
+	if (fOpacity < 1)
+		str += GetAlphaState(fOpacity, fOpacity) + " gs\n";
+	_AppendMatrix(str, mtxDst);
+	str += "cm\n";
+	auto& rcSpace = ref.rcSpace;
+	if (rcSrc.x != rcSpace.x || rcSrc.y != rcSpace.y || rcSrc.w != rcSpace.w || rcSrc.h != rcSpace.h)
+		str += "0 0 1 1 re W n\n";
+	// rcSrc to the unit square, after the image to its space
+	OMatrix mtxSrc = OMatrix::Multiply(OMatrix::Translate(-rcSrc.x, -rcSrc.y), OMatrix::Scale(1 / rcSrc.w, 1 / rcSrc.h));
+	if (!ref.bSymbol)
+		mtxSrc = OMatrix::Multiply({ rcSpace.w, 0, 0, -rcSpace.h, rcSpace.x, rcSpace.y + rcSpace.h }, mtxSrc);
+	_AppendMatrix(str, mtxSrc);
+	str += "cm\n/X" + std::to_string(ref.nId) + " Do\nQ\n";
+	++m_stats.nReused;
+	Drawn();
+}
+
+void OPdfWriter::PushClip(const OPath& path, bool bEvenOdd, const OMatrix& mtx)
+{
+	// Given in the current space, not to be restored with the clip
+	auto& str = Content();
+	str += "q\n";
+	if (path.IsEmpty())
+		str += "0 0 0 0 re\n";
+	else
+		_AppendPath(str, mtx.IsIdentity() ? path : path.Transform(mtx));
+	str += bEvenOdd ? "W* n\n" : "W n\n";
+}
+
+void OPdfWriter::PopClip()
+{
+	Content() += "Q\n";
+}
+
+bool OPdfWriter::FindImage(u64t nKey, OImageRef& ref)
+{
+	auto it = m_mapResources.find(nKey);
+	if (it == m_mapResources.end())
+		return false;
+	ref.nId = it->second;
+	++m_stats.nReused;
+	return true;
+}
+
+bool OPdfWriter::AddImageFile(u64t nKey, const u8t* pData, size_t nSize, u32t nWidth, u32t nHeight, OImageRef& ref)
+{
+	std::string strDict = "/Type/XObject/Subtype/Image";
+	if (nSize >= 3 && pData[0] == 0xFF && pData[1] == 0xD8 && pData[2] == 0xFF)
+	{
+		int nComponents = _GetJpegComponents(pData, nSize);
+		if (nComponents != 1 && nComponents != 3 && nComponents != 4)
+			return false;
+		strDict += "/Width " + std::to_string(nWidth) + "/Height " + std::to_string(nHeight) + "/BitsPerComponent 8";
+		// Adobe CMYK JPEGs are inverted
+		strDict += nComponents == 1 ? "/ColorSpace/DeviceGray"
+			: nComponents == 3 ? "/ColorSpace/DeviceRGB" : "/ColorSpace/DeviceCMYK/Decode[1 0 1 0 1 0 1 0]";
+		strDict += "/Filter/DCTDecode";
+		u32t nObj = NewObject();
+		WriteStream(nObj, strDict, pData, nSize);
+		ref.nId = AddResource(m_strXObjects, 'X', nKey, nObj);
+		return true;
+	}
+	if (nSize < 33 || memcmp(pData, "\x89PNG\r\n\x1A\n", 8) || memcmp(pData + 12, "IHDR", 4))
+		return false;
+	// PNG: its zlib data is a FlateDecode stream with the PNG predictors, but
+	// for the alpha and interlacing PDF has no filter for
+	u32t nPngWidth = _GetBigEndian32(pData + 16);
+	u32t nPngHeight = _GetBigEndian32(pData + 20);
+	u8t nDepth = pData[24];
+	u8t nColorType = pData[25];
+	u8t nInterlace = pData[28];
+	if (nInterlace || nDepth > 8 || (nColorType != 0 && nColorType != 2 && nColorType != 3)
+		|| (nColorType == 2 && nDepth != 8) || !nPngWidth || !nPngHeight)
+		return false;
+	const u8t* pPalette = nullptr;
+	size_t nPaletteSize = 0;
+	size_t nDataSize = 0;
+	for (size_t nPos = 8; ; )
+	{
+		if (nPos + 12 > nSize)
+			return false;
+		size_t nLength = _GetBigEndian32(pData + nPos);
+		if (nLength > nSize - nPos - 12)
+			return false;
+		auto pType = pData + nPos + 4;
+		if (!memcmp(pType, "IEND", 4))
+			break;
+		if (!memcmp(pType, "tRNS", 4))
+			return false;
+		if (!memcmp(pType, "PLTE", 4))
+		{
+			pPalette = pData + nPos + 8;
+			nPaletteSize = nLength / 3;
+		}
+		else if (!memcmp(pType, "IDAT", 4))
+			nDataSize += nLength;
+		nPos += nLength + 12;
+	}
+	if (!nDataSize || (nColorType == 3 && !nPaletteSize))
+		return false;
+	int nColors = nColorType == 2 ? 3 : 1;
+	strDict += "/Width " + std::to_string(nPngWidth) + "/Height " + std::to_string(nPngHeight)
+		+ "/BitsPerComponent " + std::to_string(nDepth);
+	if (nColorType == 3)
+	{
+		static const char szHex[] = "0123456789abcdef";
+		strDict += "/ColorSpace[/Indexed/DeviceRGB " + std::to_string(std::min<size_t>(nPaletteSize, 256) - 1) + '<';
+		for (size_t ii = 0; ii < std::min<size_t>(nPaletteSize, 256) * 3; ++ii)
+		{
+			strDict += szHex[pPalette[ii] >> 4];
+			strDict += szHex[pPalette[ii] & 0xF];
+		}
+		strDict += ">]";
+	}
+	else
+		strDict += nColorType == 2 ? "/ColorSpace/DeviceRGB" : "/ColorSpace/DeviceGray";
+	strDict += "/Filter/FlateDecode/DecodeParms<</Predictor 15/Colors " + std::to_string(nColors)
+		+ "/BitsPerComponent " + std::to_string(nDepth) + "/Columns " + std::to_string(nPngWidth) + ">>";
+	u32t nObj = NewObject();
+	BeginStream(nObj, strDict, std::to_string(nDataSize));
+	for (size_t nPos = 8; ; )
+	{
+		size_t nLength = _GetBigEndian32(pData + nPos);
+		auto pType = pData + nPos + 4;
+		if (!memcmp(pType, "IEND", 4))
+			break;
+		if (!memcmp(pType, "IDAT", 4))
+			Write(pData + nPos + 8, nLength);
+		nPos += nLength + 12;
+	}
+	EndStream();
+	ref.nId = AddResource(m_strXObjects, 'X', nKey, nObj);
+	return true;
+}
+
+bool OPdfWriter::AddImagePixels(u64t nKey, u32t nWidth, u32t nHeight, bool bAlpha, const RowSource& fnRows,
+	OImageRef& ref)
+{
+	u32t nObj = NewObject();
+	u32t nMaskObj = bAlpha ? NewObject() : 0;
+	std::string strDict = "/Type/XObject/Subtype/Image/Width " + std::to_string(nWidth) + "/Height "
+		+ std::to_string(nHeight) + "/BitsPerComponent 8/ColorSpace/";
+	// The rows are decoded again for the mask, rather than held
+	WriteImagePixels(nObj, strDict + (bAlpha ? "DeviceRGB/SMask " + std::to_string(nMaskObj) + " 0 R" : "DeviceRGB"),
+		nWidth, nHeight, fnRows, false);
+	if (bAlpha)
+		WriteImagePixels(nMaskObj, strDict + "DeviceGray", nWidth, nHeight, fnRows, true);
+	ref.nId = AddResource(m_strXObjects, 'X', nKey, nObj);
+	return true;
+}
+
+bool OPdfWriter::BeginSymbol(u64t nKey, const ORect& rcBounds, OImageRef& ref)
+{
+	u32t nObj = NewObject();
+	ref.nId = AddResource(m_strXObjects, 'X', nKey, nObj);
+	// The form is in the space of the metafile, its patterns as well
+	m_vContents.push_back({ std::string(), nObj, rcBounds, OMatrix() });
+	return true;
+}
+
+void OPdfWriter::EndSymbol()
+{
+	if (m_vContents.size() < 2)
+		return;
+	auto content = std::move(m_vContents.back());
+	m_vContents.pop_back();
+	std::string strDict = "/Type/XObject/Subtype/Form/BBox";
+	_AppendRect(strDict, content.rcBBox);
+	strDict += "/Resources 4 0 R";
+	QueueStream(content.nObj, std::move(strDict), std::move(content.strData));
+}
+
+bool OPdfWriter::Convert(const Source& source)
+{
+	m_out.clear();
+	m_nOffset = 0;
+	m_stats = {};
+	m_vOffsets.assign(FirstFreeObj, 0);
+	m_vContents.clear();
+	m_vPageStreams.clear();
+	m_strXObjects.clear();
+	m_strPatterns.clear();
+	m_strStates.clear();
+	m_strFonts.clear();
+	m_mapResources.clear();
+	m_nNextId = 1;
+	m_bFailed = false;
+	m_pPool = std::make_unique<ThreadPool>(m_nThreads);
+	bool bRet = PlayMetafile(source, *this);
+	WriteStreams(0);
+	m_pPool.reset();
+	return Flush() && bRet;
+}
+
+bool OPdfWriter::Convert(const u8t* pData, size_t nSize)
+{
+	return Convert(MemorySource(pData, nSize));
+}
+
+}
+
+#pragma pop_macro("min")
+#pragma pop_macro("max")
+
+#endif // _ENABLE_GDIPLUS_STRUCT
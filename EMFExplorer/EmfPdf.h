@@ -0,0 +1,167 @@
+#ifndef EMF_PDF_H
+#define EMF_PDF_H
+
+#ifdef _ENABLE_GDIPLUS_STRUCT
+
+#include "EmfVector.h"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class ThreadPool;
+
+// Streaming conversion of an EMF, and of the EMF+ records it carries, to a
+// one page PDF, as the device the metafile is played on (emfvector).
+// - The page content is cut in streams of ContentChunkSize, compressed on a
+//   thread pool while the records that follow are played, and written in
+//   order; only a couple of streams per thread are held at once.
+// - Images, embedded metafiles (form XObjects), gradients (shadings),
+//   hatches and pattern brushes (tiling patterns) and transparencies are
+//   written once, where they're first used, and referred to afterwards.
+// - JPEG payloads, and PNG ones without alpha nor interlacing, are written
+//   as is; other images are encoded from the records by bands (emfdib).
+// - Text is set in the standard 14 fonts (WinAnsi), the family picked from
+//   the name, each character at the position the records give. Text without
+//   positions is placed from a mean advance of the font, underlines and
+//   strike outs are left out.
+// - Gradients take the mean opacity of their stops and are extended past
+//   their ends, whatever their wrap mode.
+namespace emfpdf
+{
+	using namespace emfvector;
+
+	using OPdfStats = OVectorStats;
+
+	class OPdfWriter : public OVectorDevice
+	{
+	public:
+		enum : size_t {
+			FlushSize			= 64 * 1024,
+			// Of the streams the page content is cut in
+			ContentChunkSize	= 256 * 1024,
+			// Streams queued or compressed, and not written yet, per thread
+			StreamsPerThread	= 2,
+			// Past this, resources are written again rather than remembered
+			MaxResources		= 256 * 1024,
+			// Decoded pixels of an image held at once while it's encoded
+			ImageBandMemory		= 1024 * 1024,
+		};
+
+		// nThreads compress the streams, one per core if 0
+		explicit OPdfWriter(Sink sink, unsigned nThreads = 0);
+		~OPdfWriter();
+
+		OPdfWriter(const OPdfWriter&) = delete;
+		OPdfWriter& operator=(const OPdfWriter&) = delete;
+	public:
+		// Writes the PDF of the EMF read from the source. Fails on anything
+		// but an EMF, on truncated records and when the sink fails.
+		bool Convert(const Source& source);
+
+		bool Convert(const u8t* pData, size_t nSize);
+	private:
+		bool IsFailed() const override { return m_bFailed; }
+		void BeginDocument(const ORect& rcBounds, const OPoint& ptPixelsPerMm) override;
+		void EndDocument() override;
+		void DrawPath(const OPath& path, const OPaint* pFill, bool bEvenOdd, const OStroke* pStroke,
+			const OMatrix& mtx) override;
+		void DrawText(const OTextRun& run, const OMatrix& mtx) override;
+		void DrawImage(const OImageRef& ref, const ORect& rcSrc, const OMatrix& mtxDst, double fOpacity) override;
+		void PushClip(const OPath& path, bool bEvenOdd, const OMatrix& mtx) override;
+		void PopClip() override;
+		bool FindImage(u64t nKey, OImageRef& ref) override;
+		bool AddImageFile(u64t nKey, const u8t* pData, size_t nSize, u32t nWidth, u32t nHeight,
+			OImageRef& ref) override;
+		bool AddImagePixels(u64t nKey, u32t nWidth, u32t nHeight, bool bAlpha, const RowSource& fnRows,
+			OImageRef& ref) override;
+		bool BeginSymbol(u64t nKey, const ORect& rcBounds, OImageRef& ref) override;
+		void EndSymbol() override;
+
+		// Content stream of the page, or of the form XObjects being drawn
+		struct OContent
+		{
+			std::string	strData;
+			u32t		nObj;
+			ORect		rcBBox;
+			// Of the space patterns are given in, the default space of the page
+			OMatrix		mtxBase;
+		};
+
+		struct OStreamJob
+		{
+			u32t				nObj;
+			std::string			strDict;	// entries but the filter and length
+			std::string			strData;
+			std::vector<u8t>	vData;		// compressed
+			bool				bDone = false;
+		};
+
+		inline std::string& Content() { return m_vContents.back().strData; }
+		inline u64t GetOffset() const { return m_nOffset + m_out.size(); }
+
+		// Hands the output to the sink once there's enough of it
+		inline void Written()
+		{
+			if (m_out.size() >= FlushSize)
+				Flush();
+		}
+
+		bool Flush();
+		void Write(const void* pData, size_t nSize);
+
+		u32t NewObject();
+		void BeginObject(u32t nObj);
+		void WriteObject(u32t nObj, const std::string& strBody);
+		// strLength is the length or a reference to the object written with it after the stream
+		void BeginStream(u32t nObj, const std::string& strDict, const std::string& strLength);
+		void EndStream();
+		void WriteStream(u32t nObj, const std::string& strDict, const void* pData, size_t nSize);
+		// Compressed by bands, the alpha to the mask if bMask, the colors otherwise
+		void WriteImagePixels(u32t nObj, const std::string& strDict, u32t nWidth, u32t nHeight,
+			const RowSource& fnRows, bool bMask);
+
+		// Compresses the stream on the pool, written once those queued before are
+		void QueueStream(u32t nObj, std::string strDict, std::string strData);
+		void WriteStreams(size_t nKeep);
+		// Queues the page content drawn so far, once there's enough of it
+		void Drawn();
+
+		// Name of the resource whose object is strBody, written first if new
+		std::string GetResource(std::string& strEntries, char chPrefix, const std::string& strBody);
+		u32t AddResource(std::string& strEntries, char chPrefix, u64t nKey, u32t nObj);
+
+		// Operators setting the paint, for fills or strokes, drawn with mtx
+		void AppendPaint(std::string& strOps, const OPaint& paint, bool bStroke, const OMatrix& mtx);
+		std::string GetAlphaState(double fFill, double fStroke);
+		std::string GetPatternName(const OPaint& paint, const OMatrix& mtx);
+		std::string GetFontName(const OTextRun& run, double& fAdvance);
+	private:
+		Sink									m_sink;
+		unsigned								m_nThreads;
+		std::string								m_out;
+		u64t									m_nOffset = 0;
+		std::vector<u64t>						m_vOffsets;
+		std::vector<OContent>					m_vContents;
+		std::vector<u32t>						m_vPageStreams;
+		ORect									m_rcPage{};
+		// Resource dictionary entries, shared by the page, forms and patterns
+		std::string								m_strXObjects;
+		std::string								m_strPatterns;
+		std::string								m_strStates;
+		std::string								m_strFonts;
+		std::unordered_map<u64t, u32t>			m_mapResources;
+		u32t									m_nNextId = 1;
+		std::unique_ptr<ThreadPool>				m_pPool;
+		std::deque<std::unique_ptr<OStreamJob>>	m_qJobs;
+		std::mutex								m_mtxJobs;
+		std::condition_variable					m_cvJob;
+		bool									m_bFailed = false;
+	};
+}
+
+#endif // _ENABLE_GDIPLUS_STRUCT
+
+#endif // EMF_PDF_H
@@ -0,0 +1,807 @@
+#include PCH_FNAME
+#ifdef _ENABLE_GDIPLUS_STRUCT
+
+#include "EmfPixelConvert.h"
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	#define EMFPIXEL_X86
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define EMFPIXEL_AVX2
+	#else
+		#include <cpuid.h>
+		#define EMFPIXEL_AVX2	__attribute__((target("avx2")))
+	#endif
+#endif
+
+#pragma push_macro("min")
+#pragma push_macro("max")
+#undef max
+#undef min
+
+namespace emfpixel
+{
+
+// Row kernels convert nWidth pixels starting at pSrc. The SIMD ones return
+// how many pixels they converted, the rest is left to the scalar kernel.
+// pLUT is the premultiplied palette (256 entries, output order) for the
+// indexed formats.
+using RowFunc	= void (*)(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t* pLUT);
+using SimdFunc	= i32t (*)(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t* pLUT);
+
+static inline u32t _Div255(u32t x)
+{
+	// Rounded x / 255, exact for x <= 255 * 255
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+template <bool BGRA>
+static inline u32t _Pack(u32t r, u32t g, u32t b, u32t a)
+{
+	return BGRA ? (b | (g << 8) | (r << 16) | (a << 24)) : (r | (g << 8) | (b << 16) | (a << 24));
+}
+
+template <bool BGRA>
+static inline u32t _PackPremultiplied(u32t r, u32t g, u32t b, u32t a)
+{
+	return _Pack<BGRA>(_Div255(r * a), _Div255(g * a), _Div255(b * a), a);
+}
+
+static inline void _Store(u8t* pDst, u32t nPixel)
+{
+	memcpy(pDst, &nPixel, sizeof(nPixel));
+}
+
+static inline u16t _Load16(const u8t* pSrc)
+{
+	u16t val;
+	memcpy(&val, pSrc, sizeof(val));
+	return val;
+}
+
+static inline u32t _Expand5(u32t v) { return (v << 3) | (v >> 2); }
+static inline u32t _Expand6(u32t v) { return (v << 2) | (v >> 4); }
+
+// GDI+ 48/64bpp components are linear, 0..8192
+constexpr u32t LinearOne = 8192;
+
+static const u8t* _GetLinearToSRGB()
+{
+	static const auto lut = []()
+	{
+		std::array<u8t, LinearOne + 1> lut;
+		for (size_t ii = 0; ii <= LinearOne; ++ii)
+		{
+			double v = (double)ii / LinearOne;
+			v = v <= 0.0031308 ? v * 12.92 : 1.055 * std::pow(v, 1.0 / 2.4) - 0.055;
+			lut[ii] = (u8t)std::lround(v * 255.0);
+		}
+		return lut;
+	}();
+	return lut.data();
+}
+
+static inline u32t _LinearAlpha(u32t a)
+{
+	return (std::min(a, (u32t)LinearOne) * 255 + LinearOne / 2) / LinearOne;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Scalar reference kernels
+
+template <bool BGRA>
+static void _Row1bpp(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t* pLUT)
+{
+	for (i32t x = 0; x < nWidth; ++x, pDst += 4)
+		_Store(pDst, pLUT[(pSrc[x >> 3] >> (7 - (x & 7))) & 1]);
+}
+
+template <bool BGRA>
+static void _Row4bpp(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t* pLUT)
+{
+	for (i32t x = 0; x < nWidth; ++x, pDst += 4)
+		_Store(pDst, pLUT[(x & 1) ? (pSrc[x >> 1] & 0x0F) : (pSrc[x >> 1] >> 4)]);
+}
+
+template <bool BGRA>
+static void _Row8bpp(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t* pLUT)
+{
+	for (i32t x = 0; x < nWidth; ++x, pDst += 4)
+		_Store(pDst, pLUT[pSrc[x]]);
+}
+
+template <bool BGRA>
+static void _RowGray16(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t*)
+{
+	for (i32t x = 0; x < nWidth; ++x, pSrc += 2, pDst += 4)
+	{
+		u32t v = _Load16(pSrc) >> 8;
+		_Store(pDst, _Pack<BGRA>(v, v, v, 255));
+	}
+}
+
+template <bool BGRA>
+static void _Row555(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t*)
+{
+	for (i32t x = 0; x < nWidth; ++x, pSrc += 2, pDst += 4)
+	{
+		u32t v = _Load16(pSrc);
+		_Store(pDst, _Pack<BGRA>(_Expand5((v >> 10) & 0x1F), _Expand5((v >> 5) & 0x1F), _Expand5(v & 0x1F), 255));
+	}
+}
+
+template <bool BGRA>
+static void _Row565(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t*)
+{
+	for (i32t x = 0; x < nWidth; ++x, pSrc += 2, pDst += 4)
+	{
+		u32t v = _Load16(pSrc);
+		_Store(pDst, _Pack<BGRA>(_Expand5(v >> 11), _Expand6((v >> 5) & 0x3F), _Expand5(v & 0x1F), 255));
+	}
+}
+
+template <bool BGRA>
+static void _Row1555(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t*)
+{
+	for (i32t x = 0; x < nWidth; ++x, pSrc += 2, pDst += 4)
+	{
+		u32t v = _Load16(pSrc);
+		// A 1-bit alpha premultiplies to either the color or transparent black
+		u32t nPixel = 0;
+		if (v & 0x8000)
+			nPixel = _Pack<BGRA>(_Expand5((v >> 10) & 0x1F), _Expand5((v >> 5) & 0x1F), _Expand5(v & 0x1F), 255);
+		_Store(pDst, nPixel);
+	}
+}
+
+template <bool BGRA>
+static void _Row24(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t*)
+{
+	for (i32t x = 0; x < nWidth; ++x, pSrc += 3, pDst += 4)
+		_Store(pDst, _Pack<BGRA>(pSrc[2], pSrc[1], pSrc[0], 255));
+}
+
+template <bool BGRA>
+static void _Row32RGB(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t*)
+{
+	for (i32t x = 0; x < nWidth; ++x, pSrc += 4, pDst += 4)
+		_Store(pDst, _Pack<BGRA>(pSrc[2], pSrc[1], pSrc[0], 255));
+}
+
+template <bool BGRA>
+static void _Row32ARGB(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t*)
+{
+	for (i32t x = 0; x < nWidth; ++x, pSrc += 4, pDst += 4)
+		_Store(pDst, _PackPremultiplied<BGRA>(pSrc[2], pSrc[1], pSrc[0], pSrc[3]));
+}
+
+template <bool BGRA>
+static void _Row32PARGB(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t*)
+{
+	if (BGRA)
+	{
+		memcpy(pDst, pSrc, (size_t)nWidth * 4);
+		return;
+	}
+	for (i32t x = 0; x < nWidth; ++x, pSrc += 4, pDst += 4)
+		_Store(pDst, _Pack<BGRA>(pSrc[2], pSrc[1], pSrc[0], pSrc[3]));
+}
+
+template <bool BGRA>
+static void _Row48(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t*)
+{
+	auto pGamma = _GetLinearToSRGB();
+	for (i32t x = 0; x < nWidth; ++x, pSrc += 6, pDst += 4)
+	{
+		u32t b = std::min<u32t>(_Load16(pSrc), LinearOne);
+		u32t g = std::min<u32t>(_Load16(pSrc + 2), LinearOne);
+		u32t r = std::min<u32t>(_Load16(pSrc + 4), LinearOne);
+		_Store(pDst, _Pack<BGRA>(pGamma[r], pGamma[g], pGamma[b], 255));
+	}
+}
+
+template <bool BGRA>
+static void _Row64ARGB(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t*)
+{
+	auto pGamma = _GetLinearToSRGB();
+	for (i32t x = 0; x < nWidth; ++x, pSrc += 8, pDst += 4)
+	{
+		u32t b = std::min<u32t>(_Load16(pSrc), LinearOne);
+		u32t g = std::min<u32t>(_Load16(pSrc + 2), LinearOne);
+		u32t r = std::min<u32t>(_Load16(pSrc + 4), LinearOne);
+		u32t a = _LinearAlpha(_Load16(pSrc + 6));
+		_Store(pDst, _PackPremultiplied<BGRA>(pGamma[r], pGamma[g], pGamma[b], a));
+	}
+}
+
+template <bool BGRA>
+static void _Row64PARGB(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t*)
+{
+	// Premultiplied in linear space: unpremultiply, gamma encode and premultiply again
+	auto pGamma = _GetLinearToSRGB();
+	for (i32t x = 0; x < nWidth; ++x, pSrc += 8, pDst += 4)
+	{
+		u32t aLinear = std::min<u32t>(_Load16(pSrc + 6), LinearOne);
+		u32t nPixel = 0;
+		if (aLinear)
+		{
+			auto Unpremultiply = [aLinear](u32t c)
+			{
+				return std::min<u32t>((c * LinearOne + aLinear / 2) / aLinear, LinearOne);
+			};
+			u32t b = Unpremultiply(_Load16(pSrc));
+			u32t g = Unpremultiply(_Load16(pSrc + 2));
+			u32t r = Unpremultiply(_Load16(pSrc + 4));
+			nPixel = _PackPremultiplied<BGRA>(pGamma[r], pGamma[g], pGamma[b], _LinearAlpha(aLinear));
+		}
+		_Store(pDst, nPixel);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// SSE2/AVX2
+
+#ifdef EMFPIXEL_X86
+
+// 0xAARRGGBB <-> 0xAABBGGRR
+static inline __m128i _SwapRB_SSE2(__m128i x)
+{
+	const __m128i mAG = _mm_set1_epi32((int)0xFF00FF00);
+	const __m128i mLow = _mm_set1_epi32(0xFF);
+	__m128i r = _mm_and_si128(_mm_srli_epi32(x, 16), mLow);
+	__m128i b = _mm_slli_epi32(_mm_and_si128(x, mLow), 16);
+	return _mm_or_si128(_mm_and_si128(x, mAG), _mm_or_si128(r, b));
+}
+
+// Premultiplies the BGR channels of 4 BGRA pixels, alpha is kept
+static inline __m128i _Premultiply_SSE2(__m128i x)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i c128 = _mm_set1_epi16(128);
+	const __m128i mA = _mm_set1_epi32((int)0xFF000000);
+	__m128i lo = _mm_unpacklo_epi8(x, zero);
+	__m128i hi = _mm_unpackhi_epi8(x, zero);
+	__m128i alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xFF), 0xFF);
+	__m128i ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xFF), 0xFF);
+	lo = _mm_add_epi16(_mm_mullo_epi16(lo, alo), c128);
+	hi = _mm_add_epi16(_mm_mullo_epi16(hi, ahi), c128);
+	lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+	hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+	__m128i res = _mm_packus_epi16(lo, hi);
+	return _mm_or_si128(_mm_andnot_si128(mA, res), _mm_and_si128(mA, x));
+}
+
+template <bool BGRA>
+static inline __m128i _FromBGRA_SSE2(__m128i x)
+{
+	return BGRA ? x : _SwapRB_SSE2(x);
+}
+
+template <bool BGRA>
+static i32t _Row32RGB_SSE2(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t*)
+{
+	const __m128i mA = _mm_set1_epi32((int)0xFF000000);
+	i32t x = 0;
+	for (; x + 4 <= nWidth; x += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(pSrc + x * 4));
+		_mm_storeu_si128((__m128i*)(pDst + x * 4), _FromBGRA_SSE2<BGRA>(_mm_or_si128(v, mA)));
+	}
+	return x;
+}
+
+template <bool BGRA>
+static i32t _Row32ARGB_SSE2(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t*)
+{
+	i32t x = 0;
+	for (; x + 4 <= nWidth; x += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(pSrc + x * 4));
+		_mm_storeu_si128((__m128i*)(pDst + x * 4), _FromBGRA_SSE2<BGRA>(_Premultiply_SSE2(v)));
+	}
+	return x;
+}
+
+template <bool BGRA>
+static i32t _Row32PARGB_SSE2(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t*)
+{
+	i32t x = 0;
+	for (; x + 4 <= nWidth; x += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(pSrc + x * 4));
+		_mm_storeu_si128((__m128i*)(pDst + x * 4), _FromBGRA_SSE2<BGRA>(v));
+	}
+	return x;
+}
+
+enum Mode16
+{
+	Mode555,
+	Mode565,
+	Mode1555,
+};
+
+template <bool BGRA, int Mode>
+static i32t _Row16_SSE2(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t*)
+{
+	const __m128i m5 = _mm_set1_epi16(0x1F);
+	const __m128i m6 = _mm_set1_epi16(0x3F);
+	const __m128i mFF = _mm_set1_epi16(0xFF);
+	auto Expand5 = [](__m128i v) { return _mm_or_si128(_mm_slli_epi16(v, 3), _mm_srli_epi16(v, 2)); };
+	i32t x = 0;
+	for (; x + 8 <= nWidth; x += 8)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(pSrc + x * 2));
+		__m128i r, g, a;
+		__m128i b = Expand5(_mm_and_si128(v, m5));
+		if (Mode == Mode565)
+		{
+			g = _mm_and_si128(_mm_srli_epi16(v, 5), m6);
+			g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+			r = Expand5(_mm_srli_epi16(v, 11));
+		}
+		else
+		{
+			g = Expand5(_mm_and_si128(_mm_srli_epi16(v, 5), m5));
+			r = Expand5(_mm_and_si128(_mm_srli_epi16(v, 10), m5));
+		}
+		if (Mode == Mode1555)
+		{
+			a = _mm_and_si128(_mm_srai_epi16(v, 15), mFF);
+			r = _mm_and_si128(r, a);
+			g = _mm_and_si128(g, a);
+			b = _mm_and_si128(b, a);
+		}
+		else
+			a = mFF;
+		__m128i c01 = _mm_or_si128(BGRA ? b : r, _mm_slli_epi16(g, 8));
+		__m128i c23 = _mm_or_si128(BGRA ? r : b, _mm_slli_epi16(a, 8));
+		_mm_storeu_si128((__m128i*)(pDst + x * 4), _mm_unpacklo_epi16(c01, c23));
+		_mm_storeu_si128((__m128i*)(pDst + x * 4 + 16), _mm_unpackhi_epi16(c01, c23));
+	}
+	return x;
+}
+
+template <bool BGRA>
+static EMFPIXEL_AVX2 inline __m256i _FromBGRA_AVX2(__m256i x)
+{
+	if (BGRA)
+		return x;
+	const __m256i mSwap = _mm256_setr_epi8(
+		2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+		2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	return _mm256_shuffle_epi8(x, mSwap);
+}
+
+static EMFPIXEL_AVX2 inline __m256i _Premultiply_AVX2(__m256i x)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i c128 = _mm256_set1_epi16(128);
+	const __m256i mA = _mm256_set1_epi32((int)0xFF000000);
+	__m256i lo = _mm256_unpacklo_epi8(x, zero);
+	__m256i hi = _mm256_unpackhi_epi8(x, zero);
+	__m256i alo = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(lo, 0xFF), 0xFF);
+	__m256i ahi = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(hi, 0xFF), 0xFF);
+	lo = _mm256_add_epi16(_mm256_mullo_epi16(lo, alo), c128);
+	hi = _mm256_add_epi16(_mm256_mullo_epi16(hi, ahi), c128);
+	lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+	hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+	__m256i res = _mm256_packus_epi16(lo, hi);
+	return _mm256_or_si256(_mm256_andnot_si256(mA, res), _mm256_and_si256(mA, x));
+}
+
+template <bool BGRA>
+static EMFPIXEL_AVX2 i32t _Row32RGB_AVX2(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t*)
+{
+	const __m256i mA = _mm256_set1_epi32((int)0xFF000000);
+	i32t x = 0;
+	for (; x + 8 <= nWidth; x += 8)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)(pSrc + x * 4));
+		_mm256_storeu_si256((__m256i*)(pDst + x * 4), _FromBGRA_AVX2<BGRA>(_mm256_or_si256(v, mA)));
+	}
+	return x;
+}
+
+template <bool BGRA>
+static EMFPIXEL_AVX2 i32t _Row32ARGB_AVX2(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t*)
+{
+	i32t x = 0;
+	for (; x + 8 <= nWidth; x += 8)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)(pSrc + x * 4));
+		_mm256_storeu_si256((__m256i*)(pDst + x * 4), _FromBGRA_AVX2<BGRA>(_Premultiply_AVX2(v)));
+	}
+	return x;
+}
+
+template <bool BGRA>
+static EMFPIXEL_AVX2 i32t _Row32PARGB_AVX2(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t*)
+{
+	i32t x = 0;
+	for (; x + 8 <= nWidth; x += 8)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)(pSrc + x * 4));
+		_mm256_storeu_si256((__m256i*)(pDst + x * 4), _FromBGRA_AVX2<BGRA>(v));
+	}
+	return x;
+}
+
+template <bool BGRA>
+static EMFPIXEL_AVX2 i32t _Row24_AVX2(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t*)
+{
+	// Each 128-bit lane takes 4 pixels (12 of the 16 bytes loaded)
+	const __m256i mShuffle = BGRA
+		? _mm256_setr_epi8(
+			0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+			0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1)
+		: _mm256_setr_epi8(
+			2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1,
+			2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+	const __m256i mA = _mm256_set1_epi32((int)0xFF000000);
+	i32t x = 0;
+	// The second load reads 4 bytes past the 8 pixels
+	for (; x + 10 <= nWidth; x += 8)
+	{
+		__m128i lo = _mm_loadu_si128((const __m128i*)(pSrc + x * 3));
+		__m128i hi = _mm_loadu_si128((const __m128i*)(pSrc + x * 3 + 12));
+		__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+		_mm256_storeu_si256((__m256i*)(pDst + x * 4), _mm256_or_si256(_mm256_shuffle_epi8(v, mShuffle), mA));
+	}
+	return x;
+}
+
+template <bool BGRA, int Mode>
+static EMFPIXEL_AVX2 i32t _Row16_AVX2(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t*)
+{
+	const __m256i m5 = _mm256_set1_epi16(0x1F);
+	const __m256i m6 = _mm256_set1_epi16(0x3F);
+	const __m256i mFF = _mm256_set1_epi16(0xFF);
+	i32t x = 0;
+	for (; x + 16 <= nWidth; x += 16)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)(pSrc + x * 2));
+		__m256i r, g, a;
+		__m256i b = _mm256_and_si256(v, m5);
+		b = _mm256_or_si256(_mm256_slli_epi16(b, 3), _mm256_srli_epi16(b, 2));
+		if (Mode == Mode565)
+		{
+			g = _mm256_and_si256(_mm256_srli_epi16(v, 5), m6);
+			g = _mm256_or_si256(_mm256_slli_epi16(g, 2), _mm256_srli_epi16(g, 4));
+			r = _mm256_srli_epi16(v, 11);
+		}
+		else
+		{
+			g = _mm256_and_si256(_mm256_srli_epi16(v, 5), m5);
+			g = _mm256_or_si256(_mm256_slli_epi16(g, 3), _mm256_srli_epi16(g, 2));
+			r = _mm256_and_si256(_mm256_srli_epi16(v, 10), m5);
+		}
+		r = _mm256_or_si256(_mm256_slli_epi16(r, 3), _mm256_srli_epi16(r, 2));
+		if (Mode == Mode1555)
+		{
+			a = _mm256_and_si256(_mm256_srai_epi16(v, 15), mFF);
+			r = _mm256_and_si256(r, a);
+			g = _mm256_and_si256(g, a);
+			b = _mm256_and_si256(b, a);
+		}
+		else
+			a = mFF;
+		__m256i c01 = _mm256_or_si256(BGRA ? b : r, _mm256_slli_epi16(g, 8));
+		__m256i c23 = _mm256_or_si256(BGRA ? r : b, _mm256_slli_epi16(a, 8));
+		// unpack works within 128-bit lanes: lo = pixels 0-3 | 8-11, hi = 4-7 | 12-15
+		__m256i lo = _mm256_unpacklo_epi16(c01, c23);
+		__m256i hi = _mm256_unpackhi_epi16(c01, c23);
+		_mm256_storeu_si256((__m256i*)(pDst + x * 4), _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((__m256i*)(pDst + x * 4 + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+	return x;
+}
+
+template <bool BGRA>
+static EMFPIXEL_AVX2 i32t _Row8bpp_AVX2(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t* pLUT)
+{
+	i32t x = 0;
+	for (; x + 8 <= nWidth; x += 8)
+	{
+		__m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(pSrc + x)));
+		_mm256_storeu_si256((__m256i*)(pDst + x * 4), _mm256_i32gather_epi32((const int*)pLUT, idx, 4));
+	}
+	return x;
+}
+
+// The indexed kernels look up pLUT, which is already in output order
+
+template <bool BGRA>
+static i32t _Row1bpp_SSE2(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t* pLUT)
+{
+	const __m128i mBitsHi = _mm_setr_epi32(0x80, 0x40, 0x20, 0x10);
+	const __m128i mBitsLo = _mm_setr_epi32(0x08, 0x04, 0x02, 0x01);
+	const __m128i c0 = _mm_set1_epi32((int)pLUT[0]);
+	const __m128i c1 = _mm_set1_epi32((int)pLUT[1]);
+	auto Select = [&c0, &c1](__m128i m) { return _mm_or_si128(_mm_and_si128(m, c1), _mm_andnot_si128(m, c0)); };
+	i32t x = 0;
+	for (; x + 8 <= nWidth; x += 8)
+	{
+		__m128i v = _mm_set1_epi32(pSrc[x >> 3]);
+		_mm_storeu_si128((__m128i*)(pDst + x * 4), Select(_mm_cmpeq_epi32(_mm_and_si128(v, mBitsHi), mBitsHi)));
+		_mm_storeu_si128((__m128i*)(pDst + x * 4 + 16), Select(_mm_cmpeq_epi32(_mm_and_si128(v, mBitsLo), mBitsLo)));
+	}
+	return x;
+}
+
+template <bool BGRA>
+static EMFPIXEL_AVX2 i32t _Row1bpp_AVX2(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t* pLUT)
+{
+	const __m256i mBits = _mm256_setr_epi32(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+	const __m256i c0 = _mm256_set1_epi32((int)pLUT[0]);
+	const __m256i c1 = _mm256_set1_epi32((int)pLUT[1]);
+	i32t x = 0;
+	for (; x + 8 <= nWidth; x += 8)
+	{
+		__m256i m = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(pSrc[x >> 3]), mBits), mBits);
+		_mm256_storeu_si256((__m256i*)(pDst + x * 4), _mm256_blendv_epi8(c0, c1, m));
+	}
+	return x;
+}
+
+template <bool BGRA>
+static EMFPIXEL_AVX2 i32t _Row4bpp_AVX2(const u8t* pSrc, u8t* pDst, i32t nWidth, const u32t* pLUT)
+{
+	if (nWidth < 16)
+		return 0;
+	// Split the 16 palette entries into byte planes, so each channel is a single pshufb
+	const __m128i mPlanes = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+	__m128i l0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)pLUT), mPlanes);
+	__m128i l1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(pLUT + 4)), mPlanes);
+	__m128i l2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(pLUT + 8)), mPlanes);
+	__m128i l3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(pLUT + 12)), mPlanes);
+	__m128i t0 = _mm_unpacklo_epi32(l0, l1), t1 = _mm_unpacklo_epi32(l2, l3);
+	__m128i t2 = _mm_unpackhi_epi32(l0, l1), t3 = _mm_unpackhi_epi32(l2, l3);
+	const __m128i p0 = _mm_unpacklo_epi64(t0, t1), p1 = _mm_unpackhi_epi64(t0, t1);
+	const __m128i p2 = _mm_unpacklo_epi64(t2, t3), p3 = _mm_unpackhi_epi64(t2, t3);
+
+	const __m128i m0F = _mm_set1_epi8(0x0F);
+	i32t x = 0;
+	for (; x + 16 <= nWidth; x += 16)
+	{
+		__m128i v = _mm_loadl_epi64((const __m128i*)(pSrc + (x >> 1)));
+		// The high nibble is the first pixel
+		__m128i idx = _mm_unpacklo_epi8(_mm_and_si128(_mm_srli_epi16(v, 4), m0F), _mm_and_si128(v, m0F));
+		__m128i c0 = _mm_shuffle_epi8(p0, idx), c1 = _mm_shuffle_epi8(p1, idx);
+		__m128i c2 = _mm_shuffle_epi8(p2, idx), c3 = _mm_shuffle_epi8(p3, idx);
+		__m128i c01 = _mm_unpacklo_epi8(c0, c1), c23 = _mm_unpacklo_epi8(c2, c3);
+		_mm_storeu_si128((__m128i*)(pDst + x * 4), _mm_unpacklo_epi16(c01, c23));
+		_mm_storeu_si128((__m128i*)(pDst + x * 4 + 16), _mm_unpackhi_epi16(c01, c23));
+		c01 = _mm_unpackhi_epi8(c0, c1);
+		c23 = _mm_unpackhi_epi8(c2, c3);
+		_mm_storeu_si128((__m128i*)(pDst + x * 4 + 32), _mm_unpacklo_epi16(c01, c23));
+		_mm_storeu_si128((__m128i*)(pDst + x * 4 + 48), _mm_unpackhi_epi16(c01, c23));
+	}
+	return x;
+}
+
+#endif // EMFPIXEL_X86
+
+//////////////////////////////////////////////////////////////////////////
+// Dispatch
+
+struct FormatKernels
+{
+	OPixelFormat	nFormat;
+	RowFunc			pScalar[2];		// [RGBA, BGRA]
+	SimdFunc		pSSE2[2];
+	SimdFunc		pAVX2[2];
+};
+
+#define EMFPIXEL_ROW(_fn)	{ _fn<false>, _fn<true> }
+#define EMFPIXEL_NONE		{ nullptr, nullptr }
+
+#ifdef EMFPIXEL_X86
+	#define EMFPIXEL_SSE2_ROW(_fn)			{ _fn<false>, _fn<true> }
+	#define EMFPIXEL_SSE2_ROW16(_mode)		{ _Row16_SSE2<false, _mode>, _Row16_SSE2<true, _mode> }
+	#define EMFPIXEL_AVX2_ROW(_fn)			{ _fn<false>, _fn<true> }
+	#define EMFPIXEL_AVX2_ROW16(_mode)		{ _Row16_AVX2<false, _mode>, _Row16_AVX2<true, _mode> }
+#else
+	#define EMFPIXEL_SSE2_ROW(_fn)			EMFPIXEL_NONE
+	#define EMFPIXEL_SSE2_ROW16(_mode)		EMFPIXEL_NONE
+	#define EMFPIXEL_AVX2_ROW(_fn)			EMFPIXEL_NONE
+	#define EMFPIXEL_AVX2_ROW16(_mode)		EMFPIXEL_NONE
+#endif // EMFPIXEL_X86
+
+static const FormatKernels s_aKernels[] =
+{
+	{ OPixelFormat::Format1bppIndexed,		EMFPIXEL_ROW(_Row1bpp),		EMFPIXEL_SSE2_ROW(_Row1bpp_SSE2),		EMFPIXEL_AVX2_ROW(_Row1bpp_AVX2) },
+	{ OPixelFormat::Format4bppIndexed,		EMFPIXEL_ROW(_Row4bpp),		EMFPIXEL_NONE,							EMFPIXEL_AVX2_ROW(_Row4bpp_AVX2) },
+	{ OPixelFormat::Format8bppIndexed,		EMFPIXEL_ROW(_Row8bpp),		EMFPIXEL_NONE,							EMFPIXEL_AVX2_ROW(_Row8bpp_AVX2) },
+	{ OPixelFormat::Format16bppGrayScale,	EMFPIXEL_ROW(_RowGray16),	EMFPIXEL_NONE,							EMFPIXEL_NONE },
+	{ OPixelFormat::Format16bppRGB555,		EMFPIXEL_ROW(_Row555),		EMFPIXEL_SSE2_ROW16(Mode555),			EMFPIXEL_AVX2_ROW16(Mode555) },
+	{ OPixelFormat::Format16bppRGB565,		EMFPIXEL_ROW(_Row565),		EMFPIXEL_SSE2_ROW16(Mode565),			EMFPIXEL_AVX2_ROW16(Mode565) },
+	{ OPixelFormat::Format16bppARGB1555,	EMFPIXEL_ROW(_Row1555),		EMFPIXEL_SSE2_ROW16(Mode1555),			EMFPIXEL_AVX2_ROW16(Mode1555) },
+	{ OPixelFormat::Format24bppRGB,			EMFPIXEL_ROW(_Row24),		EMFPIXEL_NONE,							EMFPIXEL_AVX2_ROW(_Row24_AVX2) },
+	{ OPixelFormat::Format32bppRGB,			EMFPIXEL_ROW(_Row32RGB),	EMFPIXEL_SSE2_ROW(_Row32RGB_SSE2),		EMFPIXEL_AVX2_ROW(_Row32RGB_AVX2) },
+	{ OPixelFormat::Format32bppARGB,		EMFPIXEL_ROW(_Row32ARGB),	EMFPIXEL_SSE2_ROW(_Row32ARGB_SSE2),		EMFPIXEL_AVX2_ROW(_Row32ARGB_AVX2) },
+	{ OPixelFormat::Format32bppPARGB,		EMFPIXEL_ROW(_Row32PARGB),	EMFPIXEL_SSE2_ROW(_Row32PARGB_SSE2),	EMFPIXEL_AVX2_ROW(_Row32PARGB_AVX2) },
+	{ OPixelFormat::Format48bppRGB,			EMFPIXEL_ROW(_Row48),		EMFPIXEL_NONE,							EMFPIXEL_NONE },
+	{ OPixelFormat::Format64bppARGB,		EMFPIXEL_ROW(_Row64ARGB),	EMFPIXEL_NONE,							EMFPIXEL_NONE },
+	{ OPixelFormat::Format64bppPARGB,		EMFPIXEL_ROW(_Row64PARGB),	EMFPIXEL_NONE,							EMFPIXEL_NONE },
+};
+
+static const FormatKernels* _FindKernels(OPixelFormat nFormat)
+{
+	for (auto& kernels : s_aKernels)
+	{
+		if (kernels.nFormat == nFormat)
+			return &kernels;
+	}
+	return nullptr;
+}
+
+static SimdLevel _DetectSimdLevel()
+{
+#if defined(EMFPIXEL_X86)
+	unsigned aInfo[4] = { 0 };
+	auto CpuId = [&aInfo](unsigned nLeaf)
+	{
+	#ifdef _MSC_VER
+		__cpuidex((int*)aInfo, (int)nLeaf, 0);
+	#else
+		__cpuid_count(nLeaf, 0, aInfo[0], aInfo[1], aInfo[2], aInfo[3]);
+	#endif
+	};
+	CpuId(0);
+	unsigned nMaxLeaf = aInfo[0];
+	CpuId(1);
+	if (!(aInfo[3] & (1u << 26)))
+		return SimdLevel::Scalar;
+	bool bOSXSave = (aInfo[2] & (1u << 27)) != 0;
+	bool bAVX = (aInfo[2] & (1u << 28)) != 0;
+	if (nMaxLeaf < 7 || !bOSXSave || !bAVX)
+		return SimdLevel::SSE2;
+	// The OS must save the YMM registers
+	#ifdef _MSC_VER
+	unsigned long long nXCR0 = _xgetbv(0);
+	#else
+	unsigned nXCR0Lo, nXCR0Hi;
+	__asm__ volatile("xgetbv" : "=a"(nXCR0Lo), "=d"(nXCR0Hi) : "c"(0));
+	unsigned long long nXCR0 = ((unsigned long long)nXCR0Hi << 32) | nXCR0Lo;
+	#endif
+	if ((nXCR0 & 6) != 6)
+		return SimdLevel::SSE2;
+	CpuId(7);
+	return (aInfo[1] & (1u << 5)) ? SimdLevel::AVX2 : SimdLevel::SSE2;
+#else
+	return SimdLevel::Scalar;
+#endif
+}
+
+static SimdLevel _GetDetectedSimdLevel()
+{
+	static const SimdLevel nLevel = _DetectSimdLevel();
+	return nLevel;
+}
+
+static std::atomic<SimdLevel> s_nMaxSimdLevel{ SimdLevel::AVX2 };
+
+SimdLevel GetSimdLevel()
+{
+	return std::min(_GetDetectedSimdLevel(), s_nMaxSimdLevel.load());
+}
+
+SimdLevel SetMaxSimdLevel(SimdLevel nLevel)
+{
+	s_nMaxSimdLevel = nLevel;
+	return GetSimdLevel();
+}
+
+bool IsSupportedFormat(OPixelFormat nFormat)
+{
+	return _FindKernels(nFormat) != nullptr;
+}
+
+bool ConvertToPremultiplied(OPixelFormat nFormat, i32t nWidth, i32t nHeight, i32t nStride,
+	const u8t* pSrc, size_t nSrcSize, const u32t* pPalette, size_t nPaletteCount,
+	u8t* pDst, ptrdiff_t nDstStride, PixelOrder nOrder)
+{
+	auto pKernels = _FindKernels(nFormat);
+	if (!pKernels || nWidth <= 0 || nHeight <= 0 || !pSrc || !pDst)
+		return false;
+	size_t nRowSize = GetRowSize(nFormat, nWidth);
+	size_t nAbsStride = nStride < 0 ? (size_t)-(i64t)nStride : (size_t)nStride;
+	// OEmfPlusBitmap: the stride must cover a scanline and be a multiple of 4.
+	// It comes from the record, so one that isn't fails the conversion.
+	if (nAbsStride < nRowSize || nAbsStride % 4 != 0 || (size_t)std::abs(nDstStride) < (size_t)nWidth * 4)
+		return false;
+	if (nSrcSize < nRowSize || (nSrcSize - nRowSize) / nAbsStride < (size_t)(nHeight - 1))
+		return false;
+
+	// Bottom-up data: the first scanline is the last one in memory
+	const u8t* pSrcRow = nStride < 0 ? pSrc + nAbsStride * (nHeight - 1) : pSrc;
+
+	int nOrderIdx = nOrder == PixelOrder::BGRA ? 1 : 0;
+	u32t aLUT[256] = { 0 };
+	if ((u32t)nFormat & (u32t)OPixelFormat::FormatIFlag)
+	{
+		if (!pPalette)
+			nPaletteCount = 0;
+		for (size_t ii = 0; ii < std::min<size_t>(nPaletteCount, 256); ++ii)
+		{
+			u32t argb = pPalette[ii];
+			u32t a = argb >> 24, r = (argb >> 16) & 0xFF, g = (argb >> 8) & 0xFF, b = argb & 0xFF;
+			aLUT[ii] = nOrderIdx ? _PackPremultiplied<true>(r, g, b, a) : _PackPremultiplied<false>(r, g, b, a);
+		}
+	}
+
+	auto pScalar = pKernels->pScalar[nOrderIdx];
+	SimdFunc pSimd = nullptr;
+	switch (GetSimdLevel())
+	{
+	case SimdLevel::AVX2:
+		pSimd = pKernels->pAVX2[nOrderIdx];
+		if (pSimd)
+			break;
+		[[fallthrough]];
+	case SimdLevel::SSE2:
+		pSimd = pKernels->pSSE2[nOrderIdx];
+		break;
+	default:
+		break;
+	}
+	u32t nBitsPerPixel = GetBitsPerPixel(nFormat);
+	for (i32t y = 0; y < nHeight; ++y, pSrcRow += nStride, pDst += nDstStride)
+	{
+		i32t nDone = pSimd ? pSimd(pSrcRow, pDst, nWidth, aLUT) : 0;
+		if (nDone < nWidth)
+		{
+			// SIMD kernels only exist for byte aligned pixels
+			pScalar(pSrcRow + (size_t)nDone * nBitsPerPixel / 8, pDst + (size_t)nDone * 4, nWidth - nDone, aLUT);
+		}
+	}
+	return true;
+}
+
+static inline const OEmfPlusPalette* _GetPalette(const OEmfPlusBitmap& bmp)
+{
+	if (bmp.BitmapData->Colors.is_enabled())
+		return &bmp.BitmapData->Colors.get();
+	return nullptr;
+}
+
+bool ConvertToPremultiplied(const OEmfPlusBitmap& bmp, u8t* pDst, ptrdiff_t nDstStride, PixelOrder nOrder)
+{
+	if (bmp.Type != OBitmapDataType::Pixel || !bmp.BitmapData.is_enabled())
+		return false;
+	auto& pixels = bmp.BitmapData->PixelData;
+	auto pPalette = _GetPalette(bmp);
+	static_assert(sizeof(OEmfPlusARGB) == sizeof(u32t), "palette entries are read as ARGB values");
+	return ConvertToPremultiplied(bmp.PixelFormat, bmp.Width, bmp.Height, bmp.Stride,
+		pixels.data(), pixels.size(),
+		pPalette ? (const u32t*)pPalette->PaletteEntries.data() : nullptr,
+		pPalette ? pPalette->PaletteEntries.size() : 0,
+		pDst, nDstStride, nOrder);
+}
+
+bool ConvertToPremultiplied(const OEmfPlusBitmap& bmp, memory_vector& vOut, PixelOrder nOrder)
+{
+	if (bmp.Width <= 0 || bmp.Height <= 0)
+		return false;
+	vOut.resize((size_t)bmp.Width * bmp.Height * 4);
+	if (!ConvertToPremultiplied(bmp, vOut.data(), (ptrdiff_t)bmp.Width * 4, nOrder))
+	{
+		vOut.clear();
+		return false;
+	}
+	return true;
+}
+
+}
+
+#pragma pop_macro("min")
+#pragma pop_macro("max")
+
+#endif // _ENABLE_GDIPLUS_STRUCT
@@ -0,0 +1,72 @@
+#ifndef EMF_PIXEL_CONVERT_H
+#define EMF_PIXEL_CONVERT_H
+
+#ifdef _ENABLE_GDIPLUS_STRUCT
+
+#include "EmfPlusStruct.h"
+
+// Conversion of uncompressed EMF+ bitmap data (every OPixelFormat) to
+// premultiplied 8-bit RGBA.
+//
+// Each format has a scalar reference kernel, the common ones also have
+// SSE2/AVX2 kernels picked at runtime which produce bit-identical
+// results. 48/64bpp data holds GDI+ linear components (0..8192), it is
+// gamma encoded to sRGB on the way.
+namespace emfpixel
+{
+	using namespace emfplus;
+
+	// Byte order of the 32-bit output pixels
+	enum class PixelOrder
+	{
+		RGBA,
+		BGRA,	// GDI+ PixelFormat32bppPARGB, Win32 DIBs
+	};
+
+	enum class SimdLevel
+	{
+		Scalar,
+		SSE2,
+		AVX2,
+	};
+
+	// Best kernels in effect on this CPU
+	SimdLevel GetSimdLevel();
+
+	// Caps the kernels in use (e.g. to compare against the scalar reference),
+	// returns the level actually in effect.
+	SimdLevel SetMaxSimdLevel(SimdLevel nLevel);
+
+	bool IsSupportedFormat(OPixelFormat nFormat);
+
+	inline u32t GetBitsPerPixel(OPixelFormat nFormat)
+	{
+		return ((u32t)nFormat & (u32t)OPixelFormat::FormatBitsPerPixelMask) >> 8;
+	}
+
+	// Bytes taken by the pixels of one scanline (without padding)
+	inline size_t GetRowSize(OPixelFormat nFormat, i32t nWidth)
+	{
+		return ((size_t)nWidth * GetBitsPerPixel(nFormat) + 7) / 8;
+	}
+
+	// nStride is the byte offset between scanlines as in OEmfPlusBitmap,
+	// negative for bottom-up data; the call fails unless it's a multiple of 4.
+	// pPalette holds the ARGB entries for the indexed formats, missing entries
+	// decode as transparent black.
+	// Output rows are nDstStride bytes apart.
+	bool ConvertToPremultiplied(OPixelFormat nFormat, i32t nWidth, i32t nHeight, i32t nStride,
+		const u8t* pSrc, size_t nSrcSize, const u32t* pPalette, size_t nPaletteCount,
+		u8t* pDst, ptrdiff_t nDstStride, PixelOrder nOrder = PixelOrder::RGBA);
+
+	bool ConvertToPremultiplied(const OEmfPlusBitmap& bmp, u8t* pDst, ptrdiff_t nDstStride,
+		PixelOrder nOrder = PixelOrder::RGBA);
+
+	// Tightly packed output (Width * 4 bytes per row)
+	bool ConvertToPremultiplied(const OEmfPlusBitmap& bmp, memory_vector& vOut,
+		PixelOrder nOrder = PixelOrder::RGBA);
+}
+
+#endif // _ENABLE_GDIPLUS_STRUCT
+
+#endif // EMF_PIXEL_CONVERT_H
@@ -24,15 +24,16 @@ static inline i16t	_ReadEmfPlusPointRInteger(DataReader& reader)
 	reader.ReadBytes(&n1, 1);
 	if (n1 & 0x80)
 	{
-		// must be a EmfPlusInteger15 object
+		// must be a EmfPlusInteger15 object (signed, big-endian)
 		val = (i16t)((n1 & ~0x80) << 8);
 		reader.ReadBytes(&n1, 1);
 		val |= n1;
+		val = (i16t)(val << 1) >> 1;
 	}
 	else
 	{
-		// must be a EmfPlusInteger7 object
-		val = (i16t)(n1 & ~0x80);
+		// must be a EmfPlusInteger7 object (signed)
+		val = (i8t)(n1 << 1) >> 1;
 	}
 	return val;
 }
@@ -43,10 +44,8 @@ void OEmfPlusPointDataArray::Read(DataReader& reader, u32t Count, bool bRelative
 		return;
 	if (bRelative)
 	{
-		// the following code is not tested because I don't know how to make
-		// such case, please verify and remove the assert
-		ASSERT(0);
-		// EmfPlusPointR
+		// EmfPlusPointR, each point is relative to the previous one (the first one to 0,0).
+		// The values are kept as read, i.e. as offsets.
 		// https://docs.microsoft.com/en-us/openspecs/windows_protocols/ms-emfplus/c861a0d4-39f0-4f6c-bad9-e3f7bf63205e
 		ivals.resize((size_t)Count);
 		for (u32t ii = 0; ii < Count; ++ii)
@@ -619,8 +618,6 @@ bool OEmfPlusPalette::Read(DataReader& reader, size_t nExpectedSize)
 
 bool OEmfPlusBitmapData::Read(DataReader& reader, OPixelFormat PixelFormat, size_t nExpectedSize)
 {
-	// TODO, OEmfPlusBitmapData::Read, not tested yet
-	ASSERT(0);
 	ASSERT(nExpectedSize != UNKNOWN_SIZE);
 	ReaderChecker readerCheck(reader, nExpectedSize);
 	if ((u32t)PixelFormat & (u32t)OPixelFormat::FormatIFlag)
@@ -786,6 +783,9 @@ bool OEmfPlusRecDrawBeziers::Read(DataReader& reader, u16t nFlags, size_t nExpec
 	ReaderChecker readerCheck(reader, nExpectedSize);
 	reader.ReadBytes(&Count, sizeof(Count));
 	PointData.Read(reader, Count, FlagP & nFlags, FlagC & nFlags);
+	// EmfPlusPointR data is padded to a 4-byte boundary
+	if (nFlags & FlagP)
+		readerCheck.SkipAlignmentPadding();
 	return true;
 }
 
@@ -795,6 +795,9 @@ bool OEmfPlusRecDrawClosedCurve::Read(DataReader& reader, u16t nFlags, size_t nE
 	reader.ReadBytes(&Tension, sizeof(Tension));
 	reader.ReadBytes(&Count, sizeof(Count));
 	PointData.Read(reader, Count, FlagP & nFlags, FlagC & nFlags);
+	// EmfPlusPointR data is padded to a 4-byte boundary
+	if (nFlags & FlagP)
+		readerCheck.SkipAlignmentPadding();
 	return true;
 }
 
@@ -851,6 +854,9 @@ bool OEmfPlusRecDrawImagePoints::Read(DataReader& reader, u16t nFlags, size_t nE
 	reader.ReadBytes(&Count, sizeof(Count));
 	ASSERT(Count == 3);
 	PointData.Read(reader, Count, FlagP & nFlags, FlagC & nFlags);
+	// EmfPlusPointR data is padded to a 4-byte boundary
+	if (nFlags & FlagP)
+		readerCheck.SkipAlignmentPadding();
 	return true;
 }
 
@@ -859,6 +865,9 @@ bool OEmfPlusRecDrawLines::Read(DataReader& reader, u16t nFlags, size_t nExpecte
 	ReaderChecker readerCheck(reader, nExpectedSize);
 	reader.ReadBytes(&Count, sizeof(Count));
 	PointData.Read(reader, Count, FlagP & nFlags, FlagC & nFlags);
+	// EmfPlusPointR data is padded to a 4-byte boundary
+	if (nFlags & FlagP)
+		readerCheck.SkipAlignmentPadding();
 	return true;
 }
 
@@ -896,6 +905,9 @@ bool OEmfPlusRecFillClosedCurve::Read(DataReader& reader, u16t nFlags, size_t nE
 	reader.ReadBytes(&Tension, sizeof(Tension));
 	reader.ReadBytes(&Count, sizeof(Count));
 	PointData.Read(reader, Count, FlagP & nFlags, FlagC & nFlags);
+	// EmfPlusPointR data is padded to a 4-byte boundary
+	if (nFlags & FlagP)
+		readerCheck.SkipAlignmentPadding();
 	return true;
 }
 
@@ -921,6 +933,9 @@ bool OEmfPlusRecFillPolygon::Read(DataReader& reader, u16t nFlags, size_t nExpec
 	reader.ReadBytes(&BrushId, sizeof(BrushId));
 	reader.ReadBytes(&Count, sizeof(Count));
 	PointData.Read(reader, Count, FlagP & nFlags, FlagC & nFlags);
+	// EmfPlusPointR data is padded to a 4-byte boundary
+	if (nFlags & FlagP)
+		readerCheck.SkipAlignmentPadding();
 	return true;
 }
 
@@ -0,0 +1,443 @@
+#include PCH_FNAME
+
+#include "EmfPng.h"
+#include <cstring>
+#include <cstdlib>
+
+namespace emfpng
+{
+
+//////////////////////////////
+// Checksums
+//////////////////////////////
+
+namespace
+{
+	struct OCrcTable
+	{
+		uint32_t aValues[256];
+
+		OCrcTable()
+		{
+			for (uint32_t ii = 0; ii < 256; ++ii)
+			{
+				uint32_t nVal = ii;
+				for (int jj = 0; jj < 8; ++jj)
+					nVal = (nVal & 1) ? 0xEDB88320 ^ (nVal >> 1) : nVal >> 1;
+				aValues[ii] = nVal;
+			}
+		}
+	};
+
+	constexpr uint32_t AdlerBase = 65521;
+	// Largest n such that 255n(n+1)/2 + (n+1)(AdlerBase-1) fits 32 bits
+	constexpr size_t AdlerMaxRun = 5552;
+}
+
+uint32_t Crc32(uint32_t nCrc, const void* pData, size_t nSize)
+{
+	static const OCrcTable table;
+	auto pBytes = (const uint8_t*)pData;
+	nCrc = ~nCrc;
+	for (size_t ii = 0; ii < nSize; ++ii)
+		nCrc = table.aValues[(nCrc ^ pBytes[ii]) & 0xFF] ^ (nCrc >> 8);
+	return ~nCrc;
+}
+
+uint32_t Adler32(uint32_t nAdler, const void* pData, size_t nSize)
+{
+	auto pBytes = (const uint8_t*)pData;
+	uint32_t nSum1 = nAdler & 0xFFFF;
+	uint32_t nSum2 = nAdler >> 16;
+	while (nSize)
+	{
+		size_t nRun = nSize < AdlerMaxRun ? nSize : AdlerMaxRun;
+		nSize -= nRun;
+		for (; nRun; --nRun)
+		{
+			nSum1 += *pBytes++;
+			nSum2 += nSum1;
+		}
+		nSum1 %= AdlerBase;
+		nSum2 %= AdlerBase;
+	}
+	return nSum1 | (nSum2 << 16);
+}
+
+uint32_t Adler32Combine(uint32_t nAdlerA, uint32_t nAdlerB, size_t nSizeB)
+{
+	// As zlib's adler32_combine
+	uint32_t nRem = (uint32_t)(nSizeB % AdlerBase);
+	uint32_t nSum1 = nAdlerA & 0xFFFF;
+	uint32_t nSum2 = (uint32_t)(((uint64_t)nRem * nSum1) % AdlerBase);
+	nSum1 += (nAdlerB & 0xFFFF) + AdlerBase - 1;
+	nSum2 += (nAdlerA >> 16) + (nAdlerB >> 16) + AdlerBase - nRem;
+	if (nSum1 >= AdlerBase)
+		nSum1 -= AdlerBase;
+	if (nSum1 >= AdlerBase)
+		nSum1 -= AdlerBase;
+	if (nSum2 >= (AdlerBase << 1))
+		nSum2 -= (AdlerBase << 1);
+	if (nSum2 >= AdlerBase)
+		nSum2 -= AdlerBase;
+	return nSum1 | (nSum2 << 16);
+}
+
+//////////////////////////////
+// Deflate
+//////////////////////////////
+
+namespace
+{
+	class OBitWriter
+	{
+	public:
+		explicit OBitWriter(std::vector<uint8_t>& vOut) : m_vOut(vOut) {}
+
+		// nBits (up to 32) of nValue, least significant first
+		inline void Write(uint32_t nValue, int nBits)
+		{
+			m_nBuffer |= (uint64_t)nValue << m_nBits;
+			m_nBits += nBits;
+			while (m_nBits >= 8)
+			{
+				m_vOut.push_back((uint8_t)m_nBuffer);
+				m_nBuffer >>= 8;
+				m_nBits -= 8;
+			}
+		}
+
+		// Huffman codes are packed starting with their most significant bit
+		inline void WriteCode(uint32_t nCode, int nBits)
+		{
+			uint32_t nReversed = 0;
+			for (int ii = 0; ii < nBits; ++ii)
+				nReversed |= ((nCode >> ii) & 1) << (nBits - 1 - ii);
+			Write(nReversed, nBits);
+		}
+
+		inline void AlignToByte()
+		{
+			if (m_nBits)
+				Write(0, 8 - m_nBits);
+		}
+	private:
+		std::vector<uint8_t>&	m_vOut;
+		uint64_t				m_nBuffer = 0;
+		int						m_nBits = 0;
+	};
+
+	constexpr uint16_t aLengthBase[] = {
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	constexpr uint8_t aLengthExtra[] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+		3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	constexpr uint16_t aDistBase[] = {
+		1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+		257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	constexpr uint8_t aDistExtra[] = {
+		0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+		7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	constexpr size_t MinMatch = 3;
+	constexpr size_t MaxMatch = 258;
+	constexpr size_t WindowSize = 32768;
+	constexpr int HashBits = 15;
+	constexpr int MaxChain = 48;
+
+	// Fixed literal/length codes (RFC 1951, 3.2.6)
+	void WriteLitLen(OBitWriter& writer, uint32_t nSymbol)
+	{
+		if (nSymbol < 144)
+			writer.WriteCode(0x30 + nSymbol, 8);
+		else if (nSymbol < 256)
+			writer.WriteCode(0x190 + nSymbol - 144, 9);
+		else if (nSymbol < 280)
+			writer.WriteCode(nSymbol - 256, 7);
+		else
+			writer.WriteCode(0xC0 + nSymbol - 280, 8);
+	}
+
+	void WriteMatch(OBitWriter& writer, size_t nLength, size_t nDist)
+	{
+		int nCode = 28;
+		while (aLengthBase[nCode] > nLength)
+			--nCode;
+		WriteLitLen(writer, 257 + nCode);
+		if (aLengthExtra[nCode])
+			writer.Write((uint32_t)(nLength - aLengthBase[nCode]), aLengthExtra[nCode]);
+		nCode = 29;
+		while (aDistBase[nCode] > nDist)
+			--nCode;
+		writer.WriteCode(nCode, 5);
+		if (aDistExtra[nCode])
+			writer.Write((uint32_t)(nDist - aDistBase[nCode]), aDistExtra[nCode]);
+	}
+
+	inline uint32_t Hash3(const uint8_t* p)
+	{
+		uint32_t nVal = p[0] | (p[1] << 8) | (p[2] << 16);
+		return (nVal * 2654435761u) >> (32 - HashBits);
+	}
+}
+
+void Deflate(const uint8_t* pData, size_t nSize, bool bFinal, std::vector<uint8_t>& vOut)
+{
+	OBitWriter writer(vOut);
+	// One block with the fixed codes
+	writer.Write(bFinal ? 1 : 0, 1);
+	writer.Write(1, 2);
+	std::vector<int32_t> vHead((size_t)1 << HashBits, -1);
+	std::vector<int32_t> vPrev(nSize);
+	auto Insert = [&](size_t nPos)
+	{
+		auto nHash = Hash3(pData + nPos);
+		vPrev[nPos] = vHead[nHash];
+		vHead[nHash] = (int32_t)nPos;
+	};
+	size_t nPos = 0;
+	while (nPos < nSize)
+	{
+		size_t nBestLen = 0, nBestDist = 0;
+		if (nSize - nPos >= MinMatch)
+		{
+			size_t nMaxLen = nSize - nPos < MaxMatch ? nSize - nPos : MaxMatch;
+			int32_t nCand = vHead[Hash3(pData + nPos)];
+			for (int nChain = MaxChain; nCand >= 0 && nChain; --nChain)
+			{
+				size_t nDist = nPos - (size_t)nCand;
+				if (nDist > WindowSize)
+					break;
+				auto pCand = pData + nCand;
+				if (pCand[nBestLen] == pData[nPos + nBestLen])
+				{
+					size_t nLen = 0;
+					while (nLen < nMaxLen && pCand[nLen] == pData[nPos + nLen])
+						++nLen;
+					if (nLen > nBestLen)
+					{
+						nBestLen = nLen;
+						nBestDist = nDist;
+						if (nLen == nMaxLen)
+							break;
+					}
+				}
+				nCand = vPrev[nCand];
+			}
+			Insert(nPos);
+		}
+		if (nBestLen >= MinMatch)
+		{
+			WriteMatch(writer, nBestLen, nBestDist);
+			// Long runs are only partly hashed, they're found again from their start
+			size_t nEnd = nPos + nBestLen;
+			size_t nHashEnd = nEnd + MinMatch <= nSize ? nEnd : (nSize >= MinMatch ? nSize - MinMatch + 1 : 0);
+			size_t nStep = nBestLen > 32 ? 4 : 1;
+			for (size_t ii = nPos + 1; ii < nHashEnd; ii += nStep)
+				Insert(ii);
+			nPos = nEnd;
+		}
+		else
+		{
+			WriteLitLen(writer, pData[nPos]);
+			++nPos;
+		}
+	}
+	WriteLitLen(writer, 256);
+	if (!bFinal)
+	{
+		// Empty stored block: aligns to the byte, then LEN 0 and NLEN ~0
+		writer.Write(0, 3);
+		writer.AlignToByte();
+		const uint8_t aLen[] = { 0x00, 0x00, 0xFF, 0xFF };
+		vOut.insert(vOut.end(), aLen, aLen + sizeof(aLen));
+	}
+	else
+		writer.AlignToByte();
+}
+
+//////////////////////////////
+// Filtering
+//////////////////////////////
+
+namespace
+{
+	enum OFilterType : uint8_t
+	{
+		FilterNone,
+		FilterSub,
+		FilterUp,
+		FilterAverage,
+		FilterPaeth,
+		FilterCount,
+	};
+
+	inline uint8_t Paeth(int a, int b, int c)
+	{
+		int p = a + b - c;
+		int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+		if (pa <= pb && pa <= pc)
+			return (uint8_t)a;
+		return (uint8_t)(pb <= pc ? b : c);
+	}
+
+	void FilterRow(OFilterType nType, const uint8_t* pRow, const uint8_t* pPrev, size_t nSize, size_t nBpp, uint8_t* pOut)
+	{
+		for (size_t ii = 0; ii < nSize; ++ii)
+		{
+			int a = ii >= nBpp ? pRow[ii - nBpp] : 0;
+			int b = pPrev ? pPrev[ii] : 0;
+			int c = pPrev && ii >= nBpp ? pPrev[ii - nBpp] : 0;
+			uint8_t nPred = 0;
+			switch (nType)
+			{
+			case FilterNone:	nPred = 0; break;
+			case FilterSub:		nPred = (uint8_t)a; break;
+			case FilterUp:		nPred = (uint8_t)b; break;
+			case FilterAverage:	nPred = (uint8_t)((a + b) / 2); break;
+			case FilterPaeth:	nPred = Paeth(a, b, c); break;
+			default: break;
+			}
+			pOut[ii] = (uint8_t)(pRow[ii] - nPred);
+		}
+	}
+
+	// The usual heuristic: the smallest sum of the bytes taken as signed
+	size_t GetFilterCost(const uint8_t* pOut, size_t nSize)
+	{
+		size_t nCost = 0;
+		for (size_t ii = 0; ii < nSize; ++ii)
+			nCost += (size_t)std::abs((int)(int8_t)pOut[ii]);
+		return nCost;
+	}
+}
+
+void EncodeBand(const OImageFormat& fmt, const uint8_t* pRows, ptrdiff_t nStride, size_t nRows,
+	bool bLast, OEncodedBand& band)
+{
+	size_t nBpp = fmt.bAlpha ? 4 : 3;
+	size_t nRowSize = fmt.nWidth * nBpp;
+	std::vector<uint8_t> vRaw(nRows * (nRowSize + 1));
+	std::vector<uint8_t> vRow[2] = { std::vector<uint8_t>(nRowSize), std::vector<uint8_t>(nRowSize) };
+	std::vector<uint8_t> vTry(nRowSize);
+	for (size_t nRow = 0; nRow < nRows; ++nRow)
+	{
+		auto& vCur = vRow[nRow & 1];
+		const uint8_t* pPrev = nRow ? vRow[(nRow - 1) & 1].data() : nullptr;
+		auto pSrc = pRows + (ptrdiff_t)nRow * nStride;
+		for (size_t ii = 0, jj = 0; ii < fmt.nWidth; ++ii, jj += nBpp)
+		{
+			vCur[jj] = pSrc[ii * 4 + 2];
+			vCur[jj + 1] = pSrc[ii * 4 + 1];
+			vCur[jj + 2] = pSrc[ii * 4];
+			if (fmt.bAlpha)
+				vCur[jj + 3] = pSrc[ii * 4 + 3];
+		}
+		// The row above the band isn't known here
+		int nFilters = pPrev ? FilterCount : FilterUp;
+		auto pOut = vRaw.data() + nRow * (nRowSize + 1);
+		size_t nBestCost = (size_t)-1;
+		for (int nType = 0; nType < nFilters; ++nType)
+		{
+			FilterRow((OFilterType)nType, vCur.data(), pPrev, nRowSize, nBpp, vTry.data());
+			size_t nCost = GetFilterCost(vTry.data(), nRowSize);
+			if (nCost < nBestCost)
+			{
+				nBestCost = nCost;
+				pOut[0] = (uint8_t)nType;
+				memcpy(pOut + 1, vTry.data(), nRowSize);
+			}
+		}
+	}
+	band.nRawSize = vRaw.size();
+	band.nAdler = Adler32(1, vRaw.data(), vRaw.size());
+	band.vData.clear();
+	Deflate(vRaw.data(), vRaw.size(), bLast, band.vData);
+}
+
+//////////////////////////////
+// OPngWriter
+//////////////////////////////
+
+static void PutU32BE(uint8_t* p, uint32_t nVal)
+{
+	p[0] = (uint8_t)(nVal >> 24);
+	p[1] = (uint8_t)(nVal >> 16);
+	p[2] = (uint8_t)(nVal >> 8);
+	p[3] = (uint8_t)nVal;
+}
+
+bool OPngWriter::WriteChunk(const char* szType, const void* pData, size_t nSize,
+	const void* pPrefix, size_t nPrefixSize)
+{
+	uint8_t aHead[8];
+	PutU32BE(aHead, (uint32_t)(nPrefixSize + nSize));
+	memcpy(aHead + 4, szType, 4);
+	uint32_t nCrc = Crc32(0, aHead + 4, 4);
+	nCrc = Crc32(nCrc, pPrefix, nPrefixSize);
+	nCrc = Crc32(nCrc, pData, nSize);
+	uint8_t aCrc[4];
+	PutU32BE(aCrc, nCrc);
+	if (!m_sink(aHead, sizeof(aHead)))
+		return false;
+	if (nPrefixSize && !m_sink(pPrefix, nPrefixSize))
+		return false;
+	if (nSize && !m_sink(pData, nSize))
+		return false;
+	if (!m_sink(aCrc, sizeof(aCrc)))
+		return false;
+	m_nWritten += sizeof(aHead) + nPrefixSize + nSize + sizeof(aCrc);
+	return true;
+}
+
+bool OPngWriter::Begin(const OImageFormat& fmt, double fDpi)
+{
+	static const uint8_t aSignature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	if (!m_sink(aSignature, sizeof(aSignature)))
+		return false;
+	m_nWritten = sizeof(aSignature);
+	m_nAdler = 1;
+	m_bFirstBand = true;
+	uint8_t aHdr[13];
+	PutU32BE(aHdr, fmt.nWidth);
+	PutU32BE(aHdr + 4, fmt.nHeight);
+	aHdr[8] = 8;						// bits per component
+	aHdr[9] = fmt.bAlpha ? 6 : 2;		// RGBA or RGB
+	aHdr[10] = aHdr[11] = aHdr[12] = 0;	// deflate, adaptive filtering, not interlaced
+	if (!WriteChunk("IHDR", aHdr, sizeof(aHdr)))
+		return false;
+	if (fDpi > 0)
+	{
+		uint8_t aPhys[9];
+		auto nPerMeter = (uint32_t)(fDpi / 0.0254 + 0.5);
+		PutU32BE(aPhys, nPerMeter);
+		PutU32BE(aPhys + 4, nPerMeter);
+		aPhys[8] = 1;					// meters
+		if (!WriteChunk("pHYs", aPhys, sizeof(aPhys)))
+			return false;
+	}
+	return true;
+}
+
+bool OPngWriter::AddBand(const OEncodedBand& band)
+{
+	// zlib header: deflate with a 32K window, no dictionary, checked by % 31
+	static const uint8_t aZlibHeader[] = { 0x78, 0x01 };
+	bool bFirst = m_bFirstBand;
+	m_bFirstBand = false;
+	m_nAdler = Adler32Combine(m_nAdler, band.nAdler, band.nRawSize);
+	return WriteChunk("IDAT", band.vData.data(), band.vData.size(),
+		bFirst ? aZlibHeader : nullptr, bFirst ? sizeof(aZlibHeader) : 0);
+}
+
+bool OPngWriter::End()
+{
+	uint8_t aAdler[4];
+	PutU32BE(aAdler, m_nAdler);
+	if (!WriteChunk("IDAT", aAdler, sizeof(aAdler)))
+		return false;
+	return WriteChunk("IEND", nullptr, 0);
+}
+
+}
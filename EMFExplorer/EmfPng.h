@@ -0,0 +1,79 @@
+#ifndef EMF_PNG_H
+#define EMF_PNG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// PNG encoding of an image given a band of rows at a time, for images too
+// large to be held whole.
+//
+// Each band is filtered and compressed on its own (EncodeBand), so bands
+// can be encoded in parallel: its deflate blocks don't refer to the bands
+// before it, the first row of a band is only filtered with None or Sub,
+// and every band but the last ends on a byte boundary with an empty stored
+// block, as a zlib sync flush does. The writer then only concatenates them
+// in IDAT chunks and combines their Adler-32.
+// The compression is LZ77 with fixed Huffman codes, which does well on
+// rendered drawings (runs of the same pixels), less on photos.
+namespace emfpng
+{
+	struct OImageFormat
+	{
+		uint32_t	nWidth;
+		uint32_t	nHeight;
+		bool		bAlpha;		// RGBA, RGB otherwise
+	};
+
+	struct OEncodedBand
+	{
+		std::vector<uint8_t>	vData;		// deflate blocks
+		uint32_t				nAdler;		// of the filtered rows
+		size_t					nRawSize;	// size of the filtered rows
+	};
+
+	uint32_t Crc32(uint32_t nCrc, const void* pData, size_t nSize);
+
+	uint32_t Adler32(uint32_t nAdler, const void* pData, size_t nSize);
+
+	// Adler-32 of A followed by B, from those of A and B and the size of B
+	uint32_t Adler32Combine(uint32_t nAdlerA, uint32_t nAdlerB, size_t nSizeB);
+
+	// Appends the deflate blocks of the data to vOut. Unless bFinal, they end
+	// with an empty stored block, so whatever follows starts on a new byte.
+	void Deflate(const uint8_t* pData, size_t nSize, bool bFinal, std::vector<uint8_t>& vOut);
+
+	// pRows holds nRows rows of 32-bit BGRA pixels (GDI+ PixelFormat32bppARGB,
+	// Win32 DIBs), nStride bytes apart. bLast for the band at the bottom.
+	void EncodeBand(const OImageFormat& fmt, const uint8_t* pRows, ptrdiff_t nStride, size_t nRows,
+		bool bLast, OEncodedBand& band);
+
+	class OPngWriter
+	{
+	public:
+		using Sink = std::function<bool(const void* pData, size_t nSize)>;
+
+		explicit OPngWriter(Sink sink) : m_sink(std::move(sink)) {}
+
+		// fDpi is written as the physical pixel size when positive
+		bool Begin(const OImageFormat& fmt, double fDpi);
+
+		// The bands in order from the top, the last one encoded with bLast
+		bool AddBand(const OEncodedBand& band);
+
+		bool End();
+
+		inline uint64_t GetWrittenSize() const { return m_nWritten; }
+	private:
+		bool WriteChunk(const char* szType, const void* pData, size_t nSize,
+			const void* pPrefix = nullptr, size_t nPrefixSize = 0);
+	private:
+		Sink		m_sink;
+		uint32_t	m_nAdler = 1;
+		bool		m_bFirstBand = true;
+		uint64_t	m_nWritten = 0;
+	};
+}
+
+#endif // EMF_PNG_H
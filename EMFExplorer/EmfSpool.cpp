@@ -0,0 +1,158 @@
+#include PCH_FNAME
+#ifdef _ENABLE_GDIPLUS_STRUCT
+
+#include "EmfSpool.h"
+
+#pragma push_macro("min")
+#pragma push_macro("max")
+#undef max
+#undef min
+
+namespace emfspool
+{
+
+// ENHMETAHEADER fields checked on the pages
+constexpr size_t EMFHeaderMinSize		= 88;
+constexpr size_t EMFHeaderSignatureOff	= 40;
+constexpr size_t EMFHeaderBytesOff		= 48;
+constexpr u32t EMFSignature				= 0x464D4520;	// " EMF"
+
+static inline u32t _ReadU32(const u8t* p)
+{
+	u32t val;
+	memcpy(&val, p, sizeof(val));
+	return val;
+}
+
+static inline bool _IsKnownRecord(u32t nType)
+{
+	return nType >= (u32t)OSpoolRecordType::Metafile && nType <= (u32t)OSpoolRecordType::EmbedFontExt;
+}
+
+static bool _IsPageRecord(OSpoolRecordType nType)
+{
+	switch (nType)
+	{
+	case OSpoolRecordType::Metafile:
+	case OSpoolRecordType::FormMetafile:
+	case OSpoolRecordType::BWMetafile:
+	case OSpoolRecordType::BWFormMetafile:
+	case OSpoolRecordType::MetafileData:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool _IsFontRecord(OSpoolRecordType nType)
+{
+	switch (nType)
+	{
+	case OSpoolRecordType::EngineFont:
+	case OSpoolRecordType::Type1Font:
+	case OSpoolRecordType::SubsetFont:
+	case OSpoolRecordType::DeltaFont:
+	case OSpoolRecordType::EngineFontExt:
+	case OSpoolRecordType::Type1FontExt:
+	case OSpoolRecordType::SubsetFontExt:
+	case OSpoolRecordType::DeltaFontExt:
+	case OSpoolRecordType::EmbedFontExt:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// NUL terminated UTF-16 string inside the header
+static std::wstring _ReadHeaderString(const u8t* pHdr, size_t nHdrSize, u32t nOffset)
+{
+	std::wstring str;
+	if (!nOffset || nOffset >= nHdrSize)
+		return str;
+	for (size_t ii = nOffset; ii + 1 < nHdrSize; ii += 2)
+	{
+		auto ch = (wchar_t)(pHdr[ii] | (pHdr[ii + 1] << 8));
+		if (!ch)
+			break;
+		str.push_back(ch);
+	}
+	return str;
+}
+
+bool IsSpoolFile(const u8t* pData, size_t nSize)
+{
+	if (!pData || nSize < sizeof(OSpoolHeader))
+		return false;
+	auto pHdr = (const OSpoolHeader*)pData;
+	return pHdr->Version == SpoolHeaderVersion && pHdr->Size >= sizeof(OSpoolHeader);
+}
+
+bool BuildSpoolIndex(const u8t* pData, size_t nSize, OSpoolIndex& index)
+{
+	index = OSpoolIndex();
+	if (!IsSpoolFile(pData, nSize))
+		return false;
+	auto pHdr = (const OSpoolHeader*)pData;
+	size_t nHdrSize = std::min<size_t>(pHdr->Size, nSize);
+	index.strDocName = _ReadHeaderString(pData, nHdrSize, pHdr->offDocName);
+	index.strOutputDevice = _ReadHeaderString(pData, nHdrSize, pHdr->offOutputDevice);
+
+	size_t nDevModeOffset = 0;
+	size_t nDevModeSize = 0;
+	size_t nPos = nHdrSize;
+	while (nPos + sizeof(OSpoolRecord) <= nSize)
+	{
+		u32t nType = _ReadU32(pData + nPos);
+		if (!_IsKnownRecord(nType))
+		{
+			// Writers don't agree on padding the header and the records to DWORDs
+			size_t nAligned = (nPos + 3) & ~(size_t)3;
+			if (nAligned == nPos || nAligned + sizeof(OSpoolRecord) > nSize
+				|| !_IsKnownRecord(_ReadU32(pData + nAligned)))
+				break;
+			nPos = nAligned;
+			nType = _ReadU32(pData + nPos);
+		}
+		size_t nDataSize = _ReadU32(pData + nPos + sizeof(u32t));
+		size_t nDataOffset = nPos + sizeof(OSpoolRecord);
+		if (nDataSize > nSize - nDataOffset)
+		{
+			index.bTruncated = true;
+			nDataSize = nSize - nDataOffset;
+		}
+		auto pRecData = pData + nDataOffset;
+		auto nRecType = (OSpoolRecordType)nType;
+		if (nRecType == OSpoolRecordType::DevMode)
+		{
+			nDevModeOffset = nDataOffset;
+			nDevModeSize = nDataSize;
+		}
+		else if (_IsFontRecord(nRecType))
+			++index.nFonts;
+		else if (_IsPageRecord(nRecType) && nDataSize >= EMFHeaderMinSize
+			&& _ReadU32(pRecData) == EMR_HEADER
+			&& _ReadU32(pRecData + EMFHeaderSignatureOff) == EMFSignature)
+		{
+			// The record may be padded past the end of the document
+			size_t nBytes = _ReadU32(pRecData + EMFHeaderBytesOff);
+			OSpoolPage page;
+			page.nOffset = nDataOffset;
+			page.nSize = nBytes && nBytes <= nDataSize ? nBytes : nDataSize;
+			page.Type = nRecType;
+			page.nDevModeOffset = nDevModeOffset;
+			page.nDevModeSize = nDevModeSize;
+			index.vPages.push_back(page);
+		}
+		if (index.bTruncated)
+			break;
+		nPos = nDataOffset + nDataSize;
+	}
+	return true;
+}
+
+}
+
+#pragma pop_macro("min")
+#pragma pop_macro("max")
+
+#endif // _ENABLE_GDIPLUS_STRUCT
@@ -0,0 +1,94 @@
+#ifndef EMF_SPOOL_H
+#define EMF_SPOOL_H
+
+#ifdef _ENABLE_GDIPLUS_STRUCT
+
+#include "EmfPlusStruct.h"
+
+// Page index of Windows print spool files (.SPL, MS-EMFSPOOL): a header
+// followed by records, the pages being complete EMF documents.
+// https://docs.microsoft.com/en-us/openspecs/windows_protocols/ms-emfspool/
+//
+// Indexing only reads the record headers, the pages are left untouched so
+// that they can be opened independently (and concurrently) afterwards.
+namespace emfspool
+{
+	using namespace emfplus;
+
+	enum : u32t {
+		SpoolHeaderVersion	= 0x00010000,
+	};
+
+	enum class OSpoolRecordType : u32t
+	{
+		Metafile			= 0x00000001,
+		EngineFont			= 0x00000002,
+		DevMode				= 0x00000003,
+		Type1Font			= 0x00000004,
+		PreStartPage		= 0x00000005,
+		DesignVector		= 0x00000006,
+		SubsetFont			= 0x00000007,
+		DeltaFont			= 0x00000008,
+		FormMetafile		= 0x00000009,
+		BWMetafile			= 0x0000000A,
+		BWFormMetafile		= 0x0000000B,
+		MetafileData		= 0x0000000C,
+		MetafileExt			= 0x0000000D,
+		BWMetafileExt		= 0x0000000E,
+		EngineFontExt		= 0x0000000F,
+		Type1FontExt		= 0x00000010,
+		DesignVectorExt		= 0x00000011,
+		SubsetFontExt		= 0x00000012,
+		DeltaFontExt		= 0x00000013,
+		PSJobData			= 0x00000014,
+		EmbedFontExt		= 0x00000015,
+	};
+
+	struct OSpoolHeader
+	{
+		u32t	Version;
+		u32t	Size;			// whole header, strings included
+		u32t	offDocName;		// from the start of the header, 0 if absent
+		u32t	offOutputDevice;
+	};
+
+	struct OSpoolRecord
+	{
+		u32t	Type;
+		u32t	Size;			// data following this header
+	};
+
+	struct OSpoolPage
+	{
+		size_t				nOffset;		// of the EMF document in the file
+		size_t				nSize;
+		OSpoolRecordType	Type;
+		// DEVMODE in effect for the page (nDevModeSize is 0 if there's none)
+		size_t				nDevModeOffset;
+		size_t				nDevModeSize;
+
+		inline bool IsMonochrome() const
+		{
+			return Type == OSpoolRecordType::BWMetafile || Type == OSpoolRecordType::BWFormMetafile;
+		}
+	};
+
+	struct OSpoolIndex
+	{
+		std::wstring				strDocName;
+		std::wstring				strOutputDevice;
+		std::vector<OSpoolPage>		vPages;
+		size_t						nFonts = 0;		// font records (embedded, subset, delta)
+		bool						bTruncated = false;	// the last record runs past the end of the data
+	};
+
+	bool IsSpoolFile(const u8t* pData, size_t nSize);
+
+	// Walks the record headers once. Pages whose data isn't an EMF document
+	// are skipped.
+	bool BuildSpoolIndex(const u8t* pData, size_t nSize, OSpoolIndex& index);
+}
+
+#endif // _ENABLE_GDIPLUS_STRUCT
+
+#endif // EMF_SPOOL_H
@@ -0,0 +1,908 @@
+#include PCH_FNAME
+#ifdef _ENABLE_GDIPLUS_STRUCT
+
+#include "EmfSvg.h"
+#include "EmfPng.h"
+#include "DataHash.h"
+#include <charconv>
+
+#pragma push_macro("min")
+#pragma push_macro("max")
+#undef max
+#undef min
+
+namespace emfsvg
+{
+
+namespace
+{
+	class OBase64Writer
+	{
+	public:
+		explicit OBase64Writer(std::string& out) : m_out(out) {}
+
+		void Write(const void* pData, size_t nSize)
+		{
+			auto p = (const u8t*)pData;
+			for (size_t ii = 0; ii < nSize; ++ii)
+			{
+				m_aCarry[m_nCarry++] = p[ii];
+				if (m_nCarry == 3)
+				{
+					Encode(3);
+					m_nCarry = 0;
+				}
+			}
+		}
+
+		void End()
+		{
+			if (m_nCarry)
+			{
+				for (size_t ii = m_nCarry; ii < 3; ++ii)
+					m_aCarry[ii] = 0;
+				Encode(m_nCarry);
+				m_nCarry = 0;
+			}
+		}
+	private:
+		void Encode(size_t nBytes)
+		{
+			static const char szChars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+			u32t nVal = ((u32t)m_aCarry[0] << 16) | ((u32t)m_aCarry[1] << 8) | m_aCarry[2];
+			m_out += szChars[(nVal >> 18) & 0x3F];
+			m_out += szChars[(nVal >> 12) & 0x3F];
+			m_out += nBytes > 1 ? szChars[(nVal >> 6) & 0x3F] : '=';
+			m_out += nBytes > 2 ? szChars[nVal & 0x3F] : '=';
+		}
+	private:
+		std::string&	m_out;
+		u8t				m_aCarry[3] = {};
+		size_t			m_nCarry = 0;
+	};
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// Formatting
+
+// Up to 3 decimals, without trailing zeros
+static void _AppendNumber(std::string& str, double fVal)
+{
+	if (!std::isfinite(fVal))
+		fVal = 0;
+	fVal = std::round(std::clamp(fVal, -1e9, 1e9) * 1000) / 1000;
+	if (fVal == 0)
+	{
+		str += '0';
+		return;
+	}
+	char sz[32];
+	auto res = std::to_chars(sz, sz + sizeof(sz), fVal, std::chars_format::fixed, 3);
+	char* pEnd = res.ptr;
+	while (pEnd[-1] == '0')
+		--pEnd;
+	if (pEnd[-1] == '.')
+		--pEnd;
+	str.append(sz, pEnd);
+}
+
+static void _AppendNumber(std::string& str, const char* szAttr, double fVal)
+{
+	str += ' ';
+	str += szAttr;
+	str += "=\"";
+	_AppendNumber(str, fVal);
+	str += '"';
+}
+
+static void _AppendPoint(std::string& str, double x, double y)
+{
+	_AppendNumber(str, x);
+	str += ',';
+	_AppendNumber(str, y);
+}
+
+static void _AppendId(std::string& str, u32t nId)
+{
+	str += 'd';
+	str += std::to_string(nId);
+}
+
+static void _AppendColor(std::string& str, const OEmfPlusARGB& clr)
+{
+	static const char szHex[] = "0123456789abcdef";
+	str += '#';
+	for (u8t val : { clr.Red, clr.Green, clr.Blue })
+	{
+		str += szHex[val >> 4];
+		str += szHex[val & 0xF];
+	}
+}
+
+// CSS declaration of szProp ("fill", "stroke") with its opacity
+static void _AppendPaintColor(std::string& str, const char* szProp, const OEmfPlusARGB& clr)
+{
+	str += szProp;
+	str += ':';
+	_AppendColor(str, clr);
+	if (clr.Alpha != 255)
+	{
+		str += ';';
+		str += szProp;
+		str += "-opacity:";
+		_AppendNumber(str, clr.Alpha / 255.0);
+	}
+}
+
+static void _AppendPaintRef(std::string& str, const char* szProp, u32t nId)
+{
+	str += szProp;
+	str += ":url(#";
+	_AppendId(str, nId);
+	str += ')';
+}
+
+static void _AppendTransform(std::string& str, const OMatrix& mtx, const char* szAttr = "transform")
+{
+	if (mtx.IsIdentity())
+		return;
+	str += ' ';
+	str += szAttr;
+	if (mtx.m11 == 1 && mtx.m12 == 0 && mtx.m21 == 0 && mtx.m22 == 1)
+	{
+		str += "=\"translate(";
+		_AppendNumber(str, mtx.dx);
+		str += ' ';
+		_AppendNumber(str, mtx.dy);
+	}
+	else
+	{
+		str += "=\"matrix(";
+		for (double fVal : { mtx.m11, mtx.m12, mtx.m21, mtx.m22, mtx.dx })
+		{
+			_AppendNumber(str, fVal);
+			str += ' ';
+		}
+		_AppendNumber(str, mtx.dy);
+	}
+	str += ")\"";
+}
+
+static void _AppendUtf8(std::string& str, u32t nCode)
+{
+	if (nCode < 0x80)
+		str += (char)nCode;
+	else if (nCode < 0x800)
+	{
+		str += (char)(0xC0 | (nCode >> 6));
+		str += (char)(0x80 | (nCode & 0x3F));
+	}
+	else if (nCode < 0x10000)
+	{
+		str += (char)(0xE0 | (nCode >> 12));
+		str += (char)(0x80 | ((nCode >> 6) & 0x3F));
+		str += (char)(0x80 | (nCode & 0x3F));
+	}
+	else
+	{
+		str += (char)(0xF0 | (nCode >> 18));
+		str += (char)(0x80 | ((nCode >> 12) & 0x3F));
+		str += (char)(0x80 | ((nCode >> 6) & 0x3F));
+		str += (char)(0x80 | (nCode & 0x3F));
+	}
+}
+
+// UTF-16 text as XML character data. Characters XML doesn't allow are
+// dropped, unpaired surrogates replaced.
+template <typename _Ch>
+static void _AppendText(std::string& str, const _Ch* pText, size_t nLength)
+{
+	for (size_t ii = 0; ii < nLength; ++ii)
+	{
+		u32t nCode = (u16t)pText[ii];
+		if (nCode >= 0xD800 && nCode < 0xDC00 && ii + 1 < nLength
+			&& (u16t)pText[ii + 1] >= 0xDC00 && (u16t)pText[ii + 1] < 0xE000)
+		{
+			nCode = 0x10000 + ((nCode - 0xD800) << 10) + ((u16t)pText[++ii] - 0xDC00);
+		}
+		else if (nCode >= 0xD800 && nCode < 0xE000)
+			nCode = 0xFFFD;
+		switch (nCode)
+		{
+		case '&':	str += "&amp;";		break;
+		case '<':	str += "&lt;";		break;
+		case '>':	str += "&gt;";		break;
+		case '"':	str += "&quot;";	break;
+		default:
+			if ((nCode >= 0x20 || nCode == '\t') && nCode != 0xFFFE && nCode != 0xFFFF)
+				_AppendUtf8(str, nCode);
+			break;
+		}
+	}
+}
+
+// Quoted font-family value, without what would end the value or the style
+template <typename _Ch>
+static void _AppendFontFamily(std::string& str, const _Ch* pName, size_t nLength)
+{
+	std::string strName;
+	for (size_t ii = 0; ii < nLength && pName[ii]; ++ii)
+	{
+		u32t nCode = (u16t)pName[ii];
+		if (nCode < 0x20 || (nCode >= 0xD800 && nCode < 0xE000) || nCode >= 0xFFFE
+			|| (nCode < 0x80 && std::strchr("'\"\\;{}<>&", (int)nCode)))
+			continue;
+		_AppendUtf8(strName, nCode);
+	}
+	if (strName.empty())
+		return;
+	str += ";font-family:'";
+	str += strName;
+	str += '\'';
+}
+
+static void _AppendFontStyle(std::string& str, double fEmSize, int nWeight, bool bItalic, bool bUnderline, bool bStrikeOut)
+{
+	str += ";font-size:";
+	_AppendNumber(str, fEmSize);
+	if (nWeight >= 600 && nWeight < 800)
+		str += ";font-weight:bold";
+	else if (nWeight > 0 && nWeight != 400)
+	{
+		str += ";font-weight:";
+		str += std::to_string(std::clamp((nWeight + 50) / 100 * 100, 100, 900));
+	}
+	if (bItalic)
+		str += ";font-style:italic";
+	if (bUnderline || bStrikeOut)
+	{
+		str += ";text-decoration:";
+		if (bUnderline)
+			str += bStrikeOut ? "underline line-through" : "underline";
+		else
+			str += "line-through";
+	}
+}
+
+
+static void _AppendStop(std::string& str, double fOffset, const OEmfPlusARGB& clr)
+{
+	str += "<stop";
+	_AppendNumber(str, "offset", std::clamp(fOffset, 0.0, 1.0));
+	str += " stop-color=\"";
+	_AppendColor(str, clr);
+	str += '"';
+	if (clr.Alpha != 255)
+		_AppendNumber(str, "stop-opacity", clr.Alpha / 255.0);
+	str += "/>";
+}
+
+static const char* _GetSpreadMethod(OWrapMode nWrap)
+{
+	switch (nWrap)
+	{
+	case OWrapMode::Tile:		return " spreadMethod=\"repeat\"";
+	case OWrapMode::TileFlipX:
+	case OWrapMode::TileFlipY:
+	case OWrapMode::TileFlipXY:	return " spreadMethod=\"reflect\"";
+	default:					return "";
+	}
+}
+
+// MIME type of an image file, nullptr if it isn't one a browser shows
+static const char* _GetImageMime(const u8t* pData, size_t nSize)
+{
+	if (nSize >= 8 && !memcmp(pData, "\x89PNG\r\n\x1A\n", 8))
+		return "image/png";
+	if (nSize >= 3 && pData[0] == 0xFF && pData[1] == 0xD8 && pData[2] == 0xFF)
+		return "image/jpeg";
+	if (nSize >= 6 && (!memcmp(pData, "GIF87a", 6) || !memcmp(pData, "GIF89a", 6)))
+		return "image/gif";
+	if (nSize >= 2 && !memcmp(pData, "BM", 2))
+		return "image/bmp";
+	return nullptr;
+}
+
+// Path data, lines along an axis as H and V
+static void _AppendPath(std::string& d, const OPath& path)
+{
+	auto& vPoints = path.GetPoints();
+	size_t nPoint = 0;
+	OPoint ptCur{ 0, 0 }, ptStart{ 0, 0 };
+	char chLast = 0;
+	// Repeated commands are left out, but for moves
+	auto command = [&](char ch)
+	{
+		d += (ch == chLast && ch != 'M') ? ' ' : ch;
+		chLast = ch;
+	};
+	for (auto nOp : path.GetOps())
+	{
+		switch (nOp)
+		{
+		case OPath::Op::Move:
+			ptStart = ptCur = vPoints[nPoint++];
+			command('M');
+			_AppendPoint(d, ptCur.x, ptCur.y);
+			break;
+		case OPath::Op::Line:
+			{
+				auto& pt = vPoints[nPoint++];
+				if (pt.y == ptCur.y && pt.x != ptCur.x)
+				{
+					command('H');
+					_AppendNumber(d, pt.x);
+				}
+				else if (pt.x == ptCur.x && pt.y != ptCur.y)
+				{
+					command('V');
+					_AppendNumber(d, pt.y);
+				}
+				else
+				{
+					command('L');
+					_AppendPoint(d, pt.x, pt.y);
+				}
+				ptCur = pt;
+			}
+			break;
+		case OPath::Op::Bezier:
+			command('C');
+			for (int ii = 0; ii < 3; ++ii)
+			{
+				if (ii)
+					d += ' ';
+				_AppendPoint(d, vPoints[nPoint].x, vPoints[nPoint].y);
+				ptCur = vPoints[nPoint++];
+			}
+			break;
+		case OPath::Op::Close:
+			command('Z');
+			ptCur = ptStart;
+			break;
+		}
+	}
+}
+
+// Premultiplied rows to the straight alpha EncodeBand takes
+static void _UnPremultiply(u8t* pRows, size_t nPixels)
+{
+	for (size_t ii = 0; ii < nPixels; ++ii, pRows += 4)
+	{
+		u32t nAlpha = pRows[3];
+		if (nAlpha == 0 || nAlpha == 255)
+			continue;
+		for (int jj = 0; jj < 3; ++jj)
+			pRows[jj] = (u8t)std::min<u32t>(255, (pRows[jj] * 255 + nAlpha / 2) / nAlpha);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// OSvgWriter
+
+bool OSvgWriter::Flush()
+{
+	if (m_bFailed)
+		return false;
+	if (!m_out.empty())
+	{
+		if (!m_sink(m_out.data(), m_out.size()))
+			m_bFailed = true;
+		m_stats.nWritten += m_out.size();
+		m_out.clear();
+	}
+	return !m_bFailed;
+}
+
+std::string OSvgWriter::GetStyleAttr(const std::string& strStyle)
+{
+	auto it = m_mapStyles.find(strStyle);
+	if (it != m_mapStyles.end())
+	{
+		++m_stats.nReused;
+		return " class=\"s" + std::to_string(it->second) + '"';
+	}
+	if (m_mapStyles.size() >= MaxStyles)
+		return " style=\"" + strStyle + '"';
+	u32t nId = (u32t)m_mapStyles.size() + 1;
+	m_mapStyles.emplace(strStyle, nId);
+	++m_stats.nDefs;
+	m_out += "<style type=\"text/css\">.s" + std::to_string(nId) + '{' + strStyle + "}</style>\n";
+	return " class=\"s" + std::to_string(nId) + '"';
+}
+
+u32t OSvgWriter::GetDef(const char* szTag, const std::string& strBody)
+{
+	Hash64 hash;
+	hash.Update(szTag, strlen(szTag));
+	hash.Update(strBody.data(), strBody.size());
+	u64t nKey = hash.Digest();
+	u32t nId = 0;
+	if (FindDef(nKey, nId))
+		return nId;
+	nId = AddDef(nKey);
+	m_out += "<defs><";
+	m_out += szTag;
+	m_out += " id=\"";
+	_AppendId(m_out, nId);
+	m_out += '"';
+	m_out += strBody;
+	m_out += "</defs>\n";
+	Written();
+	return nId;
+}
+
+bool OSvgWriter::FindDef(u64t nKey, u32t& nId)
+{
+	auto it = m_mapDefs.find(nKey);
+	if (it == m_mapDefs.end())
+		return false;
+	nId = it->second;
+	++m_stats.nReused;
+	return true;
+}
+
+u32t OSvgWriter::AddDef(u64t nKey)
+{
+	u32t nId = m_nNextId++;
+	if (m_mapDefs.size() < MaxDefs)
+		m_mapDefs.emplace(nKey, nId);
+	++m_stats.nDefs;
+	return nId;
+}
+
+void OSvgWriter::AppendPaint(std::string& strStyle, const char* szProp, const OPaint& paint)
+{
+	u32t nId = 0;
+	switch (paint.nType)
+	{
+	case OPaintType::Color:
+		_AppendPaintColor(strStyle, szProp, paint.clr);
+		return;
+	case OPaintType::LinearGradient:
+	case OPaintType::RadialGradient:
+		nId = GetGradientDef(paint);
+		break;
+	case OPaintType::Hatch:
+		nId = GetHatchDef(paint);
+		break;
+	case OPaintType::Pattern:
+		nId = GetPatternDef(paint);
+		break;
+	default:
+		strStyle += szProp;
+		strStyle += ":none";
+		return;
+	}
+	_AppendPaintRef(strStyle, szProp, nId);
+}
+
+u32t OSvgWriter::GetHatchDef(const OPaint& paint)
+{
+	std::string strBody = " patternUnits=\"userSpaceOnUse\"";
+	_AppendNumber(strBody, "width", HatchSize);
+	_AppendNumber(strBody, "height", HatchSize);
+	_AppendTransform(strBody, paint.mtx, "patternTransform");
+	strBody += '>';
+	std::string strRect = "<rect width=\"8\" height=\"8\" style=\"";
+	if (paint.clrBack.Alpha)
+	{
+		strBody += strRect;
+		_AppendPaintColor(strBody, "fill", paint.clrBack);
+		strBody += "\"/>";
+	}
+	const char* szLines = nullptr;
+	switch ((OHatchStyle)paint.nHatchStyle)
+	{
+	case OHatchStyle::StyleHorizontal:			szLines = "M0 3.5H8";									break;
+	case OHatchStyle::StyleVertical:			szLines = "M3.5 0V8";									break;
+	case OHatchStyle::StyleForwardDiagonal:		szLines = "M0 0L8 8M-1 7L1 9M7 -1L9 1";				break;
+	case OHatchStyle::StyleBackwardDiagonal:	szLines = "M8 0L0 8M-1 1L1 -1M7 9L9 7";				break;
+	case OHatchStyle::StyleLargeGrid:			szLines = "M0 3.5H8M3.5 0V8";							break;
+	case OHatchStyle::StyleDiagonalCross:		szLines = "M0 0L8 8M-1 7L1 9M7 -1L9 1M8 0L0 8M-1 1L1 -1M7 9L9 7";	break;
+	default:
+		break;
+	}
+	if (szLines)
+	{
+		strBody += "<path d=\"";
+		strBody += szLines;
+		strBody += "\" style=\"fill:none;stroke-width:1;";
+		_AppendPaintColor(strBody, "stroke", paint.clr);
+		strBody += "\"/>";
+	}
+	else
+	{
+		// The other styles are dot and texture patterns, drawn as the share
+		// of the foreground color they cover
+		static const double aCoverage[] = { 0.05, 0.1, 0.2, 0.25, 0.3, 0.4, 0.5, 0.6, 0.7, 0.75, 0.8, 0.9 };
+		size_t nIndex = paint.nHatchStyle - (u32t)OHatchStyle::Style05Percent;
+		OEmfPlusARGB clr = paint.clr;
+		clr.Alpha = (u8t)std::lround(clr.Alpha * (nIndex < _countof(aCoverage) ? aCoverage[nIndex] : 0.5));
+		strBody += strRect;
+		_AppendPaintColor(strBody, "fill", clr);
+		strBody += "\"/>";
+	}
+	strBody += "</pattern>";
+	return GetDef("pattern", strBody);
+}
+
+u32t OSvgWriter::GetGradientDef(const OPaint& paint)
+{
+	bool bLinear = paint.nType == OPaintType::LinearGradient;
+	std::string strBody = " gradientUnits=\"userSpaceOnUse\"";
+	if (bLinear)
+	{
+		_AppendNumber(strBody, "x1", paint.ptStart.x);
+		_AppendNumber(strBody, "y1", paint.ptStart.y);
+		_AppendNumber(strBody, "x2", paint.ptEnd.x);
+		_AppendNumber(strBody, "y2", paint.ptEnd.y);
+	}
+	else
+		strBody += " cx=\"0\" cy=\"0\" r=\"1\"";
+	_AppendTransform(strBody, paint.mtx, "gradientTransform");
+	strBody += _GetSpreadMethod(paint.nWrap);
+	strBody += '>';
+	for (auto& stop : paint.vStops)
+		_AppendStop(strBody, stop.fOffset, stop.clr);
+	strBody += bLinear ? "</linearGradient>" : "</radialGradient>";
+	return GetDef(bLinear ? "linearGradient" : "radialGradient", strBody);
+}
+
+u32t OSvgWriter::GetPatternDef(const OPaint& paint)
+{
+	auto& rc = paint.rcImage;
+	std::string strBody = " patternUnits=\"userSpaceOnUse\"";
+	_AppendNumber(strBody, "x", rc.x);
+	_AppendNumber(strBody, "y", rc.y);
+	_AppendNumber(strBody, "width", rc.w);
+	_AppendNumber(strBody, "height", rc.h);
+	_AppendTransform(strBody, paint.mtx, "patternTransform");
+	strBody += "><use xlink:href=\"#";
+	_AppendId(strBody, paint.nImageId);
+	strBody += '"';
+	if (paint.bSymbol)
+	{
+		_AppendNumber(strBody, "x", rc.x);
+		_AppendNumber(strBody, "y", rc.y);
+		_AppendNumber(strBody, "width", rc.w);
+		_AppendNumber(strBody, "height", rc.h);
+	}
+	strBody += "/></pattern>";
+	return GetDef("pattern", strBody);
+}
+
+void OSvgWriter::WriteElement(const char* szTag, const std::string& strAttrs, const std::string& strStyle,
+	const OMatrix& mtx, const std::string& strContent)
+{
+	// The CSS rule of a new style goes before the element
+	std::string strClass = strStyle.empty() ? std::string() : GetStyleAttr(strStyle);
+	m_out += '<';
+	m_out += szTag;
+	m_out += strAttrs;
+	m_out += strClass;
+	_AppendTransform(m_out, mtx);
+	if (strContent.empty())
+		m_out += "/>\n";
+	else
+	{
+		m_out += '>';
+		m_out += strContent;
+		m_out += "</";
+		m_out += szTag;
+		m_out += ">\n";
+	}
+	++m_stats.nElements;
+	Written();
+}
+
+void OSvgWriter::WriteImageDefStart(u32t nId, double fWidth, double fHeight, const char* szMime)
+{
+	m_out += "<defs><image id=\"";
+	_AppendId(m_out, nId);
+	m_out += '"';
+	_AppendNumber(m_out, "width", fWidth);
+	_AppendNumber(m_out, "height", fHeight);
+	m_out += " preserveAspectRatio=\"none\" xlink:href=\"data:";
+	m_out += szMime;
+	m_out += ";base64,";
+}
+
+void OSvgWriter::WriteImageDefEnd()
+{
+	m_out += "\"/></defs>\n";
+	Written();
+}
+
+void OSvgWriter::BeginDocument(const ORect& rcBounds, const OPoint& ptPixelsPerMm)
+{
+	m_out += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<svg xmlns=\"http://www.w3.org/2000/svg\" xmlns:xlink=\"http://www.w3.org/1999/xlink\" version=\"1.1\"";
+	m_out += " width=\"";
+	_AppendNumber(m_out, rcBounds.w / ptPixelsPerMm.x);
+	m_out += "mm\" height=\"";
+	_AppendNumber(m_out, rcBounds.h / ptPixelsPerMm.y);
+	m_out += "mm\" viewBox=\"";
+	for (double fVal : { rcBounds.x, rcBounds.y, rcBounds.w })
+	{
+		_AppendNumber(m_out, fVal);
+		m_out += ' ';
+	}
+	_AppendNumber(m_out, rcBounds.h);
+	m_out += "\" xml:space=\"preserve\">\n";
+	Written();
+}
+
+void OSvgWriter::EndDocument()
+{
+	m_out += "</svg>\n";
+	Written();
+}
+
+void OSvgWriter::DrawPath(const OPath& path, const OPaint* pFill, bool bEvenOdd, const OStroke* pStroke,
+	const OMatrix& mtx)
+{
+	std::string strStyle;
+	if (pFill)
+	{
+		AppendPaint(strStyle, "fill", *pFill);
+		if (bEvenOdd)
+			strStyle += ";fill-rule:evenodd";
+	}
+	else
+		strStyle = "fill:none";
+	if (pStroke)
+	{
+		strStyle += ';';
+		AppendPaint(strStyle, "stroke", pStroke->paint);
+		strStyle += ";stroke-width:";
+		_AppendNumber(strStyle, pStroke->fWidth);
+		switch (pStroke->nCap)
+		{
+		case OLineCap::Round:	strStyle += ";stroke-linecap:round";	break;
+		case OLineCap::Square:	strStyle += ";stroke-linecap:square";	break;
+		default:														break;
+		}
+		switch (pStroke->nJoin)
+		{
+		case OLineJoin::Round:	strStyle += ";stroke-linejoin:round";	break;
+		case OLineJoin::Bevel:	strStyle += ";stroke-linejoin:bevel";	break;
+		default:
+			if (pStroke->fMiterLimit != 4)
+			{
+				strStyle += ";stroke-miterlimit:";
+				_AppendNumber(strStyle, pStroke->fMiterLimit);
+			}
+			break;
+		}
+		if (!pStroke->vDashes.empty())
+		{
+			strStyle += ";stroke-dasharray:";
+			for (size_t ii = 0; ii < pStroke->vDashes.size(); ++ii)
+			{
+				if (ii)
+					strStyle += ',';
+				_AppendNumber(strStyle, pStroke->vDashes[ii]);
+			}
+			if (pStroke->fDashOffset != 0)
+			{
+				strStyle += ";stroke-dashoffset:";
+				_AppendNumber(strStyle, pStroke->fDashOffset);
+			}
+		}
+	}
+	std::string d;
+	_AppendPath(d, path);
+	WriteElement("path", " d=\"" + d + '"', strStyle, mtx);
+}
+
+void OSvgWriter::DrawText(const OTextRun& run, const OMatrix& mtx)
+{
+	std::string strContent;
+	_AppendText(strContent, run.vText.data(), run.vText.size());
+	if (strContent.empty())
+		return;
+	std::string strStyle;
+	AppendPaint(strStyle, "fill", run.paint);
+	_AppendFontFamily(strStyle, run.vFamily.data(), run.vFamily.size());
+	_AppendFontStyle(strStyle, run.fEmSize, run.nWeight, run.bItalic, run.bUnderline, run.bStrikeOut);
+	switch (run.nAnchor)
+	{
+	case OTextAnchor::Middle:	strStyle += ";text-anchor:middle";	break;
+	case OTextAnchor::End:		strStyle += ";text-anchor:end";		break;
+	default:														break;
+	}
+	// A single y for text on a horizontal line
+	std::string strAttrs, strX, strY;
+	bool bOneY = true;
+	for (size_t ii = 0; ii < run.vPos.size(); ++ii)
+	{
+		if (ii)
+		{
+			strX += ' ';
+			strY += ' ';
+		}
+		_AppendNumber(strX, run.vPos[ii].x);
+		_AppendNumber(strY, run.vPos[ii].y);
+		bOneY = bOneY && run.vPos[ii].y == run.vPos[0].y;
+	}
+	if (!run.vPos.empty())
+	{
+		if (run.vPos.size() > 1 || run.vPos[0].x != 0)
+			strAttrs += " x=\"" + strX + '"';
+		if (!bOneY)
+			strAttrs += " y=\"" + strY + '"';
+		else if (run.vPos[0].y != 0)
+			_AppendNumber(strAttrs, "y", run.vPos[0].y);
+	}
+	WriteElement("text", strAttrs, strStyle, mtx, strContent);
+}
+
+void OSvgWriter::DrawImage(const OImageRef& ref, const ORect& rcImage, const OMatrix& mtxDst, double fOpacity)
+{
+	// The nested <svg> shows rcSrc of the image over its unit square, which
+	// needs a positive size; flips go to the transform
+	ORect rcSrc = rcImage;
+	OMatrix mtx = mtxDst;
+	if (rcSrc.w < 0)
+	{
+		rcSrc.x += rcSrc.w;
+		rcSrc.w = -rcSrc.w;
+		mtx = OMatrix::Multiply({ -1, 0, 0, 1, 1, 0 }, mtx);
+	}
+	if (rcSrc.h < 0)
+	{
+		rcSrc.y += rcSrc.h;
+		rcSrc.h = -rcSrc.h;
+		mtx = OMatrix::Multiply({ 1, 0, 0, -1, 0, 1 }, mtx);
+	}
+	if (!(rcSrc.w > 0) || !(rcSrc.h > 0) || !ref.nId)
+		return;
+	m_out += "<g";
+	_AppendTransform(m_out, mtx);
+	if (fOpacity < 1)
+		_AppendNumber(m_out, "opacity", std::max(fOpacity, 0.0));
+	m_out += "><svg width=\"1\" height=\"1\" viewBox=\"";
+	for (double fVal : { rcSrc.x, rcSrc.y, rcSrc.w })
+	{
+		_AppendNumber(m_out, fVal);
+		m_out += ' ';
+	}
+	_AppendNumber(m_out, rcSrc.h);
+	m_out += "\" preserveAspectRatio=\"none\"><use xlink:href=\"#";
+	_AppendId(m_out, ref.nId);
+	m_out += '"';
+	if (ref.bSymbol)
+	{
+		_AppendNumber(m_out, "x", ref.rcSpace.x);
+		_AppendNumber(m_out, "y", ref.rcSpace.y);
+		_AppendNumber(m_out, "width", ref.rcSpace.w);
+		_AppendNumber(m_out, "height", ref.rcSpace.h);
+	}
+	m_out += "/></svg></g>\n";
+	++m_stats.nElements;
+	++m_stats.nReused;
+	Written();
+}
+
+void OSvgWriter::PushClip(const OPath& path, bool bEvenOdd, const OMatrix& mtx)
+{
+	std::string strBody = " clipPathUnits=\"userSpaceOnUse\"><path d=\"";
+	_AppendPath(strBody, path);
+	strBody += '"';
+	_AppendTransform(strBody, mtx);
+	if (bEvenOdd)
+		strBody += " clip-rule=\"evenodd\"";
+	strBody += "/></clipPath>";
+	u32t nId = GetDef("clipPath", strBody);
+	m_out += "<g clip-path=\"url(#";
+	_AppendId(m_out, nId);
+	m_out += ")\">\n";
+}
+
+void OSvgWriter::PopClip()
+{
+	m_out += "</g>\n";
+	Written();
+}
+
+bool OSvgWriter::FindImage(u64t nKey, OImageRef& ref)
+{
+	return FindDef(nKey, ref.nId);
+}
+
+bool OSvgWriter::AddImageFile(u64t nKey, const u8t* pData, size_t nSize, u32t nWidth, u32t nHeight, OImageRef& ref)
+{
+	auto szMime = _GetImageMime(pData, nSize);
+	if (!szMime)
+		return false;
+	ref.nId = AddDef(nKey);
+	WriteImageDefStart(ref.nId, nWidth, nHeight, szMime);
+	OBase64Writer base64(m_out);
+	base64.Write(pData, nSize);
+	base64.End();
+	WriteImageDefEnd();
+	return true;
+}
+
+bool OSvgWriter::AddImagePixels(u64t nKey, u32t nWidth, u32t nHeight, bool bAlpha, const RowSource& fnRows,
+	OImageRef& ref)
+{
+	ref.nId = AddDef(nKey);
+	WriteImageDefStart(ref.nId, nWidth, nHeight, "image/png");
+	OBase64Writer base64(m_out);
+	emfpng::OPngWriter png([&](const void* pData, size_t nSize)
+		{
+			base64.Write(pData, nSize);
+			Written();
+			return !m_bFailed;
+		});
+	emfpng::OImageFormat fmt{ nWidth, nHeight, bAlpha };
+	size_t nStride = (size_t)nWidth * 4;
+	u32t nBandRows = (u32t)std::clamp<size_t>(ImageBandMemory / nStride, 1, nHeight);
+	memory_vector vRows(nStride * nBandRows);
+	emfpng::OEncodedBand band;
+	bool bOK = png.Begin(fmt, 0);
+	for (u32t nTop = 0; nTop < nHeight && bOK; nTop += nBandRows)
+	{
+		u32t nRows = std::min(nBandRows, nHeight - nTop);
+		if (!fnRows(nTop, nRows, vRows.data()))
+			memset(vRows.data(), 0, nStride * nRows);
+		if (bAlpha)
+			_UnPremultiply(vRows.data(), (size_t)nWidth * nRows);
+		emfpng::EncodeBand(fmt, vRows.data(), (ptrdiff_t)nStride, nRows, nTop + nRows == nHeight, band);
+		bOK = png.AddBand(band);
+	}
+	bOK = bOK && png.End();
+	base64.End();
+	WriteImageDefEnd();
+	return true;
+}
+
+bool OSvgWriter::BeginSymbol(u64t nKey, const ORect& rcBounds, OImageRef& ref)
+{
+	ref.nId = AddDef(nKey);
+	m_out += "<defs><symbol id=\"";
+	_AppendId(m_out, ref.nId);
+	m_out += "\" viewBox=\"";
+	for (double fVal : { rcBounds.x, rcBounds.y, rcBounds.w })
+	{
+		_AppendNumber(m_out, fVal);
+		m_out += ' ';
+	}
+	_AppendNumber(m_out, rcBounds.h);
+	m_out += "\" preserveAspectRatio=\"none\">\n";
+	Written();
+	return true;
+}
+
+void OSvgWriter::EndSymbol()
+{
+	m_out += "</symbol></defs>\n";
+	Written();
+}
+
+bool OSvgWriter::Convert(const Source& source)
+{
+	m_out.clear();
+	m_stats = {};
+	m_mapStyles.clear();
+	m_mapDefs.clear();
+	m_nNextId = 1;
+	m_bFailed = false;
+	bool bRet = PlayMetafile(source, *this);
+	return Flush() && bRet;
+}
+
+bool OSvgWriter::Convert(const u8t* pData, size_t nSize)
+{
+	return Convert(MemorySource(pData, nSize));
+}
+
+}
+
+#pragma pop_macro("min")
+#pragma pop_macro("max")
+
+#endif // _ENABLE_GDIPLUS_STRUCT
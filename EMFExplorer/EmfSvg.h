@@ -0,0 +1,109 @@
+#ifndef EMF_SVG_H
+#define EMF_SVG_H
+
+#ifdef _ENABLE_GDIPLUS_STRUCT
+
+#include "EmfVector.h"
+#include <string>
+#include <unordered_map>
+
+// Streaming conversion of an EMF, and of the EMF+ records it carries, to SVG,
+// as the device the metafile is played on (emfvector).
+// - Clips become nested <g> with a clip-path.
+// - Pen, brush and text styles are written once as CSS classes; gradients,
+//   hatches, clip paths, images and embedded metafiles once in <defs>. Each
+//   is written where it's first used and referred to afterwards.
+// - Images are written as PNG data URIs, encoded from the records by bands
+//   (emfdib, emfpng); JPEG, PNG, GIF and BMP payloads are written as is.
+// - Embedded EMF+ metafile images become <symbol>.
+// Text layout is left to the SVG renderer.
+namespace emfsvg
+{
+	using namespace emfvector;
+
+	using OSvgStats = OVectorStats;
+
+	class OSvgWriter : public OVectorDevice
+	{
+	public:
+		enum : size_t {
+			FlushSize		= 64 * 1024,
+			// Past these, styles and defs are written again rather than remembered
+			MaxStyles		= 64 * 1024,
+			MaxDefs			= 256 * 1024,
+			// Decoded pixels of an image held at once while it's encoded
+			ImageBandMemory	= 1024 * 1024,
+		};
+
+		explicit OSvgWriter(Sink sink) : m_sink(std::move(sink)) {}
+
+		OSvgWriter(const OSvgWriter&) = delete;
+		OSvgWriter& operator=(const OSvgWriter&) = delete;
+	public:
+		// Writes the SVG of the EMF read from the source. Fails on anything
+		// but an EMF, on truncated records and when the sink fails.
+		bool Convert(const Source& source);
+
+		bool Convert(const u8t* pData, size_t nSize);
+	private:
+		bool IsFailed() const override { return m_bFailed; }
+		void BeginDocument(const ORect& rcBounds, const OPoint& ptPixelsPerMm) override;
+		void EndDocument() override;
+		void DrawPath(const OPath& path, const OPaint* pFill, bool bEvenOdd, const OStroke* pStroke,
+			const OMatrix& mtx) override;
+		void DrawText(const OTextRun& run, const OMatrix& mtx) override;
+		void DrawImage(const OImageRef& ref, const ORect& rcSrc, const OMatrix& mtxDst, double fOpacity) override;
+		void PushClip(const OPath& path, bool bEvenOdd, const OMatrix& mtx) override;
+		void PopClip() override;
+		bool FindImage(u64t nKey, OImageRef& ref) override;
+		bool AddImageFile(u64t nKey, const u8t* pData, size_t nSize, u32t nWidth, u32t nHeight,
+			OImageRef& ref) override;
+		bool AddImagePixels(u64t nKey, u32t nWidth, u32t nHeight, bool bAlpha, const RowSource& fnRows,
+			OImageRef& ref) override;
+		bool BeginSymbol(u64t nKey, const ORect& rcBounds, OImageRef& ref) override;
+		void EndSymbol() override;
+
+		// Hands the output to the sink once there's enough of it
+		inline void Written()
+		{
+			if (m_out.size() >= FlushSize)
+				Flush();
+		}
+
+		bool Flush();
+
+		// Class attribute of the style, the CSS rule written first if new
+		std::string GetStyleAttr(const std::string& strStyle);
+
+		// szTag and strBody make a def, strBody being what follows the id.
+		// Returns the id of the same def written before, or writes it.
+		u32t GetDef(const char* szTag, const std::string& strBody);
+
+		// Defs written by the caller, keyed by a hash of their content
+		bool FindDef(u64t nKey, u32t& nId);
+		u32t AddDef(u64t nKey);
+
+		// CSS declaration of szProp ("fill", "stroke"), the def of the paint written first if new
+		void AppendPaint(std::string& strStyle, const char* szProp, const OPaint& paint);
+		u32t GetHatchDef(const OPaint& paint);
+		u32t GetGradientDef(const OPaint& paint);
+		u32t GetPatternDef(const OPaint& paint);
+
+		// <szTag strAttrs class transform>strContent</szTag>, the style written first if new
+		void WriteElement(const char* szTag, const std::string& strAttrs, const std::string& strStyle,
+			const OMatrix& mtx, const std::string& strContent = std::string());
+		void WriteImageDefStart(u32t nId, double fWidth, double fHeight, const char* szMime);
+		void WriteImageDefEnd();
+	private:
+		Sink								m_sink;
+		std::string							m_out;
+		std::unordered_map<std::string, u32t>	m_mapStyles;
+		std::unordered_map<u64t, u32t>		m_mapDefs;
+		u32t								m_nNextId = 1;
+		bool								m_bFailed = false;
+	};
+}
+
+#endif // _ENABLE_GDIPLUS_STRUCT
+
+#endif // EMF_SVG_H
@@ -0,0 +1,2854 @@
+#include PCH_FNAME
+#ifdef _ENABLE_GDIPLUS_STRUCT
+
+#include "EmfVector.h"
+#include "EmfDIBDecode.h"
+#include "DataHash.h"
+#include <memory>
+
+#pragma push_macro("min")
+#pragma push_macro("max")
+#undef max
+#undef min
+
+namespace emfvector
+{
+
+namespace
+{
+	enum : u16t
+	{
+		PlusFlagS	= 0x8000,	// the brush is a color
+		PlusFlagC	= 0x4000,	// 16-bit points and rects
+		PlusFlagW	= 0x2000,	// winding fill, also L (DrawLines) and A (transforms)
+		PlusFlagP	= 0x0800,	// relative points
+	};
+
+	enum : size_t
+	{
+		PlusObjectCount	= 64,
+		MaxHandles		= 64 * 1024,
+		MaxRecordSize	= 1024 * 1024 * 1024,
+		// Larger images are left out, their output would be as large
+		MaxImagePixels	= 256 * 1024 * 1024,
+		// Zeroed bytes past each record read, for the readers that go a bit past
+		RecordSlack		= 16,
+		// Of the consecutive lines drawn as one path
+		MaxLinesPoints	= 4096,
+	};
+
+	const u32t StockObjectFlag = 0x80000000;
+	// Font metrics aren't known here, these are of the em size
+	const double TextAscent = 0.9;
+	const double TextDescent = 0.25;
+	const double TextLineHeight = 1.15;
+
+	struct OGdiPen
+	{
+		bool				bNull = false;
+		COLORREF			crColor = 0;
+		double				fWidth = 0;			// logical units, 0 for cosmetic pens
+		u32t				nStyle = PS_SOLID;	// style, end cap and join bits
+		std::vector<double>	vDashes;			// PS_USERSTYLE
+	};
+
+	struct OGdiBrush
+	{
+		u32t		nStyle = BS_SOLID;
+		COLORREF	crColor = RGB(255, 255, 255);
+		u32t		nHatch = 0;
+		OImageRef	image;		// of pattern brushes
+	};
+
+	enum class OGdiObjectType
+	{
+		None,
+		Pen,
+		Brush,
+		Font,
+	};
+
+	struct OGdiObject
+	{
+		OGdiObjectType	nType = OGdiObjectType::None;
+		OGdiPen			pen;
+		OGdiBrush		brush;
+		LOGFONTW		font{};
+	};
+
+	struct OGdiState
+	{
+		u32t		nMapMode = MM_TEXT;
+		OPoint		ptWindowOrg{ 0, 0 };
+		OPoint		szWindowExt{ 1, 1 };
+		OPoint		ptViewportOrg{ 0, 0 };
+		OPoint		szViewportExt{ 1, 1 };
+		OMatrix		world;
+		OGdiPen		pen;
+		OGdiBrush	brush;
+		LOGFONTW	font{};
+		COLORREF	crText = 0;
+		COLORREF	crBk = RGB(255, 255, 255);
+		u32t		nBkMode = OPAQUE;
+		u32t		nTextAlign = 0;
+		u32t		nFillMode = ALTERNATE;
+		u32t		nArcDirection = AD_COUNTERCLOCKWISE;
+		double		fMiterLimit = 10;
+		POINTL		ptCur{ 0, 0 };
+		size_t		nClipBase = 0;	// clips pushed when this level was saved
+	};
+
+	struct OGdiSave
+	{
+		OGdiState	state;
+		size_t		nLevel;
+	};
+
+	struct OPlusState
+	{
+		OMatrix		world;
+		OMatrix		base;		// of the container
+		OUnitType	nPageUnit = OUnitType::Display;
+		double		fPageScale = 1;
+		size_t		nClipBase = 0;
+	};
+
+	struct OPlusSave
+	{
+		u32t		nStackIndex;
+		OPlusState	state;
+		size_t		nLevel;
+	};
+}
+
+Source MemorySource(const u8t* pData, size_t nSize)
+{
+	return [pData, nSize, nPos = (size_t)0](void* pOut, size_t nCount) mutable
+	{
+		nCount = std::min(nCount, nSize - nPos);
+		memcpy(pOut, pData + nPos, nCount);
+		nPos += nCount;
+		return nCount;
+	};
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Paints and paths
+
+bool OPaint::operator==(const OPaint& other) const
+{
+	if (nType != other.nType || clr.argb != other.clr.argb || clrBack.argb != other.clrBack.argb
+		|| nHatchStyle != other.nHatchStyle || ptStart.x != other.ptStart.x || ptStart.y != other.ptStart.y
+		|| ptEnd.x != other.ptEnd.x || ptEnd.y != other.ptEnd.y || nWrap != other.nWrap || nImageId != other.nImageId
+		|| bSymbol != other.bSymbol || !(mtx == other.mtx) || vStops.size() != other.vStops.size())
+		return false;
+	for (size_t ii = 0; ii < vStops.size(); ++ii)
+	{
+		if (vStops[ii].fOffset != other.vStops[ii].fOffset || vStops[ii].clr.argb != other.vStops[ii].clr.argb)
+			return false;
+	}
+	return true;
+}
+
+bool OStroke::operator==(const OStroke& other) const
+{
+	return paint == other.paint && fWidth == other.fWidth && nCap == other.nCap && nJoin == other.nJoin
+		&& fMiterLimit == other.fMiterLimit && vDashes == other.vDashes && fDashOffset == other.fDashOffset;
+}
+
+void OPath::Append(const OPath& path)
+{
+	m_vOps.insert(m_vOps.end(), path.m_vOps.begin(), path.m_vOps.end());
+	m_vPoints.insert(m_vPoints.end(), path.m_vPoints.begin(), path.m_vPoints.end());
+}
+
+void OPath::AddRect(double x, double y, double w, double h)
+{
+	MoveTo(x, y);
+	LineTo(x + w, y);
+	LineTo(x + w, y + h);
+	LineTo(x, y + h);
+	Close();
+}
+
+void OPath::AddEllipse(double cx, double cy, double rx, double ry)
+{
+	AddArc(cx, cy, rx, ry, 0, F_2PI, false);
+	Close();
+}
+
+void OPath::AddRoundRect(double l, double t, double r, double b, double rx, double ry)
+{
+	rx = std::min(std::fabs(rx), (r - l) / 2);
+	ry = std::min(std::fabs(ry), (b - t) / 2);
+	if (rx <= 0 || ry <= 0)
+	{
+		AddRect(l, t, r - l, b - t);
+		return;
+	}
+	const double fQuarter = F_PI / 2;
+	AddArc(r - rx, t + ry, rx, ry, -fQuarter, fQuarter, false);
+	AddArc(r - rx, b - ry, rx, ry, 0, fQuarter, true);
+	AddArc(l + rx, b - ry, rx, ry, fQuarter, fQuarter, true);
+	AddArc(l + rx, t + ry, rx, ry, F_PI, fQuarter, true);
+	Close();
+}
+
+OPoint OPath::AddArc(double cx, double cy, double rx, double ry, double fStart, double fSweep, bool bConnect)
+{
+	rx = std::fabs(rx);
+	ry = std::fabs(ry);
+	fSweep = std::clamp(fSweep, -F_2PI, F_2PI);
+	// Angles from the center to parameters of the ellipse, which the Beziers follow
+	auto ToParam = [rx, ry](double fAngle) { return std::atan2(rx * std::sin(fAngle), ry * std::cos(fAngle)); };
+	double t0 = ToParam(fStart);
+	double fParamSweep;
+	if (std::fabs(fSweep) >= F_2PI - 1e-9)
+		fParamSweep = fSweep;
+	else
+	{
+		fParamSweep = ToParam(fStart + fSweep) - t0;
+		if (fSweep > 0 && fParamSweep < 0)
+			fParamSweep += F_2PI;
+		else if (fSweep < 0 && fParamSweep > 0)
+			fParamSweep -= F_2PI;
+	}
+	auto At = [&](double t) { return OPoint{ cx + rx * std::cos(t), cy + ry * std::sin(t) }; };
+	OPoint pt = At(t0);
+	if (bConnect)
+		LineTo(pt.x, pt.y);
+	else
+		MoveTo(pt.x, pt.y);
+	// Parts of a quarter turn at most, close enough to the ellipse
+	int nParts = std::max(1, (int)std::ceil(std::fabs(fParamSweep) / (F_PI / 2) - 1e-9));
+	double fStep = fParamSweep / nParts;
+	double k = 4.0 / 3.0 * std::tan(fStep / 4);
+	for (int ii = 0; ii < nParts; ++ii)
+	{
+		double t1 = t0 + fStep * ii, t2 = t1 + fStep;
+		OPoint pt1 = At(t1);
+		pt = At(t2);
+		BezierTo({ pt1.x - k * rx * std::sin(t1), pt1.y + k * ry * std::cos(t1) },
+			{ pt.x + k * rx * std::sin(t2), pt.y - k * ry * std::cos(t2) }, pt);
+	}
+	return pt;
+}
+
+void OPath::AddCardinal(const std::vector<OPoint>& pts, double fTension, bool bClosed, size_t nOffset, size_t nSegments)
+{
+	size_t nCount = pts.size();
+	if (nCount < 2)
+		return;
+	size_t nMax = bClosed ? nCount : nCount - 1;
+	nOffset = std::min(nOffset, nMax);
+	nSegments = std::min(nSegments, nMax - nOffset);
+	if (!nSegments)
+		return;
+	auto at = [&](ptrdiff_t nIndex) -> const OPoint&
+	{
+		if (bClosed)
+			return pts[(size_t)((nIndex % (ptrdiff_t)nCount + (ptrdiff_t)nCount) % (ptrdiff_t)nCount)];
+		return pts[(size_t)std::clamp<ptrdiff_t>(nIndex, 0, (ptrdiff_t)nCount - 1)];
+	};
+	double k = fTension / 3;
+	MoveTo(at(nOffset).x, at(nOffset).y);
+	for (size_t ii = nOffset; ii < nOffset + nSegments; ++ii)
+	{
+		auto& p0 = at((ptrdiff_t)ii - 1);
+		auto& p1 = at(ii);
+		auto& p2 = at(ii + 1);
+		auto& p3 = at(ii + 2);
+		BezierTo({ p1.x + (p2.x - p0.x) * k, p1.y + (p2.y - p0.y) * k },
+			{ p2.x - (p3.x - p1.x) * k, p2.y - (p3.y - p1.y) * k }, p2);
+	}
+	if (bClosed && nSegments == nCount)
+		Close();
+}
+
+OPath OPath::Transform(const OMatrix& mtx) const
+{
+	OPath path;
+	path.m_vOps = m_vOps;
+	path.m_vPoints.reserve(m_vPoints.size());
+	for (auto& pt : m_vPoints)
+		path.m_vPoints.push_back(mtx.Map(pt.x, pt.y));
+	return path;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Record data
+
+// Rectangles of a RGNDATA
+static void _AddRegion(OPath& path, const u8t* pRgn, size_t cbRgn)
+{
+	if (cbRgn < sizeof(RGNDATAHEADER))
+		return;
+	auto& hdr = *(const RGNDATAHEADER*)pRgn;
+	if (hdr.dwSize < sizeof(RGNDATAHEADER) || hdr.dwSize > cbRgn
+		|| (u64t)hdr.nCount * sizeof(RECTL) > cbRgn - hdr.dwSize)
+		return;
+	auto prc = (const RECTL*)(pRgn + hdr.dwSize);
+	for (u32t ii = 0; ii < hdr.nCount; ++ii)
+		path.AddRect(prc[ii].left, prc[ii].top, (double)prc[ii].right - prc[ii].left, (double)prc[ii].bottom - prc[ii].top);
+}
+
+// Device bounds of the document as a path in the space mtx maps from, to
+// exclude shapes from
+static void _AddBoundsPath(OPath& path, const ORect& rcBounds, const OMatrix& mtx)
+{
+	// Wide enough for anything drawn outside the bounds to be clipped as well
+	double fMargin = std::max(rcBounds.w, rcBounds.h);
+	ORect rc{ rcBounds.x - fMargin, rcBounds.y - fMargin, rcBounds.w + 2 * fMargin, rcBounds.h + 2 * fMargin };
+	auto mtxInv = mtx.Inverse();
+	OPoint pts[4] = { mtxInv.Map(rc.x, rc.y), mtxInv.Map(rc.x + rc.w, rc.y),
+		mtxInv.Map(rc.x + rc.w, rc.y + rc.h), mtxInv.Map(rc.x, rc.y + rc.h) };
+	path.AddPoly(pts, 4, true);
+}
+
+static std::vector<OPoint> _GetPoints(const OEmfPlusPointDataArray& data, bool bRelative)
+{
+	std::vector<OPoint> pts;
+	pts.reserve(data.size());
+	if (data.fvals.size())
+	{
+		for (size_t ii = 0; ii < data.fvals.size(); ++ii)
+			pts.push_back({ data.fvals[ii].x, data.fvals[ii].y });
+	}
+	else
+	{
+		// Relative points are kept as read, as offsets from the previous one
+		double x = 0, y = 0;
+		for (size_t ii = 0; ii < data.ivals.size(); ++ii)
+		{
+			if (bRelative)
+			{
+				x += data.ivals[ii].x;
+				y += data.ivals[ii].y;
+			}
+			else
+			{
+				x = data.ivals[ii].x;
+				y = data.ivals[ii].y;
+			}
+			pts.push_back({ x, y });
+		}
+	}
+	return pts;
+}
+
+static ORect _GetRect(const OEmfPlusRectData& rc)
+{
+	if (rc.fval.is_enabled())
+		return { rc.fval->X, rc.fval->Y, rc.fval->Width, rc.fval->Height };
+	if (rc.ival.is_enabled())
+		return { (double)rc.ival->X, (double)rc.ival->Y, (double)rc.ival->Width, (double)rc.ival->Height };
+	return {};
+}
+
+static void _AddPlusPath(OPath& path, const OEmfPlusPath& plusPath)
+{
+	auto pts = _GetPoints(plusPath.PathPoints, plusPath.PointsAreRelative());
+	std::vector<u8t> vTypes;
+	vTypes.reserve(pts.size());
+	if (plusPath.PathPointTypesAreRLE())
+	{
+		for (size_t ii = 0; ii < plusPath.PathPointTypesRLE.size() && vTypes.size() < pts.size(); ++ii)
+		{
+			auto nRLE = plusPath.PathPointTypesRLE[ii];
+			u8t nType = (u8t)(nRLE & 0xFF);
+			if (nRLE & (u16t)OEmfPlusPath::OEmfPlusPathPointTypeRLEFlag::Bezier)
+				nType = (u8t)((nType & (u8t)OEmfPlusPath::OPathPointType::FlagMask) | (u8t)OEmfPlusPath::OPathPointType::Bezier);
+			vTypes.insert(vTypes.end(), std::min<size_t>(OEmfPlusPath::GetRunCount(nRLE), pts.size() - vTypes.size()), nType);
+		}
+	}
+	else
+	{
+		for (size_t ii = 0; ii < plusPath.PathPointTypes.size() && ii < pts.size(); ++ii)
+			vTypes.push_back(plusPath.PathPointTypes[ii]);
+	}
+	const u8t nClose = (u8t)OEmfPlusPath::OPathPointType::CloseSubpath;
+	for (size_t ii = 0; ii < vTypes.size(); ++ii)
+	{
+		auto nType = OEmfPlusPath::GetPathPointType(vTypes[ii]);
+		if (ii == 0 || nType == OEmfPlusPath::OPathPointType::Start)
+			path.MoveTo(pts[ii].x, pts[ii].y);
+		else if (nType == OEmfPlusPath::OPathPointType::Bezier && ii + 2 < vTypes.size())
+		{
+			path.BezierTo(pts[ii], pts[ii + 1], pts[ii + 2]);
+			ii += 2;
+		}
+		else
+			path.LineTo(pts[ii].x, pts[ii].y);
+		if (vTypes[ii] & nClose)
+			path.Close();
+	}
+}
+
+static double _UnitToPixels(OUnitType nUnit, double fDpi)
+{
+	switch (nUnit)
+	{
+	case OUnitType::Point:		return fDpi / 72;
+	case OUnitType::Inch:		return fDpi;
+	case OUnitType::Document:	return fDpi / 300;
+	case OUnitType::Millimeter:	return fDpi / 25.4;
+	default:					return 1;
+	}
+}
+
+static OEmfPlusARGB _Lerp(const OEmfPlusARGB& a, const OEmfPlusARGB& b, double t)
+{
+	t = std::clamp(t, 0.0, 1.0);
+	auto mix = [t](u8t x, u8t y) { return (u8t)std::lround(x + (y - x) * t); };
+	OEmfPlusARGB clr;
+	clr.Red = mix(a.Red, b.Red);
+	clr.Green = mix(a.Green, b.Green);
+	clr.Blue = mix(a.Blue, b.Blue);
+	clr.Alpha = mix(a.Alpha, b.Alpha);
+	return clr;
+}
+
+static void _AddStop(OPaint& paint, double fOffset, const OEmfPlusARGB& clr)
+{
+	fOffset = std::clamp(fOffset, 0.0, 1.0);
+	// Offsets only go up
+	if (!paint.vStops.empty())
+		fOffset = std::max(fOffset, paint.vStops.back().fOffset);
+	paint.vStops.push_back({ fOffset, clr });
+}
+
+static inline OPaint _ColorPaint(const OEmfPlusARGB& clr)
+{
+	OPaint paint;
+	paint.nType = OPaintType::Color;
+	paint.clr = clr;
+	return paint;
+}
+
+// Bytes taken by nCount EMF+ points at nOffset of the record data, or
+// UNKNOWN_SIZE if they don't fit
+static size_t _GetPlusPointsSize(const OEmfPlusRecInfo& rec, size_t nOffset, u64t nCount, bool bMayBeRelative = true)
+{
+	if (nOffset > rec.DataSize)
+		return UNKNOWN_SIZE;
+	size_t nAvail = rec.DataSize - nOffset;
+	if (bMayBeRelative && (rec.Flags & PlusFlagP))
+	{
+		// Each coordinate takes 1 or 2 bytes
+		size_t nSize = 0;
+		for (u64t ii = 0; ii < nCount * 2; ++ii)
+		{
+			if (nSize >= nAvail)
+				return UNKNOWN_SIZE;
+			nSize += (rec.Data[nOffset + nSize] & 0x80) ? 2 : 1;
+		}
+		return nSize <= nAvail ? nSize : UNKNOWN_SIZE;
+	}
+	u64t nSize = nCount * ((rec.Flags & PlusFlagC) ? sizeof(OEmfPlusPoint) : sizeof(OEmfPlusPointF));
+	return nSize <= nAvail ? (size_t)nSize : UNKNOWN_SIZE;
+}
+
+static inline bool _GetPlusU32(const OEmfPlusRecInfo& rec, size_t nOffset, u32t& nVal)
+{
+	if (nOffset + sizeof(u32t) > rec.DataSize)
+		return false;
+	memcpy(&nVal, rec.Data + nOffset, sizeof(u32t));
+	return true;
+}
+
+// Whether the record data holds the count of points at nCountOffset, and the points after it
+static bool _PlusPointsFit(const OEmfPlusRecInfo& rec, size_t nCountOffset, bool bMayBeRelative = true)
+{
+	u32t nCount = 0;
+	return _GetPlusU32(rec, nCountOffset, nCount)
+		&& _GetPlusPointsSize(rec, nCountOffset + sizeof(u32t), nCount, bMayBeRelative) != UNKNOWN_SIZE;
+}
+
+static bool _PlusRectsFit(const OEmfPlusRecInfo& rec, size_t nCountOffset)
+{
+	u32t nCount = 0;
+	return _GetPlusU32(rec, nCountOffset, nCount)
+		&& (u64t)nCount * ((rec.Flags & PlusFlagC) ? sizeof(OEmfPlusRect) : sizeof(OEmfPlusRectF))
+			<= rec.DataSize - nCountOffset - sizeof(u32t);
+}
+
+static inline size_t _GetPlusRectSize(const OEmfPlusRecInfo& rec)
+{
+	return (rec.Flags & PlusFlagC) ? sizeof(OEmfPlusRect) : sizeof(OEmfPlusRectF);
+}
+
+template <typename _Ty>
+static bool _ReadPlusRec(const OEmfPlusRecInfo& rec, _Ty& data)
+{
+	DataReader reader(rec.Data, rec.DataSize);
+	return data.Read(reader, rec.Flags, rec.DataSize);
+}
+
+template <typename _Ty>
+static inline const _Ty* _GetPlusRec(const OEmfPlusRecInfo& rec)
+{
+	return rec.DataSize >= sizeof(_Ty) ? (const _Ty*)rec.Data : nullptr;
+}
+
+template <typename _Ty>
+static inline const _Ty* _GetRec(const ENHMETARECORD* pRec, size_t nMinSize = sizeof(_Ty))
+{
+	return pRec->nSize >= nMinSize ? (const _Ty*)pRec : nullptr;
+}
+
+// Whether nCount items of nItemSize at nOffset are within the record
+static inline bool _InRecord(const ENHMETARECORD* pRec, u64t nOffset, u64t nCount, size_t nItemSize)
+{
+	return nOffset <= pRec->nSize && nCount * nItemSize <= pRec->nSize - nOffset;
+}
+
+// Family name up to its NUL
+template <typename _Ch>
+static std::vector<u16t> _GetFamily(const _Ch* pName, size_t nLength)
+{
+	std::vector<u16t> vFamily;
+	for (size_t ii = 0; ii < nLength && pName[ii]; ++ii)
+		vFamily.push_back((u16t)pName[ii]);
+	return vFamily;
+}
+
+static inline bool _IsLowSurrogate(u16t ch)
+{
+	return ch >= 0xDC00 && ch < 0xE000;
+}
+
+bool GetMetafileBounds(const u8t* pData, size_t nSize, ORect& rcBounds, OPoint* pPixelsPerMm)
+{
+	if (!pData || nSize < offsetof(ENHMETAHEADER, cbPixelFormat))
+		return false;
+	auto& hdr = *(const ENHMETAHEADER*)pData;
+	if (hdr.iType != EMR_HEADER || hdr.dSignature != ENHMETA_SIGNATURE || hdr.nSize < offsetof(ENHMETAHEADER, cbPixelFormat))
+		return false;
+	OPoint ptScale{ 1, 1 };
+	if (hdr.szlDevice.cx > 0 && hdr.szlDevice.cy > 0 && hdr.szlMillimeters.cx > 0 && hdr.szlMillimeters.cy > 0)
+	{
+		ptScale = { (double)hdr.szlDevice.cx / hdr.szlMillimeters.cx, (double)hdr.szlDevice.cy / hdr.szlMillimeters.cy };
+		const size_t nMicrometersEnd = offsetof(ENHMETAHEADER, szlMicrometers) + sizeof(SIZEL);
+		if (hdr.nSize >= nMicrometersEnd && nSize >= nMicrometersEnd
+			&& hdr.szlMicrometers.cx > 0 && hdr.szlMicrometers.cy > 0)
+		{
+			ptScale = { hdr.szlDevice.cx * 1000.0 / hdr.szlMicrometers.cx, hdr.szlDevice.cy * 1000.0 / hdr.szlMicrometers.cy };
+		}
+	}
+	auto& rcFrame = hdr.rclFrame;
+	if (rcFrame.right > rcFrame.left && rcFrame.bottom > rcFrame.top)
+	{
+		// 0.01 mm, inclusive
+		rcBounds = { rcFrame.left / 100.0 * ptScale.x, rcFrame.top / 100.0 * ptScale.y,
+			((double)rcFrame.right - rcFrame.left) / 100.0 * ptScale.x, ((double)rcFrame.bottom - rcFrame.top) / 100.0 * ptScale.y };
+	}
+	else
+	{
+		auto& rc = hdr.rclBounds;
+		rcBounds = { (double)rc.left, (double)rc.top, (double)rc.right - rc.left + 1, (double)rc.bottom - rc.top + 1 };
+	}
+	if (!(rcBounds.w > 0) || !(rcBounds.h > 0))
+		rcBounds.w = rcBounds.h = 1;
+	if (pPixelsPerMm)
+		*pPixelsPerMm = ptScale;
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// OVectorPlayer
+
+namespace
+{
+	// One metafile: the root one, or one embedded in an EMF+ image, played as a symbol
+	class OVectorPlayer
+	{
+	public:
+		OVectorPlayer(OVectorDevice& device, size_t nDepth) : m_device(device), m_nDepth(nDepth)
+		{
+			m_gdi.font.lfHeight = -16;
+		}
+
+		bool Play(const Source& source);
+	private:
+		bool OnHeader(const ENHMETARECORD* pRec);
+		void End();
+		void OnRecord(const ENHMETARECORD* pRec);
+		void OnComment(const ENHMETARECORD* pRec);
+
+		inline OVectorStats& Stats() { return m_device.Stats(); }
+
+		void DrawPath(const OPath& path, const OPaint* pFill, bool bEvenOdd, const OStroke* pStroke, const OMatrix& mtx);
+		// Clips what follows to the path, drawn with mtx. bReplace drops the clips pushed since nClipBase.
+		void PushClip(const OPath& path, const OMatrix& mtx, bool bEvenOdd, bool bReplace, size_t nClipBase);
+		void PopClips(size_t nLevel);
+
+		bool GetDibImage(const u8t* pBmi, size_t cbBmi, const u8t* pBits, size_t cbBits, bool bAlpha, OImageRef& ref);
+		bool GetPlusImage(const OEmfPlusImage& img, OImageRef& ref);
+
+		// GDI
+		OMatrix GetGdiMatrix() const;
+		// False for the null brush
+		bool GetGdiFill(OPaint& paint, const OMatrix& mtx) const;
+		// False for the null pen
+		bool GetGdiStroke(OStroke& stroke, const OMatrix& mtx) const;
+		void GdiDraw(const OPath& path, bool bFill, bool bStroke, const OMatrix& mtx);
+		void OnGdiRecord(const ENHMETARECORD* pRec);
+		// Draws the path (logical units), or adds it to the path bracket
+		void GdiShape(const OPath& path, bool bFill, bool bStroke);
+		void GdiLineTo(const POINTL& pt);
+		void FlushLines();
+		// The path starts at the current point, unless it continues the figure of the path bracket
+		void GdiStartFigure(OPath& path);
+		template <typename _Pt>
+		void GdiPoly(DWORD iType, const _Pt* pts, size_t nCount);
+		template <typename _Pt>
+		void GdiPolyPoly(bool bClose, const DWORD* pCounts, size_t nPolys, const _Pt* pts, size_t nCount);
+		template <typename _Pt>
+		void GdiPolyDraw(const _Pt* pts, const BYTE* pTypes, size_t nCount);
+		void GdiArc(const EMRARC& rec);
+		void GdiText(const ENHMETARECORD* pRec);
+		void GdiBlt(const ENHMETARECORD* pRec);
+		void GdiClip(const OPath& path, const OMatrix& mtx, bool bEvenOdd, DWORD iMode);
+		void GdiSelectObject(u32t ihObject);
+		void GdiPathDone(bool bFill, bool bStroke);
+		OGdiObject* GetHandle(u32t ihObject, bool bCreate);
+
+		// EMF+
+		OMatrix GetPlusMatrix() const;
+		// Length in world units of fValue in nUnit
+		double PlusToWorld(double fValue, OUnitType nUnit) const;
+		void OnPlusRecord(const OEmfPlusRecInfo& rec);
+		void OnPlusObject(const OEmfPlusRecInfo& rec);
+		template <typename _Ty>
+		const _Ty* GetPlusObject(u32t nId) const
+		{
+			return nId < PlusObjectCount ? dynamic_cast<const _Ty*>(m_aPlusObjects[nId].get()) : nullptr;
+		}
+		bool GetPlusPaint(const OEmfPlusBrush& brush, const OMatrix& mtx, OPaint& paint);
+		bool GetPlusFill(u32t nBrushId, bool bColor, const OMatrix& mtx, OPaint& paint);
+		bool GetPlusStroke(u32t nPenId, const OMatrix& mtx, OStroke& stroke);
+		void PlusFill(const OPath& path, u32t nBrushId, bool bColor, bool bWinding = true);
+		void PlusDraw(const OPath& path, u32t nPenId);
+		// Path of the region, false for an infinite one
+		bool GetPlusRegion(OPath& path, const OEmfPlusRegionNode& node);
+		void PlusClip(const OPath& path, bool bEvenOdd, OCombineMode nMode);
+		void PlusFont(const OEmfPlusFont& font, OTextRun& run) const;
+		void PlusString(const OEmfPlusRecInfo& rec);
+		void PlusDriverString(const OEmfPlusRecInfo& rec);
+		void PlusImage(u32t nImageId, const ORect& rcSrc, OUnitType nSrcUnit, const OMatrix& mtxDst);
+		void PlusSave(u32t nStackIndex);
+		void PlusRestore(u32t nStackIndex);
+		void PlusTransform(const OMatrix& mtx, u16t nFlags);
+	private:
+		OVectorDevice&		m_device;
+		size_t				m_nDepth;
+		memory_vector		m_vRecord;
+		ORect				m_rcBounds{};
+		OPoint				m_ptPixelsPerMm{ 1, 1 };
+		size_t				m_nClipLevel = 0;
+
+		// GDI
+		OGdiState				m_gdi;
+		std::vector<OGdiSave>	m_vGdiSaves;
+		std::vector<OGdiObject>	m_vHandles;
+		bool					m_bInPath = false;
+		bool					m_bFigureOpen = false;
+		bool					m_bPathWidened = false;
+		OPath					m_path;
+		OMatrix					m_mtxPath;
+		// Lines of consecutive LineTo, drawn as one path
+		OPath					m_lines;
+		OStroke					m_strokeLines;
+		OMatrix					m_mtxLines;
+		POINTL					m_ptLinesEnd{ 0, 0 };
+
+		// EMF+
+		bool					m_bPlus = false;
+		bool					m_bPlusGetDC = false;
+		OPoint					m_ptPlusDpi{ 96, 96 };
+		OPlusState				m_plus;
+		std::vector<OPlusSave>	m_vPlusSaves;
+		std::unique_ptr<OEmfPlusGraphObject>	m_aPlusObjects[PlusObjectCount];
+		OImageRef				m_aPlusImages[PlusObjectCount];
+		OEmfPlusRecObjectReader	m_objReader;
+		// The reader refers to the first record of an object continued over several
+		OEmfPlusRecInfo			m_objStart{};
+		bool					m_bObjPending = false;
+	};
+}
+
+bool OVectorPlayer::Play(const Source& source)
+{
+	bool bHeader = false;
+	bool bRet = false;
+	for (;;)
+	{
+		EMR emr;
+		size_t nRead = source(&emr, sizeof(emr));
+		// A document cut at a record boundary is taken as it is
+		if (nRead == 0 && bHeader)
+		{
+			bRet = true;
+			break;
+		}
+		if (nRead != sizeof(emr) || emr.nSize < sizeof(EMR) || (emr.nSize % 4) || emr.nSize > MaxRecordSize
+			|| (!bHeader && emr.iType != EMR_HEADER))
+			break;
+		m_vRecord.resize(emr.nSize + RecordSlack);
+		memcpy(m_vRecord.data(), &emr, sizeof(emr));
+		memset(m_vRecord.data() + emr.nSize, 0, RecordSlack);
+		size_t nRest = emr.nSize - sizeof(emr);
+		if (nRest && source(m_vRecord.data() + sizeof(emr), nRest) != nRest)
+			break;
+		++Stats().nRecords;
+		auto pRec = (const ENHMETARECORD*)m_vRecord.data();
+		if (!bHeader)
+		{
+			if (!OnHeader(pRec))
+				break;
+			bHeader = true;
+			continue;
+		}
+		if (emr.iType == EMR_EOF)
+		{
+			bRet = true;
+			break;
+		}
+		OnRecord(pRec);
+		if (m_device.IsFailed())
+			break;
+	}
+	if (bHeader)
+		End();
+	return bRet && !m_device.IsFailed();
+}
+
+bool OVectorPlayer::OnHeader(const ENHMETARECORD* pRec)
+{
+	if (!GetMetafileBounds((const u8t*)pRec, pRec->nSize, m_rcBounds, &m_ptPixelsPerMm))
+		return false;
+	auto& hdr = *(const ENHMETAHEADER*)pRec;
+	m_vHandles.resize(std::clamp<size_t>(hdr.nHandles, 1, MaxHandles));
+	// Embedded metafiles are in the symbol their parent began
+	if (!m_nDepth)
+		m_device.BeginDocument(m_rcBounds, m_ptPixelsPerMm);
+	return true;
+}
+
+void OVectorPlayer::End()
+{
+	FlushLines();
+	PopClips(0);
+	if (!m_nDepth)
+		m_device.EndDocument();
+}
+
+void OVectorPlayer::DrawPath(const OPath& path, const OPaint* pFill, bool bEvenOdd, const OStroke* pStroke,
+	const OMatrix& mtx)
+{
+	if (!path.IsEmpty() && (pFill || pStroke))
+		m_device.DrawPath(path, pFill, bEvenOdd, pStroke, mtx);
+}
+
+void OVectorPlayer::PushClip(const OPath& path, const OMatrix& mtx, bool bEvenOdd, bool bReplace, size_t nClipBase)
+{
+	FlushLines();
+	// Clips pushed before the last save can't be taken back from inside it,
+	// those still apply
+	if (bReplace)
+		PopClips(nClipBase);
+	m_device.PushClip(path, bEvenOdd, mtx);
+	++m_nClipLevel;
+}
+
+void OVectorPlayer::PopClips(size_t nLevel)
+{
+	for (; m_nClipLevel > nLevel; --m_nClipLevel)
+		m_device.PopClip();
+}
+
+bool OVectorPlayer::GetDibImage(const u8t* pBmi, size_t cbBmi, const u8t* pBits, size_t cbBits, bool bAlpha, OImageRef& ref)
+{
+	Hash64 hash((u64t)bAlpha);
+	hash.Update(pBmi, cbBmi);
+	hash.Update(pBits, cbBits);
+	u64t nKey = hash.Digest();
+	emfdib::DIBDecoder decoder;
+	if (!decoder.Init(pBmi, cbBmi, pBits, cbBits))
+		return false;
+	auto& info = decoder.GetInfo();
+	if (info.Width <= 0 || info.Height <= 0 || (u64t)info.Width * info.Height > MaxImagePixels)
+		return false;
+	ref = { 0, { 0, 0, (double)info.Width, (double)info.Height }, false };
+	if (m_device.FindImage(nKey, ref))
+		return true;
+	if (info.IsImageFile())
+		return m_device.AddImageFile(nKey, pBits, cbBits, (u32t)info.Width, (u32t)info.Height, ref);
+	decoder.SetAlphaMode(bAlpha ? emfdib::AlphaMode::Premultiplied : emfdib::AlphaMode::Ignore);
+	decoder.SetPixelOrder(emfpixel::PixelOrder::BGRA);
+	return m_device.AddImagePixels(nKey, (u32t)info.Width, (u32t)info.Height, bAlpha, [&](u32t nTop, u32t nRows, u8t* pRows)
+		{
+			return decoder.DecodeRows((i32t)nTop, (i32t)nRows, pRows, (ptrdiff_t)info.Width * 4);
+		}, ref);
+}
+
+bool OVectorPlayer::GetPlusImage(const OEmfPlusImage& img, OImageRef& ref)
+{
+	if (img.Type == OImageDataType::Metafile && img.ImageDataMetafile.is_enabled())
+	{
+		auto& mf = *img.ImageDataMetafile;
+		// WMF isn't played
+		if (mf.Type != OMetafileDataType::Emf && mf.Type != OMetafileDataType::EmfPlusOnly
+			&& mf.Type != OMetafileDataType::EmfPlusDual)
+			return false;
+		auto pData = mf.MetafileData.data();
+		size_t nSize = mf.MetafileData.size();
+		if (m_nDepth + 1 >= MaxNesting || !GetMetafileBounds(pData, nSize, ref.rcSpace))
+			return false;
+		ref.bSymbol = true;
+		u64t nKey = GetHash64(pData, nSize, 1);
+		if (m_device.FindImage(nKey, ref))
+			return true;
+		if (!m_device.BeginSymbol(nKey, ref.rcSpace, ref))
+			return false;
+		OVectorPlayer player(m_device, m_nDepth + 1);
+		// A broken metafile still leaves a symbol of what was read
+		player.Play(MemorySource(pData, nSize));
+		m_device.EndSymbol();
+		return !m_device.IsFailed();
+	}
+	if (img.Type != OImageDataType::Bitmap || !img.ImageDataBmp.is_enabled())
+		return false;
+	auto& bmp = *img.ImageDataBmp;
+	if (bmp.Width <= 0 || bmp.Height <= 0 || (u64t)bmp.Width * bmp.Height > MaxImagePixels)
+		return false;
+	ref = { 0, { 0, 0, (double)bmp.Width, (double)bmp.Height }, false };
+	if (bmp.Type == OBitmapDataType::Compressed)
+	{
+		if (!bmp.BitmapDataCompressed.is_enabled())
+			return false;
+		auto& vData = bmp.BitmapDataCompressed->CompressedImageData;
+		u64t nKey = GetHash64(vData.data(), vData.size(), 2);
+		return m_device.FindImage(nKey, ref)
+			|| m_device.AddImageFile(nKey, vData.data(), vData.size(), (u32t)bmp.Width, (u32t)bmp.Height, ref);
+	}
+	if (!bmp.BitmapData.is_enabled())
+		return false;
+	auto& vPixels = bmp.BitmapData->PixelData;
+	Hash64 hash(3);
+	hash.Update(&bmp.Width, sizeof(bmp.Width));
+	hash.Update(&bmp.Height, sizeof(bmp.Height));
+	hash.Update(&bmp.PixelFormat, sizeof(bmp.PixelFormat));
+	hash.Update(vPixels.data(), vPixels.size());
+	if (bmp.BitmapData->Colors.is_enabled())
+	{
+		auto& vEntries = bmp.BitmapData->Colors->PaletteEntries;
+		hash.Update(vEntries.data(), vEntries.size() * sizeof(OEmfPlusARGB));
+	}
+	u64t nKey = hash.Digest();
+	if (m_device.FindImage(nKey, ref))
+		return true;
+	// The pixels are in memory with the object already
+	memory_vector vOut;
+	if (!emfpixel::ConvertToPremultiplied(bmp, vOut, emfpixel::PixelOrder::BGRA))
+		return false;
+	bool bAlpha = false;
+	for (size_t ii = 3; ii < vOut.size() && !bAlpha; ii += 4)
+		bAlpha = vOut[ii] != 255;
+	size_t nStride = (size_t)bmp.Width * 4;
+	return m_device.AddImagePixels(nKey, (u32t)bmp.Width, (u32t)bmp.Height, bAlpha, [&](u32t nTop, u32t nRows, u8t* pRows)
+		{
+			memcpy(pRows, vOut.data() + nTop * nStride, nRows * nStride);
+			return true;
+		}, ref);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// GDI records
+
+OMatrix OVectorPlayer::GetGdiMatrix() const
+{
+	auto& gdi = m_gdi;
+	double sx = 1, sy = 1;
+	switch (gdi.nMapMode)
+	{
+	case MM_LOMETRIC:	sx = 0.1;		sy = -0.1;		break;
+	case MM_HIMETRIC:	sx = 0.01;		sy = -0.01;		break;
+	case MM_LOENGLISH:	sx = 0.254;		sy = -0.254;	break;
+	case MM_HIENGLISH:	sx = 0.0254;	sy = -0.0254;	break;
+	case MM_TWIPS:		sx = 25.4 / 1440;	sy = -25.4 / 1440;	break;
+	case MM_ISOTROPIC:
+	case MM_ANISOTROPIC:
+		sx = gdi.szWindowExt.x ? gdi.szViewportExt.x / gdi.szWindowExt.x : 1;
+		sy = gdi.szWindowExt.y ? gdi.szViewportExt.y / gdi.szWindowExt.y : 1;
+		if (gdi.nMapMode == MM_ISOTROPIC)
+		{
+			// The smaller scale on both axes, keeping their signs
+			double fScale = std::min(std::fabs(sx), std::fabs(sy));
+			sx = std::copysign(fScale, sx);
+			sy = std::copysign(fScale, sy);
+		}
+		break;
+	default:
+		break;
+	}
+	if (gdi.nMapMode >= MM_LOMETRIC && gdi.nMapMode <= MM_TWIPS)
+	{
+		// Millimeters to device pixels
+		sx *= m_ptPixelsPerMm.x;
+		sy *= m_ptPixelsPerMm.y;
+	}
+	OMatrix mtxPage{ sx, 0, 0, sy, gdi.ptViewportOrg.x - gdi.ptWindowOrg.x * sx, gdi.ptViewportOrg.y - gdi.ptWindowOrg.y * sy };
+	return OMatrix::Multiply(gdi.world, mtxPage);
+}
+
+bool OVectorPlayer::GetGdiFill(OPaint& paint, const OMatrix& mtx) const
+{
+	auto& brush = m_gdi.brush;
+	switch (brush.nStyle)
+	{
+	case BS_SOLID:
+		paint = _ColorPaint(OEmfPlusARGB::FromCOLORREF(brush.crColor));
+		return true;
+	case BS_HATCHED:
+		// The cells are aligned to device pixels, as GDI draws them
+		paint = OPaint();
+		paint.nType = OPaintType::Hatch;
+		paint.clr = OEmfPlusARGB::FromCOLORREF(brush.crColor);
+		if (m_gdi.nBkMode == OPAQUE)
+			paint.clrBack = OEmfPlusARGB::FromCOLORREF(m_gdi.crBk);
+		paint.nHatchStyle = brush.nHatch;
+		paint.mtx = mtx.Inverse();
+		return true;
+	case BS_DIBPATTERN:
+	case BS_DIBPATTERNPT:
+	case BS_PATTERN:
+		if (!brush.image.nId)
+			return false;
+		// Tiled from the device origin
+		paint = OPaint();
+		paint.nType = OPaintType::Pattern;
+		paint.nImageId = brush.image.nId;
+		paint.rcImage = brush.image.rcSpace;
+		paint.bSymbol = brush.image.bSymbol;
+		paint.mtx = mtx.Inverse();
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool OVectorPlayer::GetGdiStroke(OStroke& stroke, const OMatrix& mtx) const
+{
+	auto& pen = m_gdi.pen;
+	if (pen.bNull)
+		return false;
+	stroke = OStroke();
+	stroke.paint = _ColorPaint(OEmfPlusARGB::FromCOLORREF(pen.crColor));
+	// Cosmetic pens are a device pixel wide, and so are their dashes
+	double fScale = mtx.GetScale();
+	bool bCosmetic = pen.fWidth <= 0;
+	stroke.fWidth = bCosmetic ? (fScale > 0 ? 1 / fScale : 1) : pen.fWidth;
+	if (!bCosmetic)
+	{
+		switch (pen.nStyle & PS_ENDCAP_MASK)
+		{
+		case PS_ENDCAP_SQUARE:	stroke.nCap = OLineCap::Square;	break;
+		case PS_ENDCAP_FLAT:	stroke.nCap = OLineCap::Flat;	break;
+		default:				stroke.nCap = OLineCap::Round;	break;
+		}
+		switch (pen.nStyle & PS_JOIN_MASK)
+		{
+		case PS_JOIN_BEVEL:	stroke.nJoin = OLineJoin::Bevel;	break;
+		case PS_JOIN_MITER:
+			stroke.nJoin = OLineJoin::Miter;
+			stroke.fMiterLimit = std::max(m_gdi.fMiterLimit, 1.0);
+			break;
+		default:			stroke.nJoin = OLineJoin::Round;	break;
+		}
+	}
+	static const double aDash[] = { 18, 6 }, aDot[] = { 3, 3 }, aDashDot[] = { 18, 6, 3, 6 },
+		aDashDotDot[] = { 18, 6, 3, 6, 3, 6 }, aAlternate[] = { 1, 1 };
+	auto& vDashes = stroke.vDashes;
+	switch (pen.nStyle & PS_STYLE_MASK)
+	{
+	case PS_DASH:		vDashes.assign(std::begin(aDash), std::end(aDash));				break;
+	case PS_DOT:		vDashes.assign(std::begin(aDot), std::end(aDot));				break;
+	case PS_DASHDOT:	vDashes.assign(std::begin(aDashDot), std::end(aDashDot));		break;
+	case PS_DASHDOTDOT:	vDashes.assign(std::begin(aDashDotDot), std::end(aDashDotDot));	break;
+	case PS_ALTERNATE:	vDashes.assign(std::begin(aAlternate), std::end(aAlternate));	break;
+	case PS_USERSTYLE:	vDashes = pen.vDashes;											break;
+	default:			break;
+	}
+	// Geometric dashes are in pen widths, a sixth of the cosmetic ones
+	double fDashUnit = bCosmetic ? stroke.fWidth : ((pen.nStyle & PS_STYLE_MASK) == PS_USERSTYLE ? 1 : stroke.fWidth / 6);
+	for (auto& fDash : vDashes)
+		fDash = std::max(fDash, 0.0) * fDashUnit;
+	return true;
+}
+
+void OVectorPlayer::GdiDraw(const OPath& path, bool bFill, bool bStroke, const OMatrix& mtx)
+{
+	OPaint fill;
+	OStroke stroke;
+	bFill = bFill && GetGdiFill(fill, mtx);
+	bStroke = bStroke && GetGdiStroke(stroke, mtx);
+	DrawPath(path, bFill ? &fill : nullptr, m_gdi.nFillMode == ALTERNATE, bStroke ? &stroke : nullptr, mtx);
+}
+
+void OVectorPlayer::GdiShape(const OPath& path, bool bFill, bool bStroke)
+{
+	if (m_bInPath)
+	{
+		m_path.Append(path);
+		return;
+	}
+	GdiDraw(path, bFill, bStroke, GetGdiMatrix());
+}
+
+void OVectorPlayer::GdiStartFigure(OPath& path)
+{
+	if (m_bInPath && m_bFigureOpen)
+		return;
+	path.MoveTo(m_gdi.ptCur.x, m_gdi.ptCur.y);
+	m_bFigureOpen = m_bInPath;
+}
+
+void OVectorPlayer::GdiLineTo(const POINTL& pt)
+{
+	if (m_bInPath)
+	{
+		OPath path;
+		GdiStartFigure(path);
+		path.LineTo(pt.x, pt.y);
+		m_path.Append(path);
+		m_gdi.ptCur = pt;
+		return;
+	}
+	auto mtx = GetGdiMatrix();
+	OStroke stroke;
+	bool bStroke = GetGdiStroke(stroke, mtx);
+	if (!m_lines.IsEmpty() && (!bStroke || stroke != m_strokeLines || !(mtx == m_mtxLines)
+		|| m_lines.GetPointCount() >= MaxLinesPoints))
+		FlushLines();
+	if (bStroke)
+	{
+		if (m_lines.IsEmpty() || m_ptLinesEnd.x != m_gdi.ptCur.x || m_ptLinesEnd.y != m_gdi.ptCur.y)
+			m_lines.MoveTo(m_gdi.ptCur.x, m_gdi.ptCur.y);
+		m_lines.LineTo(pt.x, pt.y);
+		m_strokeLines = std::move(stroke);
+		m_mtxLines = mtx;
+		m_ptLinesEnd = pt;
+	}
+	m_gdi.ptCur = pt;
+}
+
+void OVectorPlayer::FlushLines()
+{
+	if (m_lines.IsEmpty())
+		return;
+	DrawPath(m_lines, nullptr, false, &m_strokeLines, m_mtxLines);
+	m_lines.Clear();
+}
+
+template <typename _Pt>
+void OVectorPlayer::GdiPoly(DWORD iType, const _Pt* pts, size_t nCount)
+{
+	if (!nCount)
+		return;
+	OPath path;
+	switch (iType)
+	{
+	case EMR_POLYGON:
+	case EMR_POLYGON16:
+		path.AddPoly(pts, nCount, true);
+		GdiShape(path, true, true);
+		break;
+	case EMR_POLYLINE:
+	case EMR_POLYLINE16:
+		path.AddPoly(pts, nCount, false);
+		GdiShape(path, false, true);
+		break;
+	case EMR_POLYBEZIER:
+	case EMR_POLYBEZIER16:
+		path.AddPoly(pts, 1, false);
+		path.AddPolyTo(pts + 1, nCount - 1, true);
+		GdiShape(path, false, true);
+		break;
+	case EMR_POLYLINETO:
+	case EMR_POLYLINETO16:
+	case EMR_POLYBEZIERTO:
+	case EMR_POLYBEZIERTO16:
+		{
+			bool bBezier = iType == EMR_POLYBEZIERTO || iType == EMR_POLYBEZIERTO16;
+			if (bBezier)
+				nCount -= nCount % 3;
+			if (!nCount)
+				return;
+			GdiStartFigure(path);
+			path.AddPolyTo(pts, nCount, bBezier);
+			GdiShape(path, false, true);
+			m_gdi.ptCur = { (LONG)pts[nCount - 1].x, (LONG)pts[nCount - 1].y };
+		}
+		return;
+	default:
+		return;
+	}
+	m_bFigureOpen = false;
+}
+
+template <typename _Pt>
+void OVectorPlayer::GdiPolyPoly(bool bClose, const DWORD* pCounts, size_t nPolys, const _Pt* pts, size_t nCount)
+{
+	OPath path;
+	size_t nStart = 0;
+	for (size_t ii = 0; ii < nPolys; ++ii)
+	{
+		if (pCounts[ii] > nCount - nStart)
+			break;
+		path.AddPoly(pts + nStart, pCounts[ii], bClose);
+		nStart += pCounts[ii];
+	}
+	GdiShape(path, bClose, true);
+	m_bFigureOpen = false;
+}
+
+template <typename _Pt>
+void OVectorPlayer::GdiPolyDraw(const _Pt* pts, const BYTE* pTypes, size_t nCount)
+{
+	OPath path;
+	for (size_t ii = 0; ii < nCount; ++ii)
+	{
+		BYTE nType = pTypes[ii] & ~PT_CLOSEFIGURE;
+		if (nType == PT_MOVETO)
+		{
+			path.MoveTo(pts[ii].x, pts[ii].y);
+			m_bFigureOpen = m_bInPath;
+		}
+		else if (nType == PT_BEZIERTO && ii + 2 < nCount)
+		{
+			GdiStartFigure(path);
+			path.AddPolyTo(pts + ii, 3, true);
+			ii += 2;
+		}
+		else
+		{
+			GdiStartFigure(path);
+			path.LineTo(pts[ii].x, pts[ii].y);
+		}
+		m_gdi.ptCur = { (LONG)pts[ii].x, (LONG)pts[ii].y };
+		if (pTypes[ii] & PT_CLOSEFIGURE)
+		{
+			path.Close();
+			m_bFigureOpen = false;
+		}
+	}
+	GdiShape(path, false, true);
+}
+
+void OVectorPlayer::GdiArc(const EMRARC& rec)
+{
+	auto& rc = rec.rclBox;
+	double cx = (rc.left + (double)rc.right) / 2, cy = (rc.top + (double)rc.bottom) / 2;
+	double rx = ((double)rc.right - rc.left) / 2, ry = ((double)rc.bottom - rc.top) / 2;
+	double fStart = std::atan2(rec.ptlStart.y - cy, rec.ptlStart.x - cx);
+	double fEnd = std::atan2(rec.ptlEnd.y - cy, rec.ptlEnd.x - cx);
+	// The direction is as seen on the device, where y goes down
+	bool bClockwise = m_gdi.nArcDirection == AD_CLOCKWISE;
+	auto mtx = GetGdiMatrix();
+	if (mtx.m11 * mtx.m22 - mtx.m12 * mtx.m21 < 0)
+		bClockwise = !bClockwise;
+	double fSweep = bClockwise ? fEnd - fStart : fStart - fEnd;
+	fSweep = std::fmod(fSweep + 2 * F_2PI, F_2PI);
+	if (fSweep == 0)
+		fSweep = F_2PI;
+	if (!bClockwise)
+		fSweep = -fSweep;
+	OPath path;
+	switch (rec.emr.iType)
+	{
+	case EMR_ARC:
+		path.AddArc(cx, cy, rx, ry, fStart, fSweep, false);
+		GdiShape(path, false, true);
+		m_bFigureOpen = false;
+		break;
+	case EMR_ARCTO:
+		{
+			GdiStartFigure(path);
+			auto pt = path.AddArc(cx, cy, rx, ry, fStart, fSweep, true);
+			GdiShape(path, false, true);
+			m_gdi.ptCur = { (LONG)std::lround(pt.x), (LONG)std::lround(pt.y) };
+		}
+		break;
+	case EMR_CHORD:
+		path.AddArc(cx, cy, rx, ry, fStart, fSweep, false);
+		path.Close();
+		GdiShape(path, true, true);
+		m_bFigureOpen = false;
+		break;
+	case EMR_PIE:
+		path.MoveTo(cx, cy);
+		path.AddArc(cx, cy, rx, ry, fStart, fSweep, true);
+		path.Close();
+		GdiShape(path, true, true);
+		m_bFigureOpen = false;
+		break;
+	default:
+		break;
+	}
+}
+
+void OVectorPlayer::GdiText(const ENHMETARECORD* pRec)
+{
+	auto pText = _GetRec<EMREXTTEXTOUTW>(pRec);
+	if (!pText)
+		return;
+	auto& emrtext = pText->emrtext;
+	if (emrtext.fOptions & ETO_GLYPH_INDEX)
+	{
+		++Stats().nSkipped;
+		return;
+	}
+	auto mtx = GetGdiMatrix();
+	if ((emrtext.fOptions & ETO_OPAQUE) && emrtext.rcl.right > emrtext.rcl.left && emrtext.rcl.bottom > emrtext.rcl.top)
+	{
+		auto& rc = emrtext.rcl;
+		OPath path;
+		path.AddRect(rc.left, rc.top, (double)rc.right - rc.left, (double)rc.bottom - rc.top);
+		auto paint = _ColorPaint(OEmfPlusARGB::FromCOLORREF(m_gdi.crBk));
+		DrawPath(path, &paint, false, nullptr, mtx);
+	}
+	if (!emrtext.nChars || !_InRecord(pRec, emrtext.offString, emrtext.nChars, sizeof(u16t)))
+		return;
+	auto pChars = (const u16t*)((const u8t*)pRec + emrtext.offString);
+
+	auto& font = m_gdi.font;
+	OTextRun run;
+	run.vText.assign(pChars, pChars + emrtext.nChars);
+	// Positive heights are of the cell, taken as the em size with some leading
+	run.fEmSize = font.lfHeight < 0 ? -(double)font.lfHeight : (font.lfHeight ? font.lfHeight / TextLineHeight : 12);
+	run.vFamily = _GetFamily(font.lfFaceName, _countof(font.lfFaceName));
+	run.nWeight = font.lfWeight;
+	run.bItalic = font.lfItalic;
+	run.bUnderline = font.lfUnderline;
+	run.bStrikeOut = font.lfStrikeOut;
+	run.paint = _ColorPaint(OEmfPlusARGB::FromCOLORREF(m_gdi.crText));
+	u32t nAlign = m_gdi.nTextAlign;
+	switch (nAlign & (TA_CENTER | TA_RIGHT))
+	{
+	case TA_CENTER:	run.nAnchor = OTextAnchor::Middle;	break;
+	case TA_RIGHT:	run.nAnchor = OTextAnchor::End;		break;
+	default:											break;
+	}
+	double fBaseline = 0;
+	if ((nAlign & TA_BASELINE) == TA_BASELINE)
+		fBaseline = 0;
+	else if (nAlign & TA_BOTTOM)
+		fBaseline = -TextDescent * run.fEmSize;
+	else
+		fBaseline = TextAscent * run.fEmSize;
+	run.vPos.push_back({ 0, fBaseline });
+
+	// Text stays upright whichever way the mapping turns the y axis
+	POINTL ptRef = (nAlign & TA_UPDATECP) ? m_gdi.ptCur : emrtext.ptlReference;
+	auto pt = mtx.Map(ptRef.x, ptRef.y);
+	double sx = std::hypot(mtx.m11, mtx.m12), sy = std::hypot(mtx.m21, mtx.m22);
+	double fAngle = std::atan2(mtx.m12, mtx.m11) - font.lfEscapement * F_PI / 1800;
+	OMatrix mtxText{ sx * std::cos(fAngle), sx * std::sin(fAngle), -sy * std::sin(fAngle), sy * std::cos(fAngle), pt.x, pt.y };
+
+	// Character advances, as positions of each character when laid out from the left
+	bool bPdy = emrtext.fOptions & ETO_PDY;
+	if (run.nAnchor == OTextAnchor::Start && emrtext.offDx
+		&& _InRecord(pRec, emrtext.offDx, emrtext.nChars, bPdy ? 2 * sizeof(i32t) : sizeof(i32t)))
+	{
+		auto pDx = (const i32t*)((const u8t*)pRec + emrtext.offDx);
+		double x = 0;
+		for (u32t ii = 0; ii + 1 < emrtext.nChars; ++ii)
+		{
+			x += pDx[bPdy ? ii * 2 : ii];
+			// The second half of a surrogate pair has no position of its own
+			if (!_IsLowSurrogate(pChars[ii + 1]))
+				run.vPos.push_back({ x, fBaseline });
+		}
+	}
+	m_device.DrawText(run, mtxText);
+}
+
+void OVectorPlayer::GdiBlt(const ENHMETARECORD* pRec)
+{
+	i32t xDest, yDest, cxDest, cyDest;
+	i32t xSrc, ySrc, cxSrc, cySrc;
+	u32t nRop, iUsage, offBmi, cbBmi, offBits, cbBits;
+	bool bStretchDIBits = pRec->iType == EMR_STRETCHDIBITS;
+	if (bStretchDIBits)
+	{
+		auto p = _GetRec<EMRSTRETCHDIBITS>(pRec);
+		if (!p)
+			return;
+		xDest = p->xDest;	yDest = p->yDest;	cxDest = p->cxDest;	cyDest = p->cyDest;
+		xSrc = p->xSrc;		ySrc = p->ySrc;		cxSrc = p->cxSrc;	cySrc = p->cySrc;
+		nRop = p->dwRop;	iUsage = p->iUsageSrc;
+		offBmi = p->offBmiSrc;	cbBmi = p->cbBmiSrc;	offBits = p->offBitsSrc;	cbBits = p->cbBitsSrc;
+	}
+	else
+	{
+		auto p = _GetRec<EMRBITBLT>(pRec);
+		if (!p)
+			return;
+		xDest = p->xDest;	yDest = p->yDest;	cxDest = p->cxDest;	cyDest = p->cyDest;
+		xSrc = p->xSrc;		ySrc = p->ySrc;		cxSrc = cxDest;		cySrc = cyDest;
+		nRop = p->dwRop;	iUsage = p->iUsageSrc;
+		offBmi = p->offBmiSrc;	cbBmi = p->cbBmiSrc;	offBits = p->offBitsSrc;	cbBits = p->cbBitsSrc;
+		if (pRec->iType != EMR_BITBLT)
+		{
+			// STRETCHBLT and ALPHABLEND add the source size
+			auto pStretch = _GetRec<EMRSTRETCHBLT>(pRec);
+			if (!pStretch)
+				return;
+			cxSrc = pStretch->cxSrc;
+			cySrc = pStretch->cySrc;
+		}
+	}
+	auto mtx = GetGdiMatrix();
+	if (!cbBmi && pRec->iType != EMR_ALPHABLEND)
+	{
+		// No source, the raster operation fills the destination
+		OPaint paint;
+		switch (nRop)
+		{
+		case PATCOPY:
+			if (!GetGdiFill(paint, mtx))
+				return;
+			break;
+		case BLACKNESS:	paint = _ColorPaint(OEmfPlusARGB::FromCOLORREF(RGB(0, 0, 0)));			break;
+		case WHITENESS:	paint = _ColorPaint(OEmfPlusARGB::FromCOLORREF(RGB(255, 255, 255)));	break;
+		default:		++Stats().nSkipped;														return;
+		}
+		OPath path;
+		path.AddRect(xDest, yDest, cxDest, cyDest);
+		DrawPath(path, &paint, false, nullptr, mtx);
+		return;
+	}
+	double fOpacity = 1;
+	bool bAlpha = false;
+	if (pRec->iType == EMR_ALPHABLEND)
+	{
+		// BLENDFUNCTION: BlendOp, BlendFlags, SourceConstantAlpha, AlphaFormat
+		fOpacity = ((nRop >> 16) & 0xFF) / 255.0;
+		bAlpha = ((nRop >> 24) & 0xFF) & AC_SRC_ALPHA;
+	}
+	else if (nRop != SRCCOPY)
+	{
+		++Stats().nSkipped;
+		return;
+	}
+	if (iUsage != DIB_RGB_COLORS || !_InRecord(pRec, offBmi, cbBmi, 1) || !_InRecord(pRec, offBits, cbBits, 1))
+	{
+		++Stats().nSkipped;
+		return;
+	}
+	OImageRef ref;
+	auto pBase = (const u8t*)pRec;
+	if (!GetDibImage(pBase + offBmi, cbBmi, pBase + offBits, cbBits, bAlpha, ref))
+	{
+		++Stats().nSkipped;
+		return;
+	}
+	ORect rcSrc{ (double)xSrc, (double)ySrc, (double)cxSrc, (double)cySrc };
+	if (bStretchDIBits)
+	{
+		// The source of StretchDIBits is counted from the bottom of bottom-up DIBs
+		emfdib::ODIBInfo info;
+		if (emfdib::ParseDIBInfo(pBase + offBmi, cbBmi, info) && !info.bTopDown)
+			rcSrc.y = info.Height - rcSrc.y - rcSrc.h;
+	}
+	OMatrix mtxDst = OMatrix::Multiply(OMatrix::FromSides({ (double)xDest, (double)yDest },
+		{ (double)cxDest, 0 }, { 0, (double)cyDest }), mtx);
+	m_device.DrawImage(ref, rcSrc, mtxDst, fOpacity);
+}
+
+void OVectorPlayer::GdiClip(const OPath& path, const OMatrix& mtx, bool bEvenOdd, DWORD iMode)
+{
+	switch (iMode)
+	{
+	case RGN_COPY:	PushClip(path, mtx, bEvenOdd, true, m_gdi.nClipBase);	break;
+	case RGN_AND:	PushClip(path, mtx, bEvenOdd, false, m_gdi.nClipBase);	break;
+	default:		++Stats().nSkipped;										break;
+	}
+}
+
+OGdiObject* OVectorPlayer::GetHandle(u32t ihObject, bool bCreate)
+{
+	if (ihObject >= m_vHandles.size())
+	{
+		if (!bCreate || ihObject >= MaxHandles)
+			return nullptr;
+		m_vHandles.resize(ihObject + 1);
+	}
+	return &m_vHandles[ihObject];
+}
+
+void OVectorPlayer::GdiSelectObject(u32t ihObject)
+{
+	if (ihObject & StockObjectFlag)
+	{
+		static const COLORREF aBrushColors[] = { RGB(255, 255, 255), RGB(192, 192, 192), RGB(128, 128, 128),
+			RGB(64, 64, 64), RGB(0, 0, 0) };
+		u32t nStock = ihObject & ~StockObjectFlag;
+		switch (nStock)
+		{
+		case WHITE_BRUSH: case LTGRAY_BRUSH: case GRAY_BRUSH: case DKGRAY_BRUSH: case BLACK_BRUSH:
+			m_gdi.brush = OGdiBrush();
+			m_gdi.brush.crColor = aBrushColors[nStock];
+			break;
+		case NULL_BRUSH:
+			m_gdi.brush = OGdiBrush();
+			m_gdi.brush.nStyle = BS_NULL;
+			break;
+		case WHITE_PEN:
+		case BLACK_PEN:
+			m_gdi.pen = OGdiPen();
+			m_gdi.pen.crColor = nStock == WHITE_PEN ? RGB(255, 255, 255) : RGB(0, 0, 0);
+			break;
+		case NULL_PEN:
+			m_gdi.pen = OGdiPen();
+			m_gdi.pen.bNull = true;
+			break;
+		case OEM_FIXED_FONT: case ANSI_FIXED_FONT: case ANSI_VAR_FONT: case SYSTEM_FONT:
+		case DEVICE_DEFAULT_FONT: case SYSTEM_FIXED_FONT: case DEFAULT_GUI_FONT:
+			m_gdi.font = LOGFONTW{};
+			m_gdi.font.lfHeight = -16;
+			break;
+		default:
+			break;
+		}
+		return;
+	}
+	auto pObj = GetHandle(ihObject, false);
+	if (!pObj)
+		return;
+	switch (pObj->nType)
+	{
+	case OGdiObjectType::Pen:	m_gdi.pen = pObj->pen;		break;
+	case OGdiObjectType::Brush:	m_gdi.brush = pObj->brush;	break;
+	case OGdiObjectType::Font:	m_gdi.font = pObj->font;	break;
+	default:													break;
+	}
+}
+
+void OVectorPlayer::GdiPathDone(bool bFill, bool bStroke)
+{
+	m_bInPath = false;
+	if (!m_path.IsEmpty())
+	{
+		// A widened path is the outline of its stroke, drawn here as the stroke
+		if (m_bPathWidened && bFill)
+		{
+			bFill = false;
+			bStroke = true;
+		}
+		GdiDraw(m_path, bFill, bStroke, m_mtxPath);
+	}
+	m_path.Clear();
+	m_bFigureOpen = false;
+	m_bPathWidened = false;
+}
+
+void OVectorPlayer::OnRecord(const ENHMETARECORD* pRec)
+{
+	// Consecutive lines are drawn as one path, until anything else comes
+	if (pRec->iType != EMR_MOVETOEX && pRec->iType != EMR_LINETO)
+		FlushLines();
+	if (pRec->iType == EMR_GDICOMMENT)
+	{
+		OnComment(pRec);
+		return;
+	}
+	// GDI+ plays the GDI records of EMF+ metafiles only after a GetDC
+	if (m_bPlus && !m_bPlusGetDC)
+		return;
+	OnGdiRecord(pRec);
+}
+
+void OVectorPlayer::OnGdiRecord(const ENHMETARECORD* pRec)
+{
+	auto& gdi = m_gdi;
+	switch (pRec->iType)
+	{
+	case EMR_POLYBEZIER:
+	case EMR_POLYGON:
+	case EMR_POLYLINE:
+	case EMR_POLYBEZIERTO:
+	case EMR_POLYLINETO:
+		if (auto p = _GetRec<EMRPOLYLINE>(pRec, offsetof(EMRPOLYLINE, aptl));
+			p && _InRecord(pRec, offsetof(EMRPOLYLINE, aptl), p->cptl, sizeof(POINTL)))
+			GdiPoly(pRec->iType, p->aptl, p->cptl);
+		break;
+	case EMR_POLYBEZIER16:
+	case EMR_POLYGON16:
+	case EMR_POLYLINE16:
+	case EMR_POLYBEZIERTO16:
+	case EMR_POLYLINETO16:
+		if (auto p = _GetRec<EMRPOLYLINE16>(pRec, offsetof(EMRPOLYLINE16, apts));
+			p && _InRecord(pRec, offsetof(EMRPOLYLINE16, apts), p->cpts, sizeof(POINTS)))
+			GdiPoly(pRec->iType, p->apts, p->cpts);
+		break;
+	case EMR_POLYPOLYLINE:
+	case EMR_POLYPOLYGON:
+		if (auto p = _GetRec<EMRPOLYPOLYLINE>(pRec, offsetof(EMRPOLYPOLYLINE, aPolyCounts));
+			p && _InRecord(pRec, offsetof(EMRPOLYPOLYLINE, aPolyCounts), p->nPolys, sizeof(DWORD)))
+		{
+			size_t nPointsOffset = offsetof(EMRPOLYPOLYLINE, aPolyCounts) + (size_t)p->nPolys * sizeof(DWORD);
+			if (_InRecord(pRec, nPointsOffset, p->cptl, sizeof(POINTL)))
+				GdiPolyPoly(pRec->iType == EMR_POLYPOLYGON, p->aPolyCounts, p->nPolys,
+					(const POINTL*)((const u8t*)pRec + nPointsOffset), p->cptl);
+		}
+		break;
+	case EMR_POLYPOLYLINE16:
+	case EMR_POLYPOLYGON16:
+		if (auto p = _GetRec<EMRPOLYPOLYLINE16>(pRec, offsetof(EMRPOLYPOLYLINE16, aPolyCounts));
+			p && _InRecord(pRec, offsetof(EMRPOLYPOLYLINE16, aPolyCounts), p->nPolys, sizeof(DWORD)))
+		{
+			size_t nPointsOffset = offsetof(EMRPOLYPOLYLINE16, aPolyCounts) + (size_t)p->nPolys * sizeof(DWORD);
+			if (_InRecord(pRec, nPointsOffset, p->cpts, sizeof(POINTS)))
+				GdiPolyPoly(pRec->iType == EMR_POLYPOLYGON16, p->aPolyCounts, p->nPolys,
+					(const POINTS*)((const u8t*)pRec + nPointsOffset), p->cpts);
+		}
+		break;
+	case EMR_POLYDRAW:
+		if (auto p = _GetRec<EMRPOLYDRAW>(pRec, offsetof(EMRPOLYDRAW, aptl));
+			p && _InRecord(pRec, offsetof(EMRPOLYDRAW, aptl), p->cptl, sizeof(POINTL) + 1))
+			GdiPolyDraw(p->aptl, (const BYTE*)(p->aptl + p->cptl), p->cptl);
+		break;
+	case EMR_POLYDRAW16:
+		if (auto p = _GetRec<EMRPOLYDRAW16>(pRec, offsetof(EMRPOLYDRAW16, apts));
+			p && _InRecord(pRec, offsetof(EMRPOLYDRAW16, apts), p->cpts, sizeof(POINTS) + 1))
+			GdiPolyDraw(p->apts, (const BYTE*)(p->apts + p->cpts), p->cpts);
+		break;
+	case EMR_MOVETOEX:
+		if (auto p = _GetRec<EMRMOVETOEX>(pRec))
+		{
+			gdi.ptCur = p->ptl;
+			m_bFigureOpen = false;
+		}
+		break;
+	case EMR_LINETO:
+		if (auto p = _GetRec<EMRLINETO>(pRec))
+			GdiLineTo(p->ptl);
+		break;
+	case EMR_RECTANGLE:
+		if (auto p = _GetRec<EMRRECTANGLE>(pRec))
+		{
+			auto& rc = p->rclBox;
+			OPath path;
+			path.AddRect(rc.left, rc.top, (double)rc.right - rc.left, (double)rc.bottom - rc.top);
+			GdiShape(path, true, true);
+			m_bFigureOpen = false;
+		}
+		break;
+	case EMR_ELLIPSE:
+		if (auto p = _GetRec<EMRELLIPSE>(pRec))
+		{
+			auto& rc = p->rclBox;
+			OPath path;
+			path.AddEllipse((rc.left + (double)rc.right) / 2, (rc.top + (double)rc.bottom) / 2,
+				((double)rc.right - rc.left) / 2, ((double)rc.bottom - rc.top) / 2);
+			GdiShape(path, true, true);
+			m_bFigureOpen = false;
+		}
+		break;
+	case EMR_ROUNDRECT:
+		if (auto p = _GetRec<EMRROUNDRECT>(pRec))
+		{
+			auto& rc = p->rclBox;
+			OPath path;
+			path.AddRoundRect(std::min(rc.left, rc.right), std::min(rc.top, rc.bottom),
+				std::max(rc.left, rc.right), std::max(rc.top, rc.bottom), p->szlCorner.cx / 2.0, p->szlCorner.cy / 2.0);
+			GdiShape(path, true, true);
+			m_bFigureOpen = false;
+		}
+		break;
+	case EMR_ARC:
+	case EMR_ARCTO:
+	case EMR_CHORD:
+	case EMR_PIE:
+		if (auto p = _GetRec<EMRARC>(pRec))
+			GdiArc(*p);
+		break;
+	case EMR_EXTTEXTOUTW:
+		GdiText(pRec);
+		break;
+	case EMR_BITBLT:
+	case EMR_STRETCHBLT:
+	case EMR_ALPHABLEND:
+	case EMR_STRETCHDIBITS:
+		GdiBlt(pRec);
+		break;
+	case EMR_SETPIXELV:
+		if (auto p = _GetRec<EMRSETPIXELV>(pRec))
+		{
+			OPath path;
+			path.AddRect(p->ptlPixel.x, p->ptlPixel.y, 1, 1);
+			auto paint = _ColorPaint(OEmfPlusARGB::FromCOLORREF(p->crColor));
+			DrawPath(path, &paint, false, nullptr, GetGdiMatrix());
+		}
+		break;
+	case EMR_FILLRGN:
+	case EMR_PAINTRGN:
+		{
+			// Both start with the bounds and the size of the region data
+			bool bFill = pRec->iType == EMR_FILLRGN;
+			size_t nDataOffset = bFill ? offsetof(EMRFILLRGN, RgnData) : offsetof(EMRPAINTRGN, RgnData);
+			auto p = _GetRec<EMRPAINTRGN>(pRec, nDataOffset);
+			if (!p || !_InRecord(pRec, nDataOffset, p->cbRgnData, 1))
+				break;
+			OPath path;
+			_AddRegion(path, (const u8t*)pRec + nDataOffset, p->cbRgnData);
+			auto saved = gdi;
+			if (bFill)
+				GdiSelectObject(((const EMRFILLRGN*)pRec)->ihBrush);
+			auto mtx = GetGdiMatrix();
+			OPaint paint;
+			if (GetGdiFill(paint, mtx))
+				DrawPath(path, &paint, false, nullptr, mtx);
+			gdi.brush = saved.brush;
+			gdi.pen = saved.pen;
+			gdi.font = saved.font;
+		}
+		break;
+	case EMR_ANGLEARC:
+	case EMR_EXTFLOODFILL:
+	case EMR_FRAMERGN:
+	case EMR_INVERTRGN:
+	case EMR_EXTTEXTOUTA:
+	case EMR_POLYTEXTOUTA:
+	case EMR_POLYTEXTOUTW:
+	case EMR_MASKBLT:
+	case EMR_PLGBLT:
+	case EMR_SETDIBITSTODEVICE:
+	case EMR_TRANSPARENTBLT:
+	case EMR_GRADIENTFILL:
+		++Stats().nSkipped;
+		break;
+
+	// Objects
+	case EMR_CREATEPEN:
+		if (auto p = _GetRec<EMRCREATEPEN>(pRec))
+		{
+			if (auto pObj = GetHandle(p->ihPen, true))
+			{
+				*pObj = OGdiObject();
+				pObj->nType = OGdiObjectType::Pen;
+				pObj->pen.bNull = (p->lopn.lopnStyle & PS_STYLE_MASK) == PS_NULL;
+				pObj->pen.crColor = p->lopn.lopnColor;
+				pObj->pen.fWidth = p->lopn.lopnWidth.x;
+				pObj->pen.nStyle = p->lopn.lopnStyle;
+			}
+		}
+		break;
+	case EMR_EXTCREATEPEN:
+		if (auto p = _GetRec<EMREXTCREATEPEN>(pRec, offsetof(EMREXTCREATEPEN, elp.elpStyleEntry)))
+		{
+			if (auto pObj = GetHandle(p->ihPen, true))
+			{
+				auto& elp = p->elp;
+				*pObj = OGdiObject();
+				pObj->nType = OGdiObjectType::Pen;
+				pObj->pen.bNull = (elp.elpPenStyle & PS_STYLE_MASK) == PS_NULL || elp.elpBrushStyle == BS_NULL;
+				pObj->pen.crColor = elp.elpColor;
+				pObj->pen.fWidth = (elp.elpPenStyle & PS_TYPE_MASK) == PS_GEOMETRIC ? elp.elpWidth : 0;
+				pObj->pen.nStyle = elp.elpPenStyle;
+				if ((elp.elpPenStyle & PS_STYLE_MASK) == PS_USERSTYLE
+					&& _InRecord(pRec, offsetof(EMREXTCREATEPEN, elp.elpStyleEntry), elp.elpNumEntries, sizeof(DWORD)))
+					pObj->pen.vDashes.assign(elp.elpStyleEntry, elp.elpStyleEntry + elp.elpNumEntries);
+			}
+		}
+		break;
+	case EMR_CREATEBRUSHINDIRECT:
+		if (auto p = _GetRec<EMRCREATEBRUSHINDIRECT>(pRec))
+		{
+			if (auto pObj = GetHandle(p->ihBrush, true))
+			{
+				*pObj = OGdiObject();
+				pObj->nType = OGdiObjectType::Brush;
+				pObj->brush.nStyle = p->lb.lbStyle;
+				pObj->brush.crColor = p->lb.lbColor;
+				pObj->brush.nHatch = (u32t)p->lb.lbHatch;
+			}
+		}
+		break;
+	case EMR_CREATEDIBPATTERNBRUSHPT:
+	case EMR_CREATEMONOBRUSH:
+		// Both have the same layout; the colors of monochrome brushes are
+		// taken from the DIB rather than the text and background colors
+		if (auto p = _GetRec<EMRCREATEDIBPATTERNBRUSHPT>(pRec))
+		{
+			auto pObj = GetHandle(p->ihBrush, true);
+			if (!pObj)
+				break;
+			*pObj = OGdiObject();
+			pObj->nType = OGdiObjectType::Brush;
+			pObj->brush.nStyle = BS_DIBPATTERNPT;
+			OImageRef ref;
+			auto pBase = (const u8t*)pRec;
+			if ((pRec->iType == EMR_CREATEMONOBRUSH || p->iUsage == DIB_RGB_COLORS)
+				&& _InRecord(pRec, p->offBmi, p->cbBmi, 1) && _InRecord(pRec, p->offBits, p->cbBits, 1)
+				&& GetDibImage(pBase + p->offBmi, p->cbBmi, pBase + p->offBits, p->cbBits, false, ref))
+				pObj->brush.image = ref;
+		}
+		break;
+	case EMR_EXTCREATEFONTINDIRECTW:
+		if (auto p = _GetRec<EMREXTCREATEFONTINDIRECTW>(pRec, offsetof(EMREXTCREATEFONTINDIRECTW, elfw) + sizeof(LOGFONTW)))
+		{
+			if (auto pObj = GetHandle(p->ihFont, true))
+			{
+				*pObj = OGdiObject();
+				pObj->nType = OGdiObjectType::Font;
+				memcpy(&pObj->font, &p->elfw, sizeof(LOGFONTW));
+			}
+		}
+		break;
+	case EMR_SELECTOBJECT:
+		if (auto p = _GetRec<EMRSELECTOBJECT>(pRec))
+			GdiSelectObject(p->ihObject);
+		break;
+	case EMR_DELETEOBJECT:
+		if (auto p = _GetRec<EMRDELETEOBJECT>(pRec))
+		{
+			if (auto pObj = GetHandle(p->ihObject, false))
+				*pObj = OGdiObject();
+		}
+		break;
+
+	// State
+	case EMR_SETMAPMODE:
+		if (auto p = _GetRec<EMRSETMAPMODE>(pRec))
+			gdi.nMapMode = p->iMode;
+		break;
+	case EMR_SETWINDOWEXTEX:
+		if (auto p = _GetRec<EMRSETWINDOWEXTEX>(pRec))
+			gdi.szWindowExt = { (double)p->szlExtent.cx, (double)p->szlExtent.cy };
+		break;
+	case EMR_SETVIEWPORTEXTEX:
+		if (auto p = _GetRec<EMRSETVIEWPORTEXTEX>(pRec))
+			gdi.szViewportExt = { (double)p->szlExtent.cx, (double)p->szlExtent.cy };
+		break;
+	case EMR_SETWINDOWORGEX:
+		if (auto p = _GetRec<EMRSETWINDOWORGEX>(pRec))
+			gdi.ptWindowOrg = { (double)p->ptlOrigin.x, (double)p->ptlOrigin.y };
+		break;
+	case EMR_SETVIEWPORTORGEX:
+		if (auto p = _GetRec<EMRSETVIEWPORTORGEX>(pRec))
+			gdi.ptViewportOrg = { (double)p->ptlOrigin.x, (double)p->ptlOrigin.y };
+		break;
+	case EMR_SCALEVIEWPORTEXTEX:
+	case EMR_SCALEWINDOWEXTEX:
+		if (auto p = _GetRec<EMRSCALEVIEWPORTEXTEX>(pRec); p && p->xDenom && p->yDenom)
+		{
+			auto& ext = pRec->iType == EMR_SCALEVIEWPORTEXTEX ? gdi.szViewportExt : gdi.szWindowExt;
+			ext.x = ext.x * p->xNum / p->xDenom;
+			ext.y = ext.y * p->yNum / p->yDenom;
+		}
+		break;
+	case EMR_SETWORLDTRANSFORM:
+		if (auto p = _GetRec<EMRSETWORLDTRANSFORM>(pRec))
+			gdi.world = OMatrix::FromXForm(p->xform);
+		break;
+	case EMR_MODIFYWORLDTRANSFORM:
+		if (auto p = _GetRec<EMRMODIFYWORLDTRANSFORM>(pRec))
+		{
+			auto mtx = OMatrix::FromXForm(p->xform);
+			switch (p->iMode)
+			{
+			case MWT_IDENTITY:		gdi.world = OMatrix();							break;
+			case MWT_LEFTMULTIPLY:	gdi.world = OMatrix::Multiply(mtx, gdi.world);	break;
+			case MWT_RIGHTMULTIPLY:	gdi.world = OMatrix::Multiply(gdi.world, mtx);	break;
+			case MWT_SET:			gdi.world = mtx;								break;
+			default:																break;
+			}
+		}
+		break;
+	case EMR_SETTEXTCOLOR:
+		if (auto p = _GetRec<EMRSETTEXTCOLOR>(pRec))
+			gdi.crText = p->crColor;
+		break;
+	case EMR_SETBKCOLOR:
+		if (auto p = _GetRec<EMRSETBKCOLOR>(pRec))
+			gdi.crBk = p->crColor;
+		break;
+	case EMR_SETBKMODE:
+		if (auto p = _GetRec<EMRSETBKMODE>(pRec))
+			gdi.nBkMode = p->iMode;
+		break;
+	case EMR_SETTEXTALIGN:
+		if (auto p = _GetRec<EMRSETTEXTALIGN>(pRec))
+			gdi.nTextAlign = p->iMode;
+		break;
+	case EMR_SETPOLYFILLMODE:
+		if (auto p = _GetRec<EMRSETPOLYFILLMODE>(pRec))
+			gdi.nFillMode = p->iMode;
+		break;
+	case EMR_SETARCDIRECTION:
+		if (auto p = _GetRec<EMRSETARCDIRECTION>(pRec))
+			gdi.nArcDirection = p->iArcDirection;
+		break;
+	case EMR_SETMITERLIMIT:
+		if (auto p = _GetRec<EMRSETMITERLIMIT>(pRec))
+			gdi.fMiterLimit = p->eMiterLimit;
+		break;
+	case EMR_SAVEDC:
+		m_vGdiSaves.push_back({ gdi, m_nClipLevel });
+		gdi.nClipBase = m_nClipLevel;
+		break;
+	case EMR_RESTOREDC:
+		if (auto p = _GetRec<EMRRESTOREDC>(pRec))
+		{
+			// Relative to the current level when negative, absolute otherwise
+			i64t nLevel = p->iRelative < 0 ? (i64t)m_vGdiSaves.size() + p->iRelative : (i64t)p->iRelative - 1;
+			if (nLevel < 0 || nLevel >= (i64t)m_vGdiSaves.size())
+				break;
+			PopClips(m_vGdiSaves[(size_t)nLevel].nLevel);
+			gdi = m_vGdiSaves[(size_t)nLevel].state;
+			m_vGdiSaves.resize((size_t)nLevel);
+		}
+		break;
+
+	// Paths
+	case EMR_BEGINPATH:
+		m_bInPath = true;
+		m_bFigureOpen = false;
+		m_bPathWidened = false;
+		m_path.Clear();
+		m_mtxPath = GetGdiMatrix();
+		break;
+	case EMR_ENDPATH:
+		m_bInPath = false;
+		break;
+	case EMR_ABORTPATH:
+		m_bInPath = false;
+		m_path.Clear();
+		break;
+	case EMR_CLOSEFIGURE:
+		if (m_bInPath && m_bFigureOpen)
+		{
+			m_path.Close();
+			m_bFigureOpen = false;
+		}
+		break;
+	case EMR_WIDENPATH:
+		m_bPathWidened = true;
+		break;
+	case EMR_FILLPATH:
+		GdiPathDone(true, false);
+		break;
+	case EMR_STROKEPATH:
+		GdiPathDone(false, true);
+		break;
+	case EMR_STROKEANDFILLPATH:
+		GdiPathDone(true, true);
+		break;
+
+	// Clipping
+	case EMR_INTERSECTCLIPRECT:
+	case EMR_EXCLUDECLIPRECT:
+		if (auto p = _GetRec<EMRINTERSECTCLIPRECT>(pRec))
+		{
+			auto& rc = p->rclClip;
+			auto mtx = GetGdiMatrix();
+			OPath path;
+			bool bExclude = pRec->iType == EMR_EXCLUDECLIPRECT;
+			if (bExclude)
+				_AddBoundsPath(path, m_rcBounds, mtx);
+			path.AddRect(rc.left, rc.top, (double)rc.right - rc.left, (double)rc.bottom - rc.top);
+			GdiClip(path, mtx, bExclude, RGN_AND);
+		}
+		break;
+	case EMR_EXTSELECTCLIPRGN:
+		if (auto p = _GetRec<EMREXTSELECTCLIPRGN>(pRec, offsetof(EMREXTSELECTCLIPRGN, RgnData)))
+		{
+			if (p->iMode == RGN_COPY && !p->cbRgnData)
+			{
+				// Default clipping
+				PopClips(gdi.nClipBase);
+				break;
+			}
+			if (!_InRecord(pRec, offsetof(EMREXTSELECTCLIPRGN, RgnData), p->cbRgnData, 1))
+				break;
+			// The region is in device units
+			OPath path;
+			_AddRegion(path, p->RgnData, p->cbRgnData);
+			GdiClip(path, OMatrix(), false, p->iMode);
+		}
+		break;
+	case EMR_SELECTCLIPPATH:
+		if (auto p = _GetRec<EMRSELECTCLIPPATH>(pRec))
+		{
+			m_bInPath = false;
+			GdiClip(m_path, m_mtxPath, gdi.nFillMode == ALTERNATE, p->iMode);
+			m_path.Clear();
+		}
+		break;
+	case EMR_OFFSETCLIPRGN:
+		++Stats().nSkipped;
+		break;
+	default:
+		break;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// EMF+ records
+
+void OVectorPlayer::OnComment(const ENHMETARECORD* pRec)
+{
+	auto pComment = _GetRec<EMRGDICOMMENT>(pRec, offsetof(EMRGDICOMMENT, Data) + sizeof(u32t));
+	if (!pComment || !_InRecord(pRec, offsetof(EMRGDICOMMENT, Data), pComment->cbData, 1)
+		|| pComment->cbData < sizeof(u32t) || *(const u32t*)pComment->Data != EMR_COMMENT_EMFPLUS)
+		return;
+	const u8t* pData = pComment->Data + sizeof(u32t);
+	size_t nSize = pComment->cbData - sizeof(u32t);
+	for (size_t nPos = 0; nPos + sizeof(OEmfPlusRec) <= nSize; )
+	{
+		auto& plus = *(const OEmfPlusRec*)(pData + nPos);
+		if (plus.Size < sizeof(OEmfPlusRec) || plus.Size > nSize - nPos || plus.DataSize > plus.Size - sizeof(OEmfPlusRec))
+			break;
+		OEmfPlusRecInfo rec{ plus.Type, plus.Flags, plus.Size, plus.DataSize, (u8t*)(pData + nPos + sizeof(OEmfPlusRec)) };
+		nPos += plus.Size;
+		++Stats().nRecords;
+		if (rec.Type == EmfPlusRecordTypeHeader)
+		{
+			m_bPlus = true;
+			if (auto pHeader = _GetPlusRec<OEmfPlusHeader>(rec); pHeader && pHeader->LogicalDpiX && pHeader->LogicalDpiY)
+				m_ptPlusDpi = { (double)pHeader->LogicalDpiX, (double)pHeader->LogicalDpiY };
+			continue;
+		}
+		if (!m_bPlus)
+			continue;
+		m_bPlusGetDC = rec.Type == EmfPlusRecordTypeGetDC;
+		OnPlusRecord(rec);
+		if (m_device.IsFailed())
+			break;
+	}
+}
+
+OMatrix OVectorPlayer::GetPlusMatrix() const
+{
+	double fUnitX = _UnitToPixels(m_plus.nPageUnit, m_ptPlusDpi.x) * m_plus.fPageScale;
+	double fUnitY = _UnitToPixels(m_plus.nPageUnit, m_ptPlusDpi.y) * m_plus.fPageScale;
+	return OMatrix::Multiply(OMatrix::Multiply(m_plus.world, OMatrix::Scale(fUnitX, fUnitY)), m_plus.base);
+}
+
+double OVectorPlayer::PlusToWorld(double fValue, OUnitType nUnit) const
+{
+	if (nUnit == OUnitType::World)
+		return fValue;
+	double fPageUnit = _UnitToPixels(m_plus.nPageUnit, m_ptPlusDpi.x) * m_plus.fPageScale;
+	double fScale = m_plus.world.GetScale() * fPageUnit;
+	return fScale > 0 ? fValue * _UnitToPixels(nUnit, m_ptPlusDpi.x) / fScale : fValue;
+}
+
+void OVectorPlayer::OnPlusObject(const OEmfPlusRecInfo& rec)
+{
+	OEmfPlusRecObjectReader::Status nStatus;
+	if (!m_bObjPending)
+	{
+		// The reader keeps the first record, as it is until the object completes
+		m_objStart = rec;
+		nStatus = m_objReader.Read(m_objStart);
+	}
+	else
+		nStatus = m_objReader.Read(rec);
+	if (nStatus == OEmfPlusRecObjectReader::StatusContinue)
+	{
+		m_bObjPending = m_objReader.TotalObjectSize <= MaxRecordSize;
+		if (!m_bObjPending)
+			m_objReader = OEmfPlusRecObjectReader();
+		return;
+	}
+	m_bObjPending = false;
+	if (nStatus != OEmfPlusRecObjectReader::StatusComplete)
+	{
+		m_objReader = OEmfPlusRecObjectReader();
+		return;
+	}
+	u8t nId = m_objReader.GetObjectID();
+	std::unique_ptr<OEmfPlusGraphObject> pObj(m_objReader.CreateObject());
+	if (!pObj)
+		m_objReader = OEmfPlusRecObjectReader();
+	if (nId < PlusObjectCount)
+	{
+		m_aPlusObjects[nId] = std::move(pObj);
+		m_aPlusImages[nId] = OImageRef();
+	}
+}
+
+bool OVectorPlayer::GetPlusPaint(const OEmfPlusBrush& brush, const OMatrix& mtx, OPaint& paint)
+{
+	paint = OPaint();
+	switch (brush.Type)
+	{
+	case OBrushType::SolidColor:
+		if (!brush.BrushDataSolid.is_enabled())
+			return false;
+		paint = _ColorPaint(brush.BrushDataSolid->SolidColor);
+		return true;
+	case OBrushType::HatchFill:
+		if (!brush.BrushDataHatch.is_enabled())
+			return false;
+		// The cells are aligned to device pixels, as GDI+ draws them
+		paint.nType = OPaintType::Hatch;
+		paint.clr = brush.BrushDataHatch->ForeColor;
+		paint.clrBack = brush.BrushDataHatch->BackColor;
+		paint.nHatchStyle = (u32t)brush.BrushDataHatch->HatchStyle;
+		paint.mtx = mtx.Inverse();
+		return true;
+	case OBrushType::LinearGradient:
+		{
+			if (!brush.BrushDataLinearGrad.is_enabled())
+				return false;
+			auto& grad = *brush.BrushDataLinearGrad;
+			auto& rc = grad.RectF;
+			// Along the width of the rectangle, turned and skewed by the brush transform
+			paint.nType = OPaintType::LinearGradient;
+			paint.ptStart = { rc.X, rc.Y };
+			paint.ptEnd = { rc.X + rc.Width, rc.Y };
+			if (grad.OptionalData.TransformMatrix.is_enabled())
+				paint.mtx = OMatrix::FromArray(*grad.OptionalData.TransformMatrix);
+			paint.nWrap = grad.WrapMode;
+			auto& blend = grad.OptionalData.BlendPattern;
+			if (blend.colors.is_enabled())
+			{
+				auto& colors = *blend.colors;
+				for (size_t ii = 0; ii < colors.BlendPositions.size() && ii < colors.BlendColors.size(); ++ii)
+					_AddStop(paint, colors.BlendPositions[ii], colors.BlendColors[ii]);
+			}
+			else if (blend.factorsH.is_enabled())
+			{
+				auto& factors = *blend.factorsH;
+				for (size_t ii = 0; ii < factors.BlendPositions.size() && ii < factors.BlendFactors.size(); ++ii)
+					_AddStop(paint, factors.BlendPositions[ii], _Lerp(grad.StartColor, grad.EndColor, factors.BlendFactors[ii]));
+			}
+			if (paint.vStops.empty())
+			{
+				_AddStop(paint, 0, grad.StartColor);
+				_AddStop(paint, 1, grad.EndColor);
+			}
+		}
+		return true;
+	case OBrushType::PathGradient:
+		{
+			if (!brush.BrushDataPathGrad.is_enabled())
+				return false;
+			auto& grad = *brush.BrushDataPathGrad;
+			// Played as the radial gradient of the ellipse in the bounds of the boundary
+			std::vector<OPoint> vBoundary;
+			if (grad.BoundaryDataPath.is_enabled())
+			{
+				auto& path = grad.BoundaryDataPath->BoundaryPathData;
+				vBoundary = _GetPoints(path.PathPoints, path.PointsAreRelative());
+			}
+			else if (grad.BoundaryDataPoint.is_enabled())
+			{
+				for (auto& pt : grad.BoundaryDataPoint->BoundaryPointData)
+					vBoundary.push_back({ pt.x, pt.y });
+			}
+			if (vBoundary.empty() || grad.SurroundingColor.empty())
+				return false;
+			double l = vBoundary[0].x, t = vBoundary[0].y, r = l, b = t;
+			for (auto& pt : vBoundary)
+			{
+				l = std::min(l, pt.x);
+				t = std::min(t, pt.y);
+				r = std::max(r, pt.x);
+				b = std::max(b, pt.y);
+			}
+			auto& ptCenter = grad.CenterPointF;
+			double rx = std::max(std::max(ptCenter.x - l, r - ptCenter.x), 1e-3);
+			double ry = std::max(std::max(ptCenter.y - t, b - ptCenter.y), 1e-3);
+			paint.nType = OPaintType::RadialGradient;
+			paint.mtx = { rx, 0, 0, ry, ptCenter.x, ptCenter.y };
+			if (grad.OptionalData.TransformMatrix.is_enabled())
+				paint.mtx = OMatrix::Multiply(paint.mtx, OMatrix::FromArray(*grad.OptionalData.TransformMatrix));
+			paint.nWrap = grad.WrapMode;
+			// Blend positions go from the boundary (0) to the center (1)
+			auto& clrOuter = grad.SurroundingColor[0];
+			auto& blend = grad.OptionalData.BlendPattern;
+			if (blend.colors.is_enabled())
+			{
+				auto& colors = *blend.colors;
+				size_t nCount = std::min(colors.BlendPositions.size(), colors.BlendColors.size());
+				for (size_t ii = nCount; ii-- > 0; )
+					_AddStop(paint, 1 - colors.BlendPositions[ii], colors.BlendColors[ii]);
+			}
+			else if (blend.factors.is_enabled())
+			{
+				auto& factors = *blend.factors;
+				size_t nCount = std::min(factors.BlendPositions.size(), factors.BlendFactors.size());
+				for (size_t ii = nCount; ii-- > 0; )
+					_AddStop(paint, 1 - factors.BlendPositions[ii], _Lerp(clrOuter, grad.CenterColor, factors.BlendFactors[ii]));
+			}
+			if (paint.vStops.empty())
+			{
+				_AddStop(paint, 0, grad.CenterColor);
+				_AddStop(paint, 1, clrOuter);
+			}
+		}
+		return true;
+	case OBrushType::TextureFill:
+		{
+			if (!brush.BrushDataTexture.is_enabled() || !brush.BrushDataTexture->OptionalData.ImageObject.is_enabled())
+				return false;
+			auto& opt = brush.BrushDataTexture->OptionalData;
+			OImageRef ref;
+			if (!GetPlusImage(*opt.ImageObject, ref))
+				return false;
+			paint.nType = OPaintType::Pattern;
+			paint.nImageId = ref.nId;
+			paint.rcImage = ref.rcSpace;
+			paint.bSymbol = ref.bSymbol;
+			if (opt.TransformMatrix.is_enabled())
+				paint.mtx = OMatrix::FromArray(*opt.TransformMatrix);
+		}
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool OVectorPlayer::GetPlusFill(u32t nBrushId, bool bColor, const OMatrix& mtx, OPaint& paint)
+{
+	if (bColor)
+	{
+		OEmfPlusARGB clr;
+		clr.argb = nBrushId;
+		paint = _ColorPaint(clr);
+		return true;
+	}
+	auto pBrush = GetPlusObject<OEmfPlusBrush>(nBrushId);
+	return pBrush && GetPlusPaint(*pBrush, mtx, paint);
+}
+
+bool OVectorPlayer::GetPlusStroke(u32t nPenId, const OMatrix& mtx, OStroke& stroke)
+{
+	auto pPen = GetPlusObject<OEmfPlusPen>(nPenId);
+	stroke = OStroke();
+	if (!pPen || !GetPlusPaint(pPen->BrushObject, mtx, stroke.paint))
+		return false;
+	auto& data = pPen->PenData;
+	stroke.fWidth = PlusToWorld(data.PenWidth, data.PenUnit);
+	if (!(stroke.fWidth > 0))
+	{
+		// Thinnest line the device draws
+		double fScale = mtx.GetScale();
+		stroke.fWidth = fScale > 0 ? 1 / fScale : 1;
+	}
+	auto& opt = data.OptionalData;
+	if (opt.StartCap.is_enabled() || opt.EndCap.is_enabled())
+	{
+		// One cap for both ends
+		switch (opt.StartCap.is_enabled() ? *opt.StartCap : *opt.EndCap)
+		{
+		case OLineCapType::Round:
+		case OLineCapType::Triangle:
+		case OLineCapType::RoundAnchor:
+			stroke.nCap = OLineCap::Round;
+			break;
+		case OLineCapType::Square:
+		case OLineCapType::SquareAnchor:
+			stroke.nCap = OLineCap::Square;
+			break;
+		default:
+			break;
+		}
+	}
+	if (opt.Join.is_enabled())
+	{
+		switch (*opt.Join)
+		{
+		case OLineJoinType::Bevel:	stroke.nJoin = OLineJoin::Bevel;	break;
+		case OLineJoinType::Round:	stroke.nJoin = OLineJoin::Round;	break;
+		default:														break;
+		}
+	}
+	if (opt.MiterLimit.is_enabled())
+		stroke.fMiterLimit = std::max<double>(*opt.MiterLimit, 1);
+	auto& vDashes = stroke.vDashes;
+	if (opt.LineStyle.is_enabled())
+	{
+		switch (*opt.LineStyle)
+		{
+		case OLineStyle::Dash:			vDashes = { 3, 1 };					break;
+		case OLineStyle::Dot:			vDashes = { 1, 1 };					break;
+		case OLineStyle::DashDot:		vDashes = { 3, 1, 1, 1 };			break;
+		case OLineStyle::DashDotDot:	vDashes = { 3, 1, 1, 1, 1, 1 };	break;
+		case OLineStyle::Custom:
+			if (opt.DashedLineData.is_enabled())
+				vDashes.assign(opt.DashedLineData->DashedLineData.begin(), opt.DashedLineData->DashedLineData.end());
+			break;
+		default:
+			break;
+		}
+	}
+	if (!vDashes.empty())
+	{
+		// In pen widths
+		for (auto& fDash : vDashes)
+			fDash = std::max(fDash, 0.0) * stroke.fWidth;
+		if (opt.DashOffset.is_enabled())
+			stroke.fDashOffset = *opt.DashOffset * stroke.fWidth;
+	}
+	return true;
+}
+
+void OVectorPlayer::PlusFill(const OPath& path, u32t nBrushId, bool bColor, bool bWinding)
+{
+	auto mtx = GetPlusMatrix();
+	OPaint paint;
+	if (!GetPlusFill(nBrushId, bColor, mtx, paint))
+	{
+		++Stats().nSkipped;
+		return;
+	}
+	DrawPath(path, &paint, !bWinding, nullptr, mtx);
+}
+
+void OVectorPlayer::PlusDraw(const OPath& path, u32t nPenId)
+{
+	auto mtx = GetPlusMatrix();
+	OStroke stroke;
+	if (!GetPlusStroke(nPenId, mtx, stroke))
+	{
+		++Stats().nSkipped;
+		return;
+	}
+	DrawPath(path, nullptr, false, &stroke, mtx);
+}
+
+bool OVectorPlayer::GetPlusRegion(OPath& path, const OEmfPlusRegionNode& node)
+{
+	switch (node.Type)
+	{
+	case ORegionNodeDataTypeRect:
+		if (node.rect.is_enabled())
+			path.AddRect(node.rect->X, node.rect->Y, node.rect->Width, node.rect->Height);
+		return true;
+	case ORegionNodeDataTypePath:
+		if (node.path.is_enabled())
+			_AddPlusPath(path, node.path->RegionNodePath);
+		return true;
+	case ORegionNodeDataTypeEmpty:
+		return true;
+	case ORegionNodeDataTypeInfinite:
+		return false;
+	default:
+		break;
+	}
+	if (!node.childNodes)
+		return true;
+	OPath left, right;
+	bool bLeft = GetPlusRegion(left, node.childNodes->Left);
+	bool bRight = GetPlusRegion(right, node.childNodes->Right);
+	switch (node.Type)
+	{
+	case ORegionNodeDataTypeOr:
+		// Overlapping parts add up with the nonzero rule, as long as they turn the same way
+		if (!bLeft || !bRight)
+			return false;
+		path.Append(left);
+		path.Append(right);
+		return true;
+	case ORegionNodeDataTypeAnd:
+		if (!bLeft || !bRight)
+		{
+			path.Append(bLeft ? left : right);
+			return bLeft || bRight;
+		}
+		break;
+	default:
+		break;
+	}
+	// Other combinations are taken as their first part
+	++Stats().nSkipped;
+	path.Append(left);
+	return bLeft;
+}
+
+void OVectorPlayer::PlusClip(const OPath& path, bool bEvenOdd, OCombineMode nMode)
+{
+	auto mtx = GetPlusMatrix();
+	switch (nMode)
+	{
+	case OCombineMode::Replace:
+		PushClip(path, mtx, bEvenOdd, true, m_plus.nClipBase);
+		break;
+	case OCombineMode::Intersect:
+		PushClip(path, mtx, bEvenOdd, false, m_plus.nClipBase);
+		break;
+	case OCombineMode::Exclude:
+		{
+			OPath outside;
+			_AddBoundsPath(outside, m_rcBounds, mtx);
+			outside.Append(path);
+			PushClip(outside, mtx, true, false, m_plus.nClipBase);
+		}
+		break;
+	default:
+		++Stats().nSkipped;
+		break;
+	}
+}
+
+void OVectorPlayer::PlusFont(const OEmfPlusFont& font, OTextRun& run) const
+{
+	run.vFamily = _GetFamily(font.FamilyName.c_str(), font.FamilyName.size());
+	run.fEmSize = PlusToWorld(font.EmSize, font.SizeUnit);
+	auto nFontStyle = font.FontStyleFlags;
+	run.nWeight = (nFontStyle & (i32t)OFontStyle::Bold) ? 700 : 400;
+	run.bItalic = nFontStyle & (i32t)OFontStyle::Italic;
+	run.bUnderline = nFontStyle & (i32t)OFontStyle::Underline;
+	run.bStrikeOut = nFontStyle & (i32t)OFontStyle::Strikeout;
+}
+
+void OVectorPlayer::PlusString(const OEmfPlusRecInfo& rec)
+{
+	u32t nLength = 0;
+	if (!_GetPlusU32(rec, 8, nLength) || 28 + (u64t)nLength * sizeof(u16t) > rec.DataSize)
+		return;
+	OEmfPlusRecDrawString data;
+	_ReadPlusRec(rec, data);
+	auto pFont = GetPlusObject<OEmfPlusFont>(rec.Flags & 0xFF);
+	auto pFormat = GetPlusObject<OEmfPlusStringFormat>(data.FormatID);
+	auto mtx = GetPlusMatrix();
+	OTextRun run;
+	if (!pFont || !GetPlusFill(data.BrushId, rec.Flags & PlusFlagS, mtx, run.paint))
+	{
+		++Stats().nSkipped;
+		return;
+	}
+	PlusFont(*pFont, run);
+	double fEm = run.fEmSize;
+
+	// Lines are broken at line feeds only, wrapping is left out
+	std::vector<std::vector<u16t>> vLines(1);
+	for (u32t ii = 0; ii < nLength && ii < data.StringData.size(); ++ii)
+	{
+		auto ch = (u16t)data.StringData[ii];
+		if (ch == L'\n')
+			vLines.emplace_back();
+		else if (ch != L'\r')
+			vLines.back().push_back(ch);
+	}
+	auto& rc = data.LayoutRect;
+	auto nAlign = pFormat ? pFormat->StringAlignment : OStringAlignment::Near;
+	auto nLineAlign = pFormat ? pFormat->LineAlign : OStringAlignment::Near;
+	double x = rc.X;
+	switch (nAlign)
+	{
+	case OStringAlignment::Center:	x += rc.Width / 2;	run.nAnchor = OTextAnchor::Middle;	break;
+	case OStringAlignment::Far:		x += rc.Width;		run.nAnchor = OTextAnchor::End;		break;
+	default:																				break;
+	}
+	double fLineHeight = TextLineHeight * fEm;
+	double fTextHeight = (vLines.size() - 1) * fLineHeight + (TextAscent + TextDescent) * fEm;
+	double y = rc.Y + TextAscent * fEm;
+	switch (nLineAlign)
+	{
+	case OStringAlignment::Center:	y += (rc.Height - fTextHeight) / 2;	break;
+	case OStringAlignment::Far:		y += rc.Height - fTextHeight;		break;
+	default:															break;
+	}
+	for (auto& vLine : vLines)
+	{
+		if (!vLine.empty())
+		{
+			run.vText = std::move(vLine);
+			run.vPos = { { x, y } };
+			m_device.DrawText(run, mtx);
+		}
+		y += fLineHeight;
+	}
+}
+
+void OVectorPlayer::PlusDriverString(const OEmfPlusRecInfo& rec)
+{
+	u32t nOptions = 0, nMatrix = 0, nCount = 0;
+	if (!_GetPlusU32(rec, 4, nOptions) || !_GetPlusU32(rec, 8, nMatrix) || !_GetPlusU32(rec, 12, nCount)
+		|| 16 + (u64t)nCount * (sizeof(u16t) + sizeof(OEmfPlusPointF)) + (nMatrix ? sizeof(OEmfPlusTransformMatrix) : 0) > rec.DataSize)
+		return;
+	// Without the lookup, the glyphs are font indices with nothing to map them back to text
+	if (!(nOptions & (u32t)ODriverStringOptions::CmapLookup) || !nCount)
+	{
+		++Stats().nSkipped;
+		return;
+	}
+	OEmfPlusRecDrawDriverString data;
+	_ReadPlusRec(rec, data);
+	auto pFont = GetPlusObject<OEmfPlusFont>(rec.Flags & 0xFF);
+	auto mtx = GetPlusMatrix();
+	if (data.MatrixPresent && data.TransformMatrix.is_enabled())
+		mtx = OMatrix::Multiply(OMatrix::FromArray(*data.TransformMatrix), mtx);
+	OTextRun run;
+	if (!pFont || !GetPlusFill(data.BrushId, rec.Flags & PlusFlagS, mtx, run.paint))
+	{
+		++Stats().nSkipped;
+		return;
+	}
+	PlusFont(*pFont, run);
+	run.vText.assign(data.Glyphs.begin(), data.Glyphs.end());
+	if (run.vText.empty())
+		return;
+	// With realized advances only the first position is given
+	bool bOneOrigin = nOptions & (u32t)ODriverStringOptions::RealizedAdvance;
+	for (size_t ii = 0; ii < data.GlyphPos.size(); ++ii)
+	{
+		if (ii && ii < run.vText.size() && _IsLowSurrogate(run.vText[ii]))
+			continue;
+		run.vPos.push_back({ data.GlyphPos[ii].x, data.GlyphPos[ii].y });
+		if (bOneOrigin)
+			break;
+	}
+	m_device.DrawText(run, mtx);
+}
+
+void OVectorPlayer::PlusImage(u32t nImageId, const ORect& rcSrc, OUnitType nSrcUnit, const OMatrix& mtxDst)
+{
+	auto pImage = GetPlusObject<OEmfPlusImage>(nImageId);
+	if (!pImage)
+	{
+		++Stats().nSkipped;
+		return;
+	}
+	auto& ref = m_aPlusImages[nImageId];
+	if (!ref.nId && !GetPlusImage(*pImage, ref))
+	{
+		ref = OImageRef();
+		++Stats().nSkipped;
+		return;
+	}
+	double fUnitX = _UnitToPixels(nSrcUnit, m_ptPlusDpi.x), fUnitY = _UnitToPixels(nSrcUnit, m_ptPlusDpi.y);
+	m_device.DrawImage(ref, { rcSrc.x * fUnitX, rcSrc.y * fUnitY, rcSrc.w * fUnitX, rcSrc.h * fUnitY }, mtxDst, 1);
+}
+
+void OVectorPlayer::PlusSave(u32t nStackIndex)
+{
+	m_vPlusSaves.push_back({ nStackIndex, m_plus, m_nClipLevel });
+	m_plus.nClipBase = m_nClipLevel;
+}
+
+void OVectorPlayer::PlusRestore(u32t nStackIndex)
+{
+	for (size_t ii = m_vPlusSaves.size(); ii-- > 0; )
+	{
+		if (m_vPlusSaves[ii].nStackIndex != nStackIndex)
+			continue;
+		PopClips(m_vPlusSaves[ii].nLevel);
+		m_plus = m_vPlusSaves[ii].state;
+		m_vPlusSaves.resize(ii);
+		return;
+	}
+}
+
+void OVectorPlayer::PlusTransform(const OMatrix& mtx, u16t nFlags)
+{
+	// Applied after the world transform with the A flag, before it otherwise
+	m_plus.world = (nFlags & PlusFlagW) ? OMatrix::Multiply(m_plus.world, mtx) : OMatrix::Multiply(mtx, m_plus.world);
+}
+
+void OVectorPlayer::OnPlusRecord(const OEmfPlusRecInfo& rec)
+{
+	u16t nFlags = rec.Flags;
+	u32t nObjectId = nFlags & 0xFF;
+	bool bColor = nFlags & PlusFlagS;
+	size_t nRectSize = _GetPlusRectSize(rec);
+	OPath path;
+	switch (rec.Type)
+	{
+	case EmfPlusRecordTypeObject:
+		OnPlusObject(rec);
+		break;
+	case EmfPlusRecordTypeClear:
+		if (auto p = _GetPlusRec<OEmfPlusRecClear>(rec))
+		{
+			path.AddRect(m_rcBounds.x, m_rcBounds.y, m_rcBounds.w, m_rcBounds.h);
+			auto paint = _ColorPaint(p->Color);
+			DrawPath(path, &paint, false, nullptr, OMatrix());
+		}
+		break;
+	case EmfPlusRecordTypeFillRects:
+	case EmfPlusRecordTypeDrawRects:
+		{
+			bool bFill = rec.Type == EmfPlusRecordTypeFillRects;
+			if (!_PlusRectsFit(rec, bFill ? 4 : 0))
+				break;
+			OEmfPlusRectDataArray rects;
+			u32t nBrushId = 0;
+			if (bFill)
+			{
+				OEmfPlusRecFillRects data;
+				_ReadPlusRec(rec, data);
+				nBrushId = data.BrushId;
+				rects = std::move(data.RectData);
+			}
+			else
+			{
+				OEmfPlusRecDrawRects data;
+				_ReadPlusRec(rec, data);
+				rects = std::move(data.RectData);
+			}
+			for (size_t ii = 0; ii < rects.fvals.size(); ++ii)
+				path.AddRect(rects.fvals[ii].X, rects.fvals[ii].Y, rects.fvals[ii].Width, rects.fvals[ii].Height);
+			for (size_t ii = 0; ii < rects.ivals.size(); ++ii)
+				path.AddRect(rects.ivals[ii].X, rects.ivals[ii].Y, rects.ivals[ii].Width, rects.ivals[ii].Height);
+			if (bFill)
+				PlusFill(path, nBrushId, bColor);
+			else
+				PlusDraw(path, nObjectId);
+		}
+		break;
+	case EmfPlusRecordTypeFillPolygon:
+		if (_PlusPointsFit(rec, 4))
+		{
+			OEmfPlusRecFillPolygon data;
+			_ReadPlusRec(rec, data);
+			auto pts = _GetPoints(data.PointData, nFlags & PlusFlagP);
+			path.AddPoly(pts.data(), pts.size(), true);
+			PlusFill(path, data.BrushId, bColor, nFlags & PlusFlagW);
+		}
+		break;
+	case EmfPlusRecordTypeDrawLines:
+		if (_PlusPointsFit(rec, 0))
+		{
+			OEmfPlusRecDrawLines data;
+			_ReadPlusRec(rec, data);
+			auto pts = _GetPoints(data.PointData, nFlags & PlusFlagP);
+			path.AddPoly(pts.data(), pts.size(), nFlags & OEmfPlusRecDrawLines::FlagL);
+			PlusDraw(path, nObjectId);
+		}
+		break;
+	case EmfPlusRecordTypeDrawBeziers:
+		if (_PlusPointsFit(rec, 0))
+		{
+			OEmfPlusRecDrawBeziers data;
+			_ReadPlusRec(rec, data);
+			auto pts = _GetPoints(data.PointData, nFlags & PlusFlagP);
+			if (pts.empty())
+				break;
+			path.AddPoly(pts.data(), 1, false);
+			path.AddPolyTo(pts.data() + 1, pts.size() - 1, true);
+			PlusDraw(path, nObjectId);
+		}
+		break;
+	case EmfPlusRecordTypeFillEllipse:
+	case EmfPlusRecordTypeDrawEllipse:
+		{
+			bool bFill = rec.Type == EmfPlusRecordTypeFillEllipse;
+			if ((bFill ? 4 : 0) + nRectSize > rec.DataSize)
+				break;
+			ORect rc;
+			u32t nBrushId = 0;
+			if (bFill)
+			{
+				OEmfPlusRecFillEllipse data;
+				_ReadPlusRec(rec, data);
+				nBrushId = data.BrushId;
+				rc = _GetRect(data.RectData);
+			}
+			else
+			{
+				OEmfPlusRecDrawEllipse data;
+				_ReadPlusRec(rec, data);
+				rc = _GetRect(data.RectData);
+			}
+			path.AddEllipse(rc.x + rc.w / 2, rc.y + rc.h / 2, rc.w / 2, rc.h / 2);
+			if (bFill)
+				PlusFill(path, nBrushId, bColor);
+			else
+				PlusDraw(path, nObjectId);
+		}
+		break;
+	case EmfPlusRecordTypeFillPie:
+	case EmfPlusRecordTypeDrawPie:
+	case EmfPlusRecordTypeDrawArc:
+		{
+			bool bFill = rec.Type == EmfPlusRecordTypeFillPie;
+			if ((bFill ? 4 : 0) + 8 + nRectSize > rec.DataSize)
+				break;
+			OEmfPlusArcData arc;
+			u32t nBrushId = 0;
+			if (bFill)
+			{
+				OEmfPlusRecFillPie data;
+				_ReadPlusRec(rec, data);
+				nBrushId = data.BrushId;
+				arc = std::move(data.ArcData);
+			}
+			else if (rec.Type == EmfPlusRecordTypeDrawPie)
+			{
+				OEmfPlusRecDrawPie data;
+				_ReadPlusRec(rec, data);
+				arc = std::move(data.ArcData);
+			}
+			else
+			{
+				OEmfPlusRecDrawArc data;
+				_ReadPlusRec(rec, data);
+				arc = std::move(data.ArcData);
+			}
+			auto rc = _GetRect(arc.RectData);
+			double cx = rc.x + rc.w / 2, cy = rc.y + rc.h / 2;
+			bool bPie = rec.Type != EmfPlusRecordTypeDrawArc;
+			if (bPie)
+				path.MoveTo(cx, cy);
+			path.AddArc(cx, cy, rc.w / 2, rc.h / 2, Deg2Rad(arc.StartAngle), Deg2Rad(arc.SweepAngle), bPie);
+			if (bPie)
+				path.Close();
+			if (bFill)
+				PlusFill(path, nBrushId, bColor);
+			else
+				PlusDraw(path, nObjectId);
+		}
+		break;
+	case EmfPlusRecordTypeFillClosedCurve:
+	case EmfPlusRecordTypeDrawClosedCurve:
+		{
+			bool bFill = rec.Type == EmfPlusRecordTypeFillClosedCurve;
+			if (!_PlusPointsFit(rec, bFill ? 8 : 4))
+				break;
+			std::vector<OPoint> pts;
+			double fTension;
+			u32t nBrushId = 0;
+			if (bFill)
+			{
+				OEmfPlusRecFillClosedCurve data;
+				_ReadPlusRec(rec, data);
+				nBrushId = data.BrushId;
+				fTension = data.Tension;
+				pts = _GetPoints(data.PointData, nFlags & PlusFlagP);
+			}
+			else
+			{
+				OEmfPlusRecDrawClosedCurve data;
+				_ReadPlusRec(rec, data);
+				fTension = data.Tension;
+				pts = _GetPoints(data.PointData, nFlags & PlusFlagP);
+			}
+			path.AddCardinal(pts, fTension, true);
+			if (bFill)
+				PlusFill(path, nBrushId, bColor, nFlags & PlusFlagW);
+			else
+				PlusDraw(path, nObjectId);
+		}
+		break;
+	case EmfPlusRecordTypeDrawCurve:
+		if (_PlusPointsFit(rec, 12, false))
+		{
+			OEmfPlusRecDrawCurve data;
+			_ReadPlusRec(rec, data);
+			auto pts = _GetPoints(data.PointData, false);
+			path.AddCardinal(pts, data.Tension, false, data.Offset, data.NumSegments);
+			PlusDraw(path, nObjectId);
+		}
+		break;
+	case EmfPlusRecordTypeFillPath:
+	case EmfPlusRecordTypeDrawPath:
+		if (auto p = _GetPlusRec<u32t>(rec))
+		{
+			auto pPath = GetPlusObject<OEmfPlusPath>(nObjectId);
+			if (!pPath)
+			{
+				++Stats().nSkipped;
+				break;
+			}
+			_AddPlusPath(path, *pPath);
+			if (rec.Type == EmfPlusRecordTypeFillPath)
+				PlusFill(path, *p, bColor, pPath->IsWindingFillMode());
+			else
+				PlusDraw(path, *p);
+		}
+		break;
+	case EmfPlusRecordTypeFillRegion:
+		if (auto p = _GetPlusRec<OEmfPlusRecFillRegion>(rec))
+		{
+			auto pRegion = GetPlusObject<OEmfPlusRegion>(nObjectId);
+			if (!pRegion)
+			{
+				++Stats().nSkipped;
+				break;
+			}
+			if (GetPlusRegion(path, pRegion->RegionNode))
+				PlusFill(path, p->BrushId, bColor);
+			else
+			{
+				// Infinite, the whole device
+				OPaint paint;
+				path.AddRect(m_rcBounds.x, m_rcBounds.y, m_rcBounds.w, m_rcBounds.h);
+				if (GetPlusFill(p->BrushId, bColor, OMatrix(), paint))
+					DrawPath(path, &paint, false, nullptr, OMatrix());
+			}
+		}
+		break;
+	case EmfPlusRecordTypeDrawImage:
+		if (8 + sizeof(OEmfPlusRectF) + nRectSize <= rec.DataSize)
+		{
+			OEmfPlusRecDrawImage data;
+			_ReadPlusRec(rec, data);
+			auto rc = _GetRect(data.RectData);
+			auto mtxDst = OMatrix::Multiply(OMatrix::FromSides({ rc.x, rc.y }, { rc.w, 0 }, { 0, rc.h }), GetPlusMatrix());
+			auto& src = data.SrcRect;
+			PlusImage(nObjectId, { src.X, src.Y, src.Width, src.Height }, data.SrcUnit, mtxDst);
+		}
+		break;
+	case EmfPlusRecordTypeDrawImagePoints:
+		{
+			u32t nCount = 0;
+			if (!_GetPlusU32(rec, 24, nCount) || nCount != 3 || !_PlusPointsFit(rec, 24))
+				break;
+			OEmfPlusRecDrawImagePoints data;
+			_ReadPlusRec(rec, data);
+			auto pts = _GetPoints(data.PointData, nFlags & PlusFlagP);
+			if (pts.size() != 3)
+				break;
+			// Upper-left, upper-right and lower-left corners of the destination
+			auto mtxDst = OMatrix::Multiply(OMatrix::FromSides(pts[0], { pts[1].x - pts[0].x, pts[1].y - pts[0].y },
+				{ pts[2].x - pts[0].x, pts[2].y - pts[0].y }), GetPlusMatrix());
+			auto& src = data.SrcRect;
+			PlusImage(nObjectId, { src.X, src.Y, src.Width, src.Height }, data.SrcUnit, mtxDst);
+		}
+		break;
+	case EmfPlusRecordTypeDrawString:
+		PlusString(rec);
+		break;
+	case EmfPlusRecordTypeDrawDriverString:
+		PlusDriverString(rec);
+		break;
+	case EmfPlusRecordTypeStrokeFillPath:
+		++Stats().nSkipped;
+		break;
+
+	// State
+	case EmfPlusRecordTypeSave:
+		if (auto p = _GetPlusRec<OEmfPlusRecSave>(rec))
+			PlusSave(p->StackIndex);
+		break;
+	case EmfPlusRecordTypeRestore:
+		if (auto p = _GetPlusRec<OEmfPlusRecRestore>(rec))
+			PlusRestore(p->StackIndex);
+		break;
+	case EmfPlusRecordTypeBeginContainer:
+		if (auto p = _GetPlusRec<OEmfPlusRecBeginContainer>(rec))
+		{
+			auto mtxParent = GetPlusMatrix();
+			PlusSave(p->StackIndex);
+			// The source rectangle, in the unit of the container, maps to the destination
+			auto nUnit = OEmfPlusRecBeginContainer::GetUnitType(nFlags);
+			auto& rcSrc = p->SrcRect;
+			auto& rcDst = p->DestRect;
+			double fUnitX = _UnitToPixels(nUnit, m_ptPlusDpi.x), fUnitY = _UnitToPixels(nUnit, m_ptPlusDpi.y);
+			double sx = rcSrc.Width ? rcDst.Width / (rcSrc.Width * fUnitX) : 1;
+			double sy = rcSrc.Height ? rcDst.Height / (rcSrc.Height * fUnitY) : 1;
+			OMatrix mtxContainer{ sx, 0, 0, sy, rcDst.X - rcSrc.X * fUnitX * sx, rcDst.Y - rcSrc.Y * fUnitY * sy };
+			m_plus.world = OMatrix();
+			m_plus.nPageUnit = nUnit;
+			m_plus.fPageScale = 1;
+			m_plus.base = OMatrix::Multiply(mtxContainer, mtxParent);
+		}
+		break;
+	case EmfPlusRecordTypeBeginContainerNoParams:
+		if (auto p = _GetPlusRec<OEmfPlusRecBeginContainerNoParams>(rec))
+		{
+			auto mtxParent = GetPlusMatrix();
+			PlusSave(p->StackIndex);
+			// Same drawing, with the world transform of the container starting over
+			double fUnitX = _UnitToPixels(m_plus.nPageUnit, m_ptPlusDpi.x) * m_plus.fPageScale;
+			double fUnitY = _UnitToPixels(m_plus.nPageUnit, m_ptPlusDpi.y) * m_plus.fPageScale;
+			m_plus.world = OMatrix();
+			m_plus.base = OMatrix::Multiply(OMatrix::Scale(fUnitX, fUnitY).Inverse(), mtxParent);
+		}
+		break;
+	case EmfPlusRecordTypeEndContainer:
+		if (auto p = _GetPlusRec<OEmfPlusRecEndContainer>(rec))
+			PlusRestore(p->StackIndex);
+		break;
+	case EmfPlusRecordTypeSetWorldTransform:
+		if (auto p = _GetPlusRec<OEmfPlusRecSetWorldTransform>(rec))
+			m_plus.world = OMatrix::FromArray(p->MatrixData);
+		break;
+	case EmfPlusRecordTypeResetWorldTransform:
+		m_plus.world = OMatrix();
+		break;
+	case EmfPlusRecordTypeMultiplyWorldTransform:
+		if (auto p = _GetPlusRec<OEmfPlusRecMultiplyWorldTransform>(rec))
+			PlusTransform(OMatrix::FromArray(p->MatrixData), nFlags);
+		break;
+	case EmfPlusRecordTypeTranslateWorldTransform:
+		if (auto p = _GetPlusRec<OEmfPlusRecTranslateWorldTransform>(rec))
+			PlusTransform(OMatrix::Translate(p->dx, p->dy), nFlags);
+		break;
+	case EmfPlusRecordTypeScaleWorldTransform:
+		if (auto p = _GetPlusRec<OEmfPlusRecScaleWorldTransform>(rec))
+			PlusTransform(OMatrix::Scale(p->Sx, p->Sy), nFlags);
+		break;
+	case EmfPlusRecordTypeRotateWorldTransform:
+		if (auto p = _GetPlusRec<OEmfPlusRecRotateWorldTransform>(rec))
+		{
+			double fAngle = Deg2Rad(p->Angle);
+			PlusTransform({ std::cos(fAngle), std::sin(fAngle), -std::sin(fAngle), std::cos(fAngle), 0, 0 }, nFlags);
+		}
+		break;
+	case EmfPlusRecordTypeSetPageTransform:
+		if (auto p = _GetPlusRec<OEmfPlusRecSetPageTransform>(rec))
+		{
+			m_plus.nPageUnit = OEmfPlusRecSetPageTransform::GetUnitType(nFlags);
+			m_plus.fPageScale = p->PageScale;
+		}
+		break;
+
+	// Clipping
+	case EmfPlusRecordTypeResetClip:
+		PopClips(m_plus.nClipBase);
+		break;
+	case EmfPlusRecordTypeSetClipRect:
+		if (auto p = _GetPlusRec<OEmfPlusRecSetClipRect>(rec))
+		{
+			auto& rc = p->ClipRect;
+			path.AddRect(rc.X, rc.Y, rc.Width, rc.Height);
+			PlusClip(path, false, OEmfPlusRecSetClipRect::GetCombineMode(nFlags));
+		}
+		break;
+	case EmfPlusRecordTypeSetClipPath:
+		if (auto pPath = GetPlusObject<OEmfPlusPath>(OEmfPlusRecSetClipPath::GetObjectID(nFlags)))
+		{
+			_AddPlusPath(path, *pPath);
+			PlusClip(path, !pPath->IsWindingFillMode(), OEmfPlusRecSetClipPath::GetCombineMode(nFlags));
+		}
+		break;
+	case EmfPlusRecordTypeSetClipRegion:
+		if (auto pRegion = GetPlusObject<OEmfPlusRegion>(OEmfPlusRecSetClipRegion::GetObjectID(nFlags)))
+		{
+			auto nMode = OEmfPlusRecSetClipRegion::GetCombineMode(nFlags);
+			if (GetPlusRegion(path, pRegion->RegionNode))
+				PlusClip(path, false, nMode);
+			else if (nMode == OCombineMode::Replace)
+				PopClips(m_plus.nClipBase);
+		}
+		break;
+	case EmfPlusRecordTypeOffsetClip:
+		++Stats().nSkipped;
+		break;
+	default:
+		break;
+	}
+}
+
+bool PlayMetafile(const Source& source, OVectorDevice& device)
+{
+	OVectorPlayer player(device, 0);
+	return player.Play(source);
+}
+
+}
+
+#pragma pop_macro("min")
+#pragma pop_macro("max")
+
+#endif // _ENABLE_GDIPLUS_STRUCT
@@ -0,0 +1,405 @@
+#ifndef EMF_VECTOR_H
+#define EMF_VECTOR_H
+
+#ifdef _ENABLE_GDIPLUS_STRUCT
+
+#include "EmfPlusStruct.h"
+#include <cmath>
+#include <functional>
+#include <vector>
+
+// Playback of an EMF, and of the EMF+ records it carries, on a vector
+// output device (SVG, PDF).
+//
+// The records are read one at a time and turned into drawing calls as they
+// come, tracking only the state the drawing depends on (object tables,
+// transforms, pen, brush and text settings); the memory used doesn't grow
+// with the document, only with its largest record.
+// - Saves (SaveDC, EMF+ Save) and EMF+ containers nest the clips, which the
+//   device gets as PushClip/PopClip pairs.
+// - Pens and brushes become structured paints and strokes; gradients,
+//   hatches and pattern brushes are left to the device to write.
+// - Images are handed to the device keyed by a hash of their content, to be
+//   written once; embedded EMF+ metafile images are played between
+//   BeginSymbol and EndSymbol, once as well.
+// GDI records are left out once an EMF+ header is seen, but for those
+// following an EMF+ GetDC, as GDI+ plays them.
+// Not played (counted in OVectorStats::nSkipped): raster operations other
+// than copying, masked, parallelogram and transparent blits, gradient fills,
+// text given as glyph indices, palette DIBs, WMF images, and region
+// combinations other than unions and intersections. Text layout is left to
+// the device, without wrapping; top and bottom aligned text is placed from
+// an estimated ascent and descent, and path gradients are played as radial
+// ones. A clip set before a save can't be replaced inside it, as clips only
+// narrow down the nesting.
+namespace emfvector
+{
+	using namespace emfplus;
+
+	// Reads up to nSize bytes, returns how many were read (fewer at the end)
+	using Source = std::function<size_t(void* pData, size_t nSize)>;
+	using Sink = std::function<bool(const void* pData, size_t nSize)>;
+	// Decodes nRows rows of premultiplied BGRA pixels from nTop to pRows
+	using RowSource = std::function<bool(u32t nTop, u32t nRows, u8t* pRows)>;
+
+	// Source of the data in memory, which must outlive it
+	Source MemorySource(const u8t* pData, size_t nSize);
+
+	enum : size_t {
+		// Of metafiles embedded in metafiles
+		MaxNesting		= 8,
+	};
+
+	struct OVectorStats
+	{
+		size_t	nRecords	= 0;	// EMF records, and EMF+ records in them
+		size_t	nElements	= 0;	// shapes, text and images written
+		size_t	nDefs		= 0;	// styles, paints, images and symbols written
+		size_t	nReused		= 0;	// references to one written before
+		size_t	nSkipped	= 0;	// drawing records not played
+		u64t	nWritten	= 0;	// bytes
+	};
+
+	struct OPoint
+	{
+		double	x;
+		double	y;
+	};
+
+	struct ORect
+	{
+		double	x;
+		double	y;
+		double	w;
+		double	h;
+	};
+
+	// Row vector convention, as XFORM and the EMF+ matrices:
+	// x' = x * m11 + y * m21 + dx, y' = x * m12 + y * m22 + dy
+	struct OMatrix
+	{
+		double	m11 = 1;
+		double	m12 = 0;
+		double	m21 = 0;
+		double	m22 = 1;
+		double	dx = 0;
+		double	dy = 0;
+
+		inline bool IsIdentity() const
+		{
+			return m11 == 1 && m12 == 0 && m21 == 0 && m22 == 1 && dx == 0 && dy == 0;
+		}
+
+		inline bool operator==(const OMatrix& other) const
+		{
+			return m11 == other.m11 && m12 == other.m12 && m21 == other.m21 && m22 == other.m22
+				&& dx == other.dx && dy == other.dy;
+		}
+
+		inline OPoint Map(double x, double y) const
+		{
+			return { x * m11 + y * m21 + dx, x * m12 + y * m22 + dy };
+		}
+
+		// Scale of lengths, the mean of both axes
+		inline double GetScale() const
+		{
+			return std::sqrt(std::fabs(m11 * m22 - m12 * m21));
+		}
+
+		OMatrix Inverse() const
+		{
+			double fDet = m11 * m22 - m12 * m21;
+			if (std::fabs(fDet) < 1e-12)
+				return {};
+			return { m22 / fDet, -m12 / fDet, -m21 / fDet, m11 / fDet,
+				(m21 * dy - m22 * dx) / fDet, (m12 * dx - m11 * dy) / fDet };
+		}
+
+		// a, then b
+		static OMatrix Multiply(const OMatrix& a, const OMatrix& b)
+		{
+			return { a.m11 * b.m11 + a.m12 * b.m21, a.m11 * b.m12 + a.m12 * b.m22,
+				a.m21 * b.m11 + a.m22 * b.m21, a.m21 * b.m12 + a.m22 * b.m22,
+				a.dx * b.m11 + a.dy * b.m21 + b.dx, a.dx * b.m12 + a.dy * b.m22 + b.dy };
+		}
+
+		static OMatrix FromArray(const Float* pVal)
+		{
+			return { pVal[OTM11], pVal[OTM12], pVal[OTM21], pVal[OTM22], pVal[OTMDX], pVal[OTMDY] };
+		}
+
+		static OMatrix FromXForm(const XFORM& xf)
+		{
+			return { xf.eM11, xf.eM12, xf.eM21, xf.eM22, xf.eDx, xf.eDy };
+		}
+
+		static OMatrix Scale(double sx, double sy)
+		{
+			return { sx, 0, 0, sy, 0, 0 };
+		}
+
+		static OMatrix Translate(double x, double y)
+		{
+			return { 1, 0, 0, 1, x, y };
+		}
+
+		// Maps the unit square to the parallelogram at pt, with the sides u and v
+		static OMatrix FromSides(const OPoint& pt, const OPoint& u, const OPoint& v)
+		{
+			return { u.x, u.y, v.x, v.y, pt.x, pt.y };
+		}
+	};
+
+	// Figures of lines and cubic Beziers
+	class OPath
+	{
+	public:
+		enum class Op : u8t
+		{
+			Move,		// 1 point
+			Line,		// 1 point
+			Bezier,		// 3 points, the control points first
+			Close,
+		};
+
+		inline bool IsEmpty() const { return m_vOps.empty(); }
+		inline size_t GetPointCount() const { return m_vPoints.size(); }
+		inline const std::vector<Op>& GetOps() const { return m_vOps; }
+		inline const std::vector<OPoint>& GetPoints() const { return m_vPoints; }
+
+		inline void Clear()
+		{
+			m_vOps.clear();
+			m_vPoints.clear();
+		}
+
+		inline void MoveTo(double x, double y)
+		{
+			m_vOps.push_back(Op::Move);
+			m_vPoints.push_back({ x, y });
+		}
+
+		inline void LineTo(double x, double y)
+		{
+			m_vOps.push_back(Op::Line);
+			m_vPoints.push_back({ x, y });
+		}
+
+		inline void BezierTo(const OPoint& ptCtrl1, const OPoint& ptCtrl2, const OPoint& pt)
+		{
+			m_vOps.push_back(Op::Bezier);
+			m_vPoints.insert(m_vPoints.end(), { ptCtrl1, ptCtrl2, pt });
+		}
+
+		inline void Close()
+		{
+			if (!m_vOps.empty() && m_vOps.back() != Op::Close)
+				m_vOps.push_back(Op::Close);
+		}
+
+		void Append(const OPath& path);
+
+		template <typename _Pt>
+		void AddPoly(const _Pt* pts, size_t nCount, bool bClose)
+		{
+			for (size_t ii = 0; ii < nCount; ++ii)
+			{
+				if (ii == 0)
+					MoveTo(pts[ii].x, pts[ii].y);
+				else
+					LineTo(pts[ii].x, pts[ii].y);
+			}
+			if (bClose && nCount)
+				Close();
+		}
+
+		// Points following the current one, as lines or cubic Beziers (3 points each)
+		template <typename _Pt>
+		void AddPolyTo(const _Pt* pts, size_t nCount, bool bBezier)
+		{
+			if (!bBezier)
+			{
+				for (size_t ii = 0; ii < nCount; ++ii)
+					LineTo(pts[ii].x, pts[ii].y);
+				return;
+			}
+			for (size_t ii = 0; ii + 2 < nCount; ii += 3)
+			{
+				BezierTo({ (double)pts[ii].x, (double)pts[ii].y }, { (double)pts[ii + 1].x, (double)pts[ii + 1].y },
+					{ (double)pts[ii + 2].x, (double)pts[ii + 2].y });
+			}
+		}
+
+		void AddRect(double x, double y, double w, double h);
+		void AddEllipse(double cx, double cy, double rx, double ry);
+		void AddRoundRect(double l, double t, double r, double b, double rx, double ry);
+		// Arc of the ellipse from fStart sweeping fSweep (radians, clockwise when
+		// positive as y goes down), with a line from the current point to its
+		// start if bConnect, as a new figure otherwise. Returns its last point.
+		OPoint AddArc(double cx, double cy, double rx, double ry, double fStart, double fSweep, bool bConnect);
+		// Cardinal spline through the points, the segments from nOffset on (GDI+ DrawCurve)
+		void AddCardinal(const std::vector<OPoint>& pts, double fTension, bool bClosed,
+			size_t nOffset = 0, size_t nSegments = SIZE_MAX);
+
+		// The path with its points mapped by mtx
+		OPath Transform(const OMatrix& mtx) const;
+	private:
+		std::vector<Op>		m_vOps;
+		std::vector<OPoint>	m_vPoints;
+	};
+
+	enum class OPaintType
+	{
+		None,
+		Color,
+		LinearGradient,	// from ptStart to ptEnd, mapped by mtx
+		RadialGradient,	// of the unit circle at the origin, mapped by mtx
+		Hatch,			// cells of HatchSize, mapped by mtx
+		Pattern,		// tiles of the image, mapped by mtx
+	};
+
+	struct OGradientStop
+	{
+		double			fOffset;
+		OEmfPlusARGB	clr;
+	};
+
+	struct OPaint
+	{
+		OPaintType					nType = OPaintType::None;
+		OEmfPlusARGB				clr{};		// Color, the foreground of Hatch
+		OEmfPlusARGB				clrBack{};	// Hatch, transparent for none
+		u32t						nHatchStyle = 0;	// OHatchStyle
+		OPoint						ptStart{ 0, 0 };
+		OPoint						ptEnd{ 1, 0 };
+		std::vector<OGradientStop>	vStops;		// at increasing offsets
+		OWrapMode					nWrap = OWrapMode::Clamp;
+		u32t						nImageId = 0;	// Pattern, of the device
+		ORect						rcImage{};		// Pattern, the space of the image
+		bool						bSymbol = false;
+		OMatrix						mtx;		// to the space of the shape
+
+		bool operator==(const OPaint& other) const;
+		inline bool operator!=(const OPaint& other) const { return !(*this == other); }
+	};
+
+	// Cell of the hatch patterns, in device pixels
+	constexpr double HatchSize = 8;
+
+	enum class OLineCap
+	{
+		Flat,
+		Round,
+		Square,
+	};
+
+	enum class OLineJoin
+	{
+		Miter,
+		Round,
+		Bevel,
+	};
+
+	struct OStroke
+	{
+		OPaint				paint;
+		double				fWidth = 1;
+		OLineCap			nCap = OLineCap::Flat;
+		OLineJoin			nJoin = OLineJoin::Miter;
+		double				fMiterLimit = 4;
+		std::vector<double>	vDashes;	// lengths, empty for solid lines
+		double				fDashOffset = 0;
+
+		bool operator==(const OStroke& other) const;
+		inline bool operator!=(const OStroke& other) const { return !(*this == other); }
+	};
+
+	enum class OTextAnchor
+	{
+		Start,
+		Middle,
+		End,
+	};
+
+	// Text on a line from the origin, x to the right and y down
+	struct OTextRun
+	{
+		std::vector<u16t>	vText;		// UTF-16
+		// Of the characters (not the low surrogates); those past the last one
+		// given follow with their own advance, from the origin if none is
+		std::vector<OPoint>	vPos;
+		OTextAnchor			nAnchor = OTextAnchor::Start;	// with one position or none
+		std::vector<u16t>	vFamily;
+		double				fEmSize = 12;
+		i32t				nWeight = 400;
+		bool				bItalic = false;
+		bool				bUnderline = false;
+		bool				bStrikeOut = false;
+		OPaint				paint;
+	};
+
+	// Image or metafile written by the device
+	struct OImageRef
+	{
+		u32t	nId = 0;
+		ORect	rcSpace{};		// pixels of an image, bounds of a metafile
+		bool	bSymbol = false;
+	};
+
+	// Output of the playback. The drawing is in the device pixels of the
+	// metafile, y going down.
+	class OVectorDevice
+	{
+	public:
+		virtual ~OVectorDevice() = default;
+
+		inline OVectorStats& Stats() { return m_stats; }
+		inline const OVectorStats& GetStats() const { return m_stats; }
+
+		// Once the output fails, the playback stops
+		virtual bool IsFailed() const = 0;
+
+		// rcBounds is the space of the drawing, and the page
+		virtual void BeginDocument(const ORect& rcBounds, const OPoint& ptPixelsPerMm) = 0;
+		virtual void EndDocument() = 0;
+
+		// Fills, then strokes the path, mapped by mtx; either may be null
+		virtual void DrawPath(const OPath& path, const OPaint* pFill, bool bEvenOdd, const OStroke* pStroke,
+			const OMatrix& mtx) = 0;
+		virtual void DrawText(const OTextRun& run, const OMatrix& mtx) = 0;
+		// Draws rcSrc of the image, in the space of ref.rcSpace, over the unit
+		// square mapped by mtxDst
+		virtual void DrawImage(const OImageRef& ref, const ORect& rcSrc, const OMatrix& mtxDst, double fOpacity) = 0;
+		// Clips what's drawn until the matching PopClip
+		virtual void PushClip(const OPath& path, bool bEvenOdd, const OMatrix& mtx) = 0;
+		virtual void PopClip() = 0;
+
+		// Images, keyed by a hash of their content. The player fills in the
+		// space of ref, the device its id. Adding fails for those the device
+		// can't write.
+		virtual bool FindImage(u64t nKey, OImageRef& ref) = 0;
+		// As found in the records (PNG, JPEG...)
+		virtual bool AddImageFile(u64t nKey, const u8t* pData, size_t nSize, u32t nWidth, u32t nHeight,
+			OImageRef& ref) = 0;
+		virtual bool AddImagePixels(u64t nKey, u32t nWidth, u32t nHeight, bool bAlpha, const RowSource& fnRows,
+			OImageRef& ref) = 0;
+		// What's drawn until EndSymbol is the metafile image, in the space of
+		// rcBounds. EndSymbol follows only when it succeeds.
+		virtual bool BeginSymbol(u64t nKey, const ORect& rcBounds, OImageRef& ref) = 0;
+		virtual void EndSymbol() = 0;
+	protected:
+		OVectorStats	m_stats;
+	};
+
+	// Device bounds of the EMF at pData, false if it isn't one
+	bool GetMetafileBounds(const u8t* pData, size_t nSize, ORect& rcBounds, OPoint* pPixelsPerMm = nullptr);
+
+	// Plays the EMF read from the source on the device. Fails on anything
+	// but an EMF, on truncated records and when the device fails.
+	bool PlayMetafile(const Source& source, OVectorDevice& device);
+}
+
+#endif // _ENABLE_GDIPLUS_STRUCT
+
+#endif // EMF_VECTOR_H
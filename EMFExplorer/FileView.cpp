@@ -406,6 +406,11 @@ void CFileView::LoadEMFDataEvent(bool bBefore)
 	m_wndRecList.LoadEMFDataEvent(bBefore);
 }
 
+int CFileView::UpdateRecordCount()
+{
+	return m_wndRecList.UpdateRecordCount();
+}
+
 int CFileView::GetCurSelRecIndex(BOOL bHottrack) const
 {
 	return m_wndRecList.GetCurSelRecIndex(bHottrack);
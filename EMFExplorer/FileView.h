@@ -61,6 +61,9 @@ public:
 
 	void LoadEMFDataEvent(bool bBefore);
 
+	// Returns the previous number of rows
+	int UpdateRecordCount();
+
 	int GetCurSelRecIndex(BOOL bHottrack = FALSE) const;
 
 	void SetCurSelRecIndex(int index);
@@ -36,6 +36,7 @@ BEGIN_MESSAGE_MAP(CMainFrame, CFrameWndEx)
 	ON_MESSAGE(MainFrameMsgCanOpenRecordItem, &CMainFrame::OnCanOpenRecordItem)
 	ON_MESSAGE(MainFrameMsgOpenRecordItem, &CMainFrame::OnOpenRecordItem)
 	ON_MESSAGE(MainFrameMsgViewUpdateSizeScroll, &CMainFrame::OnViewUpdateSizeScroll)
+	ON_MESSAGE(MainFrameMsgRecordsRead, &CMainFrame::OnRecordsRead)
 	ON_COMMAND(ID_EDIT_PASTE, &CMainFrame::OnEditPaste)
 	ON_UPDATE_COMMAND_UI(ID_EDIT_PASTE, &CMainFrame::OnUpdateEditPaste)
 	ON_UPDATE_COMMAND_UI(ID_STATUSBAR_PANE_COLOR_TEXT, &CMainFrame::OnUpdateStatusBarColorText)
@@ -45,6 +46,8 @@ BEGIN_MESSAGE_MAP(CMainFrame, CFrameWndEx)
 	ON_UPDATE_COMMAND_UI(ID_VIEW_DRAW_TO_HOVER_ITEM, &CMainFrame::OnUpdateViewDrawToHover)
 	ON_COMMAND(ID_VIEW_UPDATE_PROPERTIES_ON_HOVER, &CMainFrame::OnViewUpdatePropOnHover)
 	ON_UPDATE_COMMAND_UI(ID_VIEW_UPDATE_PROPERTIES_ON_HOVER, &CMainFrame::OnUpdateViewUpdatePropOnHover)
+	ON_COMMAND(ID_VIEW_RECORD_INDEX, &CMainFrame::OnViewRecordIndex)
+	ON_UPDATE_COMMAND_UI(ID_VIEW_RECORD_INDEX, &CMainFrame::OnUpdateViewRecordIndex)
 END_MESSAGE_MAP()
 
 
@@ -448,6 +451,16 @@ void CMainFrame::OnUpdateViewUpdatePropOnHover(CCmdUI* pCmdUI)
 	pCmdUI->SetCheck(m_bUpdatePropOnHover);
 }
 
+void CMainFrame::OnViewRecordIndex()
+{
+	theApp.m_bUseRecordIndex = !theApp.m_bUseRecordIndex;
+}
+
+void CMainFrame::OnUpdateViewRecordIndex(CCmdUI* pCmdUI)
+{
+	pCmdUI->SetCheck(theApp.m_bUseRecordIndex);
+}
+
 bool CMainFrame::UpdateViewOnSelRecord(int index, BOOL bHover)
 {
 	auto pView = CheckGetActiveView();
@@ -485,7 +498,21 @@ public:
 	EMFRecordVisualizer() = default;
 	virtual ~EMFRecordVisualizer() = default;
 public:
-	virtual void OpenVisualizer(CMainFrame* pFrame, EMFAccess* pEMF) {}
+	// strNestedPath is the one of the document of the record
+	virtual void OpenVisualizer(CMainFrame* pFrame, EMFAccess* pEMF, const std::wstring& strNestedPath) {}
+protected:
+	// Named after the record, the payload number is only added for the
+	// extra formats of a comment
+	static std::wstring GetNestedPath(const std::wstring& strParent, size_t nRecord, size_t nPayload = 0)
+	{
+		std::wstring strPath = strParent;
+		if (!strPath.empty())
+			strPath += L"/";
+		strPath += std::to_wstring(nRecord + 1);
+		if (nPayload)
+			strPath += L"." + std::to_wstring(nPayload + 1);
+		return strPath;
+	}
 };
 
 class EMFRecordMetafileVisualizer : public EMFRecordVisualizer
@@ -496,12 +523,13 @@ public:
 		m_pRecObj = pRec;
 	}
 public:
-	void OpenVisualizer(CMainFrame* pFrame, EMFAccess* pEMF) override;
+	void OpenVisualizer(CMainFrame* pFrame, EMFAccess* pEMF, const std::wstring& strNestedPath) override;
 protected:
 	EMFRecAccessGDIPlusRecObject* m_pRecObj;
 };
 
-void EMFRecordMetafileVisualizer::OpenVisualizer(CMainFrame* pFrame, EMFAccess* pEMF)
+void EMFRecordMetafileVisualizer::OpenVisualizer(CMainFrame* pFrame, EMFAccess* pEMF,
+	const std::wstring& strNestedPath)
 {
 	auto pWrapper = m_pRecObj->GetObjectWrapper();
 	if (!pWrapper->CacheGDIPlusObject(pEMF))
@@ -510,7 +538,37 @@ void EMFRecordMetafileVisualizer::OpenVisualizer(CMainFrame* pFrame, EMFAccess*
 		return;
 	}
 	CWaitCursor wait;
-	theApp.CreateNewFrameForSubEMF(pWrapper->GetEMFAccess());
+	auto emf = pWrapper->GetEMFAccess();
+	if (emf)
+		theApp.CreateNewFrameForSubEMF(emf, GetNestedPath(strNestedPath, m_pRecObj->GetIndex()).c_str());
+}
+
+class EMFRecordEmbeddedMetafileVisualizer : public EMFRecordVisualizer
+{
+public:
+	EMFRecordEmbeddedMetafileVisualizer(EMFRecAccessGDIRecGdiComment* pRec)
+	{
+		m_pRecComment = pRec;
+	}
+public:
+	void OpenVisualizer(CMainFrame* pFrame, EMFAccess* pEMF, const std::wstring& strNestedPath) override;
+protected:
+	EMFRecAccessGDIRecGdiComment* m_pRecComment;
+};
+
+void EMFRecordEmbeddedMetafileVisualizer::OpenVisualizer(CMainFrame* pFrame, EMFAccess* pEMF,
+	const std::wstring& strNestedPath)
+{
+	int nIndex = m_pRecComment->GetEmbeddedMetafileIndex();
+	if (nIndex < 0)
+	{
+		ASSERT(0);
+		return;
+	}
+	CWaitCursor wait;
+	auto emf = m_pRecComment->GetEmbeddedEMFAccess(nIndex);
+	if (emf)
+		theApp.CreateNewFrameForSubEMF(emf, GetNestedPath(strNestedPath, m_pRecComment->GetIndex(), nIndex).c_str());
 }
 
 using EMFRecordVisualizerOptional = std::pair<bool, std::shared_ptr<EMFRecordVisualizer>>;
@@ -541,6 +599,16 @@ static EMFRecordVisualizerOptional AccessEMRRecordVisualizer(EMFRecAccess* pRec,
 			}
 		}
 		break;
+	case emfplus::EmfRecordTypeGdiComment:
+		{
+			auto pRecComment = (EMFRecAccessGDIRecGdiComment*)pRec;
+			if (pRecComment->GetEmbeddedMetafileIndex() >= 0)
+			{
+				return std::make_pair(true, bCheckOnly ? nullptr :
+					std::make_shared<EMFRecordEmbeddedMetafileVisualizer>(pRecComment));
+			}
+		}
+		break;
 	case emfplus::EmfPlusRecordTypeDrawImage:
 	case emfplus::EmfPlusRecordTypeDrawImagePoints:
 		if (pRec->GetLinkedRecordCount())
@@ -574,10 +642,25 @@ LRESULT CMainFrame::OnOpenRecordItem(WPARAM wp, LPARAM /*lp*/)
 	auto vis = AccessEMRRecordVisualizer(pRec, false);
 	if (!vis.second)
 		return 0;
-	vis.second->OpenVisualizer(this, pEMF.get());
+	vis.second->OpenVisualizer(this, pEMF.get(), pDoc->GetNestedPath());
 	return 1;
 }
 
+LRESULT CMainFrame::OnRecordsRead(WPARAM /*wp*/, LPARAM lp)
+{
+	// The count is read again from the document, the message may be late or
+	// about the one before
+	if (!m_wndFileView.UpdateRecordCount() && m_wndFileView.GetCurSelRecIndex() < 0)
+		m_wndFileView.SetCurSelRecIndex(0);
+	else if (lp && m_wndProperties.IsWindowVisible())
+	{
+		// The properties of the selection may have been shown without what
+		// needs all the records (checksum)
+		UpdateViewOnSelRecord(m_wndFileView.GetCurSelRecIndex());
+	}
+	return 0;
+}
+
 LRESULT CMainFrame::OnViewUpdateSizeScroll(WPARAM /*wp*/, LPARAM /*lp*/)
 {
 	m_wndThumbnail.OnViewUpdateSizeScroll();
@@ -712,16 +795,22 @@ void CMainFrame::LoadEMFDataEvent(bool bBefore)
 	{
 		auto pDoc = pView->GetDocument();
 		auto emf = pDoc->GetEMFAccess();
-		emf->GetRecords();
+		// The list grows as the records are read, so large files show at once
+		HWND hWnd = GetSafeHwnd();
+		emf->StartGetRecords([hWnd](size_t nCount, bool bDone)
+			{
+				::PostMessage(hWnd, MainFrameMsgRecordsRead, (WPARAM)nCount, bDone);
+			});
 		m_wndFileView.SetEMFAccess(emf);
 		m_wndThumbnail.SetEMFAccess(emf);
-		if (emf->GetNestedPath().empty())
+		if (pDoc->GetNestedPath().empty())
 		{
 			switch (pDoc->GetEMFType())
 			{
 			case CEMFExplorerDoc::EMFType::FromFile:
 			case CEMFExplorerDoc::EMFType::FromClipboard:
-				emf->AddNestedPath(pDoc->GetTitle());
+				// The pages of a spool file are already named after it
+				pDoc->SetNestedPath(emf->GetNestedPath().empty() ? (LPCWSTR)pDoc->GetTitle() : emf->GetNestedPath().c_str());
 				break;
 			case CEMFExplorerDoc::EMFType::FromEMFRecord:
 				// Nothing is needed since it's already taken care of
@@ -121,6 +121,7 @@ protected:
 	afx_msg LRESULT OnCanOpenRecordItem(WPARAM wp, LPARAM lp);
 	afx_msg LRESULT OnOpenRecordItem(WPARAM wp, LPARAM lp);
 	afx_msg LRESULT OnViewUpdateSizeScroll(WPARAM wp, LPARAM lp);
+	afx_msg LRESULT OnRecordsRead(WPARAM wp, LPARAM lp);
 
 	afx_msg void OnUpdateStatusBarColorText(CCmdUI* pCmdUI);
 
@@ -130,6 +131,8 @@ protected:
 	afx_msg void OnUpdateViewDrawToHover(CCmdUI* pCmdUI);
 	afx_msg void OnViewUpdatePropOnHover();
 	afx_msg void OnUpdateViewUpdatePropOnHover(CCmdUI* pCmdUI);
+	afx_msg void OnViewRecordIndex();
+	afx_msg void OnUpdateViewRecordIndex(CCmdUI* pCmdUI);
 	DECLARE_MESSAGE_MAP()
 
 	BOOL CreateDockingWindows();
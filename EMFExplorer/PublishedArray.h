@@ -0,0 +1,106 @@
+#ifndef PUBLISHED_ARRAY_H
+#define PUBLISHED_ARRAY_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Append-only array written by one thread and read by any, without locks.
+// The elements are stored in chunks that never move; the writer appends
+// (Push), then makes what it appended visible (Publish). Readers only look
+// at the first GetCount() elements, the count being stored with release
+// and loaded with acquire, so those are fully written when seen.
+// The chunk directory grows by copy, the directories replaced are kept
+// until Clear() as readers may still be using them.
+template <typename T, size_t ChunkShift = 9>
+class PublishedArray
+{
+public:
+	enum : size_t {
+		ChunkSize = (size_t)1 << ChunkShift,
+		ChunkMask = ChunkSize - 1,
+	};
+
+	PublishedArray() = default;
+	~PublishedArray() { Clear(); }
+
+	PublishedArray(const PublishedArray&) = delete;
+	PublishedArray& operator=(const PublishedArray&) = delete;
+public:
+	// Elements that may be read, from any thread
+	inline size_t GetCount() const { return m_nPublished.load(std::memory_order_acquire); }
+
+	// Elements pushed, published or not. Writer only.
+	inline size_t GetWrittenCount() const { return m_nWritten; }
+
+	// index must be below GetCount(), or GetWrittenCount() for the writer
+	inline T& operator[](size_t index) const
+	{
+		return m_pDir.load(std::memory_order_acquire)[index >> ChunkShift][index & ChunkMask];
+	}
+
+	void Push(const T& val)
+	{
+		auto pDir = m_pDir.load(std::memory_order_relaxed);
+		size_t nChunk = m_nWritten >> ChunkShift;
+		if (!(m_nWritten & ChunkMask))
+		{
+			if (nChunk == m_nDirSize)
+				pDir = GrowDirectory();
+			pDir[nChunk] = new T[ChunkSize];
+		}
+		pDir[nChunk][m_nWritten & ChunkMask] = val;
+		++m_nWritten;
+	}
+
+	inline void Publish() { m_nPublished.store(m_nWritten, std::memory_order_release); }
+
+	size_t GetMemorySize() const
+	{
+		size_t nChunks = (m_nWritten + ChunkMask) >> ChunkShift;
+		return nChunks * ChunkSize * sizeof(T) + (m_nDirSize + m_nRetiredSize) * sizeof(T*);
+	}
+
+	// Not while the elements may be read
+	void Clear()
+	{
+		auto pDir = m_pDir.load(std::memory_order_relaxed);
+		size_t nChunks = (m_nWritten + ChunkMask) >> ChunkShift;
+		for (size_t ii = 0; ii < nChunks; ++ii)
+			delete[] pDir[ii];
+		delete[] pDir;
+		for (auto pOld : m_vRetired)
+			delete[] pOld;
+		m_vRetired.clear();
+		m_pDir.store(nullptr, std::memory_order_relaxed);
+		m_nDirSize = m_nRetiredSize = 0;
+		m_nWritten = 0;
+		m_nPublished.store(0, std::memory_order_relaxed);
+	}
+private:
+	T** GrowDirectory()
+	{
+		auto pOld = m_pDir.load(std::memory_order_relaxed);
+		size_t nSize = m_nDirSize ? m_nDirSize * 2 : 8;
+		auto pDir = new T*[nSize]();
+		for (size_t ii = 0; ii < m_nDirSize; ++ii)
+			pDir[ii] = pOld[ii];
+		if (pOld)
+		{
+			m_vRetired.push_back(pOld);
+			m_nRetiredSize += m_nDirSize;
+		}
+		m_nDirSize = nSize;
+		m_pDir.store(pDir, std::memory_order_release);
+		return pDir;
+	}
+private:
+	std::atomic<T**>	m_pDir = nullptr;
+	size_t				m_nDirSize = 0;
+	size_t				m_nWritten = 0;
+	std::atomic<size_t>	m_nPublished = 0;
+	std::vector<T**>	m_vRetired;
+	size_t				m_nRetiredSize = 0;
+};
+
+#endif // PUBLISHED_ARRAY_H
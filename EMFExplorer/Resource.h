@@ -86,13 +86,14 @@
 #define ID_VIEW_UPDATE_PROPERTIES_ON_HOVER 32816
 #define ID_EDIT_COPY_RECORD_LIST        32817
 #define ID_EDIT_FIND_RECORD_COMBO       32818
+#define ID_VIEW_RECORD_INDEX            32821
 
 // Next default values for new objects
 // 
 #ifdef APSTUDIO_INVOKED
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        313
-#define _APS_NEXT_COMMAND_VALUE         32821
+#define _APS_NEXT_COMMAND_VALUE         32822
 #define _APS_NEXT_CONTROL_VALUE         1001
 #define _APS_NEXT_SYMED_VALUE           310
 #endif
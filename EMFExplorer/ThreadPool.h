@@ -0,0 +1,93 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size worker pool. Tasks may submit further tasks; Wait() returns
+// once the queue is drained and every worker is idle.
+class ThreadPool
+{
+public:
+	using Task = std::function<void()>;
+
+	explicit ThreadPool(unsigned nThreads = 0)
+	{
+		if (!nThreads)
+			nThreads = std::thread::hardware_concurrency();
+		if (!nThreads)
+			nThreads = 1;
+		m_vWorkers.reserve(nThreads);
+		for (unsigned ii = 0; ii < nThreads; ++ii)
+			m_vWorkers.emplace_back(&ThreadPool::WorkerProc, this);
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mtx);
+			m_bStop = true;
+		}
+		m_cvTask.notify_all();
+		for (auto& worker : m_vWorkers)
+			worker.join();
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+public:
+	inline size_t GetThreadCount() const { return m_vWorkers.size(); }
+
+	void Submit(Task task)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mtx);
+			m_qTasks.push_back(std::move(task));
+		}
+		m_cvTask.notify_one();
+	}
+
+	void Wait()
+	{
+		std::unique_lock<std::mutex> lock(m_mtx);
+		m_cvIdle.wait(lock, [this] { return m_qTasks.empty() && !m_nBusy; });
+	}
+private:
+	void WorkerProc()
+	{
+		for (;;)
+		{
+			Task task;
+			{
+				std::unique_lock<std::mutex> lock(m_mtx);
+				m_cvTask.wait(lock, [this] { return m_bStop || !m_qTasks.empty(); });
+				if (m_qTasks.empty())
+					return;
+				task = std::move(m_qTasks.front());
+				m_qTasks.pop_front();
+				++m_nBusy;
+			}
+			task();
+			{
+				std::lock_guard<std::mutex> lock(m_mtx);
+				--m_nBusy;
+				if (!m_nBusy && m_qTasks.empty())
+					m_cvIdle.notify_all();
+			}
+		}
+	}
+private:
+	std::vector<std::thread>	m_vWorkers;
+	std::deque<Task>			m_qTasks;
+	std::mutex					m_mtx;
+	std::condition_variable		m_cvTask;
+	std::condition_variable		m_cvIdle;
+	size_t						m_nBusy = 0;
+	bool						m_bStop = false;
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,108 @@
+#include PCH_FNAME
+
+#include "WmfReader.h"
+#include <cstring>
+
+namespace wmf
+{
+
+static inline uint16_t _ReadU16(const uint8_t* p)
+{
+	uint16_t val;
+	memcpy(&val, p, sizeof(val));
+	return val;
+}
+
+static inline uint32_t _ReadU32(const uint8_t* p)
+{
+	uint32_t val;
+	memcpy(&val, p, sizeof(val));
+	return val;
+}
+
+static bool _IsValidHeader(const OWmfHeader& hdr)
+{
+	return (hdr.Type == 1 || hdr.Type == 2) && hdr.HeaderSize == sizeof(OWmfHeader) / 2;
+}
+
+bool IsWmfData(const void* pData, size_t nSize)
+{
+	auto p = (const uint8_t*)pData;
+	if (!p)
+		return false;
+	if (nSize >= sizeof(OWmfPlaceableHeader) && _ReadU32(p) == WmfPlaceableKey)
+	{
+		p += sizeof(OWmfPlaceableHeader);
+		nSize -= sizeof(OWmfPlaceableHeader);
+	}
+	if (nSize < sizeof(OWmfHeader))
+		return false;
+	OWmfHeader hdr;
+	memcpy(&hdr, p, sizeof(hdr));
+	return _IsValidHeader(hdr);
+}
+
+bool WmfReader::Open(const void* pData, size_t nSize)
+{
+	*this = WmfReader();
+	if (!IsWmfData(pData, nSize))
+		return false;
+	m_pData = (const uint8_t*)pData;
+	m_nSize = nSize;
+	if (_ReadU32(m_pData) == WmfPlaceableKey)
+	{
+		memcpy(&m_placeable, m_pData, sizeof(m_placeable));
+		m_bPlaceable = true;
+		m_nHeaderOffset = sizeof(OWmfPlaceableHeader);
+	}
+	memcpy(&m_header, m_pData + m_nHeaderOffset, sizeof(m_header));
+	Rewind();
+	return true;
+}
+
+bool WmfReader::IsPlaceableChecksumValid() const
+{
+	if (!m_bPlaceable)
+		return false;
+	uint16_t nChecksum = 0;
+	for (size_t ii = 0; ii < offsetof(OWmfPlaceableHeader, Checksum); ii += 2)
+		nChecksum ^= _ReadU16(m_pData + ii);
+	return nChecksum == m_placeable.Checksum;
+}
+
+void WmfReader::Rewind()
+{
+	m_nPos = m_nHeaderOffset + (size_t)m_header.HeaderSize * 2;
+	m_bEOF = false;
+	m_bTruncated = false;
+}
+
+bool WmfReader::Next(OWmfRecordRef& rec)
+{
+	if (!m_pData || m_bEOF || m_nPos >= m_nSize)
+		return false;
+	if (m_nSize - m_nPos < sizeof(OWmfRecordHeader))
+	{
+		m_bTruncated = true;
+		return false;
+	}
+	OWmfRecordHeader hdr;
+	memcpy(&hdr, m_pData + m_nPos, sizeof(hdr));
+	size_t nRecSize = (size_t)hdr.RecordSize * 2;
+	if (nRecSize < sizeof(OWmfRecordHeader) || nRecSize > m_nSize - m_nPos)
+	{
+		m_bTruncated = true;
+		return false;
+	}
+	rec.nOffset = m_nPos;
+	rec.nSize = nRecSize;
+	rec.Function = hdr.RecordFunction;
+	rec.pParams = m_pData + m_nPos + sizeof(OWmfRecordHeader);
+	rec.nParamSize = nRecSize - sizeof(OWmfRecordHeader);
+	if (rec.Function == WmfFuncEOF)
+		m_bEOF = true;
+	m_nPos += nRecSize;
+	return true;
+}
+
+}
@@ -0,0 +1,66 @@
+#ifndef WMF_READER_H
+#define WMF_READER_H
+
+#include <cstddef>
+#include "WmfStruct.h"
+
+namespace wmf
+{
+	// Functions (rdFunction) the reader has to know about
+	enum : uint16_t {
+		WmfFuncEOF						= 0x0000,
+	};
+
+	// Whether the data starts with META_PLACEABLE or META_HEADER
+	bool IsWmfData(const void* pData, size_t nSize);
+
+	struct OWmfRecordRef
+	{
+		size_t			nOffset;		// of the record in the data
+		size_t			nSize;			// whole record in bytes
+		uint16_t		Function;
+		// Parameters, as described by the structs of WmfStruct.h
+		const uint8_t*	pParams;
+		size_t			nParamSize;
+	};
+
+	// Reads a WMF file natively (MS-WMF), without GDI: the optional
+	// placeable header, META_HEADER, then the records one by one. The
+	// object table is left to the caller (EMFAccess links the records
+	// selecting and deleting objects to those creating them).
+	class WmfReader
+	{
+	public:
+		// The data must stay valid while the reader is in use
+		bool Open(const void* pData, size_t nSize);
+
+		inline bool IsPlaceable() const { return m_bPlaceable; }
+		inline const OWmfPlaceableHeader& GetPlaceableHeader() const { return m_placeable; }
+		bool IsPlaceableChecksumValid() const;
+
+		inline const OWmfHeader& GetHeader() const { return m_header; }
+		// Offset of META_HEADER (22 with a placeable header)
+		inline size_t GetHeaderOffset() const { return m_nHeaderOffset; }
+
+		// Next record, META_EOF included. Returns false at the end of the
+		// records, or when a record doesn't fit in the data.
+		bool Next(OWmfRecordRef& rec);
+
+		// Back to the first record
+		void Rewind();
+
+		inline bool IsTruncated() const { return m_bTruncated; }
+	private:
+		const uint8_t*		m_pData = nullptr;
+		size_t				m_nSize = 0;
+		bool				m_bPlaceable = false;
+		OWmfPlaceableHeader	m_placeable = {};
+		OWmfHeader			m_header = {};
+		size_t				m_nHeaderOffset = 0;
+		size_t				m_nPos = 0;
+		bool				m_bEOF = false;
+		bool				m_bTruncated = false;
+	};
+}
+
+#endif // WMF_READER_H
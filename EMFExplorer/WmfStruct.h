@@ -5,7 +5,8 @@
 // When Graphics::EnumerateMetafile() walks a WMF metafile, the callback
 // receives `data` pointing at the parameters of each record (i.e. just past
 // the 6-byte rdSize+rdFunction header), and `dataSize` as the size of those
-// parameters in bytes. Every struct here describes that parameter portion.
+// parameters in bytes. wmf::WmfReader hands out the same view of the records
+// it reads. Every struct here describes that parameter portion.
 //
 // Per [MS-WMF] 2.3.5.x and 2.3.4.x records were originally recorded by
 // pushing arguments on a stack, so multi-field params usually appear in
@@ -36,6 +37,46 @@ namespace wmf
 		int16_t Bottom;
 	};
 
+	// 2.3.2 Control Records --------------------------------------------------
+
+	// Unlike the parameter structs, these are read from the file itself
+	// (by WmfReader), GDI+ never hands them to the enumeration callback.
+
+	enum : uint32_t {
+		WmfPlaceableKey		= 0x9AC6CDD7,
+	};
+
+	// MS-WMF [2.3.2.3] META_PLACEABLE, optional, precedes META_HEADER
+	struct OWmfPlaceableHeader
+	{
+		uint32_t Key;
+		uint16_t HWmf;
+		WmfRectS BoundingBox;
+		uint16_t Inch;			// logical units per inch
+		uint32_t Reserved;
+		uint16_t Checksum;		// XOR of the previous 10 WORDs
+	};
+
+	// MS-WMF [2.3.2.2] META_HEADER, sizes are in WORDs
+	struct OWmfHeader
+	{
+		uint16_t Type;			// 1: memory, 2: disk
+		uint16_t HeaderSize;	// 9
+		uint16_t Version;		// 0x0100 or 0x0300
+		uint16_t SizeLow;
+		uint16_t SizeHigh;
+		uint16_t NumberOfObjects;
+		uint32_t MaxRecord;
+		uint16_t NumberOfMembers;
+	};
+
+	// Every record starts with this
+	struct OWmfRecordHeader
+	{
+		uint32_t RecordSize;	// in WORDs, the header included
+		uint16_t RecordFunction;
+	};
+
 	// 2.3.5 State Records ----------------------------------------------------
 
 	// Note: many of these records contain a trailing 2-byte Reserved field
@@ -306,6 +347,10 @@ namespace wmf
 
 #pragma pack(pop)
 
+	static_assert(sizeof(OWmfPlaceableHeader) == 22, "OWmfPlaceableHeader has incorrect size");
+	static_assert(sizeof(OWmfHeader) == 18, "OWmfHeader has incorrect size");
+	static_assert(sizeof(OWmfRecordHeader) == 6, "OWmfRecordHeader has incorrect size");
+
 } // namespace wmf
 
 #endif // WMF_STRUCT_H
@@ -41,6 +41,8 @@ enum MainFrameMsg
 	MainFrameMsgOpenRecordItem,
 	// wParam = Size changed (non-zero) or scroll only (zero)
 	MainFrameMsgViewUpdateSizeScroll,
+	// wParam = records read so far, lParam = Done (non-zero)
+	MainFrameMsgRecordsRead,
 };
 
 #ifndef _AFX_NO_OLE_SUPPORT